@@ -10,8 +10,8 @@
 
 #include "APE.h"
 #include "Config.h"
+#include "HostTable.h"
 #include "Interface.h"
-#include "LinkedListTargetSystems.h"
 #include "LinkedListFirewallRules.h"
 #include "Logging.h"
 #include "ModeDePoisoning.h"
@@ -35,10 +35,9 @@ extern char *optarg;
  * Global variables
  *
  */
-CRITICAL_SECTION csSystemsLL;
+PHOST_TABLE gTargetSystems = NULL;
 
 // Linked lists
-PSYSNODE gTargetSystemsList = NULL;
 PRULENODE gFwRulesList = NULL;
 
 int gDEBUGLEVEL = DEBUG_LEVEL;
@@ -66,7 +65,7 @@ int main(int argc, char **argv)
   }
 
   // Initialisation
-  if (!InitializeCriticalSectionAndSpinCount(&csSystemsLL, 0x00000400))
+  if ((gTargetSystems = HostTableCreate(HOST_TABLE_DEFAULT_CAPACITY)) == NULL)
   {
     retVal = 1;
     goto END;
@@ -77,7 +76,6 @@ int main(int argc, char **argv)
   strncpy(gScanParams.ApplicationName, argv[0], sizeof(gScanParams.ApplicationName));
   gARGV = argv;
 
-  gTargetSystemsList = InitSystemList();
   gFwRulesList = InitFirewallRules();
 
   // Parse command line parameters
@@ -149,7 +147,7 @@ int main(int argc, char **argv)
 
 END:
 
-  DeleteCriticalSection(&csSystemsLL);
+  HostTableDestroy(gTargetSystems);
   LogMsg(DBG_LOW, "main(): Stopping %s", argv[0]);
   StopLogging();
 
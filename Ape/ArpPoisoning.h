@@ -5,6 +5,7 @@
 
 DWORD ArpPoisoningLoop(PSCANPARAMS pScanParams);
 DWORD ArpDePoisoning(PSCANPARAMS pScanParams);
-BOOL SendArpPacket(void *interfaceHandleParam, PArpPacket arpPacketParam);
+BOOL SendArpPacket(void *transmitQueueParam, PArpPacket arpPacketParam);
+void ArpTransmitError(void *contextParam, unsigned int failedFramesParam, char *errorParam);
 BOOL SendArpPoison(PSCANPARAMS scanParamsParam, unsigned char victimMacBinParam[BIN_MAC_LEN], unsigned char victimIpBinParam[BIN_IP_LEN]);
 BOOL APE_ControlHandler(DWORD idParam);
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "APE.h"
+#include "HostTable.h"
 
 
 void PrintConfig(SCANPARAMS scanParamsParam);
-int ParseTargetHostsConfigFile(char *targetsFile);
+int ParseTargetHostsConfigFile(char *targetsFile, PHOST_TABLE hostTableParam);
+void PrintTargetSystems(PHOST_TABLE hostTableParam);
 int ParseDnsPoisoningConfigFile(char *pConfigFile);
@@ -10,7 +10,6 @@
 #include <stdarg.h>
 
 #include "APE.h"
-#include "LinkedListTargetSystems.h"
 #include "Logging.h"
 #include "NetworkHelperFunctions.h"
 
@@ -17,4 +17,16 @@
 BOOLEAN InitLogging();
 void StopLogging();
 void LogMsg(int priorityParam, char *logMessageParam, ...);
-void WriteToLogfile(char *logMessage);
\ No newline at end of file
+
+
+extern int gDEBUGLEVEL;
+
+/*
+ * Callers check this before they produce expensive log
+ * arguments (address strings, hostnames, ...)
+ *
+ */
+static __inline BOOL LogLevelEnabled(int priorityParam)
+{
+  return priorityParam >= gDEBUGLEVEL && gDEBUGLEVEL != DBG_OFF;
+}
@@ -10,7 +10,9 @@
 
 #include "APE.h"
 #include "ArpPoisoning.h"
-#include "LinkedListTargetSystems.h"
+#include "Config.h"
+#include "FileWatch.h"
+#include "HostTable.h"
 #include "LinkedListFirewallRules.h"
 #include "Logging.h"
 #include "ModeArpMitm.h"
@@ -19,7 +21,7 @@
 // External/global variables
 extern int gDEBUGLEVEL;
 extern RULENODE gFwRulesList;
-extern PSYSNODE gTargetSystemsList;
+extern PHOST_TABLE gTargetSystems;
 extern SCANPARAMS gScanParams;
 
 /*
@@ -38,7 +40,7 @@ extern SCANPARAMS gScanParams;
 void InitializeArpMitm()
 {
   AdminCheck(gScanParams.ApplicationName);
-  ParseTargetHostsConfigFile(FILE_HOST_TARGETS);
+  ParseTargetHostsConfigFile(FILE_HOST_TARGETS, gTargetSystems);
   RemoveMacFromCache((char *)gScanParams.InterfaceName, "*");
   Sleep(500);
   RemoveMacFromCache((char *)gScanParams.InterfaceName, "*");
@@ -61,9 +63,9 @@ void InitializeArpMitm()
     PrintConfig(gScanParams);
   }
 
-  // Add default GW to the gSystemsList
-  AddToSystemsList(&gTargetSystemsList, gScanParams.GatewayMacBin, (char *)gScanParams.GatewayIpStr, gScanParams.GatewayIpBin);  
-  PrintTargetSystems(gTargetSystemsList);
+  // Add default GW to the target systems
+  HostTableAdd(gTargetSystems, gScanParams.GatewayIpBin, gScanParams.GatewayMacBin, (char *)gScanParams.GatewayIpStr);
+  PrintTargetSystems(gTargetSystems);
   WriteDepoisoningFile();
 
   // Start targethosts observer file
@@ -208,28 +210,43 @@ BOOL InitTargethostObserverThread()
 }
 
 
+/*
+ * Reload .targethosts when it changes. The new records
+ * are parsed into a new table and replace the old ones
+ * in one step, the packet handlers keep looking up
+ * targets meanwhile.
+ *
+ */
 DWORD WINAPI TargethostsObserver(LPVOID params)
 {
-  struct _stat statbuf;
-  time_t mtime_previous;
-  int stat = _stat(FILE_HOST_TARGETS, &statbuf);
+  PFILE_WATCH fileWatch = NULL;
+  PHOST_TABLE newTargetSystems = NULL;
   int total_systems = 0;
 
+  if ((fileWatch = FileWatchCreate(FILE_HOST_TARGETS)) == NULL)
+  {
+    LogMsg(DBG_ERROR, "TargethostsObserver(): Can't watch .targethosts");
+    return 1;
+  }
+
   while (1 == 1)
   {
-    mtime_previous = statbuf.st_mtime;
-    stat = _stat(FILE_HOST_TARGETS, &statbuf);
+    if (FileWatchWait(fileWatch, FILE_WATCH_INFINITE) == FALSE)
+    {
+      continue;
+    }
+
+    LogMsg(DBG_INFO, "TargethostsObserver(): .targethosts changed. Reloading .targethost records.");
 
-    if (mtime_previous != statbuf.st_mtime)
+    if ((newTargetSystems = HostTableCreate(HostTableCount(gTargetSystems))) == NULL)
     {
-      total_systems = 0;
-      LogMsg(DBG_INFO, "TargethostsObserver(): .targethosts changed. Reloading .targethost records.");
-      ClearSystemList(&gTargetSystemsList);
-      total_systems = ParseTargetHostsConfigFile(FILE_HOST_TARGETS);
-      PrintTargetSystems(FILE_HOST_TARGETS);
-      LogMsg(DBG_INFO, "TargethostsObserver(): %d systems added to .targethosts.", total_systems);
+      LogMsg(DBG_ERROR, "TargethostsObserver(): Can't allocate the new target systems");
+      continue;
     }
 
-    Sleep(1000);
+    total_systems = ParseTargetHostsConfigFile(FILE_HOST_TARGETS, newTargetSystems);
+    HostTableReplace(gTargetSystems, newTargetSystems);
+    PrintTargetSystems(gTargetSystems);
+    LogMsg(DBG_INFO, "TargethostsObserver(): %d systems added to .targethosts.", total_systems);
   }
 }
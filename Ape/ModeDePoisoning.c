@@ -7,16 +7,17 @@
 
 #include "APE.h"
 #include "ArpPoisoning.h"
-#include "LinkedListTargetSystems.h"
+#include "HostTable.h"
 #include "Logging.h"
 #include "ModeDePoisoning.h"
 #include "NetworkHelperFunctions.h"
+#include "PacketCapture.h"
+#include "TransmitQueue.h"
 
 // External global variables
-extern CRITICAL_SECTION csSystemsLL;
 extern int gDEBUGLEVEL;
 extern SCANPARAMS gScanParams;
-extern PSYSNODE gTargetSystemsList;
+extern PHOST_TABLE gTargetSystems;
 extern char **gARGV;
 
 
@@ -59,26 +60,19 @@ void WriteDepoisoningFile(void)
 {
   int counter = 0;
   int numberSystems = 0;
-  SYSTEMNODE systemList[MAX_SYSTEMS_COUNT];
+  HOST_ENTRY systemList[MAX_SYSTEMS_COUNT];
   FILE *fileHandle = NULL;
   char tempBuffer[MAX_BUF_SIZE + 1];
   char srcMacStr[MAX_BUF_SIZE + 1];
-  PSYSNODE systemListPtr = NULL;
 
-  EnterCriticalSection(&csSystemsLL);
   // Get a copy of all systems found in the network.
-  for (systemListPtr = gTargetSystemsList;  systemListPtr != NULL; systemListPtr = systemListPtr->next)
+  numberSystems = HostTableCopy(gTargetSystems, systemList, MAX_SYSTEMS_COUNT);
+
+  for (counter = 0; counter < numberSystems; counter++)
   {
     ZeroMemory(srcMacStr, sizeof(srcMacStr));
-    MacBin2String(systemListPtr->data.sysMacBin, (unsigned char *)srcMacStr, sizeof(srcMacStr));
-
-    if (strnlen((char *)systemListPtr->data.sysIpStr, MAX_IP_LEN) > 0)
-    {
-      LogMsg(DBG_INFO, "WriteDepoisoningFile(): %s/%s", systemListPtr->data.sysIpStr, srcMacStr);
-      CopyMemory(systemList[numberSystems].sysIpStr, systemListPtr->data.sysIpStr, MAX_IP_LEN);
-      CopyMemory(systemList[numberSystems].sysMacBin, systemListPtr->data.sysMacBin, BIN_MAC_LEN);
-      numberSystems++;
-    }    
+    MacBin2String(systemList[counter].MacBin, (unsigned char *)srcMacStr, sizeof(srcMacStr));
+    LogMsg(DBG_INFO, "WriteDepoisoningFile(): %s/%s", systemList[counter].IpStr, srcMacStr);
   }
 
   // Depoison the victim systems
@@ -95,15 +89,15 @@ void WriteDepoisoningFile(void)
   
   for (counter = 0; counter < numberSystems && counter < MAX_SYSTEMS_COUNT; counter++)
   {
-    if (systemList[counter].sysIpStr != NULL && 
-        strnlen((char *)systemList[counter].sysIpStr, MAX_IP_LEN) > 0 &&
-        systemList[counter].sysMacBin != NULL)
+    if (systemList[counter].IpStr != NULL && 
+        strnlen((char *)systemList[counter].IpStr, MAX_IP_LEN) > 0 &&
+        systemList[counter].MacBin != NULL)
     {
       ZeroMemory(tempBuffer, sizeof(tempBuffer));
-      snprintf(tempBuffer, sizeof(tempBuffer) - 1, "%02hhX:%02hhX:%02hhX:%02hhX:%02hhX:%02hhX", systemList[counter].sysMacBin[0], systemList[counter].sysMacBin[1],
-        systemList[counter].sysMacBin[2], systemList[counter].sysMacBin[3], systemList[counter].sysMacBin[4], systemList[counter].sysMacBin[5]);
+      snprintf(tempBuffer, sizeof(tempBuffer) - 1, "%02hhX:%02hhX:%02hhX:%02hhX:%02hhX:%02hhX", systemList[counter].MacBin[0], systemList[counter].MacBin[1],
+        systemList[counter].MacBin[2], systemList[counter].MacBin[3], systemList[counter].MacBin[4], systemList[counter].MacBin[5]);
 
-      fprintf(fileHandle, "%s,%s\n", systemList[counter].sysIpStr, tempBuffer);
+      fprintf(fileHandle, "%s,%s\n", systemList[counter].IpStr, tempBuffer);
     }
   }
 
@@ -113,9 +107,6 @@ END:
   {
     fclose(fileHandle);
   }
-  
-  LeaveCriticalSection(&csSystemsLL);
-
 }
 
 
@@ -162,8 +153,9 @@ DWORD ArpDePoisoning(PSCANPARAMS scanParamsParam)
   int counter = 0;
   pcap_if_t *allDevices = NULL;
   pcap_if_t *device = NULL;
-  pcap_t *interfaceHandle = NULL;
-  char tempBuffer[PCAP_ERRBUF_SIZE];
+  PCAPTURE_HANDLE interfaceHandle = NULL;
+  PTRANSMIT_QUEUE transmitQueue = NULL;
+  char tempBuffer[CAPTURE_ERRBUF_SIZE];
   char adapter[MAX_BUF_SIZE + 1];
   int i = 0;
 
@@ -191,12 +183,20 @@ DWORD ArpDePoisoning(PSCANPARAMS scanParamsParam)
   }
 
   // Open interface.
-  if ((interfaceHandle = pcap_open(adapter, 65536, (int)NULL, PCAP_READTIMEOUT, NULL, tempBuffer)) == NULL)
+  if ((interfaceHandle = CaptureOpen(adapter, 65536, CAPTURE_FLAG_SEND_ONLY, PCAP_READTIMEOUT, tempBuffer)) == NULL)
+  {
+    retVal = -2;
+    goto END;
+  }
+
+  if ((transmitQueue = TransmitQueueCreate(interfaceHandle, TRANSMIT_QUEUE_MAX_FRAMES, 0)) == NULL)
   {
     retVal = -2;
     goto END;
   }
 
+  TransmitQueueSetErrorHandler(transmitQueue, ArpTransmitError, NULL);
+
   if ((fileHandle = fopen(FILE_UNPOISON, "r")) == NULL)
   {
     retVal = -3;
@@ -247,17 +247,17 @@ DWORD ArpDePoisoning(PSCANPARAMS scanParamsParam)
     LogMsg(DBG_INFO, "ArpDepoisoning(): %d.%d.%d.%d/%02hhX-%02hhX-%02hhX-%02hhX-%02hhX-%02hhX",
       remoteIpString, remoteMacStr);
 
-    // Send 3 ARP depoisoning packets.
+    // Send 3 ARP depoisoning packets in one batch.
     for (i = 0; i < 3; i++)
     {
-      if (SendArpPacket(interfaceHandle, &arpPacket) == FALSE)
+      if (SendArpPacket(transmitQueue, &arpPacket) == FALSE)
       {
         LogMsg(DBG_ERROR, "ArpDepoisoning(): Unable to send ARP packet.");
       }
-
-      Sleep(SLEEP_BETWEEN_ARPS);
     }
 
+    TransmitQueueFlush(transmitQueue);
+
     RemoveMacFromCache((char *)scanParams.InterfaceAlias, (char *)remoteIpString);
     Sleep(SLEEP_BETWEEN_ARPS);
   }
@@ -270,9 +270,15 @@ END:
     fclose(fileHandle);
   }
 
+  // Flush before the handle goes away
+  if (transmitQueue != NULL)
+  {
+    TransmitQueueDestroy(transmitQueue);
+  }
+
   if (interfaceHandle)
   {
-    pcap_close(interfaceHandle);
+    CaptureClose(interfaceHandle);
   }
 
   if (gScanParams.InterfaceReadHandle != NULL)
@@ -2,10 +2,13 @@
 #define __ARPSCAN__
 
 #include <windows.h>
+#include "PacketCapture.h"
+#include "TransmitQueue.h"
 
 
 #define MAX_BUF_SIZE 1024
 #define SLEEP_BETWEEN_ARPS 5
+#define ARP_BURST_SIZE 16   // Requests per transmit batch
 
 #define OK 0
 #define NOK 1
@@ -92,6 +95,7 @@ typedef struct SCANPARAMS
   unsigned char VictimMACStr[MAX_MAC_LEN];
 
   LPVOID IfcWriteHandle;
+  LPVOID TransmitQueue;
 } SCANPARAMS, * PSCANPARAMS;
 
 
@@ -103,9 +107,11 @@ void LogMsg(char* pMsg, ...);
 int GetIfcDetails(char* pIFCName, PSCANPARAMS pScanParams);
 void Ip2string(unsigned char pIP[BIN_IP_LEN], unsigned char* pOutput, int pOutputLen);
 void Mac2String(unsigned char pMAC[BIN_MAC_LEN], unsigned char* pOutput, int pOutputLen);
-int SendArpPacket(void* pIFCHandle, PARPPacket pARPPacket);
+int SendArpPacket(void* pTransmitQueue, PARPPacket pARPPacket);
 int SendArpWhoHas(PSCANPARAMS pScanParams, unsigned long lIPAddress);
 DWORD WINAPI CaptureArpReplies(LPVOID pScanParams);
+void ArpReplyBatchCallback(unsigned char* pScanParams, PCAPTURE_BATCH pBatch);
+void HandleArpReply(struct pcap_pkthdr* pPktHdr, unsigned char* pPktData);
 void ListInterfaceDetails();
 void PrintUsage(char* pAppName);
 BOOL IsFlagSet(int argc, char** argv, char* flag);
@@ -7,7 +7,8 @@
 #include <iphlpapi.h>
 
 #include "ARPScan.h"
-#include "LinkedListSystems.h"
+#include "HostTable.h"
+#include "PacketCapture.h"
 
 
 #pragma comment(lib, "iphlpapi.lib")
@@ -25,8 +26,7 @@
  *
  */
 CRITICAL_SECTION gWriteLog;
-CRITICAL_SECTION gCSSystemsLL;
-PSYSTEMNODE gSystemsList = NULL;
+PHOST_TABLE gSystemsList = NULL;
 BOOL gVerbose = FALSE;
 BOOL gXml = FALSE;
 
@@ -48,6 +48,7 @@ int main(int argc, char** argv)
   HANDLE threadHandle = INVALID_HANDLE_VALUE;
   DWORD threadId = 0;
   int counter = 0;
+  int burstCounter = 0;
   char temp[PCAP_ERRBUF_SIZE];
 
   HANDLE icmpFile = INVALID_HANDLE_VALUE;
@@ -68,10 +69,13 @@ int main(int argc, char** argv)
    
   // Initialisation
   InitializeCriticalSectionAndSpinCount(&gWriteLog, 0x00000400);
-  InitializeCriticalSectionAndSpinCount(&gCSSystemsLL, 0x00000400);
 
   ParseInputParams(argc, argv);
-  gSystemsList = InitSystemList();
+  if ((gSystemsList = HostTableCreate(HOST_TABLE_DEFAULT_CAPACITY)) == NULL)
+  {
+    exit(7);
+  }
+
   PreparePcapDevice(argv[1], adapter);
   GetIfcDetails(adapter, &scanParams);
 
@@ -86,6 +90,8 @@ int main(int argc, char** argv)
     exit(8);
   }
 
+  // The requests go out in bursts of ARP_BURST_SIZE, the
+  // average rate stays at one per SLEEP_BETWEEN_ARPS.
   for (ipCounter = scanParams.StartIPNum; ipCounter <= scanParams.StopIPNum; ipCounter++)
   {
     if (memcmp(scanParams.LocalIP, &ipCounter, BIN_IP_LEN) &&
@@ -108,22 +114,32 @@ int main(int argc, char** argv)
         LogMsg(temp);
       }
 
-      Sleep(SLEEP_BETWEEN_ARPS);
+      if (++burstCounter >= ARP_BURST_SIZE)
+      {
+        TransmitQueueFlush((PTRANSMIT_QUEUE)scanParams.TransmitQueue);
+        Sleep(SLEEP_BETWEEN_ARPS * ARP_BURST_SIZE);
+        burstCounter = 0;
+      }
     }
   }
 
+  TransmitQueueFlush((PTRANSMIT_QUEUE)scanParams.TransmitQueue);
+
   // Wait for all ARP replies and terminate thread.
   Sleep(1000);
   TerminateThread(arpReplyThreadHandle, 0);
   CloseHandle(arpReplyThreadHandle);
 
+  if (scanParams.TransmitQueue)
+    TransmitQueueDestroy((PTRANSMIT_QUEUE)scanParams.TransmitQueue);
+
   if (scanParams.IfcWriteHandle)
-    pcap_close((pcap_t*)scanParams.IfcWriteHandle);
+    CaptureClose((PCAPTURE_HANDLE)scanParams.IfcWriteHandle);
 
 END:
 
   DeleteCriticalSection(&gWriteLog);
-  DeleteCriticalSection(&gCSSystemsLL);
+  HostTableDestroy(gSystemsList);
 
   return retVal;
 }
@@ -132,14 +148,44 @@ END:
 
 DWORD WINAPI CaptureArpReplies(LPVOID pScanParams)
 {
-  pcap_t* ifcHandle = NULL;
+  PCAPTURE_HANDLE ifcHandle = NULL;
+  char temp[CAPTURE_ERRBUF_SIZE];
+  PSCANPARAMS scanParams = (PSCANPARAMS)pScanParams;
+
+  ZeroMemory(temp, sizeof(temp));
+
+  if ((ifcHandle = CaptureOpen((char*)scanParams->IFCstring, 64, CAPTURE_FLAG_PROMISCUOUS, 1, temp)) == NULL)
+  {
+    goto END;
+  }
+
+  CaptureDispatchLoop(ifcHandle, ArpReplyBatchCallback, (unsigned char*)scanParams);
+
+END:
+
+  if (ifcHandle != NULL)
+    CaptureClose(ifcHandle);
+
+  return 0;
+}
+
+
+void ArpReplyBatchCallback(unsigned char* pScanParams, PCAPTURE_BATCH pBatch)
+{
+  int counter = 0;
+
+  for (counter = 0; counter < pBatch->FrameCount; counter++)
+  {
+    HandleArpReply(pBatch->Headers[counter], pBatch->Frames[counter]);
+  }
+}
+
+
+void HandleArpReply(struct pcap_pkthdr* pktHdr, unsigned char* pktData)
+{
   char temp[1024];
-  int pcapRetVal = 0;
   PETHDR ethrHdr = NULL;
   PARPHDR arpPHdr = NULL;
-  u_char* pktData = NULL;
-  struct pcap_pkthdr* pktHdr = NULL;
-  PSCANPARAMS scanParams = (PSCANPARAMS)pScanParams;
   unsigned char tmpPkt[256];
   unsigned int tmpSize;
   unsigned char ethDstStr[MAX_MAC_LEN + 1];
@@ -149,58 +195,43 @@ DWORD WINAPI CaptureArpReplies(LPVOID pScanParams)
   unsigned char arpIpDstStr[MAX_IP_LEN + 1];
   unsigned char arpIpSrcStr[MAX_IP_LEN + 1];
 
-  if ((ifcHandle = pcap_open((char*)scanParams->IFCstring, 64, PCAP_OPENFLAG_PROMISCUOUS, 1, NULL, temp)) == NULL)
-  {
-    goto END;
-  }
-  
-  while ((pcapRetVal = pcap_next_ex(ifcHandle, &pktHdr, (const u_char * *)& pktData)) >= 0)
-  {
-    if (pcapRetVal == 1)
-    {
-      tmpSize = pktHdr->len > 255 ? 255 : pktHdr->len;
-      ZeroMemory(tmpPkt, 256);
-      CopyMemory(tmpPkt, pktData, tmpSize);
+  tmpSize = pktHdr->caplen > 255 ? 255 : pktHdr->caplen;
+  ZeroMemory(tmpPkt, 256);
+  CopyMemory(tmpPkt, pktData, tmpSize);
       
-      ethrHdr = (PETHDR)tmpPkt;
-      arpPHdr = (PARPHDR)(tmpPkt + sizeof(ETHDR));
+  ethrHdr = (PETHDR)tmpPkt;
+  arpPHdr = (PARPHDR)(tmpPkt + sizeof(ETHDR));
 
-      if (ntohs(arpPHdr->oper) == ARP_REPLY)
-      {
-        ZeroMemory(ethDstStr, sizeof(ethDstStr));
-        ZeroMemory(ethSrcStr, sizeof(ethSrcStr));
-        ZeroMemory(arpEthSrcStr, sizeof(arpEthSrcStr));
-        ZeroMemory(arpEthDstStr, sizeof(arpEthDstStr));
-        ZeroMemory(arpIpDstStr, sizeof(arpIpDstStr));
-        ZeroMemory(arpIpSrcStr, sizeof(arpIpSrcStr));
-
-        Mac2String(ethrHdr->ether_shost, ethSrcStr, sizeof(ethSrcStr) - 1);
-        Mac2String(ethrHdr->ether_dhost, ethDstStr, sizeof(ethDstStr) - 1);
-        Mac2String(arpPHdr->sha, arpEthSrcStr, sizeof(arpEthSrcStr) - 1);
-        Mac2String(arpPHdr->tha, arpEthDstStr, sizeof(arpEthDstStr) - 1);
+  if (ntohs(arpPHdr->oper) == ARP_REPLY)
+  {
+    ZeroMemory(ethDstStr, sizeof(ethDstStr));
+    ZeroMemory(ethSrcStr, sizeof(ethSrcStr));
+    ZeroMemory(arpEthSrcStr, sizeof(arpEthSrcStr));
+    ZeroMemory(arpEthDstStr, sizeof(arpEthDstStr));
+    ZeroMemory(arpIpDstStr, sizeof(arpIpDstStr));
+    ZeroMemory(arpIpSrcStr, sizeof(arpIpSrcStr));
+
+    Mac2String(ethrHdr->ether_shost, ethSrcStr, sizeof(ethSrcStr) - 1);
+    Mac2String(ethrHdr->ether_dhost, ethDstStr, sizeof(ethDstStr) - 1);
+    Mac2String(arpPHdr->sha, arpEthSrcStr, sizeof(arpEthSrcStr) - 1);
+    Mac2String(arpPHdr->tha, arpEthDstStr, sizeof(arpEthDstStr) - 1);
         
-        Ip2string(arpPHdr->tpa, arpIpDstStr, sizeof(arpIpDstStr) - 1);
-        Ip2string(arpPHdr->spa, arpIpSrcStr, sizeof(arpIpSrcStr) - 1);
+    Ip2string(arpPHdr->tpa, arpIpDstStr, sizeof(arpIpDstStr) - 1);
+    Ip2string(arpPHdr->spa, arpIpSrcStr, sizeof(arpIpSrcStr) - 1);
         
-        if (GetNodeByMac(gSystemsList, arpPHdr->sha) == NULL)
-        {
-          AddToList(&gSystemsList, arpPHdr->spa, arpPHdr->sha);
+    if (HostTableLookupMac(gSystemsList, arpPHdr->sha, NULL) == FALSE)
+    {
+      HostTableAdd(gSystemsList, arpPHdr->spa, arpPHdr->sha, NULL);
 
-          ZeroMemory(temp, sizeof(temp));
-          if (gXml == TRUE)
-          _snprintf(temp, sizeof(temp) - 1, "<arp>\n  <type>reply</type>\n  <ip>%s</ip>\n  <mac>%s</mac>\n</arp>", arpIpSrcStr, ethSrcStr);
-          else
-            _snprintf(temp, sizeof(temp) - 1, "reply;%s;%s", arpIpSrcStr, ethSrcStr);
+      ZeroMemory(temp, sizeof(temp));
+      if (gXml == TRUE)
+      _snprintf(temp, sizeof(temp) - 1, "<arp>\n  <type>reply</type>\n  <ip>%s</ip>\n  <mac>%s</mac>\n</arp>", arpIpSrcStr, ethSrcStr);
+      else
+        _snprintf(temp, sizeof(temp) - 1, "reply;%s;%s", arpIpSrcStr, ethSrcStr);
 
-          LogMsg(temp);
-        }
-      }
+      LogMsg(temp);
     }
   }
-
-END:
-
-  return 0;
 }
 
 /*
@@ -228,7 +259,7 @@ int SendArpWhoHas(PSCANPARAMS pScanParams, unsigned long lIPAddress)
   CopyMemory(&arpPacket.ARP_DstIP[0], &dstIp, BIN_IP_LEN);
 
   // Send packet
-  if (SendArpPacket(pScanParams->IfcWriteHandle, &arpPacket) != 0)
+  if (SendArpPacket(pScanParams->TransmitQueue, &arpPacket) != 0)
   {
     //    LogMsg("SendARPWhoHas() : Unable to send ARP packet.\n");
     retVal = NOK;
@@ -238,7 +269,12 @@ int SendArpWhoHas(PSCANPARAMS pScanParams, unsigned long lIPAddress)
 }
 
 
-int SendArpPacket(void* pIFCHandle, PARPPacket pARPPacket)
+/*
+ * Queue the ARP packet. It is sent with the
+ * next flush of the transmit queue.
+ *
+ */
+int SendArpPacket(void* pTransmitQueue, PARPPacket pARPPacket)
 {
   int retVal = NOK;
   unsigned char arpPacket[sizeof(ETHDR) + sizeof(ARPHDR)];
@@ -266,11 +302,9 @@ int SendArpPacket(void* pIFCHandle, PARPPacket pARPPacket)
   CopyMemory(arpHdr->spa, pARPPacket->ARP_LocalIP, BIN_IP_LEN);
   CopyMemory(arpHdr->sha, pARPPacket->ARP_LocalMAC, BIN_MAC_LEN);
 
-  // Send down the packet
-  if (pIFCHandle != NULL && pcap_sendpacket((pcap_t*)pIFCHandle, arpPacket, sizeof(ETHDR) + sizeof(ARPHDR)) == 0)
+  // Queue the packet
+  if (pTransmitQueue != NULL && TransmitQueueAdd((PTRANSMIT_QUEUE)pTransmitQueue, arpPacket, sizeof(ETHDR) + sizeof(ARPHDR)) == TRUE)
     retVal = OK;
-  //  else
-  // 	  LogMsg("SendARPPacket() : Error occured while sending the packet: %s\n", pcap_geterr((pcap_t *) pIFCHandle));
   
   return retVal;
 }
@@ -616,40 +650,27 @@ void ParseInputParams(int argc, char** argv)
 
 void ParseScanParams(PSCANPARAMS scanParams, char *adapter)
 {
-  char filter[1024];
-  bpf_u_int32 netMask;
-  struct bpf_program fCode;
-  char temp[PCAP_ERRBUF_SIZE];
-
-  ZeroMemory(&fCode, sizeof(fCode));
-  ZeroMemory(filter, sizeof(filter));
+  char temp[CAPTURE_ERRBUF_SIZE];
 
-  _snprintf(filter, sizeof(filter) - 1, "arp and arp[6:2] = 2");
-  //netMask = 0xffffff; // "255.255.255.0"
+  ZeroMemory(temp, sizeof(temp));
 
   if (scanParams->StartIPNum > scanParams->StopIPNum)
   {
     exit(4);
   }
 
-  // Start ARP Reply listener thread
-  if ((scanParams->IfcWriteHandle = pcap_open(adapter, 48, PCAP_OPENFLAG_NOCAPTURE_LOCAL | PCAP_OPENFLAG_MAX_RESPONSIVENESS, 1, NULL, temp)) == NULL)
+  // Open the transmit handle. It receives nothing, the ARP
+  // replies are read by CaptureArpReplies().
+  if ((scanParams->IfcWriteHandle = CaptureOpen(adapter, 48, CAPTURE_FLAG_SEND_ONLY, 1, temp)) == NULL)
   {
     printf("adapter: %s\n", adapter);
     exit(5);
   }
 
-  // if (pcap_compile((pcap_t *) lScanParams.IfcWriteHandle, &lFCode, (const char *) lFilter, 1, lNetMask) >= 0)
-  if (pcap_compile((pcap_t*)scanParams->IfcWriteHandle, &fCode, (const char*)filter, 1, NULL) < 0)
+  if ((scanParams->TransmitQueue = TransmitQueueCreate((PCAPTURE_HANDLE)scanParams->IfcWriteHandle, ARP_BURST_SIZE, 0)) == NULL)
   {
     exit(6);
   }
-
-  // Set the filter
-  if (pcap_setfilter((pcap_t*)scanParams->IfcWriteHandle, &fCode) < 0)
-  {
-    exit(7);
-  }
 }
 
 
@@ -0,0 +1,1122 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "AsyncLog.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+
+#ifdef _WIN32
+#define ASYNCLOG_THREAD_LOCAL __declspec(thread)
+#define ASYNCLOG_LOAD_ACQUIRE(ptr) ((unsigned int)InterlockedCompareExchange((volatile LONG *)(ptr), 0, 0))
+#define ASYNCLOG_STORE_RELEASE(ptr, value) InterlockedExchange((volatile LONG *)(ptr), (LONG)(value))
+#define ASYNCLOG_LOAD_RING(ptr) ((PASYNCLOG_RING)InterlockedCompareExchangePointer((PVOID volatile *)(ptr), NULL, NULL))
+#define ASYNCLOG_STORE_RING(ptr, value) InterlockedExchangePointer((PVOID volatile *)(ptr), (value))
+#define ASYNCLOG_FETCH_ADD(ptr, value) ((unsigned int)InterlockedExchangeAdd((volatile LONG *)(ptr), (LONG)(value)))
+#define ASYNCLOG_COMPARE_EXCHANGE(ptr, oldValue, newValue) ((unsigned int)InterlockedCompareExchange((volatile LONG *)(ptr), (LONG)(newValue), (LONG)(oldValue)))
+#else
+#define ASYNCLOG_THREAD_LOCAL __thread
+#define ASYNCLOG_LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define ASYNCLOG_STORE_RELEASE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define ASYNCLOG_LOAD_RING(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define ASYNCLOG_STORE_RING(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define ASYNCLOG_FETCH_ADD(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_ACQ_REL)
+#define ASYNCLOG_COMPARE_EXCHANGE(ptr, oldValue, newValue) __sync_val_compare_and_swap((ptr), (oldValue), (newValue))
+#endif
+
+// 100ns ticks between 1601-01-01 (FILETIME) and 1970-01-01
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL
+#define TICKS_PER_SECOND 10000000ULL
+
+// Argument classes of a conversion specification
+#define ARG_NONE 0
+#define ARG_PERCENT 1
+#define ARG_INT 2
+#define ARG_LONG 3
+#define ARG_LONGLONG 4
+#define ARG_SIZE 5
+#define ARG_DOUBLE 6
+#define ARG_STRING 7
+#define ARG_POINTER 8
+#define ARG_COUNT 9
+
+// Special %s argument values
+#define STRING_NULL 0xFFFFFFFFFFFFFFFFULL
+#define STRING_TRUNCATED 0xFFFFFFFFFFFFFFFEULL
+
+#define MAX_SPEC_LEN 32
+
+// DBG_ERROR in the tools' Logging.h
+#define PRIORITY_ERROR 6
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  char Text[MAX_SPEC_LEN];
+  int Length;
+  int Class;
+  int StarCount;
+} FORMAT_SPEC, *PFORMAT_SPEC;
+
+
+typedef struct
+{
+  // Producer side
+  volatile unsigned int Head;
+  unsigned int CachedTail;
+  volatile uint64_t Dropped;
+  volatile unsigned int Owned;
+  char Padding1[44];
+
+  // Consumer side
+  volatile unsigned int Tail;
+  unsigned int CachedHead;
+  char Padding2[56];
+
+  ASYNCLOG_RECORD Records[ASYNCLOG_RING_SIZE];
+} ASYNCLOG_RING, *PASYNCLOG_RING;
+
+
+typedef struct
+{
+  int64_t Second;
+  char Text[32];
+} TIME_CACHE, *PTIME_CACHE;
+
+
+static char *sPriorityNames[] = { "OFF", "DEBUG", "INFO", "LOW", "MEDIUM", "HIGH", "ERROR", "FATAL" };
+
+// Rings are never freed. A thread gives its ring back when it
+// exits (sRingKey destructor) and the next new thread reuses it.
+static PASYNCLOG_RING sRings[ASYNCLOG_MAX_RINGS];
+static volatile unsigned int sRingCount = 0;
+static ASYNCLOG_THREAD_LOCAL PASYNCLOG_RING sThreadRing = NULL;
+static ASYNCLOG_THREAD_LOCAL BOOL sThreadRingFailed = FALSE;
+static volatile unsigned int sNoRingThreads = 0;
+static unsigned int sReportedNoRingThreads = 0;
+static BOOL sRingKeyCreated = FALSE;
+#ifdef _WIN32
+static DWORD sRingKey = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t sRingKey;
+#endif
+
+static volatile unsigned int sRunning = FALSE;
+static volatile unsigned int sStopRequested = FALSE;
+static volatile unsigned int sNoRingDropped = 0;
+static volatile unsigned int sFlushedRecords = 0;
+static unsigned int sConsumedRecords = 0;
+static uint64_t sReportedDrops = 0;
+static uint64_t sBatchCount = 0;
+static BOOL sConsoleOutput = TRUE;
+static FILE *sLogFile = NULL;
+static char sBatch[ASYNCLOG_BATCH_SIZE];
+static int sBatchLength = 0;
+static TIME_CACHE sTimeCache = { -1, { 0 } };
+
+#ifdef _WIN32
+static HANDLE sThreadHandle = NULL;
+#else
+static pthread_t sThreadHandle;
+#endif
+
+
+static uint64_t AsyncLogNow();
+static PASYNCLOG_RING AsyncLogGetRing();
+#ifdef _WIN32
+static VOID WINAPI AsyncLogReleaseRing(PVOID param);
+#else
+static void AsyncLogReleaseRing(void *param);
+#endif
+static const char *AsyncLogNextSpec(const char *formatParam, PFORMAT_SPEC specParam);
+static void AsyncLogCaptureArgs(PASYNCLOG_RECORD recordParam, va_list argsParam);
+static unsigned int AsyncLogDrain();
+static void AsyncLogReportDrops();
+static void AsyncLogAppendLine(PASYNCLOG_RECORD recordParam);
+static int AsyncLogFormatLine(PASYNCLOG_RECORD recordParam, PTIME_CACHE timeCacheParam, char *outputParam, int outputSizeParam);
+static void AsyncLogFormatTime(uint64_t timestampParam, PTIME_CACHE timeCacheParam, char *outputParam, int outputSizeParam);
+static void AsyncLogWriteOutput(char *dataParam, int dataLengthParam);
+static void AsyncLogFlushBatch();
+#ifdef _WIN32
+static DWORD WINAPI AsyncLogThread(LPVOID param);
+#else
+static void *AsyncLogThread(void *param);
+#endif
+
+
+/*
+ * Open the logfile (if any) and start the formatter thread.
+ *
+ */
+BOOL AsyncLogStart(char *logFileParam, BOOL consoleOutputParam)
+{
+  BOOL retVal = FALSE;
+
+  if (sRunning == TRUE)
+  {
+    return TRUE;
+  }
+
+  sConsoleOutput = consoleOutputParam;
+  sStopRequested = FALSE;
+
+  // Gives a thread's ring back when the thread exits
+  if (sRingKeyCreated == FALSE)
+  {
+#ifdef _WIN32
+    if ((sRingKey = FlsAlloc(AsyncLogReleaseRing)) == FLS_OUT_OF_INDEXES)
+    {
+      goto END;
+    }
+#else
+    if (pthread_key_create(&sRingKey, AsyncLogReleaseRing) != 0)
+    {
+      goto END;
+    }
+#endif
+    sRingKeyCreated = TRUE;
+  }
+
+  if (logFileParam != NULL &&
+      (sLogFile = fopen(logFileParam, "a")) == NULL)
+  {
+    goto END;
+  }
+
+#ifdef _WIN32
+  if ((sThreadHandle = CreateThread(NULL, 0, AsyncLogThread, NULL, 0, NULL)) == NULL)
+  {
+    goto END;
+  }
+#else
+  if (pthread_create(&sThreadHandle, NULL, AsyncLogThread, NULL) != 0)
+  {
+    goto END;
+  }
+#endif
+
+  ASYNCLOG_STORE_RELEASE(&sRunning, TRUE);
+  retVal = TRUE;
+
+END:
+
+  if (retVal == FALSE &&
+      sLogFile != NULL)
+  {
+    fclose(sLogFile);
+    sLogFile = NULL;
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Stop the formatter thread after it wrote everything that
+ * was logged so far. Later records are written directly.
+ *
+ */
+void AsyncLogStop()
+{
+  if (sRunning == FALSE)
+  {
+    return;
+  }
+
+  ASYNCLOG_STORE_RELEASE(&sRunning, FALSE);
+  ASYNCLOG_STORE_RELEASE(&sStopRequested, TRUE);
+
+#ifdef _WIN32
+  WaitForSingleObject(sThreadHandle, INFINITE);
+  CloseHandle(sThreadHandle);
+  sThreadHandle = NULL;
+#else
+  pthread_join(sThreadHandle, NULL);
+#endif
+
+  // Pick up records of threads that were still
+  // in the middle of AsyncLogWriteV().
+  AsyncLogDrain();
+  AsyncLogReportDrops();
+  AsyncLogFlushBatch();
+
+  if (sLogFile != NULL)
+  {
+    fclose(sLogFile);
+    sLogFile = NULL;
+  }
+}
+
+
+/*
+ * Wait until all records logged before this call are written.
+ *
+ */
+BOOL AsyncLogFlush()
+{
+  unsigned int target = 0;
+  unsigned int ringCount = 0;
+  unsigned int counter = 0;
+  unsigned int waited = 0;
+  PASYNCLOG_RING ring = NULL;
+
+  if (sRunning == FALSE)
+  {
+    return TRUE;
+  }
+
+  ringCount = ASYNCLOG_LOAD_ACQUIRE(&sRingCount);
+  if (ringCount > ASYNCLOG_MAX_RINGS)
+  {
+    ringCount = ASYNCLOG_MAX_RINGS;
+  }
+
+  for (counter = 0; counter < ringCount; counter++)
+  {
+    if ((ring = ASYNCLOG_LOAD_RING(&sRings[counter])) != NULL)
+    {
+      target += ASYNCLOG_LOAD_ACQUIRE(&ring->Head);
+    }
+  }
+
+  while ((int)(ASYNCLOG_LOAD_ACQUIRE(&sFlushedRecords) - target) < 0)
+  {
+    if (waited >= ASYNCLOG_FLUSH_TIMEOUT)
+    {
+      return FALSE;
+    }
+
+    Sleep(1);
+    waited++;
+  }
+
+  return TRUE;
+}
+
+
+void AsyncLogWrite(int priorityParam, const char *formatParam, ...)
+{
+  va_list args;
+
+  va_start(args, formatParam);
+  AsyncLogWriteV(priorityParam, formatParam, args);
+  va_end(args);
+}
+
+
+/*
+ * Called on the packet threads. Captures the arguments into
+ * the next free record of the thread's ring.
+ *
+ */
+void AsyncLogWriteV(int priorityParam, const char *formatParam, va_list argsParam)
+{
+  PASYNCLOG_RING ring = NULL;
+  PASYNCLOG_RECORD record = NULL;
+  ASYNCLOG_RECORD directRecord;
+  char line[ASYNCLOG_MAX_LINE];
+  unsigned int head = 0;
+  int lineLength = 0;
+
+  if (formatParam == NULL)
+  {
+    return;
+  }
+
+  // Logger not running, format and write on this thread
+  if (ASYNCLOG_LOAD_ACQUIRE(&sRunning) == FALSE)
+  {
+    directRecord.Timestamp = AsyncLogNow();
+    directRecord.Format = formatParam;
+    directRecord.Priority = priorityParam;
+    AsyncLogCaptureArgs(&directRecord, argsParam);
+    lineLength = AsyncLogFormatLine(&directRecord, NULL, line, sizeof(line));
+    AsyncLogWriteOutput(line, lineLength);
+    return;
+  }
+
+  if ((ring = AsyncLogGetRing()) == NULL)
+  {
+    ASYNCLOG_FETCH_ADD(&sNoRingDropped, 1);
+    return;
+  }
+
+  head = ring->Head;
+  if (head - ring->CachedTail >= ASYNCLOG_RING_SIZE)
+  {
+    ring->CachedTail = ASYNCLOG_LOAD_ACQUIRE(&ring->Tail);
+    if (head - ring->CachedTail >= ASYNCLOG_RING_SIZE)
+    {
+      ring->Dropped++;
+      return;
+    }
+  }
+
+  record = &ring->Records[head & (ASYNCLOG_RING_SIZE - 1)];
+  record->Timestamp = AsyncLogNow();
+  record->Format = formatParam;
+  record->Priority = priorityParam;
+  AsyncLogCaptureArgs(record, argsParam);
+
+  ASYNCLOG_STORE_RELEASE(&ring->Head, head + 1);
+}
+
+
+void AsyncLogGetStats(PASYNCLOG_STATS statsParam)
+{
+  unsigned int ringCount = 0;
+  unsigned int counter = 0;
+  PASYNCLOG_RING ring = NULL;
+
+  ZeroMemory(statsParam, sizeof(ASYNCLOG_STATS));
+
+  ringCount = ASYNCLOG_LOAD_ACQUIRE(&sRingCount);
+  if (ringCount > ASYNCLOG_MAX_RINGS)
+  {
+    ringCount = ASYNCLOG_MAX_RINGS;
+  }
+
+  for (counter = 0; counter < ringCount; counter++)
+  {
+    if ((ring = ASYNCLOG_LOAD_RING(&sRings[counter])) != NULL)
+    {
+      statsParam->Dropped += ring->Dropped;
+      statsParam->Rings++;
+    }
+  }
+
+  statsParam->Dropped += ASYNCLOG_LOAD_ACQUIRE(&sNoRingDropped);
+  statsParam->Records = ASYNCLOG_LOAD_ACQUIRE(&sFlushedRecords);
+  statsParam->Batches = sBatchCount;
+}
+
+
+/*
+ * Render the message of a record, without timestamp and
+ * priority. Returns the length of the message.
+ *
+ */
+int AsyncLogFormatRecord(PASYNCLOG_RECORD recordParam, char *outputParam, int outputSizeParam)
+{
+  FORMAT_SPEC spec;
+  const char *position = recordParam->Format;
+  const char *next = NULL;
+  char specText[MAX_SPEC_LEN + 32];
+  uint64_t value = 0;
+  double doubleValue = 0;
+  int outputLength = 0;
+  int argIndex = 0;
+  int starValue = 0;
+  int specLength = 0;
+  int funcRetVal = 0;
+  int counter = 0;
+
+  if (outputSizeParam <= 0)
+  {
+    return 0;
+  }
+
+  while (*position != 0 &&
+         outputLength < outputSizeParam - 1)
+  {
+    if (*position != '%')
+    {
+      outputParam[outputLength++] = *position++;
+      continue;
+    }
+
+    next = AsyncLogNextSpec(position, &spec);
+
+    if (spec.Class == ARG_PERCENT)
+    {
+      outputParam[outputLength++] = '%';
+      position = next;
+      continue;
+    }
+    else if (spec.Class == ARG_NONE)
+    {
+      while (position < next &&
+             outputLength < outputSizeParam - 1)
+      {
+        outputParam[outputLength++] = *position++;
+      }
+      continue;
+    }
+
+    // The record ran out of argument slots
+    if (argIndex + spec.StarCount + 1 > recordParam->ArgCount)
+    {
+      funcRetVal = snprintf(outputParam + outputLength, outputSizeParam - outputLength, "...");
+      outputLength += funcRetVal > 0 ? funcRetVal : 0;
+      break;
+    }
+
+    // Put the values of '*' width/precision into the spec
+    for (counter = 0, specLength = 0; counter < spec.Length && specLength < (int)sizeof(specText) - 12; counter++)
+    {
+      if (spec.Text[counter] == '*')
+      {
+        starValue = (int)(int64_t)recordParam->Args[argIndex++];
+        if (starValue < 0 && counter > 0 && spec.Text[counter - 1] == '.')
+        {
+          specLength--;
+          continue;
+        }
+        specLength += snprintf(specText + specLength, sizeof(specText) - specLength, "%d", starValue);
+      }
+      else
+      {
+        specText[specLength++] = spec.Text[counter];
+      }
+    }
+    specText[specLength] = 0;
+
+    value = recordParam->Args[argIndex++];
+    switch (spec.Class)
+    {
+      case ARG_INT:
+        funcRetVal = snprintf(outputParam + outputLength, outputSizeParam - outputLength, specText, (int)value);
+        break;
+      case ARG_LONG:
+        funcRetVal = snprintf(outputParam + outputLength, outputSizeParam - outputLength, specText, (long)value);
+        break;
+      case ARG_LONGLONG:
+        funcRetVal = snprintf(outputParam + outputLength, outputSizeParam - outputLength, specText, (long long)value);
+        break;
+      case ARG_SIZE:
+        funcRetVal = snprintf(outputParam + outputLength, outputSizeParam - outputLength, specText, (size_t)value);
+        break;
+      case ARG_DOUBLE:
+        CopyMemory(&doubleValue, &value, sizeof(doubleValue));
+        funcRetVal = snprintf(outputParam + outputLength, outputSizeParam - outputLength, specText, doubleValue);
+        break;
+      case ARG_STRING:
+        funcRetVal = snprintf(outputParam + outputLength, outputSizeParam - outputLength, specText,
+          value == STRING_NULL ? "(null)" : value == STRING_TRUNCATED ? "" : &recordParam->Strings[value]);
+        break;
+      case ARG_POINTER:
+        funcRetVal = snprintf(outputParam + outputLength, outputSizeParam - outputLength, specText, (void *)(uintptr_t)value);
+        break;
+      default:
+        funcRetVal = 0;
+        break;
+    }
+
+    if (funcRetVal > 0)
+    {
+      outputLength += funcRetVal;
+    }
+
+    if (outputLength > outputSizeParam - 1)
+    {
+      outputLength = outputSizeParam - 1;
+    }
+
+    position = next;
+  }
+
+  outputParam[outputLength] = 0;
+
+  return outputLength;
+}
+
+
+
+/*
+ * 100ns ticks since 1970-01-01 UTC
+ *
+ */
+static uint64_t AsyncLogNow()
+{
+#ifdef _WIN32
+  FILETIME now;
+
+  GetSystemTimeAsFileTime(&now);
+
+  return (((uint64_t)now.dwHighDateTime << 32) | now.dwLowDateTime) - FILETIME_UNIX_EPOCH;
+#else
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  return (uint64_t)now.tv_sec * TICKS_PER_SECOND + (uint64_t)now.tv_nsec / 100;
+#endif
+}
+
+
+/*
+ * The calling thread's ring, assigned the first time a thread
+ * logs. A ring given back by an exited thread is taken over
+ * as it is, the new owner continues at its Head and records
+ * still queued in it are drained as usual. Otherwise a new
+ * ring is created and published.
+ *
+ */
+static PASYNCLOG_RING AsyncLogGetRing()
+{
+  PASYNCLOG_RING ring = NULL;
+  unsigned int ringCount = 0;
+  unsigned int slot = 0;
+
+  if (sThreadRing != NULL ||
+      sThreadRingFailed == TRUE)
+  {
+    return sThreadRing;
+  }
+
+  ringCount = ASYNCLOG_LOAD_ACQUIRE(&sRingCount);
+  if (ringCount > ASYNCLOG_MAX_RINGS)
+  {
+    ringCount = ASYNCLOG_MAX_RINGS;
+  }
+
+  for (slot = 0; slot < ringCount; slot++)
+  {
+    if ((ring = ASYNCLOG_LOAD_RING(&sRings[slot])) != NULL &&
+        ASYNCLOG_COMPARE_EXCHANGE(&ring->Owned, FALSE, TRUE) == FALSE)
+    {
+      goto END;
+    }
+  }
+
+  ring = NULL;
+  if ((slot = ASYNCLOG_FETCH_ADD(&sRingCount, 1)) >= ASYNCLOG_MAX_RINGS ||
+      (ring = (PASYNCLOG_RING)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(ASYNCLOG_RING))) == NULL)
+  {
+    // Reported once by the formatter thread
+    ASYNCLOG_FETCH_ADD(&sNoRingThreads, 1);
+    sThreadRingFailed = TRUE;
+    return NULL;
+  }
+
+  ring->Owned = TRUE;
+  ASYNCLOG_STORE_RING(&sRings[slot], ring);
+
+END:
+
+#ifdef _WIN32
+  FlsSetValue(sRingKey, ring);
+#else
+  pthread_setspecific(sRingKey, ring);
+#endif
+  sThreadRing = ring;
+
+  return ring;
+}
+
+
+/*
+ * Called when a thread that owns a ring exits.
+ *
+ */
+#ifdef _WIN32
+static VOID WINAPI AsyncLogReleaseRing(PVOID param)
+#else
+static void AsyncLogReleaseRing(void *param)
+#endif
+{
+  PASYNCLOG_RING ring = (PASYNCLOG_RING)param;
+
+  if (ring != NULL)
+  {
+    ASYNCLOG_STORE_RELEASE(&ring->Owned, FALSE);
+  }
+}
+
+
+/*
+ * Parse the conversion specification formatParam points to
+ * and return the position behind it.
+ *
+ */
+static const char *AsyncLogNextSpec(const char *formatParam, PFORMAT_SPEC specParam)
+{
+  const char *position = formatParam + 1;
+  int longCount = 0;
+  BOOL isSize = FALSE;
+  BOOL isWide = FALSE;
+
+  specParam->Class = ARG_NONE;
+  specParam->StarCount = 0;
+  specParam->Length = 0;
+
+  if (*position == '%')
+  {
+    specParam->Class = ARG_PERCENT;
+    return position + 1;
+  }
+
+  // Flags, width, precision
+  while (*position != 0 && strchr("-+ #0", *position) != NULL)
+  {
+    position++;
+  }
+
+  if (*position == '*')
+  {
+    specParam->StarCount++;
+    position++;
+  }
+
+  while (*position >= '0' && *position <= '9')
+  {
+    position++;
+  }
+
+  if (*position == '.')
+  {
+    position++;
+    if (*position == '*')
+    {
+      specParam->StarCount++;
+      position++;
+    }
+
+    while (*position >= '0' && *position <= '9')
+    {
+      position++;
+    }
+  }
+
+  // Length modifiers
+  while (*position != 0 && strchr("hlLqjztI", *position) != NULL)
+  {
+    if (*position == 'l' || *position == 'q')
+    {
+      longCount += *position == 'q' ? 2 : 1;
+      isWide = longCount == 1;
+    }
+    else if (*position == 'j')
+    {
+      longCount = 2;
+    }
+    else if (*position == 'z' || *position == 't')
+    {
+      isSize = TRUE;
+    }
+    else if (*position == 'I')
+    {
+      if (position[1] == '6' && position[2] == '4')
+      {
+        longCount = 2;
+        position += 2;
+      }
+      else if (position[1] == '3' && position[2] == '2')
+      {
+        position += 2;
+      }
+      else
+      {
+        isSize = TRUE;
+      }
+    }
+
+    position++;
+  }
+
+  switch (*position)
+  {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+      specParam->Class = isSize ? ARG_SIZE : longCount >= 2 ? ARG_LONGLONG : longCount == 1 ? ARG_LONG : ARG_INT;
+      break;
+    case 'c':
+      specParam->Class = ARG_INT;
+      break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+      specParam->Class = ARG_DOUBLE;
+      break;
+    case 's':
+      specParam->Class = isWide ? ARG_POINTER : ARG_STRING;
+      break;
+    case 'S': case 'p':
+      specParam->Class = ARG_POINTER;
+      break;
+    case 'n':
+      specParam->Class = ARG_COUNT;
+      break;
+    default:
+      specParam->StarCount = 0;
+      return *position != 0 ? position + 1 : position;
+  }
+
+  position++;
+
+  if (position - formatParam >= MAX_SPEC_LEN)
+  {
+    specParam->Class = ARG_NONE;
+    specParam->StarCount = 0;
+    return position;
+  }
+
+  specParam->Length = (int)(position - formatParam);
+  CopyMemory(specParam->Text, formatParam, specParam->Length);
+  specParam->Text[specParam->Length] = 0;
+
+  // Wide strings and %n are not supported, the argument
+  // is consumed and printed as a pointer.
+  if (specParam->Class == ARG_COUNT ||
+      (specParam->Class == ARG_POINTER && *(position - 1) != 'p'))
+  {
+    specParam->Class = ARG_POINTER;
+    CopyMemory(specParam->Text, "%p", 3);
+    specParam->Length = 2;
+    specParam->StarCount = 0;
+  }
+
+  return position;
+}
+
+
+/*
+ * Walk the format string and copy the raw arguments into the
+ * record. %s strings are copied, everything else by value.
+ *
+ */
+static void AsyncLogCaptureArgs(PASYNCLOG_RECORD recordParam, va_list argsParam)
+{
+  FORMAT_SPEC spec;
+  const char *position = recordParam->Format;
+  const char *stringValue = NULL;
+  double doubleValue = 0;
+  unsigned int space = 0;
+  unsigned int length = 0;
+  int counter = 0;
+
+  recordParam->ArgCount = 0;
+  recordParam->StringLength = 0;
+
+  while ((position = strchr(position, '%')) != NULL)
+  {
+    position = AsyncLogNextSpec(position, &spec);
+
+    if (spec.Class == ARG_NONE ||
+        spec.Class == ARG_PERCENT)
+    {
+      continue;
+    }
+
+    if (recordParam->ArgCount + spec.StarCount + 1 > ASYNCLOG_MAX_ARGS)
+    {
+      break;
+    }
+
+    for (counter = 0; counter < spec.StarCount; counter++)
+    {
+      recordParam->Args[recordParam->ArgCount++] = (uint64_t)(int64_t)va_arg(argsParam, int);
+    }
+
+    switch (spec.Class)
+    {
+      case ARG_INT:
+        recordParam->Args[recordParam->ArgCount++] = (uint64_t)(int64_t)va_arg(argsParam, int);
+        break;
+      case ARG_LONG:
+        recordParam->Args[recordParam->ArgCount++] = (uint64_t)(int64_t)va_arg(argsParam, long);
+        break;
+      case ARG_LONGLONG:
+        recordParam->Args[recordParam->ArgCount++] = (uint64_t)va_arg(argsParam, long long);
+        break;
+      case ARG_SIZE:
+        recordParam->Args[recordParam->ArgCount++] = (uint64_t)va_arg(argsParam, size_t);
+        break;
+      case ARG_DOUBLE:
+        doubleValue = va_arg(argsParam, double);
+        CopyMemory(&recordParam->Args[recordParam->ArgCount++], &doubleValue, sizeof(doubleValue));
+        break;
+      case ARG_POINTER:
+        recordParam->Args[recordParam->ArgCount++] = (uint64_t)(uintptr_t)va_arg(argsParam, void *);
+        break;
+      case ARG_STRING:
+        stringValue = va_arg(argsParam, const char *);
+        space = ASYNCLOG_STRING_SPACE - recordParam->StringLength;
+
+        if (stringValue == NULL)
+        {
+          recordParam->Args[recordParam->ArgCount++] = STRING_NULL;
+        }
+        else if (space <= 1)
+        {
+          recordParam->Args[recordParam->ArgCount++] = STRING_TRUNCATED;
+        }
+        else
+        {
+          for (length = 0; length < space - 1 && stringValue[length] != 0; length++);
+          CopyMemory(&recordParam->Strings[recordParam->StringLength], stringValue, length);
+          recordParam->Strings[recordParam->StringLength + length] = 0;
+          recordParam->Args[recordParam->ArgCount++] = recordParam->StringLength;
+          recordParam->StringLength += length + 1;
+        }
+        break;
+    }
+  }
+}
+
+
+/*
+ * Consume all available records, oldest first across all
+ * rings, and append them to the output batch.
+ *
+ */
+static unsigned int AsyncLogDrain()
+{
+  PASYNCLOG_RING ring = NULL;
+  PASYNCLOG_RING oldestRing = NULL;
+  PASYNCLOG_RECORD record = NULL;
+  PASYNCLOG_RECORD oldestRecord = NULL;
+  unsigned int ringCount = 0;
+  unsigned int counter = 0;
+  unsigned int retVal = 0;
+
+  while (TRUE)
+  {
+    oldestRing = NULL;
+    oldestRecord = NULL;
+
+    ringCount = ASYNCLOG_LOAD_ACQUIRE(&sRingCount);
+    if (ringCount > ASYNCLOG_MAX_RINGS)
+    {
+      ringCount = ASYNCLOG_MAX_RINGS;
+    }
+
+    for (counter = 0; counter < ringCount; counter++)
+    {
+      if ((ring = ASYNCLOG_LOAD_RING(&sRings[counter])) == NULL)
+      {
+        continue;
+      }
+
+      if (ring->Tail == ring->CachedHead &&
+          ring->Tail == (ring->CachedHead = ASYNCLOG_LOAD_ACQUIRE(&ring->Head)))
+      {
+        continue;
+      }
+
+      record = &ring->Records[ring->Tail & (ASYNCLOG_RING_SIZE - 1)];
+      if (oldestRecord == NULL ||
+          record->Timestamp < oldestRecord->Timestamp)
+      {
+        oldestRing = ring;
+        oldestRecord = record;
+      }
+    }
+
+    if (oldestRecord == NULL)
+    {
+      break;
+    }
+
+    AsyncLogAppendLine(oldestRecord);
+    ASYNCLOG_STORE_RELEASE(&oldestRing->Tail, oldestRing->Tail + 1);
+    sConsumedRecords++;
+    retVal++;
+  }
+
+  return retVal;
+}
+
+
+static void AsyncLogReportDrops()
+{
+  ASYNCLOG_STATS stats;
+  ASYNCLOG_RECORD record;
+  uint64_t fullDrops = 0;
+  unsigned int noRingThreads = 0;
+
+  // Once per thread that was refused a ring
+  noRingThreads = ASYNCLOG_LOAD_ACQUIRE(&sNoRingThreads);
+  if (noRingThreads != sReportedNoRingThreads)
+  {
+    ZeroMemory(&record, sizeof(record));
+    record.Timestamp = AsyncLogNow();
+    record.Priority = PRIORITY_ERROR;
+    record.Format = "AsyncLog(): %u more threads got no log ring, all %d are in use. Their records are dropped";
+    record.ArgCount = 2;
+    record.Args[0] = noRingThreads - sReportedNoRingThreads;
+    record.Args[1] = ASYNCLOG_MAX_RINGS;
+    sReportedNoRingThreads = noRingThreads;
+
+    AsyncLogAppendLine(&record);
+  }
+
+  // Records of threads without a ring are covered above
+  AsyncLogGetStats(&stats);
+  fullDrops = stats.Dropped - ASYNCLOG_LOAD_ACQUIRE(&sNoRingDropped);
+  if (fullDrops == sReportedDrops)
+  {
+    return;
+  }
+
+  ZeroMemory(&record, sizeof(record));
+  record.Timestamp = AsyncLogNow();
+  record.Priority = PRIORITY_ERROR;
+  record.Format = "AsyncLog(): %llu log records dropped, rings are full";
+  record.ArgCount = 1;
+  record.Args[0] = fullDrops - sReportedDrops;
+  sReportedDrops = fullDrops;
+
+  AsyncLogAppendLine(&record);
+}
+
+
+static void AsyncLogAppendLine(PASYNCLOG_RECORD recordParam)
+{
+  if (sBatchLength > ASYNCLOG_BATCH_SIZE - ASYNCLOG_MAX_LINE)
+  {
+    AsyncLogFlushBatch();
+  }
+
+  sBatchLength += AsyncLogFormatLine(recordParam, &sTimeCache, sBatch + sBatchLength, ASYNCLOG_BATCH_SIZE - sBatchLength);
+}
+
+
+/*
+ * "MM/DD/YY HH:MM:SS.mmm PRIORITY: message\n"
+ *
+ */
+static int AsyncLogFormatLine(PASYNCLOG_RECORD recordParam, PTIME_CACHE timeCacheParam, char *outputParam, int outputSizeParam)
+{
+  char timeStamp[64];
+  char *priority = "";
+  int retVal = 0;
+
+  if (outputSizeParam > ASYNCLOG_MAX_LINE)
+  {
+    outputSizeParam = ASYNCLOG_MAX_LINE;
+  }
+
+  if (recordParam->Priority >= 0 &&
+      recordParam->Priority < (int)(sizeof(sPriorityNames) / sizeof(sPriorityNames[0])))
+  {
+    priority = sPriorityNames[recordParam->Priority];
+  }
+
+  AsyncLogFormatTime(recordParam->Timestamp, timeCacheParam, timeStamp, sizeof(timeStamp));
+  retVal = snprintf(outputParam, outputSizeParam, "%s %-7s: ", timeStamp, priority);
+  if (retVal < 0 || retVal >= outputSizeParam - 1)
+  {
+    return 0;
+  }
+
+  retVal += AsyncLogFormatRecord(recordParam, outputParam + retVal, outputSizeParam - retVal - 1);
+
+  // Callers are not consistent about trailing line breaks
+  while (retVal > 0 &&
+         (outputParam[retVal - 1] == '\n' || outputParam[retVal - 1] == '\r'))
+  {
+    retVal--;
+  }
+
+  outputParam[retVal++] = '\n';
+  outputParam[retVal] = 0;
+
+  return retVal;
+}
+
+
+static void AsyncLogFormatTime(uint64_t timestampParam, PTIME_CACHE timeCacheParam, char *outputParam, int outputSizeParam)
+{
+  TIME_CACHE localCache;
+  time_t seconds = (time_t)(timestampParam / TICKS_PER_SECOND);
+  unsigned int milliSeconds = (unsigned int)((timestampParam / 10000) % 1000);
+  struct tm localTime;
+
+  if (timeCacheParam == NULL)
+  {
+    localCache.Second = -1;
+    timeCacheParam = &localCache;
+  }
+
+  // localtime() and strftime() only once per second
+  if (timeCacheParam->Second != (int64_t)seconds)
+  {
+#ifdef _WIN32
+    localtime_s(&localTime, &seconds);
+#else
+    localtime_r(&seconds, &localTime);
+#endif
+    strftime(timeCacheParam->Text, sizeof(timeCacheParam->Text), "%m/%d/%y %H:%M:%S", &localTime);
+    timeCacheParam->Second = (int64_t)seconds;
+  }
+
+  snprintf(outputParam, outputSizeParam, "%s.%03u", timeCacheParam->Text, milliSeconds);
+}
+
+
+static void AsyncLogWriteOutput(char *dataParam, int dataLengthParam)
+{
+  if (dataLengthParam <= 0)
+  {
+    return;
+  }
+
+  if (sConsoleOutput == TRUE)
+  {
+    fwrite(dataParam, 1, dataLengthParam, stdout);
+    fflush(stdout);
+  }
+
+  if (sLogFile != NULL)
+  {
+    fwrite(dataParam, 1, dataLengthParam, sLogFile);
+    fflush(sLogFile);
+  }
+}
+
+
+static void AsyncLogFlushBatch()
+{
+  if (sBatchLength > 0)
+  {
+    AsyncLogWriteOutput(sBatch, sBatchLength);
+    sBatchLength = 0;
+    sBatchCount++;
+  }
+
+  ASYNCLOG_STORE_RELEASE(&sFlushedRecords, sConsumedRecords);
+}
+
+
+/*
+ * Formatter thread
+ *
+ */
+#ifdef _WIN32
+static DWORD WINAPI AsyncLogThread(LPVOID param)
+#else
+static void *AsyncLogThread(void *param)
+#endif
+{
+  unsigned int stopRequested = FALSE;
+
+  while (TRUE)
+  {
+    stopRequested = ASYNCLOG_LOAD_ACQUIRE(&sStopRequested);
+
+    // Everything that piled up since the last pass
+    // goes out as one batch.
+    if (AsyncLogDrain() > 0)
+    {
+      AsyncLogFlushBatch();
+      continue;
+    }
+
+    AsyncLogReportDrops();
+    AsyncLogFlushBatch();
+
+    if (stopRequested == TRUE)
+    {
+      break;
+    }
+
+    Sleep(ASYNCLOG_IDLE_SLEEP);
+  }
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#include "Platform.h"
+
+/*
+ * Asynchronous logger shared by the tools' LogMsg().
+ *
+ * The calling thread only stores the format pointer, a timestamp and
+ * the raw arguments in a fixed size record. Every thread owns a
+ * single producer/single consumer ring of these records, so writing
+ * a record needs neither a lock nor a system call. One background
+ * thread merges the rings by timestamp, formats the records and
+ * writes them to the console and the logfile in batches.
+ *
+ * There are at most ASYNCLOG_MAX_RINGS rings. A thread gives its
+ * ring back when it exits and a later thread reuses it. Threads
+ * beyond that many live loggers get no ring, their records are
+ * dropped and reported once per thread.
+ *
+ * Format strings must be string literals. Only the pointer is kept
+ * and the text is read again when the record is formatted. %s
+ * arguments are copied into the record, all strings of one record
+ * share ASYNCLOG_STRING_SPACE bytes. If a ring is full the record is
+ * dropped and counted, the packet thread never waits.
+ *
+ * Before AsyncLogStart() and after AsyncLogStop() records are
+ * formatted and written right away on the calling thread.
+ *
+ */
+
+#define ASYNCLOG_RING_SIZE 4096
+#define ASYNCLOG_MAX_RINGS 64
+#define ASYNCLOG_MAX_ARGS 12
+#define ASYNCLOG_STRING_SPACE 384
+#define ASYNCLOG_MAX_LINE 2048
+#define ASYNCLOG_BATCH_SIZE 65536
+#define ASYNCLOG_IDLE_SLEEP 1
+#define ASYNCLOG_FLUSH_TIMEOUT 2000
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  uint64_t Timestamp;
+  const char *Format;
+  int Priority;
+  int ArgCount;
+  uint64_t Args[ASYNCLOG_MAX_ARGS];
+  unsigned int StringLength;
+  char Strings[ASYNCLOG_STRING_SPACE];
+} ASYNCLOG_RECORD, *PASYNCLOG_RECORD;
+
+
+typedef struct
+{
+  uint64_t Records;
+  uint64_t Dropped;
+  uint64_t Batches;
+  unsigned int Rings;
+} ASYNCLOG_STATS, *PASYNCLOG_STATS;
+
+
+/*
+ * Function forward declarations.
+ *
+ */
+BOOL AsyncLogStart(char *logFileParam, BOOL consoleOutputParam);
+void AsyncLogStop();
+BOOL AsyncLogFlush();
+void AsyncLogWrite(int priorityParam, const char *formatParam, ...);
+void AsyncLogWriteV(int priorityParam, const char *formatParam, va_list argsParam);
+void AsyncLogGetStats(PASYNCLOG_STATS statsParam);
+int AsyncLogFormatRecord(PASYNCLOG_RECORD recordParam, char *outputParam, int outputSizeParam);
@@ -0,0 +1,461 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define HAVE_REMOTE
+#endif
+
+#include <pcap.h>
+
+#include "Benchmark.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+// Call the real allocator in here
+#ifdef BENCHMARK_COUNT_ALLOCS
+#undef HeapAlloc
+#ifndef _WIN32
+#define HeapAlloc(heap, flags, size) calloc(1, (size))
+#endif
+#endif
+
+
+#ifdef _WIN32
+static volatile LONG64 sAllocationCount = 0;
+#else
+static volatile uint64_t sAllocationCount = 0;
+#endif
+
+static char sMicroFilter[BENCHMARK_NAME_SIZE];
+static volatile uint64_t sMicroSink = 0;
+
+static void BenchmarkBatchHandler(unsigned char *param, PCAPTURE_BATCH batchParam);
+static void BenchmarkWrite16(unsigned char *bufferParam, unsigned short valueParam);
+
+
+/*
+ * Replay all frames of replayHandle through handlerParam and
+ * collect the numbers in benchmarkRunParam.
+ *
+ */
+BOOL BenchmarkReplay(PCAPTURE_HANDLE replayHandle, char *nameParam, BENCHMARK_PACKET_HANDLER handlerParam, unsigned char *handlerArgParam, PBENCHMARK_RUN benchmarkRunParam)
+{
+  BOOL retVal = FALSE;
+  uint64_t startTime = 0;
+  uint64_t startAllocations = 0;
+  uint64_t startSentPackets = 0;
+  uint64_t startSentBytes = 0;
+  uint64_t sentPackets = 0;
+  uint64_t sentBytes = 0;
+
+  if (replayHandle == NULL ||
+      handlerParam == NULL ||
+      benchmarkRunParam == NULL)
+  {
+    goto END;
+  }
+
+  ZeroMemory(benchmarkRunParam, sizeof(BENCHMARK_RUN));
+  HistogramReset(&benchmarkRunParam->Latency);
+  benchmarkRunParam->Name = nameParam;
+  benchmarkRunParam->Handler = handlerParam;
+  benchmarkRunParam->HandlerArg = handlerArgParam;
+
+  CaptureGetSentCounters(replayHandle, &startSentPackets, &startSentBytes);
+  startAllocations = BenchmarkGetAllocationCount();
+  startTime = BenchmarkNow();
+
+  if (CaptureDispatchLoop(replayHandle, BenchmarkBatchHandler, (unsigned char *)benchmarkRunParam) == CAPTURE_ERROR)
+  {
+    goto END;
+  }
+
+  benchmarkRunParam->ElapsedNs = BenchmarkNow() - startTime;
+  benchmarkRunParam->Allocations = BenchmarkGetAllocationCount() - startAllocations;
+  CaptureGetSentCounters(replayHandle, &sentPackets, &sentBytes);
+  benchmarkRunParam->SentPackets = sentPackets - startSentPackets;
+  benchmarkRunParam->SentBytes = sentBytes - startSentBytes;
+  retVal = TRUE;
+
+END:
+
+  return retVal;
+}
+
+
+void BenchmarkPrintReport(PBENCHMARK_RUN benchmarkRunParam)
+{
+  double packets = (double)benchmarkRunParam->Packets;
+  double seconds = (double)benchmarkRunParam->ElapsedNs / 1e9;
+
+  printf("%s\n", benchmarkRunParam->Name);
+  printf("  packets      : %llu (%llu bytes)\n", (unsigned long long)benchmarkRunParam->Packets, (unsigned long long)benchmarkRunParam->Bytes);
+
+  if (benchmarkRunParam->Packets == 0)
+  {
+    printf("\n");
+    return;
+  }
+
+  printf("  throughput   : %.0f pps, %.1f ns/packet\n", seconds > 0 ? packets / seconds : 0, (double)benchmarkRunParam->ElapsedNs / packets);
+
+  if (BenchmarkCountsAllocations() == TRUE)
+  {
+    printf("  allocations  : %.3f per packet\n", (double)benchmarkRunParam->Allocations / packets);
+  }
+  else
+  {
+    printf("  allocations  : n/a (build with BENCHMARK_COUNT_ALLOCS)\n");
+  }
+
+  printf("  latency      : p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n",
+    (unsigned long long)HistogramPercentile(&benchmarkRunParam->Latency, 50.0),
+    (unsigned long long)HistogramPercentile(&benchmarkRunParam->Latency, 99.0),
+    (unsigned long long)HistogramPercentile(&benchmarkRunParam->Latency, 99.9),
+    (unsigned long long)benchmarkRunParam->Latency.MaxValue);
+  printf("  sent         : %llu packets (%llu bytes)\n\n", (unsigned long long)benchmarkRunParam->SentPackets, (unsigned long long)benchmarkRunParam->SentBytes);
+}
+
+
+/*
+ * Print the table header of a group of microbenchmarks.
+ * filterParam may be NULL, all benchmarks run then.
+ *
+ */
+void BenchmarkMicroStart(char *titleParam, char *filterParam)
+{
+  ZeroMemory(sMicroFilter, sizeof(sMicroFilter));
+
+  if (filterParam != NULL)
+  {
+    strncpy(sMicroFilter, filterParam, sizeof(sMicroFilter) - 1);
+  }
+
+  printf("%s\n", titleParam);
+  printf("  %-40s %12s %12s %12s\n", "benchmark", "ns/op", "allocs/op", "iterations");
+}
+
+
+/*
+ * TRUE if <primitive>/<size> passes the filter. Lets the
+ * caller skip setting up inputs nobody asked for.
+ *
+ */
+BOOL BenchmarkMicroSelected(char *primitiveParam, int sizeParam)
+{
+  char name[BENCHMARK_NAME_SIZE];
+
+  if (sMicroFilter[0] == 0)
+  {
+    return TRUE;
+  }
+
+  ZeroMemory(name, sizeof(name));
+  _snprintf(name, sizeof(name) - 1, "%s/%d", primitiveParam, sizeParam);
+
+  return strstr(name, sMicroFilter) != NULL ? TRUE : FALSE;
+}
+
+
+/*
+ * Run handlerParam with growing iteration counts until one
+ * run lasts BENCHMARK_MICRO_MIN_TIME and print its numbers.
+ * Returns FALSE if the benchmark was filtered out.
+ *
+ */
+BOOL BenchmarkMicro(char *primitiveParam, int sizeParam, BENCHMARK_MICRO_HANDLER handlerParam, void *contextParam)
+{
+  char name[BENCHMARK_NAME_SIZE];
+  uint64_t iterations = 1;
+  uint64_t nextIterations = 0;
+  uint64_t startTime = 0;
+  uint64_t startAllocations = 0;
+  uint64_t elapsedNs = 0;
+  uint64_t allocations = 0;
+
+  if (handlerParam == NULL ||
+      BenchmarkMicroSelected(primitiveParam, sizeParam) == FALSE)
+  {
+    return FALSE;
+  }
+
+  ZeroMemory(name, sizeof(name));
+  _snprintf(name, sizeof(name) - 1, "%s/%d", primitiveParam, sizeParam);
+
+  while (TRUE)
+  {
+    startAllocations = BenchmarkGetAllocationCount();
+    startTime = BenchmarkNow();
+    sMicroSink += handlerParam(contextParam, iterations);
+    elapsedNs = BenchmarkNow() - startTime;
+    allocations = BenchmarkGetAllocationCount() - startAllocations;
+
+    if (elapsedNs >= BENCHMARK_MICRO_MIN_TIME ||
+        iterations >= BENCHMARK_MICRO_MAX_ITERATIONS)
+    {
+      break;
+    }
+
+    // Aim a bit past the minimum time, grow by 2x to 10x
+    nextIterations = elapsedNs > 0 ? iterations * (BENCHMARK_MICRO_MIN_TIME * 14 / 10) / elapsedNs : iterations * 10;
+
+    if (nextIterations < iterations * 2)
+    {
+      nextIterations = iterations * 2;
+    }
+    else if (nextIterations > iterations * 10)
+    {
+      nextIterations = iterations * 10;
+    }
+
+    iterations = nextIterations < BENCHMARK_MICRO_MAX_ITERATIONS ? nextIterations : BENCHMARK_MICRO_MAX_ITERATIONS;
+  }
+
+  if (BenchmarkCountsAllocations() == TRUE)
+  {
+    printf("  %-40s %12.1f %12.3f %12llu\n", name, (double)elapsedNs / (double)iterations, (double)allocations / (double)iterations, (unsigned long long)iterations);
+  }
+  else
+  {
+    printf("  %-40s %12.1f %12s %12llu\n", name, (double)elapsedNs / (double)iterations, "n/a", (unsigned long long)iterations);
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * Ethernet/IPv4 frame 10.0.0.1 -> 192.168.0.1 with a TCP
+ * (BENCHMARK_PROTO_TCP) or UDP header and the payload, cut to fit
+ * BENCHMARK_FRAME_SIZE. frameParam must hold
+ * BENCHMARK_FRAME_SIZE bytes. Returns the frame length.
+ *
+ */
+unsigned int BenchmarkBuildFrame(unsigned char *frameParam, unsigned char protoParam, unsigned short srcPortParam, unsigned short dstPortParam, unsigned char *payloadParam, unsigned int payloadLengthParam)
+{
+  unsigned char *ipHeader = frameParam + 14;
+  unsigned char *l4Header = ipHeader + 20;
+  unsigned int l4HeaderLength = protoParam == BENCHMARK_PROTO_TCP ? 20 : 8;
+  unsigned int checksum = 0;
+  int counter = 0;
+
+  if (payloadLengthParam > BENCHMARK_FRAME_SIZE - 14 - 20 - l4HeaderLength)
+  {
+    payloadLengthParam = BENCHMARK_FRAME_SIZE - 14 - 20 - l4HeaderLength;
+  }
+
+  ZeroMemory(frameParam, 14 + 20 + l4HeaderLength);
+
+  // 02:00:00:00:00:02 -> 02:00:00:00:00:01, IPv4
+  frameParam[0] = 0x02;
+  frameParam[5] = 0x01;
+  frameParam[6] = 0x02;
+  frameParam[11] = 0x02;
+  BenchmarkWrite16(frameParam + 12, 0x0800);
+
+  ipHeader[0] = 0x45;
+  BenchmarkWrite16(ipHeader + 2, (unsigned short)(20 + l4HeaderLength + payloadLengthParam));
+  ipHeader[8] = 64;
+  ipHeader[9] = protoParam;
+  ipHeader[12] = 10;
+  ipHeader[15] = 1;
+  ipHeader[16] = 192;
+  ipHeader[17] = 168;
+  ipHeader[19] = 1;
+
+  for (counter = 0; counter < 20; counter += 2)
+  {
+    checksum += ((unsigned int)ipHeader[counter] << 8) | ipHeader[counter + 1];
+  }
+
+  checksum = (checksum & 0xffff) + (checksum >> 16);
+  checksum = (checksum & 0xffff) + (checksum >> 16);
+  BenchmarkWrite16(ipHeader + 10, (unsigned short)~checksum);
+
+  BenchmarkWrite16(l4Header, srcPortParam);
+  BenchmarkWrite16(l4Header + 2, dstPortParam);
+
+  if (protoParam == BENCHMARK_PROTO_TCP)
+  {
+    l4Header[12] = 0x50;      // 20 byte header
+    l4Header[13] = 0x18;      // PSH, ACK
+    BenchmarkWrite16(l4Header + 14, 65535);
+  }
+  else
+  {
+    BenchmarkWrite16(l4Header + 4, (unsigned short)(8 + payloadLengthParam));
+  }
+
+  if (payloadParam != NULL && payloadLengthParam > 0)
+  {
+    CopyMemory(l4Header + l4HeaderLength, payloadParam, payloadLengthParam);
+  }
+
+  return 14 + 20 + l4HeaderLength + payloadLengthParam;
+}
+
+
+/*
+ * DNS message with a single A/IN question for hostnameParam.
+ * Returns its length, 0 if it doesn't fit or a label is
+ * longer than 63 characters.
+ *
+ */
+unsigned int BenchmarkBuildDnsQuery(unsigned char *bufferParam, unsigned int bufferSizeParam, char *hostnameParam)
+{
+  unsigned int hostnameLength = (unsigned int)strlen(hostnameParam);
+  unsigned int position = 12;
+  unsigned int labelStart = 0;
+  unsigned int counter = 0;
+
+  // Header, labels, root label, type and class
+  if (12 + hostnameLength + 2 + 4 > bufferSizeParam)
+  {
+    return 0;
+  }
+
+  ZeroMemory(bufferParam, 12);
+  BenchmarkWrite16(bufferParam, 0x1234);
+  BenchmarkWrite16(bufferParam + 2, 0x0100);    // Recursion desired
+  BenchmarkWrite16(bufferParam + 4, 1);
+
+  for (counter = 0; counter <= hostnameLength; counter++)
+  {
+    if (hostnameParam[counter] != '.' &&
+        hostnameParam[counter] != '\0')
+    {
+      continue;
+    }
+
+    if (counter - labelStart > 63)
+    {
+      return 0;
+    }
+
+    bufferParam[position++] = (unsigned char)(counter - labelStart);
+    CopyMemory(bufferParam + position, hostnameParam + labelStart, counter - labelStart);
+    position += counter - labelStart;
+    labelStart = counter + 1;
+  }
+
+  bufferParam[position++] = 0;
+  BenchmarkWrite16(bufferParam + position, 1);
+  BenchmarkWrite16(bufferParam + position + 2, 1);
+
+  return position + 4;
+}
+
+
+/*
+ * Host name of lengthParam characters (at least 13) ending in
+ * ".example.com", 15 character labels before that. bufferParam
+ * must hold lengthParam + 1 bytes.
+ *
+ */
+void BenchmarkBuildHostname(char *bufferParam, int lengthParam)
+{
+  int labelsLength = lengthParam - 12;
+  int counter = 0;
+
+  for (counter = 0; counter < labelsLength; counter++)
+  {
+    bufferParam[counter] = counter % 16 == 15 ? '.' : (char)('a' + counter % 16);
+  }
+
+  if (labelsLength > 0 &&
+      bufferParam[labelsLength - 1] == '.')
+  {
+    bufferParam[labelsLength - 1] = 'x';
+  }
+
+  strcpy(bufferParam + (labelsLength > 0 ? labelsLength : 0), ".example.com");
+}
+
+
+/*
+ * Monotonic clock in nanoseconds
+ *
+ */
+uint64_t BenchmarkNow()
+{
+#ifdef _WIN32
+  static LARGE_INTEGER frequency = { 0 };
+  LARGE_INTEGER counter;
+
+  if (frequency.QuadPart == 0)
+  {
+    QueryPerformanceFrequency(&frequency);
+  }
+
+  QueryPerformanceCounter(&counter);
+
+  return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+         (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (uint64_t)frequency.QuadPart;
+#else
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+
+BOOL BenchmarkCountsAllocations()
+{
+#ifdef BENCHMARK_COUNT_ALLOCS
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+
+uint64_t BenchmarkGetAllocationCount()
+{
+  return (uint64_t)sAllocationCount;
+}
+
+
+void *BenchmarkHeapAlloc(void *heapParam, DWORD flagsParam, size_t sizeParam)
+{
+#ifdef _WIN32
+  InterlockedIncrement64(&sAllocationCount);
+#else
+  __atomic_fetch_add(&sAllocationCount, 1, __ATOMIC_RELAXED);
+#endif
+
+  return HeapAlloc(heapParam, flagsParam, sizeParam);
+}
+
+
+
+/*
+ * Capture layer callback. Times every single handler call.
+ *
+ */
+static void BenchmarkBatchHandler(unsigned char *param, PCAPTURE_BATCH batchParam)
+{
+  PBENCHMARK_RUN benchmarkRun = (PBENCHMARK_RUN)param;
+  uint64_t startTime = 0;
+  int counter = 0;
+
+  for (counter = 0; counter < batchParam->FrameCount; counter++)
+  {
+    startTime = BenchmarkNow();
+    benchmarkRun->Handler(benchmarkRun->HandlerArg, batchParam->Headers[counter], batchParam->Frames[counter]);
+    HistogramRecord(&benchmarkRun->Latency, BenchmarkNow() - startTime);
+
+    benchmarkRun->Packets++;
+    benchmarkRun->Bytes += batchParam->Headers[counter]->caplen;
+  }
+}
+
+
+static void BenchmarkWrite16(unsigned char *bufferParam, unsigned short valueParam)
+{
+  bufferParam[0] = (unsigned char)(valueParam >> 8);
+  bufferParam[1] = (unsigned char)valueParam;
+}
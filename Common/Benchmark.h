@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Platform.h"
+#include "Histogram.h"
+#include "PacketCapture.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Replay benchmark for packet handlers.
+ *
+ * BenchmarkReplay() feeds every frame of a replay capture handle
+ * (see CaptureOpenReplay()) to a per-packet handler, times each call
+ * and reports throughput and latency percentiles. Frames the handler
+ * sends through the replay handle end in its null sink and are only
+ * counted.
+ *
+ * Heap allocations are counted if the tool is built with
+ * BENCHMARK_COUNT_ALLOCS defined. Platform.h then routes HeapAlloc()
+ * through BenchmarkHeapAlloc(). malloc() calls are not seen.
+ *
+ * BenchmarkMicro() times a single primitive (a parser, a lookup,
+ * a checksum) the way Google Benchmark does: the handler runs the
+ * primitive a given number of times, the count grows until one run
+ * takes BENCHMARK_MICRO_MIN_TIME. Every benchmark is named
+ * <primitive>/<size>, size being the input length or table size,
+ * and only runs if its name contains the filter passed to
+ * BenchmarkMicroStart().
+ *
+ */
+
+#define BENCHMARK_MICRO_MIN_TIME 200000000ULL   // ns
+#define BENCHMARK_MICRO_MAX_ITERATIONS 1000000000ULL
+#define BENCHMARK_NAME_SIZE 64
+#define BENCHMARK_FRAME_SIZE 1514
+#define BENCHMARK_PROTO_TCP 6
+#define BENCHMARK_PROTO_UDP 17
+
+// Same signature as the pcap_handler style per-packet callbacks
+typedef void(*BENCHMARK_PACKET_HANDLER)(unsigned char *param, const struct pcap_pkthdr *pktHeader, const unsigned char *data);
+
+// Runs the primitive iterationsParam times. The return value is folded
+// into a sink so the compiler can't drop the calls.
+typedef uint64_t(*BENCHMARK_MICRO_HANDLER)(void *contextParam, uint64_t iterationsParam);
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  char *Name;
+  BENCHMARK_PACKET_HANDLER Handler;
+  unsigned char *HandlerArg;
+  uint64_t Packets;
+  uint64_t Bytes;
+  uint64_t ElapsedNs;
+  uint64_t Allocations;
+  uint64_t SentPackets;
+  uint64_t SentBytes;
+  HISTOGRAM Latency;
+} BENCHMARK_RUN, *PBENCHMARK_RUN;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+void BenchmarkMicroStart(char *titleParam, char *filterParam);
+BOOL BenchmarkMicroSelected(char *primitiveParam, int sizeParam);
+BOOL BenchmarkMicro(char *primitiveParam, int sizeParam, BENCHMARK_MICRO_HANDLER handlerParam, void *contextParam);
+unsigned int BenchmarkBuildFrame(unsigned char *frameParam, unsigned char protoParam, unsigned short srcPortParam, unsigned short dstPortParam, unsigned char *payloadParam, unsigned int payloadLengthParam);
+unsigned int BenchmarkBuildDnsQuery(unsigned char *bufferParam, unsigned int bufferSizeParam, char *hostnameParam);
+void BenchmarkBuildHostname(char *bufferParam, int lengthParam);
+BOOL BenchmarkReplay(PCAPTURE_HANDLE replayHandle, char *nameParam, BENCHMARK_PACKET_HANDLER handlerParam, unsigned char *handlerArgParam, PBENCHMARK_RUN benchmarkRunParam);
+void BenchmarkPrintReport(PBENCHMARK_RUN benchmarkRunParam);
+uint64_t BenchmarkNow();
+BOOL BenchmarkCountsAllocations();
+uint64_t BenchmarkGetAllocationCount();
+void *BenchmarkHeapAlloc(void *heapParam, DWORD flagsParam, size_t sizeParam);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,474 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CaptureStats.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#endif
+
+
+#ifdef _WIN32
+#define CAPTURE_STATS_LOCK() AcquireSRWLockExclusive(&sSourcesLock)
+#define CAPTURE_STATS_UNLOCK() ReleaseSRWLockExclusive(&sSourcesLock)
+#define CAPTURE_STATS_LOAD_ACQUIRE(ptr) ((unsigned int)InterlockedCompareExchange((volatile LONG *)(ptr), 0, 0))
+#define CAPTURE_STATS_STORE_RELEASE(ptr, value) InterlockedExchange((volatile LONG *)(ptr), (LONG)(value))
+#else
+#define CAPTURE_STATS_LOCK() pthread_mutex_lock(&sSourcesLock)
+#define CAPTURE_STATS_UNLOCK() pthread_mutex_unlock(&sSourcesLock)
+#define CAPTURE_STATS_LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define CAPTURE_STATS_STORE_RELEASE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#endif
+
+#define SOURCE_HANDLE 0
+#define SOURCE_STAGE  1
+#define SOURCE_QUEUE  2
+
+
+/*
+ * Type definitions
+ *
+ */
+
+// Key identifies the source for CaptureStatsRemove(): the capture
+// handle, the packet counter or the queue handler's context.
+typedef struct
+{
+  int Type;
+  char Name[CAPTURE_STATS_NAME_SIZE];
+  void *Key;
+  PCAPTURE_HANDLE CaptureHandle;
+  uint64_t *Packets;
+  uint64_t *Bytes;
+  CAPTURE_STATS_QUEUE_HANDLER QueueHandler;
+  CAPTURE_STATS LastCapture;
+  uint64_t LastPackets;
+  uint64_t LastBytes;
+  uint64_t LastDrops;
+} CAPTURE_STATS_SOURCE, *PCAPTURE_STATS_SOURCE;
+
+
+static CAPTURE_STATS_SOURCE sSources[CAPTURE_STATS_MAX_SOURCES];
+static int sSourceCount = 0;
+static CAPTURE_STATS_LOG_HANDLER sLogHandler = NULL;
+static uint64_t sLastReportAt = 0;
+static int sInterval = 0;
+static double sThreshold = CAPTURE_STATS_DEFAULT_THRESHOLD;
+static volatile unsigned int sStopRequested = FALSE;
+static BOOL sRunning = FALSE;
+
+#ifdef _WIN32
+static SRWLOCK sSourcesLock = SRWLOCK_INIT;
+static HANDLE sThreadHandle = NULL;
+#else
+static pthread_mutex_t sSourcesLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t sThreadHandle;
+#endif
+
+
+static BOOL CaptureStatsAdd(PCAPTURE_STATS_SOURCE sourceParam);
+static void CaptureStatsLog(BOOL warningParam, char *messageParam);
+static uint64_t CaptureStatsNow();
+static double CaptureStatsMbits(uint64_t bytesParam, uint64_t elapsedMsParam);
+#ifdef _WIN32
+static DWORD WINAPI CaptureStatsThread(LPVOID param);
+#else
+static void *CaptureStatsThread(void *param);
+#endif
+
+
+/*
+ * CAPTURE_STATS_ENV is read once.
+ *
+ */
+BOOL CaptureStatsEnabled()
+{
+  char *interval = NULL;
+
+  if (sInterval == 0 &&
+      (interval = getenv(CAPTURE_STATS_ENV)) != NULL)
+  {
+    sInterval = atoi(interval) > 0 ? atoi(interval) : -1;
+  }
+
+  return sInterval > 0 ? TRUE : FALSE;
+}
+
+
+/*
+ * Start the monitor thread if CAPTURE_STATS_ENV asks for it.
+ * Without logHandlerParam the reports go to stdout.
+ *
+ */
+BOOL CaptureStatsStart(CAPTURE_STATS_LOG_HANDLER logHandlerParam)
+{
+  char *threshold = NULL;
+
+  if (sRunning == TRUE ||
+      CaptureStatsEnabled() == FALSE)
+  {
+    return FALSE;
+  }
+
+  if ((threshold = getenv(CAPTURE_STATS_THRESHOLD_ENV)) != NULL &&
+      atof(threshold) >= 0.0)
+  {
+    sThreshold = atof(threshold);
+  }
+
+  sLogHandler = logHandlerParam;
+  sLastReportAt = CaptureStatsNow();
+  CAPTURE_STATS_STORE_RELEASE(&sStopRequested, FALSE);
+
+#ifdef _WIN32
+  if ((sThreadHandle = CreateThread(NULL, 0, CaptureStatsThread, NULL, 0, NULL)) == NULL)
+  {
+    return FALSE;
+  }
+#else
+  if (pthread_create(&sThreadHandle, NULL, CaptureStatsThread, NULL) != 0)
+  {
+    return FALSE;
+  }
+#endif
+
+  sRunning = TRUE;
+
+  return TRUE;
+}
+
+
+/*
+ * Stop the monitor thread and log what happened since the
+ * last report. Must run before the registered handles are
+ * closed.
+ *
+ */
+void CaptureStatsStop()
+{
+  if (sRunning == FALSE)
+  {
+    return;
+  }
+
+  CAPTURE_STATS_STORE_RELEASE(&sStopRequested, TRUE);
+
+#ifdef _WIN32
+  WaitForSingleObject(sThreadHandle, INFINITE);
+  CloseHandle(sThreadHandle);
+  sThreadHandle = NULL;
+#else
+  pthread_join(sThreadHandle, NULL);
+#endif
+
+  sRunning = FALSE;
+  CaptureStatsReport();
+}
+
+
+BOOL CaptureStatsAddHandle(char *nameParam, PCAPTURE_HANDLE captureHandle)
+{
+  CAPTURE_STATS_SOURCE source;
+
+  if (nameParam == NULL ||
+      captureHandle == NULL)
+  {
+    return FALSE;
+  }
+
+  ZeroMemory(&source, sizeof(source));
+  source.Type = SOURCE_HANDLE;
+  strncpy(source.Name, nameParam, sizeof(source.Name) - 1);
+  source.Key = captureHandle;
+  source.CaptureHandle = captureHandle;
+
+  return CaptureStatsAdd(&source);
+}
+
+
+/*
+ * packetsParam and bytesParam (optional) stay owned by the
+ * caller and must stay valid until CaptureStatsRemove()
+ * with packetsParam.
+ *
+ */
+BOOL CaptureStatsAddStage(char *nameParam, uint64_t *packetsParam, uint64_t *bytesParam)
+{
+  CAPTURE_STATS_SOURCE source;
+
+  if (nameParam == NULL ||
+      packetsParam == NULL)
+  {
+    return FALSE;
+  }
+
+  ZeroMemory(&source, sizeof(source));
+  source.Type = SOURCE_STAGE;
+  strncpy(source.Name, nameParam, sizeof(source.Name) - 1);
+  source.Key = packetsParam;
+  source.Packets = packetsParam;
+  source.Bytes = bytesParam;
+
+  return CaptureStatsAdd(&source);
+}
+
+
+BOOL CaptureStatsAddQueue(char *nameParam, CAPTURE_STATS_QUEUE_HANDLER handlerParam, void *contextParam)
+{
+  CAPTURE_STATS_SOURCE source;
+
+  if (nameParam == NULL ||
+      handlerParam == NULL)
+  {
+    return FALSE;
+  }
+
+  ZeroMemory(&source, sizeof(source));
+  source.Type = SOURCE_QUEUE;
+  strncpy(source.Name, nameParam, sizeof(source.Name) - 1);
+  source.Key = contextParam;
+  source.QueueHandler = handlerParam;
+
+  return CaptureStatsAdd(&source);
+}
+
+
+/*
+ * Forget every source registered with sourceParam (capture
+ * handle, packet counter or queue context).
+ *
+ */
+void CaptureStatsRemove(void *sourceParam)
+{
+  int counter = 0;
+
+  CAPTURE_STATS_LOCK();
+
+  while (counter < sSourceCount)
+  {
+    if (sSources[counter].Key == sourceParam)
+    {
+      memmove(&sSources[counter], &sSources[counter + 1], (sSourceCount - counter - 1) * sizeof(CAPTURE_STATS_SOURCE));
+      sSourceCount--;
+    }
+    else
+    {
+      counter++;
+    }
+  }
+
+  CAPTURE_STATS_UNLOCK();
+}
+
+
+/*
+ * Log the differences of all sources to the previous report.
+ *
+ */
+void CaptureStatsReport()
+{
+  char lines[CAPTURE_STATS_MAX_SOURCES + 1][CAPTURE_STATS_LINE_SIZE];
+  PCAPTURE_STATS_SOURCE source = NULL;
+  CAPTURE_STATS captureStats;
+  CAPTURE_STATS_QUEUE queueStats;
+  uint64_t now = CaptureStatsNow();
+  uint64_t elapsed = 0;
+  uint64_t frames = 0;
+  uint64_t drops = 0;
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  uint64_t kernelDrops = 0;
+  uint64_t interfaceDrops = 0;
+  double dropRate = 0.0;
+  BOOL warning = FALSE;
+  int lineCount = 0;
+  int counter = 0;
+
+  CAPTURE_STATS_LOCK();
+
+  elapsed = now - sLastReportAt > 0 ? now - sLastReportAt : 1;
+  sLastReportAt = now;
+
+  for (counter = 0; counter < sSourceCount; counter++)
+  {
+    source = &sSources[counter];
+    ZeroMemory(lines[lineCount + 1], CAPTURE_STATS_LINE_SIZE);
+
+    if (source->Type == SOURCE_HANDLE)
+    {
+      CaptureGetStats(source->CaptureHandle, &captureStats);
+      packets = captureStats.ReceivedPackets - source->LastCapture.ReceivedPackets;
+      bytes = captureStats.ReceivedBytes - source->LastCapture.ReceivedBytes;
+      kernelDrops = captureStats.KernelDrops - source->LastCapture.KernelDrops;
+      interfaceDrops = captureStats.InterfaceDrops - source->LastCapture.InterfaceDrops;
+      frames += packets + kernelDrops + interfaceDrops;
+      drops += kernelDrops + interfaceDrops;
+
+      _snprintf(lines[lineCount + 1], CAPTURE_STATS_LINE_SIZE - 1, "  %-20s rx %llu pkts (%llu/s, %.1f Mbit/s), %llu kernel drops, %llu interface drops, tx %llu pkts (%.1f Mbit/s)",
+        source->Name, (unsigned long long)packets, (unsigned long long)(packets * 1000 / elapsed), CaptureStatsMbits(bytes, elapsed),
+        (unsigned long long)kernelDrops, (unsigned long long)interfaceDrops,
+        (unsigned long long)(captureStats.SentPackets - source->LastCapture.SentPackets), CaptureStatsMbits(captureStats.SentBytes - source->LastCapture.SentBytes, elapsed));
+
+      CopyMemory(&source->LastCapture, &captureStats, sizeof(CAPTURE_STATS));
+    }
+    else if (source->Type == SOURCE_STAGE)
+    {
+      packets = *source->Packets - source->LastPackets;
+      source->LastPackets += packets;
+
+      if (source->Bytes != NULL)
+      {
+        bytes = *source->Bytes - source->LastBytes;
+        source->LastBytes += bytes;
+        _snprintf(lines[lineCount + 1], CAPTURE_STATS_LINE_SIZE - 1, "  %-20s %llu pkts (%llu/s, %.1f Mbit/s)",
+          source->Name, (unsigned long long)packets, (unsigned long long)(packets * 1000 / elapsed), CaptureStatsMbits(bytes, elapsed));
+      }
+      else
+      {
+        _snprintf(lines[lineCount + 1], CAPTURE_STATS_LINE_SIZE - 1, "  %-20s %llu pkts (%llu/s)",
+          source->Name, (unsigned long long)packets, (unsigned long long)(packets * 1000 / elapsed));
+      }
+    }
+    else
+    {
+      ZeroMemory(&queueStats, sizeof(queueStats));
+      source->QueueHandler(source->Key, &queueStats);
+      drops += queueStats.Drops - source->LastDrops;
+
+      _snprintf(lines[lineCount + 1], CAPTURE_STATS_LINE_SIZE - 1, "  %-20s depth %llu/%llu, %llu drops",
+        source->Name, (unsigned long long)queueStats.Depth, (unsigned long long)queueStats.Capacity, (unsigned long long)(queueStats.Drops - source->LastDrops));
+
+      source->LastDrops = queueStats.Drops;
+    }
+
+    lineCount++;
+  }
+
+  CAPTURE_STATS_UNLOCK();
+
+  if (lineCount == 0)
+  {
+    return;
+  }
+
+  // Queue drops were received, they are part of frames already
+  if (frames > 0)
+  {
+    dropRate = (double)drops * 100.0 / (double)frames;
+  }
+
+  warning = (drops > 0 && (frames == 0 || dropRate > sThreshold)) ? TRUE : FALSE;
+
+  ZeroMemory(lines[0], CAPTURE_STATS_LINE_SIZE);
+  _snprintf(lines[0], CAPTURE_STATS_LINE_SIZE - 1, "Capture stats (%.1fs): %llu frames, %llu dropped (%.3f%%)%s",
+    (double)elapsed / 1000.0, (unsigned long long)frames, (unsigned long long)drops, dropRate, warning == TRUE ? ", OVERLOAD" : "");
+
+  for (counter = 0; counter <= lineCount; counter++)
+  {
+    CaptureStatsLog(warning, lines[counter]);
+  }
+}
+
+
+
+static BOOL CaptureStatsAdd(PCAPTURE_STATS_SOURCE sourceParam)
+{
+  BOOL retVal = FALSE;
+
+  CAPTURE_STATS_LOCK();
+
+  if (sSourceCount < CAPTURE_STATS_MAX_SOURCES)
+  {
+    // Count from now on
+    if (sourceParam->Type == SOURCE_HANDLE)
+    {
+      CaptureGetStats(sourceParam->CaptureHandle, &sourceParam->LastCapture);
+    }
+    else if (sourceParam->Type == SOURCE_STAGE)
+    {
+      sourceParam->LastPackets = *sourceParam->Packets;
+      sourceParam->LastBytes = sourceParam->Bytes != NULL ? *sourceParam->Bytes : 0;
+    }
+
+    CopyMemory(&sSources[sSourceCount++], sourceParam, sizeof(CAPTURE_STATS_SOURCE));
+    retVal = TRUE;
+  }
+
+  CAPTURE_STATS_UNLOCK();
+
+  return retVal;
+}
+
+
+static void CaptureStatsLog(BOOL warningParam, char *messageParam)
+{
+  if (sLogHandler != NULL)
+  {
+    sLogHandler(warningParam, messageParam);
+  }
+  else
+  {
+    printf("%s\n", messageParam);
+  }
+}
+
+
+/*
+ * Monotonic clock in milliseconds
+ *
+ */
+static uint64_t CaptureStatsNow()
+{
+#ifdef _WIN32
+  static LARGE_INTEGER frequency = { 0 };
+  LARGE_INTEGER counter;
+
+  if (frequency.QuadPart == 0)
+  {
+    QueryPerformanceFrequency(&frequency);
+  }
+
+  QueryPerformanceCounter(&counter);
+
+  return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000ULL +
+         (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000ULL / (uint64_t)frequency.QuadPart;
+#else
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000ULL + (uint64_t)now.tv_nsec / 1000000;
+#endif
+}
+
+
+static double CaptureStatsMbits(uint64_t bytesParam, uint64_t elapsedMsParam)
+{
+  return (double)bytesParam * 8.0 / ((double)elapsedMsParam * 1000.0);
+}
+
+
+#ifdef _WIN32
+static DWORD WINAPI CaptureStatsThread(LPVOID param)
+#else
+static void *CaptureStatsThread(void *param)
+#endif
+{
+  while (CAPTURE_STATS_LOAD_ACQUIRE(&sStopRequested) == FALSE)
+  {
+    Sleep(CAPTURE_STATS_POLL_STEP);
+
+    if (CaptureStatsNow() - sLastReportAt >= (uint64_t)sInterval * 1000)
+    {
+      CaptureStatsReport();
+    }
+  }
+
+#ifdef _WIN32
+  return 0;
+#else
+  return NULL;
+#endif
+}
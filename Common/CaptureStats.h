@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Platform.h"
+#include "PacketCapture.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Drop and backpressure accounting for the capture loops.
+ *
+ * A tool registers what it wants watched:
+ *
+ *  - capture handles: received packets/bytes, kernel and
+ *    interface drops, sent packets/bytes (CaptureGetStats())
+ *  - stages: packet and byte counters the tool keeps anyway,
+ *    registered by address (e.g. the packets a worker forwarded)
+ *  - queues: a handler reporting the current depth, capacity
+ *    and drops of a user space queue (e.g. a worker's ring)
+ *
+ * A monitor thread reads all of them every CAPTURE_STATS_ENV
+ * seconds and logs the differences to the previous report. If
+ * the frames dropped in an interval (kernel, interface and queue
+ * drops) exceed CAPTURE_STATS_THRESHOLD_ENV percent of the frames
+ * seen, the report is logged as a warning. The counters are read
+ * while their owners write them, a report may be off by the
+ * packets of one batch.
+ *
+ */
+
+// Report interval in seconds. Unset or 0: no monitor thread.
+#define CAPTURE_STATS_ENV "CAPTURE_STATS"
+// Drop percentage that turns a report into a warning
+#define CAPTURE_STATS_THRESHOLD_ENV "CAPTURE_STATS_THRESHOLD"
+
+#define CAPTURE_STATS_DEFAULT_THRESHOLD 0.1   // %
+#define CAPTURE_STATS_MAX_SOURCES 64
+#define CAPTURE_STATS_NAME_SIZE 32
+#define CAPTURE_STATS_LINE_SIZE 320
+#define CAPTURE_STATS_POLL_STEP 200           // ms
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  uint64_t Depth;
+  uint64_t Capacity;
+  uint64_t Drops;
+} CAPTURE_STATS_QUEUE, *PCAPTURE_STATS_QUEUE;
+
+// Called on the monitor thread, fills in queueParam
+typedef void(*CAPTURE_STATS_QUEUE_HANDLER)(void *contextParam, PCAPTURE_STATS_QUEUE queueParam);
+
+// Receives every report line. warningParam is set for the lines
+// of an interval with too many drops.
+typedef void(*CAPTURE_STATS_LOG_HANDLER)(BOOL warningParam, char *messageParam);
+
+
+/*
+ * Function forward declarations
+ *
+ */
+BOOL CaptureStatsEnabled();
+BOOL CaptureStatsStart(CAPTURE_STATS_LOG_HANDLER logHandlerParam);
+void CaptureStatsStop();
+BOOL CaptureStatsAddHandle(char *nameParam, PCAPTURE_HANDLE captureHandle);
+BOOL CaptureStatsAddStage(char *nameParam, uint64_t *packetsParam, uint64_t *bytesParam);
+BOOL CaptureStatsAddQueue(char *nameParam, CAPTURE_STATS_QUEUE_HANDLER handlerParam, void *contextParam);
+void CaptureStatsRemove(void *sourceParam);
+void CaptureStatsReport();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,372 @@
+#include <string.h>
+
+#include "Checksum.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define CHECKSUM_SSE2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and clang only emit AVX2 code in functions marked for it,
+// MSVC emits whatever intrinsics it is given
+#if defined(__GNUC__)
+#define CHECKSUM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CHECKSUM_TARGET_AVX2
+#endif
+
+
+typedef uint32_t(*CHECKSUM_HANDLER)(uint32_t sumParam, const void *dataParam, unsigned int lengthParam);
+
+static CHECKSUM_HANDLER sChecksumAdd = NULL;
+static char *sChecksumImplementation = CHECKSUM_IMPL_SCALAR;
+
+
+static uint32_t ChecksumReduce(uint64_t sumParam);
+#ifdef CHECKSUM_SSE2
+static uint32_t ChecksumAddSse2(uint32_t sumParam, const void *dataParam, unsigned int lengthParam);
+static uint32_t ChecksumAddAvx2(uint32_t sumParam, const void *dataParam, unsigned int lengthParam);
+static BOOL ChecksumCpuHasAvx2();
+#endif
+
+
+/*
+ * Add lengthParam bytes to the partial sum sumParam
+ *
+ */
+uint32_t ChecksumAdd(uint32_t sumParam, const void *dataParam, unsigned int lengthParam)
+{
+  // Benign race, every thread picks the same implementation
+  if (sChecksumAdd == NULL)
+  {
+    ChecksumSelect(NULL);
+  }
+
+  return sChecksumAdd(sumParam, dataParam, lengthParam);
+}
+
+
+/*
+ * Reference implementation, one 16 bit word at a time. The
+ * vector implementations must return the same folded sums.
+ *
+ */
+uint32_t ChecksumAddScalar(uint32_t sumParam, const void *dataParam, unsigned int lengthParam)
+{
+  const unsigned char *data = (const unsigned char *)dataParam;
+  unsigned char lastWord[2] = { 0, 0 };
+  uint64_t sum = sumParam;
+  uint16_t word = 0;
+
+  while (lengthParam > 1)
+  {
+    CopyMemory(&word, data, sizeof(word));
+    sum += word;
+    data += 2;
+    lengthParam -= 2;
+  }
+
+  // Odd byte, padded with a zero byte
+  if (lengthParam == 1)
+  {
+    lastWord[0] = *data;
+    CopyMemory(&word, lastWord, sizeof(word));
+    sum += word;
+  }
+
+  return ChecksumReduce(sum);
+}
+
+
+/*
+ * Add the TCP/UDP pseudo header. The addresses are
+ * BIN_IP_LEN bytes each, lengthParam is the TCP/UDP
+ * length in host order.
+ *
+ */
+uint32_t ChecksumPseudoHeader(uint32_t sumParam, const unsigned char *srcIpBinParam, const unsigned char *dstIpBinParam, unsigned char protocolParam, unsigned short lengthParam)
+{
+  unsigned char pseudoHeader[12];
+
+  CopyMemory(pseudoHeader, srcIpBinParam, 4);
+  CopyMemory(pseudoHeader + 4, dstIpBinParam, 4);
+  pseudoHeader[8] = 0;
+  pseudoHeader[9] = protocolParam;
+  pseudoHeader[10] = (unsigned char)(lengthParam >> 8);
+  pseudoHeader[11] = (unsigned char)lengthParam;
+
+  return ChecksumAddScalar(sumParam, pseudoHeader, sizeof(pseudoHeader));
+}
+
+
+/*
+ * Fold the partial sum to 16 bits and complement it
+ *
+ */
+unsigned short ChecksumFold(uint32_t sumParam)
+{
+  sumParam = (sumParam & 0xffff) + (sumParam >> 16);
+  sumParam = (sumParam & 0xffff) + (sumParam >> 16);
+
+  return (unsigned short)~sumParam;
+}
+
+
+unsigned short ChecksumCompute(const void *dataParam, unsigned int lengthParam)
+{
+  return ChecksumFold(ChecksumAdd(0, dataParam, lengthParam));
+}
+
+
+/*
+ * RFC 1624 incremental update, eqn. 3:
+ *   HC' = ~(~HC + ~m + m')
+ * for a 16 bit field changing from m to m'
+ *
+ */
+unsigned short ChecksumUpdate16(unsigned short checksumParam, unsigned short oldValueParam, unsigned short newValueParam)
+{
+  uint32_t sum = (uint16_t)~checksumParam;
+
+  sum += (uint16_t)~oldValueParam;
+  sum += newValueParam;
+
+  return ChecksumFold(sum);
+}
+
+
+/*
+ * Same for a 32 bit field, e.g. an IP address
+ *
+ */
+unsigned short ChecksumUpdate32(unsigned short checksumParam, uint32_t oldValueParam, uint32_t newValueParam)
+{
+  uint32_t sum = (uint16_t)~checksumParam;
+
+  sum += (uint16_t)~(oldValueParam >> 16);
+  sum += (uint16_t)~oldValueParam;
+  sum += newValueParam >> 16;
+  sum += newValueParam & 0xffff;
+
+  return ChecksumFold(sum);
+}
+
+
+/*
+ * Pick the implementation ChecksumAdd() uses. NULL picks the
+ * fastest one the CPU supports. Returns FALSE if the requested
+ * implementation isn't available, the selection is unchanged then.
+ *
+ */
+BOOL ChecksumSelect(char *implementationParam)
+{
+  if (implementationParam == NULL)
+  {
+#ifdef CHECKSUM_SSE2
+    if (ChecksumCpuHasAvx2() == TRUE)
+    {
+      return ChecksumSelect(CHECKSUM_IMPL_AVX2);
+    }
+
+    return ChecksumSelect(CHECKSUM_IMPL_SSE2);
+#else
+    return ChecksumSelect(CHECKSUM_IMPL_SCALAR);
+#endif
+  }
+
+  if (strcmp(implementationParam, CHECKSUM_IMPL_SCALAR) == 0)
+  {
+    sChecksumImplementation = CHECKSUM_IMPL_SCALAR;
+    sChecksumAdd = ChecksumAddScalar;
+    return TRUE;
+  }
+
+#ifdef CHECKSUM_SSE2
+  if (strcmp(implementationParam, CHECKSUM_IMPL_SSE2) == 0)
+  {
+    sChecksumImplementation = CHECKSUM_IMPL_SSE2;
+    sChecksumAdd = ChecksumAddSse2;
+    return TRUE;
+  }
+
+  if (strcmp(implementationParam, CHECKSUM_IMPL_AVX2) == 0 &&
+      ChecksumCpuHasAvx2() == TRUE)
+  {
+    sChecksumImplementation = CHECKSUM_IMPL_AVX2;
+    sChecksumAdd = ChecksumAddAvx2;
+    return TRUE;
+  }
+#endif
+
+  return FALSE;
+}
+
+
+char *ChecksumImplementation()
+{
+  if (sChecksumAdd == NULL)
+  {
+    ChecksumSelect(NULL);
+  }
+
+  return sChecksumImplementation;
+}
+
+
+
+/*
+ * Fold a 64 bit sum of 16/32 bit words back to 32 bits. Since
+ * 2^32 - 1 is a multiple of 2^16 - 1 the 16 bit fold of the
+ * result stays the same.
+ *
+ */
+static uint32_t ChecksumReduce(uint64_t sumParam)
+{
+  sumParam = (sumParam & 0xffffffffULL) + (sumParam >> 32);
+  sumParam = (sumParam & 0xffffffffULL) + (sumParam >> 32);
+
+  return (uint32_t)sumParam;
+}
+
+
+#ifdef CHECKSUM_SSE2
+
+/*
+ * 16 bytes per load. The 32 bit words are widened to 64 bit lanes
+ * so no carry is lost, two accumulators hide the add latency.
+ *
+ */
+static uint32_t ChecksumAddSse2(uint32_t sumParam, const void *dataParam, unsigned int lengthParam)
+{
+  const unsigned char *data = (const unsigned char *)dataParam;
+  __m128i zero = _mm_setzero_si128();
+  __m128i sum1 = _mm_setzero_si128();
+  __m128i sum2 = _mm_setzero_si128();
+  __m128i block1;
+  __m128i block2;
+  uint64_t lanes[2];
+  uint64_t sum = sumParam;
+
+  while (lengthParam >= 32)
+  {
+    block1 = _mm_loadu_si128((const __m128i *)data);
+    block2 = _mm_loadu_si128((const __m128i *)(data + 16));
+    sum1 = _mm_add_epi64(sum1, _mm_unpacklo_epi32(block1, zero));
+    sum2 = _mm_add_epi64(sum2, _mm_unpackhi_epi32(block1, zero));
+    sum1 = _mm_add_epi64(sum1, _mm_unpacklo_epi32(block2, zero));
+    sum2 = _mm_add_epi64(sum2, _mm_unpackhi_epi32(block2, zero));
+    data += 32;
+    lengthParam -= 32;
+  }
+
+  if (lengthParam >= 16)
+  {
+    block1 = _mm_loadu_si128((const __m128i *)data);
+    sum1 = _mm_add_epi64(sum1, _mm_unpacklo_epi32(block1, zero));
+    sum2 = _mm_add_epi64(sum2, _mm_unpackhi_epi32(block1, zero));
+    data += 16;
+    lengthParam -= 16;
+  }
+
+  _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(sum1, sum2));
+  sum += ChecksumReduce(lanes[0]);
+  sum += ChecksumReduce(lanes[1]);
+
+  return ChecksumAddScalar(ChecksumReduce(sum), data, lengthParam);
+}
+
+
+CHECKSUM_TARGET_AVX2 static uint32_t ChecksumAddAvx2(uint32_t sumParam, const void *dataParam, unsigned int lengthParam)
+{
+  const unsigned char *data = (const unsigned char *)dataParam;
+  __m256i zero = _mm256_setzero_si256();
+  __m256i sum1 = _mm256_setzero_si256();
+  __m256i sum2 = _mm256_setzero_si256();
+  __m256i block1;
+  __m256i block2;
+  __m128i block;
+  uint64_t lanes[4];
+  uint64_t sum = sumParam;
+  int counter = 0;
+
+  while (lengthParam >= 64)
+  {
+    block1 = _mm256_loadu_si256((const __m256i *)data);
+    block2 = _mm256_loadu_si256((const __m256i *)(data + 32));
+    sum1 = _mm256_add_epi64(sum1, _mm256_unpacklo_epi32(block1, zero));
+    sum2 = _mm256_add_epi64(sum2, _mm256_unpackhi_epi32(block1, zero));
+    sum1 = _mm256_add_epi64(sum1, _mm256_unpacklo_epi32(block2, zero));
+    sum2 = _mm256_add_epi64(sum2, _mm256_unpackhi_epi32(block2, zero));
+    data += 64;
+    lengthParam -= 64;
+  }
+
+  if (lengthParam >= 32)
+  {
+    block1 = _mm256_loadu_si256((const __m256i *)data);
+    sum1 = _mm256_add_epi64(sum1, _mm256_unpacklo_epi32(block1, zero));
+    sum2 = _mm256_add_epi64(sum2, _mm256_unpackhi_epi32(block1, zero));
+    data += 32;
+    lengthParam -= 32;
+  }
+
+  // The tail stays in VEX encoded code, calling the SSE2 version
+  // here would cost an AVX/SSE transition on every call
+  if (lengthParam >= 16)
+  {
+    block = _mm_loadu_si128((const __m128i *)data);
+    sum1 = _mm256_add_epi64(sum1, _mm256_cvtepu32_epi64(block));
+    data += 16;
+    lengthParam -= 16;
+  }
+
+  _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(sum1, sum2));
+  _mm256_zeroupper();
+
+  for (counter = 0; counter < 4; counter++)
+  {
+    sum += ChecksumReduce(lanes[counter]);
+  }
+
+  return ChecksumAddScalar(ChecksumReduce(sum), data, lengthParam);
+}
+
+
+static BOOL ChecksumCpuHasAvx2()
+{
+#ifdef _MSC_VER
+  int cpuInfo[4];
+
+  __cpuid(cpuInfo, 0);
+
+  if (cpuInfo[0] < 7)
+  {
+    return FALSE;
+  }
+
+  // OSXSAVE and AVX, and the OS saves the YMM registers
+  __cpuid(cpuInfo, 1);
+
+  if ((cpuInfo[2] & (1 << 27)) == 0 ||
+      (cpuInfo[2] & (1 << 28)) == 0 ||
+      (_xgetbv(0) & 0x06) != 0x06)
+  {
+    return FALSE;
+  }
+
+  __cpuidex(cpuInfo, 7, 0);
+
+  return (cpuInfo[1] & (1 << 5)) != 0 ? TRUE : FALSE;
+#elif defined(__GNUC__)
+  __builtin_cpu_init();
+
+  return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+#else
+  return FALSE;
+#endif
+}
+
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Internet checksum (RFC 1071)
+ *
+ * Partial sums are one's complement sums of the data's 16 bit
+ * words in memory order. The folded result is stored into the
+ * header as it is, without htons(), the same way in_cksum()
+ * results always were. Byte order only matters for values
+ * passed as numbers: ChecksumPseudoHeader()'s length is in
+ * host order, the ChecksumUpdate*() values are in memory order
+ * (e.g. ipHdr->tlen as read from the header).
+ *
+ * ChecksumAdd() can be chained over several blocks, all but the
+ * last one must have an even length.
+ *
+ * ChecksumAdd() uses AVX2 or SSE2 if the CPU has them and falls
+ * back to ChecksumAddScalar(), the reference implementation,
+ * everywhere else.
+ *
+ */
+
+#define CHECKSUM_IMPL_SCALAR "scalar"
+#define CHECKSUM_IMPL_SSE2 "sse2"
+#define CHECKSUM_IMPL_AVX2 "avx2"
+
+
+/*
+ * Function forward declarations
+ *
+ */
+uint32_t ChecksumAdd(uint32_t sumParam, const void *dataParam, unsigned int lengthParam);
+uint32_t ChecksumAddScalar(uint32_t sumParam, const void *dataParam, unsigned int lengthParam);
+uint32_t ChecksumPseudoHeader(uint32_t sumParam, const unsigned char *srcIpBinParam, const unsigned char *dstIpBinParam, unsigned char protocolParam, unsigned short lengthParam);
+unsigned short ChecksumFold(uint32_t sumParam);
+unsigned short ChecksumCompute(const void *dataParam, unsigned int lengthParam);
+unsigned short ChecksumUpdate16(unsigned short checksumParam, unsigned short oldValueParam, unsigned short newValueParam);
+unsigned short ChecksumUpdate32(unsigned short checksumParam, uint32_t oldValueParam, uint32_t newValueParam);
+BOOL ChecksumSelect(char *implementationParam);
+char *ChecksumImplementation();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,167 @@
+#include "Epoch.h"
+
+#ifndef _WIN32
+#include <sched.h>
+#endif
+
+
+#ifdef _WIN32
+#define EPOCH_THREAD_LOCAL __declspec(thread)
+#define EPOCH_LOAD_ACQUIRE(ptr) ((unsigned int)InterlockedCompareExchange((volatile LONG *)(ptr), 0, 0))
+#define EPOCH_STORE_RELEASE(ptr, value) InterlockedExchange((volatile LONG *)(ptr), (LONG)(value))
+#define EPOCH_STORE_FENCE(ptr, value) InterlockedExchange((volatile LONG *)(ptr), (LONG)(value))
+#define EPOCH_INCREMENT(ptr) ((unsigned int)InterlockedIncrement((volatile LONG *)(ptr)))
+#define EPOCH_ADVANCE(ptr) ((unsigned int)InterlockedExchangeAdd((volatile LONG *)(ptr), 2) + 2)
+#define EPOCH_DECREMENT(ptr) ((unsigned int)InterlockedDecrement((volatile LONG *)(ptr)))
+#define EPOCH_YIELD() SwitchToThread()
+#else
+#define EPOCH_THREAD_LOCAL __thread
+#define EPOCH_LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define EPOCH_STORE_RELEASE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define EPOCH_STORE_FENCE(ptr, value) do { __atomic_exchange_n((ptr), (value), __ATOMIC_SEQ_CST); __atomic_thread_fence(__ATOMIC_SEQ_CST); } while (0)
+#define EPOCH_INCREMENT(ptr) __atomic_add_fetch((ptr), 1, __ATOMIC_SEQ_CST)
+#define EPOCH_ADVANCE(ptr) __atomic_add_fetch((ptr), 2, __ATOMIC_SEQ_CST)
+#define EPOCH_DECREMENT(ptr) __atomic_sub_fetch((ptr), 1, __ATOMIC_SEQ_CST)
+#define EPOCH_YIELD() sched_yield()
+#endif
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  volatile unsigned int Epoch;        // 0 while the thread is outside
+  unsigned int Nesting;
+  char Padding[56];                   // One record per cache line
+} EPOCH_RECORD, *PEPOCH_RECORD;
+
+
+static EPOCH_RECORD sRecords[EPOCH_MAX_THREADS];
+static volatile unsigned int sRecordCount = 0;
+static volatile unsigned int sGlobalEpoch = 1;        // Odd, 0 never occurs
+static volatile unsigned int sOverflowReaders = 0;
+static EPOCH_THREAD_LOCAL PEPOCH_RECORD sThreadRecord = NULL;
+static EPOCH_THREAD_LOCAL BOOL sThreadRecordFailed = FALSE;
+static EPOCH_THREAD_LOCAL unsigned int sThreadOverflowNesting = 0;
+
+
+static PEPOCH_RECORD EpochGetRecord();
+
+
+/*
+ * The epoch is stored before the reader loads any shared
+ * pointer, a writer that swapped the pointer earlier either
+ * sees the epoch or the reader sees the new pointer.
+ *
+ */
+void EpochEnter()
+{
+  PEPOCH_RECORD record = EpochGetRecord();
+
+  if (record == NULL)
+  {
+    if (sThreadOverflowNesting++ == 0)
+    {
+      EPOCH_INCREMENT(&sOverflowReaders);
+    }
+
+    return;
+  }
+
+  if (record->Nesting++ == 0)
+  {
+    EPOCH_STORE_FENCE(&record->Epoch, EPOCH_LOAD_ACQUIRE(&sGlobalEpoch));
+  }
+}
+
+
+void EpochExit()
+{
+  PEPOCH_RECORD record = sThreadRecord;
+
+  if (record == NULL)
+  {
+    if (sThreadOverflowNesting > 0 &&
+        --sThreadOverflowNesting == 0)
+    {
+      EPOCH_DECREMENT(&sOverflowReaders);
+    }
+
+    return;
+  }
+
+  if (record->Nesting > 0 &&
+      --record->Nesting == 0)
+  {
+    EPOCH_STORE_RELEASE(&record->Epoch, 0);
+  }
+}
+
+
+/*
+ * Wait until every thread that entered before the call
+ * has left. Threads entering meanwhile get the new epoch
+ * and are not waited for.
+ *
+ */
+void EpochSynchronize()
+{
+  unsigned int epoch = EPOCH_ADVANCE(&sGlobalEpoch);
+  unsigned int recordCount = EPOCH_LOAD_ACQUIRE(&sRecordCount);
+  unsigned int readerEpoch = 0;
+  unsigned int counter = 0;
+
+  if (recordCount > EPOCH_MAX_THREADS)
+  {
+    recordCount = EPOCH_MAX_THREADS;
+  }
+
+  for (counter = 0; counter < recordCount; counter++)
+  {
+    if (&sRecords[counter] == sThreadRecord)
+    {
+      continue;
+    }
+
+    while ((readerEpoch = EPOCH_LOAD_ACQUIRE(&sRecords[counter].Epoch)) != 0 &&
+           (int)(readerEpoch - epoch) < 0)
+    {
+      EPOCH_YIELD();
+    }
+  }
+
+  while (EPOCH_LOAD_ACQUIRE(&sOverflowReaders) > (sThreadOverflowNesting > 0 ? 1U : 0U))
+  {
+    EPOCH_YIELD();
+  }
+}
+
+
+
+/*
+ * The calling thread's record. Claimed the first time
+ * the thread enters.
+ *
+ */
+static PEPOCH_RECORD EpochGetRecord()
+{
+  unsigned int slot = 0;
+
+  if (sThreadRecord != NULL ||
+      sThreadRecordFailed == TRUE)
+  {
+    return sThreadRecord;
+  }
+
+  if ((slot = EPOCH_INCREMENT(&sRecordCount) - 1) >= EPOCH_MAX_THREADS)
+  {
+    sThreadRecordFailed = TRUE;
+    return NULL;
+  }
+
+  sThreadRecord = &sRecords[slot];
+
+  return sThreadRecord;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Epoch based reclamation for data read without a lock.
+ *
+ * Readers bracket their accesses with EpochEnter() and EpochExit().
+ * A writer publishes a new version with a single pointer store and
+ * then calls EpochSynchronize(). It returns once every reader that
+ * may still see the old version has left, after that the old version
+ * can be freed.
+ *
+ * Every reading thread gets a record on its first EpochEnter().
+ * Entering and leaving only write to the thread's own record, readers
+ * never wait for writers. Records are never released. Threads beyond
+ * EPOCH_MAX_THREADS share a counter instead, EpochSynchronize() then
+ * waits until no such thread is inside.
+ *
+ * EpochEnter()/EpochExit() nest. EpochSynchronize() does not wait
+ * for the calling thread, which must not free data it still reads.
+ *
+ */
+
+#define EPOCH_MAX_THREADS 128
+
+
+/*
+ * Function forward declarations
+ *
+ */
+void EpochEnter();
+void EpochExit();
+void EpochSynchronize();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "NetworkStructs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Prebuilt Ethernet addresses for a next hop.
+ *
+ * Forwarding a frame rewrites its destination and source MAC
+ * address, the first 12 bytes of the frame. A template holds both
+ * in frame order, so the rewrite is one fixed size copy (an 8 and
+ * a 4 byte store) instead of two 6 byte copies from different
+ * places. Templates are built once per next hop (gateway, target
+ * system, flow) and applied to every frame sent there.
+ *
+ */
+
+#define ETHER_TEMPLATE_LEN (2 * BIN_MAC_LEN)
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  uint32_t Words[ETHER_TEMPLATE_LEN / 4];   // ether_dhost, ether_shost
+} ETHER_TEMPLATE, *PETHER_TEMPLATE;
+
+
+static __inline void EtherTemplateBuild(PETHER_TEMPLATE templateParam, const unsigned char dstMacBinParam[BIN_MAC_LEN], const unsigned char srcMacBinParam[BIN_MAC_LEN])
+{
+  CopyMemory((unsigned char *)templateParam->Words, dstMacBinParam, BIN_MAC_LEN);
+  CopyMemory((unsigned char *)templateParam->Words + BIN_MAC_LEN, srcMacBinParam, BIN_MAC_LEN);
+}
+
+
+static __inline void EtherTemplateApply(unsigned char *frameParam, const ETHER_TEMPLATE *templateParam)
+{
+  CopyMemory(frameParam, templateParam->Words, ETHER_TEMPLATE_LEN);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "FileWatch.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+
+struct FILE_WATCH
+{
+  char Directory[FILE_WATCH_MAX_PATH];
+  char FileName[FILE_WATCH_MAX_PATH];
+#ifdef _WIN32
+  char FilePath[FILE_WATCH_MAX_PATH];
+  HANDLE Notification;
+  WIN32_FILE_ATTRIBUTE_DATA Attributes;
+  BOOL Exists;
+#else
+  int NotifyFd;
+  int WatchDescriptor;
+#endif
+};
+
+
+static void FileWatchSplitPath(PFILE_WATCH fileWatchParam, char *filePathParam);
+#ifdef _WIN32
+static BOOL FileWatchFileChanged(PFILE_WATCH fileWatchParam);
+#else
+static BOOL FileWatchReadEvents(PFILE_WATCH fileWatchParam);
+#endif
+
+
+/*
+ * Start watching filePathParam. The file doesn't have to
+ * exist yet, its directory does.
+ *
+ */
+PFILE_WATCH FileWatchCreate(char *filePathParam)
+{
+  PFILE_WATCH fileWatch = NULL;
+
+  if (filePathParam == NULL ||
+      strlen(filePathParam) >= FILE_WATCH_MAX_PATH)
+  {
+    return NULL;
+  }
+
+  if ((fileWatch = (PFILE_WATCH)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(FILE_WATCH))) == NULL)
+  {
+    return NULL;
+  }
+
+  FileWatchSplitPath(fileWatch, filePathParam);
+
+#ifdef _WIN32
+  strncpy(fileWatch->FilePath, filePathParam, sizeof(fileWatch->FilePath) - 1);
+  fileWatch->Exists = GetFileAttributesExA(fileWatch->FilePath, GetFileExInfoStandard, &fileWatch->Attributes);
+
+  if ((fileWatch->Notification = FindFirstChangeNotificationA(fileWatch->Directory, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE)) == INVALID_HANDLE_VALUE)
+  {
+    HeapFree(GetProcessHeap(), 0, fileWatch);
+    return NULL;
+  }
+#else
+  if ((fileWatch->NotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+  {
+    HeapFree(GetProcessHeap(), 0, fileWatch);
+    return NULL;
+  }
+
+  if ((fileWatch->WatchDescriptor = inotify_add_watch(fileWatch->NotifyFd, fileWatch->Directory, IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) < 0)
+  {
+    close(fileWatch->NotifyFd);
+    HeapFree(GetProcessHeap(), 0, fileWatch);
+    return NULL;
+  }
+#endif
+
+  return fileWatch;
+}
+
+
+void FileWatchDestroy(PFILE_WATCH fileWatchParam)
+{
+  if (fileWatchParam == NULL)
+  {
+    return;
+  }
+
+#ifdef _WIN32
+  FindCloseChangeNotification(fileWatchParam->Notification);
+#else
+  close(fileWatchParam->NotifyFd);
+#endif
+
+  HeapFree(GetProcessHeap(), 0, fileWatchParam);
+}
+
+
+/*
+ * Block until something in the file's directory changed or
+ * timeoutParam ms passed. Returns TRUE if the file itself
+ * was written, replaced, created or removed.
+ *
+ */
+BOOL FileWatchWait(PFILE_WATCH fileWatchParam, unsigned int timeoutParam)
+{
+#ifdef _WIN32
+  if (fileWatchParam == NULL ||
+      WaitForSingleObject(fileWatchParam->Notification, timeoutParam == FILE_WATCH_INFINITE ? INFINITE : timeoutParam) != WAIT_OBJECT_0)
+  {
+    return FALSE;
+  }
+
+  // Let the writer finish
+  do
+  {
+    FindNextChangeNotification(fileWatchParam->Notification);
+  } while (WaitForSingleObject(fileWatchParam->Notification, FILE_WATCH_SETTLE_TIME) == WAIT_OBJECT_0);
+
+  return FileWatchFileChanged(fileWatchParam);
+#else
+  struct pollfd pollFd;
+  BOOL changed = FALSE;
+
+  if (fileWatchParam == NULL)
+  {
+    return FALSE;
+  }
+
+  pollFd.fd = fileWatchParam->NotifyFd;
+  pollFd.events = POLLIN;
+
+  if (poll(&pollFd, 1, timeoutParam == FILE_WATCH_INFINITE ? -1 : (int)timeoutParam) <= 0)
+  {
+    return FALSE;
+  }
+
+  // Let the writer finish
+  do
+  {
+    if (FileWatchReadEvents(fileWatchParam) == TRUE)
+    {
+      changed = TRUE;
+    }
+  } while (poll(&pollFd, 1, FILE_WATCH_SETTLE_TIME) > 0);
+
+  return changed;
+#endif
+}
+
+
+
+static void FileWatchSplitPath(PFILE_WATCH fileWatchParam, char *filePathParam)
+{
+  char *separator = strrchr(filePathParam, '/');
+
+#ifdef _WIN32
+  if (strrchr(filePathParam, '\\') > separator)
+  {
+    separator = strrchr(filePathParam, '\\');
+  }
+#endif
+
+  if (separator == NULL)
+  {
+    strncpy(fileWatchParam->Directory, ".", sizeof(fileWatchParam->Directory) - 1);
+    strncpy(fileWatchParam->FileName, filePathParam, sizeof(fileWatchParam->FileName) - 1);
+  }
+  else if (separator == filePathParam)
+  {
+    strncpy(fileWatchParam->Directory, "/", sizeof(fileWatchParam->Directory) - 1);
+    strncpy(fileWatchParam->FileName, separator + 1, sizeof(fileWatchParam->FileName) - 1);
+  }
+  else
+  {
+    CopyMemory(fileWatchParam->Directory, filePathParam, separator - filePathParam);
+    strncpy(fileWatchParam->FileName, separator + 1, sizeof(fileWatchParam->FileName) - 1);
+  }
+}
+
+
+#ifdef _WIN32
+/*
+ * The notification covers the whole directory. Compare
+ * the file's attributes with the ones seen last time.
+ *
+ */
+static BOOL FileWatchFileChanged(PFILE_WATCH fileWatchParam)
+{
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  BOOL exists = FALSE;
+  BOOL changed = FALSE;
+
+  ZeroMemory(&attributes, sizeof(attributes));
+  exists = GetFileAttributesExA(fileWatchParam->FilePath, GetFileExInfoStandard, &attributes);
+
+  if (exists != fileWatchParam->Exists)
+  {
+    changed = TRUE;
+  }
+  else if (exists == TRUE &&
+           (CompareFileTime(&attributes.ftLastWriteTime, &fileWatchParam->Attributes.ftLastWriteTime) != 0 ||
+            attributes.nFileSizeLow != fileWatchParam->Attributes.nFileSizeLow ||
+            attributes.nFileSizeHigh != fileWatchParam->Attributes.nFileSizeHigh))
+  {
+    changed = TRUE;
+  }
+
+  fileWatchParam->Exists = exists;
+  CopyMemory(&fileWatchParam->Attributes, &attributes, sizeof(attributes));
+
+  return changed;
+}
+#else
+/*
+ * Drain the pending events. Returns TRUE if one of
+ * them was about the watched file.
+ *
+ */
+static BOOL FileWatchReadEvents(PFILE_WATCH fileWatchParam)
+{
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct inotify_event *event = NULL;
+  ssize_t length = 0;
+  ssize_t offset = 0;
+  BOOL changed = FALSE;
+
+  while ((length = read(fileWatchParam->NotifyFd, buffer, sizeof(buffer))) > 0)
+  {
+    for (offset = 0; offset < length; offset += sizeof(struct inotify_event) + event->len)
+    {
+      event = (struct inotify_event *)(buffer + offset);
+
+      if (event->len > 0 &&
+          strcmp(event->name, fileWatchParam->FileName) == 0)
+      {
+        changed = TRUE;
+      }
+    }
+  }
+
+  return changed;
+}
+#endif
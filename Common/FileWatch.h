@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Notification when a configuration file changes.
+ *
+ * The directory of the file is watched, so editors that write a new
+ * file and rename it over the old one are noticed too. On Linux the
+ * events come from inotify. On Windows a change notification handle
+ * reports changes in the directory, changes of other files are
+ * filtered out by the file's last write time and size.
+ *
+ * A file is often written in several steps. FileWatchWait() reports
+ * them once, after the file was quiet for FILE_WATCH_SETTLE_TIME ms.
+ *
+ */
+
+#define FILE_WATCH_SETTLE_TIME 200
+#define FILE_WATCH_INFINITE 0xFFFFFFFF
+#define FILE_WATCH_MAX_PATH 1024
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct FILE_WATCH FILE_WATCH, *PFILE_WATCH;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+PFILE_WATCH FileWatchCreate(char *filePathParam);
+void FileWatchDestroy(PFILE_WATCH fileWatchParam);
+BOOL FileWatchWait(PFILE_WATCH fileWatchParam, unsigned int timeoutParam);
+
+#ifdef __cplusplus
+}
+#endif
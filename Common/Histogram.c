@@ -0,0 +1,179 @@
+#include "Histogram.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+static int HistogramMostSignificantBit(uint64_t valueParam);
+static int HistogramBucketIndex(uint64_t valueParam);
+static uint64_t HistogramBucketHighestValue(int bucketIndexParam);
+
+
+void HistogramReset(PHISTOGRAM histogramParam)
+{
+  ZeroMemory(histogramParam, sizeof(HISTOGRAM));
+  histogramParam->MinValue = UINT64_MAX;
+}
+
+
+void HistogramRecord(PHISTOGRAM histogramParam, uint64_t valueParam)
+{
+  histogramParam->Counts[HistogramBucketIndex(valueParam)]++;
+  histogramParam->TotalCount++;
+  histogramParam->Sum += valueParam;
+
+  if (valueParam < histogramParam->MinValue)
+  {
+    histogramParam->MinValue = valueParam;
+  }
+
+  if (valueParam > histogramParam->MaxValue)
+  {
+    histogramParam->MaxValue = valueParam;
+  }
+}
+
+
+void HistogramMerge(PHISTOGRAM dstHistogramParam, PHISTOGRAM srcHistogramParam)
+{
+  int counter = 0;
+
+  if (srcHistogramParam->TotalCount == 0)
+  {
+    return;
+  }
+
+  for (counter = 0; counter < HISTOGRAM_BUCKETS; counter++)
+  {
+    dstHistogramParam->Counts[counter] += srcHistogramParam->Counts[counter];
+  }
+
+  dstHistogramParam->TotalCount += srcHistogramParam->TotalCount;
+  dstHistogramParam->Sum += srcHistogramParam->Sum;
+
+  if (srcHistogramParam->MinValue < dstHistogramParam->MinValue)
+  {
+    dstHistogramParam->MinValue = srcHistogramParam->MinValue;
+  }
+
+  if (srcHistogramParam->MaxValue > dstHistogramParam->MaxValue)
+  {
+    dstHistogramParam->MaxValue = srcHistogramParam->MaxValue;
+  }
+}
+
+
+/*
+ * Smallest recorded value (rounded up to its bucket) that is
+ * greater than or equal to percentileParam percent of all values.
+ *
+ */
+uint64_t HistogramPercentile(PHISTOGRAM histogramParam, double percentileParam)
+{
+  uint64_t rank = 0;
+  uint64_t runningCount = 0;
+  uint64_t retVal = 0;
+  int counter = 0;
+
+  if (histogramParam->TotalCount == 0)
+  {
+    return 0;
+  }
+
+  if (percentileParam > 100.0)
+  {
+    percentileParam = 100.0;
+  }
+
+  rank = (uint64_t)((percentileParam / 100.0) * (double)histogramParam->TotalCount + 0.5);
+  if (rank == 0)
+  {
+    rank = 1;
+  }
+
+  for (counter = 0; counter < HISTOGRAM_BUCKETS; counter++)
+  {
+    runningCount += histogramParam->Counts[counter];
+
+    if (runningCount >= rank)
+    {
+      retVal = HistogramBucketHighestValue(counter);
+      break;
+    }
+  }
+
+  return retVal > histogramParam->MaxValue ? histogramParam->MaxValue : retVal;
+}
+
+
+uint64_t HistogramMean(PHISTOGRAM histogramParam)
+{
+  if (histogramParam->TotalCount == 0)
+  {
+    return 0;
+  }
+
+  return histogramParam->Sum / histogramParam->TotalCount;
+}
+
+
+
+/*
+ * Bucket arithmetic
+ *
+ */
+static int HistogramMostSignificantBit(uint64_t valueParam)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+  unsigned long bitIndex = 0;
+
+  _BitScanReverse64(&bitIndex, valueParam);
+  return (int)bitIndex;
+#elif defined(__GNUC__)
+  return 63 - __builtin_clzll(valueParam);
+#else
+  int bitIndex = 0;
+
+  while (valueParam >>= 1)
+  {
+    bitIndex++;
+  }
+
+  return bitIndex;
+#endif
+}
+
+
+static int HistogramBucketIndex(uint64_t valueParam)
+{
+  int shift = 0;
+
+  if (valueParam < HISTOGRAM_SUB_BUCKETS)
+  {
+    return (int)valueParam;
+  }
+
+  // Keep the top HISTOGRAM_SUB_BUCKET_BITS bits of the value
+  shift = HistogramMostSignificantBit(valueParam) - (HISTOGRAM_SUB_BUCKET_BITS - 1);
+
+  return HISTOGRAM_SUB_BUCKETS + (shift - 1) * HISTOGRAM_HALF_BUCKETS + (int)(valueParam >> shift) - HISTOGRAM_HALF_BUCKETS;
+}
+
+
+static uint64_t HistogramBucketHighestValue(int bucketIndexParam)
+{
+  int shift = 0;
+  uint64_t subBucket = 0;
+
+  if (bucketIndexParam < HISTOGRAM_SUB_BUCKETS)
+  {
+    return (uint64_t)bucketIndexParam;
+  }
+
+  bucketIndexParam -= HISTOGRAM_SUB_BUCKETS;
+  shift = bucketIndexParam / HISTOGRAM_HALF_BUCKETS + 1;
+  subBucket = (uint64_t)(bucketIndexParam % HISTOGRAM_HALF_BUCKETS + HISTOGRAM_HALF_BUCKETS);
+
+  return ((subBucket + 1) << shift) - 1;
+}
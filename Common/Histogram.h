@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Log-linear latency histogram (HDR histogram layout).
+ *
+ * Values below HISTOGRAM_SUB_BUCKETS are counted exactly. Above that
+ * every power of two is split into HISTOGRAM_SUB_BUCKETS / 2 linear
+ * buckets, so a recorded value is off by at most 1/32 (~3%) no matter
+ * if it is 50ns or 5s. Recording is a few shifts and one increment,
+ * cheap enough to be done for every packet.
+ *
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS 6
+#define HISTOGRAM_SUB_BUCKETS     (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_HALF_BUCKETS    (HISTOGRAM_SUB_BUCKETS / 2)
+#define HISTOGRAM_BUCKETS         (HISTOGRAM_SUB_BUCKETS + (64 - HISTOGRAM_SUB_BUCKET_BITS) * HISTOGRAM_HALF_BUCKETS)
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  uint64_t TotalCount;
+  uint64_t MinValue;
+  uint64_t MaxValue;
+  uint64_t Sum;
+  uint64_t Counts[HISTOGRAM_BUCKETS];
+} HISTOGRAM, *PHISTOGRAM;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+void HistogramReset(PHISTOGRAM histogramParam);
+void HistogramRecord(PHISTOGRAM histogramParam, uint64_t valueParam);
+void HistogramMerge(PHISTOGRAM dstHistogramParam, PHISTOGRAM srcHistogramParam);
+uint64_t HistogramPercentile(PHISTOGRAM histogramParam, double percentileParam);
+uint64_t HistogramMean(PHISTOGRAM histogramParam);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,655 @@
+#include <string.h>
+
+#include "Epoch.h"
+#include "HostTable.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+
+#ifdef _WIN32
+#define HOSTTABLE_LOAD_ACQUIRE(ptr) ((unsigned int)InterlockedCompareExchange((volatile LONG *)(ptr), 0, 0))
+#define HOSTTABLE_STORE_RELEASE(ptr, value) InterlockedExchange((volatile LONG *)(ptr), (LONG)(value))
+#define HOSTTABLE_LOAD_DATA(ptr) ((PHOST_TABLE_DATA)InterlockedCompareExchangePointer((PVOID volatile *)(ptr), NULL, NULL))
+#define HOSTTABLE_STORE_DATA(ptr, value) InterlockedExchangePointer((PVOID volatile *)(ptr), (value))
+#define HOSTTABLE_INCREMENT(ptr) InterlockedIncrement((volatile LONG *)(ptr))
+#define HOSTTABLE_READ_FENCE() MemoryBarrier()
+#define HOSTTABLE_LOCK(ptr) EnterCriticalSection(ptr)
+#define HOSTTABLE_UNLOCK(ptr) LeaveCriticalSection(ptr)
+#else
+#define HOSTTABLE_LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define HOSTTABLE_STORE_RELEASE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define HOSTTABLE_LOAD_DATA(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define HOSTTABLE_STORE_DATA(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define HOSTTABLE_INCREMENT(ptr) __atomic_add_fetch((ptr), 1, __ATOMIC_ACQ_REL)
+#define HOSTTABLE_READ_FENCE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define HOSTTABLE_LOCK(ptr) pthread_mutex_lock(ptr)
+#define HOSTTABLE_UNLOCK(ptr) pthread_mutex_unlock(ptr)
+#endif
+
+
+// New arrays without the MAC index slots of old addresses
+// once half of the hosts changed their MAC
+#define HOST_TABLE_MAC_REBUILD(data) ((data)->Capacity + (data)->Capacity / 2)
+
+
+typedef struct
+{
+  volatile unsigned int Sequence;     // Odd while the host is written
+  HOST_ENTRY Host;
+} HOST_SLOT, *PHOST_SLOT;
+
+
+typedef struct HOST_TABLE_DATA
+{
+  unsigned int Capacity;
+  unsigned int IndexMask;
+  volatile unsigned int Count;
+  unsigned int MacIndexUsed;          // Includes slots left behind by MAC changes
+  PHOST_SLOT Slots;
+  volatile unsigned int *IpIndex;     // Slot + 1, 0 is empty
+  volatile unsigned int *MacIndex;
+} HOST_TABLE_DATA, *PHOST_TABLE_DATA;
+
+
+struct HOST_TABLE
+{
+#ifdef _WIN32
+  CRITICAL_SECTION Lock;
+#else
+  pthread_mutex_t Lock;
+#endif
+  PHOST_TABLE_DATA volatile Data;
+  volatile unsigned int Generation;
+};
+
+
+static PHOST_TABLE_DATA HostTableAllocData(unsigned int capacityParam);
+static PHOST_TABLE_DATA HostTableResize(PHOST_TABLE hostTableParam, PHOST_TABLE_DATA dataParam, unsigned int capacityParam);
+static void HostTableIndexInsert(volatile unsigned int *indexParam, unsigned int indexMaskParam, unsigned int hashParam, unsigned int slotParam);
+static int HostTableFindIp(PHOST_TABLE_DATA dataParam, unsigned char ipBinParam[HOST_IP_LEN], PHOST_ENTRY hostParam);
+static BOOL HostTableReadSlot(PHOST_SLOT slotParam, PHOST_ENTRY hostParam);
+static void HostTableWriteSlot(PHOST_SLOT slotParam, unsigned char ipBinParam[HOST_IP_LEN], unsigned char macBinParam[HOST_MAC_LEN], char *ipStrParam);
+static unsigned int HostTableIpHash(unsigned char ipBinParam[HOST_IP_LEN]);
+static unsigned int HostTableMacHash(unsigned char macBinParam[HOST_MAC_LEN]);
+
+
+/*
+ * Table for capacityParam hosts. It grows when it is full.
+ *
+ */
+PHOST_TABLE HostTableCreate(int capacityParam)
+{
+  PHOST_TABLE hostTable = NULL;
+  unsigned int capacity = HOST_TABLE_DEFAULT_CAPACITY;
+
+  while (capacity < (unsigned int)capacityParam && capacity < HOST_TABLE_MAX_CAPACITY)
+  {
+    capacity <<= 1;
+  }
+
+  if ((hostTable = (PHOST_TABLE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(HOST_TABLE))) == NULL)
+  {
+    return NULL;
+  }
+
+  if ((hostTable->Data = HostTableAllocData(capacity)) == NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, hostTable);
+    return NULL;
+  }
+
+#ifdef _WIN32
+  InitializeCriticalSectionAndSpinCount(&hostTable->Lock, 0x00000400);
+#else
+  pthread_mutex_init(&hostTable->Lock, NULL);
+#endif
+
+  return hostTable;
+}
+
+
+/*
+ * No reader may use the table any more.
+ *
+ */
+void HostTableDestroy(PHOST_TABLE hostTableParam)
+{
+  if (hostTableParam == NULL)
+  {
+    return;
+  }
+
+  if (hostTableParam->Data != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, hostTableParam->Data);
+  }
+
+#ifdef _WIN32
+  DeleteCriticalSection(&hostTableParam->Lock);
+#else
+  pthread_mutex_destroy(&hostTableParam->Lock);
+#endif
+
+  HeapFree(GetProcessHeap(), 0, hostTableParam);
+}
+
+
+/*
+ * Add a host or update the MAC address and IP string of
+ * the host with the same IP address. Returns FALSE if the
+ * table is full and can't grow.
+ *
+ */
+BOOL HostTableAdd(PHOST_TABLE hostTableParam, unsigned char ipBinParam[HOST_IP_LEN], unsigned char macBinParam[HOST_MAC_LEN], char *ipStrParam)
+{
+  BOOL retVal = FALSE;
+  PHOST_TABLE_DATA data = NULL;
+  PHOST_TABLE_DATA newData = NULL;
+  PHOST_TABLE_DATA retired = NULL;
+  PHOST_SLOT slot = NULL;
+  BOOL changed = TRUE;
+  int slotIndex = 0;
+
+  if (hostTableParam == NULL ||
+      ipBinParam == NULL ||
+      macBinParam == NULL)
+  {
+    return FALSE;
+  }
+
+  HOSTTABLE_LOCK(&hostTableParam->Lock);
+  data = hostTableParam->Data;
+
+  // Known host. Readers may look at the slot while it changes.
+  if ((slotIndex = HostTableFindIp(data, ipBinParam, NULL)) >= 0)
+  {
+    slot = &data->Slots[slotIndex];
+
+    if (memcmp(slot->Host.MacBin, macBinParam, HOST_MAC_LEN) != 0)
+    {
+      HostTableWriteSlot(slot, ipBinParam, macBinParam, ipStrParam);
+
+      // The old MAC's index slot stays. Lookups skip it, new
+      // arrays of the same size drop it. Without memory for
+      // them the host can't be found by MAC once the index
+      // is full.
+      if (data->MacIndexUsed >= HOST_TABLE_MAC_REBUILD(data) &&
+          (newData = HostTableResize(hostTableParam, data, data->Capacity)) != NULL)
+      {
+        retired = data;
+      }
+      else if (data->MacIndexUsed < data->IndexMask)
+      {
+        HostTableIndexInsert(data->MacIndex, data->IndexMask, HostTableMacHash(macBinParam), (unsigned int)slotIndex);
+        data->MacIndexUsed++;
+      }
+    }
+    else if (ipStrParam != NULL && strncmp(slot->Host.IpStr, ipStrParam, HOST_IPSTR_LEN) != 0)
+    {
+      HostTableWriteSlot(slot, ipBinParam, macBinParam, ipStrParam);
+    }
+    else
+    {
+      changed = FALSE;
+    }
+
+    retVal = TRUE;
+    goto END;
+  }
+
+  if (data->Count >= data->Capacity)
+  {
+    retired = data;
+
+    if (data->Capacity >= HOST_TABLE_MAX_CAPACITY ||
+        (data = HostTableResize(hostTableParam, data, data->Capacity * 2)) == NULL)
+    {
+      retired = NULL;
+      goto END;
+    }
+  }
+  else if (data->MacIndexUsed >= HOST_TABLE_MAC_REBUILD(data))
+  {
+    if ((newData = HostTableResize(hostTableParam, data, data->Capacity)) != NULL)
+    {
+      retired = data;
+      data = newData;
+    }
+    else if (data->MacIndexUsed >= data->IndexMask)
+    {
+      goto END;
+    }
+  }
+
+  // Fill the slot first, then make it reachable
+  slotIndex = (int)data->Count;
+  HostTableWriteSlot(&data->Slots[slotIndex], ipBinParam, macBinParam, ipStrParam);
+  HostTableIndexInsert(data->IpIndex, data->IndexMask, HostTableIpHash(ipBinParam), (unsigned int)slotIndex);
+  HostTableIndexInsert(data->MacIndex, data->IndexMask, HostTableMacHash(macBinParam), (unsigned int)slotIndex);
+  data->MacIndexUsed++;
+  HOSTTABLE_STORE_RELEASE(&data->Count, data->Count + 1);
+
+  retVal = TRUE;
+
+END:
+
+  if (retVal == TRUE && changed == TRUE)
+  {
+    HOSTTABLE_INCREMENT(&hostTableParam->Generation);
+  }
+
+  HOSTTABLE_UNLOCK(&hostTableParam->Lock);
+
+  // Readers may still use the arrays from before the resize
+  // or the MAC index rebuild
+  if (retired != NULL)
+  {
+    EpochSynchronize();
+    HeapFree(GetProcessHeap(), 0, retired);
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Publish the hosts of newTableParam in hostTableParam in one
+ * step and destroy newTableParam. Lookups running meanwhile
+ * see either all old or all new hosts. The old arrays are
+ * freed once no reader uses them any more.
+ *
+ */
+BOOL HostTableReplace(PHOST_TABLE hostTableParam, PHOST_TABLE newTableParam)
+{
+  PHOST_TABLE_DATA retired = NULL;
+
+  if (hostTableParam == NULL ||
+      newTableParam == NULL ||
+      hostTableParam == newTableParam)
+  {
+    return FALSE;
+  }
+
+  HOSTTABLE_LOCK(&newTableParam->Lock);
+  HOSTTABLE_LOCK(&hostTableParam->Lock);
+
+  retired = hostTableParam->Data;
+  HOSTTABLE_STORE_DATA(&hostTableParam->Data, newTableParam->Data);
+  newTableParam->Data = NULL;
+  HOSTTABLE_INCREMENT(&hostTableParam->Generation);
+
+  HOSTTABLE_UNLOCK(&hostTableParam->Lock);
+  HOSTTABLE_UNLOCK(&newTableParam->Lock);
+
+  EpochSynchronize();
+  HeapFree(GetProcessHeap(), 0, retired);
+  HostTableDestroy(newTableParam);
+
+  return TRUE;
+}
+
+
+/*
+ * Copy the host with IP address ipBinParam to hostParam.
+ * hostParam may be NULL to only check if the host exists.
+ *
+ */
+BOOL HostTableLookupIp(PHOST_TABLE hostTableParam, unsigned char ipBinParam[HOST_IP_LEN], PHOST_ENTRY hostParam)
+{
+  BOOL retVal = FALSE;
+
+  if (hostTableParam == NULL ||
+      ipBinParam == NULL)
+  {
+    return FALSE;
+  }
+
+  EpochEnter();
+  retVal = HostTableFindIp(HOSTTABLE_LOAD_DATA(&hostTableParam->Data), ipBinParam, hostParam) >= 0 ? TRUE : FALSE;
+  EpochExit();
+
+  return retVal;
+}
+
+
+/*
+ * Copy the first host added with MAC address macBinParam
+ * to hostParam. hostParam may be NULL.
+ *
+ */
+BOOL HostTableLookupMac(PHOST_TABLE hostTableParam, unsigned char macBinParam[HOST_MAC_LEN], PHOST_ENTRY hostParam)
+{
+  BOOL retVal = FALSE;
+  PHOST_TABLE_DATA data = NULL;
+  HOST_ENTRY host;
+  unsigned int position = 0;
+  unsigned int slotIndex = 0;
+  unsigned int probe = 0;
+
+  if (hostTableParam == NULL ||
+      macBinParam == NULL)
+  {
+    return FALSE;
+  }
+
+  EpochEnter();
+  data = HOSTTABLE_LOAD_DATA(&hostTableParam->Data);
+  position = HostTableMacHash(macBinParam) & data->IndexMask;
+
+  for (probe = 0; probe <= data->IndexMask; probe++)
+  {
+    if ((slotIndex = HOSTTABLE_LOAD_ACQUIRE(&data->MacIndex[position])) == 0)
+    {
+      break;
+    }
+
+    // The host's MAC may have changed since the index slot was written
+    if (HostTableReadSlot(&data->Slots[slotIndex - 1], &host) == TRUE &&
+        memcmp(host.MacBin, macBinParam, HOST_MAC_LEN) == 0)
+    {
+      if (hostParam != NULL)
+      {
+        CopyMemory(hostParam, &host, sizeof(HOST_ENTRY));
+      }
+
+      retVal = TRUE;
+      break;
+    }
+
+    position = (position + 1) & data->IndexMask;
+  }
+
+  EpochExit();
+
+  return retVal;
+}
+
+
+/*
+ * Hosts are numbered in the order they were added. Returns
+ * FALSE past the last one.
+ *
+ */
+BOOL HostTableGetEntry(PHOST_TABLE hostTableParam, int indexParam, PHOST_ENTRY hostParam)
+{
+  BOOL retVal = FALSE;
+  PHOST_TABLE_DATA data = NULL;
+
+  if (hostTableParam == NULL ||
+      hostParam == NULL ||
+      indexParam < 0)
+  {
+    return FALSE;
+  }
+
+  EpochEnter();
+  data = HOSTTABLE_LOAD_DATA(&hostTableParam->Data);
+
+  if ((unsigned int)indexParam < HOSTTABLE_LOAD_ACQUIRE(&data->Count))
+  {
+    retVal = HostTableReadSlot(&data->Slots[indexParam], hostParam);
+  }
+
+  EpochExit();
+
+  return retVal;
+}
+
+
+/*
+ * Copy up to maxHostsParam hosts, returns the number copied.
+ *
+ */
+int HostTableCopy(PHOST_TABLE hostTableParam, PHOST_ENTRY hostsParam, int maxHostsParam)
+{
+  PHOST_TABLE_DATA data = NULL;
+  unsigned int count = 0;
+  int counter = 0;
+
+  if (hostTableParam == NULL ||
+      hostsParam == NULL)
+  {
+    return 0;
+  }
+
+  EpochEnter();
+  data = HOSTTABLE_LOAD_DATA(&hostTableParam->Data);
+  count = HOSTTABLE_LOAD_ACQUIRE(&data->Count);
+
+  for (counter = 0; counter < maxHostsParam && (unsigned int)counter < count; counter++)
+  {
+    HostTableReadSlot(&data->Slots[counter], &hostsParam[counter]);
+  }
+
+  EpochExit();
+
+  return counter;
+}
+
+
+int HostTableCount(PHOST_TABLE hostTableParam)
+{
+  int count = 0;
+
+  if (hostTableParam == NULL)
+  {
+    return 0;
+  }
+
+  EpochEnter();
+  count = (int)HOSTTABLE_LOAD_ACQUIRE(&HOSTTABLE_LOAD_DATA(&hostTableParam->Data)->Count);
+  EpochExit();
+
+  return count;
+}
+
+
+/*
+ * Changes on every add, update and replace. Readers keeping
+ * results derived from the table compare it.
+ *
+ */
+long HostTableGeneration(PHOST_TABLE hostTableParam)
+{
+  if (hostTableParam == NULL)
+  {
+    return 0;
+  }
+
+  return (long)HOSTTABLE_LOAD_ACQUIRE(&hostTableParam->Generation);
+}
+
+
+
+/*
+ * Slots, IP index and MAC index in one allocation. The
+ * indexes have twice as many slots as there are hosts.
+ *
+ */
+static PHOST_TABLE_DATA HostTableAllocData(unsigned int capacityParam)
+{
+  PHOST_TABLE_DATA data = NULL;
+  unsigned int indexSize = capacityParam * 2;
+  size_t dataSize = sizeof(HOST_TABLE_DATA) + capacityParam * sizeof(HOST_SLOT) + 2 * indexSize * sizeof(unsigned int);
+
+  if ((data = (PHOST_TABLE_DATA)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, dataSize)) == NULL)
+  {
+    return NULL;
+  }
+
+  data->Capacity = capacityParam;
+  data->IndexMask = indexSize - 1;
+  data->Slots = (PHOST_SLOT)(data + 1);
+  data->IpIndex = (volatile unsigned int *)(data->Slots + capacityParam);
+  data->MacIndex = data->IpIndex + indexSize;
+
+  return data;
+}
+
+
+/*
+ * Copy the hosts into new arrays and rebuild both indexes
+ * there, then publish them. With the same capacity this
+ * drops the MAC index slots of old addresses. Called with
+ * the lock held. The caller frees the old arrays after
+ * EpochSynchronize().
+ *
+ */
+static PHOST_TABLE_DATA HostTableResize(PHOST_TABLE hostTableParam, PHOST_TABLE_DATA dataParam, unsigned int capacityParam)
+{
+  PHOST_TABLE_DATA data = NULL;
+  unsigned int counter = 0;
+
+  if ((data = HostTableAllocData(capacityParam)) == NULL)
+  {
+    return NULL;
+  }
+
+  for (counter = 0; counter < dataParam->Count; counter++)
+  {
+    CopyMemory(&data->Slots[counter].Host, &dataParam->Slots[counter].Host, sizeof(HOST_ENTRY));
+    HostTableIndexInsert(data->IpIndex, data->IndexMask, HostTableIpHash(data->Slots[counter].Host.IpBin), counter);
+    HostTableIndexInsert(data->MacIndex, data->IndexMask, HostTableMacHash(data->Slots[counter].Host.MacBin), counter);
+  }
+
+  data->Count = dataParam->Count;
+  data->MacIndexUsed = dataParam->Count;
+  HOSTTABLE_STORE_DATA(&hostTableParam->Data, data);
+
+  return data;
+}
+
+
+static void HostTableIndexInsert(volatile unsigned int *indexParam, unsigned int indexMaskParam, unsigned int hashParam, unsigned int slotParam)
+{
+  unsigned int position = hashParam & indexMaskParam;
+
+  while (indexParam[position] != 0)
+  {
+    position = (position + 1) & indexMaskParam;
+  }
+
+  HOSTTABLE_STORE_RELEASE(&indexParam[position], slotParam + 1);
+}
+
+
+/*
+ * Index of the slot holding ipBinParam or -1. The slot is
+ * copied to hostParam if that isn't NULL.
+ *
+ */
+static int HostTableFindIp(PHOST_TABLE_DATA dataParam, unsigned char ipBinParam[HOST_IP_LEN], PHOST_ENTRY hostParam)
+{
+  HOST_ENTRY host;
+  unsigned int position = HostTableIpHash(ipBinParam) & dataParam->IndexMask;
+  unsigned int slotIndex = 0;
+  unsigned int probe = 0;
+
+  for (probe = 0; probe <= dataParam->IndexMask; probe++)
+  {
+    if ((slotIndex = HOSTTABLE_LOAD_ACQUIRE(&dataParam->IpIndex[position])) == 0)
+    {
+      break;
+    }
+
+    // Other hosts share the probe sequence
+    if (HostTableReadSlot(&dataParam->Slots[slotIndex - 1], &host) == TRUE &&
+        memcmp(host.IpBin, ipBinParam, HOST_IP_LEN) == 0)
+    {
+      if (hostParam != NULL)
+      {
+        CopyMemory(hostParam, &host, sizeof(HOST_ENTRY));
+      }
+
+      return (int)slotIndex - 1;
+    }
+
+    position = (position + 1) & dataParam->IndexMask;
+  }
+
+  return -1;
+}
+
+
+/*
+ * Copy a slot without taking the lock. Retries while a
+ * writer changes it.
+ *
+ */
+static BOOL HostTableReadSlot(PHOST_SLOT slotParam, PHOST_ENTRY hostParam)
+{
+  unsigned int sequence = 0;
+
+  while (1 == 1)
+  {
+    if (((sequence = HOSTTABLE_LOAD_ACQUIRE(&slotParam->Sequence)) & 1) != 0)
+    {
+      continue;
+    }
+
+    CopyMemory(hostParam, &slotParam->Host, sizeof(HOST_ENTRY));
+    HOSTTABLE_READ_FENCE();
+
+    if (slotParam->Sequence == sequence)
+    {
+      return TRUE;
+    }
+  }
+}
+
+
+static void HostTableWriteSlot(PHOST_SLOT slotParam, unsigned char ipBinParam[HOST_IP_LEN], unsigned char macBinParam[HOST_MAC_LEN], char *ipStrParam)
+{
+  HOSTTABLE_INCREMENT(&slotParam->Sequence);
+
+  CopyMemory(slotParam->Host.IpBin, ipBinParam, HOST_IP_LEN);
+  CopyMemory(slotParam->Host.MacBin, macBinParam, HOST_MAC_LEN);
+  ZeroMemory(slotParam->Host.IpStr, sizeof(slotParam->Host.IpStr));
+
+  if (ipStrParam != NULL)
+  {
+    strncpy(slotParam->Host.IpStr, ipStrParam, HOST_IPSTR_LEN);
+  }
+
+  HOSTTABLE_INCREMENT(&slotParam->Sequence);
+}
+
+
+static unsigned int HostTableIpHash(unsigned char ipBinParam[HOST_IP_LEN])
+{
+  unsigned int hash = 0;
+
+  CopyMemory(&hash, ipBinParam, HOST_IP_LEN);
+
+  // MurmurHash3 fmix32
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+
+  return hash;
+}
+
+
+static unsigned int HostTableMacHash(unsigned char macBinParam[HOST_MAC_LEN])
+{
+  unsigned int hash = 0;
+  unsigned short tail = 0;
+
+  // The vendor part (first 3 bytes) is often the same,
+  // the last 4 bytes differ most
+  CopyMemory(&hash, macBinParam + 2, 4);
+  CopyMemory(&tail, macBinParam, 2);
+  hash ^= (unsigned int)tail * 0x9e3779b1;
+
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+
+  return hash;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Host table shared by the tools that track systems by IPv4 and
+ * MAC address (target systems, ARP scan results).
+ *
+ * The hosts live in one array in the order they were added. Two open
+ * addressing indexes point into it, one keyed by the binary IPv4
+ * address and one by the MAC address. Both are kept at most half
+ * full, so a lookup is a hash and usually one or two probes, no
+ * matter how many hosts there are.
+ *
+ * Writers (add, replace) are serialized by the table's lock. Readers
+ * take no lock: every host carries a sequence number that is odd
+ * while the host is written, readers copy the host and retry if the
+ * sequence number changed meanwhile. When the array is full the
+ * writer builds a larger one and publishes it with a single pointer
+ * store. Readers still on the old array see the old hosts. Readers
+ * run inside an epoch (Epoch.h), the old array is freed once all
+ * readers that could see it have left.
+ *
+ * A whole new set of hosts, e.g. a reloaded configuration file, is
+ * built in a second table off the lookup path and published with
+ * HostTableReplace(). Lookups never see a half filled table.
+ *
+ */
+
+#define HOST_TABLE_DEFAULT_CAPACITY 256
+#define HOST_TABLE_MAX_CAPACITY (1 << 24)
+
+// Same as BIN_IP_LEN/BIN_MAC_LEN/MAX_IP_LEN in NetworkStructs.h,
+// which not every tool includes
+#define HOST_IP_LEN 4
+#define HOST_MAC_LEN 6
+#define HOST_IPSTR_LEN 18
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  unsigned char IpBin[HOST_IP_LEN];
+  unsigned char MacBin[HOST_MAC_LEN];
+  char IpStr[HOST_IPSTR_LEN + 1];
+} HOST_ENTRY, *PHOST_ENTRY;
+
+
+// Opaque, see HostTable.c
+typedef struct HOST_TABLE HOST_TABLE, *PHOST_TABLE;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+PHOST_TABLE HostTableCreate(int capacityParam);
+void HostTableDestroy(PHOST_TABLE hostTableParam);
+BOOL HostTableAdd(PHOST_TABLE hostTableParam, unsigned char ipBinParam[HOST_IP_LEN], unsigned char macBinParam[HOST_MAC_LEN], char *ipStrParam);
+BOOL HostTableReplace(PHOST_TABLE hostTableParam, PHOST_TABLE newTableParam);
+BOOL HostTableLookupIp(PHOST_TABLE hostTableParam, unsigned char ipBinParam[HOST_IP_LEN], PHOST_ENTRY hostParam);
+BOOL HostTableLookupMac(PHOST_TABLE hostTableParam, unsigned char macBinParam[HOST_MAC_LEN], PHOST_ENTRY hostParam);
+BOOL HostTableGetEntry(PHOST_TABLE hostTableParam, int indexParam, PHOST_ENTRY hostParam);
+int HostTableCopy(PHOST_TABLE hostTableParam, PHOST_ENTRY hostsParam, int maxHostsParam);
+int HostTableCount(PHOST_TABLE hostTableParam);
+long HostTableGeneration(PHOST_TABLE hostTableParam);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,538 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "LatencyStats.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+
+#ifdef _WIN32
+#define LATENCY_LOCK() AcquireSRWLockExclusive(&sRegistryLock)
+#define LATENCY_UNLOCK() ReleaseSRWLockExclusive(&sRegistryLock)
+#define LATENCY_LOAD_ACQUIRE(ptr) ((unsigned int)InterlockedCompareExchange((volatile LONG *)(ptr), 0, 0))
+#define LATENCY_STORE_RELEASE(ptr, value) InterlockedExchange((volatile LONG *)(ptr), (LONG)(value))
+#else
+#define LATENCY_LOCK() pthread_mutex_lock(&sRegistryLock)
+#define LATENCY_UNLOCK() pthread_mutex_unlock(&sRegistryLock)
+#define LATENCY_LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define LATENCY_STORE_RELEASE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#endif
+
+// 100ns ticks between 1601-01-01 (FILETIME) and 1970-01-01
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL
+
+#define LATENCY_SERVER_NAME_SIZE 108
+
+
+static char *sClassNames[LATENCY_CLASSES] = { "GW", "IN", "OUT", "BLOCK" };
+
+static PLATENCY_STATS sRegistry[LATENCY_STATS_MAX_THREADS];
+static int sRegistryCount = 0;
+static volatile unsigned int sServerStopRequested = FALSE;
+static char sServerName[LATENCY_SERVER_NAME_SIZE];
+
+#ifdef _WIN32
+static SRWLOCK sRegistryLock = SRWLOCK_INIT;
+static HANDLE sServerThread = NULL;
+#else
+static pthread_mutex_t sRegistryLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t sServerThread;
+static BOOL sServerRunning = FALSE;
+static int sServerSocket = -1;
+#endif
+
+
+static int LatencyStatsFormatClasses(char *outputParam, int outputSizeParam, char *titleParam, PHISTOGRAM histogramsParam);
+#ifdef _WIN32
+static DWORD WINAPI LatencyStatsServerThread(LPVOID param);
+#else
+static void *LatencyStatsServerThread(void *param);
+#endif
+
+
+/*
+ * LATENCY_STATS_ENV is read once.
+ *
+ */
+BOOL LatencyStatsEnabled()
+{
+  static int enabled = -1;
+
+  if (enabled < 0)
+  {
+    enabled = getenv(LATENCY_STATS_ENV) != NULL ? TRUE : FALSE;
+  }
+
+  return (BOOL)enabled;
+}
+
+
+/*
+ * Histograms for the calling thread. They are part of every
+ * report until LatencyStatsDestroy(). Returns NULL if
+ * LATENCY_STATS_MAX_THREADS are registered already.
+ *
+ */
+PLATENCY_STATS LatencyStatsCreate()
+{
+  PLATENCY_STATS latencyStats = NULL;
+  int counter = 0;
+
+  if ((latencyStats = (PLATENCY_STATS)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(LATENCY_STATS))) == NULL)
+  {
+    return NULL;
+  }
+
+  for (counter = 0; counter < LATENCY_CLASSES; counter++)
+  {
+    HistogramReset(&latencyStats->Transit[counter]);
+    HistogramReset(&latencyStats->Handler[counter]);
+  }
+
+  LATENCY_LOCK();
+
+  if (sRegistryCount < LATENCY_STATS_MAX_THREADS)
+  {
+    sRegistry[sRegistryCount++] = latencyStats;
+  }
+  else
+  {
+    HeapFree(GetProcessHeap(), 0, latencyStats);
+    latencyStats = NULL;
+  }
+
+  LATENCY_UNLOCK();
+
+  return latencyStats;
+}
+
+
+void LatencyStatsDestroy(PLATENCY_STATS latencyStatsParam)
+{
+  int counter = 0;
+
+  if (latencyStatsParam == NULL)
+  {
+    return;
+  }
+
+  LATENCY_LOCK();
+
+  for (counter = 0; counter < sRegistryCount; counter++)
+  {
+    if (sRegistry[counter] == latencyStatsParam)
+    {
+      sRegistry[counter] = sRegistry[--sRegistryCount];
+      sRegistry[sRegistryCount] = NULL;
+      break;
+    }
+  }
+
+  LATENCY_UNLOCK();
+
+  HeapFree(GetProcessHeap(), 0, latencyStatsParam);
+}
+
+
+/*
+ * Monotonic clock in nanoseconds
+ *
+ */
+uint64_t LatencyStatsNow()
+{
+#ifdef _WIN32
+  static LARGE_INTEGER frequency = { 0 };
+  LARGE_INTEGER counter;
+
+  if (frequency.QuadPart == 0)
+  {
+    QueryPerformanceFrequency(&frequency);
+  }
+
+  QueryPerformanceCounter(&counter);
+
+  return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+         (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (uint64_t)frequency.QuadPart;
+#else
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+
+/*
+ * Wall clock in micro seconds since 1970, the time base
+ * of capture timestamps.
+ *
+ */
+uint64_t LatencyStatsWallClockUs()
+{
+#ifdef _WIN32
+  FILETIME now;
+
+  GetSystemTimeAsFileTime(&now);
+
+  return ((((uint64_t)now.dwHighDateTime << 32) | now.dwLowDateTime) - FILETIME_UNIX_EPOCH) / 10;
+#else
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000;
+#endif
+}
+
+
+/*
+ * Record the time since startTimeParam (LatencyStatsNow())
+ *
+ */
+void LatencyStatsRecordHandler(PLATENCY_STATS latencyStatsParam, int classParam, uint64_t startTimeParam)
+{
+  if (latencyStatsParam == NULL ||
+      classParam < 0 ||
+      classParam >= LATENCY_CLASSES)
+  {
+    return;
+  }
+
+  HistogramRecord(&latencyStatsParam->Handler[classParam], LatencyStatsNow() - startTimeParam);
+}
+
+
+/*
+ * Frames without a capture timestamp and frames "sent
+ * before they were captured" (the wall clock was set back)
+ * are not recorded.
+ *
+ */
+void LatencyStatsRecordTransit(PLATENCY_STATS latencyStatsParam, int classParam, uint64_t captureTimeUsParam, uint64_t nowUsParam)
+{
+  if (latencyStatsParam == NULL ||
+      classParam < 0 ||
+      classParam >= LATENCY_CLASSES ||
+      captureTimeUsParam == 0 ||
+      nowUsParam < captureTimeUsParam)
+  {
+    return;
+  }
+
+  HistogramRecord(&latencyStatsParam->Transit[classParam], (nowUsParam - captureTimeUsParam) * 1000);
+}
+
+
+/*
+ * TRANSMIT_SENT_HANDLER, see TransmitQueue.h. contextParam
+ * is the queue owner's PLATENCY_STATS.
+ *
+ */
+void LatencyStatsSentHandler(void *contextParam, uint64_t *captureTimesParam, unsigned char *classesParam, int frameCountParam)
+{
+  PLATENCY_STATS latencyStats = (PLATENCY_STATS)contextParam;
+  uint64_t now = LatencyStatsWallClockUs();
+  int counter = 0;
+
+  for (counter = 0; counter < frameCountParam; counter++)
+  {
+    LatencyStatsRecordTransit(latencyStats, classesParam[counter], captureTimesParam[counter], now);
+  }
+}
+
+
+/*
+ * Merge the histograms of all threads and write the
+ * report to outputParam. Returns the report length.
+ *
+ */
+int LatencyStatsFormat(char *outputParam, int outputSizeParam)
+{
+  PLATENCY_STATS merged = NULL;
+  int threadCount = 0;
+  int length = 0;
+  int counter = 0;
+  int classCounter = 0;
+
+  if (outputParam == NULL ||
+      outputSizeParam <= 0)
+  {
+    return 0;
+  }
+
+  ZeroMemory(outputParam, outputSizeParam);
+
+  if ((merged = (PLATENCY_STATS)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(LATENCY_STATS))) == NULL)
+  {
+    return 0;
+  }
+
+  for (classCounter = 0; classCounter < LATENCY_CLASSES; classCounter++)
+  {
+    HistogramReset(&merged->Transit[classCounter]);
+    HistogramReset(&merged->Handler[classCounter]);
+  }
+
+  LATENCY_LOCK();
+
+  for (counter = 0; counter < sRegistryCount; counter++)
+  {
+    for (classCounter = 0; classCounter < LATENCY_CLASSES; classCounter++)
+    {
+      HistogramMerge(&merged->Transit[classCounter], &sRegistry[counter]->Transit[classCounter]);
+      HistogramMerge(&merged->Handler[classCounter], &sRegistry[counter]->Handler[classCounter]);
+    }
+  }
+
+  threadCount = sRegistryCount;
+
+  LATENCY_UNLOCK();
+
+  length = _snprintf(outputParam, outputSizeParam - 1, "Latency in ns, %d threads\n", threadCount);
+  length = length < 0 ? 0 : length;
+  length += LatencyStatsFormatClasses(outputParam + length, outputSizeParam - length, "Capture to transmit", merged->Transit);
+  length += LatencyStatsFormatClasses(outputParam + length, outputSizeParam - length, "Packet handler", merged->Handler);
+
+  HeapFree(GetProcessHeap(), 0, merged);
+
+  return length;
+}
+
+
+void LatencyStatsPrint()
+{
+  char report[LATENCY_STATS_REPORT_SIZE];
+
+  if (LatencyStatsFormat(report, sizeof(report)) > 0)
+  {
+    printf("%s", report);
+    fflush(stdout);
+  }
+}
+
+
+/*
+ * Start a thread answering every client of the local
+ * stats server nameParam with a report.
+ *
+ */
+BOOL LatencyStatsServerStart(char *nameParam)
+{
+#ifdef _WIN32
+  if (nameParam == NULL ||
+      sServerThread != NULL)
+  {
+    return FALSE;
+  }
+
+  ZeroMemory(sServerName, sizeof(sServerName));
+  _snprintf(sServerName, sizeof(sServerName) - 1, "\\\\.\\pipe\\%s", nameParam);
+  LATENCY_STORE_RELEASE(&sServerStopRequested, FALSE);
+
+  if ((sServerThread = CreateThread(NULL, 0, LatencyStatsServerThread, NULL, 0, NULL)) == NULL)
+  {
+    return FALSE;
+  }
+
+  return TRUE;
+#else
+  struct sockaddr_un address;
+  socklen_t addressLength = 0;
+
+  if (nameParam == NULL ||
+      sServerRunning == TRUE ||
+      strlen(nameParam) >= sizeof(address.sun_path) - 1)
+  {
+    return FALSE;
+  }
+
+  // Abstract name: sun_path starts with a 0 byte, no file is created
+  ZeroMemory(&address, sizeof(address));
+  address.sun_family = AF_UNIX;
+  CopyMemory(address.sun_path + 1, nameParam, strlen(nameParam));
+  addressLength = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + strlen(nameParam));
+
+  ZeroMemory(sServerName, sizeof(sServerName));
+  strncpy(sServerName, nameParam, sizeof(sServerName) - 1);
+
+  if ((sServerSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+  {
+    return FALSE;
+  }
+
+  if (bind(sServerSocket, (struct sockaddr *)&address, addressLength) != 0 ||
+      listen(sServerSocket, 4) != 0)
+  {
+    close(sServerSocket);
+    sServerSocket = -1;
+    return FALSE;
+  }
+
+  LATENCY_STORE_RELEASE(&sServerStopRequested, FALSE);
+
+  if (pthread_create(&sServerThread, NULL, LatencyStatsServerThread, NULL) != 0)
+  {
+    close(sServerSocket);
+    sServerSocket = -1;
+    return FALSE;
+  }
+
+  sServerRunning = TRUE;
+
+  return TRUE;
+#endif
+}
+
+
+void LatencyStatsServerStop()
+{
+#ifdef _WIN32
+  HANDLE wakeupClient = INVALID_HANDLE_VALUE;
+
+  if (sServerThread == NULL)
+  {
+    return;
+  }
+
+  LATENCY_STORE_RELEASE(&sServerStopRequested, TRUE);
+
+  // The thread waits in ConnectNamedPipe(), connect once to wake it up
+  if ((wakeupClient = CreateFileA(sServerName, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL)) != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(wakeupClient);
+  }
+
+  WaitForSingleObject(sServerThread, INFINITE);
+  CloseHandle(sServerThread);
+  sServerThread = NULL;
+#else
+  if (sServerRunning == FALSE)
+  {
+    return;
+  }
+
+  LATENCY_STORE_RELEASE(&sServerStopRequested, TRUE);
+  pthread_join(sServerThread, NULL);
+
+  close(sServerSocket);
+  sServerSocket = -1;
+  sServerRunning = FALSE;
+#endif
+}
+
+
+
+static int LatencyStatsFormatClasses(char *outputParam, int outputSizeParam, char *titleParam, PHISTOGRAM histogramsParam)
+{
+  int length = 0;
+  int funcRetVal = 0;
+  int counter = 0;
+
+  if (outputSizeParam <= 1)
+  {
+    return 0;
+  }
+
+  funcRetVal = _snprintf(outputParam, outputSizeParam - 1, "%s\n  %-6s %12s %10s %10s %10s %10s %12s\n",
+    titleParam, "", "count", "p50", "p90", "p99", "p99.9", "max");
+
+  if (funcRetVal < 0 || funcRetVal >= outputSizeParam - 1)
+  {
+    return 0;
+  }
+
+  length = funcRetVal;
+
+  for (counter = 0; counter < LATENCY_CLASSES; counter++)
+  {
+    funcRetVal = _snprintf(outputParam + length, outputSizeParam - length - 1, "  %-6s %12llu %10llu %10llu %10llu %10llu %12llu\n",
+      sClassNames[counter],
+      (unsigned long long)histogramsParam[counter].TotalCount,
+      (unsigned long long)HistogramPercentile(&histogramsParam[counter], 50.0),
+      (unsigned long long)HistogramPercentile(&histogramsParam[counter], 90.0),
+      (unsigned long long)HistogramPercentile(&histogramsParam[counter], 99.0),
+      (unsigned long long)HistogramPercentile(&histogramsParam[counter], 99.9),
+      (unsigned long long)histogramsParam[counter].MaxValue);
+
+    if (funcRetVal < 0 || funcRetVal >= outputSizeParam - length - 1)
+    {
+      break;
+    }
+
+    length += funcRetVal;
+  }
+
+  return length;
+}
+
+
+#ifdef _WIN32
+static DWORD WINAPI LatencyStatsServerThread(LPVOID param)
+{
+  char report[LATENCY_STATS_REPORT_SIZE];
+  HANDLE pipeHandle = INVALID_HANDLE_VALUE;
+  DWORD bytesWritten = 0;
+  int reportLength = 0;
+
+  while (LATENCY_LOAD_ACQUIRE(&sServerStopRequested) == FALSE)
+  {
+    if ((pipeHandle = CreateNamedPipeA(sServerName, PIPE_ACCESS_OUTBOUND, PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, PIPE_UNLIMITED_INSTANCES, LATENCY_STATS_REPORT_SIZE, 0, 0, NULL)) == INVALID_HANDLE_VALUE)
+    {
+      break;
+    }
+
+    if ((ConnectNamedPipe(pipeHandle, NULL) == TRUE || GetLastError() == ERROR_PIPE_CONNECTED) &&
+        LATENCY_LOAD_ACQUIRE(&sServerStopRequested) == FALSE)
+    {
+      reportLength = LatencyStatsFormat(report, sizeof(report));
+      WriteFile(pipeHandle, report, (DWORD)reportLength, &bytesWritten, NULL);
+      FlushFileBuffers(pipeHandle);
+    }
+
+    DisconnectNamedPipe(pipeHandle);
+    CloseHandle(pipeHandle);
+  }
+
+  return 0;
+}
+#else
+static void *LatencyStatsServerThread(void *param)
+{
+  char report[LATENCY_STATS_REPORT_SIZE];
+  struct pollfd pollFd;
+  int clientSocket = -1;
+  int reportLength = 0;
+
+  pollFd.fd = sServerSocket;
+  pollFd.events = POLLIN;
+
+  while (LATENCY_LOAD_ACQUIRE(&sServerStopRequested) == FALSE)
+  {
+    if (poll(&pollFd, 1, LATENCY_STATS_POLL_TIMEOUT) <= 0 ||
+        (clientSocket = accept(sServerSocket, NULL, NULL)) < 0)
+    {
+      continue;
+    }
+
+    reportLength = LatencyStatsFormat(report, sizeof(report));
+
+    if (send(clientSocket, report, reportLength, MSG_NOSIGNAL) != reportLength)
+    {
+      // The client went away, nothing to do about it
+    }
+
+    close(clientSocket);
+  }
+
+  return NULL;
+}
+#endif
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Histogram.h"
+#include "Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-thread latency histograms of the forwarding path.
+ *
+ * Every packet thread owns one LATENCY_STATS and is the only one
+ * recording into it, so recording takes no lock. Two values are
+ * kept per verdict:
+ *
+ *  - Transit: capture timestamp of the frame until it was handed
+ *    to the backend (CaptureSendBatch() returned, or the frame
+ *    was put on the AF_XDP transmit ring). Blocked frames are
+ *    never sent, for them it ends with the verdict.
+ *  - Handler: time the packet handler spent on the frame.
+ *
+ * All values are in nanoseconds. Capture timestamps only have
+ * micro second resolution and come from the capture driver's
+ * wall clock, transit times include any difference between the
+ * two clocks.
+ *
+ * LatencyStatsFormat() merges the histograms of all threads. It
+ * reads them while they are written, a report may be off by the
+ * packets recorded meanwhile. Reports are written on request
+ * (LatencyStatsPrint()) or to every client of the stats server:
+ * a named pipe \\.\pipe\<name> on Windows, an abstract unix
+ * socket @<name> on Linux.
+ *
+ */
+
+// Set to record latencies. Off by default, it costs two clock reads per packet.
+#define LATENCY_STATS_ENV "LATENCY_STATS"
+
+#define LATENCY_STATS_MAX_THREADS 64
+#define LATENCY_STATS_REPORT_SIZE 4096
+#define LATENCY_STATS_POLL_TIMEOUT 200   // ms
+
+// Verdicts
+#define LATENCY_CLASS_GW    0
+#define LATENCY_CLASS_IN    1
+#define LATENCY_CLASS_OUT   2
+#define LATENCY_CLASS_BLOCK 3
+#define LATENCY_CLASSES     4
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  HISTOGRAM Transit[LATENCY_CLASSES];
+  HISTOGRAM Handler[LATENCY_CLASSES];
+} LATENCY_STATS, *PLATENCY_STATS;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+BOOL LatencyStatsEnabled();
+PLATENCY_STATS LatencyStatsCreate();
+void LatencyStatsDestroy(PLATENCY_STATS latencyStatsParam);
+uint64_t LatencyStatsNow();
+uint64_t LatencyStatsWallClockUs();
+void LatencyStatsRecordHandler(PLATENCY_STATS latencyStatsParam, int classParam, uint64_t startTimeParam);
+void LatencyStatsRecordTransit(PLATENCY_STATS latencyStatsParam, int classParam, uint64_t captureTimeUsParam, uint64_t nowUsParam);
+void LatencyStatsSentHandler(void *contextParam, uint64_t *captureTimesParam, unsigned char *classesParam, int frameCountParam);
+int LatencyStatsFormat(char *outputParam, int outputSizeParam);
+void LatencyStatsPrint();
+BOOL LatencyStatsServerStart(char *nameParam);
+void LatencyStatsServerStop();
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,10 +1,12 @@
 #pragma once
 
-#include <Windows.h>
 #include <stdint.h>
+#include "Platform.h"
 
 #define ETHERTYPE_ARP 0x0806
 #define ETHERTYPE_IP 0x0800
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88a8
 
 #define IP_PROTO_UDP 17
 #define IP_PROTO_TCP 6
@@ -22,6 +24,8 @@
 #define MAX_MAC_LEN 18
 #define BIN_IP_LEN 4
 #define MAX_IP_LEN 18
+#define BIN_IPv6_LEN  16
+#define MAX_IPv6_LEN 64
 
 
 
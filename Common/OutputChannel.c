@@ -0,0 +1,684 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "OutputChannel.h"
+#include "Probes.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+
+#ifdef _WIN32
+#define OUTPUT_CHANNEL_LOAD_ACQUIRE(ptr) ((unsigned int)InterlockedCompareExchange((volatile LONG *)(ptr), 0, 0))
+#define OUTPUT_CHANNEL_STORE_RELEASE(ptr, value) InterlockedExchange((volatile LONG *)(ptr), (LONG)(value))
+#define OUTPUT_CHANNEL_CAS(ptr, expected, value) (InterlockedCompareExchange((volatile LONG *)(ptr), (LONG)(value), (LONG)(expected)) == (LONG)(expected))
+#define OUTPUT_CHANNEL_LOAD64(ptr) ((uint64_t)InterlockedCompareExchange64((volatile LONG64 *)(ptr), 0, 0))
+#define OUTPUT_CHANNEL_ADD64(ptr, value) InterlockedExchangeAdd64((volatile LONG64 *)(ptr), (LONG64)(value))
+#else
+#define OUTPUT_CHANNEL_LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define OUTPUT_CHANNEL_STORE_RELEASE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define OUTPUT_CHANNEL_CAS(ptr, expected, value) __sync_bool_compare_and_swap((ptr), (expected), (value))
+#define OUTPUT_CHANNEL_LOAD64(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define OUTPUT_CHANNEL_ADD64(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_RELAXED)
+#endif
+
+/*
+ * A record in the ring is a 32 bit header followed by the data,
+ * padded to the next header. The header is 0 until the record is
+ * ready, the writer thread zeroes every byte it consumed. A record
+ * that would wrap around starts at offset 0 instead, a skip header
+ * marks the rest of the lap as unused.
+ *
+ */
+#define OUTPUT_RECORD_HEADER 4
+#define OUTPUT_RECORD_READY 0x01
+#define OUTPUT_RECORD_SKIP 0x02
+#define OUTPUT_RECORD_LENGTH_SHIFT 2
+#define OUTPUT_RECORD_SIZE(length) ((OUTPUT_RECORD_HEADER + (length) + 3) & ~3U)
+#define OUTPUT_RING_MASK (OUTPUT_CHANNEL_RING_SIZE - 1)
+
+
+/*
+ * Type definitions
+ *
+ */
+struct OUTPUT_CHANNEL
+{
+  // Callers of OutputChannelWrite()
+  volatile unsigned int Head;        // Ring bytes claimed
+  char Padding1[60];
+
+  // Writer thread
+  volatile unsigned int Tail;        // Ring bytes consumed
+  volatile unsigned int Written;     // Ring bytes consumed and written
+  char Padding2[56];
+
+  unsigned char *Ring;
+  char *Batch;
+  int Policy;
+  BOOL MessageMode;                  // Endpoint keeps the write boundaries
+  volatile unsigned int Open;
+  volatile unsigned int StopRequested;
+  volatile uint64_t Dropped;
+  volatile uint64_t DroppedBytes;
+  volatile uint64_t Blocked;
+  uint64_t Records;
+  uint64_t Bytes;
+  uint64_t Batches;
+  uint64_t WriteErrors;
+  OUTPUT_CHANNEL_ERROR_HANDLER ErrorHandler;
+  void *ErrorContext;
+
+#ifdef _WIN32
+  HANDLE Target;
+  HANDLE Thread;
+#else
+  int Target;
+  pthread_t Thread;
+#endif
+};
+
+
+static volatile unsigned int *OutputChannelReserve(POUTPUT_CHANNEL channelParam, unsigned int dataLengthParam);
+static void OutputChannelDrop(POUTPUT_CHANNEL channelParam, uint64_t recordsParam, uint64_t bytesParam);
+static unsigned int OutputChannelDrain(POUTPUT_CHANNEL channelParam);
+static BOOL OutputChannelWriteTarget(POUTPUT_CHANNEL channelParam, char *dataParam, int dataLengthParam);
+static BOOL OutputChannelOpenTarget(POUTPUT_CHANNEL channelParam, char *pathParam);
+static void OutputChannelCloseTarget(POUTPUT_CHANNEL channelParam);
+#ifdef _WIN32
+static DWORD WINAPI OutputChannelThread(LPVOID param);
+#else
+static void *OutputChannelThread(void *param);
+#endif
+
+
+/*
+ * Connect to the endpoint at pathParam and start the writer
+ * thread. On Windows pathParam is a file name, usually
+ * "\\.\pipe\<name>". On Linux it is the path of a listening Unix
+ * domain socket or of a FIFO, opening a FIFO waits for its reader.
+ *
+ */
+POUTPUT_CHANNEL OutputChannelOpen(char *pathParam, int policyParam)
+{
+  POUTPUT_CHANNEL channel = NULL;
+  BOOL started = FALSE;
+
+  if (pathParam == NULL ||
+      (policyParam != OUTPUT_POLICY_DROP && policyParam != OUTPUT_POLICY_BLOCK))
+  {
+    return NULL;
+  }
+
+  if ((channel = (POUTPUT_CHANNEL)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(OUTPUT_CHANNEL))) == NULL)
+  {
+    return NULL;
+  }
+
+  channel->Policy = policyParam;
+#ifdef _WIN32
+  channel->Target = INVALID_HANDLE_VALUE;
+#else
+  channel->Target = -1;
+#endif
+
+  if ((channel->Ring = (unsigned char *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, OUTPUT_CHANNEL_RING_SIZE)) == NULL ||
+      (channel->Batch = (char *)HeapAlloc(GetProcessHeap(), 0, OUTPUT_CHANNEL_BATCH_SIZE)) == NULL ||
+      OutputChannelOpenTarget(channel, pathParam) == FALSE)
+  {
+    goto END;
+  }
+
+  channel->Open = TRUE;
+
+#ifdef _WIN32
+  if ((channel->Thread = CreateThread(NULL, 0, OutputChannelThread, channel, 0, NULL)) == NULL)
+  {
+    goto END;
+  }
+#else
+  if (pthread_create(&channel->Thread, NULL, OutputChannelThread, channel) != 0)
+  {
+    goto END;
+  }
+#endif
+
+  started = TRUE;
+
+END:
+
+  if (started == TRUE)
+  {
+    return channel;
+  }
+
+  OutputChannelCloseTarget(channel);
+
+  if (channel->Batch != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, channel->Batch);
+  }
+
+  if (channel->Ring != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, channel->Ring);
+  }
+
+  HeapFree(GetProcessHeap(), 0, channel);
+
+  return NULL;
+}
+
+
+/*
+ * Write out what is in the ring, stop the writer thread and
+ * close the endpoint.
+ *
+ */
+void OutputChannelClose(POUTPUT_CHANNEL channelParam)
+{
+  if (channelParam == NULL)
+  {
+    return;
+  }
+
+  OUTPUT_CHANNEL_STORE_RELEASE(&channelParam->StopRequested, TRUE);
+
+#ifdef _WIN32
+  WaitForSingleObject(channelParam->Thread, INFINITE);
+  CloseHandle(channelParam->Thread);
+#else
+  pthread_join(channelParam->Thread, NULL);
+#endif
+
+  OutputChannelCloseTarget(channelParam);
+  HeapFree(GetProcessHeap(), 0, channelParam->Batch);
+  HeapFree(GetProcessHeap(), 0, channelParam->Ring);
+  HeapFree(GetProcessHeap(), 0, channelParam);
+}
+
+
+/*
+ * Set it before the first record is written, the writer
+ * thread reads it without synchronisation.
+ *
+ */
+void OutputChannelSetErrorHandler(POUTPUT_CHANNEL channelParam, OUTPUT_CHANNEL_ERROR_HANDLER handlerParam, void *contextParam)
+{
+  if (channelParam == NULL)
+  {
+    return;
+  }
+
+  channelParam->ErrorHandler = handlerParam;
+  channelParam->ErrorContext = contextParam;
+}
+
+
+/*
+ * FALSE once a write to the endpoint failed
+ *
+ */
+BOOL OutputChannelIsOpen(POUTPUT_CHANNEL channelParam)
+{
+  return channelParam != NULL && OUTPUT_CHANNEL_LOAD_ACQUIRE(&channelParam->Open) == TRUE;
+}
+
+
+BOOL OutputChannelWrite(POUTPUT_CHANNEL channelParam, char *dataParam, int dataLengthParam)
+{
+  OUTPUT_BUFFER buffer;
+
+  buffer.Data = dataParam;
+  buffer.Length = dataLengthParam;
+
+  return OutputChannelWriteVector(channelParam, &buffer, 1);
+}
+
+
+/*
+ * Gather the buffers into one record. FALSE if the record
+ * was dropped.
+ *
+ */
+BOOL OutputChannelWriteVector(POUTPUT_CHANNEL channelParam, POUTPUT_BUFFER buffersParam, int bufferCountParam)
+{
+  volatile unsigned int *header = NULL;
+  unsigned char *data = NULL;
+  int dataLength = 0;
+  int counter = 0;
+
+  if (channelParam == NULL ||
+      buffersParam == NULL ||
+      bufferCountParam <= 0)
+  {
+    return FALSE;
+  }
+
+  for (counter = 0; counter < bufferCountParam; counter++)
+  {
+    dataLength += buffersParam[counter].Length;
+  }
+
+  if (dataLength <= 0)
+  {
+    return FALSE;
+  }
+
+  if (dataLength > OUTPUT_CHANNEL_MAX_RECORD ||
+      (header = OutputChannelReserve(channelParam, dataLength)) == NULL)
+  {
+    OutputChannelDrop(channelParam, 1, dataLength);
+    return FALSE;
+  }
+
+  data = (unsigned char *)header + OUTPUT_RECORD_HEADER;
+
+  for (dataLength = 0, counter = 0; counter < bufferCountParam; counter++)
+  {
+    CopyMemory(data + dataLength, buffersParam[counter].Data, buffersParam[counter].Length);
+    dataLength += buffersParam[counter].Length;
+  }
+
+  PROBE_OUTPUT_WRITTEN(data, dataLength);
+  OUTPUT_CHANNEL_STORE_RELEASE(header, ((unsigned int)dataLength << OUTPUT_RECORD_LENGTH_SHIFT) | OUTPUT_RECORD_READY);
+
+  return TRUE;
+}
+
+
+/*
+ * Wait until all records written before this call
+ * reached the endpoint (or were dropped).
+ *
+ */
+BOOL OutputChannelFlush(POUTPUT_CHANNEL channelParam)
+{
+  unsigned int target = 0;
+  unsigned int waited = 0;
+
+  if (channelParam == NULL)
+  {
+    return TRUE;
+  }
+
+  target = OUTPUT_CHANNEL_LOAD_ACQUIRE(&channelParam->Head);
+
+  while ((int)(OUTPUT_CHANNEL_LOAD_ACQUIRE(&channelParam->Written) - target) < 0)
+  {
+    if (waited >= OUTPUT_CHANNEL_FLUSH_TIMEOUT)
+    {
+      return FALSE;
+    }
+
+    Sleep(1);
+    waited++;
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * The writer thread's counters are read without synchronisation,
+ * they may be slightly behind.
+ *
+ */
+void OutputChannelGetStats(POUTPUT_CHANNEL channelParam, POUTPUT_CHANNEL_STATS statsParam)
+{
+  if (statsParam == NULL)
+  {
+    return;
+  }
+
+  ZeroMemory(statsParam, sizeof(OUTPUT_CHANNEL_STATS));
+
+  if (channelParam == NULL)
+  {
+    return;
+  }
+
+  statsParam->Records = channelParam->Records;
+  statsParam->Bytes = channelParam->Bytes;
+  statsParam->Batches = channelParam->Batches;
+  statsParam->Dropped = OUTPUT_CHANNEL_LOAD64(&channelParam->Dropped);
+  statsParam->DroppedBytes = OUTPUT_CHANNEL_LOAD64(&channelParam->DroppedBytes);
+  statsParam->Blocked = OUTPUT_CHANNEL_LOAD64(&channelParam->Blocked);
+  statsParam->WriteErrors = channelParam->WriteErrors;
+  statsParam->Pending = OUTPUT_CHANNEL_LOAD_ACQUIRE(&channelParam->Head) - OUTPUT_CHANNEL_LOAD_ACQUIRE(&channelParam->Written);
+}
+
+
+
+/*
+ * Claim ring space for a record of dataLengthParam bytes and
+ * return its header. NULL if the record has to be dropped.
+ *
+ */
+static volatile unsigned int *OutputChannelReserve(POUTPUT_CHANNEL channelParam, unsigned int dataLengthParam)
+{
+  unsigned int recordSize = OUTPUT_RECORD_SIZE(dataLengthParam);
+  unsigned int claimSize = 0;
+  unsigned int head = 0;
+  unsigned int tail = 0;
+  unsigned int offset = 0;
+  unsigned int waited = 0;
+
+  if (OUTPUT_CHANNEL_LOAD_ACQUIRE(&channelParam->Open) == FALSE)
+  {
+    return NULL;
+  }
+
+  while (TRUE)
+  {
+    head = OUTPUT_CHANNEL_LOAD_ACQUIRE(&channelParam->Head);
+    tail = OUTPUT_CHANNEL_LOAD_ACQUIRE(&channelParam->Tail);
+    offset = head & OUTPUT_RING_MASK;
+
+    // No wrap around inside a record
+    claimSize = offset + recordSize > OUTPUT_CHANNEL_RING_SIZE ?
+      OUTPUT_CHANNEL_RING_SIZE - offset + recordSize : recordSize;
+
+    if (head + claimSize - tail <= OUTPUT_CHANNEL_RING_SIZE)
+    {
+      if (OUTPUT_CHANNEL_CAS(&channelParam->Head, head, head + claimSize))
+      {
+        break;
+      }
+
+      continue;
+    }
+
+    // Ring is full
+    if (channelParam->Policy == OUTPUT_POLICY_DROP ||
+        OUTPUT_CHANNEL_LOAD_ACQUIRE(&channelParam->Open) == FALSE)
+    {
+      return NULL;
+    }
+
+    if (waited == 0)
+    {
+      OUTPUT_CHANNEL_ADD64(&channelParam->Blocked, 1);
+    }
+
+    Sleep(waited < OUTPUT_CHANNEL_BLOCK_SPINS ? 0 : 1);
+    waited++;
+  }
+
+  if (claimSize != recordSize)
+  {
+    OUTPUT_CHANNEL_STORE_RELEASE((volatile unsigned int *)(channelParam->Ring + offset), OUTPUT_RECORD_SKIP);
+    offset = 0;
+  }
+
+  return (volatile unsigned int *)(channelParam->Ring + offset);
+}
+
+
+static void OutputChannelDrop(POUTPUT_CHANNEL channelParam, uint64_t recordsParam, uint64_t bytesParam)
+{
+  OUTPUT_CHANNEL_ADD64(&channelParam->Dropped, recordsParam);
+  OUTPUT_CHANNEL_ADD64(&channelParam->DroppedBytes, bytesParam);
+}
+
+
+/*
+ * Move the ready records at the tail of the ring into the batch
+ * buffer and write them out. A message-mode pipe gets one record
+ * per batch. Returns the ring bytes consumed.
+ *
+ */
+static unsigned int OutputChannelDrain(POUTPUT_CHANNEL channelParam)
+{
+  unsigned int head = OUTPUT_CHANNEL_LOAD_ACQUIRE(&channelParam->Head);
+  unsigned int start = channelParam->Tail;
+  unsigned int tail = start;
+  unsigned int offset = 0;
+  unsigned int header = 0;
+  unsigned int recordSize = 0;
+  unsigned int dataLength = 0;
+  unsigned int batchLength = 0;
+  unsigned int records = 0;
+
+  while (tail != head)
+  {
+    offset = tail & OUTPUT_RING_MASK;
+
+    // Still being copied in
+    if ((header = OUTPUT_CHANNEL_LOAD_ACQUIRE((volatile unsigned int *)(channelParam->Ring + offset))) == 0)
+    {
+      break;
+    }
+
+    if (header == OUTPUT_RECORD_SKIP)
+    {
+      recordSize = OUTPUT_CHANNEL_RING_SIZE - offset;
+    }
+    else
+    {
+      dataLength = header >> OUTPUT_RECORD_LENGTH_SHIFT;
+      if (records > 0 &&
+          (channelParam->MessageMode == TRUE || batchLength + dataLength > OUTPUT_CHANNEL_BATCH_SIZE))
+      {
+        break;
+      }
+
+      CopyMemory(channelParam->Batch + batchLength, channelParam->Ring + offset + OUTPUT_RECORD_HEADER, dataLength);
+      batchLength += dataLength;
+      recordSize = OUTPUT_RECORD_SIZE(dataLength);
+      records++;
+    }
+
+    ZeroMemory(channelParam->Ring + offset, recordSize);
+    tail += recordSize;
+  }
+
+  if (tail == start)
+  {
+    return 0;
+  }
+
+  // Hand the space back before the slow part
+  OUTPUT_CHANNEL_STORE_RELEASE(&channelParam->Tail, tail);
+
+  if (records > 0)
+  {
+    if (OUTPUT_CHANNEL_LOAD_ACQUIRE(&channelParam->Open) == TRUE &&
+        OutputChannelWriteTarget(channelParam, channelParam->Batch, batchLength) == TRUE)
+    {
+      channelParam->Records += records;
+      channelParam->Bytes += batchLength;
+      channelParam->Batches++;
+    }
+    else
+    {
+      OutputChannelDrop(channelParam, records, batchLength);
+    }
+  }
+
+  OUTPUT_CHANNEL_STORE_RELEASE(&channelParam->Written, tail);
+
+  return tail - start;
+}
+
+
+static BOOL OutputChannelWriteTarget(POUTPUT_CHANNEL channelParam, char *dataParam, int dataLengthParam)
+{
+  char error[128];
+#ifdef _WIN32
+  DWORD written = 0;
+#else
+  ssize_t written = 0;
+#endif
+
+  while (dataLengthParam > 0)
+  {
+#ifdef _WIN32
+    if (!WriteFile(channelParam->Target, dataParam, dataLengthParam, &written, NULL))
+#else
+    if ((written = write(channelParam->Target, dataParam, dataLengthParam)) < 0 &&
+        errno == EINTR)
+    {
+      continue;
+    }
+
+    if (written <= 0)
+#endif
+    {
+      // The reader is gone. Only the first failed write gets
+      // here, nothing is written once the channel is closed.
+      ZeroMemory(error, sizeof(error));
+#ifdef _WIN32
+      _snprintf(error, sizeof(error) - 1, "WriteFile(): Error %lu", GetLastError());
+#else
+      _snprintf(error, sizeof(error) - 1, "write(): %s", strerror(errno));
+#endif
+
+      channelParam->WriteErrors++;
+      OUTPUT_CHANNEL_STORE_RELEASE(&channelParam->Open, FALSE);
+      OutputChannelCloseTarget(channelParam);
+
+      if (channelParam->ErrorHandler != NULL)
+      {
+        channelParam->ErrorHandler(channelParam->ErrorContext, error);
+      }
+
+      return FALSE;
+    }
+
+    dataParam += written;
+    dataLengthParam -= (int)written;
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * Only a pipe created with PIPE_TYPE_MESSAGE keeps the write
+ * boundaries, every other endpoint is a byte stream.
+ *
+ */
+static BOOL OutputChannelOpenTarget(POUTPUT_CHANNEL channelParam, char *pathParam)
+{
+#ifdef _WIN32
+  DWORD pipeFlags = 0;
+
+  if ((channelParam->Target = CreateFileA(pathParam, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL)) == INVALID_HANDLE_VALUE)
+  {
+    return FALSE;
+  }
+
+  channelParam->MessageMode = GetNamedPipeInfo(channelParam->Target, &pipeFlags, NULL, NULL, NULL) &&
+    (pipeFlags & PIPE_TYPE_MESSAGE) != 0 ? TRUE : FALSE;
+
+  return TRUE;
+#else
+  struct sockaddr_un address;
+  struct stat targetInfo;
+
+  if (stat(pathParam, &targetInfo) != 0)
+  {
+    return FALSE;
+  }
+
+  if (S_ISSOCK(targetInfo.st_mode) == 0)
+  {
+    return (channelParam->Target = open(pathParam, O_WRONLY | O_CLOEXEC)) >= 0;
+  }
+
+  if (strlen(pathParam) >= sizeof(address.sun_path))
+  {
+    return FALSE;
+  }
+
+  ZeroMemory(&address, sizeof(address));
+  address.sun_family = AF_UNIX;
+  CopyMemory(address.sun_path, pathParam, strlen(pathParam));
+
+  if ((channelParam->Target = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+  {
+    return FALSE;
+  }
+
+  if (connect(channelParam->Target, (struct sockaddr *)&address, sizeof(address)) != 0)
+  {
+    close(channelParam->Target);
+    channelParam->Target = -1;
+    return FALSE;
+  }
+
+  return TRUE;
+#endif
+}
+
+
+static void OutputChannelCloseTarget(POUTPUT_CHANNEL channelParam)
+{
+#ifdef _WIN32
+  if (channelParam->Target != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(channelParam->Target);
+    channelParam->Target = INVALID_HANDLE_VALUE;
+  }
+#else
+  if (channelParam->Target >= 0)
+  {
+    close(channelParam->Target);
+    channelParam->Target = -1;
+  }
+#endif
+}
+
+
+/*
+ * Writer thread. Once stopped it empties the ring before it
+ * returns.
+ *
+ */
+#ifdef _WIN32
+static DWORD WINAPI OutputChannelThread(LPVOID param)
+#else
+static void *OutputChannelThread(void *param)
+#endif
+{
+  POUTPUT_CHANNEL channel = (POUTPUT_CHANNEL)param;
+  unsigned int stopRequested = FALSE;
+
+#ifndef _WIN32
+  sigset_t signals;
+
+  // A reader going away must not kill the process,
+  // the write fails with EPIPE instead.
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+#endif
+
+  while (TRUE)
+  {
+    stopRequested = OUTPUT_CHANNEL_LOAD_ACQUIRE(&channel->StopRequested);
+
+    if (OutputChannelDrain(channel) > 0)
+    {
+      continue;
+    }
+
+    if (stopRequested == TRUE &&
+        OUTPUT_CHANNEL_LOAD_ACQUIRE(&channel->Head) == channel->Tail)
+    {
+      break;
+    }
+
+    Sleep(OUTPUT_CHANNEL_IDLE_SLEEP);
+  }
+
+  return 0;
+}
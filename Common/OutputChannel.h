@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Batched asynchronous output channel.
+ *
+ * Records are written to a local IPC endpoint: a named pipe on
+ * Windows, a Unix domain socket or a FIFO on Linux. Any thread may
+ * call OutputChannelWrite(). The record is copied into a bounded
+ * ring shared by all writers, a slot is claimed with a single
+ * compare-and-swap and no lock is taken. One writer thread gathers
+ * the ready records into batches of up to OUTPUT_CHANNEL_BATCH_SIZE
+ * bytes and writes each batch with a single system call.
+ *
+ * Records are never split or interleaved. On stream endpoints (Unix
+ * domain sockets, FIFOs and byte-mode pipes) consecutive records
+ * share one write, the reader finds the record boundaries in the
+ * data itself, e.g. the line breaks ending the Sniffer records. A
+ * message-mode pipe gets every record as a message of its own.
+ *
+ * If the ring is full, OUTPUT_POLICY_DROP drops the record and counts
+ * it, the caller never waits. OUTPUT_POLICY_BLOCK makes the caller
+ * wait until the writer thread freed enough space.
+ *
+ * If a write fails the endpoint is closed. Later records are dropped
+ * and OutputChannelIsOpen() returns FALSE. The error handler, if
+ * one is set, is called once from the writer thread then.
+ *
+ * No thread may write to the channel while it is closed.
+ *
+ */
+
+#define OUTPUT_CHANNEL_RING_SIZE (1024 * 1024)   // Power of two
+#define OUTPUT_CHANNEL_BATCH_SIZE 65536
+#define OUTPUT_CHANNEL_MAX_RECORD (OUTPUT_CHANNEL_BATCH_SIZE - 4)
+#define OUTPUT_CHANNEL_IDLE_SLEEP 1
+#define OUTPUT_CHANNEL_BLOCK_SPINS 64             // Yields before a blocked writer sleeps
+#define OUTPUT_CHANNEL_FLUSH_TIMEOUT 2000
+
+#define OUTPUT_POLICY_DROP 0
+#define OUTPUT_POLICY_BLOCK 1
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  char *Data;
+  int Length;
+} OUTPUT_BUFFER, *POUTPUT_BUFFER;
+
+
+typedef struct
+{
+  uint64_t Records;          // Written to the endpoint
+  uint64_t Bytes;
+  uint64_t Batches;          // Writes, one record each on message-mode pipes
+  uint64_t Dropped;          // Ring full, record too long or endpoint closed
+  uint64_t DroppedBytes;
+  uint64_t Blocked;          // Records that waited for space
+  uint64_t WriteErrors;
+  unsigned int Pending;      // Ring bytes not written yet
+} OUTPUT_CHANNEL_STATS, *POUTPUT_CHANNEL_STATS;
+
+// Opaque, see OutputChannel.c
+typedef struct OUTPUT_CHANNEL OUTPUT_CHANNEL, *POUTPUT_CHANNEL;
+
+// Called from the writer thread when the endpoint was closed
+// after a failed write
+typedef void(*OUTPUT_CHANNEL_ERROR_HANDLER)(void *contextParam, char *errorParam);
+
+
+/*
+ * Function forward declarations
+ *
+ */
+POUTPUT_CHANNEL OutputChannelOpen(char *pathParam, int policyParam);
+void OutputChannelClose(POUTPUT_CHANNEL channelParam);
+void OutputChannelSetErrorHandler(POUTPUT_CHANNEL channelParam, OUTPUT_CHANNEL_ERROR_HANDLER handlerParam, void *contextParam);
+BOOL OutputChannelIsOpen(POUTPUT_CHANNEL channelParam);
+BOOL OutputChannelWrite(POUTPUT_CHANNEL channelParam, char *dataParam, int dataLengthParam);
+BOOL OutputChannelWriteVector(POUTPUT_CHANNEL channelParam, POUTPUT_BUFFER buffersParam, int bufferCountParam);
+BOOL OutputChannelFlush(POUTPUT_CHANNEL channelParam);
+void OutputChannelGetStats(POUTPUT_CHANNEL channelParam, POUTPUT_CHANNEL_STATS statsParam);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,2962 @@
+// sendmmsg()
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define HAVE_REMOTE
+#endif
+
+#include <pcap.h>
+
+#include "PacketCapture.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/ethtool.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+// pcap.h has its own (classic) struct bpf_insn
+#define bpf_insn linux_bpf_insn
+#include <linux/bpf.h>
+#undef bpf_insn
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/sockios.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#endif
+
+
+// Dump file windows are mapped at multiples of this
+#define DUMP_WINDOW_ALIGNMENT (64 * 1024)
+
+// pcapng block types
+#define PCAPNG_SECTION_HEADER    0x0a0d0d0a
+#define PCAPNG_INTERFACE         0x00000001
+#define PCAPNG_ENHANCED_PACKET   0x00000006
+
+
+#if defined(__linux__)
+// Ownership of a receive chunk of the AF_XDP UMEM
+#define XDP_CHUNK_KERNEL   0    // On the fill or receive ring
+#define XDP_CHUNK_USER     1    // In the batch the handler works on
+#define XDP_CHUNK_TX_USER  2    // Forwarded, the batch isn't done yet
+#define XDP_CHUNK_TX       3    // Forwarded, waits for its completion
+
+// The kernel puts received frames this far into their chunk
+// (XDP_PACKET_HEADROOM), the rest of the chunk limits the MTU
+#define XDP_FRAME_HEADROOM 256
+
+// 802.1Q tag the kernel strips from TPACKET frames, see
+// TpacketInsertVlanTag()
+#define TPACKET_VLAN_TAG_LEN 4
+
+// Instructions of the XDP steering program, see XdpAttachProgram()
+#define XDP_PROG_PORTS     19
+#define XDP_PROG_REDIRECT  33
+#define XDP_PROG_PASS      39
+#define XDP_PROG_LENGTH    41
+#define XDP_JUMP(fromParam, toParam) ((toParam) - (fromParam) - 1)
+
+
+// One AF_XDP ring as mapped from the socket. Cached is the
+// producer index on rings user space fills (fill, TX) and
+// the consumer index on the others (completion, RX).
+typedef struct
+{
+  volatile uint32_t *Producer;
+  volatile uint32_t *Consumer;
+  void *Descriptors;
+  unsigned char *Map;
+  size_t MapSize;
+  uint32_t Mask;
+  uint32_t Size;
+  uint32_t Cached;
+} XDP_RING, *PXDP_RING;
+#endif
+
+
+struct CAPTURE_HANDLE
+{
+  int Backend;
+  int SnapLen;
+  int ReadTimeout;
+  volatile int BreakLoop;
+  pcap_t *PcapHandle;
+  int Socket;
+  unsigned char *Ring;
+  unsigned int RingSize;
+  unsigned int BlockSize;
+  unsigned int BlockCount;
+  unsigned int CurrentBlock;
+  unsigned char *ReplayData;
+  unsigned int ReplayDataSize;
+  struct pcap_pkthdr *ReplayHeaders;
+  unsigned char **ReplayFrames;
+  unsigned int ReplayFrameCount;
+  int ReplayLoopCount;
+  BOOL ReplayBigEndian;
+  BOOL ReplayNanoSeconds;
+  uint64_t SentPackets;
+  uint64_t SentBytes;
+  uint64_t ReceivedPackets;
+  uint64_t ReceivedBytes;
+  uint64_t ReceivedBatches;
+  uint64_t KernelDrops;
+  uint64_t InterfaceDrops;
+  unsigned int PcapLastDrops;
+  unsigned int PcapLastInterfaceDrops;
+  CAPTURE_BATCH_HANDLER Handler;
+  unsigned char *HandlerArg;
+  int DumpFormat;
+  unsigned char *DumpView;
+  uint64_t DumpViewOffset;
+  uint64_t DumpOffset;
+  uint64_t DumpFrameCount;
+#ifdef _WIN32
+  pcap_send_queue *SendQueue;
+  HANDLE DumpFile;
+  HANDLE DumpMapping;
+#endif
+#if defined(__linux__)
+  int DumpFd;
+  char InterfaceName[IFNAMSIZ];
+  uint64_t InterfaceDropsBase;
+  unsigned int InterfaceIndex;
+  BOOL Receiving;
+#endif
+#if defined(__linux__)
+  unsigned char *XdpUmem;
+  size_t XdpUmemSize;
+  XDP_RING XdpFill;
+  XDP_RING XdpCompletion;
+  XDP_RING XdpRx;
+  XDP_RING XdpTx;
+  unsigned char *XdpChunkState;
+  unsigned int XdpSpareChunks[CAPTURE_XDP_TX_FRAMES];
+  unsigned int XdpSpareCount;
+  uint64_t XdpBatchAddr[CAPTURE_MAX_BATCH];
+  unsigned int XdpTxQueued;
+  int XdpMapFd;
+  int XdpProgFd;
+  int XdpLinkFd;
+  BOOL XdpCopyMode;
+  unsigned int XdpQueueCount;
+  BOOL XdpFilterSet;
+  struct bpf_program XdpFilter;
+#endif
+  struct pcap_pkthdr HeaderStorage[CAPTURE_MAX_BATCH];
+  CAPTURE_BATCH Batch;
+  char ErrorBuffer[CAPTURE_ERRBUF_SIZE];
+};
+
+
+static PCAPTURE_HANDLE CaptureAllocHandle(int snapLenParam, int readTimeoutParam);
+static void CaptureCountBatch(unsigned char *param, PCAPTURE_BATCH batch);
+static BOOL PcapOpen(PCAPTURE_HANDLE captureHandle, char *interfaceNameParam, int flagsParam);
+static int PcapDispatchLoop(PCAPTURE_HANDLE captureHandle, CAPTURE_BATCH_HANDLER handlerParam, unsigned char *handlerArgParam);
+static int PcapSendBatch(PCAPTURE_HANDLE captureHandle, unsigned char **framesParam, unsigned int *lengthsParam, int frameCountParam);
+static BOOL ReplayLoadFile(PCAPTURE_HANDLE captureHandle, char *filePathParam);
+static unsigned int ReplayIndexRecords(PCAPTURE_HANDLE captureHandle);
+static unsigned int ReplayRead32(PCAPTURE_HANDLE captureHandle, unsigned char *dataParam);
+static int ReplayDispatchLoop(PCAPTURE_HANDLE captureHandle, CAPTURE_BATCH_HANDLER handlerParam, unsigned char *handlerArgParam);
+static void ReplayClose(PCAPTURE_HANDLE captureHandle);
+static BOOL DumpOpen(PCAPTURE_HANDLE captureHandle, char *filePathParam);
+static unsigned char *DumpReserve(PCAPTURE_HANDLE captureHandle, unsigned int lengthParam);
+static BOOL DumpMapWindow(PCAPTURE_HANDLE captureHandle, uint64_t offsetParam);
+static void DumpPut16(unsigned char *dataParam, uint16_t valueParam);
+static void DumpPut32(unsigned char *dataParam, uint32_t valueParam);
+static int DumpSendBatch(PCAPTURE_HANDLE captureHandle, unsigned char **framesParam, unsigned int *lengthsParam, int frameCountParam);
+static void DumpClose(PCAPTURE_HANDLE captureHandle);
+
+#if defined(__linux__)
+static BOOL TpacketOpen(PCAPTURE_HANDLE captureHandle, char *interfaceNameParam, int flagsParam);
+static BOOL TpacketSetFilter(PCAPTURE_HANDLE captureHandle, char *filterParam, unsigned int netMaskParam);
+static BOOL TpacketStartReceiving(PCAPTURE_HANDLE captureHandle);
+static void TpacketInsertVlanTag(struct tpacket3_hdr *frameHdrParam, struct pcap_pkthdr *pktHeaderParam, unsigned char **frameParam);
+static int TpacketDispatchLoop(PCAPTURE_HANDLE captureHandle, CAPTURE_BATCH_HANDLER handlerParam, unsigned char *handlerArgParam);
+static int TpacketSendBatch(PCAPTURE_HANDLE captureHandle, unsigned char **framesParam, unsigned int *lengthsParam, int frameCountParam);
+static void TpacketClose(PCAPTURE_HANDLE captureHandle);
+static void CaptureSetInterface(PCAPTURE_HANDLE captureHandle, char *interfaceNameParam);
+static uint64_t CaptureReadInterfaceCounter(PCAPTURE_HANDLE captureHandle, char *counterParam);
+static BOOL XdpOpen(PCAPTURE_HANDLE captureHandle, char *interfaceNameParam, unsigned char localMacBinParam[6], unsigned char localIpBinParam[4]);
+static BOOL XdpCheckInterface(PCAPTURE_HANDLE captureHandle, char *interfaceNameParam);
+static BOOL XdpMapRing(PCAPTURE_HANDLE captureHandle, PXDP_RING ringParam, struct xdp_ring_offset *offsetsParam, uint32_t sizeParam, size_t entrySizeParam, off_t pageOffsetParam);
+static BOOL XdpAttachProgram(PCAPTURE_HANDLE captureHandle, unsigned int ifcIndexParam, unsigned char localMacBinParam[6], unsigned char localIpBinParam[4]);
+static int XdpBpf(int commandParam, union bpf_attr *attrParam);
+static BOOL XdpSetFilter(PCAPTURE_HANDLE captureHandle, char *filterParam, unsigned int netMaskParam);
+static int XdpDispatchLoop(PCAPTURE_HANDLE captureHandle, CAPTURE_BATCH_HANDLER handlerParam, unsigned char *handlerArgParam);
+static BOOL XdpForwardFrame(PCAPTURE_HANDLE captureHandle, unsigned char *frameParam, unsigned int frameLengthParam);
+static int XdpSendBatch(PCAPTURE_HANDLE captureHandle, unsigned char **framesParam, unsigned int *lengthsParam, int frameCountParam);
+static BOOL XdpReserveTx(PCAPTURE_HANDLE captureHandle);
+static void XdpPutTx(PCAPTURE_HANDLE captureHandle, uint64_t addressParam, unsigned int lengthParam);
+static void XdpReapCompletions(PCAPTURE_HANDLE captureHandle);
+static void XdpRecycle(PCAPTURE_HANDLE captureHandle, uint64_t addressParam);
+static void XdpKick(PCAPTURE_HANDLE captureHandle);
+static void XdpClose(PCAPTURE_HANDLE captureHandle);
+#endif
+
+
+/*
+ * Open a live capture on the interface. On Linux the TPACKET_V3
+ * ring is tried first, everywhere else (or if the ring can't be
+ * set up) libpcap is used.
+ *
+ * CAPTURE_FLAG_SEND_ONLY opens a handle for CaptureSendPacket()
+ * only. On Linux that is a plain packet socket without a ring,
+ * with libpcap a filter that matches nothing is installed.
+ *
+ */
+PCAPTURE_HANDLE CaptureOpen(char *interfaceNameParam, int snapLenParam, int flagsParam, int readTimeoutParam, char *errorBufferParam)
+{
+  PCAPTURE_HANDLE captureHandle = NULL;
+
+  if ((captureHandle = CaptureAllocHandle(snapLenParam, readTimeoutParam)) == NULL)
+  {
+    if (errorBufferParam != NULL)
+    {
+      _snprintf(errorBufferParam, CAPTURE_ERRBUF_SIZE - 1, "CaptureOpen(): Unable to allocate capture handle");
+    }
+
+    goto END;
+  }
+
+#if defined(__linux__)
+  if ((flagsParam & CAPTURE_FLAG_PCAP_ONLY) == 0 &&
+      getenv("CAPTURE_PCAP_ONLY") == NULL &&
+      TpacketOpen(captureHandle, interfaceNameParam, flagsParam) == TRUE)
+  {
+    captureHandle->Backend = CAPTURE_BACKEND_TPACKETV3;
+    CaptureSetInterface(captureHandle, interfaceNameParam);
+    goto END;
+  }
+#endif
+
+  if (PcapOpen(captureHandle, interfaceNameParam, flagsParam) == FALSE)
+  {
+    if (errorBufferParam != NULL)
+    {
+      strncpy(errorBufferParam, captureHandle->ErrorBuffer, CAPTURE_ERRBUF_SIZE - 1);
+    }
+
+    HeapFree(GetProcessHeap(), 0, captureHandle);
+    captureHandle = NULL;
+    goto END;
+  }
+
+  captureHandle->Backend = CAPTURE_BACKEND_PCAP;
+
+  if ((flagsParam & CAPTURE_FLAG_SEND_ONLY) &&
+      CaptureSetFilter(captureHandle, CAPTURE_SEND_ONLY_FILTER, 0) == FALSE)
+  {
+    if (errorBufferParam != NULL)
+    {
+      strncpy(errorBufferParam, captureHandle->ErrorBuffer, CAPTURE_ERRBUF_SIZE - 1);
+    }
+
+    CaptureClose(captureHandle);
+    captureHandle = NULL;
+  }
+
+END:
+
+  return captureHandle;
+}
+
+
+PCAPTURE_HANDLE CaptureOpenOffline(char *filePathParam, char *errorBufferParam)
+{
+  PCAPTURE_HANDLE captureHandle = NULL;
+  char pcapErrorBuffer[PCAP_ERRBUF_SIZE];
+
+  ZeroMemory(pcapErrorBuffer, sizeof(pcapErrorBuffer));
+
+  if ((captureHandle = CaptureAllocHandle(65536, 0)) == NULL)
+  {
+    goto END;
+  }
+
+  if ((captureHandle->PcapHandle = pcap_open_offline(filePathParam, pcapErrorBuffer)) == NULL)
+  {
+    if (errorBufferParam != NULL)
+    {
+      strncpy(errorBufferParam, pcapErrorBuffer, CAPTURE_ERRBUF_SIZE - 1);
+    }
+
+    HeapFree(GetProcessHeap(), 0, captureHandle);
+    captureHandle = NULL;
+    goto END;
+  }
+
+  captureHandle->Backend = CAPTURE_BACKEND_PCAP;
+
+END:
+
+  return captureHandle;
+}
+
+
+/*
+ * Load a pcap file into memory and replay it loopCountParam
+ * times as fast as the handler can take it. Frames sent on
+ * this handle go to a null sink. Meant for benchmarks and
+ * doesn't need libpcap to read the file.
+ *
+ */
+PCAPTURE_HANDLE CaptureOpenReplay(char *filePathParam, int loopCountParam, char *errorBufferParam)
+{
+  PCAPTURE_HANDLE captureHandle = NULL;
+
+  if ((captureHandle = CaptureAllocHandle(65536, 0)) == NULL)
+  {
+    if (errorBufferParam != NULL)
+    {
+      _snprintf(errorBufferParam, CAPTURE_ERRBUF_SIZE - 1, "CaptureOpenReplay(): Unable to allocate capture handle");
+    }
+
+    goto END;
+  }
+
+  captureHandle->Backend = CAPTURE_BACKEND_REPLAY;
+  captureHandle->ReplayLoopCount = loopCountParam > 0 ? loopCountParam : 1;
+
+  if (filePathParam == NULL ||
+      ReplayLoadFile(captureHandle, filePathParam) == FALSE)
+  {
+    if (errorBufferParam != NULL)
+    {
+      strncpy(errorBufferParam, captureHandle->ErrorBuffer, CAPTURE_ERRBUF_SIZE - 1);
+    }
+
+    CaptureClose(captureHandle);
+    captureHandle = NULL;
+  }
+
+END:
+
+  return captureHandle;
+}
+
+
+/*
+ * A replay handle without frames. Only counts what is sent
+ * on it, used as a per-thread transmit handle in benchmarks.
+ *
+ */
+PCAPTURE_HANDLE CaptureOpenNullSink(char *errorBufferParam)
+{
+  PCAPTURE_HANDLE captureHandle = NULL;
+
+  if ((captureHandle = CaptureAllocHandle(65536, 0)) == NULL)
+  {
+    if (errorBufferParam != NULL)
+    {
+      _snprintf(errorBufferParam, CAPTURE_ERRBUF_SIZE - 1, "CaptureOpenNullSink(): Unable to allocate capture handle");
+    }
+
+    return NULL;
+  }
+
+  captureHandle->Backend = CAPTURE_BACKEND_REPLAY;
+
+  return captureHandle;
+}
+
+
+/*
+ * Write the frames sent on this handle to a pcap or pcapng
+ * file instead of an interface. Nothing is captured. The file
+ * is written through a mapped window, see DumpReserve(). The
+ * frames get their sequence number (in micro seconds) as
+ * timestamp, so the same frames always give the same file.
+ *
+ */
+PCAPTURE_HANDLE CaptureOpenDumpFile(char *filePathParam, int formatParam, char *errorBufferParam)
+{
+  PCAPTURE_HANDLE captureHandle = NULL;
+
+  if ((captureHandle = CaptureAllocHandle(CAPTURE_DUMP_SNAPLEN, 0)) == NULL)
+  {
+    if (errorBufferParam != NULL)
+    {
+      _snprintf(errorBufferParam, CAPTURE_ERRBUF_SIZE - 1, "CaptureOpenDumpFile(): Unable to allocate capture handle");
+    }
+
+    goto END;
+  }
+
+  captureHandle->Backend = CAPTURE_BACKEND_DUMP;
+  captureHandle->DumpFormat = formatParam == CAPTURE_DUMP_PCAPNG ? CAPTURE_DUMP_PCAPNG : CAPTURE_DUMP_PCAP;
+
+  if (filePathParam == NULL ||
+      DumpOpen(captureHandle, filePathParam) == FALSE)
+  {
+    if (errorBufferParam != NULL)
+    {
+      strncpy(errorBufferParam, captureHandle->ErrorBuffer, CAPTURE_ERRBUF_SIZE - 1);
+    }
+
+    CaptureClose(captureHandle);
+    captureHandle = NULL;
+  }
+
+END:
+
+  return captureHandle;
+}
+
+
+/*
+ * Open an AF_XDP socket on receive queue CAPTURE_XDP_QUEUE of
+ * the interface. Receive and transmit ring share one UMEM, so
+ * a received frame can be rewritten and sent with
+ * CaptureForwardFrame() without copying it.
+ *
+ * An XDP program hands the socket the IPv4 frames sent to
+ * localMacBinParam that are neither from nor to
+ * localIpBinParam and no DNS. Everything else, and all frames
+ * on other receive queues, goes to the network stack as usual.
+ * The program is detached when the handle is closed (or the
+ * process ends).
+ *
+ * The socket only sees receive queue CAPTURE_XDP_QUEUE and
+ * received frames must fit into a UMEM chunk. Returns NULL
+ * if the interface has an MTU above CAPTURE_XDP_FRAME_SIZE
+ * minus the XDP headroom and the Ethernet header. On an
+ * interface with more than one receive queue the handle
+ * comes from CaptureOpen() instead (promiscuous, without
+ * local frames) and errorBufferParam holds a warning for the
+ * caller to log. Reduce the queues with
+ * "ethtool -L <ifc> combined 1" to get AF_XDP.
+ *
+ * Only zero-copy mode is used. Returns NULL if the driver
+ * doesn't support it, the caller falls back to CaptureOpen().
+ * CAPTURE_AFXDP_COPY in the environment allows copy mode and
+ * generic XDP, e.g. for tests on veth pairs.
+ *
+ */
+PCAPTURE_HANDLE CaptureOpenXdp(char *interfaceNameParam, unsigned char localMacBinParam[6], unsigned char localIpBinParam[4], int snapLenParam, int readTimeoutParam, char *errorBufferParam)
+{
+  PCAPTURE_HANDLE captureHandle = NULL;
+  unsigned int queueCount = 0;
+
+  if ((captureHandle = CaptureAllocHandle(snapLenParam, readTimeoutParam)) == NULL)
+  {
+    if (errorBufferParam != NULL)
+    {
+      _snprintf(errorBufferParam, CAPTURE_ERRBUF_SIZE - 1, "CaptureOpenXdp(): Unable to allocate capture handle");
+    }
+
+    return NULL;
+  }
+
+#if defined(__linux__)
+  if (interfaceNameParam != NULL &&
+      localMacBinParam != NULL &&
+      localIpBinParam != NULL &&
+      XdpOpen(captureHandle, interfaceNameParam, localMacBinParam, localIpBinParam) == TRUE)
+  {
+    captureHandle->Backend = CAPTURE_BACKEND_AFXDP;
+    CaptureSetInterface(captureHandle, interfaceNameParam);
+    return captureHandle;
+  }
+
+  // Frames on the other queues would never reach the socket
+  if ((queueCount = captureHandle->XdpQueueCount) > 1)
+  {
+    HeapFree(GetProcessHeap(), 0, captureHandle);
+
+    if ((captureHandle = CaptureOpen(interfaceNameParam, snapLenParam, CAPTURE_FLAG_PROMISCUOUS | CAPTURE_FLAG_NOCAPTURE_LOCAL, readTimeoutParam, errorBufferParam)) != NULL &&
+        errorBufferParam != NULL)
+    {
+      _snprintf(errorBufferParam, CAPTURE_ERRBUF_SIZE - 1, "CaptureOpenXdp(): \"%s\" has %u receive queues, AF_XDP only uses queue %d. Capturing with %s instead (ethtool -L %s combined 1)",
+        interfaceNameParam, queueCount, CAPTURE_XDP_QUEUE, CaptureGetBackendName(captureHandle), interfaceNameParam);
+    }
+
+    return captureHandle;
+  }
+#else
+  _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "CaptureOpenXdp(): AF_XDP is only available on Linux");
+#endif
+
+  if (errorBufferParam != NULL)
+  {
+    strncpy(errorBufferParam, captureHandle->ErrorBuffer, CAPTURE_ERRBUF_SIZE - 1);
+  }
+
+  HeapFree(GetProcessHeap(), 0, captureHandle);
+
+  return NULL;
+}
+
+
+BOOL CaptureSetFilter(PCAPTURE_HANDLE captureHandle, char *filterParam, unsigned int netMaskParam)
+{
+  BOOL retVal = FALSE;
+  struct bpf_program filterCode;
+
+  if (captureHandle == NULL ||
+      filterParam == NULL)
+  {
+    goto END;
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_REPLAY)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "CaptureSetFilter(): Replay handles don't filter");
+    goto END;
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_DUMP)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "CaptureSetFilter(): Dump file handles don't filter");
+    goto END;
+  }
+
+#if defined(__linux__)
+  if (captureHandle->Backend == CAPTURE_BACKEND_TPACKETV3)
+  {
+    retVal = TpacketSetFilter(captureHandle, filterParam, netMaskParam);
+    goto END;
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_AFXDP)
+  {
+    retVal = XdpSetFilter(captureHandle, filterParam, netMaskParam);
+    goto END;
+  }
+#endif
+
+  ZeroMemory(&filterCode, sizeof(filterCode));
+  if (pcap_compile(captureHandle->PcapHandle, &filterCode, filterParam, 1, netMaskParam) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "%s", pcap_geterr(captureHandle->PcapHandle));
+    goto END;
+  }
+
+  if (pcap_setfilter(captureHandle->PcapHandle, &filterCode) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "%s", pcap_geterr(captureHandle->PcapHandle));
+    pcap_freecode(&filterCode);
+    goto END;
+  }
+
+  pcap_freecode(&filterCode);
+  retVal = TRUE;
+
+END:
+
+  return retVal;
+}
+
+
+/*
+ * Hand batches of frames to the handler until the capture
+ * is stopped. The return value has the same meaning as the
+ * last pcap_next_ex() return value.
+ *
+ */
+int CaptureDispatchLoop(PCAPTURE_HANDLE captureHandle, CAPTURE_BATCH_HANDLER handlerParam, unsigned char *handlerArgParam)
+{
+  if (captureHandle == NULL ||
+      handlerParam == NULL)
+  {
+    return CAPTURE_ERROR;
+  }
+
+  // The backends call CaptureCountBatch(), it counts and passes the batch on
+  captureHandle->Handler = handlerParam;
+  captureHandle->HandlerArg = handlerArgParam;
+  handlerParam = CaptureCountBatch;
+  handlerArgParam = (unsigned char *)captureHandle;
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_REPLAY)
+  {
+    return ReplayDispatchLoop(captureHandle, handlerParam, handlerArgParam);
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_DUMP)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "CaptureDispatchLoop(): Dump file handles don't capture");
+    return CAPTURE_ERROR;
+  }
+
+#if defined(__linux__)
+  if (captureHandle->Backend == CAPTURE_BACKEND_TPACKETV3)
+  {
+    return TpacketDispatchLoop(captureHandle, handlerParam, handlerArgParam);
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_AFXDP)
+  {
+    return XdpDispatchLoop(captureHandle, handlerParam, handlerArgParam);
+  }
+#endif
+
+  return PcapDispatchLoop(captureHandle, handlerParam, handlerArgParam);
+}
+
+
+int CaptureSendPacket(PCAPTURE_HANDLE captureHandle, unsigned char *dataParam, unsigned int dataLengthParam)
+{
+  int retVal = -1;
+
+  if (captureHandle == NULL ||
+      dataParam == NULL)
+  {
+    return -1;
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_REPLAY)
+  {
+    // Null sink, the frame is only counted.
+    retVal = 0;
+  }
+  else if (captureHandle->Backend == CAPTURE_BACKEND_DUMP)
+  {
+    retVal = DumpSendBatch(captureHandle, &dataParam, &dataLengthParam, 1) == 1 ? 0 : -1;
+  }
+#if defined(__linux__)
+  else if (captureHandle->Backend == CAPTURE_BACKEND_TPACKETV3)
+  {
+    if (send(captureHandle->Socket, dataParam, dataLengthParam, 0) != (ssize_t)dataLengthParam)
+    {
+      _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "send(): %s", strerror(errno));
+    }
+    else
+    {
+      retVal = 0;
+    }
+  }
+  else if (captureHandle->Backend == CAPTURE_BACKEND_AFXDP)
+  {
+    retVal = XdpSendBatch(captureHandle, &dataParam, &dataLengthParam, 1) == 1 ? 0 : -1;
+  }
+#endif
+  else
+  {
+    retVal = pcap_sendpacket(captureHandle->PcapHandle, dataParam, dataLengthParam);
+  }
+
+  if (retVal == 0)
+  {
+    captureHandle->SentPackets++;
+    captureHandle->SentBytes += dataLengthParam;
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Send frameCountParam frames with as few system calls as the
+ * backend allows: sendmmsg() on Linux packet sockets, a pcap
+ * send queue with WinPcap/Npcap. Other libpcap builds send the
+ * frames one by one. Frames go out in order and sending stops
+ * at the first frame that fails.
+ *
+ * Returns the number of frames sent, -1 for invalid arguments.
+ *
+ */
+int CaptureSendBatch(PCAPTURE_HANDLE captureHandle, unsigned char **framesParam, unsigned int *lengthsParam, int frameCountParam)
+{
+  int sentFrames = 0;
+  int counter = 0;
+
+  if (captureHandle == NULL ||
+      framesParam == NULL ||
+      lengthsParam == NULL ||
+      frameCountParam < 0)
+  {
+    return -1;
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_REPLAY)
+  {
+    // Null sink, the frames are only counted.
+    sentFrames = frameCountParam;
+  }
+  else if (captureHandle->Backend == CAPTURE_BACKEND_DUMP)
+  {
+    sentFrames = DumpSendBatch(captureHandle, framesParam, lengthsParam, frameCountParam);
+  }
+#if defined(__linux__)
+  else if (captureHandle->Backend == CAPTURE_BACKEND_TPACKETV3)
+  {
+    sentFrames = TpacketSendBatch(captureHandle, framesParam, lengthsParam, frameCountParam);
+  }
+  else if (captureHandle->Backend == CAPTURE_BACKEND_AFXDP)
+  {
+    sentFrames = XdpSendBatch(captureHandle, framesParam, lengthsParam, frameCountParam);
+  }
+#endif
+  else
+  {
+    sentFrames = PcapSendBatch(captureHandle, framesParam, lengthsParam, frameCountParam);
+  }
+
+  captureHandle->SentPackets += sentFrames;
+  for (counter = 0; counter < sentFrames; counter++)
+  {
+    captureHandle->SentBytes += lengthsParam[counter];
+  }
+
+  return sentFrames;
+}
+
+
+/*
+ * TRUE if frames handed out by this handle can be sent with
+ * CaptureForwardFrame(). Only the AF_XDP backend can.
+ *
+ */
+BOOL CaptureCanForwardInPlace(PCAPTURE_HANDLE captureHandle)
+{
+  return captureHandle != NULL && captureHandle->Backend == CAPTURE_BACKEND_AFXDP ? TRUE : FALSE;
+}
+
+
+/*
+ * Send a frame of the current batch from where it was
+ * received. Only valid inside the batch handler and at most
+ * once per frame. The frame may be rewritten before, but not
+ * after the call. The receive buffer is reused once the frame
+ * left. Returns 0 on success, -1 if the frame can't be sent
+ * (the caller drops it or sends a copy).
+ *
+ */
+int CaptureForwardFrame(PCAPTURE_HANDLE captureHandle, unsigned char *frameParam, unsigned int frameLengthParam)
+{
+  if (captureHandle == NULL ||
+      frameParam == NULL)
+  {
+    return -1;
+  }
+
+#if defined(__linux__)
+  if (captureHandle->Backend == CAPTURE_BACKEND_AFXDP)
+  {
+    if (XdpForwardFrame(captureHandle, frameParam, frameLengthParam) == FALSE)
+    {
+      return -1;
+    }
+
+    captureHandle->SentPackets++;
+    captureHandle->SentBytes += frameLengthParam;
+
+    return 0;
+  }
+#endif
+
+  _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "CaptureForwardFrame(): %s handles can't forward in place", CaptureGetBackendName(captureHandle));
+
+  return -1;
+}
+
+
+void CaptureBreakLoop(PCAPTURE_HANDLE captureHandle)
+{
+  if (captureHandle == NULL)
+  {
+    return;
+  }
+
+  captureHandle->BreakLoop = 1;
+
+  if (captureHandle->PcapHandle != NULL)
+  {
+    pcap_breakloop(captureHandle->PcapHandle);
+  }
+}
+
+
+void CaptureClose(PCAPTURE_HANDLE captureHandle)
+{
+  if (captureHandle == NULL)
+  {
+    return;
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_REPLAY)
+  {
+    ReplayClose(captureHandle);
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_DUMP)
+  {
+    DumpClose(captureHandle);
+  }
+
+#if defined(__linux__)
+  if (captureHandle->Backend == CAPTURE_BACKEND_TPACKETV3)
+  {
+    TpacketClose(captureHandle);
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_AFXDP)
+  {
+    XdpClose(captureHandle);
+  }
+#endif
+
+#ifdef _WIN32
+  if (captureHandle->SendQueue != NULL)
+  {
+    pcap_sendqueue_destroy(captureHandle->SendQueue);
+    captureHandle->SendQueue = NULL;
+  }
+#endif
+
+  if (captureHandle->PcapHandle != NULL)
+  {
+    pcap_close(captureHandle->PcapHandle);
+    captureHandle->PcapHandle = NULL;
+  }
+
+  HeapFree(GetProcessHeap(), 0, captureHandle);
+}
+
+
+char *CaptureGetError(PCAPTURE_HANDLE captureHandle)
+{
+  if (captureHandle == NULL)
+  {
+    return "";
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_PCAP &&
+      captureHandle->PcapHandle != NULL &&
+      captureHandle->ErrorBuffer[0] == 0)
+  {
+    return pcap_geterr(captureHandle->PcapHandle);
+  }
+
+  return captureHandle->ErrorBuffer;
+}
+
+
+char *CaptureGetBackendName(PCAPTURE_HANDLE captureHandle)
+{
+  if (captureHandle != NULL &&
+      captureHandle->Backend == CAPTURE_BACKEND_TPACKETV3)
+  {
+    return "TPACKET_V3";
+  }
+  else if (captureHandle != NULL &&
+           captureHandle->Backend == CAPTURE_BACKEND_REPLAY)
+  {
+    return "replay";
+  }
+  else if (captureHandle != NULL &&
+           captureHandle->Backend == CAPTURE_BACKEND_DUMP)
+  {
+    return captureHandle->DumpFormat == CAPTURE_DUMP_PCAPNG ? "pcapng file" : "pcap file";
+  }
+#if defined(__linux__)
+  else if (captureHandle != NULL &&
+           captureHandle->Backend == CAPTURE_BACKEND_AFXDP)
+  {
+    return captureHandle->XdpCopyMode == TRUE ? "AF_XDP (copy)" : "AF_XDP";
+  }
+#endif
+
+  return "pcap";
+}
+
+
+/*
+ * Frames and bytes CaptureSendPacket() and CaptureSendBatch()
+ * put on the wire (or into the null sink of a replay handle,
+ * or into a dump file).
+ *
+ */
+void CaptureGetSentCounters(PCAPTURE_HANDLE captureHandle, uint64_t *packetsParam, uint64_t *bytesParam)
+{
+  if (packetsParam != NULL)
+  {
+    *packetsParam = captureHandle != NULL ? captureHandle->SentPackets : 0;
+  }
+
+  if (bytesParam != NULL)
+  {
+    *bytesParam = captureHandle != NULL ? captureHandle->SentBytes : 0;
+  }
+}
+
+
+/*
+ * Receive, drop and send counters of the handle. The drop
+ * counters are read from the backend, which resets some of
+ * them on every read (TPACKET). Only one thread may call
+ * this per handle. The receive counters are written by the
+ * dispatching thread meanwhile, a report may lag behind by
+ * a batch.
+ *
+ */
+BOOL CaptureGetStats(PCAPTURE_HANDLE captureHandle, PCAPTURE_STATS statsParam)
+{
+  struct pcap_stat pcapStats;
+#if defined(__linux__)
+  struct tpacket_stats_v3 tpacketStats;
+  struct xdp_statistics xdpStats;
+  socklen_t optionLength = 0;
+#endif
+
+  if (statsParam == NULL)
+  {
+    return FALSE;
+  }
+
+  ZeroMemory(statsParam, sizeof(CAPTURE_STATS));
+
+  if (captureHandle == NULL)
+  {
+    return FALSE;
+  }
+
+  if (captureHandle->Backend == CAPTURE_BACKEND_PCAP &&
+      captureHandle->PcapHandle != NULL &&
+      pcap_stats(captureHandle->PcapHandle, &pcapStats) == 0)
+  {
+    // 32 bit counters, the differences survive a wrap
+    captureHandle->KernelDrops += (unsigned int)(pcapStats.ps_drop - captureHandle->PcapLastDrops);
+    captureHandle->InterfaceDrops += (unsigned int)(pcapStats.ps_ifdrop - captureHandle->PcapLastInterfaceDrops);
+    captureHandle->PcapLastDrops = pcapStats.ps_drop;
+    captureHandle->PcapLastInterfaceDrops = pcapStats.ps_ifdrop;
+  }
+#if defined(__linux__)
+  else if (captureHandle->Backend == CAPTURE_BACKEND_TPACKETV3)
+  {
+    optionLength = sizeof(tpacketStats);
+    ZeroMemory(&tpacketStats, sizeof(tpacketStats));
+
+    if (getsockopt(captureHandle->Socket, SOL_PACKET, PACKET_STATISTICS, &tpacketStats, &optionLength) == 0)
+    {
+      captureHandle->KernelDrops += tpacketStats.tp_drops;
+    }
+  }
+  else if (captureHandle->Backend == CAPTURE_BACKEND_AFXDP)
+  {
+    // Older kernels return the first three counters only
+    optionLength = sizeof(xdpStats);
+    ZeroMemory(&xdpStats, sizeof(xdpStats));
+
+    if (getsockopt(captureHandle->Socket, SOL_XDP, XDP_STATISTICS, &xdpStats, &optionLength) == 0)
+    {
+      captureHandle->KernelDrops = xdpStats.rx_dropped + xdpStats.rx_ring_full;
+    }
+  }
+
+  if (captureHandle->InterfaceName[0] != '\0')
+  {
+    captureHandle->InterfaceDrops = CaptureReadInterfaceCounter(captureHandle, "rx_missed_errors") - captureHandle->InterfaceDropsBase;
+  }
+#endif
+
+  statsParam->ReceivedPackets = captureHandle->ReceivedPackets;
+  statsParam->ReceivedBytes = captureHandle->ReceivedBytes;
+  statsParam->ReceivedBatches = captureHandle->ReceivedBatches;
+  statsParam->KernelDrops = captureHandle->KernelDrops;
+  statsParam->InterfaceDrops = captureHandle->InterfaceDrops;
+  statsParam->SentPackets = captureHandle->SentPackets;
+  statsParam->SentBytes = captureHandle->SentBytes;
+
+  return TRUE;
+}
+
+
+
+/*
+ * libpcap backend
+ *
+ */
+static PCAPTURE_HANDLE CaptureAllocHandle(int snapLenParam, int readTimeoutParam)
+{
+  PCAPTURE_HANDLE captureHandle = NULL;
+  int counter = 0;
+
+  if ((captureHandle = (PCAPTURE_HANDLE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(CAPTURE_HANDLE))) == NULL)
+  {
+    return NULL;
+  }
+
+  for (counter = 0; counter < CAPTURE_MAX_BATCH; counter++)
+  {
+    captureHandle->Batch.Headers[counter] = &captureHandle->HeaderStorage[counter];
+  }
+
+  captureHandle->SnapLen = snapLenParam;
+  captureHandle->ReadTimeout = readTimeoutParam;
+  captureHandle->Socket = -1;
+#if defined(__linux__)
+  captureHandle->XdpMapFd = -1;
+  captureHandle->XdpProgFd = -1;
+  captureHandle->XdpLinkFd = -1;
+  captureHandle->DumpFd = -1;
+#endif
+
+  return captureHandle;
+}
+
+
+/*
+ * Sits between the backend and the caller's batch handler
+ * and counts what was received.
+ *
+ */
+static void CaptureCountBatch(unsigned char *param, PCAPTURE_BATCH batch)
+{
+  PCAPTURE_HANDLE captureHandle = (PCAPTURE_HANDLE)param;
+  int counter = 0;
+
+  if (batch->FrameCount > 0)
+  {
+    for (counter = 0; counter < batch->FrameCount; counter++)
+    {
+      captureHandle->ReceivedBytes += batch->Headers[counter]->len;
+    }
+
+    captureHandle->ReceivedPackets += batch->FrameCount;
+    captureHandle->ReceivedBatches++;
+  }
+
+  captureHandle->Handler(captureHandle->HandlerArg, batch);
+}
+
+
+static BOOL PcapOpen(PCAPTURE_HANDLE captureHandle, char *interfaceNameParam, int flagsParam)
+{
+  char pcapErrorBuffer[PCAP_ERRBUF_SIZE];
+
+  ZeroMemory(pcapErrorBuffer, sizeof(pcapErrorBuffer));
+
+#ifdef _WIN32
+  {
+    int pcapFlags = PCAP_OPENFLAG_MAX_RESPONSIVENESS;
+
+    if (flagsParam & CAPTURE_FLAG_PROMISCUOUS)
+    {
+      pcapFlags |= PCAP_OPENFLAG_PROMISCUOUS;
+    }
+
+    if (flagsParam & CAPTURE_FLAG_NOCAPTURE_LOCAL)
+    {
+      pcapFlags |= PCAP_OPENFLAG_NOCAPTURE_LOCAL;
+    }
+
+    captureHandle->PcapHandle = pcap_open(interfaceNameParam, captureHandle->SnapLen, pcapFlags, captureHandle->ReadTimeout, NULL, pcapErrorBuffer);
+  }
+#else
+  captureHandle->PcapHandle = pcap_open_live(interfaceNameParam, captureHandle->SnapLen, (flagsParam & CAPTURE_FLAG_PROMISCUOUS) ? 1 : 0, captureHandle->ReadTimeout, pcapErrorBuffer);
+#endif
+
+  if (captureHandle->PcapHandle == NULL)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "%s", pcapErrorBuffer);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static int PcapDispatchLoop(PCAPTURE_HANDLE captureHandle, CAPTURE_BATCH_HANDLER handlerParam, unsigned char *handlerArgParam)
+{
+  int funcRetVal = 0;
+  struct pcap_pkthdr *packetHeader = NULL;
+  const unsigned char *packetData = NULL;
+
+  // libpcap reuses its buffer on every read, so frames can't be
+  // collected across calls. Hand them out one by one.
+  while ((funcRetVal = pcap_next_ex(captureHandle->PcapHandle, &packetHeader, &packetData)) >= 0)
+  {
+    if (funcRetVal == 1)
+    {
+      CopyMemory(captureHandle->Batch.Headers[0], packetHeader, sizeof(struct pcap_pkthdr));
+      captureHandle->Batch.Frames[0] = (unsigned char *)packetData;
+      captureHandle->Batch.FrameCount = 1;
+
+      handlerParam(handlerArgParam, &captureHandle->Batch);
+    }
+    else
+    {
+      // Read timeout, nothing is waiting.
+      captureHandle->Batch.FrameCount = 0;
+      handlerParam(handlerArgParam, &captureHandle->Batch);
+    }
+
+    if (captureHandle->BreakLoop != 0)
+    {
+      funcRetVal = CAPTURE_EOF;
+      break;
+    }
+  }
+
+  return funcRetVal;
+}
+
+
+static int PcapSendBatch(PCAPTURE_HANDLE captureHandle, unsigned char **framesParam, unsigned int *lengthsParam, int frameCountParam)
+{
+  int sentFrames = 0;
+
+#ifdef _WIN32
+  struct pcap_pkthdr pktHeader;
+  unsigned int queueSize = 0;
+  unsigned int sentBytes = 0;
+  unsigned int frameBytes = 0;
+  int counter = 0;
+
+  // pcap_sendqueue_transmit() hands the whole queue to the
+  // driver at once. The queue is kept and only grows.
+  for (counter = 0; counter < frameCountParam; counter++)
+  {
+    queueSize += sizeof(struct pcap_pkthdr) + lengthsParam[counter];
+  }
+
+  if (captureHandle->SendQueue != NULL &&
+      captureHandle->SendQueue->maxlen < queueSize)
+  {
+    pcap_sendqueue_destroy(captureHandle->SendQueue);
+    captureHandle->SendQueue = NULL;
+  }
+
+  if (captureHandle->SendQueue == NULL &&
+      (captureHandle->SendQueue = pcap_sendqueue_alloc(queueSize)) == NULL)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "PcapSendBatch(): Unable to allocate the send queue");
+    return 0;
+  }
+
+  captureHandle->SendQueue->len = 0;
+  ZeroMemory(&pktHeader, sizeof(pktHeader));
+
+  for (counter = 0; counter < frameCountParam; counter++)
+  {
+    pktHeader.caplen = lengthsParam[counter];
+    pktHeader.len = lengthsParam[counter];
+    pcap_sendqueue_queue(captureHandle->SendQueue, &pktHeader, framesParam[counter]);
+  }
+
+  // The return value counts queue bytes (record headers
+  // included). Every record covered completely was sent.
+  if ((sentBytes = pcap_sendqueue_transmit(captureHandle->PcapHandle, captureHandle->SendQueue, 0)) < captureHandle->SendQueue->len)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "%s", pcap_geterr(captureHandle->PcapHandle));
+  }
+
+  for (sentFrames = 0; sentFrames < frameCountParam; sentFrames++)
+  {
+    frameBytes += sizeof(struct pcap_pkthdr) + lengthsParam[sentFrames];
+
+    if (frameBytes > sentBytes)
+    {
+      break;
+    }
+  }
+#else
+  for (sentFrames = 0; sentFrames < frameCountParam; sentFrames++)
+  {
+    if (pcap_sendpacket(captureHandle->PcapHandle, framesParam[sentFrames], lengthsParam[sentFrames]) != 0)
+    {
+      break;
+    }
+  }
+#endif
+
+  return sentFrames;
+}
+
+
+
+/*
+ * In-memory replay backend. The pcap file is read and indexed
+ * once, afterwards batches of up to CAPTURE_MAX_BATCH frames are
+ * handed out straight from that buffer. The frames are writable,
+ * so handlers rewriting MAC addresses in place work as usual.
+ * Classic pcap files in either byte order with micro or nano
+ * second timestamps are supported, pcapng is not.
+ *
+ */
+static BOOL ReplayLoadFile(PCAPTURE_HANDLE captureHandle, char *filePathParam)
+{
+  BOOL retVal = FALSE;
+  FILE *fileHandle = NULL;
+  long fileSize = 0;
+  unsigned int magic = 0;
+
+  if ((fileHandle = fopen(filePathParam, "rb")) == NULL)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "ReplayLoadFile(): Unable to open \"%s\"", filePathParam);
+    goto END;
+  }
+
+  if (fseek(fileHandle, 0, SEEK_END) != 0 ||
+      (fileSize = ftell(fileHandle)) < 24 ||
+      fileSize > CAPTURE_REPLAY_MAX_FILE_SIZE ||
+      fseek(fileHandle, 0, SEEK_SET) != 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "ReplayLoadFile(): \"%s\" has an unsupported size", filePathParam);
+    goto END;
+  }
+
+  captureHandle->ReplayDataSize = (unsigned int)fileSize;
+  if ((captureHandle->ReplayData = (unsigned char *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, captureHandle->ReplayDataSize)) == NULL ||
+      fread(captureHandle->ReplayData, 1, captureHandle->ReplayDataSize, fileHandle) != captureHandle->ReplayDataSize)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "ReplayLoadFile(): Unable to read \"%s\"", filePathParam);
+    goto END;
+  }
+
+  // The magic number tells byte order and timestamp resolution
+  magic = ((unsigned int)captureHandle->ReplayData[0] << 24) | ((unsigned int)captureHandle->ReplayData[1] << 16) |
+          ((unsigned int)captureHandle->ReplayData[2] << 8) | captureHandle->ReplayData[3];
+
+  if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d)
+  {
+    captureHandle->ReplayBigEndian = TRUE;
+    captureHandle->ReplayNanoSeconds = magic == 0xa1b23c4d;
+  }
+  else if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1)
+  {
+    captureHandle->ReplayBigEndian = FALSE;
+    captureHandle->ReplayNanoSeconds = magic == 0x4d3cb2a1;
+  }
+  else
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "ReplayLoadFile(): \"%s\" is not a pcap file", filePathParam);
+    goto END;
+  }
+
+  if ((ReplayRead32(captureHandle, captureHandle->ReplayData + 20) & 0xffff) != DLT_EN10MB)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "ReplayLoadFile(): \"%s\" doesn't hold Ethernet frames", filePathParam);
+    goto END;
+  }
+
+  // Count the records, then index them.
+  if ((captureHandle->ReplayFrameCount = ReplayIndexRecords(captureHandle)) == 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "ReplayLoadFile(): \"%s\" holds no frames", filePathParam);
+    goto END;
+  }
+
+  if ((captureHandle->ReplayHeaders = (struct pcap_pkthdr *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, captureHandle->ReplayFrameCount * sizeof(struct pcap_pkthdr))) == NULL ||
+      (captureHandle->ReplayFrames = (unsigned char **)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, captureHandle->ReplayFrameCount * sizeof(unsigned char *))) == NULL)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "ReplayLoadFile(): Unable to allocate the frame index");
+    goto END;
+  }
+
+  ReplayIndexRecords(captureHandle);
+  retVal = TRUE;
+
+END:
+
+  if (fileHandle != NULL)
+  {
+    fclose(fileHandle);
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Walk the records in the file buffer. Fills in the index if
+ * it's allocated already. A truncated last record is dropped.
+ *
+ */
+static unsigned int ReplayIndexRecords(PCAPTURE_HANDLE captureHandle)
+{
+  unsigned int frameCount = 0;
+  unsigned int offset = 24;
+  unsigned int capLength = 0;
+  unsigned char *recordHeader = NULL;
+  struct pcap_pkthdr *pktHeader = NULL;
+
+  while (captureHandle->ReplayDataSize - offset >= 16)
+  {
+    recordHeader = captureHandle->ReplayData + offset;
+    capLength = ReplayRead32(captureHandle, recordHeader + 8);
+
+    if (capLength > captureHandle->ReplayDataSize - offset - 16)
+    {
+      break;
+    }
+
+    if (captureHandle->ReplayHeaders != NULL)
+    {
+      pktHeader = &captureHandle->ReplayHeaders[frameCount];
+      pktHeader->ts.tv_sec = ReplayRead32(captureHandle, recordHeader);
+      pktHeader->ts.tv_usec = ReplayRead32(captureHandle, recordHeader + 4);
+      pktHeader->caplen = capLength < (unsigned int)captureHandle->SnapLen ? capLength : (unsigned int)captureHandle->SnapLen;
+      pktHeader->len = ReplayRead32(captureHandle, recordHeader + 12);
+
+      if (captureHandle->ReplayNanoSeconds == TRUE)
+      {
+        pktHeader->ts.tv_usec /= 1000;
+      }
+
+      captureHandle->ReplayFrames[frameCount] = recordHeader + 16;
+    }
+
+    frameCount++;
+    offset += 16 + capLength;
+  }
+
+  return frameCount;
+}
+
+
+static unsigned int ReplayRead32(PCAPTURE_HANDLE captureHandle, unsigned char *dataParam)
+{
+  if (captureHandle->ReplayBigEndian == TRUE)
+  {
+    return ((unsigned int)dataParam[0] << 24) | ((unsigned int)dataParam[1] << 16) | ((unsigned int)dataParam[2] << 8) | dataParam[3];
+  }
+
+  return ((unsigned int)dataParam[3] << 24) | ((unsigned int)dataParam[2] << 16) | ((unsigned int)dataParam[1] << 8) | dataParam[0];
+}
+
+
+static int ReplayDispatchLoop(PCAPTURE_HANDLE captureHandle, CAPTURE_BATCH_HANDLER handlerParam, unsigned char *handlerArgParam)
+{
+  PCAPTURE_BATCH batch = &captureHandle->Batch;
+  unsigned int frameIndex = 0;
+  int loopCounter = 0;
+
+  for (loopCounter = 0; loopCounter < captureHandle->ReplayLoopCount && captureHandle->BreakLoop == 0; loopCounter++)
+  {
+    frameIndex = 0;
+
+    while (frameIndex < captureHandle->ReplayFrameCount &&
+           captureHandle->BreakLoop == 0)
+    {
+      batch->FrameCount = 0;
+
+      while (frameIndex < captureHandle->ReplayFrameCount &&
+             batch->FrameCount < CAPTURE_MAX_BATCH)
+      {
+        batch->Headers[batch->FrameCount] = &captureHandle->ReplayHeaders[frameIndex];
+        batch->Frames[batch->FrameCount] = captureHandle->ReplayFrames[frameIndex];
+        batch->FrameCount++;
+        frameIndex++;
+      }
+
+      handlerParam(handlerArgParam, batch);
+    }
+  }
+
+  // Nothing more to come. Let the handler flush.
+  batch->FrameCount = 0;
+  handlerParam(handlerArgParam, batch);
+
+  // Like pcap_breakloop() a break request only ends
+  // the current loop. The handle can be replayed again.
+  captureHandle->BreakLoop = 0;
+
+  return CAPTURE_EOF;
+}
+
+
+static void ReplayClose(PCAPTURE_HANDLE captureHandle)
+{
+  if (captureHandle->ReplayFrames != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, captureHandle->ReplayFrames);
+    captureHandle->ReplayFrames = NULL;
+  }
+
+  if (captureHandle->ReplayHeaders != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, captureHandle->ReplayHeaders);
+    captureHandle->ReplayHeaders = NULL;
+  }
+
+  if (captureHandle->ReplayData != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, captureHandle->ReplayData);
+    captureHandle->ReplayData = NULL;
+  }
+}
+
+
+
+/*
+ * Dump file backend. Frames sent on the handle are appended
+ * to a pcap or pcapng file. Instead of a write() per frame the
+ * records are copied into a mapped window of the file. If a
+ * record doesn't fit anymore, the file is grown and the window
+ * moves on. When the handle is closed the file is cut to the
+ * data actually written.
+ *
+ */
+static BOOL DumpOpen(PCAPTURE_HANDLE captureHandle, char *filePathParam)
+{
+  unsigned char *header = NULL;
+
+#ifdef _WIN32
+  HANDLE fileHandle = CreateFileA(filePathParam, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+  if (fileHandle == INVALID_HANDLE_VALUE)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "DumpOpen(): Unable to create \"%s\" (error %lu)", filePathParam, GetLastError());
+    return FALSE;
+  }
+
+  captureHandle->DumpFile = fileHandle;
+#elif defined(__linux__)
+  if ((captureHandle->DumpFd = open(filePathParam, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "DumpOpen(): Unable to create \"%s\": %s", filePathParam, strerror(errno));
+    return FALSE;
+  }
+#else
+  _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "DumpOpen(): Dump files are not supported on this platform");
+  return FALSE;
+#endif
+
+  // All fields in host byte order, the magic numbers tell readers which one.
+  if (captureHandle->DumpFormat == CAPTURE_DUMP_PCAPNG)
+  {
+    if ((header = DumpReserve(captureHandle, 48)) == NULL)
+    {
+      return FALSE;
+    }
+
+    // Section header block, section length unknown
+    DumpPut32(header, PCAPNG_SECTION_HEADER);
+    DumpPut32(header + 4, 28);
+    DumpPut32(header + 8, 0x1a2b3c4d);
+    DumpPut16(header + 12, 1);
+    DumpPut16(header + 14, 0);
+    DumpPut32(header + 16, 0xffffffff);
+    DumpPut32(header + 20, 0xffffffff);
+    DumpPut32(header + 24, 28);
+
+    // Interface description block, micro second timestamps
+    DumpPut32(header + 28, PCAPNG_INTERFACE);
+    DumpPut32(header + 32, 20);
+    DumpPut16(header + 36, DLT_EN10MB);
+    DumpPut16(header + 38, 0);
+    DumpPut32(header + 40, CAPTURE_DUMP_SNAPLEN);
+    DumpPut32(header + 44, 20);
+
+    captureHandle->DumpOffset += 48;
+  }
+  else
+  {
+    if ((header = DumpReserve(captureHandle, 24)) == NULL)
+    {
+      return FALSE;
+    }
+
+    DumpPut32(header, 0xa1b2c3d4);
+    DumpPut16(header + 4, 2);
+    DumpPut16(header + 6, 4);
+    DumpPut32(header + 8, 0);
+    DumpPut32(header + 12, 0);
+    DumpPut32(header + 16, CAPTURE_DUMP_SNAPLEN);
+    DumpPut32(header + 20, DLT_EN10MB);
+
+    captureHandle->DumpOffset += 24;
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * Make lengthParam bytes at the end of the written data
+ * available in the mapped window. Returns where to put them
+ * or NULL if the file can't be grown. The caller advances
+ * DumpOffset.
+ *
+ */
+static unsigned char *DumpReserve(PCAPTURE_HANDLE captureHandle, unsigned int lengthParam)
+{
+  if (captureHandle->DumpView == NULL ||
+      captureHandle->DumpOffset + lengthParam > captureHandle->DumpViewOffset + CAPTURE_DUMP_WINDOW_SIZE)
+  {
+    if (DumpMapWindow(captureHandle, captureHandle->DumpOffset & ~((uint64_t)DUMP_WINDOW_ALIGNMENT - 1)) == FALSE)
+    {
+      return NULL;
+    }
+  }
+
+  return captureHandle->DumpView + (captureHandle->DumpOffset - captureHandle->DumpViewOffset);
+}
+
+
+/*
+ * Map CAPTURE_DUMP_WINDOW_SIZE bytes of the file starting
+ * at offsetParam. The file is grown to cover the window
+ * first, the new part reads as zeros.
+ *
+ */
+static BOOL DumpMapWindow(PCAPTURE_HANDLE captureHandle, uint64_t offsetParam)
+{
+  uint64_t fileSize = offsetParam + CAPTURE_DUMP_WINDOW_SIZE;
+
+#ifdef _WIN32
+  if (captureHandle->DumpView != NULL)
+  {
+    UnmapViewOfFile(captureHandle->DumpView);
+    captureHandle->DumpView = NULL;
+  }
+
+  if (captureHandle->DumpMapping != NULL)
+  {
+    CloseHandle(captureHandle->DumpMapping);
+    captureHandle->DumpMapping = NULL;
+  }
+
+  if ((captureHandle->DumpMapping = CreateFileMappingA(captureHandle->DumpFile, NULL, PAGE_READWRITE, (DWORD)(fileSize >> 32), (DWORD)fileSize, NULL)) == NULL ||
+      (captureHandle->DumpView = (unsigned char *)MapViewOfFile(captureHandle->DumpMapping, FILE_MAP_WRITE, (DWORD)(offsetParam >> 32), (DWORD)offsetParam, CAPTURE_DUMP_WINDOW_SIZE)) == NULL)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "DumpMapWindow(): Unable to map the dump file (error %lu)", GetLastError());
+    return FALSE;
+  }
+#elif defined(__linux__)
+  void *view = NULL;
+
+  if (captureHandle->DumpView != NULL)
+  {
+    munmap(captureHandle->DumpView, CAPTURE_DUMP_WINDOW_SIZE);
+    captureHandle->DumpView = NULL;
+  }
+
+  if (ftruncate(captureHandle->DumpFd, (off_t)fileSize) != 0 ||
+      (view = mmap(NULL, CAPTURE_DUMP_WINDOW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, captureHandle->DumpFd, (off_t)offsetParam)) == MAP_FAILED)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "DumpMapWindow(): Unable to map the dump file: %s", strerror(errno));
+    return FALSE;
+  }
+
+  captureHandle->DumpView = (unsigned char *)view;
+#else
+  return FALSE;
+#endif
+
+  captureHandle->DumpViewOffset = offsetParam;
+
+  return TRUE;
+}
+
+
+static void DumpPut16(unsigned char *dataParam, uint16_t valueParam)
+{
+  CopyMemory(dataParam, &valueParam, sizeof(valueParam));
+}
+
+
+static void DumpPut32(unsigned char *dataParam, uint32_t valueParam)
+{
+  CopyMemory(dataParam, &valueParam, sizeof(valueParam));
+}
+
+
+static int DumpSendBatch(PCAPTURE_HANDLE captureHandle, unsigned char **framesParam, unsigned int *lengthsParam, int frameCountParam)
+{
+  unsigned char *record = NULL;
+  unsigned int recordLength = 0;
+  unsigned int frameLength = 0;
+  uint64_t timeStamp = 0;
+  int counter = 0;
+
+  for (counter = 0; counter < frameCountParam; counter++)
+  {
+    frameLength = lengthsParam[counter];
+    timeStamp = captureHandle->DumpFrameCount;
+
+    if (frameLength > CAPTURE_DUMP_SNAPLEN)
+    {
+      _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "DumpSendBatch(): Frame of %u bytes is larger than the snap length", frameLength);
+      break;
+    }
+
+    if (captureHandle->DumpFormat == CAPTURE_DUMP_PCAPNG)
+    {
+      // Enhanced packet block, data padded to 32 bits
+      recordLength = 32 + ((frameLength + 3) & ~3u);
+
+      if ((record = DumpReserve(captureHandle, recordLength)) == NULL)
+      {
+        break;
+      }
+
+      DumpPut32(record, PCAPNG_ENHANCED_PACKET);
+      DumpPut32(record + 4, recordLength);
+      DumpPut32(record + 8, 0);
+      DumpPut32(record + 12, (uint32_t)(timeStamp >> 32));
+      DumpPut32(record + 16, (uint32_t)timeStamp);
+      DumpPut32(record + 20, frameLength);
+      DumpPut32(record + 24, frameLength);
+      CopyMemory(record + 28, framesParam[counter], frameLength);
+      ZeroMemory(record + 28 + frameLength, recordLength - 32 - frameLength);
+      DumpPut32(record + recordLength - 4, recordLength);
+    }
+    else
+    {
+      recordLength = 16 + frameLength;
+
+      if ((record = DumpReserve(captureHandle, recordLength)) == NULL)
+      {
+        break;
+      }
+
+      DumpPut32(record, (uint32_t)(timeStamp / 1000000));
+      DumpPut32(record + 4, (uint32_t)(timeStamp % 1000000));
+      DumpPut32(record + 8, frameLength);
+      DumpPut32(record + 12, frameLength);
+      CopyMemory(record + 16, framesParam[counter], frameLength);
+    }
+
+    captureHandle->DumpOffset += recordLength;
+    captureHandle->DumpFrameCount++;
+  }
+
+  return counter;
+}
+
+
+static void DumpClose(PCAPTURE_HANDLE captureHandle)
+{
+#ifdef _WIN32
+  LARGE_INTEGER fileSize;
+
+  if (captureHandle->DumpView != NULL)
+  {
+    UnmapViewOfFile(captureHandle->DumpView);
+    captureHandle->DumpView = NULL;
+  }
+
+  if (captureHandle->DumpMapping != NULL)
+  {
+    CloseHandle(captureHandle->DumpMapping);
+    captureHandle->DumpMapping = NULL;
+  }
+
+  if (captureHandle->DumpFile != NULL)
+  {
+    fileSize.QuadPart = (LONGLONG)captureHandle->DumpOffset;
+    SetFilePointerEx(captureHandle->DumpFile, fileSize, NULL, FILE_BEGIN);
+    SetEndOfFile(captureHandle->DumpFile);
+    CloseHandle(captureHandle->DumpFile);
+    captureHandle->DumpFile = NULL;
+  }
+#elif defined(__linux__)
+  if (captureHandle->DumpView != NULL)
+  {
+    munmap(captureHandle->DumpView, CAPTURE_DUMP_WINDOW_SIZE);
+    captureHandle->DumpView = NULL;
+  }
+
+  if (captureHandle->DumpFd >= 0)
+  {
+    if (ftruncate(captureHandle->DumpFd, (off_t)captureHandle->DumpOffset) != 0)
+    {
+      _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "DumpClose(): Unable to truncate the dump file: %s", strerror(errno));
+    }
+
+    close(captureHandle->DumpFd);
+    captureHandle->DumpFd = -1;
+  }
+#endif
+}
+
+
+
+#if defined(__linux__)
+/*
+ * Linux TPACKET_V3 backend. The kernel fills variable sized
+ * frames into a ring of memory mapped blocks. A block is handed
+ * to user space as a whole and all its frames are passed to the
+ * handler without copying them. The block goes back to the
+ * kernel once the handler returned.
+ *
+ * The socket is opened for protocol 0 and receives nothing until
+ * the dispatch loop starts, see TpacketStartReceiving(). A filter
+ * set in between applies to every frame in the ring.
+ *
+ */
+static BOOL TpacketOpen(PCAPTURE_HANDLE captureHandle, char *interfaceNameParam, int flagsParam)
+{
+  BOOL retVal = FALSE;
+  int version = TPACKET_V3;
+  int reserve = TPACKET_VLAN_TAG_LEN;
+  unsigned int ifcIndex = 0;
+  unsigned int blockCount = CAPTURE_RING_BLOCK_COUNT;
+  char *ringSize = NULL;
+  struct tpacket_req3 ringRequest;
+  struct sockaddr_ll ifcAddress;
+  struct packet_mreq membership;
+
+  // Names from pcap_findalldevs_ex() carry the source prefix.
+  if (strncmp(interfaceNameParam, "rpcap://", 8) == 0)
+  {
+    interfaceNameParam += 8;
+  }
+
+  if ((ifcIndex = if_nametoindex(interfaceNameParam)) == 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketOpen(): Unknown interface \"%s\"", interfaceNameParam);
+    goto END;
+  }
+
+  captureHandle->InterfaceIndex = ifcIndex;
+
+  // Protocol 0 sockets don't receive anything. A send only
+  // handle stays that way, there is no need for a ring.
+  if ((captureHandle->Socket = socket(AF_PACKET, SOCK_RAW, 0)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketOpen(): socket(): %s", strerror(errno));
+    goto END;
+  }
+
+  ZeroMemory(&ifcAddress, sizeof(ifcAddress));
+  ifcAddress.sll_family = AF_PACKET;
+  ifcAddress.sll_protocol = 0;
+  ifcAddress.sll_ifindex = ifcIndex;
+
+  if (bind(captureHandle->Socket, (struct sockaddr *)&ifcAddress, sizeof(ifcAddress)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketOpen(): bind(): %s", strerror(errno));
+    goto END;
+  }
+
+  if (flagsParam & CAPTURE_FLAG_SEND_ONLY)
+  {
+    retVal = TRUE;
+    goto END;
+  }
+
+  if (setsockopt(captureHandle->Socket, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketOpen(): PACKET_VERSION: %s", strerror(errno));
+    goto END;
+  }
+
+  // Room in front of each frame to put the VLAN tag back
+  if (setsockopt(captureHandle->Socket, SOL_PACKET, PACKET_RESERVE, &reserve, sizeof(reserve)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketOpen(): PACKET_RESERVE: %s", strerror(errno));
+    goto END;
+  }
+
+  if ((ringSize = getenv("CAPTURE_RING_MB")) != NULL &&
+      atoi(ringSize) > 0)
+  {
+    blockCount = (unsigned int)atoi(ringSize) * (1024 * 1024 / CAPTURE_RING_BLOCK_SIZE);
+    blockCount = blockCount < CAPTURE_RING_MAX_BLOCKS ? blockCount : CAPTURE_RING_MAX_BLOCKS;
+  }
+
+  ZeroMemory(&ringRequest, sizeof(ringRequest));
+  ringRequest.tp_block_size = CAPTURE_RING_BLOCK_SIZE;
+  ringRequest.tp_block_nr = blockCount;
+  ringRequest.tp_frame_size = CAPTURE_RING_FRAME_SIZE;
+  ringRequest.tp_frame_nr = (CAPTURE_RING_BLOCK_SIZE / CAPTURE_RING_FRAME_SIZE) * blockCount;
+
+  // Retire partially filled blocks after the read timeout so
+  // low traffic isn't delayed for the whole block.
+  ringRequest.tp_retire_blk_tov = captureHandle->ReadTimeout > 0 ? captureHandle->ReadTimeout : 1;
+
+  if (setsockopt(captureHandle->Socket, SOL_PACKET, PACKET_RX_RING, &ringRequest, sizeof(ringRequest)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketOpen(): PACKET_RX_RING: %s", strerror(errno));
+    goto END;
+  }
+
+  captureHandle->BlockSize = ringRequest.tp_block_size;
+  captureHandle->BlockCount = ringRequest.tp_block_nr;
+  captureHandle->RingSize = ringRequest.tp_block_size * ringRequest.tp_block_nr;
+
+  if ((captureHandle->Ring = mmap(NULL, captureHandle->RingSize, PROT_READ | PROT_WRITE, MAP_SHARED, captureHandle->Socket, 0)) == MAP_FAILED)
+  {
+    captureHandle->Ring = NULL;
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketOpen(): mmap(): %s", strerror(errno));
+    goto END;
+  }
+
+#ifdef PACKET_IGNORE_OUTGOING
+  if (flagsParam & CAPTURE_FLAG_NOCAPTURE_LOCAL)
+  {
+    int ignoreOutgoing = 1;
+    setsockopt(captureHandle->Socket, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignoreOutgoing, sizeof(ignoreOutgoing));
+  }
+#endif
+
+  if (flagsParam & CAPTURE_FLAG_PROMISCUOUS)
+  {
+    ZeroMemory(&membership, sizeof(membership));
+    membership.mr_ifindex = ifcIndex;
+    membership.mr_type = PACKET_MR_PROMISC;
+    setsockopt(captureHandle->Socket, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &membership, sizeof(membership));
+  }
+
+  retVal = TRUE;
+
+END:
+
+  if (retVal == FALSE)
+  {
+    TpacketClose(captureHandle);
+  }
+
+  return retVal;
+}
+
+
+static BOOL TpacketSetFilter(PCAPTURE_HANDLE captureHandle, char *filterParam, unsigned int netMaskParam)
+{
+  BOOL retVal = FALSE;
+  pcap_t *deadHandle = NULL;
+  struct bpf_program filterCode;
+  struct sock_fprog socketFilter;
+
+  ZeroMemory(&filterCode, sizeof(filterCode));
+
+  // Compile with libpcap and attach the classic BPF program
+  // to the socket directly.
+  if ((deadHandle = pcap_open_dead(DLT_EN10MB, captureHandle->SnapLen)) == NULL)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketSetFilter(): pcap_open_dead() failed");
+    goto END;
+  }
+
+  if (pcap_compile(deadHandle, &filterCode, filterParam, 1, netMaskParam) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "%s", pcap_geterr(deadHandle));
+    goto END;
+  }
+
+  socketFilter.len = (unsigned short)filterCode.bf_len;
+  socketFilter.filter = (struct sock_filter *)filterCode.bf_insns;
+
+  if (setsockopt(captureHandle->Socket, SOL_SOCKET, SO_ATTACH_FILTER, &socketFilter, sizeof(socketFilter)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketSetFilter(): SO_ATTACH_FILTER: %s", strerror(errno));
+    goto END;
+  }
+
+  retVal = TRUE;
+
+END:
+
+  if (filterCode.bf_insns != NULL)
+  {
+    pcap_freecode(&filterCode);
+  }
+
+  if (deadHandle != NULL)
+  {
+    pcap_close(deadHandle);
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Rebind the socket from protocol 0 to all protocols. Only from
+ * here on frames are queued on the ring, each of them went
+ * through the filter attached before.
+ *
+ */
+static BOOL TpacketStartReceiving(PCAPTURE_HANDLE captureHandle)
+{
+  struct sockaddr_ll ifcAddress;
+
+  if (captureHandle->Ring == NULL)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketStartReceiving(): Send only handle");
+    return FALSE;
+  }
+
+  ZeroMemory(&ifcAddress, sizeof(ifcAddress));
+  ifcAddress.sll_family = AF_PACKET;
+  ifcAddress.sll_protocol = htons(ETH_P_ALL);
+  ifcAddress.sll_ifindex = captureHandle->InterfaceIndex;
+
+  if (bind(captureHandle->Socket, (struct sockaddr *)&ifcAddress, sizeof(ifcAddress)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketStartReceiving(): bind(): %s", strerror(errno));
+    return FALSE;
+  }
+
+  captureHandle->Receiving = TRUE;
+
+  return TRUE;
+}
+
+
+static int TpacketDispatchLoop(PCAPTURE_HANDLE captureHandle, CAPTURE_BATCH_HANDLER handlerParam, unsigned char *handlerArgParam)
+{
+  struct tpacket_block_desc *blockDesc = NULL;
+  struct tpacket3_hdr *frameHdr = NULL;
+  PCAPTURE_BATCH batch = &captureHandle->Batch;
+  struct pollfd pollDesc;
+  unsigned int frameCount = 0;
+  unsigned int counter = 0;
+  BOOL framesSinceIdle = FALSE;
+
+  if (captureHandle->Receiving == FALSE &&
+      TpacketStartReceiving(captureHandle) == FALSE)
+  {
+    return CAPTURE_ERROR;
+  }
+
+  ZeroMemory(&pollDesc, sizeof(pollDesc));
+  pollDesc.fd = captureHandle->Socket;
+  pollDesc.events = POLLIN | POLLERR;
+
+  while (captureHandle->BreakLoop == 0)
+  {
+    blockDesc = (struct tpacket_block_desc *)(captureHandle->Ring + captureHandle->CurrentBlock * captureHandle->BlockSize);
+
+    // Block still owned by the kernel. Tell the handler
+    // the ring ran empty, then wait for the block.
+    if ((__atomic_load_n(&blockDesc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+    {
+      if (framesSinceIdle == TRUE)
+      {
+        batch->FrameCount = 0;
+        handlerParam(handlerArgParam, batch);
+        framesSinceIdle = FALSE;
+      }
+
+      if (poll(&pollDesc, 1, 100) < 0 &&
+          errno != EINTR)
+      {
+        _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "TpacketDispatchLoop(): poll(): %s", strerror(errno));
+        return CAPTURE_ERROR;
+      }
+
+      continue;
+    }
+
+    frameCount = blockDesc->hdr.bh1.num_pkts;
+    frameHdr = (struct tpacket3_hdr *)((unsigned char *)blockDesc + blockDesc->hdr.bh1.offset_to_first_pkt);
+    batch->FrameCount = 0;
+    framesSinceIdle = TRUE;
+
+    for (counter = 0; counter < frameCount; counter++)
+    {
+      struct pcap_pkthdr *pktHeader = batch->Headers[batch->FrameCount];
+
+      pktHeader->ts.tv_sec = frameHdr->tp_sec;
+      pktHeader->ts.tv_usec = frameHdr->tp_nsec / 1000;
+      pktHeader->len = frameHdr->tp_len;
+      pktHeader->caplen = frameHdr->tp_snaplen < (unsigned int)captureHandle->SnapLen ? frameHdr->tp_snaplen : (unsigned int)captureHandle->SnapLen;
+      batch->Frames[batch->FrameCount] = (unsigned char *)frameHdr + frameHdr->tp_mac;
+      TpacketInsertVlanTag(frameHdr, pktHeader, &batch->Frames[batch->FrameCount]);
+      batch->FrameCount++;
+
+      if (batch->FrameCount == CAPTURE_MAX_BATCH)
+      {
+        handlerParam(handlerArgParam, batch);
+        batch->FrameCount = 0;
+      }
+
+      frameHdr = (struct tpacket3_hdr *)((unsigned char *)frameHdr + frameHdr->tp_next_offset);
+    }
+
+    if (batch->FrameCount > 0)
+    {
+      handlerParam(handlerArgParam, batch);
+      batch->FrameCount = 0;
+    }
+
+    // Return the block to the kernel and move on.
+    __atomic_store_n(&blockDesc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    captureHandle->CurrentBlock = (captureHandle->CurrentBlock + 1) % captureHandle->BlockCount;
+  }
+
+  return CAPTURE_EOF;
+}
+
+
+/*
+ * The kernel strips the 802.1Q tag of received frames and
+ * passes it in the frame header. Put it back in front of the
+ * EtherType, like libpcap does, so handlers and forwarding see
+ * the frame as it was on the wire. PACKET_RESERVE left room
+ * for the tag in front of the frame.
+ *
+ */
+static void TpacketInsertVlanTag(struct tpacket3_hdr *frameHdrParam, struct pcap_pkthdr *pktHeaderParam, unsigned char **frameParam)
+{
+  unsigned char *frame = *frameParam;
+  uint16_t tagProtocol = ETH_P_8021Q;
+  uint16_t tagControl = frameHdrParam->hv1.tp_vlan_tci;
+
+  if (((frameHdrParam->tp_status & TP_STATUS_VLAN_VALID) == 0 && tagControl == 0) ||
+      pktHeaderParam->caplen < 2 * ETH_ALEN)
+  {
+    return;
+  }
+
+#ifdef TP_STATUS_VLAN_TPID_VALID
+  if (frameHdrParam->tp_status & TP_STATUS_VLAN_TPID_VALID)
+  {
+    tagProtocol = frameHdrParam->hv1.tp_vlan_tpid;
+  }
+#endif
+
+  frame -= TPACKET_VLAN_TAG_LEN;
+  memmove(frame, frame + TPACKET_VLAN_TAG_LEN, 2 * ETH_ALEN);
+  frame[2 * ETH_ALEN] = (unsigned char)(tagProtocol >> 8);
+  frame[2 * ETH_ALEN + 1] = (unsigned char)tagProtocol;
+  frame[2 * ETH_ALEN + 2] = (unsigned char)(tagControl >> 8);
+  frame[2 * ETH_ALEN + 3] = (unsigned char)tagControl;
+
+  pktHeaderParam->len += TPACKET_VLAN_TAG_LEN;
+  pktHeaderParam->caplen += TPACKET_VLAN_TAG_LEN;
+  *frameParam = frame;
+}
+
+
+/*
+ * One sendmmsg() call per CAPTURE_MAX_BATCH frames. The socket
+ * is bound to the interface, the messages need no address.
+ *
+ */
+static int TpacketSendBatch(PCAPTURE_HANDLE captureHandle, unsigned char **framesParam, unsigned int *lengthsParam, int frameCountParam)
+{
+  struct mmsghdr messages[CAPTURE_MAX_BATCH];
+  struct iovec frameVectors[CAPTURE_MAX_BATCH];
+  int sentFrames = 0;
+  int chunkSize = 0;
+  int funcRetVal = 0;
+  int counter = 0;
+
+  while (sentFrames < frameCountParam)
+  {
+    chunkSize = frameCountParam - sentFrames < CAPTURE_MAX_BATCH ? frameCountParam - sentFrames : CAPTURE_MAX_BATCH;
+    ZeroMemory(messages, chunkSize * sizeof(struct mmsghdr));
+
+    for (counter = 0; counter < chunkSize; counter++)
+    {
+      frameVectors[counter].iov_base = framesParam[sentFrames + counter];
+      frameVectors[counter].iov_len = lengthsParam[sentFrames + counter];
+      messages[counter].msg_hdr.msg_iov = &frameVectors[counter];
+      messages[counter].msg_hdr.msg_iovlen = 1;
+    }
+
+    if ((funcRetVal = sendmmsg(captureHandle->Socket, messages, chunkSize, 0)) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "sendmmsg(): %s", strerror(errno));
+      break;
+    }
+
+    sentFrames += funcRetVal;
+
+    // The kernel stopped at a frame it couldn't take.
+    if (funcRetVal < chunkSize)
+    {
+      _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "sendmmsg(): %d of %d frames sent", funcRetVal, chunkSize);
+      break;
+    }
+  }
+
+  return sentFrames;
+}
+
+
+static void TpacketClose(PCAPTURE_HANDLE captureHandle)
+{
+  if (captureHandle->Ring != NULL)
+  {
+    munmap(captureHandle->Ring, captureHandle->RingSize);
+    captureHandle->Ring = NULL;
+  }
+
+  if (captureHandle->Socket >= 0)
+  {
+    close(captureHandle->Socket);
+    captureHandle->Socket = -1;
+  }
+}
+
+
+/*
+ * Remember the interface of a TPACKET or AF_XDP handle. Its
+ * drop counter counts from here on.
+ *
+ */
+static void CaptureSetInterface(PCAPTURE_HANDLE captureHandle, char *interfaceNameParam)
+{
+  if (strncmp(interfaceNameParam, "rpcap://", 8) == 0)
+  {
+    interfaceNameParam += 8;
+  }
+
+  ZeroMemory(captureHandle->InterfaceName, sizeof(captureHandle->InterfaceName));
+  strncpy(captureHandle->InterfaceName, interfaceNameParam, sizeof(captureHandle->InterfaceName) - 1);
+  captureHandle->InterfaceDropsBase = CaptureReadInterfaceCounter(captureHandle, "rx_missed_errors");
+}
+
+
+/*
+ * One counter of /sys/class/net/<interface>/statistics.
+ * 0 if the driver doesn't provide it.
+ *
+ */
+static uint64_t CaptureReadInterfaceCounter(PCAPTURE_HANDLE captureHandle, char *counterParam)
+{
+  char counterPath[256];
+  unsigned long long counterValue = 0;
+  FILE *counterFile = NULL;
+
+  ZeroMemory(counterPath, sizeof(counterPath));
+  _snprintf(counterPath, sizeof(counterPath) - 1, "/sys/class/net/%s/statistics/%s", captureHandle->InterfaceName, counterParam);
+
+  if ((counterFile = fopen(counterPath, "r")) == NULL)
+  {
+    return 0;
+  }
+
+  if (fscanf(counterFile, "%llu", &counterValue) != 1)
+  {
+    counterValue = 0;
+  }
+
+  fclose(counterFile);
+
+  return (uint64_t)counterValue;
+}
+#endif
+
+
+
+#if defined(__linux__)
+/*
+ * Linux AF_XDP backend. The UMEM is split into 2KB chunks.
+ * Receive chunks circulate between the fill ring, the receive
+ * ring and the batch handler. A chunk the handler forwards goes
+ * to the transmit ring as it is and back to the fill ring once
+ * its completion arrived, every other chunk goes back right
+ * after the handler returned. Frames sent with
+ * CaptureSendBatch() are copied into spare chunks.
+ *
+ * The XDP program is built and loaded with plain bpf() calls,
+ * there is no libbpf/libxdp dependency.
+ *
+ */
+static BOOL XdpOpen(PCAPTURE_HANDLE captureHandle, char *interfaceNameParam, unsigned char localMacBinParam[6], unsigned char localIpBinParam[4])
+{
+  BOOL retVal = FALSE;
+  unsigned int ifcIndex = 0;
+  unsigned int counter = 0;
+  int ringSize = 0;
+  struct xdp_umem_reg umemRegistration;
+  struct xdp_mmap_offsets ringOffsets;
+  struct xdp_options socketOptions;
+  struct sockaddr_xdp xdpAddress;
+  socklen_t optionLength = 0;
+
+  captureHandle->XdpCopyMode = getenv("CAPTURE_AFXDP_COPY") != NULL ? TRUE : FALSE;
+
+  if (strncmp(interfaceNameParam, "rpcap://", 8) == 0)
+  {
+    interfaceNameParam += 8;
+  }
+
+  if ((ifcIndex = if_nametoindex(interfaceNameParam)) == 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpOpen(): Unknown interface \"%s\"", interfaceNameParam);
+    goto END;
+  }
+
+  if (XdpCheckInterface(captureHandle, interfaceNameParam) == FALSE)
+  {
+    goto END;
+  }
+
+  if ((captureHandle->Socket = socket(AF_XDP, SOCK_RAW, 0)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpOpen(): socket(): %s", strerror(errno));
+    goto END;
+  }
+
+  // UMEM: the receive chunks first, the spare chunks behind them
+  captureHandle->XdpUmemSize = (size_t)(CAPTURE_XDP_RX_FRAMES + CAPTURE_XDP_TX_FRAMES) * CAPTURE_XDP_FRAME_SIZE;
+  if ((captureHandle->XdpUmem = mmap(NULL, captureHandle->XdpUmemSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+  {
+    captureHandle->XdpUmem = NULL;
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpOpen(): mmap(): %s", strerror(errno));
+    goto END;
+  }
+
+  if ((captureHandle->XdpChunkState = (unsigned char *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, CAPTURE_XDP_RX_FRAMES)) == NULL)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpOpen(): Unable to allocate the chunk states");
+    goto END;
+  }
+
+  ZeroMemory(&umemRegistration, sizeof(umemRegistration));
+  umemRegistration.addr = (uint64_t)(uintptr_t)captureHandle->XdpUmem;
+  umemRegistration.len = captureHandle->XdpUmemSize;
+  umemRegistration.chunk_size = CAPTURE_XDP_FRAME_SIZE;
+
+  if (setsockopt(captureHandle->Socket, SOL_XDP, XDP_UMEM_REG, &umemRegistration, sizeof(umemRegistration)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpOpen(): XDP_UMEM_REG: %s", strerror(errno));
+    goto END;
+  }
+
+  ringSize = CAPTURE_XDP_RX_FRAMES;
+  if (setsockopt(captureHandle->Socket, SOL_XDP, XDP_UMEM_FILL_RING, &ringSize, sizeof(ringSize)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpOpen(): XDP_UMEM_FILL_RING: %s", strerror(errno));
+    goto END;
+  }
+
+  ringSize = CAPTURE_XDP_RING_SIZE;
+  if (setsockopt(captureHandle->Socket, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ringSize, sizeof(ringSize)) < 0 ||
+      setsockopt(captureHandle->Socket, SOL_XDP, XDP_RX_RING, &ringSize, sizeof(ringSize)) < 0 ||
+      setsockopt(captureHandle->Socket, SOL_XDP, XDP_TX_RING, &ringSize, sizeof(ringSize)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpOpen(): Ring setup: %s", strerror(errno));
+    goto END;
+  }
+
+  ZeroMemory(&ringOffsets, sizeof(ringOffsets));
+  optionLength = sizeof(ringOffsets);
+  if (getsockopt(captureHandle->Socket, SOL_XDP, XDP_MMAP_OFFSETS, &ringOffsets, &optionLength) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpOpen(): XDP_MMAP_OFFSETS: %s", strerror(errno));
+    goto END;
+  }
+
+  if (XdpMapRing(captureHandle, &captureHandle->XdpFill, &ringOffsets.fr, CAPTURE_XDP_RX_FRAMES, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) == FALSE ||
+      XdpMapRing(captureHandle, &captureHandle->XdpCompletion, &ringOffsets.cr, CAPTURE_XDP_RING_SIZE, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) == FALSE ||
+      XdpMapRing(captureHandle, &captureHandle->XdpRx, &ringOffsets.rx, CAPTURE_XDP_RING_SIZE, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) == FALSE ||
+      XdpMapRing(captureHandle, &captureHandle->XdpTx, &ringOffsets.tx, CAPTURE_XDP_RING_SIZE, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) == FALSE)
+  {
+    goto END;
+  }
+
+  // Every receive chunk starts out on the fill ring
+  for (counter = 0; counter < CAPTURE_XDP_RX_FRAMES; counter++)
+  {
+    XdpRecycle(captureHandle, (uint64_t)counter * CAPTURE_XDP_FRAME_SIZE);
+  }
+
+  for (counter = 0; counter < CAPTURE_XDP_TX_FRAMES; counter++)
+  {
+    captureHandle->XdpSpareChunks[counter] = CAPTURE_XDP_RX_FRAMES + counter;
+  }
+
+  captureHandle->XdpSpareCount = CAPTURE_XDP_TX_FRAMES;
+
+  // Zero-copy fails here if the driver doesn't support it
+  ZeroMemory(&xdpAddress, sizeof(xdpAddress));
+  xdpAddress.sxdp_family = AF_XDP;
+  xdpAddress.sxdp_ifindex = ifcIndex;
+  xdpAddress.sxdp_queue_id = CAPTURE_XDP_QUEUE;
+  xdpAddress.sxdp_flags = captureHandle->XdpCopyMode == TRUE ? 0 : XDP_ZEROCOPY;
+
+  if (bind(captureHandle->Socket, (struct sockaddr *)&xdpAddress, sizeof(xdpAddress)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpOpen(): bind(): %s%s", strerror(errno),
+      captureHandle->XdpCopyMode == TRUE ? "" : " (no zero-copy support?)");
+    goto END;
+  }
+
+  // Without the zero-copy flag the kernel still uses it if it can
+  ZeroMemory(&socketOptions, sizeof(socketOptions));
+  optionLength = sizeof(socketOptions);
+  if (captureHandle->XdpCopyMode == TRUE &&
+      getsockopt(captureHandle->Socket, SOL_XDP, XDP_OPTIONS, &socketOptions, &optionLength) == 0 &&
+      (socketOptions.flags & XDP_OPTIONS_ZEROCOPY) != 0)
+  {
+    captureHandle->XdpCopyMode = FALSE;
+  }
+
+  if (XdpAttachProgram(captureHandle, ifcIndex, localMacBinParam, localIpBinParam) == FALSE)
+  {
+    goto END;
+  }
+
+  retVal = TRUE;
+
+END:
+
+  if (retVal == FALSE)
+  {
+    XdpClose(captureHandle);
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Frames on other receive queues than CAPTURE_XDP_QUEUE
+ * would never reach the socket, frames longer than a chunk
+ * minus the headroom are dropped by the kernel. Refuse both
+ * instead of losing traffic silently, XdpQueueCount tells
+ * CaptureOpenXdp() to fall back for the first. Drivers
+ * without channel information have a single queue.
+ *
+ */
+static BOOL XdpCheckInterface(PCAPTURE_HANDLE captureHandle, char *interfaceNameParam)
+{
+  BOOL retVal = FALSE;
+  int controlSocket = -1;
+  unsigned int queueCount = 1;
+  struct ifreq interfaceRequest;
+  struct ethtool_channels channels;
+
+  if ((controlSocket = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpCheckInterface(): socket(): %s", strerror(errno));
+    goto END;
+  }
+
+  ZeroMemory(&interfaceRequest, sizeof(interfaceRequest));
+  strncpy(interfaceRequest.ifr_name, interfaceNameParam, sizeof(interfaceRequest.ifr_name) - 1);
+
+  if (ioctl(controlSocket, SIOCGIFMTU, &interfaceRequest) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpCheckInterface(): SIOCGIFMTU: %s", strerror(errno));
+    goto END;
+  }
+
+  if (interfaceRequest.ifr_mtu + ETH_HLEN > CAPTURE_XDP_FRAME_SIZE - XDP_FRAME_HEADROOM)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpCheckInterface(): MTU %d of \"%s\" is above the AF_XDP limit of %d",
+      interfaceRequest.ifr_mtu, interfaceNameParam, CAPTURE_XDP_FRAME_SIZE - XDP_FRAME_HEADROOM - ETH_HLEN);
+    goto END;
+  }
+
+  ZeroMemory(&channels, sizeof(channels));
+  channels.cmd = ETHTOOL_GCHANNELS;
+  interfaceRequest.ifr_data = (char *)&channels;
+
+  if (ioctl(controlSocket, SIOCETHTOOL, &interfaceRequest) == 0 &&
+      channels.combined_count + channels.rx_count > 1)
+  {
+    queueCount = channels.combined_count + channels.rx_count;
+  }
+
+  captureHandle->XdpQueueCount = queueCount;
+
+  if (queueCount > 1)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpCheckInterface(): \"%s\" has %u receive queues, AF_XDP only uses queue %d (ethtool -L %s combined 1)",
+      interfaceNameParam, queueCount, CAPTURE_XDP_QUEUE, interfaceNameParam);
+    goto END;
+  }
+
+  retVal = TRUE;
+
+END:
+
+  if (controlSocket >= 0)
+  {
+    close(controlSocket);
+  }
+
+  return retVal;
+}
+
+
+static BOOL XdpMapRing(PCAPTURE_HANDLE captureHandle, PXDP_RING ringParam, struct xdp_ring_offset *offsetsParam, uint32_t sizeParam, size_t entrySizeParam, off_t pageOffsetParam)
+{
+  ringParam->MapSize = offsetsParam->desc + sizeParam * entrySizeParam;
+
+  if ((ringParam->Map = mmap(NULL, ringParam->MapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, captureHandle->Socket, pageOffsetParam)) == MAP_FAILED)
+  {
+    ringParam->Map = NULL;
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpMapRing(): mmap(): %s", strerror(errno));
+    return FALSE;
+  }
+
+  ringParam->Producer = (volatile uint32_t *)(ringParam->Map + offsetsParam->producer);
+  ringParam->Consumer = (volatile uint32_t *)(ringParam->Map + offsetsParam->consumer);
+  ringParam->Descriptors = ringParam->Map + offsetsParam->desc;
+  ringParam->Size = sizeParam;
+  ringParam->Mask = sizeParam - 1;
+  ringParam->Cached = 0;
+
+  return TRUE;
+}
+
+
+/*
+ * Steering program, equivalent to:
+ *
+ *   if (frame is shorter than Ethernet + IPv4 header ||
+ *       ether dst != local MAC || ether type != IPv4 ||
+ *       ip src == local IP || ip dst == local IP)
+ *     return XDP_PASS;
+ *   if ((TCP || UDP) && not a fragment &&
+ *       (src port == 53 || dst port == 53))
+ *     return XDP_PASS;
+ *   return bpf_redirect_map(&xsks, rx_queue_index, XDP_PASS);
+ *
+ * Constants are compared as they sit in the frame, so they
+ * are taken byte by byte from the network order addresses.
+ *
+ */
+static BOOL XdpAttachProgram(PCAPTURE_HANDLE captureHandle, unsigned int ifcIndexParam, unsigned char localMacBinParam[6], unsigned char localIpBinParam[4])
+{
+  static const unsigned char ipv4Type[2] = { 0x08, 0x00 };
+  static const unsigned char fragmentMask[2] = { 0x1f, 0xff };
+  static const unsigned char dnsPort[2] = { 0x00, 0x35 };
+  union bpf_attr bpfAttr;
+  struct linux_bpf_insn program[XDP_PROG_LENGTH];
+  uint32_t mac03 = 0;
+  uint16_t mac45 = 0;
+  uint16_t etherType = 0;
+  uint16_t fragment = 0;
+  uint16_t dns = 0;
+  uint32_t localIp = 0;
+  uint32_t queueId = CAPTURE_XDP_QUEUE;
+  int counter = 0;
+
+  CopyMemory(&mac03, localMacBinParam, 4);
+  CopyMemory(&mac45, localMacBinParam + 4, 2);
+  CopyMemory(&etherType, ipv4Type, 2);
+  CopyMemory(&fragment, fragmentMask, 2);
+  CopyMemory(&dns, dnsPort, 2);
+  CopyMemory(&localIp, localIpBinParam, 4);
+
+  // XSKMAP: receive queue -> socket
+  ZeroMemory(&bpfAttr, sizeof(bpfAttr));
+  bpfAttr.map_type = BPF_MAP_TYPE_XSKMAP;
+  bpfAttr.key_size = sizeof(uint32_t);
+  bpfAttr.value_size = sizeof(uint32_t);
+  bpfAttr.max_entries = CAPTURE_XDP_MAX_QUEUES;
+
+  if ((captureHandle->XdpMapFd = XdpBpf(BPF_MAP_CREATE, &bpfAttr)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpAttachProgram(): BPF_MAP_CREATE: %s", strerror(errno));
+    return FALSE;
+  }
+
+  ZeroMemory(&bpfAttr, sizeof(bpfAttr));
+  bpfAttr.map_fd = captureHandle->XdpMapFd;
+  bpfAttr.key = (uint64_t)(uintptr_t)&queueId;
+  bpfAttr.value = (uint64_t)(uintptr_t)&captureHandle->Socket;
+  bpfAttr.flags = BPF_ANY;
+
+  if (XdpBpf(BPF_MAP_UPDATE_ELEM, &bpfAttr) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpAttachProgram(): BPF_MAP_UPDATE_ELEM: %s", strerror(errno));
+    return FALSE;
+  }
+
+  ZeroMemory(program, sizeof(program));
+#define XDP_INSN(codeParam, dstParam, srcParam, offParam, immParam) \
+  program[counter].code = (codeParam); program[counter].dst_reg = (dstParam); program[counter].src_reg = (srcParam); \
+  program[counter].off = (short)(offParam); program[counter].imm = (int)(immParam); counter++;
+
+  XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0);                                    //  0 r6 = ctx
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, 0, 0);                                      //  1 r2 = data
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_6, 4, 0);                                      //  2 r3 = data_end
+  XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);                                    //  3
+  XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, 34);                                           //  4 Ethernet + IPv4
+  XDP_INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, XDP_JUMP(5, XDP_PROG_PASS), 0);             //  5
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, 0, 0);                                      //  6 ether dst
+  XDP_INSN(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, XDP_JUMP(7, XDP_PROG_PASS), mac03);               //  7
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 4, 0);                                      //  8
+  XDP_INSN(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, XDP_JUMP(9, XDP_PROG_PASS), mac45);               //  9
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 12, 0);                                     // 10 ether type
+  XDP_INSN(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, XDP_JUMP(11, XDP_PROG_PASS), etherType);          // 11
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, 26, 0);                                     // 12 ip src
+  XDP_INSN(BPF_JMP32 | BPF_JEQ | BPF_K, BPF_REG_5, 0, XDP_JUMP(13, XDP_PROG_PASS), localIp);            // 13
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, 30, 0);                                     // 14 ip dst
+  XDP_INSN(BPF_JMP32 | BPF_JEQ | BPF_K, BPF_REG_5, 0, XDP_JUMP(15, XDP_PROG_PASS), localIp);            // 15
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 23, 0);                                     // 16 ip protocol
+  XDP_INSN(BPF_JMP32 | BPF_JEQ | BPF_K, BPF_REG_5, 0, XDP_JUMP(17, XDP_PROG_PORTS), 6);                 // 17 TCP
+  XDP_INSN(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, XDP_JUMP(18, XDP_PROG_REDIRECT), 17);             // 18 UDP
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 20, 0);                                     // 19 fragment offset
+  XDP_INSN(BPF_ALU | BPF_AND | BPF_K, BPF_REG_5, 0, 0, fragment);                                       // 20
+  XDP_INSN(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, XDP_JUMP(21, XDP_PROG_REDIRECT), 0);              // 21
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 14, 0);                                     // 22 ip header length
+  XDP_INSN(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, 0x0f);                                         // 23
+  XDP_INSN(BPF_ALU64 | BPF_LSH | BPF_K, BPF_REG_5, 0, 0, 2);                                            // 24
+  XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_X, BPF_REG_2, BPF_REG_5, 0, 0);                                    // 25 r2 = IP payload - 14
+  XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);                                    // 26
+  XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, 18);                                           // 27 + ports
+  XDP_INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, XDP_JUMP(28, XDP_PROG_PASS), 0);            // 28
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 14, 0);                                     // 29 src port
+  XDP_INSN(BPF_JMP32 | BPF_JEQ | BPF_K, BPF_REG_5, 0, XDP_JUMP(30, XDP_PROG_PASS), dns);               // 30
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 16, 0);                                     // 31 dst port
+  XDP_INSN(BPF_JMP32 | BPF_JEQ | BPF_K, BPF_REG_5, 0, XDP_JUMP(32, XDP_PROG_PASS), dns);               // 32
+  XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, 16, 0);                                     // 33 rx_queue_index
+  XDP_INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, captureHandle->XdpMapFd);        // 34 r1 = &xsks
+  XDP_INSN(0, 0, 0, 0, 0);                                                                              // 35
+  XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS);                                     // 36
+  XDP_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);                                         // 37
+  XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);                                                             // 38
+  XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS);                                     // 39
+  XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);                                                             // 40
+#undef XDP_INSN
+
+  ZeroMemory(&bpfAttr, sizeof(bpfAttr));
+  bpfAttr.prog_type = BPF_PROG_TYPE_XDP;
+  bpfAttr.insns = (uint64_t)(uintptr_t)program;
+  bpfAttr.insn_cnt = counter;
+  bpfAttr.license = (uint64_t)(uintptr_t)"GPL";
+
+  if ((captureHandle->XdpProgFd = XdpBpf(BPF_PROG_LOAD, &bpfAttr)) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpAttachProgram(): BPF_PROG_LOAD: %s", strerror(errno));
+    return FALSE;
+  }
+
+  // A link detaches the program when its last fd is closed.
+  // Generic XDP is slower and never zero-copy.
+  ZeroMemory(&bpfAttr, sizeof(bpfAttr));
+  bpfAttr.link_create.prog_fd = captureHandle->XdpProgFd;
+  bpfAttr.link_create.target_ifindex = ifcIndexParam;
+  bpfAttr.link_create.attach_type = BPF_XDP;
+  bpfAttr.link_create.flags = XDP_FLAGS_DRV_MODE;
+
+  if ((captureHandle->XdpLinkFd = XdpBpf(BPF_LINK_CREATE, &bpfAttr)) < 0 &&
+      captureHandle->XdpCopyMode == TRUE)
+  {
+    bpfAttr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    captureHandle->XdpLinkFd = XdpBpf(BPF_LINK_CREATE, &bpfAttr);
+  }
+
+  if (captureHandle->XdpLinkFd < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpAttachProgram(): BPF_LINK_CREATE: %s", strerror(errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static int XdpBpf(int commandParam, union bpf_attr *attrParam)
+{
+  return (int)syscall(__NR_bpf, commandParam, attrParam, sizeof(union bpf_attr));
+}
+
+
+/*
+ * The XDP program only preselects. The filter is compiled
+ * with libpcap and run on every received frame, frames it
+ * rejects go back to the fill ring.
+ *
+ */
+static BOOL XdpSetFilter(PCAPTURE_HANDLE captureHandle, char *filterParam, unsigned int netMaskParam)
+{
+  pcap_t *deadHandle = NULL;
+  struct bpf_program filterCode;
+
+  ZeroMemory(&filterCode, sizeof(filterCode));
+
+  if ((deadHandle = pcap_open_dead(DLT_EN10MB, captureHandle->SnapLen)) == NULL)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpSetFilter(): pcap_open_dead() failed");
+    return FALSE;
+  }
+
+  if (pcap_compile(deadHandle, &filterCode, filterParam, 1, netMaskParam) < 0)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "%s", pcap_geterr(deadHandle));
+    pcap_close(deadHandle);
+    return FALSE;
+  }
+
+  pcap_close(deadHandle);
+
+  if (captureHandle->XdpFilterSet == TRUE)
+  {
+    pcap_freecode(&captureHandle->XdpFilter);
+  }
+
+  CopyMemory(&captureHandle->XdpFilter, &filterCode, sizeof(filterCode));
+  captureHandle->XdpFilterSet = TRUE;
+
+  return TRUE;
+}
+
+
+static int XdpDispatchLoop(PCAPTURE_HANDLE captureHandle, CAPTURE_BATCH_HANDLER handlerParam, unsigned char *handlerArgParam)
+{
+  PCAPTURE_BATCH batch = &captureHandle->Batch;
+  struct xdp_desc *rxDescriptors = (struct xdp_desc *)captureHandle->XdpRx.Descriptors;
+  struct xdp_desc *rxDescriptor = NULL;
+  struct pcap_pkthdr *pktHeader = NULL;
+  struct pollfd pollDesc;
+  struct timeval now;
+  uint32_t available = 0;
+  uint32_t counter = 0;
+  uint64_t address = 0;
+  BOOL framesSinceIdle = FALSE;
+
+  ZeroMemory(&pollDesc, sizeof(pollDesc));
+  pollDesc.fd = captureHandle->Socket;
+  pollDesc.events = POLLIN | POLLERR;
+
+  while (captureHandle->BreakLoop == 0)
+  {
+    XdpReapCompletions(captureHandle);
+
+    if ((available = __atomic_load_n(captureHandle->XdpRx.Producer, __ATOMIC_ACQUIRE) - captureHandle->XdpRx.Cached) == 0)
+    {
+      if (framesSinceIdle == TRUE)
+      {
+        batch->FrameCount = 0;
+        handlerParam(handlerArgParam, batch);
+        XdpKick(captureHandle);
+        framesSinceIdle = FALSE;
+      }
+
+      if (poll(&pollDesc, 1, 100) < 0 &&
+          errno != EINTR)
+      {
+        _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpDispatchLoop(): poll(): %s", strerror(errno));
+        return CAPTURE_ERROR;
+      }
+
+      continue;
+    }
+
+    if (available > CAPTURE_MAX_BATCH)
+    {
+      available = CAPTURE_MAX_BATCH;
+    }
+
+    // AF_XDP has no timestamps
+    gettimeofday(&now, NULL);
+    batch->FrameCount = 0;
+    framesSinceIdle = TRUE;
+
+    for (counter = 0; counter < available; counter++)
+    {
+      rxDescriptor = &rxDescriptors[(captureHandle->XdpRx.Cached + counter) & captureHandle->XdpRx.Mask];
+      pktHeader = batch->Headers[batch->FrameCount];
+      pktHeader->ts = now;
+      pktHeader->len = rxDescriptor->len;
+      pktHeader->caplen = rxDescriptor->len < (unsigned int)captureHandle->SnapLen ? rxDescriptor->len : (unsigned int)captureHandle->SnapLen;
+
+      if (captureHandle->XdpFilterSet == TRUE &&
+          pcap_offline_filter(&captureHandle->XdpFilter, pktHeader, captureHandle->XdpUmem + rxDescriptor->addr) == 0)
+      {
+        XdpRecycle(captureHandle, rxDescriptor->addr);
+        continue;
+      }
+
+      captureHandle->XdpChunkState[rxDescriptor->addr / CAPTURE_XDP_FRAME_SIZE] = XDP_CHUNK_USER;
+      captureHandle->XdpBatchAddr[batch->FrameCount] = rxDescriptor->addr;
+      batch->Frames[batch->FrameCount] = captureHandle->XdpUmem + rxDescriptor->addr;
+      batch->FrameCount++;
+    }
+
+    captureHandle->XdpRx.Cached += available;
+    __atomic_store_n(captureHandle->XdpRx.Consumer, captureHandle->XdpRx.Cached, __ATOMIC_RELEASE);
+
+    if (batch->FrameCount > 0)
+    {
+      handlerParam(handlerArgParam, batch);
+    }
+
+    // Forwarded chunks return with their completion
+    for (counter = 0; counter < (uint32_t)batch->FrameCount; counter++)
+    {
+      address = captureHandle->XdpBatchAddr[counter];
+
+      if (captureHandle->XdpChunkState[address / CAPTURE_XDP_FRAME_SIZE] == XDP_CHUNK_TX_USER)
+      {
+        captureHandle->XdpChunkState[address / CAPTURE_XDP_FRAME_SIZE] = XDP_CHUNK_TX;
+      }
+      else
+      {
+        XdpRecycle(captureHandle, address);
+      }
+    }
+
+    batch->FrameCount = 0;
+    XdpKick(captureHandle);
+  }
+
+  return CAPTURE_EOF;
+}
+
+
+static BOOL XdpForwardFrame(PCAPTURE_HANDLE captureHandle, unsigned char *frameParam, unsigned int frameLengthParam)
+{
+  uint64_t address = 0;
+  unsigned int chunk = 0;
+
+  if (frameParam < captureHandle->XdpUmem ||
+      frameParam >= captureHandle->XdpUmem + (size_t)CAPTURE_XDP_RX_FRAMES * CAPTURE_XDP_FRAME_SIZE)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpForwardFrame(): Not a received frame");
+    return FALSE;
+  }
+
+  address = (uint64_t)(frameParam - captureHandle->XdpUmem);
+  chunk = (unsigned int)(address / CAPTURE_XDP_FRAME_SIZE);
+
+  if (captureHandle->XdpChunkState[chunk] != XDP_CHUNK_USER ||
+      address % CAPTURE_XDP_FRAME_SIZE + frameLengthParam > CAPTURE_XDP_FRAME_SIZE)
+  {
+    _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpForwardFrame(): Frame is not part of the current batch");
+    return FALSE;
+  }
+
+  if (XdpReserveTx(captureHandle) == FALSE)
+  {
+    return FALSE;
+  }
+
+  captureHandle->XdpChunkState[chunk] = XDP_CHUNK_TX_USER;
+  XdpPutTx(captureHandle, address, frameLengthParam);
+
+  return TRUE;
+}
+
+
+static int XdpSendBatch(PCAPTURE_HANDLE captureHandle, unsigned char **framesParam, unsigned int *lengthsParam, int frameCountParam)
+{
+  int sentFrames = 0;
+  unsigned int chunk = 0;
+
+  for (sentFrames = 0; sentFrames < frameCountParam; sentFrames++)
+  {
+    if (lengthsParam[sentFrames] > CAPTURE_XDP_FRAME_SIZE)
+    {
+      _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpSendBatch(): Frame of %u bytes is too large", lengthsParam[sentFrames]);
+      break;
+    }
+
+    if (captureHandle->XdpSpareCount == 0)
+    {
+      XdpKick(captureHandle);
+      XdpReapCompletions(captureHandle);
+    }
+
+    if (captureHandle->XdpSpareCount == 0)
+    {
+      _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpSendBatch(): No free transmit buffer");
+      break;
+    }
+
+    if (XdpReserveTx(captureHandle) == FALSE)
+    {
+      break;
+    }
+
+    chunk = captureHandle->XdpSpareChunks[--captureHandle->XdpSpareCount];
+    CopyMemory(captureHandle->XdpUmem + (size_t)chunk * CAPTURE_XDP_FRAME_SIZE, framesParam[sentFrames], lengthsParam[sentFrames]);
+    XdpPutTx(captureHandle, (uint64_t)chunk * CAPTURE_XDP_FRAME_SIZE, lengthsParam[sentFrames]);
+  }
+
+  XdpKick(captureHandle);
+
+  return sentFrames;
+}
+
+
+/*
+ * Make sure the TX ring has a free slot. A full ring is
+ * kicked once and its completions reaped before giving up.
+ *
+ */
+static BOOL XdpReserveTx(PCAPTURE_HANDLE captureHandle)
+{
+  PXDP_RING txRing = &captureHandle->XdpTx;
+
+  if (txRing->Cached - __atomic_load_n(txRing->Consumer, __ATOMIC_ACQUIRE) < txRing->Size)
+  {
+    return TRUE;
+  }
+
+  XdpKick(captureHandle);
+  XdpReapCompletions(captureHandle);
+
+  if (txRing->Cached - __atomic_load_n(txRing->Consumer, __ATOMIC_ACQUIRE) < txRing->Size)
+  {
+    return TRUE;
+  }
+
+  _snprintf(captureHandle->ErrorBuffer, sizeof(captureHandle->ErrorBuffer) - 1, "XdpReserveTx(): TX ring full");
+
+  return FALSE;
+}
+
+
+static void XdpPutTx(PCAPTURE_HANDLE captureHandle, uint64_t addressParam, unsigned int lengthParam)
+{
+  PXDP_RING txRing = &captureHandle->XdpTx;
+  struct xdp_desc *txDescriptor = &((struct xdp_desc *)txRing->Descriptors)[txRing->Cached & txRing->Mask];
+
+  txDescriptor->addr = addressParam;
+  txDescriptor->len = lengthParam;
+  txDescriptor->options = 0;
+
+  txRing->Cached++;
+  __atomic_store_n(txRing->Producer, txRing->Cached, __ATOMIC_RELEASE);
+  captureHandle->XdpTxQueued++;
+}
+
+
+/*
+ * Sent chunks come back on the completion ring. Receive
+ * chunks go back to the fill ring unless the handler still
+ * holds their batch, spare chunks go back on the stack.
+ *
+ */
+static void XdpReapCompletions(PCAPTURE_HANDLE captureHandle)
+{
+  PXDP_RING completionRing = &captureHandle->XdpCompletion;
+  uint32_t available = __atomic_load_n(completionRing->Producer, __ATOMIC_ACQUIRE) - completionRing->Cached;
+  uint64_t address = 0;
+  unsigned int chunk = 0;
+
+  while (available-- > 0)
+  {
+    address = ((uint64_t *)completionRing->Descriptors)[completionRing->Cached & completionRing->Mask];
+    chunk = (unsigned int)(address / CAPTURE_XDP_FRAME_SIZE);
+    completionRing->Cached++;
+
+    if (chunk >= CAPTURE_XDP_RX_FRAMES)
+    {
+      captureHandle->XdpSpareChunks[captureHandle->XdpSpareCount++] = chunk;
+    }
+    else if (captureHandle->XdpChunkState[chunk] == XDP_CHUNK_TX_USER)
+    {
+      captureHandle->XdpChunkState[chunk] = XDP_CHUNK_USER;
+    }
+    else
+    {
+      XdpRecycle(captureHandle, address);
+    }
+  }
+
+  __atomic_store_n(completionRing->Consumer, completionRing->Cached, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Hand a receive chunk back to the kernel. The fill ring
+ * holds all receive chunks, it never runs full.
+ *
+ */
+static void XdpRecycle(PCAPTURE_HANDLE captureHandle, uint64_t addressParam)
+{
+  PXDP_RING fillRing = &captureHandle->XdpFill;
+  uint64_t chunkAddress = addressParam - addressParam % CAPTURE_XDP_FRAME_SIZE;
+
+  captureHandle->XdpChunkState[chunkAddress / CAPTURE_XDP_FRAME_SIZE] = XDP_CHUNK_KERNEL;
+  ((uint64_t *)fillRing->Descriptors)[fillRing->Cached & fillRing->Mask] = chunkAddress;
+  fillRing->Cached++;
+  __atomic_store_n(fillRing->Producer, fillRing->Cached, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Copy mode and most drivers only transmit after a
+ * sendto(). In copy mode one call sends a limited number
+ * of frames and fails with EAGAIN while more are left or
+ * the completion ring is full.
+ *
+ */
+static void XdpKick(PCAPTURE_HANDLE captureHandle)
+{
+  PXDP_RING txRing = &captureHandle->XdpTx;
+  unsigned int retries = CAPTURE_XDP_RING_SIZE;
+
+  if (captureHandle->XdpTxQueued == 0)
+  {
+    return;
+  }
+
+  while (sendto(captureHandle->Socket, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+         errno == EAGAIN &&
+         __atomic_load_n(txRing->Consumer, __ATOMIC_ACQUIRE) != txRing->Cached &&
+         retries-- > 0)
+  {
+    XdpReapCompletions(captureHandle);
+  }
+
+  captureHandle->XdpTxQueued = 0;
+}
+
+
+static void XdpClose(PCAPTURE_HANDLE captureHandle)
+{
+  PXDP_RING rings[4] = { &captureHandle->XdpFill, &captureHandle->XdpCompletion, &captureHandle->XdpRx, &captureHandle->XdpTx };
+  int counter = 0;
+
+  if (captureHandle->XdpLinkFd >= 0)
+  {
+    close(captureHandle->XdpLinkFd);
+    captureHandle->XdpLinkFd = -1;
+  }
+
+  if (captureHandle->XdpProgFd >= 0)
+  {
+    close(captureHandle->XdpProgFd);
+    captureHandle->XdpProgFd = -1;
+  }
+
+  if (captureHandle->XdpMapFd >= 0)
+  {
+    close(captureHandle->XdpMapFd);
+    captureHandle->XdpMapFd = -1;
+  }
+
+  for (counter = 0; counter < 4; counter++)
+  {
+    if (rings[counter]->Map != NULL)
+    {
+      munmap(rings[counter]->Map, rings[counter]->MapSize);
+      rings[counter]->Map = NULL;
+    }
+  }
+
+  if (captureHandle->Socket >= 0)
+  {
+    close(captureHandle->Socket);
+    captureHandle->Socket = -1;
+  }
+
+  if (captureHandle->XdpUmem != NULL)
+  {
+    munmap(captureHandle->XdpUmem, captureHandle->XdpUmemSize);
+    captureHandle->XdpUmem = NULL;
+  }
+
+  if (captureHandle->XdpChunkState != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, captureHandle->XdpChunkState);
+    captureHandle->XdpChunkState = NULL;
+  }
+
+  if (captureHandle->XdpFilterSet == TRUE)
+  {
+    pcap_freecode(&captureHandle->XdpFilter);
+    captureHandle->XdpFilterSet = FALSE;
+  }
+}
+#endif
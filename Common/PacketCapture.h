@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPTURE_ERRBUF_SIZE 256
+#define CAPTURE_MAX_BATCH 256
+
+// Open flags
+#define CAPTURE_FLAG_PROMISCUOUS      0x01
+#define CAPTURE_FLAG_NOCAPTURE_LOCAL  0x02
+#define CAPTURE_FLAG_PCAP_ONLY        0x04
+#define CAPTURE_FLAG_SEND_ONLY        0x08  // Transmit handle, receives nothing
+
+// Matches no frame. Keeps the pcap buffer of send only handles empty.
+#define CAPTURE_SEND_ONLY_FILTER "less 1"
+
+// Backends
+#define CAPTURE_BACKEND_PCAP       0
+#define CAPTURE_BACKEND_TPACKETV3  1
+#define CAPTURE_BACKEND_REPLAY     2
+#define CAPTURE_BACKEND_AFXDP      3
+#define CAPTURE_BACKEND_DUMP       4
+
+// Largest pcap file CaptureOpenReplay() loads into memory
+#define CAPTURE_REPLAY_MAX_FILE_SIZE (1024 * 1024 * 1024)
+
+// Dump file formats, see CaptureOpenDumpFile()
+#define CAPTURE_DUMP_PCAP    0
+#define CAPTURE_DUMP_PCAPNG  1
+
+// Dump files are written through a mapped window of this size. A
+// multiple of the allocation granularity (64KB on Windows).
+#define CAPTURE_DUMP_WINDOW_SIZE (64 * 1024 * 1024)
+#define CAPTURE_DUMP_SNAPLEN     65535
+
+// TPACKET_V3 ring geometry: blocks of 1MB, 16 of them (16MB of
+// locked memory per handle) unless CAPTURE_RING_MB asks for another
+// ring size. Frames up to 2KB.
+#define CAPTURE_RING_BLOCK_SIZE  (1 << 20)
+#define CAPTURE_RING_BLOCK_COUNT 16
+#define CAPTURE_RING_MAX_BLOCKS  1024
+#define CAPTURE_RING_FRAME_SIZE  (1 << 11)
+
+// AF_XDP UMEM geometry: 2KB chunks, 4096 for receiving (all on the fill
+// ring) and 1024 spare ones for frames sent with CaptureSendBatch()
+#define CAPTURE_XDP_FRAME_SIZE  (1 << 11)
+#define CAPTURE_XDP_RX_FRAMES   4096
+#define CAPTURE_XDP_TX_FRAMES   1024
+#define CAPTURE_XDP_RING_SIZE   2048
+#define CAPTURE_XDP_QUEUE       0      // The only queue, see CaptureOpenXdp()
+#define CAPTURE_XDP_MAX_QUEUES  64
+
+// Dispatch return values (same meaning as pcap_next_ex())
+#define CAPTURE_EOF    -2
+#define CAPTURE_ERROR  -1
+
+// No pcap.h here. It drags winsock2.h in behind windows.h.
+struct pcap_pkthdr;
+
+
+/*
+ * Type definitions
+ *
+ */
+
+// One batch of frames. On the TPACKET_V3 backend Frames[] point straight
+// into the mapped ring and stay valid (and writable) until the handler
+// returns. The pcap fallback hands out batches of one frame. The replay
+// backend points into its in-memory copy of the pcap file. On the AF_XDP
+// backend Frames[] point into the UMEM shared by the receive and the
+// transmit ring, CaptureForwardFrame() sends them from there.
+//
+// A batch with FrameCount 0 means no more frames are waiting right now
+// (read timeout, empty ring, end of a replay). Handlers use it to flush
+// what they have queued for transmission, see TransmitQueue.h.
+typedef struct
+{
+  int FrameCount;
+  struct pcap_pkthdr *Headers[CAPTURE_MAX_BATCH];
+  unsigned char *Frames[CAPTURE_MAX_BATCH];
+} CAPTURE_BATCH, *PCAPTURE_BATCH;
+
+typedef void(*CAPTURE_BATCH_HANDLER)(unsigned char *param, PCAPTURE_BATCH batch);
+
+// Counters of one handle since it was opened, see CaptureGetStats().
+// KernelDrops: frames the capture driver or kernel had no buffer or
+// ring space for (pcap ps_drop, TPACKET tp_drops, AF_XDP rx_dropped
+// and rx_ring_full). InterfaceDrops: frames the NIC dropped before
+// they reached the capture (pcap ps_ifdrop, rx_missed_errors of the
+// interface on Linux). Bytes are wire lengths.
+typedef struct
+{
+  uint64_t ReceivedPackets;
+  uint64_t ReceivedBytes;
+  uint64_t ReceivedBatches;
+  uint64_t KernelDrops;
+  uint64_t InterfaceDrops;
+  uint64_t SentPackets;
+  uint64_t SentBytes;
+} CAPTURE_STATS, *PCAPTURE_STATS;
+
+// Opaque, see PacketCapture.c
+typedef struct CAPTURE_HANDLE CAPTURE_HANDLE, *PCAPTURE_HANDLE;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+PCAPTURE_HANDLE CaptureOpen(char *interfaceNameParam, int snapLenParam, int flagsParam, int readTimeoutParam, char *errorBufferParam);
+PCAPTURE_HANDLE CaptureOpenOffline(char *filePathParam, char *errorBufferParam);
+PCAPTURE_HANDLE CaptureOpenReplay(char *filePathParam, int loopCountParam, char *errorBufferParam);
+PCAPTURE_HANDLE CaptureOpenNullSink(char *errorBufferParam);
+PCAPTURE_HANDLE CaptureOpenDumpFile(char *filePathParam, int formatParam, char *errorBufferParam);
+PCAPTURE_HANDLE CaptureOpenXdp(char *interfaceNameParam, unsigned char localMacBinParam[6], unsigned char localIpBinParam[4], int snapLenParam, int readTimeoutParam, char *errorBufferParam);
+BOOL CaptureSetFilter(PCAPTURE_HANDLE captureHandle, char *filterParam, unsigned int netMaskParam);
+int CaptureDispatchLoop(PCAPTURE_HANDLE captureHandle, CAPTURE_BATCH_HANDLER handlerParam, unsigned char *handlerArgParam);
+int CaptureSendPacket(PCAPTURE_HANDLE captureHandle, unsigned char *dataParam, unsigned int dataLengthParam);
+int CaptureSendBatch(PCAPTURE_HANDLE captureHandle, unsigned char **framesParam, unsigned int *lengthsParam, int frameCountParam);
+BOOL CaptureCanForwardInPlace(PCAPTURE_HANDLE captureHandle);
+int CaptureForwardFrame(PCAPTURE_HANDLE captureHandle, unsigned char *frameParam, unsigned int frameLengthParam);
+void CaptureBreakLoop(PCAPTURE_HANDLE captureHandle);
+void CaptureClose(PCAPTURE_HANDLE captureHandle);
+char *CaptureGetError(PCAPTURE_HANDLE captureHandle);
+char *CaptureGetBackendName(PCAPTURE_HANDLE captureHandle);
+void CaptureGetSentCounters(PCAPTURE_HANDLE captureHandle, uint64_t *packetsParam, uint64_t *bytesParam);
+BOOL CaptureGetStats(PCAPTURE_HANDLE captureHandle, PCAPTURE_STATS statsParam);
+
+#ifdef __cplusplus
+}
+#endif
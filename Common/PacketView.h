@@ -0,0 +1,292 @@
+#pragma once
+
+#include "NetworkStructs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Single pass decoder for captured Ethernet frames.
+ *
+ * PacketViewParse() walks Ethernet, one optional 802.1Q/802.1ad tag,
+ * ARP or IPv4 and TCP/UDP/ICMP exactly once and records the offsets of
+ * every header it could fully validate against the captured length.
+ * Handlers work on these offsets instead of recomputing "data + 14",
+ * "(ver_ihl & 0xf) * 4" and "doff * 4" themselves. A layer bit is only
+ * set if the whole header lies inside the captured data, so the PV_*()
+ * accessors below are safe to dereference once the bit was checked.
+ *
+ */
+
+// Layers found in the frame
+#define PV_LAYER_ETH   0x01
+#define PV_LAYER_VLAN  0x02
+#define PV_LAYER_ARP   0x04
+#define PV_LAYER_IPV4  0x08
+#define PV_LAYER_TCP   0x10
+#define PV_LAYER_UDP   0x20
+#define PV_LAYER_ICMP  0x40
+
+// Decoder findings
+#define PV_FLAG_TRUNCATED  0x01  // Snap length cut off a header or the IP payload
+#define PV_FLAG_FRAGMENT   0x02  // Non-first IPv4 fragment, there is no L4 header
+#define PV_FLAG_BADHDR     0x04  // Inconsistent version/length fields
+
+// TCP flags as found in byte 13 of the TCP header
+#define PV_TCP_FIN  0x01
+#define PV_TCP_SYN  0x02
+#define PV_TCP_RST  0x04
+#define PV_TCP_PSH  0x08
+#define PV_TCP_ACK  0x10
+#define PV_TCP_URG  0x20
+
+#define PV_ICMP_HDR_LEN 8
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  unsigned short L3Offset;          // ARP/IPv4 header
+  unsigned short L4Offset;          // TCP/UDP/ICMP header, 0 if there is none
+  unsigned short PayloadOffset;     // L4 payload
+  unsigned short PayloadLength;     // L4 payload length announced by the IP header
+  unsigned short PayloadCapLength;  // L4 payload bytes actually captured
+  unsigned short IpTotalLength;
+  unsigned short EtherType;         // Inner EtherType if the frame is VLAN tagged
+  unsigned short VlanId;
+  unsigned short SrcPort;           // Host byte order
+  unsigned short DstPort;           // Host byte order
+  unsigned char IpProto;
+  unsigned char TcpFlags;
+  unsigned char Layers;
+  unsigned char Flags;
+} PACKET_VIEW, *PPACKET_VIEW;
+
+
+/*
+ * Header accessors. Only valid if the corresponding PV_LAYER_* bit is set.
+ *
+ */
+#define PV_ETH(dataParam)                ((PETHDR)(dataParam))
+#define PV_ARP(dataParam, viewParam)     ((PARPHDR)((dataParam) + (viewParam)->L3Offset))
+#define PV_IP(dataParam, viewParam)      ((PIPHDR)((dataParam) + (viewParam)->L3Offset))
+#define PV_TCP(dataParam, viewParam)     ((PTCPHDR)((dataParam) + (viewParam)->L4Offset))
+#define PV_UDP(dataParam, viewParam)     ((PUDPHDR)((dataParam) + (viewParam)->L4Offset))
+#define PV_ICMP(dataParam, viewParam)    ((PICMPHDR)((dataParam) + (viewParam)->L4Offset))
+#define PV_PAYLOAD(dataParam, viewParam) ((dataParam) + (viewParam)->PayloadOffset)
+
+
+static __inline unsigned short PacketViewRead16(const unsigned char *dataParam)
+{
+  return (unsigned short)((dataParam[0] << 8) | dataParam[1]);
+}
+
+
+/*
+ * Decode one frame. Returns FALSE if the frame does not even hold
+ * an Ethernet header, TRUE otherwise. Check viewParam->Layers for
+ * what was found.
+ *
+ */
+static __inline BOOL PacketViewParse(const unsigned char *dataParam, unsigned int capLengthParam, PPACKET_VIEW viewParam)
+{
+  unsigned int offset = 0;
+  unsigned int ipHdrLength = 0;
+  unsigned int l4HdrLength = 0;
+  unsigned int ipEnd = 0;
+  unsigned int capEnd = 0;
+
+  ZeroMemory(viewParam, sizeof(PACKET_VIEW));
+
+  if (dataParam == NULL ||
+      capLengthParam < sizeof(ETHDR))
+  {
+    return FALSE;
+  }
+
+  // Offsets are 16 bit wide
+  if (capLengthParam > 0xffff)
+  {
+    capLengthParam = 0xffff;
+  }
+
+  viewParam->Layers = PV_LAYER_ETH;
+  viewParam->EtherType = PacketViewRead16(dataParam + 12);
+  offset = sizeof(ETHDR);
+
+  if (viewParam->EtherType == ETHERTYPE_VLAN ||
+      viewParam->EtherType == ETHERTYPE_QINQ)
+  {
+    if (capLengthParam < offset + 4)
+    {
+      viewParam->Flags |= PV_FLAG_TRUNCATED;
+      return TRUE;
+    }
+
+    viewParam->VlanId = PacketViewRead16(dataParam + offset) & 0x0fff;
+    viewParam->EtherType = PacketViewRead16(dataParam + offset + 2);
+    viewParam->Layers |= PV_LAYER_VLAN;
+    offset += 4;
+  }
+
+  viewParam->L3Offset = (unsigned short)offset;
+
+  // ARP
+  if (viewParam->EtherType == ETHERTYPE_ARP)
+  {
+    if (capLengthParam < offset + sizeof(ARPHDR))
+    {
+      viewParam->Flags |= PV_FLAG_TRUNCATED;
+    }
+    else
+    {
+      viewParam->Layers |= PV_LAYER_ARP;
+    }
+
+    return TRUE;
+  }
+
+  if (viewParam->EtherType != ETHERTYPE_IP)
+  {
+    return TRUE;
+  }
+
+  // IPv4
+  if (capLengthParam < offset + sizeof(IPHDR))
+  {
+    viewParam->Flags |= PV_FLAG_TRUNCATED;
+    return TRUE;
+  }
+
+  ipHdrLength = (dataParam[offset] & 0x0f) * 4;
+  viewParam->IpTotalLength = PacketViewRead16(dataParam + offset + 2);
+
+  if ((dataParam[offset] >> 4) != 4 ||
+      ipHdrLength < sizeof(IPHDR) ||
+      viewParam->IpTotalLength < ipHdrLength)
+  {
+    viewParam->Flags |= PV_FLAG_BADHDR;
+    return TRUE;
+  }
+
+  if (capLengthParam < offset + ipHdrLength)
+  {
+    viewParam->Flags |= PV_FLAG_TRUNCATED;
+    return TRUE;
+  }
+
+  viewParam->Layers |= PV_LAYER_IPV4;
+  viewParam->IpProto = dataParam[offset + 9];
+
+  // Ethernet padding is not part of the IP packet, missing
+  // bytes are.
+  ipEnd = offset + viewParam->IpTotalLength;
+  capEnd = ipEnd;
+  if (ipEnd > capLengthParam)
+  {
+    viewParam->Flags |= PV_FLAG_TRUNCATED;
+    capEnd = capLengthParam;
+  }
+
+  if ((PacketViewRead16(dataParam + offset + 6) & 0x1fff) != 0)
+  {
+    viewParam->Flags |= PV_FLAG_FRAGMENT;
+    return TRUE;
+  }
+
+  offset += ipHdrLength;
+  viewParam->L4Offset = (unsigned short)offset;
+
+  // TCP/UDP/ICMP
+  if (viewParam->IpProto == IP_PROTO_TCP)
+  {
+    if (capEnd < offset + sizeof(TCPHDR))
+    {
+      viewParam->Flags |= PV_FLAG_TRUNCATED;
+      return TRUE;
+    }
+
+    l4HdrLength = (dataParam[offset + 12] >> 4) * 4;
+    if (l4HdrLength < sizeof(TCPHDR) ||
+        ipEnd < offset + l4HdrLength)
+    {
+      viewParam->Flags |= PV_FLAG_BADHDR;
+      return TRUE;
+    }
+
+    if (capEnd < offset + l4HdrLength)
+    {
+      viewParam->Flags |= PV_FLAG_TRUNCATED;
+      return TRUE;
+    }
+
+    viewParam->TcpFlags = dataParam[offset + 13] & 0x3f;
+    viewParam->Layers |= PV_LAYER_TCP;
+  }
+  else if (viewParam->IpProto == IP_PROTO_UDP)
+  {
+    l4HdrLength = sizeof(UDPHDR);
+    if (capEnd < offset + l4HdrLength)
+    {
+      viewParam->Flags |= PV_FLAG_TRUNCATED;
+      return TRUE;
+    }
+
+    viewParam->Layers |= PV_LAYER_UDP;
+  }
+  else if (viewParam->IpProto == IP_PROTO_ICMP)
+  {
+    l4HdrLength = PV_ICMP_HDR_LEN;
+    if (capEnd < offset + l4HdrLength)
+    {
+      viewParam->Flags |= PV_FLAG_TRUNCATED;
+      return TRUE;
+    }
+
+    viewParam->Layers |= PV_LAYER_ICMP;
+  }
+
+  if (viewParam->Layers & (PV_LAYER_TCP | PV_LAYER_UDP))
+  {
+    viewParam->SrcPort = PacketViewRead16(dataParam + offset);
+    viewParam->DstPort = PacketViewRead16(dataParam + offset + 2);
+  }
+
+  offset += l4HdrLength;
+  viewParam->PayloadOffset = (unsigned short)offset;
+  viewParam->PayloadLength = (unsigned short)(ipEnd > offset ? ipEnd - offset : 0);
+  viewParam->PayloadCapLength = (unsigned short)(capEnd > offset ? capEnd - offset : 0);
+
+  return TRUE;
+}
+
+
+/*
+ * Protocol name for log lines and firewall rules
+ *
+ */
+static __inline char *PacketViewProtoName(PPACKET_VIEW viewParam)
+{
+  if (viewParam->IpProto == IP_PROTO_TCP)
+  {
+    return "TCP";
+  }
+  else if (viewParam->IpProto == IP_PROTO_UDP)
+  {
+    return "UDP";
+  }
+  else if (viewParam->IpProto == IP_PROTO_ICMP)
+  {
+    return "ICMP";
+  }
+
+  return "Unknown";
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * Minimal platform glue for the modules in Common/.
+ *
+ * The tools themselves are Windows programs, but the shared modules
+ * also build on Linux (capture/transmit backends, benchmarks). Only the
+ * few Win32 names these modules rely on are mapped here.
+ *
+ */
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef int BOOL;
+typedef unsigned char BOOLEAN;
+typedef unsigned long DWORD;
+typedef void *LPVOID;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define ZeroMemory(dst, len) memset((dst), 0, (len))
+#define CopyMemory(dst, src, len) memcpy((dst), (src), (len))
+#define Sleep(ms) usleep((ms) * 1000)
+
+#define HEAP_ZERO_MEMORY 0x00000008
+#define GetProcessHeap() NULL
+#define HeapAlloc(heap, flags, size) calloc(1, (size))
+
+static inline BOOL HeapFree(void *heapParam, DWORD flagsParam, void *memParam)
+{
+  free(memParam);
+  return TRUE;
+}
+
+#define _snprintf snprintf
+
+#endif
+
+
+// Count heap allocations for the replay benchmark, see Benchmark.h
+#ifdef BENCHMARK_COUNT_ALLOCS
+void *BenchmarkHeapAlloc(void *heapParam, DWORD flagsParam, size_t sizeParam);
+
+#undef HeapAlloc
+#define HeapAlloc(heap, flags, size) BenchmarkHeapAlloc((heap), (flags), (size))
+#endif
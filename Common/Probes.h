@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+ * USDT tracepoints on the packet paths.
+ *
+ * On Linux, if <sys/sdt.h> (systemtap-sdt-dev) is found at build
+ * time, every PROBE_*() below becomes a static probe of provider
+ * "minary". A probe is a single nop plus an ELF note describing
+ * where its arguments live. Nothing is evaluated or called while
+ * no tracer is attached, so the arguments must be values the code
+ * has at hand anyway. Everywhere else (Windows, no sdt.h, or
+ * PROBES_DISABLE defined) the macros compile to nothing.
+ *
+ * List the probes of a binary:
+ *   readelf -n RouterIPv4 | grep -A3 stapsdt
+ *
+ * Time from capture to the verdict, per verdict:
+ *   bpftrace -e 'usdt:./RouterIPv4:minary:packet_received { @s[arg0] = nsecs; }
+ *                usdt:./RouterIPv4:minary:firewall_verdict /@s[arg0]/ { @verdict[arg1] = hist(nsecs - @s[arg0]); delete(@s[arg0]); }'
+ *
+ * The first argument of the per packet probes is the frame's
+ * address, it ties the probes of one packet together. RouterIPv4's
+ * forwarding workers get a copy of the frame, after packet_parsed
+ * the address changes to the copy in the worker's ring.
+ *
+ *  packet_received(frame, length)      frame handed over by the capture layer
+ *  packet_parsed(frame, layers)        headers decoded, PV_LAYER_* bits
+ *  flow_lookup(frame, hit)             flow/connection table lookup, hit is 0/1
+ *  firewall_verdict(frame, verdict)    FLOW_VERDICT_* of the packet
+ *  dns_name(frame, name, matched)      DNS query name extracted, matched is
+ *                                      set if a spoofing rule applies
+ *  output_written(data, length)        Sniffer record written to the output
+ *  packets_transmitted(frames, count)  count frames handed to the backend,
+ *                                      frames is the array of their addresses
+ *
+ */
+#if defined(__linux__) && !defined(PROBES_DISABLE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PROBES_ENABLED
+#endif
+#endif
+
+#ifdef PROBES_ENABLED
+
+#define PROBE_PACKET_RECEIVED(frame, length) DTRACE_PROBE2(minary, packet_received, (frame), (length))
+#define PROBE_PACKET_PARSED(frame, layers) DTRACE_PROBE2(minary, packet_parsed, (frame), (layers))
+#define PROBE_FLOW_LOOKUP(frame, hit) DTRACE_PROBE2(minary, flow_lookup, (frame), (hit))
+#define PROBE_FIREWALL_VERDICT(frame, verdict) DTRACE_PROBE2(minary, firewall_verdict, (frame), (verdict))
+#define PROBE_DNS_NAME(frame, name, matched) DTRACE_PROBE3(minary, dns_name, (frame), (name), (matched))
+#define PROBE_OUTPUT_WRITTEN(data, length) DTRACE_PROBE2(minary, output_written, (data), (length))
+#define PROBE_PACKETS_TRANSMITTED(frames, count) DTRACE_PROBE2(minary, packets_transmitted, (frames), (count))
+
+#else
+
+#define PROBE_PACKET_RECEIVED(frame, length)
+#define PROBE_PACKET_PARSED(frame, layers)
+#define PROBE_FLOW_LOOKUP(frame, hit)
+#define PROBE_FIREWALL_VERDICT(frame, verdict)
+#define PROBE_DNS_NAME(frame, name, matched)
+#define PROBE_OUTPUT_WRITTEN(data, length)
+#define PROBE_PACKETS_TRANSMITTED(frames, count)
+
+#endif
@@ -0,0 +1,358 @@
+/*
+ * Forwarding harness for the AF_XDP capture backend, see
+ * AfXdpVeth.sh. Linux only.
+ *
+ *   AfXdpVeth forward <ifc> <local ip>
+ *     Open <ifc> with CaptureOpenXdp() and send every frame back
+ *     to its sender with CaptureForwardFrame(), rewritten like
+ *     RouterIPv4 does (destination MAC = source MAC, source MAC =
+ *     our MAC). Handles that can't forward in place send a copy.
+ *     Runs until SIGINT/SIGTERM and prints its counters.
+ *
+ *   AfXdpVeth send <ifc> <router mac> <frames>
+ *     Send <frames> numbered UDP frames to <router mac> with
+ *     CaptureSendPacket() and count the ones that come back from
+ *     it. Exits 0 if all came back in order. The handle only
+ *     receives once its dispatch loop runs, a thread sends.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <pcap.h>
+
+#include "PacketCapture.h"
+
+
+/*
+ * Constants
+ *
+ */
+#define HARNESS_FRAME_SIZE   64
+#define HARNESS_MARKER       0x58445054 // "XDPT"
+#define HARNESS_WAIT_SECONDS 5
+#define HARNESS_START_DELAY  200000 // usec
+#define HARNESS_SOURCE_IP    "10.77.0.2"
+#define HARNESS_TARGET_IP    "10.77.0.3"
+
+
+/*
+ * Global variables
+ *
+ */
+static PCAPTURE_HANDLE gCaptureHandle = NULL;
+static unsigned char gLocalMac[6];
+static unsigned char gRouterMac[6];
+static unsigned char gFrame[HARNESS_FRAME_SIZE];
+static uint64_t gForwarded = 0;
+static uint64_t gCopied = 0;
+static uint64_t gFailed = 0;
+static unsigned int gExpected = 0;
+static unsigned int gReceived = 0;
+static unsigned int gNextSequence = 0;
+static unsigned int gOutOfOrder = 0;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+static int Forward(char *interfaceNameParam, char *localIpParam);
+static int Send(char *interfaceNameParam, char *routerMacParam, unsigned int frameCountParam);
+static void ForwardHandler(unsigned char *param, PCAPTURE_BATCH batch);
+static void *SendFrames(void *param);
+static void SendHandler(unsigned char *param, PCAPTURE_BATCH batch);
+static void BreakHandler(int signalParam);
+static BOOL GetInterfaceMac(char *interfaceNameParam, unsigned char macParam[6]);
+static BOOL ParseMac(char *macStrParam, unsigned char macParam[6]);
+
+
+
+int main(int argc, char *argv[])
+{
+  if (argc == 4 &&
+      strcmp(argv[1], "forward") == 0)
+  {
+    return Forward(argv[2], argv[3]);
+  }
+
+  if (argc == 5 &&
+      strcmp(argv[1], "send") == 0)
+  {
+    return Send(argv[2], argv[3], (unsigned int)strtoul(argv[4], NULL, 10));
+  }
+
+  fprintf(stderr, "Usage: %s forward <ifc> <local ip>\n       %s send <ifc> <router mac> <frames>\n", argv[0], argv[0]);
+
+  return 2;
+}
+
+
+
+static int Forward(char *interfaceNameParam, char *localIpParam)
+{
+  char errorBuffer[CAPTURE_ERRBUF_SIZE];
+  unsigned char localIp[4];
+
+  ZeroMemory(errorBuffer, sizeof(errorBuffer));
+
+  if (GetInterfaceMac(interfaceNameParam, gLocalMac) == FALSE ||
+      inet_pton(AF_INET, localIpParam, localIp) != 1)
+  {
+    fprintf(stderr, "forward: Bad interface \"%s\" or IP \"%s\"\n", interfaceNameParam, localIpParam);
+    return 2;
+  }
+
+  if ((gCaptureHandle = CaptureOpenXdp(interfaceNameParam, gLocalMac, localIp, 65536, 100, errorBuffer)) == NULL)
+  {
+    printf("forward: refused: %s\n", errorBuffer);
+    return 1;
+  }
+
+  if (errorBuffer[0] != '\0')
+  {
+    printf("forward: warning: %s\n", errorBuffer);
+  }
+
+  printf("forward: backend %s\n", CaptureGetBackendName(gCaptureHandle));
+  fflush(stdout);
+
+  signal(SIGINT, BreakHandler);
+  signal(SIGTERM, BreakHandler);
+
+  if (CaptureDispatchLoop(gCaptureHandle, ForwardHandler, NULL) == CAPTURE_ERROR)
+  {
+    printf("forward: %s\n", CaptureGetError(gCaptureHandle));
+  }
+
+  printf("forward: %llu in place, %llu copied, %llu failed\n", (unsigned long long)gForwarded, (unsigned long long)gCopied, (unsigned long long)gFailed);
+  CaptureClose(gCaptureHandle);
+
+  return 0;
+}
+
+
+static int Send(char *interfaceNameParam, char *routerMacParam, unsigned int frameCountParam)
+{
+  char errorBuffer[CAPTURE_ERRBUF_SIZE];
+  unsigned char *frame = gFrame;
+  uint32_t marker = htonl(HARNESS_MARKER);
+  pthread_t sendThread;
+
+  ZeroMemory(errorBuffer, sizeof(errorBuffer));
+  ZeroMemory(gFrame, sizeof(gFrame));
+
+  if (GetInterfaceMac(interfaceNameParam, gLocalMac) == FALSE ||
+      ParseMac(routerMacParam, gRouterMac) == FALSE)
+  {
+    fprintf(stderr, "send: Bad interface \"%s\" or MAC \"%s\"\n", interfaceNameParam, routerMacParam);
+    return 2;
+  }
+
+  if ((gCaptureHandle = CaptureOpen(interfaceNameParam, 65536, CAPTURE_FLAG_PROMISCUOUS | CAPTURE_FLAG_NOCAPTURE_LOCAL, 100, errorBuffer)) == NULL)
+  {
+    printf("send: %s\n", errorBuffer);
+    return 1;
+  }
+
+  // Ethernet, IPv4 (no checksum, nobody routes it), UDP 9/9
+  CopyMemory(frame, gRouterMac, 6);
+  CopyMemory(frame + 6, gLocalMac, 6);
+  frame[12] = 0x08;
+  frame[14] = 0x45;
+  frame[17] = HARNESS_FRAME_SIZE - 14;
+  frame[22] = 64;
+  frame[23] = 17;
+  inet_pton(AF_INET, HARNESS_SOURCE_IP, frame + 26);
+  inet_pton(AF_INET, HARNESS_TARGET_IP, frame + 30);
+  frame[35] = 9;
+  frame[37] = 9;
+  frame[39] = HARNESS_FRAME_SIZE - 34;
+  CopyMemory(frame + 42, &marker, 4);
+
+  gExpected = frameCountParam;
+
+  if (pthread_create(&sendThread, NULL, SendFrames, NULL) != 0)
+  {
+    printf("send: Unable to start the send thread\n");
+    CaptureClose(gCaptureHandle);
+    return 1;
+  }
+
+  signal(SIGALRM, BreakHandler);
+  alarm(HARNESS_WAIT_SECONDS);
+  CaptureDispatchLoop(gCaptureHandle, SendHandler, NULL);
+  pthread_join(sendThread, NULL);
+  CaptureClose(gCaptureHandle);
+
+  printf("send: %u of %u frames came back, %u out of order\n", gReceived, frameCountParam, gOutOfOrder);
+
+  return gReceived == frameCountParam && gOutOfOrder == 0 ? 0 : 1;
+}
+
+
+static void *SendFrames(void *param)
+{
+  uint32_t sequence = 0;
+  unsigned int counter = 0;
+
+  usleep(HARNESS_START_DELAY);
+
+  for (counter = 0; counter < gExpected; counter++)
+  {
+    sequence = htonl(counter);
+    CopyMemory(gFrame + 46, &sequence, 4);
+
+    if (CaptureSendPacket(gCaptureHandle, gFrame, sizeof(gFrame)) != 0)
+    {
+      printf("send: %s\n", CaptureGetError(gCaptureHandle));
+      break;
+    }
+
+    // Stay below the veth backlog
+    if (counter % 64 == 63)
+    {
+      usleep(1000);
+    }
+  }
+
+  return NULL;
+}
+
+
+static void ForwardHandler(unsigned char *param, PCAPTURE_BATCH batch)
+{
+  unsigned char *frame = NULL;
+  unsigned int frameLength = 0;
+  int counter = 0;
+
+  for (counter = 0; counter < batch->FrameCount; counter++)
+  {
+    frame = batch->Frames[counter];
+    frameLength = batch->Headers[counter]->caplen;
+
+    CopyMemory(frame, frame + 6, 6);
+    CopyMemory(frame + 6, gLocalMac, 6);
+
+    if (CaptureCanForwardInPlace(gCaptureHandle) == TRUE &&
+        CaptureForwardFrame(gCaptureHandle, frame, frameLength) == 0)
+    {
+      gForwarded++;
+    }
+    else if (CaptureSendPacket(gCaptureHandle, frame, frameLength) == 0)
+    {
+      gCopied++;
+    }
+    else
+    {
+      gFailed++;
+    }
+  }
+}
+
+
+static void SendHandler(unsigned char *param, PCAPTURE_BATCH batch)
+{
+  unsigned char *frame = NULL;
+  uint32_t marker = 0;
+  uint32_t sequence = 0;
+  int counter = 0;
+
+  for (counter = 0; counter < batch->FrameCount; counter++)
+  {
+    frame = batch->Frames[counter];
+
+    if (batch->Headers[counter]->caplen < 50)
+    {
+      continue;
+    }
+
+    CopyMemory(&marker, frame + 42, 4);
+    CopyMemory(&sequence, frame + 46, 4);
+
+    if (memcmp(frame, gLocalMac, 6) != 0 ||
+        memcmp(frame + 6, gRouterMac, 6) != 0 ||
+        ntohl(marker) != HARNESS_MARKER)
+    {
+      continue;
+    }
+
+    if (ntohl(sequence) < gNextSequence)
+    {
+      gOutOfOrder++;
+    }
+
+    gNextSequence = ntohl(sequence) + 1;
+    gReceived++;
+  }
+
+  if (gReceived >= gExpected)
+  {
+    CaptureBreakLoop(gCaptureHandle);
+  }
+}
+
+
+static void BreakHandler(int signalParam)
+{
+  CaptureBreakLoop(gCaptureHandle);
+}
+
+
+static BOOL GetInterfaceMac(char *interfaceNameParam, unsigned char macParam[6])
+{
+  BOOL retVal = FALSE;
+  int controlSocket = -1;
+  struct ifreq interfaceRequest;
+
+  if ((controlSocket = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+  {
+    goto END;
+  }
+
+  ZeroMemory(&interfaceRequest, sizeof(interfaceRequest));
+  strncpy(interfaceRequest.ifr_name, interfaceNameParam, sizeof(interfaceRequest.ifr_name) - 1);
+
+  if (ioctl(controlSocket, SIOCGIFHWADDR, &interfaceRequest) < 0)
+  {
+    goto END;
+  }
+
+  CopyMemory(macParam, interfaceRequest.ifr_hwaddr.sa_data, 6);
+  retVal = TRUE;
+
+END:
+
+  if (controlSocket >= 0)
+  {
+    close(controlSocket);
+  }
+
+  return retVal;
+}
+
+
+static BOOL ParseMac(char *macStrParam, unsigned char macParam[6])
+{
+  unsigned int bytes[6];
+  int counter = 0;
+
+  if (sscanf(macStrParam, "%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6)
+  {
+    return FALSE;
+  }
+
+  for (counter = 0; counter < 6; counter++)
+  {
+    macParam[counter] = (unsigned char)bytes[counter];
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,113 @@
+#!/bin/sh
+#
+# Forwarding test of the AF_XDP capture backend on a veth pair.
+#
+# Usage: AfXdpVeth.sh path/to/AfXdpVeth [frames]
+#
+# Build the harness with
+#
+#   cc -O2 -I.. -o AfXdpVeth AfXdpVeth.c ../PacketCapture.c -lpcap -lpthread
+#
+# Needs root and iproute2. Two network namespaces are connected by
+# a veth pair:
+#
+#   xdpa: a0 10.77.0.2  --  xdpr: r0 10.77.0.1 (AfXdpVeth forward)
+#
+# The harness in xdpa sends numbered frames for 10.77.0.3 to r0's MAC,
+# the one in xdpr opens r0 with CaptureOpenXdp() and sends them back
+# rewritten, with CaptureForwardFrame() on AF_XDP. The kernel of xdpr
+# doesn't forward, so every frame counted went through the harness.
+#
+# Generic XDP and copy mode are allowed (CAPTURE_AFXDP_COPY), veth
+# has no zero-copy support. The script also checks that an MTU above
+# the UMEM chunk size is refused and that an interface with several
+# receive queues falls back to TPACKET_V3 with a warning.
+#
+
+HARNESS=$1
+FRAMES=${2:-1000}
+WORKDIR=$(mktemp -d)
+
+if [ -z "$HARNESS" ] || [ ! -x "$HARNESS" ]; then
+  echo "Usage: $0 path/to/AfXdpVeth [frames]"
+  exit 2
+fi
+
+HARNESS=$(cd "$(dirname "$HARNESS")" && pwd)/$(basename "$HARNESS")
+
+
+cleanup()
+{
+  [ -n "$FORWARD_PID" ] && kill "$FORWARD_PID" 2>/dev/null
+  ip netns del xdpa 2>/dev/null
+  ip netns del xdpr 2>/dev/null
+  rm -rf "$WORKDIR"
+}
+
+trap cleanup EXIT INT TERM
+
+
+fail()
+{
+  echo "FAIL: $1"
+  cat "$WORKDIR/forward.log" "$WORKDIR/send.log" 2>/dev/null
+  exit 1
+}
+
+
+# Create the veth pair with the given receive queue count per end
+setup()
+{
+  ip netns del xdpa 2>/dev/null
+  ip netns del xdpr 2>/dev/null
+  ip netns add xdpa
+  ip netns add xdpr
+  ip link add a0 netns xdpa numrxqueues "$1" numtxqueues "$1" type veth peer name r0 netns xdpr numrxqueues "$1" numtxqueues "$1"
+  ip -n xdpa addr add 10.77.0.2/24 dev a0
+  ip -n xdpr addr add 10.77.0.1/24 dev r0
+  ip -n xdpa link set a0 up
+  ip -n xdpr link set r0 up
+  ip netns exec xdpr sysctl -qw net.ipv4.ip_forward=0
+
+  R0_MAC=$(ip netns exec xdpr cat /sys/class/net/r0/address)
+  rm -f "$WORKDIR/forward.log" "$WORKDIR/send.log"
+}
+
+
+# Forward on r0 and send from a0, all frames have to come back
+run()
+{
+  CAPTURE_AFXDP_COPY=1 ip netns exec xdpr "$HARNESS" forward r0 10.77.0.1 > "$WORKDIR/forward.log" 2>&1 &
+  FORWARD_PID=$!
+  sleep 1
+
+  ip netns exec xdpa "$HARNESS" send a0 "$R0_MAC" "$FRAMES" > "$WORKDIR/send.log" 2>&1
+  SENT=$?
+
+  kill -INT "$FORWARD_PID" 2>/dev/null
+  wait "$FORWARD_PID" 2>/dev/null
+  FORWARD_PID=
+
+  cat "$WORKDIR/forward.log" "$WORKDIR/send.log"
+  [ "$SENT" -eq 0 ] || fail "$1"
+  grep -q "backend $2" "$WORKDIR/forward.log" || fail "$1"
+  echo "PASS: $1"
+}
+
+
+setup 1
+ip -n xdpr link set r0 mtu 3000
+ip netns exec xdpr "$HARNESS" forward r0 10.77.0.1 > "$WORKDIR/forward.log" 2>&1
+grep -q "refused:.*MTU" "$WORKDIR/forward.log" || fail "an MTU of 3000 is refused"
+cat "$WORKDIR/forward.log"
+echo "PASS: an MTU of 3000 is refused"
+
+setup 2
+run "two receive queues fall back to TPACKET_V3" "TPACKET_V3"
+grep -q "warning:.*2 receive queues" "$WORKDIR/forward.log" || fail "no warning for two receive queues"
+
+setup 1
+run "$FRAMES frames forwarded in place" "AF_XDP"
+grep -q "^forward: $FRAMES in place" "$WORKDIR/forward.log" || fail "frames were not forwarded in place"
+
+exit 0
@@ -0,0 +1,299 @@
+#include <string.h>
+
+#include "TimerWheel.h"
+
+
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+
+struct TIMER_WHEEL
+{
+  uint64_t Now;
+  int Count;
+  TIMER_WHEEL_TIMER Slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];   // List heads
+};
+
+
+static void TimerWheelInsert(PTIMER_WHEEL timerWheelParam, PTIMER_WHEEL_TIMER timerParam);
+static void TimerWheelListInit(PTIMER_WHEEL_TIMER headParam);
+static void TimerWheelListAppend(PTIMER_WHEEL_TIMER headParam, PTIMER_WHEEL_TIMER timerParam);
+static void TimerWheelListUnlink(PTIMER_WHEEL_TIMER timerParam);
+static void TimerWheelListMove(PTIMER_WHEEL_TIMER fromParam, PTIMER_WHEEL_TIMER toParam);
+
+
+PTIMER_WHEEL TimerWheelCreate(uint64_t nowParam)
+{
+  PTIMER_WHEEL timerWheel = NULL;
+  int level = 0;
+  int slot = 0;
+
+  if ((timerWheel = (PTIMER_WHEEL)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TIMER_WHEEL))) == NULL)
+  {
+    return NULL;
+  }
+
+  for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+  {
+    for (slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+    {
+      TimerWheelListInit(&timerWheel->Slots[level][slot]);
+    }
+  }
+
+  timerWheel->Now = nowParam;
+
+  return timerWheel;
+}
+
+
+/*
+ * Pending timers are left alone, their
+ * owners free them
+ *
+ */
+void TimerWheelDestroy(PTIMER_WHEEL timerWheelParam)
+{
+  if (timerWheelParam == NULL)
+  {
+    return;
+  }
+
+  HeapFree(GetProcessHeap(), 0, timerWheelParam);
+}
+
+
+/*
+ * (Re)schedule the timer to fire once the clock reaches
+ * expiresParam. A time already passed fires on the next tick.
+ *
+ */
+void TimerWheelSchedule(PTIMER_WHEEL timerWheelParam, PTIMER_WHEEL_TIMER timerParam, uint64_t expiresParam)
+{
+  if (timerWheelParam == NULL ||
+      timerParam == NULL)
+  {
+    return;
+  }
+
+  if (TimerWheelPending(timerParam) == TRUE)
+  {
+    TimerWheelListUnlink(timerParam);
+    timerWheelParam->Count--;
+  }
+
+  if (expiresParam <= timerWheelParam->Now)
+  {
+    expiresParam = timerWheelParam->Now + 1;
+  }
+  else if (expiresParam - timerWheelParam->Now >= TIMER_WHEEL_RANGE)
+  {
+    expiresParam = timerWheelParam->Now + TIMER_WHEEL_RANGE - 1;
+  }
+
+  timerParam->Expires = expiresParam;
+  TimerWheelInsert(timerWheelParam, timerParam);
+  timerWheelParam->Count++;
+}
+
+
+void TimerWheelCancel(PTIMER_WHEEL timerWheelParam, PTIMER_WHEEL_TIMER timerParam)
+{
+  if (timerWheelParam == NULL ||
+      timerParam == NULL ||
+      TimerWheelPending(timerParam) == FALSE)
+  {
+    return;
+  }
+
+  TimerWheelListUnlink(timerParam);
+  timerWheelParam->Count--;
+}
+
+
+BOOL TimerWheelPending(PTIMER_WHEEL_TIMER timerParam)
+{
+  return timerParam != NULL && timerParam->Next != NULL ? TRUE : FALSE;
+}
+
+
+/*
+ * Move the clock to nowParam and call handlerParam for every timer
+ * that expired on the way, in tick order. A jump of TIMER_WHEEL_RANGE
+ * ticks or more expires all timers at once, in no particular order.
+ * Returns the number of timers fired.
+ *
+ */
+int TimerWheelAdvance(PTIMER_WHEEL timerWheelParam, uint64_t nowParam, TIMER_WHEEL_HANDLER handlerParam, void *contextParam)
+{
+  TIMER_WHEEL_TIMER expired;
+  TIMER_WHEEL_TIMER cascade;
+  PTIMER_WHEEL_TIMER timer = NULL;
+  uint64_t index = 0;
+  int fired = 0;
+  int level = 0;
+
+  if (timerWheelParam == NULL)
+  {
+    return 0;
+  }
+
+  TimerWheelListInit(&expired);
+  TimerWheelListInit(&cascade);
+
+  if (nowParam > timerWheelParam->Now &&
+      nowParam - timerWheelParam->Now >= TIMER_WHEEL_RANGE)
+  {
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+      for (index = 0; index < TIMER_WHEEL_SLOTS; index++)
+      {
+        TimerWheelListMove(&timerWheelParam->Slots[level][index], &expired);
+      }
+    }
+
+    timerWheelParam->Now = nowParam;
+  }
+
+  while ((timer = expired.Next) != &expired)
+  {
+    TimerWheelListUnlink(timer);
+    timerWheelParam->Count--;
+    fired++;
+
+    if (handlerParam != NULL)
+    {
+      handlerParam(contextParam, timer);
+    }
+  }
+
+  while (timerWheelParam->Now < nowParam)
+  {
+    // Nothing to fire on the way, jump
+    if (timerWheelParam->Count == 0)
+    {
+      timerWheelParam->Now = nowParam;
+      break;
+    }
+
+    timerWheelParam->Now++;
+
+    // The finer wheel wrapped, spread the next slot of the
+    // coarser one over it, and so on upwards
+    for (level = 1; level < TIMER_WHEEL_LEVELS; level++)
+    {
+      if (((timerWheelParam->Now >> ((level - 1) * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK) != 0)
+      {
+        break;
+      }
+
+      index = (timerWheelParam->Now >> (level * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK;
+      TimerWheelListMove(&timerWheelParam->Slots[level][index], &cascade);
+
+      while ((timer = cascade.Next) != &cascade)
+      {
+        TimerWheelListUnlink(timer);
+        TimerWheelInsert(timerWheelParam, timer);
+      }
+    }
+
+    // Handlers may schedule and cancel timers, including
+    // the ones still on the expired list
+    TimerWheelListMove(&timerWheelParam->Slots[0][timerWheelParam->Now & TIMER_WHEEL_SLOT_MASK], &expired);
+
+    while ((timer = expired.Next) != &expired)
+    {
+      TimerWheelListUnlink(timer);
+      timerWheelParam->Count--;
+      fired++;
+
+      if (handlerParam != NULL)
+      {
+        handlerParam(contextParam, timer);
+      }
+    }
+  }
+
+  return fired;
+}
+
+
+uint64_t TimerWheelNow(PTIMER_WHEEL timerWheelParam)
+{
+  return timerWheelParam != NULL ? timerWheelParam->Now : 0;
+}
+
+
+int TimerWheelCount(PTIMER_WHEEL timerWheelParam)
+{
+  return timerWheelParam != NULL ? timerWheelParam->Count : 0;
+}
+
+
+
+/*
+ * The finest wheel the timer fits in. A timer of a coarser wheel
+ * sits in the slot its expiry time falls into, it moves down when
+ * the finer wheel wraps into that slot.
+ *
+ */
+static void TimerWheelInsert(PTIMER_WHEEL timerWheelParam, PTIMER_WHEEL_TIMER timerParam)
+{
+  uint64_t delta = timerParam->Expires > timerWheelParam->Now ? timerParam->Expires - timerWheelParam->Now : 0;
+  uint64_t index = 0;
+  int level = 0;
+
+  for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++)
+  {
+    if (delta < (1ULL << ((level + 1) * TIMER_WHEEL_SLOT_BITS)))
+    {
+      break;
+    }
+  }
+
+  index = (timerParam->Expires >> (level * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK;
+  TimerWheelListAppend(&timerWheelParam->Slots[level][index], timerParam);
+}
+
+
+static void TimerWheelListInit(PTIMER_WHEEL_TIMER headParam)
+{
+  headParam->Next = headParam;
+  headParam->Prev = headParam;
+}
+
+
+static void TimerWheelListAppend(PTIMER_WHEEL_TIMER headParam, PTIMER_WHEEL_TIMER timerParam)
+{
+  timerParam->Prev = headParam->Prev;
+  timerParam->Next = headParam;
+  headParam->Prev->Next = timerParam;
+  headParam->Prev = timerParam;
+}
+
+
+static void TimerWheelListUnlink(PTIMER_WHEEL_TIMER timerParam)
+{
+  timerParam->Prev->Next = timerParam->Next;
+  timerParam->Next->Prev = timerParam->Prev;
+  timerParam->Next = NULL;
+  timerParam->Prev = NULL;
+}
+
+
+/*
+ * Append all timers of fromParam to toParam
+ *
+ */
+static void TimerWheelListMove(PTIMER_WHEEL_TIMER fromParam, PTIMER_WHEEL_TIMER toParam)
+{
+  if (fromParam->Next == fromParam)
+  {
+    return;
+  }
+
+  fromParam->Next->Prev = toParam->Prev;
+  fromParam->Prev->Next = toParam;
+  toParam->Prev->Next = fromParam->Next;
+  toParam->Prev = fromParam->Prev;
+  TimerWheelListInit(fromParam);
+}
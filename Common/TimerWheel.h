@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hierarchical timer wheel
+ *
+ * TIMER_WHEEL_LEVELS wheels of TIMER_WHEEL_SLOTS slots each. A timer
+ * due within TIMER_WHEEL_SLOTS ticks sits in the first wheel, one due
+ * later in the slot of a coarser wheel. Whenever the first wheel
+ * wraps, the next slot of the coarser wheel is spread over the finer
+ * one. Scheduling, cancelling and firing a timer are O(1), advancing
+ * the clock by one tick touches one slot.
+ *
+ * Timers are embedded in the caller's objects, the wheel allocates
+ * nothing per timer. A zeroed TIMER_WHEEL_TIMER is not pending.
+ *
+ * Ticks are whatever unit the caller counts in. Timers further out
+ * than TIMER_WHEEL_RANGE ticks fire after TIMER_WHEEL_RANGE ticks.
+ * The clock never goes backwards, an older time leaves it unchanged.
+ *
+ * Not thread safe, the owner serializes all calls.
+ *
+ */
+
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_RANGE (1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS))
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct TIMER_WHEEL_TIMER
+{
+  struct TIMER_WHEEL_TIMER *Next;
+  struct TIMER_WHEEL_TIMER *Prev;
+  uint64_t Expires;
+} TIMER_WHEEL_TIMER, *PTIMER_WHEEL_TIMER;
+
+
+// Called for every expired timer. The timer is no longer pending,
+// the handler may schedule it again or free the object around it.
+typedef void(*TIMER_WHEEL_HANDLER)(void *contextParam, PTIMER_WHEEL_TIMER timerParam);
+
+
+// Opaque, see TimerWheel.c
+typedef struct TIMER_WHEEL TIMER_WHEEL, *PTIMER_WHEEL;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+PTIMER_WHEEL TimerWheelCreate(uint64_t nowParam);
+void TimerWheelDestroy(PTIMER_WHEEL timerWheelParam);
+void TimerWheelSchedule(PTIMER_WHEEL timerWheelParam, PTIMER_WHEEL_TIMER timerParam, uint64_t expiresParam);
+void TimerWheelCancel(PTIMER_WHEEL timerWheelParam, PTIMER_WHEEL_TIMER timerParam);
+BOOL TimerWheelPending(PTIMER_WHEEL_TIMER timerParam);
+int TimerWheelAdvance(PTIMER_WHEEL timerWheelParam, uint64_t nowParam, TIMER_WHEEL_HANDLER handlerParam, void *contextParam);
+uint64_t TimerWheelNow(PTIMER_WHEEL timerWheelParam);
+int TimerWheelCount(PTIMER_WHEEL timerWheelParam);
+
+#ifdef __cplusplus
+}
+#endif
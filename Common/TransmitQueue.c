@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Probes.h"
+#include "TransmitQueue.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+
+struct TRANSMIT_QUEUE
+{
+  PCAPTURE_HANDLE CaptureHandle;
+  int MaxFrames;
+  uint64_t MaxDelayUs;
+  uint64_t FirstQueuedAt;
+  int FrameCount;
+  unsigned int BufferUsed;
+  unsigned char *Buffer;
+  unsigned char *Frames[TRANSMIT_QUEUE_MAX_FRAMES];
+  unsigned int Lengths[TRANSMIT_QUEUE_MAX_FRAMES];
+  uint64_t CaptureTimes[TRANSMIT_QUEUE_MAX_FRAMES];
+  unsigned char Classes[TRANSMIT_QUEUE_MAX_FRAMES];
+  uint64_t OriginCaptureTime;
+  unsigned char OriginClass;
+  TRANSMIT_ERROR_HANDLER ErrorHandler;
+  void *ErrorContext;
+  TRANSMIT_SENT_HANDLER SentHandler;
+  void *SentContext;
+  TRANSMIT_QUEUE_STATS Stats;
+};
+
+
+static uint64_t TransmitQueueNow();
+
+
+/*
+ * Queue for frames sent on captureHandle. maxFramesParam is
+ * clamped to 1..TRANSMIT_QUEUE_MAX_FRAMES. With maxDelayUsParam
+ * 0 the queue only flushes when it is full or when asked to.
+ * The capture handle stays owned by the caller.
+ *
+ */
+PTRANSMIT_QUEUE TransmitQueueCreate(PCAPTURE_HANDLE captureHandle, int maxFramesParam, int maxDelayUsParam)
+{
+  PTRANSMIT_QUEUE transmitQueue = NULL;
+
+  if (captureHandle == NULL)
+  {
+    return NULL;
+  }
+
+  if ((transmitQueue = (PTRANSMIT_QUEUE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TRANSMIT_QUEUE))) == NULL)
+  {
+    return NULL;
+  }
+
+  if ((transmitQueue->Buffer = (unsigned char *)HeapAlloc(GetProcessHeap(), 0, TRANSMIT_QUEUE_BUFFER_SIZE)) == NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, transmitQueue);
+    return NULL;
+  }
+
+  if (maxFramesParam < 1)
+  {
+    maxFramesParam = 1;
+  }
+  else if (maxFramesParam > TRANSMIT_QUEUE_MAX_FRAMES)
+  {
+    maxFramesParam = TRANSMIT_QUEUE_MAX_FRAMES;
+  }
+
+  transmitQueue->CaptureHandle = captureHandle;
+  transmitQueue->MaxFrames = maxFramesParam;
+  transmitQueue->MaxDelayUs = maxDelayUsParam > 0 ? (uint64_t)maxDelayUsParam : 0;
+
+  return transmitQueue;
+}
+
+
+void TransmitQueueSetErrorHandler(PTRANSMIT_QUEUE transmitQueue, TRANSMIT_ERROR_HANDLER handlerParam, void *contextParam)
+{
+  if (transmitQueue == NULL)
+  {
+    return;
+  }
+
+  transmitQueue->ErrorHandler = handlerParam;
+  transmitQueue->ErrorContext = contextParam;
+}
+
+
+void TransmitQueueSetSentHandler(PTRANSMIT_QUEUE transmitQueue, TRANSMIT_SENT_HANDLER handlerParam, void *contextParam)
+{
+  if (transmitQueue == NULL)
+  {
+    return;
+  }
+
+  transmitQueue->SentHandler = handlerParam;
+  transmitQueue->SentContext = contextParam;
+}
+
+
+/*
+ * Origin of the frames queued from now on. A capture
+ * time of 0 means unknown.
+ *
+ */
+void TransmitQueueSetOrigin(PTRANSMIT_QUEUE transmitQueue, uint64_t captureTimeUsParam, unsigned char classParam)
+{
+  if (transmitQueue == NULL)
+  {
+    return;
+  }
+
+  transmitQueue->OriginCaptureTime = captureTimeUsParam;
+  transmitQueue->OriginClass = classParam;
+}
+
+
+/*
+ * Copy the frame into the queue. Returns FALSE only if the
+ * frame can't be queued at all. Transmit errors show up
+ * later in the statistics and the error handler.
+ *
+ */
+BOOL TransmitQueueAdd(PTRANSMIT_QUEUE transmitQueue, unsigned char *dataParam, unsigned int dataLengthParam)
+{
+  uint64_t now = 0;
+
+  if (transmitQueue == NULL ||
+      dataParam == NULL ||
+      dataLengthParam == 0 ||
+      dataLengthParam > TRANSMIT_QUEUE_MAX_FRAME_SIZE)
+  {
+    return FALSE;
+  }
+
+  // No room left in the buffer
+  if (dataLengthParam > TRANSMIT_QUEUE_BUFFER_SIZE - transmitQueue->BufferUsed)
+  {
+    TransmitQueueFlush(transmitQueue);
+  }
+
+  if (transmitQueue->MaxDelayUs > 0)
+  {
+    now = TransmitQueueNow();
+
+    if (transmitQueue->FrameCount == 0)
+    {
+      transmitQueue->FirstQueuedAt = now;
+    }
+  }
+
+  transmitQueue->Frames[transmitQueue->FrameCount] = transmitQueue->Buffer + transmitQueue->BufferUsed;
+  transmitQueue->Lengths[transmitQueue->FrameCount] = dataLengthParam;
+  transmitQueue->CaptureTimes[transmitQueue->FrameCount] = transmitQueue->OriginCaptureTime;
+  transmitQueue->Classes[transmitQueue->FrameCount] = transmitQueue->OriginClass;
+  CopyMemory(transmitQueue->Buffer + transmitQueue->BufferUsed, dataParam, dataLengthParam);
+  transmitQueue->BufferUsed += dataLengthParam;
+  transmitQueue->FrameCount++;
+  transmitQueue->Stats.Queued++;
+
+  if (transmitQueue->FrameCount >= transmitQueue->MaxFrames ||
+      (transmitQueue->MaxDelayUs > 0 && now - transmitQueue->FirstQueuedAt >= transmitQueue->MaxDelayUs))
+  {
+    TransmitQueueFlush(transmitQueue);
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * Send everything queued. Frames the backend refuses are
+ * retried from the first unsent one. Returns the number of
+ * frames sent.
+ *
+ */
+int TransmitQueueFlush(PTRANSMIT_QUEUE transmitQueue)
+{
+  int sentFrames = 0;
+  int failedFrames = 0;
+  int funcRetVal = 0;
+  int tries = 0;
+
+  if (transmitQueue == NULL ||
+      transmitQueue->FrameCount == 0)
+  {
+    return 0;
+  }
+
+  while (sentFrames < transmitQueue->FrameCount &&
+         tries < TRANSMIT_QUEUE_MAX_RETRIES)
+  {
+    funcRetVal = CaptureSendBatch(transmitQueue->CaptureHandle, &transmitQueue->Frames[sentFrames], &transmitQueue->Lengths[sentFrames], transmitQueue->FrameCount - sentFrames);
+
+    if (funcRetVal > 0)
+    {
+      sentFrames += funcRetVal;
+    }
+
+    if (sentFrames < transmitQueue->FrameCount)
+    {
+      tries++;
+      transmitQueue->Stats.Retries++;
+    }
+  }
+
+  PROBE_PACKETS_TRANSMITTED(transmitQueue->Frames, sentFrames);
+
+  failedFrames = transmitQueue->FrameCount - sentFrames;
+  transmitQueue->Stats.Sent += sentFrames;
+  transmitQueue->Stats.Failed += failedFrames;
+  transmitQueue->Stats.Batches++;
+
+  transmitQueue->FrameCount = 0;
+  transmitQueue->BufferUsed = 0;
+
+  // The backend sends in order, the first sentFrames are out
+  if (sentFrames > 0 &&
+      transmitQueue->SentHandler != NULL)
+  {
+    transmitQueue->SentHandler(transmitQueue->SentContext, transmitQueue->CaptureTimes, transmitQueue->Classes, sentFrames);
+  }
+
+  if (failedFrames > 0 &&
+      transmitQueue->ErrorHandler != NULL)
+  {
+    transmitQueue->ErrorHandler(transmitQueue->ErrorContext, (unsigned int)failedFrames, CaptureGetError(transmitQueue->CaptureHandle));
+  }
+
+  return sentFrames;
+}
+
+
+void TransmitQueueGetStats(PTRANSMIT_QUEUE transmitQueue, PTRANSMIT_QUEUE_STATS statsParam)
+{
+  if (statsParam == NULL)
+  {
+    return;
+  }
+
+  if (transmitQueue == NULL)
+  {
+    ZeroMemory(statsParam, sizeof(TRANSMIT_QUEUE_STATS));
+    return;
+  }
+
+  CopyMemory(statsParam, &transmitQueue->Stats, sizeof(TRANSMIT_QUEUE_STATS));
+}
+
+
+PCAPTURE_HANDLE TransmitQueueGetHandle(PTRANSMIT_QUEUE transmitQueue)
+{
+  return transmitQueue != NULL ? transmitQueue->CaptureHandle : NULL;
+}
+
+
+/*
+ * Flush and free the queue. The capture handle
+ * is not closed.
+ *
+ */
+void TransmitQueueDestroy(PTRANSMIT_QUEUE transmitQueue)
+{
+  if (transmitQueue == NULL)
+  {
+    return;
+  }
+
+  TransmitQueueFlush(transmitQueue);
+
+  HeapFree(GetProcessHeap(), 0, transmitQueue->Buffer);
+  HeapFree(GetProcessHeap(), 0, transmitQueue);
+}
+
+
+
+/*
+ * Monotonic clock in microseconds
+ *
+ */
+static uint64_t TransmitQueueNow()
+{
+#ifdef _WIN32
+  static LARGE_INTEGER frequency = { 0 };
+  LARGE_INTEGER counter;
+
+  if (frequency.QuadPart == 0)
+  {
+    QueryPerformanceFrequency(&frequency);
+  }
+
+  QueryPerformanceCounter(&counter);
+
+  return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000ULL +
+         (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000ULL / (uint64_t)frequency.QuadPart;
+#else
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000;
+#endif
+}
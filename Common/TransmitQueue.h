@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Platform.h"
+#include "PacketCapture.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Batched transmit path shared by all tools that inject frames.
+ *
+ * TransmitQueueAdd() copies the frame into the queue's buffer and
+ * returns. The queued frames go out with one CaptureSendBatch()
+ * call once maxFrames are queued, the oldest frame waited maxDelayUs
+ * or the owner calls TransmitQueueFlush(), e.g. on an empty capture
+ * batch. Frames that still fail after TRANSMIT_QUEUE_MAX_RETRIES
+ * attempts are counted and reported to the error handler from the
+ * flushing thread, the caller of TransmitQueueAdd() never waits
+ * for a retry.
+ *
+ * A queue belongs to one thread. It takes no lock.
+ *
+ * Each queued frame carries the origin set last with
+ * TransmitQueueSetOrigin(): the capture timestamp and verdict of
+ * the frame it was derived from. After every flush the sent
+ * handler gets the origins of the frames that went out, e.g. to
+ * measure the forwarding latency.
+ *
+ */
+
+#define TRANSMIT_QUEUE_MAX_FRAMES 256
+#define TRANSMIT_QUEUE_BUFFER_SIZE (256 * 1024)
+#define TRANSMIT_QUEUE_MAX_FRAME_SIZE 65536
+#define TRANSMIT_QUEUE_MAX_RETRIES 4
+
+// Defaults for packet forwarding
+#define TRANSMIT_QUEUE_DEFAULT_FRAMES 64
+#define TRANSMIT_QUEUE_DEFAULT_DELAY 1000   // us
+
+
+/*
+ * Type definitions
+ *
+ */
+
+// Called with the number of frames of one flush that
+// couldn't be sent and the last transmit error.
+typedef void(*TRANSMIT_ERROR_HANDLER)(void *contextParam, unsigned int failedFramesParam, char *errorParam);
+
+// Called with the origins of the frames one flush sent
+typedef void(*TRANSMIT_SENT_HANDLER)(void *contextParam, uint64_t *captureTimesParam, unsigned char *classesParam, int frameCountParam);
+
+typedef struct
+{
+  uint64_t Queued;
+  uint64_t Sent;
+  uint64_t Failed;
+  uint64_t Batches;
+  uint64_t Retries;
+} TRANSMIT_QUEUE_STATS, *PTRANSMIT_QUEUE_STATS;
+
+// Opaque, see TransmitQueue.c
+typedef struct TRANSMIT_QUEUE TRANSMIT_QUEUE, *PTRANSMIT_QUEUE;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+PTRANSMIT_QUEUE TransmitQueueCreate(PCAPTURE_HANDLE captureHandle, int maxFramesParam, int maxDelayUsParam);
+void TransmitQueueSetErrorHandler(PTRANSMIT_QUEUE transmitQueue, TRANSMIT_ERROR_HANDLER handlerParam, void *contextParam);
+void TransmitQueueSetSentHandler(PTRANSMIT_QUEUE transmitQueue, TRANSMIT_SENT_HANDLER handlerParam, void *contextParam);
+void TransmitQueueSetOrigin(PTRANSMIT_QUEUE transmitQueue, uint64_t captureTimeUsParam, unsigned char classParam);
+BOOL TransmitQueueAdd(PTRANSMIT_QUEUE transmitQueue, unsigned char *dataParam, unsigned int dataLengthParam);
+int TransmitQueueFlush(PTRANSMIT_QUEUE transmitQueue);
+void TransmitQueueGetStats(PTRANSMIT_QUEUE transmitQueue, PTRANSMIT_QUEUE_STATS statsParam);
+PCAPTURE_HANDLE TransmitQueueGetHandle(PTRANSMIT_QUEUE transmitQueue);
+void TransmitQueueDestroy(PTRANSMIT_QUEUE transmitQueue);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,18 +1,18 @@
 #include <stdio.h>
 #include <Shlwapi.h>
 
+#include "Config.h"
+#include "HostTable.h"
 #include "LinkedListSpoofedDnsHosts.h"
-#include "LinkedListTargetSystems.h"
 #include "Logging.h"
 #include "NetworkHelperFunctions.h"
 
 
 // External/Global variables
 extern PHOSTNODE gDnsSpoofingList;
-extern PSYSNODE gTargetSystemsList;
 
 
-int ParseTargetHostsConfigFile(char *targetsFile)
+int ParseTargetHostsConfigFile(char *targetsFile, PHOST_TABLE hostTableParam)
 {
   int retVal = 0;
   unsigned char ipStr[MAX_IP_LEN];
@@ -58,7 +58,7 @@ int ParseTargetHostsConfigFile(char *targetsFile)
       MacString2Bin(macBin, macStr, strnlen((char *)macStr, sizeof(macStr) - 1));
       IpString2Bin(ipBin, ipStr, strnlen((char *)ipStr, sizeof(ipStr) - 1));
 
-      AddToSystemsList(&gTargetSystemsList, macBin, (char *)ipStr, ipBin);
+      HostTableAdd(hostTableParam, ipBin, macBin, (char *)ipStr);
       retVal++;
       LogMsg(DBG_MEDIUM, "ParseTargetHostsConfigFile(): New system added :  %s/%s", macStr, ipStr);
     }
@@ -81,6 +81,19 @@ END:
 }
 
 
+void PrintTargetSystems(PHOST_TABLE hostTableParam)
+{
+  HOST_ENTRY host;
+  int counter = 0;
+
+  for (counter = 0; HostTableGetEntry(hostTableParam, counter, &host) == TRUE; counter++)
+  {
+    LogMsg(DBG_DEBUG, "PrintTargetSystems(): Target system: %s / %02x-%02x-%02x-%02x-%02x-%02x", host.IpStr,
+      host.MacBin[0], host.MacBin[1], host.MacBin[2], host.MacBin[3], host.MacBin[4], host.MacBin[5]);
+  }
+}
+
+
 void PrintConfig(SCANPARAMS scanParamsParam)
 {
   printf("Local IP :\t%d.%d.%d.%d\n", scanParamsParam.LocalIpBin[0], scanParamsParam.LocalIpBin[1], scanParamsParam.LocalIpBin[2], scanParamsParam.LocalIpBin[3]);
@@ -7,48 +7,27 @@
 #include "DnsStructs.h"
 #include "LinkedListSpoofedDnsHosts.h"
 #include "NetworkStructs.h"
+#include "PacketView.h"
 
 
-BOOL GetHostnameFromPcapDnsPacket(u_char *dataParam, u_char *hostname, int hostnameBufLen)
+BOOL GetHostnameFromPcapDnsPacket(u_char *dataParam, PPACKET_VIEW viewParam, u_char *hostname, int hostnameBufLen)
 {
   BOOL retVal = FALSE;
-  PETHDR ethrHdr = (PETHDR)dataParam;
-  PIPHDR ipHdr = NULL;
-  PUDPHDR updHdr = NULL;
-  int ipHdrLen = 0;
   char *dnsData = NULL;
   PDNS_HEADER dnsHdr = NULL;
   unsigned char *reader = NULL;
   int stop;
   unsigned char *peerName = NULL;
 
-  ipHdr = (PIPHDR)(dataParam + sizeof(ETHDR));
-  if (ipHdr == NULL ||
-      ipHdr->proto != IP_PROTO_UDP)
-  {
-    goto END;
-  }
-
-  ipHdrLen = (ipHdr->ver_ihl & 0xf) * 4;
-  if (ipHdrLen <= 0)
-  {
-    goto END;
-  }
-
-  updHdr = (PUDPHDR)((unsigned char*)ipHdr + ipHdrLen);
-  if (updHdr == NULL ||
-      updHdr->ulen <= 0 ||
-      (ntohs(updHdr->dport) != 53 && ntohs(updHdr->sport) != 53))
-  {
-    goto END;
-  }
-
-  dnsData = ((char*)updHdr + sizeof(UDPHDR));
-  if ((dnsHdr = (PDNS_HEADER)&dnsData[sizeof(DNS_HEADER)]) == NULL)
+  if ((viewParam->Layers & PV_LAYER_UDP) == 0 ||
+      (viewParam->DstPort != 53 && viewParam->SrcPort != 53) ||
+      viewParam->PayloadCapLength <= sizeof(DNS_HEADER))
   {
     goto END;
   }
 
+  dnsData = (char *)PV_PAYLOAD(dataParam, viewParam);
+  dnsHdr = (PDNS_HEADER)dnsData;
   if (ntohs(dnsHdr->q_count) <= 0)
   {
     goto END;
@@ -61,7 +40,6 @@ BOOL GetHostnameFromPcapDnsPacket(u_char *dataParam, u_char *hostname, int hostn
     goto END;
   }
 
-  int peerNameLen = strnlen(peerName, hostnameBufLen-1);
   RtlZeroMemory(hostname, hostnameBufLen);
   strncpy(hostname,peerName, hostnameBufLen-1);
   retVal = TRUE;
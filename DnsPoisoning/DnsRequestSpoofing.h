@@ -3,7 +3,10 @@
 #include <Windows.h>
 #include "DnsStructs.h"
 #include "LinkedListSpoofedDNSHosts.h"
+#include "PacketCapture.h"
+#include "PacketView.h"
+#include "TransmitQueue.h"
 
-BOOL DnsRequestSpoofing(unsigned char * rawPacket, pcap_t *deviceHandle, PPOISONING_DATA spoofingRecord, char *srcIp, char *dstIp);
+BOOL DnsRequestSpoofing(unsigned char * rawPacket, PTRANSMIT_QUEUE transmitQueue, PPOISONING_DATA spoofingRecord);
 void FixNetworkLayerData4Request(unsigned char * data, PRAW_DNS_DATA responseData);
-PPOISONING_DATA DnsRequestPoisonerGetHost2Spoof(u_char *pData);
+PPOISONING_DATA DnsRequestPoisonerGetHost2Spoof(u_char *dataParam, PPACKET_VIEW viewParam);
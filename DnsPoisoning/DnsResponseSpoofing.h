@@ -2,8 +2,11 @@
 
 #include <Windows.h>
 #include "LinkedListSpoofedDnsHosts.h"
+#include "PacketCapture.h"
+#include "PacketView.h"
+#include "TransmitQueue.h"
 
 
-BOOL DnsResponseSpoofing(unsigned char * rawPacket, pcap_t *deviceHandle, PPOISONING_DATA spoofingRecord, char *srcIp, char *dstIp);
+BOOL DnsResponseSpoofing(unsigned char * rawPacket, PTRANSMIT_QUEUE transmitQueue, PPOISONING_DATA spoofingRecord);
 void FixNetworkLayerData4Response(unsigned char * data, PRAW_DNS_DATA responseData);
-PPOISONING_DATA DnsResponsePoisonerGetHost2Spoof(u_char *dataParam);
+PPOISONING_DATA DnsResponsePoisonerGetHost2Spoof(u_char *dataParam, PPACKET_VIEW viewParam);
@@ -0,0 +1,342 @@
+#define HAVE_REMOTE
+
+#include <pcap.h>
+#include <stdio.h>
+#include <Shlwapi.h>
+#include <windows.h>
+
+#include "Benchmark.h"
+#include "Config.h"
+#include "DnsHelper.h"
+#include "DnsPoisoning.h"
+#include "DnsStructs.h"
+#include "HostTable.h"
+#include "LinkedListSpoofedDnsHosts.h"
+#include "Logging.h"
+#include "ModeBenchmark.h"
+#include "NetworkHelperFunctions.h"
+#include "PacketCapture.h"
+#include "PacketHandlerDP.h"
+#include "TransmitQueue.h"
+
+
+// Global/external variables
+extern int gDEBUGLEVEL;
+extern SCANPARAMS gScanParams;
+extern PHOSTNODE gDnsSpoofingList;
+extern PHOST_TABLE gTargetSystems;
+
+
+static BOOL MicroBuildDnsQuery(PMICRO_BENCHMARK microBenchmarkParam, int hostnameLengthParam);
+static uint64_t MicroPrepareDataPacketStructure(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroGetHostnameFromPcapDnsPacket(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroChangeDnsNameToTextFormat(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroWildcardCompare(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroChecksum(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroIpBin2String(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroMacBin2String(void *contextParam, uint64_t iterationsParam);
+
+
+/*
+ * Replay benchmark
+ *
+ * param   pcap file, loop count
+ *   -b     {...}
+ *
+ * Feeds the pcap file through DnsPoisoning_handler as fast as
+ * possible. The frames come from memory, forwarded frames and
+ * forged DNS answers end in the replay handle's null sink. Use
+ * .dnshosts and .targethosts in the current directory to make
+ * the spoofing paths part of the measurement.
+ *
+ */
+int InitializeBenchmark(int loopCountParam)
+{
+  int retVal = 0;
+  char errorBuffer[CAPTURE_ERRBUF_SIZE];
+  PBENCHMARK_RUN benchmarkRun = NULL;
+
+  ZeroMemory(errorBuffer, sizeof(errorBuffer));
+
+  // Logging would be all we measure
+  gDEBUGLEVEL = DBG_OFF;
+
+  if (PathFileExists(FILE_HOST_TARGETS))
+  {
+    ParseTargetHostsConfigFile(FILE_HOST_TARGETS, gTargetSystems);
+  }
+
+  if (PathFileExists(FILE_DNS_POISONING))
+  {
+    ParseDnsPoisoningConfigFile(FILE_DNS_POISONING);
+  }
+
+  if ((benchmarkRun = (PBENCHMARK_RUN)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(BENCHMARK_RUN))) == NULL)
+  {
+    retVal = 1;
+    goto END;
+  }
+
+  if ((gScanParams.InterfaceReadHandle = CaptureOpenReplay((char *)gScanParams.PcapFilePath, loopCountParam, errorBuffer)) == NULL)
+  {
+    fprintf(stderr, "Unable to open the file %s.\nerror=%s\n", gScanParams.PcapFilePath, errorBuffer);
+    retVal = 2;
+    goto END;
+  }
+
+  gScanParams.InterfaceWriteHandle = gScanParams.InterfaceReadHandle;
+
+  if (OpenTransmitQueue(&gScanParams) == FALSE)
+  {
+    retVal = 4;
+    goto END;
+  }
+
+  gScanParams.OfflineCapture = TRUE;
+
+  if (BenchmarkReplay((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle, "DnsPoisoning_handler", (BENCHMARK_PACKET_HANDLER)DnsPoisoning_handler, (unsigned char *)&gScanParams, benchmarkRun) == FALSE)
+  {
+    fprintf(stderr, "Replay failed: %s\n", CaptureGetError((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle));
+    retVal = 3;
+    goto END;
+  }
+
+  // Count the frames still queued at the end of the replay
+  TransmitQueueFlush((PTRANSMIT_QUEUE)gScanParams.TransmitQueue);
+  CaptureGetSentCounters((PCAPTURE_HANDLE)gScanParams.InterfaceWriteHandle, &benchmarkRun->SentPackets, &benchmarkRun->SentBytes);
+  BenchmarkPrintReport(benchmarkRun);
+
+END:
+
+  CloseTransmitQueue(&gScanParams);
+
+  if (gScanParams.InterfaceReadHandle != NULL)
+  {
+    CaptureClose(gScanParams.InterfaceReadHandle);
+    gScanParams.InterfaceReadHandle = NULL;
+    gScanParams.InterfaceWriteHandle = NULL;
+  }
+
+  if (benchmarkRun != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, benchmarkRun);
+  }
+
+  return retVal;
+}
+
+
+
+/*
+ * Microbenchmarks
+ *
+ * param   filter
+ *   -m     {...}
+ *
+ * Times the primitives of the DNS path one at a time, each for
+ * a few frame or host name sizes. Only benchmarks whose name
+ * (<primitive>/<size>) contains the filter run, e.g.
+ * "-m WildcardCompare" or "-m /200".
+ *
+ */
+int InitializeMicroBenchmark(char *filterParam)
+{
+  int retVal = 0;
+  int frameSizes[] = { 64, 594, 1514 };
+  int checksumSizes[] = { 20, 576, 1480 };
+  int hostnameSizes[] = { 16, 64, 200 };
+  PMICRO_BENCHMARK microBenchmark = NULL;
+  int counter = 0;
+
+  gDEBUGLEVEL = DBG_OFF;
+
+  if ((microBenchmark = (PMICRO_BENCHMARK)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(MICRO_BENCHMARK))) == NULL)
+  {
+    retVal = 1;
+    goto END;
+  }
+
+  BenchmarkMicroStart("DnsPoisoning primitives", filterParam);
+
+  // UDP frames of 64 bytes up to the MTU
+  for (counter = 0; counter < (int)(sizeof(frameSizes) / sizeof(frameSizes[0])); counter++)
+  {
+    microBenchmark->FrameLength = BenchmarkBuildFrame(microBenchmark->Frame, BENCHMARK_PROTO_UDP, 40000, 53, NULL, frameSizes[counter] - 42);
+    BenchmarkMicro("PrepareDataPacketStructure", frameSizes[counter], MicroPrepareDataPacketStructure, microBenchmark);
+  }
+
+  // DNS queries, the size is the length of the queried name
+  for (counter = 0; counter < (int)(sizeof(hostnameSizes) / sizeof(hostnameSizes[0])); counter++)
+  {
+    if (MicroBuildDnsQuery(microBenchmark, hostnameSizes[counter]) == FALSE)
+    {
+      retVal = 2;
+      goto END;
+    }
+
+    BenchmarkMicro("GetHostnameFromPcapDnsPacket", hostnameSizes[counter], MicroGetHostnameFromPcapDnsPacket, microBenchmark);
+    BenchmarkMicro("ChangeDnsNameToTextFormat", hostnameSizes[counter], MicroChangeDnsNameToTextFormat, microBenchmark);
+    BenchmarkMicro("WildcardCompare", hostnameSizes[counter], MicroWildcardCompare, microBenchmark);
+  }
+
+  for (counter = 0; counter < (int)(sizeof(checksumSizes) / sizeof(checksumSizes[0])); counter++)
+  {
+    microBenchmark->ChecksumLength = checksumSizes[counter];
+    BenchmarkMicro("in_cksum", checksumSizes[counter], MicroChecksum, microBenchmark);
+  }
+
+  BenchmarkMicro("IpBin2String", BIN_IP_LEN, MicroIpBin2String, microBenchmark);
+  BenchmarkMicro("MacBin2String", BIN_MAC_LEN, MicroMacBin2String, microBenchmark);
+
+  printf("\n");
+
+END:
+
+  if (microBenchmark != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, microBenchmark);
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Frame with a DNS query for a host name of
+ * hostnameLengthParam characters
+ *
+ */
+static BOOL MicroBuildDnsQuery(PMICRO_BENCHMARK microBenchmarkParam, int hostnameLengthParam)
+{
+  unsigned char query[BENCHMARK_FRAME_SIZE];
+  unsigned int queryLength = 0;
+
+  BenchmarkBuildHostname(microBenchmarkParam->Hostname, hostnameLengthParam);
+
+  if ((queryLength = BenchmarkBuildDnsQuery(query, sizeof(query), microBenchmarkParam->Hostname)) == 0)
+  {
+    return FALSE;
+  }
+
+  microBenchmarkParam->FrameLength = BenchmarkBuildFrame(microBenchmarkParam->Frame, BENCHMARK_PROTO_UDP, 40000, 53, query, queryLength);
+
+  return PacketViewParse(microBenchmarkParam->Frame, microBenchmarkParam->FrameLength, &microBenchmarkParam->View);
+}
+
+
+static uint64_t MicroPrepareDataPacketStructure(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  PACKET_INFO packetInfo;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    result += PrepareDataPacketStructure(microBenchmark->Frame, microBenchmark->FrameLength, &packetInfo);
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroGetHostnameFromPcapDnsPacket(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  unsigned char hostname[MAX_BUF_SIZE + 1];
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    result += GetHostnameFromPcapDnsPacket(microBenchmark->Frame, &microBenchmark->View, hostname, sizeof(hostname) - 1);
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroChangeDnsNameToTextFormat(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  unsigned char *dnsData = PV_PAYLOAD(microBenchmark->Frame, &microBenchmark->View);
+  unsigned char *name = NULL;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+  int stop = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    if ((name = ChangeDnsNameToTextFormat(dnsData + sizeof(DNS_HEADER), dnsData, &stop)) != NULL)
+    {
+      result += name[0];
+      HeapFree(GetProcessHeap(), 0, name);
+    }
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroWildcardCompare(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    result += WildcardCompare(MICRO_BENCHMARK_PATTERN, microBenchmark->Hostname);
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroChecksum(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    result += in_cksum((unsigned short *)(microBenchmark->Frame + sizeof(ETHDR)), microBenchmark->ChecksumLength);
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroIpBin2String(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  unsigned char output[MAX_IP_LEN + 1];
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    IpBin2String(microBenchmark->Frame + sizeof(ETHDR) + 12, output, sizeof(output) - 1);
+    result += output[0];
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroMacBin2String(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  unsigned char output[MAX_MAC_LEN + 1];
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    MacBin2String(microBenchmark->Frame + BIN_MAC_LEN, output, sizeof(output) - 1);
+    result += output[0];
+  }
+
+  return result;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Benchmark.h"
+#include "DnsPoisoning.h"
+#include "PacketView.h"
+
+#define MICRO_BENCHMARK_PATTERN "*.example.com"
+
+
+/*
+ * Type definitions
+ *
+ */
+
+// Inputs of the microbenchmark currently running
+typedef struct
+{
+  unsigned char Frame[BENCHMARK_FRAME_SIZE];
+  unsigned int FrameLength;
+  PACKET_VIEW View;
+  int ChecksumLength;
+  char Hostname[MAX_BUF_SIZE + 1];
+} MICRO_BENCHMARK, *PMICRO_BENCHMARK;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+int InitializeBenchmark(int loopCountParam);
+int InitializeMicroBenchmark(char *filterParam);
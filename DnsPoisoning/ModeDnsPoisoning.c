@@ -7,9 +7,10 @@
 
 #include "PacketHandlerDP.h"
 #include "Config.h"
+#include "FileWatch.h"
 #include "DnsPoisoning.h"
+#include "HostTable.h"
 #include "LinkedListSpoofedDnsHosts.h"
-#include "LinkedListTargetSystems.h"
 #include "Logging.h"
 #include "ModeDnsPoisoning.h"
 #include "NetworkHelperFunctions.h"
@@ -18,7 +19,7 @@
 // Extern/global variables
 extern int gDEBUGLEVEL;
 extern SCANPARAMS gScanParams;
-extern PSYSNODE gTargetSystemsList;
+extern PHOST_TABLE gTargetSystems;
 extern PHOSTNODE gDnsSpoofingList;
 
 DWORD gPOISONINGThreadID = 0;
@@ -62,7 +63,7 @@ void InitializeDP()
     printf("No target hosts file \"%s\"!\n", FILE_HOST_TARGETS);
   }
 
-  if (ParseTargetHostsConfigFile(FILE_HOST_TARGETS) <= 0)
+  if (ParseTargetHostsConfigFile(FILE_HOST_TARGETS, gTargetSystems) <= 0)
   {
     printf("No target hosts were defined!\n");
   }
@@ -77,7 +78,7 @@ void InitializeDP()
     ParseDnsPoisoningConfigFile(FILE_DNS_POISONING);
   }
 
-  PrintTargetSystems(gTargetSystemsList);
+  PrintTargetSystems(gTargetSystems);
   PrintDnsSpoofingRulesNodes(gDnsSpoofingList);
 
   // Start targethosts observer file
@@ -145,28 +146,43 @@ BOOL InitTargethostObserverThread()
 }
 
 
+/*
+ * Reload .targethosts when it changes. The new records
+ * are parsed into a new table and replace the old ones
+ * in one step, the packet handlers keep looking up
+ * targets meanwhile.
+ *
+ */
 DWORD WINAPI TargethostsObserver(LPVOID params)
 {
-  struct _stat statbuf;
-  time_t mtime_previous;
-  int stat = _stat(FILE_HOST_TARGETS, &statbuf);
+  PFILE_WATCH fileWatch = NULL;
+  PHOST_TABLE newTargetSystems = NULL;
   int total_systems = 0;
 
+  if ((fileWatch = FileWatchCreate(FILE_HOST_TARGETS)) == NULL)
+  {
+    LogMsg(DBG_ERROR, "TargethostsObserver(): Can't watch .targethosts");
+    return 1;
+  }
+
   while (1 == 1)
   {
-    mtime_previous = statbuf.st_mtime;
-    stat = _stat(FILE_HOST_TARGETS, &statbuf);
+    if (FileWatchWait(fileWatch, FILE_WATCH_INFINITE) == FALSE)
+    {
+      continue;
+    }
+
+    LogMsg(DBG_INFO, "TargethostsObserver(): .targethosts changed. Reloading .targethost records.");
 
-    if (mtime_previous != statbuf.st_mtime)
+    if ((newTargetSystems = HostTableCreate(HostTableCount(gTargetSystems))) == NULL)
     {
-      total_systems = 0;
-      LogMsg(DBG_INFO, "TargethostsObserver(): .targethosts changed. Reloading .targethost records.");
-      ClearSystemList(&gTargetSystemsList);
-      total_systems = ParseTargetHostsConfigFile(FILE_HOST_TARGETS);
-      PrintTargetSystems(FILE_HOST_TARGETS);
-      LogMsg(DBG_INFO, "TargethostsObserver(): %d systems added to .targethosts.", total_systems);
+      LogMsg(DBG_ERROR, "TargethostsObserver(): Can't allocate the new target systems");
+      continue;
     }
 
-    Sleep(1000);
+    total_systems = ParseTargetHostsConfigFile(FILE_HOST_TARGETS, newTargetSystems);
+    HostTableReplace(gTargetSystems, newTargetSystems);
+    PrintTargetSystems(gTargetSystems);
+    LogMsg(DBG_INFO, "TargethostsObserver(): %d systems added to .targethosts.", total_systems);
   }
 }
@@ -6,24 +6,23 @@
 
 #include "Config.h"
 #include "DnsPoisoning.h"
+#include "HostTable.h"
 #include "LinkedListSpoofedDnsHosts.h"
-#include "LinkedListTargetSystems.h"
 #include "Logging.h"
 #include "ModePcap.h"
 #include "NetworkHelperFunctions.h"
+#include "PacketCapture.h"
 #include "PackethandlerDP.h"
 
 extern int gDEBUGLEVEL;
 extern SCANPARAMS gScanParams;
 extern PHOSTNODE gDnsSpoofingList;
-extern PSYSNODE gTargetSystemsList;
+extern PHOST_TABLE gTargetSystems;
 
 
 int InitializeParsePcapDumpFile()
 {
   int funcRetVal;
-  struct pcap_pkthdr *packetHeader = NULL;
-  unsigned char *packetData = NULL;
   int retVal = -1;
   
   // Initialisation. Parse parameters (Ifc, start IP, stop IP) and
@@ -48,7 +47,7 @@ int InitializeParsePcapDumpFile()
     printf("No target hosts file \"%s\"!\n", FILE_HOST_TARGETS);
   }
 
-  if (ParseTargetHostsConfigFile(FILE_HOST_TARGETS) <= 0)
+  if (ParseTargetHostsConfigFile(FILE_HOST_TARGETS, gTargetSystems) <= 0)
   {
     printf("No target hosts were defined!\n");
   }
@@ -63,7 +62,7 @@ int InitializeParsePcapDumpFile()
     ParseDnsPoisoningConfigFile(FILE_DNS_POISONING);
   }
 
-  PrintTargetSystems(gTargetSystemsList);
+  PrintTargetSystems(gTargetSystems);
   LogMsg(DBG_INFO, "InitializeParsePcapDumpFile(1): -f interface=%s, pcapFile=%s", gScanParams.InterfaceName, gScanParams.PcapFilePath);
 
   // Open Pcap input file
@@ -73,38 +72,52 @@ int InitializeParsePcapDumpFile()
     goto END;
   }
 
-  // Open Pcap interface read/write
-  if (OpenPcapInterfaceHandle(&gScanParams) == FALSE)
+  // Open Pcap interface read/write, or the output of a dry run
+  if (gScanParams.DumpFilePath[0] != '\0')
+  {
+    if (OpenPcapOutputHandle(&gScanParams) == FALSE)
+    {
+      retVal = -2;
+      goto END;
+    }
+  }
+  else if (OpenPcapInterfaceHandle(&gScanParams) == FALSE)
   {
     retVal = -2;
     goto END;
   }
 
-  // Start processing packets
-  LogMsg(DBG_INFO, "CaptureIncomingPackets(): Pcap packet handling started ...");
-  while ((funcRetVal = pcap_next_ex((pcap_t*)gScanParams.PcapFileHandle, (struct pcap_pkthdr **) &packetHeader, (const u_char **)&packetData)) >= 0)
+  if (OpenTransmitQueue(&gScanParams) == FALSE)
   {
-    if (funcRetVal == 1)
-    {
-      DnsPoisoning_handler((unsigned char *)&gScanParams, packetHeader, packetData);
-    }
+    retVal = -3;
+    goto END;
   }
 
+  gScanParams.OfflineCapture = TRUE;
+
+  // Start processing packets
+  LogMsg(DBG_INFO, "CaptureIncomingPackets(): Pcap packet handling started ...");
+  funcRetVal = CaptureDispatchLoop((PCAPTURE_HANDLE)gScanParams.PcapFileHandle, DnsPoisoning_batch_handler, (unsigned char *)&gScanParams);
+  LogMsg(DBG_INFO, "CaptureIncomingPackets(): Pcap packet handling stopped with return value: %d", funcRetVal);
+
 END:
 
+  // Flush before the write handle goes away
+  CloseTransmitQueue(&gScanParams);
+
   if (gScanParams.PcapFileHandle != NULL)
   {
-    pcap_close(gScanParams.PcapFileHandle);
+    CaptureClose(gScanParams.PcapFileHandle);
+    gScanParams.PcapFileHandle = NULL;
   }
 
-  if (gScanParams.InterfaceReadHandle != NULL)
-  {
-    pcap_close(gScanParams.InterfaceReadHandle);
-  }
+  ClosePcapOutputHandle(&gScanParams);
 
   if (gScanParams.InterfaceReadHandle != NULL)
   {
-    pcap_close(gScanParams.InterfaceReadHandle);
+    CaptureClose(gScanParams.InterfaceReadHandle);
+    gScanParams.InterfaceReadHandle = NULL;
+    gScanParams.InterfaceWriteHandle = NULL;
   }
 
   return retVal;
@@ -115,9 +128,11 @@ END:
 BOOL OpenPcapFileHandle(PSCANPARAMS scanParams)
 {
   BOOL retVal = FALSE;
-  char errbuf[PCAP_ERRBUF_SIZE];
+  char errbuf[CAPTURE_ERRBUF_SIZE];
+
+  ZeroMemory(errbuf, sizeof(errbuf));
 
-  if ((gScanParams.PcapFileHandle = pcap_open_offline(gScanParams.PcapFilePath, errbuf)) == NULL)
+  if ((gScanParams.PcapFileHandle = CaptureOpenOffline((char *)gScanParams.PcapFilePath, errbuf)) == NULL)
   {
     fprintf(stderr, "Unable to open the file %s.\nerror=%s\n", gScanParams.PcapFilePath, errbuf);
     retVal = FALSE;
@@ -135,7 +150,6 @@ BOOL OpenPcapFileHandle(PSCANPARAMS scanParams)
 BOOL OpenPcapInterfaceHandle(PSCANPARAMS scanParams)
 {
   BOOL retVal = FALSE;
-  struct bpf_program ifcCode;
   char pcapErrorBuffer[PCAP_ERRBUF_SIZE];
   char filter[MAX_BUF_SIZE + 1];
   unsigned int netMask = 0;
@@ -147,9 +161,9 @@ BOOL OpenPcapInterfaceHandle(PSCANPARAMS scanParams)
   ZeroMemory(pcapErrorBuffer, sizeof(pcapErrorBuffer));
 
   // Open interface.
-  if ((scanParams->InterfaceReadHandle = pcap_open_live((char *)scanParams->InterfaceName, 65536, PCAP_OPENFLAG_NOCAPTURE_LOCAL | PCAP_OPENFLAG_MAX_RESPONSIVENESS, PCAP_READTIMEOUT, pcapErrorBuffer)) == NULL)
+  if ((scanParams->InterfaceReadHandle = CaptureOpen((char *)scanParams->InterfaceName, 65536, CAPTURE_FLAG_PROMISCUOUS | CAPTURE_FLAG_NOCAPTURE_LOCAL, PCAP_READTIMEOUT, pcapErrorBuffer)) == NULL)
   {
-    LogMsg(DBG_ERROR, "OpenPcapInterfaceHandle(): Unable to open the adapter");
+    LogMsg(DBG_ERROR, "OpenPcapInterfaceHandle(): Unable to open the adapter: %s", pcapErrorBuffer);
     retVal = FALSE;
     goto END;
   }
@@ -173,30 +187,102 @@ BOOL OpenPcapInterfaceHandle(PSCANPARAMS scanParams)
 
   // MAC == LocalMAC and (IP == GWIP or IP == VictimIP
   scanParams->InterfaceWriteHandle = scanParams->InterfaceReadHandle;
-  ZeroMemory(&ifcCode, sizeof(ifcCode));
   ZeroMemory(filter, sizeof(filter));
 
   _snprintf(filter, sizeof(filter) - 1, "ip && ether dst %s && not src host %s && not dst host %s", scanParams->LocalMacStr, scanParams->LocalIpStr, scanParams->LocalIpStr);
   netMask = 0xffffff; // "255.255.255.0"
 
-  if (pcap_compile((pcap_t *)scanParams->InterfaceWriteHandle, &ifcCode, (const char *)filter, 1, netMask) < 0)
+  if (CaptureSetFilter((PCAPTURE_HANDLE)scanParams->InterfaceWriteHandle, filter, netMask) == FALSE)
   {
-    LogMsg(DBG_ERROR, "OpenPcapInterfaceHandle(): Unable to compile the BPF filter \"%s\"", filter);
+    LogMsg(DBG_ERROR, "OpenPcapInterfaceHandle(): Unable to set the BPF filter \"%s\": %s", filter, CaptureGetError((PCAPTURE_HANDLE)scanParams->InterfaceWriteHandle));
     retVal = FALSE;
     goto END;
   }
 
-  if (pcap_setfilter((pcap_t *)scanParams->InterfaceWriteHandle, &ifcCode) < 0)
+  // Everything went well so far.
+  // Set the return value to true.
+  retVal = TRUE;
+END:
+
+  return retVal;
+}
+
+
+
+/*
+ * Dry run output. Instead of an interface the forwarded frames
+ * go to DumpFilePath: a .pcapng or any other pcap file, or the
+ * null sink for "NUL". The interface isn't opened, it only
+ * supplies the addresses. The input file gets the filter the
+ * live capture would use, so the same frames are processed.
+ *
+ */
+BOOL OpenPcapOutputHandle(PSCANPARAMS scanParams)
+{
+  BOOL retVal = FALSE;
+  char errorBuffer[CAPTURE_ERRBUF_SIZE];
+  char filter[MAX_BUF_SIZE + 1];
+  int dumpFormat = CAPTURE_DUMP_PCAP;
+
+  ZeroMemory(errorBuffer, sizeof(errorBuffer));
+  ZeroMemory(filter, sizeof(filter));
+
+  if (StrCmpI((LPCSTR)scanParams->DumpFilePath, "NUL") == 0)
+  {
+    scanParams->InterfaceWriteHandle = CaptureOpenNullSink(errorBuffer);
+  }
+  else
+  {
+    if (StrCmpI(PathFindExtension((LPCSTR)scanParams->DumpFilePath), ".pcapng") == 0)
+    {
+      dumpFormat = CAPTURE_DUMP_PCAPNG;
+    }
+
+    scanParams->InterfaceWriteHandle = CaptureOpenDumpFile((char *)scanParams->DumpFilePath, dumpFormat, errorBuffer);
+  }
+
+  if (scanParams->InterfaceWriteHandle == NULL)
+  {
+    LogMsg(DBG_ERROR, "OpenPcapOutputHandle(): Unable to open the output \"%s\": %s", scanParams->DumpFilePath, errorBuffer);
+    fprintf(stderr, "Unable to open the output %s.\nerror=%s\n", scanParams->DumpFilePath, errorBuffer);
+    goto END;
+  }
+
+  _snprintf(filter, sizeof(filter) - 1, "ip && ether dst %s && not src host %s && not dst host %s", scanParams->LocalMacStr, scanParams->LocalIpStr, scanParams->LocalIpStr);
+
+  if (CaptureSetFilter((PCAPTURE_HANDLE)scanParams->PcapFileHandle, filter, 0xffffff) == FALSE)
   {
-    LogMsg(DBG_ERROR, "OpenPcapInterfaceHandle(): Unable to set the BPF filter \"%s\"", filter);
-    retVal = FALSE;
+    LogMsg(DBG_ERROR, "OpenPcapOutputHandle(): Unable to set the BPF filter \"%s\": %s", filter, CaptureGetError((PCAPTURE_HANDLE)scanParams->PcapFileHandle));
     goto END;
   }
 
-  // Everything went well so far.
-  // Set the return value to true.
   retVal = TRUE;
+
 END:
 
   return retVal;
 }
+
+
+/*
+ * Close the dry run output and tell how much went into it.
+ *
+ */
+void ClosePcapOutputHandle(PSCANPARAMS scanParams)
+{
+  uint64_t sentPackets = 0;
+  uint64_t sentBytes = 0;
+
+  if (scanParams->InterfaceWriteHandle == NULL ||
+      scanParams->InterfaceWriteHandle == scanParams->InterfaceReadHandle)
+  {
+    return;
+  }
+
+  CaptureGetSentCounters((PCAPTURE_HANDLE)scanParams->InterfaceWriteHandle, &sentPackets, &sentBytes);
+  printf("%llu frames (%llu bytes) written to %s (%s)\n", (unsigned long long)sentPackets, (unsigned long long)sentBytes,
+    scanParams->DumpFilePath, CaptureGetBackendName((PCAPTURE_HANDLE)scanParams->InterfaceWriteHandle));
+
+  CaptureClose(scanParams->InterfaceWriteHandle);
+  scanParams->InterfaceWriteHandle = NULL;
+}
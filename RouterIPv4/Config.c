@@ -2,14 +2,15 @@
 #include <stdio.h>
 
 #include "RouterIPv4.h"
+#include "FirewallClassifier.h"
+#include "HostTable.h"
 #include "LinkedListFirewallRules.h"
-#include "LinkedListTargetSystems.h"
 #include "Logging.h"
 #include "NetworkHelperFunctions.h"
 
 
 extern PRULENODE gFwRulesList;
-extern PSYSNODE gTargetSystemsList;
+extern PFIREWALL_CLASSIFIER gFirewallClassifier;
 
 
 void PrintConfig(SCANPARAMS scanParamsParam)
@@ -25,7 +26,7 @@ void PrintConfig(SCANPARAMS scanParamsParam)
 }
 
 
-int ParseTargetHostsConfigFile(char *targetsFile)
+int ParseTargetHostsConfigFile(char *targetsFile, PHOST_TABLE hostTableParam)
 {
   int retVal = 0;
   unsigned char ipStr[MAX_IP_LEN];
@@ -70,7 +71,7 @@ int ParseTargetHostsConfigFile(char *targetsFile)
       MacString2Bin(macBin, macStr, strnlen((char *)macStr, sizeof(macStr) - 1));
       IpString2Bin(ipBin, ipStr, strnlen((char *)ipStr, sizeof(ipStr) - 1));
 
-      AddToSystemsList(&gTargetSystemsList, macBin, (char *)ipStr, ipBin);
+      HostTableAdd(hostTableParam, ipBin, macBin, (char *)ipStr);
       retVal++;
       LogMsg(DBG_MEDIUM, "ParseTargetHostsConfigFile(): New system added :  %s/%s", macStr, ipStr);
     }
@@ -93,6 +94,19 @@ END:
 }
 
 
+void PrintTargetSystems(PHOST_TABLE hostTableParam)
+{
+  HOST_ENTRY host;
+  int counter = 0;
+
+  for (counter = 0; HostTableGetEntry(hostTableParam, counter, &host) == TRUE; counter++)
+  {
+    LogMsg(DBG_DEBUG, "PrintTargetSystems(): Target system: %s / %02x-%02x-%02x-%02x-%02x-%02x", host.IpStr,
+      host.MacBin[0], host.MacBin[1], host.MacBin[2], host.MacBin[3], host.MacBin[4], host.MacBin[5]);
+  }
+}
+
+
 
 int ParseFirewallConfigFile(char *firewallRulesFile)
 {
@@ -172,5 +186,9 @@ END:
     fclose(fileHandle);
   }
 
+  // The forwarding path only looks at the compiled rules
+  FirewallClassifierRelease(gFirewallClassifier);
+  gFirewallClassifier = FirewallClassifierCompile(gFwRulesList);
+
   return retVal;
 }
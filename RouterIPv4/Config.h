@@ -1,9 +1,11 @@
 #pragma once
 
+#include "HostTable.h"
 #include "RouterIPv4.h"
 
 
 void PrintConfig(SCANPARAMS scanParamsParam);
-int ParseTargetHostsConfigFile(char *targetsFile);
+int ParseTargetHostsConfigFile(char *targetsFile, PHOST_TABLE hostTableParam);
+void PrintTargetSystems(PHOST_TABLE hostTableParam);
 int ParseDnsPoisoningConfigFile(char *pConfigFile);
 int ParseFirewallConfigFile(char *firewallRulesFile);
\ No newline at end of file
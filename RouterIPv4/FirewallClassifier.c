@@ -0,0 +1,921 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "FirewallClassifier.h"
+#include "LinkedListFirewallRules.h"
+#include "Logging.h"
+
+
+// One rule while compiling, ranges already resolved
+typedef struct
+{
+  PRULENODE Rule;
+  int Priority;
+  int Protocol;
+  unsigned long SrcIpBin;
+  unsigned long DstIpBin;
+  unsigned int SrcLower;
+  unsigned int SrcUpper;
+  unsigned int DstLower;
+  unsigned int DstUpper;
+} FIREWALL_COMPILE_RULE, *PFIREWALL_COMPILE_RULE;
+
+
+// Work arrays of AppendSrcSegments(), sized for all rules of a group
+typedef struct
+{
+  unsigned int *Bounds;
+  PFIREWALL_COMPILE_RULE *ByPriority;
+  PFIREWALL_COMPILE_RULE *Best;
+  int *Next;
+} FIREWALL_COMPILE_SCRATCH, *PFIREWALL_COMPILE_SCRATCH;
+
+
+static int CompareCompileRules(const void *firstParam, const void *secondParam);
+static int CompareDstLower(const void *firstParam, const void *secondParam);
+static int ComparePriority(const void *firstParam, const void *secondParam);
+static int CompareUInt(const void *firstParam, const void *secondParam);
+static int SortUnique(unsigned int *valuesParam, int countParam);
+static int FindBound(unsigned int *boundsParam, int boundCountParam, unsigned int valueParam);
+static int NextUnpainted(int *nextParam, int indexParam);
+static BOOL CompileGroup(PFIREWALL_CLASSIFIER classifierParam, PFIREWALL_COMPILE_RULE rulesParam, int ruleCountParam, PFIREWALL_GROUP groupParam, int *srcCapacityParam);
+static void CompileLinearGroup(PFIREWALL_CLASSIFIER classifierParam, PFIREWALL_COMPILE_RULE rulesParam, int ruleCountParam, PFIREWALL_GROUP groupParam);
+static BOOL AppendSrcSegments(PFIREWALL_CLASSIFIER classifierParam, PFIREWALL_COMPILE_RULE *activeParam, int activeCountParam, PFIREWALL_COMPILE_SCRATCH scratchParam, int *srcCapacityParam);
+static BOOL BuildGroupTable(PFIREWALL_CLASSIFIER classifierParam);
+
+
+/*
+ * Group hash over protocol and the two addresses
+ *
+ */
+static __inline unsigned int FirewallGroupHash(int protocolParam, unsigned long srcIpParam, unsigned long dstIpParam)
+{
+  uint32_t hash = (uint32_t)srcIpParam * 0x9e3779b1U;
+
+  hash ^= ((uint32_t)dstIpParam + 0x7f4a7c15U) * 0x85ebca77U;
+  hash ^= (uint32_t)protocolParam * 0xc2b2ae3dU;
+  hash ^= hash >> 15;
+  hash *= 0x2c1b3c6dU;
+  hash ^= hash >> 12;
+
+  return hash;
+}
+
+
+static __inline PFIREWALL_GROUP FirewallFindGroup(PFIREWALL_CLASSIFIER classifierParam, int protocolParam, unsigned long srcIpParam, unsigned long dstIpParam)
+{
+  unsigned int slot = FirewallGroupHash(protocolParam, srcIpParam, dstIpParam) & classifierParam->TableMask;
+  PFIREWALL_GROUP group = NULL;
+
+  while (classifierParam->Table[slot] != 0)
+  {
+    group = &classifierParam->Groups[classifierParam->Table[slot] - 1];
+
+    if (group->SrcIpBin == srcIpParam &&
+        group->DstIpBin == dstIpParam &&
+        group->Protocol == protocolParam)
+    {
+      return group;
+    }
+
+    slot = (slot + 1) & classifierParam->TableMask;
+  }
+
+  return NULL;
+}
+
+
+
+/*
+ * Compile the rule list. Returns NULL if memory runs out,
+ * the caller then has to stay with FirewallBlockRuleMatch().
+ *
+ */
+PFIREWALL_CLASSIFIER FirewallClassifierCompile(PRULENODE listHead)
+{
+  PFIREWALL_CLASSIFIER classifier = NULL;
+  PFIREWALL_COMPILE_RULE rules = NULL;
+  PRULENODE tmpRule = NULL;
+  char protocol[FIREWALL_PROTOCOL_LEN + 1];
+  int listCount = 0;
+  int ruleCount = 0;
+  int priority = 0;
+  int groupStart = 0;
+  int srcCapacity = 0;
+  int counter = 0;
+  int protocolIndex = 0;
+
+  for (tmpRule = listHead; tmpRule != NULL && tmpRule->isTail == FALSE; tmpRule = tmpRule->next)
+  {
+    listCount++;
+  }
+
+  if ((classifier = (PFIREWALL_CLASSIFIER)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(FIREWALL_CLASSIFIER))) == NULL ||
+      (rules = (PFIREWALL_COMPILE_RULE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (listCount + 1) * sizeof(FIREWALL_COMPILE_RULE))) == NULL ||
+      (classifier->Protocols = (char (*)[FIREWALL_PROTOCOL_LEN + 1])HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (listCount + 1) * (FIREWALL_PROTOCOL_LEN + 1))) == NULL ||
+      (classifier->GroupKinds = (unsigned int *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (listCount + 1) * sizeof(unsigned int))) == NULL ||
+      (classifier->Groups = (PFIREWALL_GROUP)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (listCount + 1) * sizeof(FIREWALL_GROUP))) == NULL ||
+      (classifier->DstSegments = (PFIREWALL_DST_SEGMENT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (3 * listCount + 1) * sizeof(FIREWALL_DST_SEGMENT))) == NULL ||
+      (classifier->LinearRules = (PFIREWALL_LINEAR_RULE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (listCount + 1) * sizeof(FIREWALL_LINEAR_RULE))) == NULL)
+  {
+    goto ERROR_END;
+  }
+
+  // Resolve the rules the way FirewallBlockRuleMatch() reads them.
+  // A port range only applies if both ends are set.
+  for (tmpRule = listHead; tmpRule != NULL && tmpRule->isTail == FALSE; tmpRule = tmpRule->next, priority++)
+  {
+    PFIREWALL_COMPILE_RULE rule = &rules[ruleCount];
+
+    rule->Rule = tmpRule;
+    rule->Priority = priority;
+    rule->SrcIpBin = tmpRule->SrcIPBin;
+    rule->DstIpBin = tmpRule->DstIPBin;
+    rule->SrcLower = 0;
+    rule->SrcUpper = 65535;
+    rule->DstLower = 0;
+    rule->DstUpper = 65535;
+
+    if (tmpRule->SrcPortLower != 0 && tmpRule->SrcPortUpper != 0)
+    {
+      rule->SrcLower = tmpRule->SrcPortLower;
+      rule->SrcUpper = tmpRule->SrcPortUpper;
+    }
+
+    if (tmpRule->DstPortLower != 0 && tmpRule->DstPortUpper != 0)
+    {
+      rule->DstLower = tmpRule->DstPortLower;
+      rule->DstUpper = tmpRule->DstPortUpper;
+    }
+
+    // Can't match anything
+    if (rule->SrcLower > rule->SrcUpper ||
+        rule->DstLower > rule->DstUpper)
+    {
+      continue;
+    }
+
+    ZeroMemory(protocol, sizeof(protocol));
+    strncpy(protocol, tmpRule->Protocol, FIREWALL_PROTOCOL_LEN);
+
+    for (protocolIndex = 0; protocolIndex < classifier->ProtocolCount; protocolIndex++)
+    {
+      if (strcmp(classifier->Protocols[protocolIndex], protocol) == 0)
+      {
+        break;
+      }
+    }
+
+    if (protocolIndex == classifier->ProtocolCount)
+    {
+      CopyMemory(classifier->Protocols[protocolIndex], protocol, sizeof(protocol));
+      classifier->ProtocolCount++;
+    }
+
+    rule->Protocol = protocolIndex;
+    ruleCount++;
+  }
+
+  classifier->RuleCount = ruleCount;
+
+  // Rules with the same protocol and addresses form one group
+  qsort(rules, ruleCount, sizeof(FIREWALL_COMPILE_RULE), CompareCompileRules);
+
+  for (groupStart = 0, counter = 1; counter <= ruleCount; counter++)
+  {
+    if (counter < ruleCount &&
+        rules[counter].Protocol == rules[groupStart].Protocol &&
+        rules[counter].SrcIpBin == rules[groupStart].SrcIpBin &&
+        rules[counter].DstIpBin == rules[groupStart].DstIpBin)
+    {
+      continue;
+    }
+
+    if (CompileGroup(classifier, &rules[groupStart], counter - groupStart, &classifier->Groups[classifier->GroupCount], &srcCapacity) == FALSE)
+    {
+      goto ERROR_END;
+    }
+
+    classifier->GroupKinds[rules[groupStart].Protocol] |= 1 << ((rules[groupStart].SrcIpBin == 0 ? 2 : 0) | (rules[groupStart].DstIpBin == 0 ? 1 : 0));
+    classifier->GroupCount++;
+    groupStart = counter;
+  }
+
+  if (BuildGroupTable(classifier) == FALSE)
+  {
+    goto ERROR_END;
+  }
+
+  if (classifier->LinearGroupCount > 0)
+  {
+    LogMsg(DBG_INFO, "FirewallClassifierCompile(): %d rules in %d groups overlap too much for segments, they are matched one by one", classifier->LinearRuleCount, classifier->LinearGroupCount);
+  }
+
+  HeapFree(GetProcessHeap(), 0, rules);
+
+  return classifier;
+
+ERROR_END:
+
+  LogMsg(DBG_ERROR, "FirewallClassifierCompile(): Not enough memory for %d rules", listCount);
+
+  if (rules != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, rules);
+  }
+
+  FirewallClassifierRelease(classifier);
+
+  return NULL;
+}
+
+
+
+/*
+ * Same result as FirewallBlockRuleMatch() on the compiled
+ * list: the first rule in list order that matches, or NULL.
+ *
+ */
+PRULENODE FirewallClassify(PFIREWALL_CLASSIFIER classifierParam, char *protocolParam, unsigned long srcIpParam, unsigned long dstIpParam, unsigned short srcPortParam, unsigned short dstPortParam)
+{
+  PRULENODE retVal = NULL;
+  int bestPriority = INT_MAX;
+  int protocol = 0;
+  int lastProtocol = 0;
+  int kind = 0;
+  PFIREWALL_GROUP group = NULL;
+  PFIREWALL_DST_SEGMENT dstSegments = NULL;
+  PFIREWALL_SRC_SEGMENT srcSegments = NULL;
+  PFIREWALL_LINEAR_RULE linearRules = NULL;
+  unsigned int counter = 0;
+  int lower = 0;
+  int upper = 0;
+  int middle = 0;
+
+  if (classifierParam == NULL ||
+      classifierParam->GroupCount == 0)
+  {
+    return NULL;
+  }
+
+  // Without a protocol every protocol is checked
+  if (protocolParam == NULL)
+  {
+    protocol = 0;
+    lastProtocol = classifierParam->ProtocolCount - 1;
+  }
+  else
+  {
+    for (protocol = 0; protocol < classifierParam->ProtocolCount; protocol++)
+    {
+      if (strncmp(protocolParam, classifierParam->Protocols[protocol], FIREWALL_PROTOCOL_LEN) == 0)
+      {
+        break;
+      }
+    }
+
+    lastProtocol = protocol;
+  }
+
+  for (; protocol <= lastProtocol && protocol < classifierParam->ProtocolCount; protocol++)
+  {
+    // Kind bit 1: any destination IP, bit 2: any source IP
+    for (kind = 0; kind < 4; kind++)
+    {
+      if ((classifierParam->GroupKinds[protocol] & (1 << kind)) == 0 ||
+          ((kind & 2) == 0 && srcIpParam == 0) ||
+          ((kind & 1) == 0 && dstIpParam == 0) ||
+          (group = FirewallFindGroup(classifierParam, protocol, (kind & 2) ? 0 : srcIpParam, (kind & 1) ? 0 : dstIpParam)) == NULL)
+      {
+        continue;
+      }
+
+      // Rules in list order, the first one matching wins
+      if (group->LinearCount > 0)
+      {
+        linearRules = &classifierParam->LinearRules[group->LinearOffset];
+
+        for (counter = 0; counter < group->LinearCount && linearRules[counter].Priority < bestPriority; counter++)
+        {
+          if (linearRules[counter].SrcLower <= srcPortParam &&
+              linearRules[counter].SrcUpper >= srcPortParam &&
+              linearRules[counter].DstLower <= dstPortParam &&
+              linearRules[counter].DstUpper >= dstPortParam)
+          {
+            retVal = linearRules[counter].Rule;
+            bestPriority = linearRules[counter].Priority;
+            break;
+          }
+        }
+
+        continue;
+      }
+
+      // Last destination segment starting at or below the port.
+      // The first one starts at 0.
+      dstSegments = &classifierParam->DstSegments[group->DstOffset];
+      lower = 0;
+      upper = group->DstCount - 1;
+
+      while (lower < upper)
+      {
+        middle = (lower + upper + 1) / 2;
+
+        if (dstSegments[middle].Start <= dstPortParam)
+        {
+          lower = middle;
+        }
+        else
+        {
+          upper = middle - 1;
+        }
+      }
+
+      if (dstSegments[lower].SrcCount == 0)
+      {
+        continue;
+      }
+
+      // Same for the source port
+      srcSegments = &classifierParam->SrcSegments[dstSegments[lower].SrcOffset];
+      upper = dstSegments[lower].SrcCount - 1;
+      lower = 0;
+
+      while (lower < upper)
+      {
+        middle = (lower + upper + 1) / 2;
+
+        if (srcSegments[middle].Start <= srcPortParam)
+        {
+          lower = middle;
+        }
+        else
+        {
+          upper = middle - 1;
+        }
+      }
+
+      if (srcSegments[lower].Rule != NULL &&
+          srcSegments[lower].Priority < bestPriority)
+      {
+        retVal = srcSegments[lower].Rule;
+        bestPriority = srcSegments[lower].Priority;
+      }
+    }
+  }
+
+  return retVal;
+}
+
+
+
+void FirewallClassifierGetStats(PFIREWALL_CLASSIFIER classifierParam, PFIREWALL_CLASSIFIER_STATS statsParam)
+{
+  ZeroMemory(statsParam, sizeof(FIREWALL_CLASSIFIER_STATS));
+
+  if (classifierParam == NULL)
+  {
+    return;
+  }
+
+  statsParam->Rules = classifierParam->RuleCount;
+  statsParam->Protocols = classifierParam->ProtocolCount;
+  statsParam->Groups = classifierParam->GroupCount;
+  statsParam->DstSegments = classifierParam->DstSegmentCount;
+  statsParam->SrcSegments = classifierParam->SrcSegmentCount;
+  statsParam->LinearGroups = classifierParam->LinearGroupCount;
+  statsParam->LinearRules = classifierParam->LinearRuleCount;
+}
+
+
+
+void FirewallClassifierRelease(PFIREWALL_CLASSIFIER classifierParam)
+{
+  if (classifierParam == NULL)
+  {
+    return;
+  }
+
+  if (classifierParam->Protocols != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, classifierParam->Protocols);
+  }
+
+  if (classifierParam->GroupKinds != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, classifierParam->GroupKinds);
+  }
+
+  if (classifierParam->Table != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, classifierParam->Table);
+  }
+
+  if (classifierParam->Groups != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, classifierParam->Groups);
+  }
+
+  if (classifierParam->DstSegments != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, classifierParam->DstSegments);
+  }
+
+  if (classifierParam->SrcSegments != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, classifierParam->SrcSegments);
+  }
+
+  if (classifierParam->LinearRules != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, classifierParam->LinearRules);
+  }
+
+  HeapFree(GetProcessHeap(), 0, classifierParam);
+}
+
+
+
+/*
+ * Cut the destination ports of one group into segments and
+ * sweep over them, keeping the rules whose range covers the
+ * current segment. A segment whose source segments equal
+ * those of the one before is merged into it.
+ *
+ * Every destination segment may add up to twice as many
+ * source segments as it has rules. Once that would exceed the
+ * group's limit the segments are dropped again and the group
+ * is matched rule by rule.
+ *
+ */
+static BOOL CompileGroup(PFIREWALL_CLASSIFIER classifierParam, PFIREWALL_COMPILE_RULE rulesParam, int ruleCountParam, PFIREWALL_GROUP groupParam, int *srcCapacityParam)
+{
+  BOOL retVal = FALSE;
+  unsigned int *bounds = NULL;
+  PFIREWALL_COMPILE_RULE *byLower = NULL;
+  PFIREWALL_COMPILE_RULE *active = NULL;
+  PFIREWALL_DST_SEGMENT segment = NULL;
+  PFIREWALL_DST_SEGMENT previous = NULL;
+  FIREWALL_COMPILE_SCRATCH scratch;
+  int boundCount = 0;
+  int activeCount = 0;
+  int nextRule = 0;
+  int srcStart = 0;
+  int groupSrcStart = classifierParam->SrcSegmentCount;
+  int64_t segmentLimit = (int64_t)FIREWALL_GROUP_SEGMENTS_PER_RULE * ruleCountParam;
+  int64_t segmentCount = 0;
+  int counter = 0;
+  int counter2 = 0;
+
+  ZeroMemory(&scratch, sizeof(scratch));
+
+  if (segmentLimit < FIREWALL_GROUP_MIN_SEGMENTS)
+  {
+    segmentLimit = FIREWALL_GROUP_MIN_SEGMENTS;
+  }
+
+  if ((bounds = (unsigned int *)HeapAlloc(GetProcessHeap(), 0, (2 * ruleCountParam + 1) * sizeof(unsigned int))) == NULL ||
+      (byLower = (PFIREWALL_COMPILE_RULE *)HeapAlloc(GetProcessHeap(), 0, ruleCountParam * sizeof(PFIREWALL_COMPILE_RULE))) == NULL ||
+      (active = (PFIREWALL_COMPILE_RULE *)HeapAlloc(GetProcessHeap(), 0, ruleCountParam * sizeof(PFIREWALL_COMPILE_RULE))) == NULL ||
+      (scratch.Bounds = (unsigned int *)HeapAlloc(GetProcessHeap(), 0, (2 * ruleCountParam + 1) * sizeof(unsigned int))) == NULL ||
+      (scratch.ByPriority = (PFIREWALL_COMPILE_RULE *)HeapAlloc(GetProcessHeap(), 0, ruleCountParam * sizeof(PFIREWALL_COMPILE_RULE))) == NULL ||
+      (scratch.Best = (PFIREWALL_COMPILE_RULE *)HeapAlloc(GetProcessHeap(), 0, (2 * ruleCountParam + 1) * sizeof(PFIREWALL_COMPILE_RULE))) == NULL ||
+      (scratch.Next = (int *)HeapAlloc(GetProcessHeap(), 0, (2 * ruleCountParam + 2) * sizeof(int))) == NULL)
+  {
+    goto END;
+  }
+
+  bounds[boundCount++] = 0;
+
+  for (counter = 0; counter < ruleCountParam; counter++)
+  {
+    byLower[counter] = &rulesParam[counter];
+    bounds[boundCount++] = rulesParam[counter].DstLower;
+
+    if (rulesParam[counter].DstUpper < 65535)
+    {
+      bounds[boundCount++] = rulesParam[counter].DstUpper + 1;
+    }
+  }
+
+  boundCount = SortUnique(bounds, boundCount);
+  qsort(byLower, ruleCountParam, sizeof(PFIREWALL_COMPILE_RULE), CompareDstLower);
+
+  groupParam->Protocol = rulesParam[0].Protocol;
+  groupParam->SrcIpBin = rulesParam[0].SrcIpBin;
+  groupParam->DstIpBin = rulesParam[0].DstIpBin;
+  groupParam->DstOffset = classifierParam->DstSegmentCount;
+
+  for (counter = 0; counter < boundCount; counter++)
+  {
+    // Drop the rules ending below this segment ...
+    for (counter2 = 0; counter2 < activeCount; )
+    {
+      if (active[counter2]->DstUpper < bounds[counter])
+      {
+        active[counter2] = active[--activeCount];
+      }
+      else
+      {
+        counter2++;
+      }
+    }
+
+    // ... and add the ones starting here
+    while (nextRule < ruleCountParam &&
+           byLower[nextRule]->DstLower <= bounds[counter])
+    {
+      active[activeCount++] = byLower[nextRule++];
+    }
+
+    segmentCount += 2 * activeCount + 1;
+
+    if (segmentCount > segmentLimit)
+    {
+      classifierParam->DstSegmentCount = groupParam->DstOffset;
+      classifierParam->SrcSegmentCount = groupSrcStart;
+      CompileLinearGroup(classifierParam, rulesParam, ruleCountParam, groupParam);
+      retVal = TRUE;
+      goto END;
+    }
+
+    srcStart = classifierParam->SrcSegmentCount;
+
+    if (AppendSrcSegments(classifierParam, active, activeCount, &scratch, srcCapacityParam) == FALSE)
+    {
+      goto END;
+    }
+
+    if (previous != NULL &&
+        previous->SrcCount == (unsigned int)(classifierParam->SrcSegmentCount - srcStart) &&
+        memcmp(&classifierParam->SrcSegments[previous->SrcOffset], &classifierParam->SrcSegments[srcStart], previous->SrcCount * sizeof(FIREWALL_SRC_SEGMENT)) == 0)
+    {
+      classifierParam->SrcSegmentCount = srcStart;
+      continue;
+    }
+
+    segment = &classifierParam->DstSegments[classifierParam->DstSegmentCount++];
+    segment->Start = (unsigned short)bounds[counter];
+    segment->SrcOffset = srcStart;
+    segment->SrcCount = classifierParam->SrcSegmentCount - srcStart;
+    previous = segment;
+  }
+
+  groupParam->DstCount = classifierParam->DstSegmentCount - groupParam->DstOffset;
+  retVal = TRUE;
+
+END:
+
+  if (bounds != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, bounds);
+  }
+
+  if (byLower != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, byLower);
+  }
+
+  if (active != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, active);
+  }
+
+  if (scratch.Bounds != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, scratch.Bounds);
+  }
+
+  if (scratch.ByPriority != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, scratch.ByPriority);
+  }
+
+  if (scratch.Best != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, scratch.Best);
+  }
+
+  if (scratch.Next != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, scratch.Next);
+  }
+
+  return retVal;
+}
+
+
+
+/*
+ * Keep the group's rules for FirewallClassify() to check one
+ * by one. rulesParam is in list order already.
+ *
+ */
+static void CompileLinearGroup(PFIREWALL_CLASSIFIER classifierParam, PFIREWALL_COMPILE_RULE rulesParam, int ruleCountParam, PFIREWALL_GROUP groupParam)
+{
+  PFIREWALL_LINEAR_RULE linearRule = NULL;
+  int counter = 0;
+
+  groupParam->DstCount = 0;
+  groupParam->LinearOffset = classifierParam->LinearRuleCount;
+  groupParam->LinearCount = ruleCountParam;
+
+  for (counter = 0; counter < ruleCountParam; counter++)
+  {
+    linearRule = &classifierParam->LinearRules[classifierParam->LinearRuleCount++];
+    linearRule->SrcLower = (unsigned short)rulesParam[counter].SrcLower;
+    linearRule->SrcUpper = (unsigned short)rulesParam[counter].SrcUpper;
+    linearRule->DstLower = (unsigned short)rulesParam[counter].DstLower;
+    linearRule->DstUpper = (unsigned short)rulesParam[counter].DstUpper;
+    linearRule->Priority = rulesParam[counter].Priority;
+    linearRule->Rule = rulesParam[counter].Rule;
+  }
+
+  classifierParam->LinearGroupCount++;
+}
+
+
+
+/*
+ * Source port segments for one destination segment. Every
+ * segment names the first rule in list order covering it,
+ * neighbours naming the same rule are merged.
+ *
+ * The rules are applied in list order, each one claims the
+ * segments of its range no earlier rule claimed. Claimed
+ * segments are skipped through Next, so every segment is
+ * claimed once.
+ *
+ */
+static BOOL AppendSrcSegments(PFIREWALL_CLASSIFIER classifierParam, PFIREWALL_COMPILE_RULE *activeParam, int activeCountParam, PFIREWALL_COMPILE_SCRATCH scratchParam, int *srcCapacityParam)
+{
+  unsigned int *bounds = scratchParam->Bounds;
+  PFIREWALL_SRC_SEGMENT segments = NULL;
+  PFIREWALL_COMPILE_RULE best = NULL;
+  int boundCount = 0;
+  int capacity = 0;
+  int first = 0;
+  int last = 0;
+  int counter = 0;
+  int counter2 = 0;
+
+  if (activeCountParam == 0)
+  {
+    return TRUE;
+  }
+
+  bounds[boundCount++] = 0;
+
+  for (counter = 0; counter < activeCountParam; counter++)
+  {
+    bounds[boundCount++] = activeParam[counter]->SrcLower;
+
+    if (activeParam[counter]->SrcUpper < 65535)
+    {
+      bounds[boundCount++] = activeParam[counter]->SrcUpper + 1;
+    }
+  }
+
+  boundCount = SortUnique(bounds, boundCount);
+
+  // Make room for the worst case
+  if (classifierParam->SrcSegmentCount + boundCount > *srcCapacityParam)
+  {
+    capacity = *srcCapacityParam > 0 ? *srcCapacityParam : 1024;
+
+    while (classifierParam->SrcSegmentCount + boundCount > capacity)
+    {
+      capacity *= 2;
+    }
+
+    if (classifierParam->SrcSegments == NULL)
+    {
+      segments = (PFIREWALL_SRC_SEGMENT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, capacity * sizeof(FIREWALL_SRC_SEGMENT));
+    }
+    else
+    {
+      segments = (PFIREWALL_SRC_SEGMENT)HeapReAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, classifierParam->SrcSegments, capacity * sizeof(FIREWALL_SRC_SEGMENT));
+    }
+
+    if (segments == NULL)
+    {
+      return FALSE;
+    }
+
+    classifierParam->SrcSegments = segments;
+    *srcCapacityParam = capacity;
+  }
+
+  for (counter = 0; counter < boundCount; counter++)
+  {
+    scratchParam->Best[counter] = NULL;
+    scratchParam->Next[counter] = counter;
+  }
+
+  scratchParam->Next[boundCount] = boundCount;
+
+  CopyMemory(scratchParam->ByPriority, activeParam, activeCountParam * sizeof(PFIREWALL_COMPILE_RULE));
+  qsort(scratchParam->ByPriority, activeCountParam, sizeof(PFIREWALL_COMPILE_RULE), ComparePriority);
+
+  for (counter = 0; counter < activeCountParam; counter++)
+  {
+    best = scratchParam->ByPriority[counter];
+    first = FindBound(bounds, boundCount, best->SrcLower);
+    last = best->SrcUpper < 65535 ? FindBound(bounds, boundCount, best->SrcUpper + 1) : boundCount;
+
+    for (counter2 = NextUnpainted(scratchParam->Next, first); counter2 < last; counter2 = NextUnpainted(scratchParam->Next, counter2 + 1))
+    {
+      scratchParam->Best[counter2] = best;
+      scratchParam->Next[counter2] = counter2 + 1;
+    }
+  }
+
+  segments = classifierParam->SrcSegments;
+
+  for (counter = 0; counter < boundCount; counter++)
+  {
+    best = scratchParam->Best[counter];
+
+    if (counter > 0 &&
+        segments[classifierParam->SrcSegmentCount - 1].Rule == (best != NULL ? best->Rule : NULL))
+    {
+      continue;
+    }
+
+    // Keep the memcmp() in CompileGroup() meaningful
+    ZeroMemory(&segments[classifierParam->SrcSegmentCount], sizeof(FIREWALL_SRC_SEGMENT));
+    segments[classifierParam->SrcSegmentCount].Start = (unsigned short)bounds[counter];
+    segments[classifierParam->SrcSegmentCount].Priority = best != NULL ? best->Priority : INT_MAX;
+    segments[classifierParam->SrcSegmentCount].Rule = best != NULL ? best->Rule : NULL;
+    classifierParam->SrcSegmentCount++;
+  }
+
+  return TRUE;
+}
+
+
+
+/*
+ * Open addressing table, at most half full
+ *
+ */
+static BOOL BuildGroupTable(PFIREWALL_CLASSIFIER classifierParam)
+{
+  unsigned int tableSize = 16;
+  unsigned int slot = 0;
+  PFIREWALL_GROUP group = NULL;
+  int counter = 0;
+
+  while (tableSize < 2 * (unsigned int)classifierParam->GroupCount)
+  {
+    tableSize *= 2;
+  }
+
+  if ((classifierParam->Table = (int *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, tableSize * sizeof(int))) == NULL)
+  {
+    return FALSE;
+  }
+
+  classifierParam->TableMask = tableSize - 1;
+
+  for (counter = 0; counter < classifierParam->GroupCount; counter++)
+  {
+    group = &classifierParam->Groups[counter];
+    slot = FirewallGroupHash(group->Protocol, group->SrcIpBin, group->DstIpBin) & classifierParam->TableMask;
+
+    while (classifierParam->Table[slot] != 0)
+    {
+      slot = (slot + 1) & classifierParam->TableMask;
+    }
+
+    classifierParam->Table[slot] = counter + 1;
+  }
+
+  return TRUE;
+}
+
+
+
+static int CompareCompileRules(const void *firstParam, const void *secondParam)
+{
+  PFIREWALL_COMPILE_RULE first = (PFIREWALL_COMPILE_RULE)firstParam;
+  PFIREWALL_COMPILE_RULE second = (PFIREWALL_COMPILE_RULE)secondParam;
+
+  if (first->Protocol != second->Protocol)
+  {
+    return first->Protocol < second->Protocol ? -1 : 1;
+  }
+
+  if (first->SrcIpBin != second->SrcIpBin)
+  {
+    return first->SrcIpBin < second->SrcIpBin ? -1 : 1;
+  }
+
+  if (first->DstIpBin != second->DstIpBin)
+  {
+    return first->DstIpBin < second->DstIpBin ? -1 : 1;
+  }
+
+  return first->Priority < second->Priority ? -1 : (first->Priority > second->Priority ? 1 : 0);
+}
+
+
+
+static int CompareDstLower(const void *firstParam, const void *secondParam)
+{
+  PFIREWALL_COMPILE_RULE first = *(PFIREWALL_COMPILE_RULE *)firstParam;
+  PFIREWALL_COMPILE_RULE second = *(PFIREWALL_COMPILE_RULE *)secondParam;
+
+  return first->DstLower < second->DstLower ? -1 : (first->DstLower > second->DstLower ? 1 : 0);
+}
+
+
+
+static int ComparePriority(const void *firstParam, const void *secondParam)
+{
+  PFIREWALL_COMPILE_RULE first = *(PFIREWALL_COMPILE_RULE *)firstParam;
+  PFIREWALL_COMPILE_RULE second = *(PFIREWALL_COMPILE_RULE *)secondParam;
+
+  return first->Priority < second->Priority ? -1 : (first->Priority > second->Priority ? 1 : 0);
+}
+
+
+
+static int CompareUInt(const void *firstParam, const void *secondParam)
+{
+  unsigned int first = *(unsigned int *)firstParam;
+  unsigned int second = *(unsigned int *)secondParam;
+
+  return first < second ? -1 : (first > second ? 1 : 0);
+}
+
+
+
+static int SortUnique(unsigned int *valuesParam, int countParam)
+{
+  int unique = 0;
+  int counter = 0;
+
+  qsort(valuesParam, countParam, sizeof(unsigned int), CompareUInt);
+
+  for (counter = 0; counter < countParam; counter++)
+  {
+    if (unique == 0 || valuesParam[unique - 1] != valuesParam[counter])
+    {
+      valuesParam[unique++] = valuesParam[counter];
+    }
+  }
+
+  return unique;
+}
+
+
+
+/*
+ * Index of valueParam in the sorted boundsParam, which
+ * has to contain it
+ *
+ */
+static int FindBound(unsigned int *boundsParam, int boundCountParam, unsigned int valueParam)
+{
+  int lower = 0;
+  int upper = boundCountParam - 1;
+  int middle = 0;
+
+  while (lower < upper)
+  {
+    middle = (lower + upper) / 2;
+
+    if (boundsParam[middle] < valueParam)
+    {
+      lower = middle + 1;
+    }
+    else
+    {
+      upper = middle;
+    }
+  }
+
+  return lower;
+}
+
+
+
+/*
+ * First segment at or after indexParam no rule claimed yet.
+ * The path is shortened on the way.
+ *
+ */
+static int NextUnpainted(int *nextParam, int indexParam)
+{
+  while (nextParam[indexParam] != indexParam)
+  {
+    nextParam[indexParam] = nextParam[nextParam[indexParam]];
+    indexParam = nextParam[indexParam];
+  }
+
+  return indexParam;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <windows.h>
+
+#include "LinkedListFirewallRules.h"
+
+/*
+ * Compiled firewall rules.
+ *
+ * FirewallClassifierCompile() turns the RULENODE list into a table
+ * that answers the same question as FirewallBlockRuleMatch() without
+ * walking the list.
+ *
+ * Rules are grouped by protocol, source IP and destination IP. A
+ * wildcard address (0.0.0.0) is part of the key, so a packet probes
+ * at most four groups: (src, dst), (src, any), (any, dst) and
+ * (any, any). The groups sit in an open addressing hash table.
+ *
+ * Inside a group the destination port space is cut into segments at
+ * every range boundary. Every destination segment has its own list
+ * of source port segments, each naming the first rule in list order
+ * that covers it. A lookup is a binary search on each of the two
+ * segment lists, so its cost depends on how the port ranges of one
+ * group overlap and not on the number of rules.
+ *
+ * Rules whose port ranges overlap heavily can make the segments grow
+ * with the square of the rule count. A group that would need more
+ * than FIREWALL_GROUP_SEGMENTS_PER_RULE segments per rule (and more
+ * than FIREWALL_GROUP_MIN_SEGMENTS) is not cut into segments. Its
+ * rules are kept in list order and checked one by one, the way
+ * FirewallBlockRuleMatch() does.
+ *
+ * The classifier is read only after compiling and is shared by all
+ * forwarding workers. Rule changes mean compiling a new one.
+ *
+ */
+
+#define FIREWALL_PROTOCOL_LEN 4     // FirewallBlockRuleMatch() compares 4 chars
+#define FIREWALL_GROUP_SEGMENTS_PER_RULE 64
+#define FIREWALL_GROUP_MIN_SEGMENTS 65536
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  unsigned short Start;           // First source port of the segment
+  int Priority;                   // Position of Rule in the list
+  PRULENODE Rule;                 // NULL if no rule covers the segment
+} FIREWALL_SRC_SEGMENT, *PFIREWALL_SRC_SEGMENT;
+
+
+typedef struct
+{
+  unsigned short Start;           // First destination port of the segment
+  unsigned int SrcOffset;
+  unsigned int SrcCount;
+} FIREWALL_DST_SEGMENT, *PFIREWALL_DST_SEGMENT;
+
+
+// Rule of a group that is matched one by one
+typedef struct
+{
+  unsigned short SrcLower;
+  unsigned short SrcUpper;
+  unsigned short DstLower;
+  unsigned short DstUpper;
+  int Priority;
+  PRULENODE Rule;
+} FIREWALL_LINEAR_RULE, *PFIREWALL_LINEAR_RULE;
+
+
+typedef struct
+{
+  int Protocol;
+  unsigned long SrcIpBin;         // 0: any
+  unsigned long DstIpBin;         // 0: any
+  unsigned int DstOffset;
+  unsigned int DstCount;
+  unsigned int LinearOffset;
+  unsigned int LinearCount;       // Not 0: no segments, match the rules one by one
+} FIREWALL_GROUP, *PFIREWALL_GROUP;
+
+
+typedef struct
+{
+  int Rules;
+  int Protocols;
+  int Groups;
+  int DstSegments;
+  int SrcSegments;
+  int LinearGroups;
+  int LinearRules;
+} FIREWALL_CLASSIFIER_STATS, *PFIREWALL_CLASSIFIER_STATS;
+
+
+typedef struct
+{
+  int RuleCount;
+  int ProtocolCount;
+  char (*Protocols)[FIREWALL_PROTOCOL_LEN + 1];
+  unsigned int *GroupKinds;       // Per protocol, which of the 4 probes can hit
+  unsigned int TableMask;
+  int *Table;                     // Group index + 1, 0 is empty
+  int GroupCount;
+  PFIREWALL_GROUP Groups;
+  int DstSegmentCount;
+  PFIREWALL_DST_SEGMENT DstSegments;
+  int SrcSegmentCount;
+  PFIREWALL_SRC_SEGMENT SrcSegments;
+  int LinearGroupCount;
+  int LinearRuleCount;
+  PFIREWALL_LINEAR_RULE LinearRules;
+} FIREWALL_CLASSIFIER, *PFIREWALL_CLASSIFIER;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+PFIREWALL_CLASSIFIER FirewallClassifierCompile(PRULENODE listHead);
+PRULENODE FirewallClassify(PFIREWALL_CLASSIFIER classifierParam, char *protocolParam, unsigned long srcIpParam, unsigned long dstIpParam, unsigned short srcPortParam, unsigned short dstPortParam);
+void FirewallClassifierGetStats(PFIREWALL_CLASSIFIER classifierParam, PFIREWALL_CLASSIFIER_STATS statsParam);
+void FirewallClassifierRelease(PFIREWALL_CLASSIFIER classifierParam);
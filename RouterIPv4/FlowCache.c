@@ -0,0 +1,176 @@
+#include <windows.h>
+
+#include "FlowCache.h"
+
+
+static unsigned int FlowCacheHash(PFLOW_KEY keyParam);
+static BOOL FlowCacheEntryMatch(PFLOW_CACHE_ENTRY entryParam, PFLOW_KEY keyParam);
+
+
+/*
+ * Allocate the table. If that fails the cache stays
+ * disabled, every lookup misses and inserts are dropped.
+ *
+ */
+BOOL FlowCacheInit(PFLOW_CACHE flowCacheParam)
+{
+  ULONG_PTR alignedAddress = 0;
+
+  ZeroMemory(flowCacheParam, sizeof(FLOW_CACHE));
+  flowCacheParam->Generation = 1;
+
+  // The heap only guarantees 16 byte alignment
+  if ((flowCacheParam->Memory = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, FLOW_CACHE_BUCKETS * sizeof(FLOW_CACHE_BUCKET) + FLOW_CACHE_LINE_SIZE)) == NULL)
+  {
+    return FALSE;
+  }
+
+  alignedAddress = ((ULONG_PTR)flowCacheParam->Memory + FLOW_CACHE_LINE_SIZE - 1) & ~(ULONG_PTR)(FLOW_CACHE_LINE_SIZE - 1);
+  flowCacheParam->Buckets = (PFLOW_CACHE_BUCKET)alignedAddress;
+
+  return TRUE;
+}
+
+
+void FlowCacheRelease(PFLOW_CACHE flowCacheParam)
+{
+  if (flowCacheParam->Memory != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, flowCacheParam->Memory);
+  }
+
+  flowCacheParam->Memory = NULL;
+  flowCacheParam->Buckets = NULL;
+}
+
+
+/*
+ * Forget all entries. Only the generation changes, stale
+ * entries are ignored by lookups and overwritten by inserts.
+ *
+ */
+void FlowCacheInvalidate(PFLOW_CACHE flowCacheParam)
+{
+  flowCacheParam->Generation++;
+
+  // Wrapped around. 0 marks empty entries and entries of an old
+  // round could look valid again, so start over with a clean table.
+  if (flowCacheParam->Generation <= 0)
+  {
+    flowCacheParam->Generation = 1;
+
+    if (flowCacheParam->Buckets != NULL)
+    {
+      ZeroMemory(flowCacheParam->Buckets, FLOW_CACHE_BUCKETS * sizeof(FLOW_CACHE_BUCKET));
+    }
+  }
+}
+
+
+PFLOW_CACHE_ENTRY FlowCacheLookup(PFLOW_CACHE flowCacheParam, PFLOW_KEY keyParam)
+{
+  PFLOW_CACHE_BUCKET bucket = NULL;
+  int counter = 0;
+
+  if (flowCacheParam->Buckets == NULL)
+  {
+    flowCacheParam->Misses++;
+    return NULL;
+  }
+
+  bucket = &flowCacheParam->Buckets[FlowCacheHash(keyParam) & (FLOW_CACHE_BUCKETS - 1)];
+
+  for (counter = 0; counter < FLOW_CACHE_WAYS; counter++)
+  {
+    if (bucket->Entries[counter].Generation == flowCacheParam->Generation &&
+        FlowCacheEntryMatch(&bucket->Entries[counter], keyParam) == TRUE)
+    {
+      flowCacheParam->Hits++;
+      return &bucket->Entries[counter];
+    }
+  }
+
+  flowCacheParam->Misses++;
+
+  return NULL;
+}
+
+
+/*
+ * Remember the verdict for keyParam. The new entry goes to
+ * the first slot of its bucket, a valid entry there moves to
+ * the second one and pushes out what was there before.
+ *
+ */
+void FlowCacheInsert(PFLOW_CACHE flowCacheParam, PFLOW_KEY keyParam, unsigned char verdictParam, PETHER_TEMPLATE etherTemplateParam)
+{
+  PFLOW_CACHE_BUCKET bucket = NULL;
+  PFLOW_CACHE_ENTRY entry = NULL;
+
+  if (flowCacheParam->Buckets == NULL)
+  {
+    return;
+  }
+
+  bucket = &flowCacheParam->Buckets[FlowCacheHash(keyParam) & (FLOW_CACHE_BUCKETS - 1)];
+  entry = &bucket->Entries[0];
+
+  if (entry->Generation == flowCacheParam->Generation)
+  {
+    CopyMemory(&bucket->Entries[1], entry, sizeof(FLOW_CACHE_ENTRY));
+  }
+
+  entry->SrcIpBin = keyParam->SrcIpBin;
+  entry->DstIpBin = keyParam->DstIpBin;
+  entry->SrcPort = keyParam->SrcPort;
+  entry->DstPort = keyParam->DstPort;
+  entry->IpProto = keyParam->IpProto;
+  entry->Verdict = verdictParam;
+  entry->Generation = flowCacheParam->Generation;
+
+  if (etherTemplateParam != NULL)
+  {
+    CopyMemory(&entry->EtherTemplate, etherTemplateParam, sizeof(ETHER_TEMPLATE));
+  }
+  else
+  {
+    ZeroMemory(&entry->EtherTemplate, sizeof(ETHER_TEMPLATE));
+  }
+}
+
+
+
+/*
+ * Directional, A->B and B->A usually land in different
+ * buckets. Their verdicts differ anyway.
+ *
+ */
+static unsigned int FlowCacheHash(PFLOW_KEY keyParam)
+{
+  unsigned int hash = 0;
+
+  hash = keyParam->SrcIpBin * 0x9e3779b1;
+  hash ^= keyParam->DstIpBin;
+  hash *= 0x85ebca6b;
+  hash ^= ((unsigned int)keyParam->SrcPort << 16) | keyParam->DstPort;
+  hash ^= (unsigned int)keyParam->IpProto << 8;
+
+  // Final mix (MurmurHash3 fmix32)
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+
+  return hash;
+}
+
+
+static BOOL FlowCacheEntryMatch(PFLOW_CACHE_ENTRY entryParam, PFLOW_KEY keyParam)
+{
+  return entryParam->SrcIpBin == keyParam->SrcIpBin &&
+         entryParam->DstIpBin == keyParam->DstIpBin &&
+         entryParam->SrcPort == keyParam->SrcPort &&
+         entryParam->DstPort == keyParam->DstPort &&
+         entryParam->IpProto == keyParam->IpProto ? TRUE : FALSE;
+}
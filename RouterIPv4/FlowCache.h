@@ -0,0 +1,96 @@
+#pragma once
+
+#include <windows.h>
+
+#include "EtherTemplate.h"
+#include "RouterIPv4.h"
+
+/*
+ * Per flow verdict cache.
+ *
+ * Remembers what ForwardPacket() decided for a 5-tuple (source and
+ * destination IP, protocol, source and destination port), so the
+ * following packets of the flow skip the firewall match, the gateway
+ * comparison and the target lookup. Along with the verdict the entry
+ * holds the Ethernet addresses of the next hop, ready to be copied
+ * into the frame.
+ *
+ * IPv4 fragments are neither looked up nor inserted. The non-first
+ * fragments carry no ports, keyed with ports 0 they would share one
+ * entry across all fragmented datagrams between two hosts.
+ *
+ * The table is a fixed array of 64 byte buckets, each holding two
+ * entries and aligned to a cache line. A lookup reads exactly one
+ * line. A full bucket evicts its older entry.
+ *
+ * Every entry carries the generation it was computed in. The owner
+ * moves to a new generation when the target systems or the firewall
+ * rules change, which invalidates all entries at once without
+ * touching the table.
+ *
+ * A cache belongs to one forwarding thread. It takes no lock.
+ *
+ */
+
+#define FLOW_CACHE_BUCKETS 4096       // Power of 2
+#define FLOW_CACHE_WAYS 2
+#define FLOW_CACHE_LINE_SIZE 64
+
+#define FLOW_VERDICT_BLOCK 1
+#define FLOW_VERDICT_GATEWAY 2
+#define FLOW_VERDICT_VICTIM 3
+#define FLOW_VERDICT_INTERNET 4
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  unsigned int SrcIpBin;
+  unsigned int DstIpBin;
+  unsigned short SrcPort;
+  unsigned short DstPort;
+  unsigned char IpProto;
+} FLOW_KEY, *PFLOW_KEY;
+
+
+typedef struct
+{
+  unsigned int SrcIpBin;
+  unsigned int DstIpBin;
+  unsigned short SrcPort;
+  unsigned short DstPort;
+  unsigned char IpProto;
+  unsigned char Verdict;
+  ETHER_TEMPLATE EtherTemplate;           // Zeroed for FLOW_VERDICT_BLOCK
+  LONG Generation;                        // 0: empty. 32 bytes, two per cache line
+} FLOW_CACHE_ENTRY, *PFLOW_CACHE_ENTRY;
+
+
+typedef struct
+{
+  FLOW_CACHE_ENTRY Entries[FLOW_CACHE_WAYS];
+} FLOW_CACHE_BUCKET, *PFLOW_CACHE_BUCKET;
+
+
+typedef struct
+{
+  LONG Generation;
+  void *Memory;
+  PFLOW_CACHE_BUCKET Buckets;
+  unsigned long long Hits;
+  unsigned long long Misses;
+} FLOW_CACHE, *PFLOW_CACHE;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+BOOL FlowCacheInit(PFLOW_CACHE flowCacheParam);
+void FlowCacheRelease(PFLOW_CACHE flowCacheParam);
+void FlowCacheInvalidate(PFLOW_CACHE flowCacheParam);
+PFLOW_CACHE_ENTRY FlowCacheLookup(PFLOW_CACHE flowCacheParam, PFLOW_KEY keyParam);
+void FlowCacheInsert(PFLOW_CACHE flowCacheParam, PFLOW_KEY keyParam, unsigned char verdictParam, PETHER_TEMPLATE etherTemplateParam);
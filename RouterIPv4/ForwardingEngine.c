@@ -0,0 +1,482 @@
+#define HAVE_REMOTE
+
+#include <pcap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <windows.h>
+
+#include "CaptureStats.h"
+#include "ForwardingEngine.h"
+#include "LatencyStats.h"
+#include "Logging.h"
+#include "PacketCapture.h"
+#include "PacketHandlerIPv4Forwarding.h"
+#include "Probes.h"
+#include "RouterIPv4.h"
+#include "TransmitQueue.h"
+
+#define LOAD_ACQUIRE(ptr) InterlockedCompareExchange((ptr), 0, 0)
+#define STORE_RELEASE(ptr, value) InterlockedExchange((ptr), (value))
+
+
+static BOOL ForwardingEnqueue(PFORWARDING_ENGINE engineParam, PFORWARDING_WORKER workerParam, const struct pcap_pkthdr *pktHeader, const u_char *data, PPACKET_VIEW viewParam);
+static void ForwardingPublish(PFORWARDING_WORKER workerParam);
+static void ForwardingReleaseWorkers(PFORWARDING_ENGINE engineParam);
+
+
+/*
+ * Number of forwarding workers. FORWARDING_WORKERS_ENV if set,
+ * otherwise one per processor the capture thread leaves.
+ *
+ */
+int ForwardingEngineWorkerCount()
+{
+  SYSTEM_INFO systemInfo;
+  char *workersEnv = NULL;
+  int workerCount = 0;
+
+  if ((workersEnv = getenv(FORWARDING_WORKERS_ENV)) != NULL)
+  {
+    workerCount = atoi(workersEnv);
+  }
+  else
+  {
+    ZeroMemory(&systemInfo, sizeof(systemInfo));
+    GetSystemInfo(&systemInfo);
+    workerCount = (int)systemInfo.dwNumberOfProcessors - 1;
+  }
+
+  if (workerCount < 1)
+  {
+    workerCount = 1;
+  }
+  else if (workerCount > FORWARDING_MAX_WORKERS)
+  {
+    workerCount = FORWARDING_MAX_WORKERS;
+  }
+
+  return workerCount;
+}
+
+
+/*
+ * Allocate the workers and start their threads. Every worker
+ * sends on writeHandlesParam[index]. The handles stay owned by
+ * the caller.
+ *
+ */
+BOOL ForwardingEngineStart(PFORWARDING_ENGINE engineParam, PSCANPARAMS scanParams, int workerCountParam, PCAPTURE_HANDLE *writeHandlesParam, BOOL waitWhenFullParam)
+{
+  BOOL retVal = FALSE;
+  PFORWARDING_WORKER worker = NULL;
+  DWORD threadId = 0;
+  char sourceName[CAPTURE_STATS_NAME_SIZE];
+  int counter = 0;
+
+  ZeroMemory(engineParam, sizeof(FORWARDING_ENGINE));
+
+  if (workerCountParam < 1 ||
+      workerCountParam > FORWARDING_MAX_WORKERS ||
+      writeHandlesParam == NULL)
+  {
+    LogMsg(DBG_ERROR, "ForwardingEngineStart(): Invalid worker count %d", workerCountParam);
+    goto END;
+  }
+
+  engineParam->WaitWhenFull = waitWhenFullParam;
+
+  for (counter = 0; counter < workerCountParam; counter++)
+  {
+    if ((worker = (PFORWARDING_WORKER)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(FORWARDING_WORKER))) == NULL ||
+        (worker->Ring.Slots = (PFORWARDING_SLOT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, FORWARDING_RING_SIZE * sizeof(FORWARDING_SLOT))) == NULL ||
+        (worker->WakeupEvent = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL)
+    {
+      LogMsg(DBG_ERROR, "ForwardingEngineStart(): Unable to allocate worker %d", counter);
+
+      if (worker != NULL && worker->Ring.Slots != NULL)
+      {
+        HeapFree(GetProcessHeap(), 0, worker->Ring.Slots);
+      }
+
+      if (worker != NULL)
+      {
+        HeapFree(GetProcessHeap(), 0, worker);
+      }
+
+      goto END;
+    }
+
+    worker->Index = counter;
+    worker->Engine = engineParam;
+    engineParam->Workers[counter] = worker;
+    engineParam->WorkerCount++;
+
+    if (ForwardingContextInit(&worker->Context, scanParams, writeHandlesParam[counter]) == FALSE)
+    {
+      LogMsg(DBG_ERROR, "ForwardingEngineStart(): Unable to set up worker %d", counter);
+      goto END;
+    }
+
+    // Replayed frames carry the file's timestamps
+    worker->Context.OfflineCapture = waitWhenFullParam;
+
+    _snprintf(sourceName, sizeof(sourceName) - 1, "worker %d ring", counter);
+    CaptureStatsAddQueue(sourceName, ForwardingRingStats, worker);
+    _snprintf(sourceName, sizeof(sourceName) - 1, "worker %d", counter);
+    CaptureStatsAddStage(sourceName, (uint64_t *)&worker->Context.Packets, NULL);
+    _snprintf(sourceName, sizeof(sourceName) - 1, "worker %d tx", counter);
+    CaptureStatsAddHandle(sourceName, writeHandlesParam[counter]);
+
+    if ((worker->ThreadHandle = CreateThread(NULL, 0, ForwardingWorkerThread, worker, 0, &threadId)) == NULL)
+    {
+      LogMsg(DBG_ERROR, "ForwardingEngineStart(): Unable to start worker %d: Error no=%d", counter, GetLastError());
+      goto END;
+    }
+  }
+
+  CaptureStatsAddStage("dispatched", (uint64_t *)&engineParam->Dispatched, NULL);
+  CaptureStatsAddStage("oversized", (uint64_t *)&engineParam->Oversized, NULL);
+  LogMsg(DBG_INFO, "ForwardingEngineStart(): %d forwarding workers started", engineParam->WorkerCount);
+  retVal = TRUE;
+
+END:
+
+  if (retVal == FALSE)
+  {
+    ForwardingEngineStop(engineParam);
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Capture layer callback. Runs on the capture thread, hands
+ * every IPv4 frame to the worker owning its flow.
+ *
+ */
+void ForwardingEngine_batch_handler(u_char *param, PCAPTURE_BATCH batch)
+{
+  PFORWARDING_ENGINE engine = (PFORWARDING_ENGINE)param;
+  PFORWARDING_WORKER worker = NULL;
+  PACKET_VIEW view;
+  unsigned int workerIndex = 0;
+  int counter = 0;
+
+  for (counter = 0; counter < batch->FrameCount; counter++)
+  {
+    PROBE_PACKET_RECEIVED(batch->Frames[counter], batch->Headers[counter]->caplen);
+
+    if (PacketViewParse(batch->Frames[counter], batch->Headers[counter]->caplen, &view) == FALSE ||
+        (view.Layers & PV_LAYER_IPV4) == 0)
+    {
+      engine->Ignored++;
+      continue;
+    }
+
+    PROBE_PACKET_PARSED(batch->Frames[counter], view.Layers);
+
+    workerIndex = (unsigned int)(((unsigned long long)ForwardingFlowHash(batch->Frames[counter], &view) * engine->WorkerCount) >> 32);
+    worker = engine->Workers[workerIndex];
+
+    if (ForwardingEnqueue(engine, worker, batch->Headers[counter], batch->Frames[counter], &view) == TRUE)
+    {
+      engine->Dispatched++;
+    }
+  }
+
+  // Make the whole batch visible at once
+  ForwardingReleaseWorkers(engine);
+}
+
+
+/*
+ * Let the workers drain their rings and flush their transmit
+ * queues, then stop and free them.
+ *
+ */
+void ForwardingEngineStop(PFORWARDING_ENGINE engineParam)
+{
+  int counter = 0;
+
+  ForwardingReleaseWorkers(engineParam);
+  STORE_RELEASE(&engineParam->StopRequested, 1);
+  CaptureStatsRemove(&engineParam->Dispatched);
+  CaptureStatsRemove(&engineParam->Oversized);
+
+  for (counter = 0; counter < engineParam->WorkerCount; counter++)
+  {
+    if (engineParam->Workers[counter]->ThreadHandle != NULL)
+    {
+      SetEvent(engineParam->Workers[counter]->WakeupEvent);
+      WaitForSingleObject(engineParam->Workers[counter]->ThreadHandle, INFINITE);
+      CloseHandle(engineParam->Workers[counter]->ThreadHandle);
+      engineParam->Workers[counter]->ThreadHandle = NULL;
+    }
+  }
+
+  ForwardingEnginePrintStats(engineParam);
+
+  for (counter = 0; counter < engineParam->WorkerCount; counter++)
+  {
+    CaptureStatsRemove(engineParam->Workers[counter]);
+    CaptureStatsRemove(&engineParam->Workers[counter]->Context.Packets);
+    CaptureStatsRemove(TransmitQueueGetHandle(engineParam->Workers[counter]->Context.TransmitQueue));
+    ForwardingContextRelease(&engineParam->Workers[counter]->Context);
+    CloseHandle(engineParam->Workers[counter]->WakeupEvent);
+    HeapFree(GetProcessHeap(), 0, engineParam->Workers[counter]->Ring.Slots);
+    HeapFree(GetProcessHeap(), 0, engineParam->Workers[counter]);
+    engineParam->Workers[counter] = NULL;
+  }
+
+  engineParam->WorkerCount = 0;
+}
+
+
+void ForwardingEnginePrintStats(PFORWARDING_ENGINE engineParam)
+{
+  PFORWARDING_WORKER worker = NULL;
+  TRANSMIT_QUEUE_STATS transmitStats;
+  int counter = 0;
+
+  LogMsg(DBG_INFO, "ForwardingEnginePrintStats(): %llu packets dispatched (%llu oversized), %llu non-IPv4 frames ignored",
+    engineParam->Dispatched, engineParam->Oversized, engineParam->Ignored);
+
+  for (counter = 0; counter < engineParam->WorkerCount; counter++)
+  {
+    worker = engineParam->Workers[counter];
+    TransmitQueueGetStats(worker->Context.TransmitQueue, &transmitStats);
+    LogMsg(DBG_INFO, "ForwardingEnginePrintStats(): Worker %d: %llu packets, %llu blocked, %llu send errors, %llu ring drops, %llu transmit batches, %llu/%llu flow cache hits/misses",
+      worker->Index, worker->Context.Packets, worker->Context.Blocked, worker->Context.SendErrors, worker->Ring.Dropped, (unsigned long long)transmitStats.Batches,
+      worker->Context.FlowCache.Hits, worker->Context.FlowCache.Misses);
+  }
+
+  if (engineParam->WorkerCount > 0 &&
+      engineParam->Workers[0]->Context.Latency != NULL)
+  {
+    LatencyStatsPrint();
+  }
+}
+
+
+/*
+ * Capture stats queue handler, contextParam is a worker.
+ * Head and tail are read without stopping the threads, the
+ * depth is a snapshot.
+ *
+ */
+void ForwardingRingStats(void *contextParam, PCAPTURE_STATS_QUEUE queueParam)
+{
+  PFORWARDING_WORKER worker = (PFORWARDING_WORKER)contextParam;
+  LONG tail = LOAD_ACQUIRE(&worker->Ring.Tail);
+  LONG head = LOAD_ACQUIRE(&worker->Ring.Head);
+
+  queueParam->Depth = (uint64_t)(unsigned long)(head - tail);
+  queueParam->Capacity = FORWARDING_RING_SIZE;
+  queueParam->Drops = worker->Ring.Dropped;
+}
+
+
+/*
+ * Symmetric flow hash. Source and destination are combined
+ * with XOR, so A->B and B->A hash the same. Fragmented
+ * datagrams are hashed on addresses and protocol only, the
+ * non-first fragments carry no ports.
+ *
+ */
+unsigned int ForwardingFlowHash(const u_char *data, PPACKET_VIEW viewParam)
+{
+  PIPHDR ipHdr = PV_IP(data, viewParam);
+  unsigned int hash = 0;
+  unsigned int srcIp = 0;
+  unsigned int dstIp = 0;
+
+  CopyMemory(&srcIp, &ipHdr->saddr, BIN_IP_LEN);
+  CopyMemory(&dstIp, &ipHdr->daddr, BIN_IP_LEN);
+
+  hash = (srcIp ^ dstIp) * 0x9e3779b1;
+  hash ^= viewParam->IpProto;
+
+  if ((PacketViewRead16(data + viewParam->L3Offset + 6) & 0x3fff) == 0)
+  {
+    hash ^= (unsigned int)(viewParam->SrcPort ^ viewParam->DstPort) << 8;
+  }
+
+  // Final mix (MurmurHash3 fmix32)
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+
+  return hash;
+}
+
+
+DWORD WINAPI ForwardingWorkerThread(LPVOID params)
+{
+  PFORWARDING_WORKER worker = (PFORWARDING_WORKER)params;
+  PFORWARDING_RING ring = &worker->Ring;
+  PFORWARDING_SLOT slot = NULL;
+  PACKET_INFO packetInfo;
+  unsigned char *data = NULL;
+  LONG tail = ring->Tail;
+  LONG head = 0;
+  int batchCounter = 0;
+  int spinCounter = 0;
+
+  while (1 == 1)
+  {
+    head = LOAD_ACQUIRE(&ring->Head);
+
+    if (head == tail)
+    {
+      // Nothing more to forward right now. Don't keep
+      // queued frames waiting for the next packet.
+      TransmitQueueFlush(worker->Context.TransmitQueue);
+
+      // The ring is empty and no more packets come in.
+      if (LOAD_ACQUIRE(&worker->Engine->StopRequested) != 0 &&
+          LOAD_ACQUIRE(&ring->Head) == tail)
+      {
+        break;
+      }
+
+      if (spinCounter++ < FORWARDING_SPIN_COUNT)
+      {
+        YieldProcessor();
+        continue;
+      }
+
+      // The capture thread sets the event if it sees
+      // Waiting after publishing new slots.
+      STORE_RELEASE(&ring->Waiting, 1);
+
+      if (LOAD_ACQUIRE(&ring->Head) == tail)
+      {
+        WaitForSingleObject(worker->WakeupEvent, FORWARDING_IDLE_WAIT);
+      }
+
+      STORE_RELEASE(&ring->Waiting, 0);
+      spinCounter = 0;
+      continue;
+    }
+
+    spinCounter = 0;
+
+    for (batchCounter = 0; head != tail && batchCounter < FORWARDING_WORKER_BATCH; batchCounter++)
+    {
+      slot = &ring->Slots[tail & (FORWARDING_RING_SIZE - 1)];
+      data = slot->Oversize != NULL ? slot->Oversize : slot->Data;
+      PreparePacketInfo(data, slot->DataLength, &slot->View, &packetInfo);
+
+      if (worker->Context.OfflineCapture == FALSE)
+      {
+        packetInfo.captureTimeUs = slot->CaptureTimeUs;
+      }
+
+      // The transmit queue keeps a copy of the frame
+      ForwardPacket(&worker->Context, &packetInfo);
+
+      if (slot->Oversize != NULL)
+      {
+        HeapFree(GetProcessHeap(), 0, slot->Oversize);
+        slot->Oversize = NULL;
+      }
+
+      tail++;
+    }
+
+    STORE_RELEASE(&ring->Tail, tail);
+  }
+
+  return 0;
+}
+
+
+
+/*
+ * Copy the frame into the next free slot of the worker's ring,
+ * a frame larger than the slot into a heap copy the slot points
+ * at. The slot becomes visible to the worker in
+ * ForwardingPublish().
+ *
+ */
+static BOOL ForwardingEnqueue(PFORWARDING_ENGINE engineParam, PFORWARDING_WORKER workerParam, const struct pcap_pkthdr *pktHeader, const u_char *data, PPACKET_VIEW viewParam)
+{
+  PFORWARDING_RING ring = &workerParam->Ring;
+  PFORWARDING_SLOT slot = NULL;
+  unsigned char *oversize = NULL;
+  unsigned int dataLength = pktHeader->caplen;
+
+  if (ring->PendingHead - ring->CachedTail >= FORWARDING_RING_SIZE)
+  {
+    ring->CachedTail = LOAD_ACQUIRE(&ring->Tail);
+
+    // Replayed traffic waits for the worker, everything
+    // published so far has to be visible first.
+    while (engineParam->WaitWhenFull == TRUE &&
+           ring->PendingHead - ring->CachedTail >= FORWARDING_RING_SIZE)
+    {
+      ForwardingPublish(workerParam);
+      SwitchToThread();
+      ring->CachedTail = LOAD_ACQUIRE(&ring->Tail);
+    }
+
+    if (ring->PendingHead - ring->CachedTail >= FORWARDING_RING_SIZE)
+    {
+      ring->Dropped++;
+      return FALSE;
+    }
+  }
+
+  if (dataLength > FORWARDING_SLOT_SIZE)
+  {
+    if ((oversize = (unsigned char *)HeapAlloc(GetProcessHeap(), 0, dataLength)) == NULL)
+    {
+      ring->Dropped++;
+      return FALSE;
+    }
+
+    engineParam->Oversized++;
+  }
+
+  slot = &ring->Slots[ring->PendingHead & (FORWARDING_RING_SIZE - 1)];
+  slot->DataLength = dataLength;
+  slot->CaptureTimeUs = (uint64_t)pktHeader->ts.tv_sec * 1000000 + (uint64_t)pktHeader->ts.tv_usec;
+  slot->Oversize = oversize;
+  CopyMemory(&slot->View, viewParam, sizeof(PACKET_VIEW));
+  CopyMemory(oversize != NULL ? oversize : slot->Data, data, dataLength);
+  ring->PendingHead++;
+
+  return TRUE;
+}
+
+
+static void ForwardingPublish(PFORWARDING_WORKER workerParam)
+{
+  PFORWARDING_RING ring = &workerParam->Ring;
+
+  if (ring->PendingHead == ring->Head)
+  {
+    return;
+  }
+
+  STORE_RELEASE(&ring->Head, ring->PendingHead);
+
+  if (LOAD_ACQUIRE(&ring->Waiting) != 0)
+  {
+    SetEvent(workerParam->WakeupEvent);
+  }
+}
+
+
+static void ForwardingReleaseWorkers(PFORWARDING_ENGINE engineParam)
+{
+  int counter = 0;
+
+  for (counter = 0; counter < engineParam->WorkerCount; counter++)
+  {
+    ForwardingPublish(engineParam->Workers[counter]);
+  }
+}
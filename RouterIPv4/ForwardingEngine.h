@@ -0,0 +1,116 @@
+#pragma once
+
+#include <windows.h>
+
+#include "CaptureStats.h"
+#include "PacketCapture.h"
+#include "PacketHandlerIPv4Forwarding.h"
+#include "PacketView.h"
+#include "RouterIPv4.h"
+
+/*
+ * Flow sharded forwarding.
+ *
+ * The capture thread decodes every frame once, hashes the IPv4
+ * addresses, protocol and ports and copies the frame into the ring of
+ * the worker the hash selects. The hash is symmetric, both directions
+ * of a connection end up at the same worker. Fragments are hashed
+ * without ports so all fragments of a datagram stay together.
+ *
+ * Every ring has exactly one producer (the capture thread) and one
+ * consumer (its worker), so neither side takes a lock and the packets
+ * of one flow leave in the order they arrived. Every worker forwards
+ * with its own FORWARDING_CONTEXT and sends through its own transmit
+ * queue on its own transmit handle.
+ *
+ * On live traffic a frame that finds its ring full is dropped and
+ * counted, the capture thread never waits for a worker. Replayed
+ * traffic (WaitWhenFull) waits instead.
+ *
+ * Frames larger than a slot (jumbo frames, frames the NIC merged
+ * with GRO/LRO) take the same way. Their slot points at a heap copy
+ * of the frame that the worker frees once it forwarded it, so they
+ * keep their place in the order of their flow.
+ *
+ */
+
+#define FORWARDING_MAX_WORKERS 16
+#define FORWARDING_RING_SIZE 1024       // Slots per worker, power of 2
+#define FORWARDING_SLOT_SIZE 2048       // Largest frame a slot holds
+#define FORWARDING_WORKER_BATCH 64      // Slots a worker frees at once
+#define FORWARDING_SPIN_COUNT 256
+#define FORWARDING_IDLE_WAIT 1          // ms
+
+// Overrides the number of forwarding workers
+#define FORWARDING_WORKERS_ENV "ROUTERIPV4_WORKERS"
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  unsigned int DataLength;
+  uint64_t CaptureTimeUs;
+  PACKET_VIEW View;
+  unsigned char *Oversize;              // Heap copy of a frame larger than Data, or NULL
+  unsigned char Data[FORWARDING_SLOT_SIZE];
+} FORWARDING_SLOT, *PFORWARDING_SLOT;
+
+
+typedef struct
+{
+  // Written by the capture thread
+  volatile LONG Head;
+  LONG PendingHead;
+  LONG CachedTail;
+  unsigned long long Dropped;
+  char Padding1[40];
+
+  // Written by the worker
+  volatile LONG Tail;
+  volatile LONG Waiting;
+  char Padding2[56];
+
+  PFORWARDING_SLOT Slots;
+} FORWARDING_RING, *PFORWARDING_RING;
+
+
+typedef struct FORWARDING_ENGINE FORWARDING_ENGINE, *PFORWARDING_ENGINE;
+
+typedef struct
+{
+  FORWARDING_RING Ring;
+  int Index;
+  HANDLE ThreadHandle;
+  HANDLE WakeupEvent;
+  PFORWARDING_ENGINE Engine;
+  FORWARDING_CONTEXT Context;
+} FORWARDING_WORKER, *PFORWARDING_WORKER;
+
+
+struct FORWARDING_ENGINE
+{
+  int WorkerCount;
+  BOOL WaitWhenFull;
+  volatile LONG StopRequested;
+  unsigned long long Dispatched;
+  unsigned long long Ignored;
+  unsigned long long Oversized;
+  PFORWARDING_WORKER Workers[FORWARDING_MAX_WORKERS];
+};
+
+
+/*
+ * Function forward declarations
+ *
+ */
+int ForwardingEngineWorkerCount();
+BOOL ForwardingEngineStart(PFORWARDING_ENGINE engineParam, PSCANPARAMS scanParams, int workerCountParam, PCAPTURE_HANDLE *writeHandlesParam, BOOL waitWhenFullParam);
+void ForwardingEngine_batch_handler(u_char *param, PCAPTURE_BATCH batch);
+void ForwardingEngineStop(PFORWARDING_ENGINE engineParam);
+void ForwardingEnginePrintStats(PFORWARDING_ENGINE engineParam);
+void ForwardingRingStats(void *contextParam, PCAPTURE_STATS_QUEUE queueParam);
+unsigned int ForwardingFlowHash(const u_char *data, PPACKET_VIEW viewParam);
+DWORD WINAPI ForwardingWorkerThread(LPVOID params);
@@ -12,6 +12,10 @@
 
 extern CRITICAL_SECTION gCSFirewallRules;
 
+// Bumped on every change of the rules. Readers caching
+// firewall verdicts compare it to notice changes.
+volatile LONG gFirewallRulesGeneration = 0;
+
 
 
 PRULENODE InitFirewallRules()
@@ -44,6 +48,7 @@ void AddRuleToList(PPRULENODE listHead, PRULENODE newRule)
   // Set the new record at the head of the list
   ((PRULENODE)*listHead)->prev = newRule;
   *listHead = newRule;
+  InterlockedIncrement(&gFirewallRulesGeneration);
 
 END:
 
@@ -52,6 +57,24 @@ END:
 
 
 
+/*
+ * Free all rules and the tail
+ *
+ */
+void FreeFirewallRules(PRULENODE listHead)
+{
+  PRULENODE tmpRule = NULL;
+
+  while (listHead != NULL)
+  {
+    tmpRule = listHead->next;
+    HeapFree(GetProcessHeap(), 0, listHead);
+    listHead = tmpRule;
+  }
+}
+
+
+
 int FirewallRulesCountNodes(PRULENODE allConNodesParam)
 {
   int retVal = 0;
@@ -33,6 +33,7 @@ typedef struct RULENODESTRUCT
 
 PRULENODE InitFirewallRules();
 void AddRuleToList(PPRULENODE listHead, PRULENODE pTmpRuleNode);
+void FreeFirewallRules(PRULENODE listHead);
 int FirewallRulesCountNodes(PRULENODE allConNodlistHeadesParam);
 void PrintAllFirewallRulesNodes(PRULENODE listHead);
 PRULENODE FirewallBlockRuleMatch(PRULENODE listHead, char *protocolParam, unsigned long srcIpParam, unsigned long dstIpParam, unsigned short srcPortParam, unsigned short dstPortParam);
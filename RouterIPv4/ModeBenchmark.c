@@ -0,0 +1,1305 @@
+#define HAVE_REMOTE
+
+#include <pcap.h>
+#include <stdio.h>
+#include <Shlwapi.h>
+#include <windows.h>
+
+#include "Benchmark.h"
+#include "Config.h"
+#include "ForwardingEngine.h"
+#include "HostTable.h"
+#include "LinkedListFirewallRules.h"
+#include "Logging.h"
+#include "ModeBenchmark.h"
+#include "NetworkHelperFunctions.h"
+#include "PacketCapture.h"
+#include "PacketHandlerIPv4Forwarding.h"
+#include "RouterIPv4.h"
+#include "TransmitQueue.h"
+
+
+// Global/external variables
+extern int gDEBUGLEVEL;
+extern SCANPARAMS gScanParams;
+extern PHOST_TABLE gTargetSystems;
+
+
+static BOOL BenchmarkOversizedFrame(int workerCountParam);
+static uint64_t MicroPrepareDataPacketStructure(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroChecksum(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroChecksumUpdate16(void *contextParam, uint64_t iterationsParam);
+static BOOL MicroChecksumVerify();
+static uint64_t MicroIpBin2String(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroMacBin2String(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroFirewallBlockRuleMatch(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroFirewallClassify(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroHostTableLookupIp(void *contextParam, uint64_t iterationsParam);
+
+
+/*
+ * Replay benchmark
+ *
+ * param   pcap file, loop count
+ *   -b     {...}
+ *
+ * Feeds the pcap file through PacketForwarding_handler as fast
+ * as possible. The frames come from memory and forwarded frames
+ * end in the replay handle's null sink, so no interface and no
+ * administrator permissions are needed. .targethosts and .fwrules
+ * in the current directory are used if present.
+ *
+ * The file is then replayed through the forwarding engine with
+ * ForwardingEngineWorkerCount() workers, each sending into its
+ * own null sink. At the end a frame larger than the engine's
+ * ring slots has to come out of the engine in one piece.
+ *
+ */
+int InitializeBenchmark(int loopCountParam)
+{
+  int retVal = 0;
+  char errorBuffer[CAPTURE_ERRBUF_SIZE];
+  PBENCHMARK_RUN benchmarkRun = NULL;
+  PFORWARDING_CONTEXT forwardingContext = NULL;
+
+  ZeroMemory(errorBuffer, sizeof(errorBuffer));
+
+  // Logging would be all we measure
+  gDEBUGLEVEL = DBG_OFF;
+
+  if (PathFileExists(FILE_HOST_TARGETS))
+  {
+    ParseTargetHostsConfigFile(FILE_HOST_TARGETS, gTargetSystems);
+  }
+
+  ParseFirewallConfigFile(FILE_FIREWALL_RULES);
+
+  if ((benchmarkRun = (PBENCHMARK_RUN)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(BENCHMARK_RUN))) == NULL ||
+      (forwardingContext = (PFORWARDING_CONTEXT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(FORWARDING_CONTEXT))) == NULL)
+  {
+    retVal = 1;
+    goto END;
+  }
+
+  if ((gScanParams.InterfaceReadHandle = CaptureOpenReplay((char *)gScanParams.PcapFilePath, loopCountParam, errorBuffer)) == NULL)
+  {
+    fprintf(stderr, "Unable to open the file %s.\nerror=%s\n", gScanParams.PcapFilePath, errorBuffer);
+    retVal = 2;
+    goto END;
+  }
+
+  gScanParams.InterfaceWriteHandle = gScanParams.InterfaceReadHandle;
+
+  if (ForwardingContextInit(forwardingContext, &gScanParams, (PCAPTURE_HANDLE)gScanParams.InterfaceWriteHandle) == FALSE)
+  {
+    retVal = 5;
+    goto END;
+  }
+
+  forwardingContext->OfflineCapture = TRUE;
+
+  if (BenchmarkReplay((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle, "PacketForwarding_handler", (BENCHMARK_PACKET_HANDLER)PacketForwarding_handler, (unsigned char *)forwardingContext, benchmarkRun) == FALSE)
+  {
+    fprintf(stderr, "Replay failed: %s\n", CaptureGetError((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle));
+    retVal = 3;
+    goto END;
+  }
+
+  // Count the frames still queued at the end of the replay
+  TransmitQueueFlush(forwardingContext->TransmitQueue);
+  CaptureGetSentCounters((PCAPTURE_HANDLE)gScanParams.InterfaceWriteHandle, &benchmarkRun->SentPackets, &benchmarkRun->SentBytes);
+  BenchmarkPrintReport(benchmarkRun);
+
+  if (BenchmarkForwardingEngine((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle, ForwardingEngineWorkerCount()) == FALSE ||
+      BenchmarkOversizedFrame(ForwardingEngineWorkerCount()) == FALSE)
+  {
+    retVal = 4;
+  }
+
+END:
+
+  if (forwardingContext != NULL)
+  {
+    ForwardingContextRelease(forwardingContext);
+    HeapFree(GetProcessHeap(), 0, forwardingContext);
+  }
+
+  if (gScanParams.InterfaceReadHandle != NULL)
+  {
+    CaptureClose(gScanParams.InterfaceReadHandle);
+    gScanParams.InterfaceReadHandle = NULL;
+    gScanParams.InterfaceWriteHandle = NULL;
+  }
+
+  if (benchmarkRun != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, benchmarkRun);
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Replay the file once more through the forwarding engine.
+ * The capture thread waits for full rings instead of
+ * dropping, so every frame is forwarded. The time includes
+ * draining the rings.
+ *
+ */
+BOOL BenchmarkForwardingEngine(PCAPTURE_HANDLE replayHandle, int workerCountParam)
+{
+  BOOL retVal = FALSE;
+  FORWARDING_ENGINE engine;
+  PCAPTURE_HANDLE sinkHandles[FORWARDING_MAX_WORKERS];
+  char errorBuffer[CAPTURE_ERRBUF_SIZE];
+  uint64_t startTime = 0;
+  uint64_t elapsedNs = 0;
+  uint64_t dispatched = 0;
+  uint64_t sentPackets = 0;
+  uint64_t sentBytes = 0;
+  uint64_t workerPackets = 0;
+  uint64_t workerBytes = 0;
+  double seconds = 0;
+  int counter = 0;
+
+  ZeroMemory(sinkHandles, sizeof(sinkHandles));
+  ZeroMemory(errorBuffer, sizeof(errorBuffer));
+
+  for (counter = 0; counter < workerCountParam; counter++)
+  {
+    if ((sinkHandles[counter] = CaptureOpenNullSink(errorBuffer)) == NULL)
+    {
+      fprintf(stderr, "%s\n", errorBuffer);
+      goto END;
+    }
+  }
+
+  if (ForwardingEngineStart(&engine, &gScanParams, workerCountParam, sinkHandles, TRUE) == FALSE)
+  {
+    fprintf(stderr, "Unable to start the forwarding engine\n");
+    goto END;
+  }
+
+  startTime = BenchmarkNow();
+  CaptureDispatchLoop(replayHandle, ForwardingEngine_batch_handler, (unsigned char *)&engine);
+  dispatched = engine.Dispatched;
+  ForwardingEngineStop(&engine);
+  elapsedNs = BenchmarkNow() - startTime;
+  seconds = (double)elapsedNs / 1e9;
+
+  printf("ForwardingEngine (%d workers)\n", workerCountParam);
+  printf("  packets      : %llu\n", (unsigned long long)dispatched);
+
+  if (dispatched > 0)
+  {
+    printf("  throughput   : %.0f pps, %.1f ns/packet\n", seconds > 0 ? (double)dispatched / seconds : 0, (double)elapsedNs / (double)dispatched);
+  }
+
+  for (counter = 0; counter < workerCountParam; counter++)
+  {
+    CaptureGetSentCounters(sinkHandles[counter], &workerPackets, &workerBytes);
+    printf("  worker %-2d    : %llu packets sent\n", counter, (unsigned long long)workerPackets);
+    sentPackets += workerPackets;
+    sentBytes += workerBytes;
+  }
+
+  printf("  sent         : %llu packets (%llu bytes)\n\n", (unsigned long long)sentPackets, (unsigned long long)sentBytes);
+  retVal = TRUE;
+
+END:
+
+  for (counter = 0; counter < FORWARDING_MAX_WORKERS; counter++)
+  {
+    if (sinkHandles[counter] != NULL)
+    {
+      CaptureClose(sinkHandles[counter]);
+    }
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Firewall benchmark
+ *
+ * param   lookup count
+ *   -r     {...}
+ *
+ * Generates rule sets of 10, 1000 and 10000 rules and times
+ * FirewallBlockRuleMatch() on the rule list against
+ * FirewallClassify() on the compiled rules. Half of the
+ * lookups are built to hit a rule, the rest are random.
+ * Both have to return the same rule for every lookup.
+ *
+ * The "mixed" sets look like real rule files. In the
+ * "overlapping" sets all rules share their addresses, have
+ * nested destination port ranges and distinct source port
+ * ranges, the worst case for the compiled segments. Their
+ * groups have to end up being matched rule by rule.
+ *
+ */
+int InitializeFirewallBenchmark(int lookupCountParam)
+{
+  int retVal = 0;
+  int ruleCounts[] = { 10, 1000, 10000 };
+  int ruleSets[] = { FIREWALL_RULES_MIXED, FIREWALL_RULES_OVERLAPPING };
+  PFIREWALL_LOOKUP lookups = NULL;
+  int counter = 0;
+  int counter2 = 0;
+
+  gDEBUGLEVEL = DBG_OFF;
+
+  if (lookupCountParam <= 0)
+  {
+    lookupCountParam = FIREWALL_BENCHMARK_LOOKUPS;
+  }
+
+  if ((lookups = (PFIREWALL_LOOKUP)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, lookupCountParam * sizeof(FIREWALL_LOOKUP))) == NULL)
+  {
+    retVal = 1;
+    goto END;
+  }
+
+  printf("Firewall rule matching, %d lookups per pass\n", lookupCountParam);
+  printf("  %-11s %6s %8s %10s %8s %10s %14s %14s %8s %10s\n", "set", "rules", "groups", "segments", "linear", "compile ms", "list ns/op", "compiled ns/op", "blocked", "mismatches");
+
+  for (counter2 = 0; counter2 < (int)(sizeof(ruleSets) / sizeof(ruleSets[0])) && retVal == 0; counter2++)
+  {
+    for (counter = 0; counter < (int)(sizeof(ruleCounts) / sizeof(ruleCounts[0])); counter++)
+    {
+      if (BenchmarkFirewallRules(ruleCounts[counter], ruleSets[counter2], lookups, lookupCountParam) == FALSE)
+      {
+        retVal = 2;
+        break;
+      }
+    }
+  }
+
+  printf("\n");
+
+END:
+
+  if (lookups != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, lookups);
+  }
+
+  return retVal;
+}
+
+
+/*
+ * xorshift, the rule sets only have to be
+ * the same from run to run
+ *
+ */
+static unsigned int FirewallBenchmarkRandom(uint64_t *stateParam, unsigned int rangeParam)
+{
+  *stateParam ^= *stateParam << 13;
+  *stateParam ^= *stateParam >> 7;
+  *stateParam ^= *stateParam << 17;
+
+  return (unsigned int)(*stateParam % rangeParam);
+}
+
+
+/*
+ * Time one matcher over all lookups until
+ * FIREWALL_BENCHMARK_MIN_TIME has passed
+ *
+ */
+static double FirewallBenchmarkTime(PRULENODE rulesParam, PFIREWALL_CLASSIFIER classifierParam, PFIREWALL_LOOKUP lookupsParam, int lookupCountParam, uint64_t *blockedParam)
+{
+  uint64_t startTime = BenchmarkNow();
+  uint64_t elapsedNs = 0;
+  uint64_t lookups = 0;
+  PRULENODE rule = NULL;
+  int counter = 0;
+
+  *blockedParam = 0;
+
+  do
+  {
+    for (counter = 0; counter < lookupCountParam; counter++)
+    {
+      if (classifierParam != NULL)
+      {
+        rule = FirewallClassify(classifierParam, lookupsParam[counter].Protocol, lookupsParam[counter].SrcIpBin, lookupsParam[counter].DstIpBin, lookupsParam[counter].SrcPort, lookupsParam[counter].DstPort);
+      }
+      else
+      {
+        rule = FirewallBlockRuleMatch(rulesParam, lookupsParam[counter].Protocol, lookupsParam[counter].SrcIpBin, lookupsParam[counter].DstIpBin, lookupsParam[counter].SrcPort, lookupsParam[counter].DstPort);
+      }
+
+      if (rule != NULL)
+      {
+        (*blockedParam)++;
+      }
+    }
+
+    lookups += lookupCountParam;
+    elapsedNs = BenchmarkNow() - startTime;
+  } while (elapsedNs < FIREWALL_BENCHMARK_MIN_TIME);
+
+  *blockedParam = *blockedParam * lookupCountParam / lookups;
+
+  return (double)elapsedNs / (double)lookups;
+}
+
+
+/*
+ * Rule set of ruleCountParam generated rules of the kind
+ * ruleSetParam and lookupCountParam lookups against it.
+ * Returns NULL if out of memory.
+ *
+ */
+static PRULENODE FirewallBenchmarkRuleSet(int ruleCountParam, int ruleSetParam, PFIREWALL_LOOKUP lookupsParam, int lookupCountParam)
+{
+  PRULENODE rules = NULL;
+  PRULENODE rule = NULL;
+  PRULENODE *ruleArray = NULL;
+  PFIREWALL_LOOKUP lookup = NULL;
+  uint64_t randomState = 0x2545f4914f6cdd1dULL;
+  int hostCount = ruleCountParam / 4 + 1;
+  int counter = 0;
+
+  if ((rules = InitFirewallRules()) == NULL ||
+      (ruleArray = (PRULENODE *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, ruleCountParam * sizeof(PRULENODE))) == NULL)
+  {
+    goto END;
+  }
+
+  // Mostly per host rules on single destination
+  // ports, some wildcards and port ranges.
+  for (counter = 0; counter < ruleCountParam; counter++)
+  {
+    if ((rule = (PRULENODE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(RULENODE))) == NULL)
+    {
+      goto END;
+    }
+
+    // One group, every destination segment covered by
+    // all rules starting below it
+    if (ruleSetParam == FIREWALL_RULES_OVERLAPPING)
+    {
+      strncpy(rule->Protocol, "TCP", sizeof(rule->Protocol) - 1);
+      rule->SrcIPBin = htonl(0x0a000001);
+      rule->DstIPBin = htonl(0xc0a80001);
+      rule->SrcPortLower = (unsigned short)(1024 + 6 * (counter % 10000));
+      rule->SrcPortUpper = rule->SrcPortLower + 2;
+      rule->DstPortLower = (unsigned short)(1 + counter % 30000);
+      rule->DstPortUpper = (unsigned short)(65534 - counter % 30000);
+
+      snprintf(rule->Descr, sizeof(rule->Descr) - 1, "benchmark rule %d", counter);
+      AddRuleToList(&rules, rule);
+      ruleArray[counter] = rule;
+      continue;
+    }
+
+    strncpy(rule->Protocol, FirewallBenchmarkRandom(&randomState, 4) == 0 ? "UDP" : "TCP", sizeof(rule->Protocol) - 1);
+
+    if (FirewallBenchmarkRandom(&randomState, 4) != 0)
+    {
+      rule->SrcIPBin = htonl(0x0a000000 | (1 + FirewallBenchmarkRandom(&randomState, hostCount)));
+    }
+
+    if (FirewallBenchmarkRandom(&randomState, 2) != 0)
+    {
+      rule->DstIPBin = htonl(0xc0a80000 | (1 + FirewallBenchmarkRandom(&randomState, hostCount)));
+    }
+
+    if (FirewallBenchmarkRandom(&randomState, 4) == 0)
+    {
+      rule->SrcPortLower = 1024;
+      rule->SrcPortUpper = 65535;
+    }
+
+    rule->DstPortLower = (unsigned short)(1 + FirewallBenchmarkRandom(&randomState, 60000));
+    rule->DstPortUpper = rule->DstPortLower;
+
+    if (FirewallBenchmarkRandom(&randomState, 4) == 0)
+    {
+      rule->DstPortUpper += 99;
+    }
+
+    snprintf(rule->Descr, sizeof(rule->Descr) - 1, "benchmark rule %d", counter);
+    AddRuleToList(&rules, rule);
+    ruleArray[counter] = rule;
+  }
+
+  for (counter = 0; counter < lookupCountParam; counter++)
+  {
+    lookup = &lookupsParam[counter];
+
+    // Built to hit the rule, unless an earlier one hits first
+    if ((counter & 1) == 0)
+    {
+      rule = ruleArray[FirewallBenchmarkRandom(&randomState, ruleCountParam)];
+      lookup->Protocol = strcmp(rule->Protocol, "UDP") == 0 ? "UDP" : "TCP";
+      lookup->SrcIpBin = rule->SrcIPBin != 0 ? rule->SrcIPBin : htonl(0x0a000000 | (1 + FirewallBenchmarkRandom(&randomState, hostCount)));
+      lookup->DstIpBin = rule->DstIPBin != 0 ? rule->DstIPBin : htonl(0xc0a80000 | (1 + FirewallBenchmarkRandom(&randomState, hostCount)));
+      lookup->SrcPort = (unsigned short)(1024 + FirewallBenchmarkRandom(&randomState, 64512));
+      lookup->DstPort = (unsigned short)(rule->DstPortLower + FirewallBenchmarkRandom(&randomState, rule->DstPortUpper - rule->DstPortLower + 1));
+
+      if (ruleSetParam == FIREWALL_RULES_OVERLAPPING)
+      {
+        lookup->SrcPort = (unsigned short)(rule->SrcPortLower + FirewallBenchmarkRandom(&randomState, rule->SrcPortUpper - rule->SrcPortLower + 1));
+      }
+    }
+    else
+    {
+      lookup->Protocol = FirewallBenchmarkRandom(&randomState, 8) == 0 ? "ICMP" : (FirewallBenchmarkRandom(&randomState, 4) == 0 ? "UDP" : "TCP");
+      lookup->SrcIpBin = htonl(0x0a000000 | (1 + FirewallBenchmarkRandom(&randomState, hostCount)));
+      lookup->DstIpBin = htonl(0xc0a80000 | (1 + FirewallBenchmarkRandom(&randomState, hostCount)));
+      lookup->SrcPort = (unsigned short)(1024 + FirewallBenchmarkRandom(&randomState, 64512));
+      lookup->DstPort = (unsigned short)(1 + FirewallBenchmarkRandom(&randomState, 65535));
+    }
+  }
+
+  HeapFree(GetProcessHeap(), 0, ruleArray);
+
+  return rules;
+
+END:
+
+  FreeFirewallRules(rules);
+
+  if (ruleArray != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, ruleArray);
+  }
+
+  return NULL;
+}
+
+
+BOOL BenchmarkFirewallRules(int ruleCountParam, int ruleSetParam, PFIREWALL_LOOKUP lookupsParam, int lookupCountParam)
+{
+  BOOL retVal = FALSE;
+  PRULENODE rules = NULL;
+  PFIREWALL_CLASSIFIER classifier = NULL;
+  FIREWALL_CLASSIFIER_STATS stats;
+  PFIREWALL_LOOKUP lookup = NULL;
+  uint64_t listBlocked = 0;
+  uint64_t compiledBlocked = 0;
+  uint64_t startTime = 0;
+  double compileMs = 0;
+  double listNs = 0;
+  double compiledNs = 0;
+  int mismatches = 0;
+  int counter = 0;
+
+  if ((rules = FirewallBenchmarkRuleSet(ruleCountParam, ruleSetParam, lookupsParam, lookupCountParam)) == NULL)
+  {
+    goto END;
+  }
+
+  startTime = BenchmarkNow();
+
+  if ((classifier = FirewallClassifierCompile(rules)) == NULL)
+  {
+    goto END;
+  }
+
+  compileMs = (double)(BenchmarkNow() - startTime) / 1e6;
+
+  for (counter = 0; counter < lookupCountParam; counter++)
+  {
+    lookup = &lookupsParam[counter];
+
+    if (FirewallBlockRuleMatch(rules, lookup->Protocol, lookup->SrcIpBin, lookup->DstIpBin, lookup->SrcPort, lookup->DstPort) !=
+        FirewallClassify(classifier, lookup->Protocol, lookup->SrcIpBin, lookup->DstIpBin, lookup->SrcPort, lookup->DstPort))
+    {
+      mismatches++;
+    }
+  }
+
+  listNs = FirewallBenchmarkTime(rules, NULL, lookupsParam, lookupCountParam, &listBlocked);
+  compiledNs = FirewallBenchmarkTime(NULL, classifier, lookupsParam, lookupCountParam, &compiledBlocked);
+  FirewallClassifierGetStats(classifier, &stats);
+
+  printf("  %-11s %6d %8d %10d %8d %10.1f %14.1f %14.1f %7.1f%% %10d\n", ruleSetParam == FIREWALL_RULES_OVERLAPPING ? "overlapping" : "mixed",
+    ruleCountParam, stats.Groups, stats.DstSegments + stats.SrcSegments, stats.LinearRules, compileMs,
+    listNs, compiledNs, 100.0 * (double)compiledBlocked / (double)lookupCountParam, mismatches);
+
+  retVal = mismatches == 0 && listBlocked == compiledBlocked;
+
+  // More segments than the limit allows without it
+  if (ruleSetParam == FIREWALL_RULES_OVERLAPPING &&
+      ruleCountParam >= 1000 &&
+      stats.LinearGroups == 0)
+  {
+    retVal = FALSE;
+  }
+
+END:
+
+  FirewallClassifierRelease(classifier);
+  FreeFirewallRules(rules);
+
+  return retVal;
+}
+
+
+/*
+ * Host table benchmark
+ *
+ * param   host count
+ *   -t     {...}
+ *
+ * Fills host tables of 16, 1024 and hostCountParam systems and
+ * times lookups by IP address (hits and misses) and by MAC
+ * address. For comparison the same hits are searched with a
+ * linear scan over the hosts, the way the target system lists
+ * were searched before. The ns/op of the table should not grow
+ * with the number of hosts.
+ *
+ */
+int InitializeHostTableBenchmark(int hostCountParam)
+{
+  int retVal = 0;
+  int hostCounts[] = { 16, 1024, HOST_TABLE_BENCHMARK_HOSTS };
+  int counter = 0;
+
+  gDEBUGLEVEL = DBG_OFF;
+
+  if (hostCountParam <= 0 || hostCountParam > HOST_TABLE_MAX_CAPACITY)
+  {
+    hostCountParam = HOST_TABLE_BENCHMARK_HOSTS;
+  }
+
+  hostCounts[2] = hostCountParam;
+
+  printf("Target system lookups, %d lookups per pass\n", HOST_TABLE_BENCHMARK_LOOKUPS);
+  printf("  %8s %12s %12s %12s %12s %8s\n", "hosts", "ip ns/op", "miss ns/op", "mac ns/op", "scan ns/op", "errors");
+
+  for (counter = 0; counter < (int)(sizeof(hostCounts) / sizeof(hostCounts[0])); counter++)
+  {
+    if (counter > 0 && hostCounts[counter] <= hostCounts[counter - 1])
+    {
+      continue;
+    }
+
+    if (BenchmarkHostTable(hostCounts[counter], HOST_TABLE_BENCHMARK_LOOKUPS) == FALSE)
+    {
+      retVal = 2;
+      break;
+    }
+  }
+
+  printf("\n");
+
+  return retVal;
+}
+
+
+/*
+ * Benchmark host number n: IP 10.0.0.0 + n + 1,
+ * MAC 02:00 followed by the same 32 bits
+ *
+ */
+static void HostTableBenchmarkHost(unsigned int hostParam, unsigned char ipBinParam[HOST_IP_LEN], unsigned char macBinParam[HOST_MAC_LEN])
+{
+  unsigned int ipAddress = 0x0a000000 + hostParam + 1;
+
+  ipBinParam[0] = (unsigned char)(ipAddress >> 24);
+  ipBinParam[1] = (unsigned char)(ipAddress >> 16);
+  ipBinParam[2] = (unsigned char)(ipAddress >> 8);
+  ipBinParam[3] = (unsigned char)ipAddress;
+
+  macBinParam[0] = 0x02;
+  macBinParam[1] = 0x00;
+  CopyMemory(&macBinParam[2], ipBinParam, HOST_IP_LEN);
+}
+
+
+/*
+ * Time one kind of lookup over all keys until
+ * FIREWALL_BENCHMARK_MIN_TIME has passed. Returns
+ * ns per lookup, the hits of one pass go to foundParam.
+ *
+ */
+static double HostTableBenchmarkTime(PHOST_TABLE hostTableParam, PHOST_ENTRY hostsParam, int hostCountParam, PHOST_ENTRY keysParam, int keyCountParam, int lookupTypeParam, int *foundParam)
+{
+  uint64_t startTime = BenchmarkNow();
+  uint64_t elapsedNs = 0;
+  uint64_t lookups = 0;
+  HOST_ENTRY host;
+  int counter = 0;
+  int hostCounter = 0;
+  int found = 0;
+
+  do
+  {
+    found = 0;
+
+    for (counter = 0; counter < keyCountParam; counter++)
+    {
+      if (lookupTypeParam == HOST_LOOKUP_IP)
+      {
+        found += HostTableLookupIp(hostTableParam, keysParam[counter].IpBin, &host) == TRUE ? 1 : 0;
+      }
+      else if (lookupTypeParam == HOST_LOOKUP_MAC)
+      {
+        found += HostTableLookupMac(hostTableParam, keysParam[counter].MacBin, &host) == TRUE ? 1 : 0;
+      }
+      else
+      {
+        for (hostCounter = 0; hostCounter < hostCountParam; hostCounter++)
+        {
+          if (memcmp(hostsParam[hostCounter].IpBin, keysParam[counter].IpBin, HOST_IP_LEN) == 0)
+          {
+            CopyMemory(&host, &hostsParam[hostCounter], sizeof(HOST_ENTRY));
+            found++;
+            break;
+          }
+        }
+      }
+    }
+
+    lookups += keyCountParam;
+    elapsedNs = BenchmarkNow() - startTime;
+  } while (elapsedNs < FIREWALL_BENCHMARK_MIN_TIME);
+
+  *foundParam = found;
+
+  return (double)elapsedNs / (double)lookups;
+}
+
+
+BOOL BenchmarkHostTable(int hostCountParam, int lookupCountParam)
+{
+  BOOL retVal = FALSE;
+  PHOST_TABLE hostTable = NULL;
+  PHOST_ENTRY hosts = NULL;
+  PHOST_ENTRY hitKeys = NULL;
+  PHOST_ENTRY missKeys = NULL;
+  uint64_t randomState = 0x2545f4914f6cdd1dULL;
+  double ipNs = 0;
+  double missNs = 0;
+  double macNs = 0;
+  double scanNs = 0;
+  int ipFound = 0;
+  int missFound = 0;
+  int macFound = 0;
+  int scanFound = 0;
+  int errors = 0;
+  int counter = 0;
+
+  if ((hostTable = HostTableCreate(HOST_TABLE_DEFAULT_CAPACITY)) == NULL ||
+      (hosts = (PHOST_ENTRY)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, hostCountParam * sizeof(HOST_ENTRY))) == NULL ||
+      (hitKeys = (PHOST_ENTRY)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, lookupCountParam * sizeof(HOST_ENTRY))) == NULL ||
+      (missKeys = (PHOST_ENTRY)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, lookupCountParam * sizeof(HOST_ENTRY))) == NULL)
+  {
+    goto END;
+  }
+
+  // Grow the table the way .targethosts does, one host at a time
+  for (counter = 0; counter < hostCountParam; counter++)
+  {
+    HostTableBenchmarkHost(counter, hosts[counter].IpBin, hosts[counter].MacBin);
+
+    if (HostTableAdd(hostTable, hosts[counter].IpBin, hosts[counter].MacBin, NULL) == FALSE)
+    {
+      goto END;
+    }
+  }
+
+  for (counter = 0; counter < lookupCountParam; counter++)
+  {
+    CopyMemory(&hitKeys[counter], &hosts[FirewallBenchmarkRandom(&randomState, hostCountParam)], sizeof(HOST_ENTRY));
+    HostTableBenchmarkHost(hostCountParam + FirewallBenchmarkRandom(&randomState, hostCountParam), missKeys[counter].IpBin, missKeys[counter].MacBin);
+  }
+
+  ipNs = HostTableBenchmarkTime(hostTable, hosts, hostCountParam, hitKeys, lookupCountParam, HOST_LOOKUP_IP, &ipFound);
+  missNs = HostTableBenchmarkTime(hostTable, hosts, hostCountParam, missKeys, lookupCountParam, HOST_LOOKUP_IP, &missFound);
+  macNs = HostTableBenchmarkTime(hostTable, hosts, hostCountParam, hitKeys, lookupCountParam, HOST_LOOKUP_MAC, &macFound);
+  scanNs = HostTableBenchmarkTime(hostTable, hosts, hostCountParam, hitKeys, lookupCountParam, HOST_LOOKUP_SCAN, &scanFound);
+
+  errors = (lookupCountParam - ipFound) + missFound + (lookupCountParam - macFound) + (lookupCountParam - scanFound);
+  if (HostTableCount(hostTable) != hostCountParam)
+  {
+    errors++;
+  }
+
+  printf("  %8d %12.1f %12.1f %12.1f %12.1f %8d\n", hostCountParam, ipNs, missNs, macNs, scanNs, errors);
+
+  retVal = errors == 0;
+
+END:
+
+  HostTableDestroy(hostTable);
+
+  if (hosts != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, hosts);
+  }
+
+  if (hitKeys != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, hitKeys);
+  }
+
+  if (missKeys != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, missKeys);
+  }
+
+  return retVal;
+}
+
+
+
+/*
+ * Microbenchmarks
+ *
+ * param   filter
+ *   -m     {...}
+ *
+ * Times the primitives of the forwarding path one at a time,
+ * each for a few frame, input or table sizes. Only benchmarks
+ * whose name (<primitive>/<size>) contains the filter run, e.g.
+ * "-m in_cksum" or "-m /1024". Run before and after changing a
+ * primitive to see what the change is worth.
+ *
+ * HostTableLookupIp replaced the linear GetNodeByIp() search,
+ * -t compares both. ChecksumAdd.<implementation> times each
+ * checksum implementation the CPU has, after checking them
+ * against the scalar reference on random inputs.
+ *
+ */
+int InitializeMicroBenchmark(char *filterParam)
+{
+  int retVal = 0;
+  int frameSizes[] = { 64, 594, 1514 };
+  int checksumSizes[] = { 20, 576, 1480 };
+  int ruleCounts[] = { 10, 1000, 10000 };
+  int hostCounts[] = { 16, 1024, HOST_TABLE_BENCHMARK_HOSTS };
+  char *checksumImplementations[] = { CHECKSUM_IMPL_SCALAR, CHECKSUM_IMPL_SSE2, CHECKSUM_IMPL_AVX2 };
+  char primitive[BENCHMARK_NAME_SIZE];
+  int implementationCounter = 0;
+  PMICRO_BENCHMARK microBenchmark = NULL;
+  uint64_t randomState = 0x2545f4914f6cdd1dULL;
+  int counter = 0;
+  int keyCounter = 0;
+
+  gDEBUGLEVEL = DBG_OFF;
+
+  if ((microBenchmark = (PMICRO_BENCHMARK)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(MICRO_BENCHMARK))) == NULL ||
+      (microBenchmark->Lookups = (PFIREWALL_LOOKUP)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, FIREWALL_BENCHMARK_LOOKUPS * sizeof(FIREWALL_LOOKUP))) == NULL ||
+      (microBenchmark->Keys = (PHOST_ENTRY)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, HOST_TABLE_BENCHMARK_LOOKUPS * sizeof(HOST_ENTRY))) == NULL)
+  {
+    retVal = 1;
+    goto END;
+  }
+
+  BenchmarkMicroStart("RouterIPv4 primitives", filterParam);
+
+  // TCP frames of 64 bytes up to the MTU
+  for (counter = 0; counter < (int)(sizeof(frameSizes) / sizeof(frameSizes[0])); counter++)
+  {
+    microBenchmark->FrameLength = BenchmarkBuildFrame(microBenchmark->Frame, BENCHMARK_PROTO_TCP, 40000, 80, NULL, frameSizes[counter] - 54);
+    BenchmarkMicro("PrepareDataPacketStructure", frameSizes[counter], MicroPrepareDataPacketStructure, microBenchmark);
+  }
+
+  for (counter = 0; counter < (int)(sizeof(checksumSizes) / sizeof(checksumSizes[0])); counter++)
+  {
+    microBenchmark->ChecksumLength = checksumSizes[counter];
+    BenchmarkMicro("in_cksum", checksumSizes[counter], MicroChecksum, microBenchmark);
+  }
+
+  // Each implementation the CPU has, in_cksum() above uses the best one
+  if (MicroChecksumVerify() == FALSE)
+  {
+    retVal = 4;
+    goto END;
+  }
+
+  for (implementationCounter = 0; implementationCounter < (int)(sizeof(checksumImplementations) / sizeof(checksumImplementations[0])); implementationCounter++)
+  {
+    if (ChecksumSelect(checksumImplementations[implementationCounter]) == FALSE)
+    {
+      continue;
+    }
+
+    ZeroMemory(primitive, sizeof(primitive));
+    _snprintf(primitive, sizeof(primitive) - 1, "ChecksumAdd.%s", checksumImplementations[implementationCounter]);
+
+    for (counter = 0; counter < (int)(sizeof(checksumSizes) / sizeof(checksumSizes[0])); counter++)
+    {
+      microBenchmark->ChecksumLength = checksumSizes[counter];
+      BenchmarkMicro(primitive, checksumSizes[counter], MicroChecksum, microBenchmark);
+    }
+  }
+
+  ChecksumSelect(NULL);
+
+  // Rewriting one header field, compare with in_cksum/20
+  BenchmarkMicro("ChecksumUpdate16", 2, MicroChecksumUpdate16, microBenchmark);
+
+  BenchmarkMicro("IpBin2String", BIN_IP_LEN, MicroIpBin2String, microBenchmark);
+  BenchmarkMicro("MacBin2String", BIN_MAC_LEN, MicroMacBin2String, microBenchmark);
+
+  for (counter = 0; counter < (int)(sizeof(ruleCounts) / sizeof(ruleCounts[0])); counter++)
+  {
+    if (BenchmarkMicroSelected("FirewallBlockRuleMatch", ruleCounts[counter]) == FALSE &&
+        BenchmarkMicroSelected("FirewallClassify", ruleCounts[counter]) == FALSE)
+    {
+      continue;
+    }
+
+    microBenchmark->LookupCount = FIREWALL_BENCHMARK_LOOKUPS;
+
+    if ((microBenchmark->Rules = FirewallBenchmarkRuleSet(ruleCounts[counter], FIREWALL_RULES_MIXED, microBenchmark->Lookups, microBenchmark->LookupCount)) == NULL ||
+        (microBenchmark->Classifier = FirewallClassifierCompile(microBenchmark->Rules)) == NULL)
+    {
+      retVal = 2;
+      goto END;
+    }
+
+    BenchmarkMicro("FirewallBlockRuleMatch", ruleCounts[counter], MicroFirewallBlockRuleMatch, microBenchmark);
+    BenchmarkMicro("FirewallClassify", ruleCounts[counter], MicroFirewallClassify, microBenchmark);
+
+    FirewallClassifierRelease(microBenchmark->Classifier);
+    FreeFirewallRules(microBenchmark->Rules);
+    microBenchmark->Classifier = NULL;
+    microBenchmark->Rules = NULL;
+  }
+
+  for (counter = 0; counter < (int)(sizeof(hostCounts) / sizeof(hostCounts[0])); counter++)
+  {
+    if (BenchmarkMicroSelected("HostTableLookupIp", hostCounts[counter]) == FALSE)
+    {
+      continue;
+    }
+
+    if ((microBenchmark->HostTable = HostTableCreate(HOST_TABLE_DEFAULT_CAPACITY)) == NULL)
+    {
+      retVal = 3;
+      goto END;
+    }
+
+    for (keyCounter = 0; keyCounter < hostCounts[counter]; keyCounter++)
+    {
+      HostTableBenchmarkHost(keyCounter, microBenchmark->Keys[0].IpBin, microBenchmark->Keys[0].MacBin);
+      HostTableAdd(microBenchmark->HostTable, microBenchmark->Keys[0].IpBin, microBenchmark->Keys[0].MacBin, NULL);
+    }
+
+    // Hits only, in random order
+    microBenchmark->LookupCount = HOST_TABLE_BENCHMARK_LOOKUPS;
+
+    for (keyCounter = 0; keyCounter < microBenchmark->LookupCount; keyCounter++)
+    {
+      HostTableBenchmarkHost(FirewallBenchmarkRandom(&randomState, hostCounts[counter]), microBenchmark->Keys[keyCounter].IpBin, microBenchmark->Keys[keyCounter].MacBin);
+    }
+
+    BenchmarkMicro("HostTableLookupIp", hostCounts[counter], MicroHostTableLookupIp, microBenchmark);
+
+    HostTableDestroy(microBenchmark->HostTable);
+    microBenchmark->HostTable = NULL;
+  }
+
+  printf("\n");
+
+END:
+
+  if (microBenchmark != NULL)
+  {
+    FirewallClassifierRelease(microBenchmark->Classifier);
+    FreeFirewallRules(microBenchmark->Rules);
+    HostTableDestroy(microBenchmark->HostTable);
+
+    if (microBenchmark->Lookups != NULL)
+    {
+      HeapFree(GetProcessHeap(), 0, microBenchmark->Lookups);
+    }
+
+    if (microBenchmark->Keys != NULL)
+    {
+      HeapFree(GetProcessHeap(), 0, microBenchmark->Keys);
+    }
+
+    HeapFree(GetProcessHeap(), 0, microBenchmark);
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Push one UDP frame larger than a ring slot through the
+ * forwarding engine. It goes through the ring of the worker
+ * owning its flow and has to leave on that worker's handle
+ * with its full length, unless a firewall rule blocks it.
+ *
+ */
+static BOOL BenchmarkOversizedFrame(int workerCountParam)
+{
+  BOOL retVal = FALSE;
+  FORWARDING_ENGINE engine;
+  BOOL engineStarted = FALSE;
+  PCAPTURE_HANDLE sinkHandles[FORWARDING_MAX_WORKERS];
+  char errorBuffer[CAPTURE_ERRBUF_SIZE];
+  CAPTURE_BATCH batch;
+  PACKET_VIEW view;
+  struct pcap_pkthdr pktHeader;
+  unsigned char *frame = NULL;
+  unsigned char *ipHeader = NULL;
+  unsigned short checksum = 0;
+  uint64_t sentPackets = 0;
+  uint64_t sentBytes = 0;
+  unsigned long long blocked = 0;
+  unsigned long long otherPackets = 0;
+  unsigned int workerIndex = 0;
+  int counter = 0;
+
+  ZeroMemory(sinkHandles, sizeof(sinkHandles));
+  ZeroMemory(errorBuffer, sizeof(errorBuffer));
+  ZeroMemory(&batch, sizeof(batch));
+  ZeroMemory(&pktHeader, sizeof(pktHeader));
+
+  if ((frame = (unsigned char *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, BENCHMARK_OVERSIZED_FRAME_SIZE)) == NULL)
+  {
+    goto END;
+  }
+
+  // Header of an empty datagram, then stretch it to the full size
+  BenchmarkBuildFrame(frame, BENCHMARK_PROTO_UDP, 40000, 9000, NULL, 0);
+  ipHeader = frame + sizeof(ETHDR);
+  *(unsigned short *)(ipHeader + 2) = htons((unsigned short)(BENCHMARK_OVERSIZED_FRAME_SIZE - sizeof(ETHDR)));
+  *(unsigned short *)(ipHeader + 10) = 0;
+  checksum = ChecksumCompute(ipHeader, 20);
+  CopyMemory(ipHeader + 10, &checksum, sizeof(checksum));
+  *(unsigned short *)(ipHeader + 24) = htons((unsigned short)(BENCHMARK_OVERSIZED_FRAME_SIZE - sizeof(ETHDR) - 20));
+
+  pktHeader.caplen = BENCHMARK_OVERSIZED_FRAME_SIZE;
+  pktHeader.len = BENCHMARK_OVERSIZED_FRAME_SIZE;
+
+  for (counter = 0; counter < workerCountParam; counter++)
+  {
+    if ((sinkHandles[counter] = CaptureOpenNullSink(errorBuffer)) == NULL)
+    {
+      fprintf(stderr, "%s\n", errorBuffer);
+      goto END;
+    }
+  }
+
+  if ((engineStarted = ForwardingEngineStart(&engine, &gScanParams, workerCountParam, sinkHandles, TRUE)) == FALSE)
+  {
+    fprintf(stderr, "Unable to start the forwarding engine\n");
+    goto END;
+  }
+
+  batch.FrameCount = 1;
+  batch.Headers[0] = &pktHeader;
+  batch.Frames[0] = frame;
+  ForwardingEngine_batch_handler((u_char *)&engine, &batch);
+
+  PacketViewParse(frame, BENCHMARK_OVERSIZED_FRAME_SIZE, &view);
+  workerIndex = (unsigned int)(((unsigned long long)ForwardingFlowHash(frame, &view) * engine.WorkerCount) >> 32);
+
+  // The firewall verdict is in once the worker took the slot
+  while (InterlockedCompareExchange(&engine.Workers[workerIndex]->Ring.Tail, 0, 0) != engine.Workers[workerIndex]->Ring.Head)
+  {
+    SwitchToThread();
+  }
+
+  blocked = engine.Workers[workerIndex]->Context.Blocked;
+  ForwardingEngineStop(&engine);
+  engineStarted = FALSE;
+
+  for (counter = 0; counter < workerCountParam; counter++)
+  {
+    if ((unsigned int)counter != workerIndex)
+    {
+      CaptureGetSentCounters(sinkHandles[counter], &sentPackets, &sentBytes);
+      otherPackets += sentPackets;
+    }
+  }
+
+  CaptureGetSentCounters(sinkHandles[workerIndex], &sentPackets, &sentBytes);
+
+  if (engine.Oversized != 1 ||
+      otherPackets != 0 ||
+      sentPackets + blocked != 1 ||
+      (sentPackets == 1 && sentBytes != BENCHMARK_OVERSIZED_FRAME_SIZE))
+  {
+    fprintf(stderr, "ForwardingEngine lost a %d byte frame: %llu oversized, %llu sent by worker %u (%llu bytes), %llu by the others, %llu blocked\n",
+      BENCHMARK_OVERSIZED_FRAME_SIZE, engine.Oversized, (unsigned long long)sentPackets, workerIndex, (unsigned long long)sentBytes, otherPackets, blocked);
+    goto END;
+  }
+
+  printf("ForwardingEngine oversized frame (%d bytes): %s\n\n", BENCHMARK_OVERSIZED_FRAME_SIZE, sentPackets == 1 ? "forwarded" : "blocked");
+  retVal = TRUE;
+
+END:
+
+  if (engineStarted == TRUE)
+  {
+    ForwardingEngineStop(&engine);
+  }
+
+  for (counter = 0; counter < FORWARDING_MAX_WORKERS; counter++)
+  {
+    if (sinkHandles[counter] != NULL)
+    {
+      CaptureClose(sinkHandles[counter]);
+    }
+  }
+
+  if (frame != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, frame);
+  }
+
+  return retVal;
+}
+
+
+static uint64_t MicroPrepareDataPacketStructure(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  PACKET_INFO packetInfo;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    result += PrepareDataPacketStructure(microBenchmark->Frame, microBenchmark->FrameLength, &packetInfo);
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroChecksum(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    result += in_cksum((unsigned short *)(microBenchmark->Frame + sizeof(ETHDR)), microBenchmark->ChecksumLength);
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroChecksumUpdate16(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  unsigned char *ipHeader = microBenchmark->Frame + sizeof(ETHDR);
+  unsigned short checksum = 0;
+  unsigned short ttlProtocol = 0;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  CopyMemory(&checksum, ipHeader + 10, sizeof(checksum));
+  CopyMemory(&ttlProtocol, ipHeader + 8, sizeof(ttlProtocol));
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    result += ChecksumUpdate16(checksum, ttlProtocol, (unsigned short)(ttlProtocol - counter));
+  }
+
+  return result;
+}
+
+
+/*
+ * Random inputs, lengths and misalignments through every
+ * implementation the CPU has, chained and in one piece, and
+ * random header field rewrites through ChecksumUpdate16/32().
+ * Everything must match ChecksumAddScalar().
+ *
+ */
+static BOOL MicroChecksumVerify()
+{
+  char *implementations[] = { CHECKSUM_IMPL_SCALAR, CHECKSUM_IMPL_SSE2, CHECKSUM_IMPL_AVX2 };
+  unsigned char *buffer = NULL;
+  unsigned char *data = NULL;
+  uint64_t randomState = 0x2545f4914f6cdd1dULL;
+  unsigned short expected = 0;
+  unsigned short checksum = 0;
+  unsigned short oldValue16 = 0;
+  unsigned short newValue16 = 0;
+  uint32_t oldValue32 = 0;
+  uint32_t newValue32 = 0;
+  unsigned int length = 0;
+  unsigned int split = 0;
+  unsigned int field = 0;
+  int mismatches = 0;
+  int implementationCounter = 0;
+  int counter = 0;
+
+  if ((buffer = (unsigned char *)HeapAlloc(GetProcessHeap(), 0, CHECKSUM_BENCHMARK_MAX_OFFSET + BENCHMARK_FRAME_SIZE)) == NULL)
+  {
+    return FALSE;
+  }
+
+  for (counter = 0; counter < CHECKSUM_BENCHMARK_INPUTS; counter++)
+  {
+    data = buffer + FirewallBenchmarkRandom(&randomState, CHECKSUM_BENCHMARK_MAX_OFFSET);
+    length = FirewallBenchmarkRandom(&randomState, BENCHMARK_FRAME_SIZE + 1);
+
+    // Random bytes, or all 0xff for the carries
+    for (field = 0; field < length; field++)
+    {
+      data[field] = counter % 16 == 0 ? 0xff : (unsigned char)FirewallBenchmarkRandom(&randomState, 256);
+    }
+
+    expected = ChecksumFold(ChecksumAddScalar(0, data, length));
+    split = FirewallBenchmarkRandom(&randomState, length + 1) & ~1U;
+
+    for (implementationCounter = 0; implementationCounter < (int)(sizeof(implementations) / sizeof(implementations[0])); implementationCounter++)
+    {
+      if (ChecksumSelect(implementations[implementationCounter]) == TRUE &&
+          (ChecksumCompute(data, length) != expected ||
+           ChecksumFold(ChecksumAdd(ChecksumAdd(0, data, split), data + split, length - split)) != expected))
+      {
+        mismatches++;
+      }
+    }
+
+    if (length < sizeof(IPHDR))
+    {
+      continue;
+    }
+
+    // Rewrite a 16 bit field and an address of an IP header sized
+    // block. 0x0000 and 0xffff are the same in one's complement.
+    checksum = ChecksumFold(ChecksumAddScalar(0, data, sizeof(IPHDR)));
+    field = FirewallBenchmarkRandom(&randomState, sizeof(IPHDR) / 2) * 2;
+    CopyMemory(&oldValue16, data + field, sizeof(oldValue16));
+    newValue16 = (unsigned short)FirewallBenchmarkRandom(&randomState, 0x10000);
+    CopyMemory(data + field, &newValue16, sizeof(newValue16));
+    checksum = ChecksumUpdate16(checksum, oldValue16, newValue16);
+
+    field = FirewallBenchmarkRandom(&randomState, 2) == 0 ? 12 : 16;
+    CopyMemory(&oldValue32, data + field, sizeof(oldValue32));
+    newValue32 = (uint32_t)randomState;
+    CopyMemory(data + field, &newValue32, sizeof(newValue32));
+    checksum = ChecksumUpdate32(checksum, oldValue32, newValue32);
+
+    expected = ChecksumFold(ChecksumAddScalar(0, data, sizeof(IPHDR)));
+
+    if (checksum != expected &&
+        (checksum != 0 && checksum != 0xffff || expected != 0 && expected != 0xffff))
+    {
+      mismatches++;
+    }
+  }
+
+  ChecksumSelect(NULL);
+  HeapFree(GetProcessHeap(), 0, buffer);
+
+  printf("  %-40s %d inputs, %d mismatches\n", "ChecksumAdd.* vs. ChecksumAddScalar", CHECKSUM_BENCHMARK_INPUTS, mismatches);
+
+  return mismatches == 0;
+}
+
+
+static uint64_t MicroIpBin2String(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  unsigned char output[MAX_IP_LEN + 1];
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    IpBin2String(microBenchmark->Frame + sizeof(ETHDR) + 12, output, sizeof(output) - 1);
+    result += output[0];
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroMacBin2String(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  unsigned char output[MAX_MAC_LEN + 1];
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    MacBin2String(microBenchmark->Frame + BIN_MAC_LEN, output, sizeof(output) - 1);
+    result += output[0];
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroFirewallBlockRuleMatch(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  PFIREWALL_LOOKUP lookup = NULL;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+  int index = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    lookup = &microBenchmark->Lookups[index];
+    result += FirewallBlockRuleMatch(microBenchmark->Rules, lookup->Protocol, lookup->SrcIpBin, lookup->DstIpBin, lookup->SrcPort, lookup->DstPort) != NULL ? 1 : 0;
+
+    if (++index >= microBenchmark->LookupCount)
+    {
+      index = 0;
+    }
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroFirewallClassify(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  PFIREWALL_LOOKUP lookup = NULL;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+  int index = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    lookup = &microBenchmark->Lookups[index];
+    result += FirewallClassify(microBenchmark->Classifier, lookup->Protocol, lookup->SrcIpBin, lookup->DstIpBin, lookup->SrcPort, lookup->DstPort) != NULL ? 1 : 0;
+
+    if (++index >= microBenchmark->LookupCount)
+    {
+      index = 0;
+    }
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroHostTableLookupIp(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  HOST_ENTRY host;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+  int index = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    result += HostTableLookupIp(microBenchmark->HostTable, microBenchmark->Keys[index].IpBin, &host) == TRUE ? 1 : 0;
+
+    if (++index >= microBenchmark->LookupCount)
+    {
+      index = 0;
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Benchmark.h"
+#include "Checksum.h"
+#include "FirewallClassifier.h"
+#include "HostTable.h"
+#include "LinkedListFirewallRules.h"
+#include "PacketCapture.h"
+#include "RouterIPv4.h"
+
+#define FIREWALL_BENCHMARK_LOOKUPS 10000
+#define FIREWALL_BENCHMARK_MIN_TIME 200000000ULL   // ns per matcher and rule set
+#define FIREWALL_RULES_MIXED 0
+#define FIREWALL_RULES_OVERLAPPING 1                 // Worst case for FirewallClassifierCompile()
+#define BENCHMARK_OVERSIZED_FRAME_SIZE 9014              // Jumbo frame, larger than FORWARDING_SLOT_SIZE
+#define HOST_TABLE_BENCHMARK_HOSTS 65536
+#define HOST_TABLE_BENCHMARK_LOOKUPS 4096
+
+#define HOST_LOOKUP_IP 0
+#define HOST_LOOKUP_MAC 1
+#define HOST_LOOKUP_SCAN 2                         // Linear search, for comparison
+
+#define CHECKSUM_BENCHMARK_INPUTS 100000             // Random inputs per implementation
+#define CHECKSUM_BENCHMARK_MAX_OFFSET 20             // Misalignment of the inputs
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  char *Protocol;
+  unsigned long SrcIpBin;
+  unsigned long DstIpBin;
+  unsigned short SrcPort;
+  unsigned short DstPort;
+} FIREWALL_LOOKUP, *PFIREWALL_LOOKUP;
+
+
+// Inputs of the microbenchmark currently running
+typedef struct
+{
+  unsigned char Frame[BENCHMARK_FRAME_SIZE];
+  unsigned int FrameLength;
+  int ChecksumLength;
+  PRULENODE Rules;
+  PFIREWALL_CLASSIFIER Classifier;
+  PFIREWALL_LOOKUP Lookups;
+  PHOST_TABLE HostTable;
+  PHOST_ENTRY Keys;
+  int LookupCount;
+} MICRO_BENCHMARK, *PMICRO_BENCHMARK;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+int InitializeBenchmark(int loopCountParam);
+BOOL BenchmarkForwardingEngine(PCAPTURE_HANDLE replayHandle, int workerCountParam);
+int InitializeFirewallBenchmark(int lookupCountParam);
+BOOL BenchmarkFirewallRules(int ruleCountParam, int ruleSetParam, PFIREWALL_LOOKUP lookupsParam, int lookupCountParam);
+int InitializeHostTableBenchmark(int hostCountParam);
+BOOL BenchmarkHostTable(int hostCountParam, int lookupCountParam);
+int InitializeMicroBenchmark(char *filterParam);
\ No newline at end of file
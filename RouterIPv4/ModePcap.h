@@ -6,3 +6,5 @@
 int InitializeParsePcapDumpFile();
 BOOL OpenPcapFileHandle(PSCANPARAMS scanParams);
 BOOL OpenPcapInterfaceHandle(PSCANPARAMS scanParams);
+BOOL OpenPcapOutputHandle(PSCANPARAMS scanParams);
+void ClosePcapOutputHandle(PSCANPARAMS scanParams);
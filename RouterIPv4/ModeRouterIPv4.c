@@ -9,7 +9,8 @@
 #include <Windows.h>
 
 #include "Config.h"
-#include "LinkedListTargetSystems.h"
+#include "FileWatch.h"
+#include "HostTable.h"
 #include "LinkedListFirewallRules.h"
 #include "Logging.h"
 #include "ModeRouterIPv4.h"
@@ -20,7 +21,7 @@
 // Global variables
 extern int gDEBUGLEVEL;
 extern RULENODE gFwRulesList;
-extern PSYSNODE gTargetSystemsList;
+extern PHOST_TABLE gTargetSystems;
 extern SCANPARAMS gScanParams;
 
 DWORD gRESENDThreadID = 0;
@@ -57,12 +58,12 @@ void InitializeRouterIPv4()
     PrintConfig(gScanParams);
   }
 
-  // 0 Add default GW to the gSystemsList
-  AddToSystemsList(&gTargetSystemsList, gScanParams.GatewayMacBin, (char *)gScanParams.GatewayIpStr, gScanParams.GatewayIpBin);
+  // 0 Add default GW to the target systems
+  HostTableAdd(gTargetSystems, gScanParams.GatewayIpBin, gScanParams.GatewayMacBin, (char *)gScanParams.GatewayIpStr);
 
   // 1. Parse target file
   if (PathFileExists(FILE_HOST_TARGETS) &&
-      ParseTargetHostsConfigFile(FILE_HOST_TARGETS) <= 0)
+      ParseTargetHostsConfigFile(FILE_HOST_TARGETS, gTargetSystems) <= 0)
   {
     LogMsg(DBG_ERROR, "InitializeRouterIPv4(): No target hosts were defined");
   }
@@ -71,7 +72,7 @@ void InitializeRouterIPv4()
     LogMsg(DBG_ERROR, "InitializeRouterIPv4(): No target hosts file \"%s\"", FILE_HOST_TARGETS);
   }
 
-  PrintTargetSystems(gTargetSystemsList);
+  PrintTargetSystems(gTargetSystems);
 
   // Start targethosts observer file
   if (InitTargethostObserverThread() == FALSE)
@@ -140,26 +141,46 @@ BOOL InitTargethostObserverThread()
 }
 
 
+/*
+ * Reload .targethosts when it changes. The new records
+ * are parsed into a new table and replace the old ones
+ * in one step, the packet handlers keep looking up
+ * targets meanwhile.
+ *
+ */
 DWORD WINAPI TargethostsObserver(LPVOID params)
 {
-  struct _stat statbuf;
-  time_t mtime_previous;
-  int stat = _stat(FILE_HOST_TARGETS, &statbuf);
+  PFILE_WATCH fileWatch = NULL;
+  PHOST_TABLE newTargetSystems = NULL;
+  int total_systems = 0;
+
+  if ((fileWatch = FileWatchCreate(FILE_HOST_TARGETS)) == NULL)
+  {
+    LogMsg(DBG_ERROR, "TargethostsObserver(): Can't watch .targethosts");
+    return 1;
+  }
 
   while (1 == 1)
   {
-    mtime_previous = statbuf.st_mtime;
-    stat = _stat(FILE_HOST_TARGETS, &statbuf);
+    if (FileWatchWait(fileWatch, FILE_WATCH_INFINITE) == FALSE)
+    {
+      continue;
+    }
+
+    LogMsg(DBG_INFO, "TargethostsObserver(): .targethosts changed. Reloading .targethost records.");
 
-    if (mtime_previous != statbuf.st_mtime)
+    if ((newTargetSystems = HostTableCreate(HostTableCount(gTargetSystems))) == NULL)
     {
-      LogMsg(DBG_INFO, "TargethostsObserver(): .targethosts changed. Reloading .targethost records.");
-      ClearSystemList(&gTargetSystemsList);
-      ParseTargetHostsConfigFile(FILE_HOST_TARGETS);
-      PrintTargetSystems(FILE_HOST_TARGETS);
+      LogMsg(DBG_ERROR, "TargethostsObserver(): Can't allocate the new target systems");
+      continue;
     }
 
-    Sleep(1000);
+    // The default GW is a target system too
+    HostTableAdd(newTargetSystems, gScanParams.GatewayIpBin, gScanParams.GatewayMacBin, (char *)gScanParams.GatewayIpStr);
+    total_systems = ParseTargetHostsConfigFile(FILE_HOST_TARGETS, newTargetSystems);
+    HostTableReplace(gTargetSystems, newTargetSystems);
+    PrintTargetSystems(gTargetSystems);
+    LogMsg(DBG_INFO, "TargethostsObserver(): %d systems added to .targethosts.", total_systems);
   }
 }
 
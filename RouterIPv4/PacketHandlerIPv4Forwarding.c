@@ -7,38 +7,64 @@
 #include <iphlpapi.h>
 
 #include "RouterIPv4.h"
-#include "LinkedListTargetSystems.h"
+#include "CaptureStats.h"
 #include "LinkedListFirewallRules.h"
+#include "FirewallClassifier.h"
+#include "FlowCache.h"
+#include "ForwardingEngine.h"
+#include "HostTable.h"
+#include "LatencyStats.h"
 #include "Logging.h"
 #include "NetworkHelperFunctions.h"
+#include "PacketCapture.h"
 #include "PacketHandlerIPv4Forwarding.h"
+#include "Probes.h"
+#include "TransmitQueue.h"
 
-#define MAX_INJECT_RETRIES 4
+
+#define LATENCY_SERVER_NAME "RouterIPv4Latency"
 
 
 // Global/external variables
-extern PSYSNODE gTargetSystemsList;
+extern PHOST_TABLE gTargetSystems;
 extern PRULENODE gFwRulesList;
+extern PFIREWALL_CLASSIFIER gFirewallClassifier;
 extern SCANPARAMS gScanParams;
+extern volatile LONG gFirewallRulesGeneration;
+
+FORWARDING_ENGINE gForwardingEngine;
 
 
 /*
  * Receive, parse, resend
  *
+ * The calling thread only captures. Forwarding happens on
+ * the forwarding engine's workers, see ForwardingEngine.h.
+ * An AF_XDP handle (FORWARDING_AFXDP_ENV) forwards the
+ * frames from their receive buffers, then the calling
+ * thread forwards itself.
+ *
+ * With LATENCY_STATS_ENV set the latency report is printed on
+ * Ctrl-Break and at the end, and served to local clients of
+ * LATENCY_SERVER_NAME while forwarding.
+ *
  */
 DWORD PacketHandlerRouterIPv4(PSCANPARAMS lpParam)
 {
   char cwd[MAX_BUF_SIZE + 1];
   char filter[MAX_BUF_SIZE + 1];
   DWORD retVal = 0;
-  char pcapErrorBuffer[PCAP_ERRBUF_SIZE];
-  int counter = 0;
-  int ifcNum = 0;
-  struct bpf_program ifcCode;
+  char captureErrorBuffer[CAPTURE_ERRBUF_SIZE];
   unsigned int netMask = 0;
   int funcRetVal = 0;
-  struct pcap_pkthdr *packetHeader = NULL;
-  unsigned char *packetData = NULL;
+  int workerCount = 0;
+  int counter = 0;
+  BOOL engineStarted = FALSE;
+  BOOL inPlaceStarted = FALSE;
+  BOOL latencyServerStarted = FALSE;
+  BOOL captureStatsStarted = FALSE;
+  PCAPTURE_HANDLE writeHandles[FORWARDING_MAX_WORKERS];
+  FORWARDING_CONTEXT inPlaceContext;
   
   // Determine and print current working directory
   GetCurrentDirectory(sizeof(cwd) - 1, cwd);
@@ -47,53 +73,104 @@ DWORD PacketHandlerRouterIPv4(PSCANPARAMS lpParam)
   // Set exit function to trigger depoisoning functions and command.
   SetConsoleCtrlHandler((PHANDLER_ROUTINE)RouterIPv4_ControlHandler, TRUE);
 
-  ZeroMemory(pcapErrorBuffer, sizeof(pcapErrorBuffer));
+  ZeroMemory(captureErrorBuffer, sizeof(captureErrorBuffer));
+  ZeroMemory(writeHandles, sizeof(writeHandles));
+  ZeroMemory(&inPlaceContext, sizeof(inPlaceContext));
   //ZeroMemory(&gScanParams, sizeof(gScanParams));
   //CopyMemory(&gScanParams, lpParam, sizeof(gScanParams));
 
+  // Zero-copy capture if requested and supported by the driver
+  if (getenv(FORWARDING_AFXDP_ENV) != NULL &&
+      (gScanParams.InterfaceReadHandle = CaptureOpenXdp((char *)gScanParams.InterfaceName, gScanParams.LocalMacBin, gScanParams.LocalIpBin, 65536, PCAP_READTIMEOUT, captureErrorBuffer)) == NULL)
+  {
+    LogMsg(DBG_INFO, "PacketHandlerRouterIPv4(): AF_XDP not available on \"%s\", falling back to the default capture: %s", gScanParams.InterfaceName, captureErrorBuffer);
+  }
+  else if (gScanParams.InterfaceReadHandle != NULL &&
+           captureErrorBuffer[0] != '\0')
+  {
+    LogMsg(DBG_MEDIUM, "PacketHandlerRouterIPv4(): %s", captureErrorBuffer);
+  }
+
   // Open interface.
-  if ((gScanParams.InterfaceReadHandle = pcap_open_live((char *)gScanParams.InterfaceName, 65536, PCAP_OPENFLAG_NOCAPTURE_LOCAL | PCAP_OPENFLAG_MAX_RESPONSIVENESS, PCAP_READTIMEOUT, pcapErrorBuffer)) == NULL)
+  if (gScanParams.InterfaceReadHandle == NULL &&
+      (gScanParams.InterfaceReadHandle = CaptureOpen((char *)gScanParams.InterfaceName, 65536, CAPTURE_FLAG_PROMISCUOUS | CAPTURE_FLAG_NOCAPTURE_LOCAL, PCAP_READTIMEOUT, captureErrorBuffer)) == NULL)
   {
-    LogMsg(DBG_ERROR, "PacketHandlerRouterIPv4(): Unable to open the adapter \"%s\"", gScanParams.InterfaceName);
+    LogMsg(DBG_ERROR, "PacketHandlerRouterIPv4(): Unable to open the adapter \"%s\": %s", gScanParams.InterfaceName, captureErrorBuffer);
     retVal = 5;
     goto END;
   }
 
   // MAC == LocalMAC and (IP == GWIP or IP == VictimIP
-  gScanParams.InterfaceWriteHandle = gScanParams.InterfaceReadHandle;
-  ZeroMemory(&ifcCode, sizeof(ifcCode));
   ZeroMemory(filter, sizeof(filter));
 
   _snprintf(filter, sizeof(filter) - 1, "ip && ether dst %s && not src host %s && not dst host %s && not port 53", gScanParams.LocalMacStr, gScanParams.LocalIpStr, gScanParams.LocalIpStr);
   netMask = 0xffffff; // "255.255.255.0"
 
-  if (pcap_compile((pcap_t *)gScanParams.InterfaceWriteHandle, &ifcCode, (const char *)filter, 1, netMask) < 0)
+  if (CaptureSetFilter((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle, filter, netMask) == FALSE)
   {
-    LogMsg(DBG_ERROR, "PacketHandlerRouterIPv4(): Unable to compile the BPF filter \"%s\"", filter);
-    retVal = 6;
+    LogMsg(DBG_ERROR, "PacketHandlerRouterIPv4(): Unable to set the BPF filter \"%s\": %s", filter, CaptureGetError((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle));
+    retVal = 7;
     goto END;
   }
 
-  if (pcap_setfilter((pcap_t *)gScanParams.InterfaceWriteHandle, &ifcCode) < 0)
+  if (LatencyStatsEnabled() == TRUE &&
+      (latencyServerStarted = LatencyStatsServerStart(LATENCY_SERVER_NAME)) == FALSE)
   {
-    LogMsg(DBG_ERROR, "PacketHandlerRouterIPv4(): Unable to set the BPF filter \"%s\"", filter);
-    retVal = 7;
-    goto END;
+    LogMsg(DBG_ERROR, "PacketHandlerRouterIPv4(): Unable to start the latency stats server \"%s\"", LATENCY_SERVER_NAME);
   }
 
-LogMsg(DBG_INFO, "PacketHandlerRouterIPv4(): BPF filter: %s", filter);
-  LogMsg(DBG_INFO, "PacketHandlerRouterIPv4(): Enter listening/forwarding loop.");
-  while ((funcRetVal = pcap_next_ex((pcap_t*)gScanParams.InterfaceWriteHandle, (struct pcap_pkthdr **) &packetHeader, (const u_char **)&packetData)) >= 0)
+  CaptureStatsAddHandle("capture", (PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle);
+
+  if (CaptureStatsEnabled() == TRUE &&
+      (captureStatsStarted = CaptureStatsStart(LogCaptureStats)) == FALSE)
   {
-    if (funcRetVal == 1)
+    LogMsg(DBG_ERROR, "PacketHandlerRouterIPv4(): Unable to start the capture stats monitor");
+  }
+
+  // Forward on the capturing thread, straight from the receive buffers
+  if (CaptureCanForwardInPlace((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle) == TRUE)
+  {
+    if ((inPlaceStarted = ForwardingContextInit(&inPlaceContext, &gScanParams, (PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle)) == FALSE)
+    {
+      retVal = 9;
+      goto END;
+    }
+
+    inPlaceContext.InPlaceHandle = (PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle;
+    CaptureStatsAddStage("forwarded", (uint64_t *)&inPlaceContext.Packets, NULL);
+
+    LogMsg(DBG_INFO, "PacketHandlerRouterIPv4(): BPF filter: %s", filter);
+    LogMsg(DBG_INFO, "PacketHandlerRouterIPv4(): Enter listening/forwarding loop (%s, in place)", CaptureGetBackendName((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle));
+    funcRetVal = CaptureDispatchLoop((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle, PacketForwarding_batch_handler, (unsigned char *)&inPlaceContext);
+  }
+  else
+  {
+    // Every worker sends on its own handle
+    workerCount = ForwardingEngineWorkerCount();
+    for (counter = 0; counter < workerCount; counter++)
     {
-      PacketForwarding_handler((unsigned char *)&gScanParams, packetHeader, packetData);
+      if ((writeHandles[counter] = CaptureOpen((char *)gScanParams.InterfaceName, 65536, CAPTURE_FLAG_SEND_ONLY, PCAP_READTIMEOUT, captureErrorBuffer)) == NULL)
+      {
+        LogMsg(DBG_ERROR, "PacketHandlerRouterIPv4(): Unable to open the transmit handle %d on \"%s\": %s", counter, gScanParams.InterfaceName, captureErrorBuffer);
+        retVal = 8;
+        goto END;
+      }
     }
+
+    if ((engineStarted = ForwardingEngineStart(&gForwardingEngine, &gScanParams, workerCount, writeHandles, FALSE)) == FALSE)
+    {
+      retVal = 9;
+      goto END;
+    }
+
+    LogMsg(DBG_INFO, "PacketHandlerRouterIPv4(): BPF filter: %s", filter);
+    LogMsg(DBG_INFO, "PacketHandlerRouterIPv4(): Enter listening/forwarding loop (%s, %d workers)", CaptureGetBackendName((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle), workerCount);
+    funcRetVal = CaptureDispatchLoop((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle, ForwardingEngine_batch_handler, (unsigned char *)&gForwardingEngine);
   }
 
   if (funcRetVal < 0)
   {
-    char *errorMsg = pcap_geterr(gScanParams.InterfaceWriteHandle);
+    char *errorMsg = CaptureGetError((PCAPTURE_HANDLE)gScanParams.InterfaceReadHandle);
     LogMsg(DBG_ERROR, "PacketHandlerRouterIPv4(): Listener stopped unexpectedly with return value: %d, %s", funcRetVal, errorMsg);
   }
   else
@@ -103,6 +180,44 @@ LogMsg(DBG_INFO, "PacketHandlerRouterIPv4(): BPF filter: %s", filter);
 
 END:
 
+  if (captureStatsStarted == TRUE)
+  {
+    CaptureStatsStop();
+  }
+
+  CaptureStatsRemove(gScanParams.InterfaceReadHandle);
+  CaptureStatsRemove(&inPlaceContext.Packets);
+
+  if (latencyServerStarted == TRUE)
+  {
+    LatencyStatsServerStop();
+  }
+
+  if (engineStarted == TRUE)
+  {
+    ForwardingEngineStop(&gForwardingEngine);
+  }
+
+  if (inPlaceStarted == TRUE)
+  {
+    TransmitQueueFlush(inPlaceContext.TransmitQueue);
+
+    if (inPlaceContext.Latency != NULL)
+    {
+      LatencyStatsPrint();
+    }
+
+    ForwardingContextRelease(&inPlaceContext);
+  }
+
+  for (counter = 0; counter < FORWARDING_MAX_WORKERS; counter++)
+  {
+    if (writeHandles[counter] != NULL)
+    {
+      CaptureClose(writeHandles[counter]);
+    }
+  }
+
   LogMsg(DBG_INFO, "PacketHandlerRouterIPv4(): Exit");
 
   return retVal;
@@ -110,178 +225,500 @@ END:
 
 
 /*
- * Callback function invoked by libpcap for every incoming packet
+ * Set up a context for one forwarding thread. Forwarded
+ * frames are batched in a transmit queue on writeHandle.
+ * Without memory for the flow cache every packet takes the
+ * slow path, without latency stats nothing is recorded.
+ *
+ */
+BOOL ForwardingContextInit(PFORWARDING_CONTEXT forwardingContext, PSCANPARAMS scanParams, PCAPTURE_HANDLE writeHandle)
+{
+  ZeroMemory(forwardingContext, sizeof(FORWARDING_CONTEXT));
+  forwardingContext->ScanParams = scanParams;
+  forwardingContext->FirewallRules = gFwRulesList;
+  forwardingContext->Firewall = gFirewallClassifier;
+  forwardingContext->TargetsGeneration = HostTableGeneration(gTargetSystems);
+  forwardingContext->FirewallGeneration = gFirewallRulesGeneration;
+  EtherTemplateBuild(&forwardingContext->GatewayTemplate, scanParams->GatewayMacBin, scanParams->LocalMacBin);
+
+  if (FlowCacheInit(&forwardingContext->FlowCache) == FALSE)
+  {
+    LogMsg(DBG_ERROR, "ForwardingContextInit(): Unable to allocate the flow cache");
+  }
+
+  if ((forwardingContext->TransmitQueue = TransmitQueueCreate(writeHandle, TRANSMIT_QUEUE_DEFAULT_FRAMES, TRANSMIT_QUEUE_DEFAULT_DELAY)) == NULL)
+  {
+    LogMsg(DBG_ERROR, "ForwardingContextInit(): Unable to create the transmit queue");
+    return FALSE;
+  }
+
+  TransmitQueueSetErrorHandler(forwardingContext->TransmitQueue, ForwardingTransmitError, forwardingContext);
+
+  if (LatencyStatsEnabled() == TRUE)
+  {
+    if ((forwardingContext->Latency = LatencyStatsCreate()) == NULL)
+    {
+      LogMsg(DBG_ERROR, "ForwardingContextInit(): Unable to allocate the latency stats");
+    }
+    else
+    {
+      TransmitQueueSetSentHandler(forwardingContext->TransmitQueue, LatencyStatsSentHandler, forwardingContext->Latency);
+    }
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * Send what is still queued and free the transmit queue,
+ * the flow cache and the latency stats.
+ *
+ */
+void ForwardingContextRelease(PFORWARDING_CONTEXT forwardingContext)
+{
+  FlowCacheRelease(&forwardingContext->FlowCache);
+
+  if (forwardingContext->TransmitQueue != NULL)
+  {
+    TransmitQueueDestroy(forwardingContext->TransmitQueue);
+    forwardingContext->TransmitQueue = NULL;
+  }
+
+  LatencyStatsDestroy(forwardingContext->Latency);
+  forwardingContext->Latency = NULL;
+}
+
+
+/*
+ * Transmit queue error handler. Runs on the forwarding thread
+ * when a flush gives up on frames.
+ *
+ */
+void ForwardingTransmitError(void *contextParam, unsigned int failedFramesParam, char *errorParam)
+{
+  PFORWARDING_CONTEXT forwardingContext = (PFORWARDING_CONTEXT)contextParam;
+
+  forwardingContext->SendErrors += failedFramesParam;
+  LogMsg(DBG_ERROR, "ForwardingTransmitError(): Unable to send %u packets: %s", failedFramesParam, errorParam);
+}
+
+
+/*
+ * Pick up changes of the target systems and the firewall
+ * rules. Cached verdicts may depend on either.
+ *
+ */
+void ForwardingContextRefresh(PFORWARDING_CONTEXT forwardingContext)
+{
+  LONG targetsGeneration = HostTableGeneration(gTargetSystems);
+  LONG firewallGeneration = gFirewallRulesGeneration;
+
+  // .targethosts was reloaded
+  if (targetsGeneration != forwardingContext->TargetsGeneration)
+  {
+    forwardingContext->TargetsGeneration = targetsGeneration;
+    FlowCacheInvalidate(&forwardingContext->FlowCache);
+  }
+
+  if (firewallGeneration != forwardingContext->FirewallGeneration)
+  {
+    forwardingContext->FirewallGeneration = firewallGeneration;
+    FlowCacheInvalidate(&forwardingContext->FlowCache);
+  }
+}
+
+
+/*
+ * Callback function invoked by the capture layer for every
+ * batch of incoming packets. An empty batch flushes the
+ * transmit queue.
+ *
+ */
+void PacketForwarding_batch_handler(u_char *param, PCAPTURE_BATCH batch)
+{
+  int counter = 0;
+
+  if (batch->FrameCount == 0)
+  {
+    TransmitQueueFlush(((PFORWARDING_CONTEXT)param)->TransmitQueue);
+    return;
+  }
+
+  for (counter = 0; counter < batch->FrameCount; counter++)
+  {
+    PacketForwarding_handler(param, batch->Headers[counter], batch->Frames[counter]);
+  }
+}
+
+
+/*
+ * Handle one incoming packet on the calling thread.
+ * param is the thread's PFORWARDING_CONTEXT.
  *
  */
 void PacketForwarding_handler(u_char *param, const struct pcap_pkthdr *pktHeader, const u_char *data)
 {
-  PSCANPARAMS scanParams = (PSCANPARAMS)param;
-  int bytesSent = 0;
-  PSYSNODE realDstSys = NULL;
-  PRULENODE firewallRule = NULL;
+  PFORWARDING_CONTEXT forwardingContext = (PFORWARDING_CONTEXT)param;
   PACKET_INFO packetInfo;
 
   if (pktHeader == NULL || 
-      pktHeader->len <= 0 || 
+      pktHeader->caplen <= 0 || 
       data == NULL)
   {
     return;
   }
 
-  ZeroMemory(&packetInfo, sizeof(packetInfo));
-  PrepareDataPacketStructure(data,(PPACKET_INFO) &packetInfo);
-  packetInfo.pcapDataLen = pktHeader->len;
+  PROBE_PACKET_RECEIVED(data, pktHeader->caplen);
 
+  if (PrepareDataPacketStructure(data, pktHeader->caplen, &packetInfo) == FALSE)
+  {
+    return;
+  }
+
+  PROBE_PACKET_PARSED(data, packetInfo.view.Layers);
 
-  IpBin2String((unsigned char *)&packetInfo.ipHdr->daddr, (unsigned char *)packetInfo.dstIp, sizeof(packetInfo.dstIp) - 1);
-  IpBin2String((unsigned char *)&packetInfo.ipHdr->saddr, (unsigned char *)packetInfo.srcIp, sizeof(packetInfo.srcIp) - 1);
+  if (forwardingContext->OfflineCapture == FALSE)
+  {
+    packetInfo.captureTimeUs = (uint64_t)pktHeader->ts.tv_sec * 1000000 + (uint64_t)pktHeader->ts.tv_usec;
+  }
 
-  CopyMemory(&packetInfo.srcIpBin, &packetInfo.ipHdr->saddr, 4);
-  CopyMemory(&packetInfo.dstIpBin, &packetInfo.ipHdr->daddr, 4);
-  snprintf(packetInfo.logMsg, sizeof(packetInfo.logMsg) - 1, "%%-5s %-4s %-15s %5d -> %-15s %-5d    %5d bytes    %s",
-    packetInfo.proto, packetInfo.srcIp, packetInfo.srcPort, packetInfo.dstIp,
-    packetInfo.dstPort, packetInfo.pktLen, packetInfo.suffix);
+  ForwardPacket(forwardingContext, &packetInfo);
+}
 
-  // Firewall checks
-  if ((firewallRule = FirewallBlockRuleMatch(gFwRulesList, packetInfo.proto, packetInfo.srcIpBin, packetInfo.dstIpBin, packetInfo.srcPort, packetInfo.dstPort)) != NULL)
+
+/*
+ * Firewall check, then rewrite the MAC addresses
+ * and send the packet on. The decision and the next
+ * hop's addresses are found once per flow, later
+ * packets take them from the flow cache. Fragments
+ * bypass the cache, only the first one carries the
+ * ports of the flow.
+ *
+ * Frames the packet gives rise to are queued with its
+ * capture time and verdict as their origin.
+ *
+ */
+void ForwardPacket(PFORWARDING_CONTEXT forwardingContext, PPACKET_INFO packetInfo)
+{
+  PFLOW_CACHE_ENTRY flowEntry = NULL;
+  FLOW_KEY flowKey;
+  unsigned char verdict = 0;
+  ETHER_TEMPLATE etherTemplate;
+  PETHER_TEMPLATE nextHop = &etherTemplate;
+  uint64_t startTime = 0;
+  BOOL fragment = FALSE;
+
+  if (forwardingContext->Latency != NULL)
   {
-    if (ProcessFirewalledData(&packetInfo, scanParams) == FALSE)
+    startTime = LatencyStatsNow();
+  }
+
+  forwardingContext->Packets++;
+  CopyMemory(&packetInfo->srcIpBin, &packetInfo->ipHdr->saddr, 4);
+  CopyMemory(&packetInfo->dstIpBin, &packetInfo->ipHdr->daddr, 4);
+
+  ForwardingContextRefresh(forwardingContext);
+
+  // More fragments or a fragment offset
+  fragment = (PacketViewRead16((unsigned char *)packetInfo->ipHdr + 6) & 0x3fff) != 0;
+
+  flowKey.SrcIpBin = (unsigned int)packetInfo->srcIpBin;
+  flowKey.DstIpBin = (unsigned int)packetInfo->dstIpBin;
+  flowKey.SrcPort = packetInfo->view.SrcPort;
+  flowKey.DstPort = packetInfo->view.DstPort;
+  flowKey.IpProto = packetInfo->view.IpProto;
+
+  if (fragment == FALSE)
+  {
+    flowEntry = FlowCacheLookup(&forwardingContext->FlowCache, &flowKey);
+    PROBE_FLOW_LOOKUP(packetInfo->pcapData, flowEntry != NULL);
+  }
+
+  if (flowEntry != NULL)
+  {
+    verdict = flowEntry->Verdict;
+    nextHop = &flowEntry->EtherTemplate;
+  }
+  else
+  {
+    verdict = ForwardingVerdict(forwardingContext, packetInfo, &etherTemplate);
+
+    if (fragment == FALSE)
+    {
+      FlowCacheInsert(&forwardingContext->FlowCache, &flowKey, verdict, &etherTemplate);
+    }
+  }
+
+  PROBE_FIREWALL_VERDICT(packetInfo->pcapData, verdict);
+
+  packetInfo->latencyClass = ForwardingLatencyClass(verdict);
+
+  if (forwardingContext->Latency != NULL)
+  {
+    TransmitQueueSetOrigin(forwardingContext->TransmitQueue, packetInfo->captureTimeUs, (unsigned char)packetInfo->latencyClass);
+  }
+
+  if (verdict == FLOW_VERDICT_BLOCK)
+  {
+    forwardingContext->Blocked++;
+
+    // The frame's journey ends here
+    if (forwardingContext->Latency != NULL)
+    {
+      LatencyStatsRecordTransit(forwardingContext->Latency, LATENCY_CLASS_BLOCK, packetInfo->captureTimeUs, LatencyStatsWallClockUs());
+    }
+
+    if (ProcessFirewalledData(packetInfo, forwardingContext) == FALSE)
     {
       LogMsg(DBG_ERROR, "Unable to apply firewall rules");
     }
   }
 
   // Destination IP is GW
-  else if (memcmp(&packetInfo.ipHdr->daddr, scanParams->GatewayIpBin, BIN_IP_LEN) == 0)
+  else if (verdict == FLOW_VERDICT_GATEWAY)
   {
-    if (ProcessData2GW(&packetInfo, scanParams) == FALSE)
+    if (ProcessData2GW(packetInfo, nextHop, forwardingContext) == FALSE)
     {
+      forwardingContext->SendErrors++;
       LogMsg(DBG_ERROR, "Unable to send DATA 2 GW");
     }
 
 
   // Destination is victim system
   }
-  else if ((realDstSys = GetNodeByIp(gTargetSystemsList, (unsigned char *)&packetInfo.ipHdr->daddr)) != NULL)
+  else if (verdict == FLOW_VERDICT_VICTIM)
   {
-    if (ProcessData2Victim(&packetInfo, realDstSys, scanParams) == FALSE)
+    if (ProcessData2Victim(packetInfo, nextHop, forwardingContext) == FALSE)
     {
+      forwardingContext->SendErrors++;
       LogMsg(DBG_ERROR, "Unable to send DATA 2 VICTIM");
     }
 
   // Destination IP is not inside the Network range.
   // Forward packet to the GW
   }
-  else if (ProcessData2Internet(&packetInfo, scanParams) == FALSE)
+  else if (ProcessData2Internet(packetInfo, nextHop, forwardingContext) == FALSE)
   {
+    forwardingContext->SendErrors++;
     LogMsg(DBG_ERROR, "Unable to send DATA 2 INTERNET");
   }
   else
   {
     // Data successfully forwarded    
   }
+
+  if (forwardingContext->Latency != NULL)
+  {
+    LatencyStatsRecordHandler(forwardingContext->Latency, packetInfo->latencyClass, startTime);
+  }
 }
 
 
-BOOL ProcessData2Internet(PPACKET_INFO packetInfo, PSCANPARAMS scanParams)
+/*
+ * The slow path: firewall rules, gateway, target systems.
+ * The next hop's Ethernet addresses are returned in
+ * etherTemplateParam, zeroed for FLOW_VERDICT_BLOCK.
+ *
+ */
+unsigned char ForwardingVerdict(PFORWARDING_CONTEXT forwardingContext, PPACKET_INFO packetInfo, PETHER_TEMPLATE etherTemplateParam)
 {
-  BOOL retVal = FALSE;
+  HOST_ENTRY realDstSys;
+  PRULENODE firewallRule = NULL;
+
+  ZeroMemory(etherTemplateParam, sizeof(ETHER_TEMPLATE));
+
+  // Firewall checks
+  if (forwardingContext->Firewall != NULL)
+  {
+    firewallRule = FirewallClassify(forwardingContext->Firewall, packetInfo->proto, packetInfo->srcIpBin, packetInfo->dstIpBin, packetInfo->view.SrcPort, packetInfo->view.DstPort);
+  }
+  else
+  {
+    firewallRule = FirewallBlockRuleMatch(forwardingContext->FirewallRules, packetInfo->proto, packetInfo->srcIpBin, packetInfo->dstIpBin, packetInfo->view.SrcPort, packetInfo->view.DstPort);
+  }
 
-  CopyMemory(packetInfo->etherHdr->ether_dhost, scanParams->GatewayMacBin, BIN_MAC_LEN);
-  CopyMemory(packetInfo->etherHdr->ether_shost, scanParams->LocalMacBin, BIN_MAC_LEN);
-  LogMsg(DBG_INFO, packetInfo->logMsg, "OUT");
+  if (firewallRule != NULL)
+  {
+    return FLOW_VERDICT_BLOCK;
+  }
+
+  if (memcmp(&packetInfo->ipHdr->daddr, forwardingContext->ScanParams->GatewayIpBin, BIN_IP_LEN) == 0)
+  {
+    CopyMemory(etherTemplateParam, &forwardingContext->GatewayTemplate, sizeof(ETHER_TEMPLATE));
+    return FLOW_VERDICT_GATEWAY;
+  }
+
+  if (HostTableLookupIp(gTargetSystems, (unsigned char *)&packetInfo->ipHdr->daddr, &realDstSys) == TRUE)
+  {
+    EtherTemplateBuild(etherTemplateParam, realDstSys.MacBin, forwardingContext->ScanParams->LocalMacBin);
+    return FLOW_VERDICT_VICTIM;
+  }
 
-  return SendPacket(MAX_INJECT_RETRIES, scanParams->InterfaceWriteHandle, packetInfo->pcapData, packetInfo->pcapDataLen);
+  CopyMemory(etherTemplateParam, &forwardingContext->GatewayTemplate, sizeof(ETHER_TEMPLATE));
+
+  return FLOW_VERDICT_INTERNET;
 }
 
 
-BOOL ProcessData2Victim(PPACKET_INFO packetInfo, PSYSNODE realDstSys, PSCANPARAMS scanParams)
+int ForwardingLatencyClass(unsigned char verdictParam)
 {
-  CopyMemory(packetInfo->etherHdr->ether_dhost, realDstSys->data.sysMacBin, BIN_MAC_LEN);
-  CopyMemory(packetInfo->etherHdr->ether_shost, scanParams->LocalMacBin, BIN_MAC_LEN);
-  LogMsg(DBG_INFO, packetInfo->logMsg, "IN");
-
-  return SendPacket(MAX_INJECT_RETRIES, scanParams->InterfaceWriteHandle, packetInfo->pcapData, packetInfo->pcapDataLen);
+  switch (verdictParam)
+  {
+  case FLOW_VERDICT_BLOCK:
+    return LATENCY_CLASS_BLOCK;
+  case FLOW_VERDICT_GATEWAY:
+    return LATENCY_CLASS_GW;
+  case FLOW_VERDICT_VICTIM:
+    return LATENCY_CLASS_IN;
+  default:
+    return LATENCY_CLASS_OUT;
+  }
 }
 
 
-BOOL ProcessData2GW(PPACKET_INFO packetInfo, PSCANPARAMS scanParams)
+BOOL ProcessData2Internet(PPACKET_INFO packetInfo, PETHER_TEMPLATE etherTemplateParam, PFORWARDING_CONTEXT forwardingContext)
 {
-  CopyMemory(packetInfo->etherHdr->ether_dhost, scanParams->GatewayMacBin, BIN_MAC_LEN);
-  CopyMemory(packetInfo->etherHdr->ether_shost, scanParams->LocalMacBin, BIN_MAC_LEN);
-  LogMsg(DBG_INFO, packetInfo->logMsg, "GW");
+  EtherTemplateApply(packetInfo->pcapData, etherTemplateParam);
+  LogForwardedPacket(packetInfo, "OUT");
 
-  return SendPacket(MAX_INJECT_RETRIES, scanParams->InterfaceWriteHandle, packetInfo->pcapData, packetInfo->pcapDataLen);
+  return ForwardingTransmit(forwardingContext, packetInfo);
 }
 
 
-BOOL ProcessFirewalledData(PPACKET_INFO packetInfo, PSCANPARAMS scanParams)
+BOOL ProcessData2Victim(PPACKET_INFO packetInfo, PETHER_TEMPLATE etherTemplateParam, PFORWARDING_CONTEXT forwardingContext)
 {
-  LogMsg(DBG_INFO, packetInfo->logMsg, "BLOCK");
+  EtherTemplateApply(packetInfo->pcapData, etherTemplateParam);
+  LogForwardedPacket(packetInfo, "IN");
 
-  return TRUE;
+  return ForwardingTransmit(forwardingContext, packetInfo);
 }
 
 
-void PrepareDataPacketStructure(const u_char *data, PPACKET_INFO packetInfo)
+BOOL ProcessData2GW(PPACKET_INFO packetInfo, PETHER_TEMPLATE etherTemplateParam, PFORWARDING_CONTEXT forwardingContext)
 {
-  ZeroMemory(packetInfo, sizeof(PACKET_INFO));
+  EtherTemplateApply(packetInfo->pcapData, etherTemplateParam);
+  LogForwardedPacket(packetInfo, "GW");
 
-  packetInfo->pcapData = (u_char *)data;
-  packetInfo->etherHdr = (PETHDR)data;
-  packetInfo->ipHdr = (PIPHDR)(data + 14);
-  packetInfo->ipHdrLen = (packetInfo->ipHdr->ver_ihl & 0xf) * 4;
+  return ForwardingTransmit(forwardingContext, packetInfo);
+}
 
-  if (packetInfo->ipHdr->proto == IP_PROTO_TCP) // TCP
-  {
-    packetInfo->tcpHdr = (PTCPHDR)((unsigned char*)packetInfo->ipHdr + packetInfo->ipHdrLen);
-    strcat(packetInfo->proto, "TCP");
 
-    packetInfo->pktLen = ntohs(packetInfo->ipHdr->tlen) - packetInfo->ipHdrLen - packetInfo->tcpHdr->doff * 4;
-    packetInfo->dstPort = ntohs(packetInfo->tcpHdr->dport);
-    packetInfo->srcPort = ntohs(packetInfo->tcpHdr->sport);
-    snprintf(packetInfo->suffix, sizeof(packetInfo->suffix) - 1, "[%s%s%s%s%s%s]",
-      packetInfo->tcpHdr->ack ? "a" : " ",
-      packetInfo->tcpHdr->syn ? "s" : " ",
-      packetInfo->tcpHdr->psh ? "p" : " ",
-      packetInfo->tcpHdr->fin ? "f" : " ",
-      packetInfo->tcpHdr->rst ? "r" : " ",
-      packetInfo->tcpHdr->urg ? "u" : " ");
-  }
-  else if (packetInfo->ipHdr->proto == 17) // UDP
-  {
-    packetInfo->udpHdr = (PUDPHDR)((unsigned char*)packetInfo->ipHdr + packetInfo->ipHdrLen);
-    strcat(packetInfo->proto, "UDP");
-    packetInfo->pktLen = ntohs(packetInfo->udpHdr->ulen);
-    packetInfo->dstPort = ntohs(packetInfo->udpHdr->dport);
-    packetInfo->srcPort = ntohs(packetInfo->udpHdr->sport);
-  }
-  else if (packetInfo->ipHdr->proto == 1)
+/*
+ * Send the rewritten frame. Frames in a buffer the capture
+ * handle can transmit from are forwarded without a copy.
+ * They are on the transmit ring once CaptureForwardFrame()
+ * returns, their transit time ends there.
+ *
+ */
+BOOL ForwardingTransmit(PFORWARDING_CONTEXT forwardingContext, PPACKET_INFO packetInfo)
+{
+  if (forwardingContext->InPlaceHandle != NULL)
   {
-    strcat(packetInfo->proto, "ICMP");
+    if (CaptureForwardFrame(forwardingContext->InPlaceHandle, packetInfo->pcapData, packetInfo->pcapDataLen) != 0)
+    {
+      return FALSE;
+    }
+
+    PROBE_PACKETS_TRANSMITTED(&packetInfo->pcapData, 1);
+
+    if (forwardingContext->Latency != NULL)
+    {
+      LatencyStatsRecordTransit(forwardingContext->Latency, packetInfo->latencyClass, packetInfo->captureTimeUs, LatencyStatsWallClockUs());
+    }
+
+    return TRUE;
   }
-  else
+
+  return TransmitQueueAdd(forwardingContext->TransmitQueue, packetInfo->pcapData, packetInfo->pcapDataLen);
+}
+
+
+BOOL ProcessFirewalledData(PPACKET_INFO packetInfo, PFORWARDING_CONTEXT forwardingContext)
+{
+  LogForwardedPacket(packetInfo, "BLOCK");
+
+  return TRUE;
+}
+
+
+/*
+ * Decode the frame once. Everything downstream works
+ * on the offsets in packetInfo->view.
+ *
+ */
+BOOL PrepareDataPacketStructure(const u_char *data, unsigned int dataLength, PPACKET_INFO packetInfo)
+{
+  PACKET_VIEW view;
+
+  if (PacketViewParse(data, dataLength, &view) == FALSE ||
+      (view.Layers & PV_LAYER_IPV4) == 0)
   {
-    strcat(packetInfo->proto, "Unknown");
+    return FALSE;
   }
+
+  PreparePacketInfo(data, dataLength, &view, packetInfo);
+
+  return TRUE;
 }
 
 
-BOOL SendPacket(int maxTries, LPVOID writeHandle, u_char *data, unsigned int dataSize)
+/*
+ * Fill in packetInfo for a frame that was decoded already,
+ * e.g. by the forwarding engine's capture thread.
+ *
+ */
+void PreparePacketInfo(const u_char *data, unsigned int dataLength, PPACKET_VIEW viewParam, PPACKET_INFO packetInfo)
 {
-  BOOL retVal = FALSE;
-  int counter = 0;
+  ZeroMemory(packetInfo, sizeof(PACKET_INFO));
+  CopyMemory(&packetInfo->view, viewParam, sizeof(PACKET_VIEW));
+
+  packetInfo->pcapData = (u_char *)data;
+  packetInfo->pcapDataLen = dataLength;
+  packetInfo->etherHdr = PV_ETH(data);
+  packetInfo->ipHdr = PV_IP(data, &packetInfo->view);
+  packetInfo->proto = PacketViewProtoName(&packetInfo->view);
+}
+
+
+/*
+ * The packet handlers only carry binary addresses. The
+ * text line is built here and only if it actually gets
+ * written to the log.
+ *
+ */
+void LogForwardedPacket(PPACKET_INFO packetInfo, char *directionParam)
+{
+  char srcIp[MAX_IP_LEN + 1];
+  char dstIp[MAX_IP_LEN + 1];
+  char suffix[16];
 
-  for (; counter < maxTries; counter++)
+  if (LogLevelEnabled(DBG_INFO) == FALSE)
   {
-    if (pcap_sendpacket(writeHandle, data, dataSize) == 0)
-    {
-      retVal = TRUE;
-      break;
-    }
+    return;
   }
 
-  return retVal;
+  ZeroMemory(srcIp, sizeof(srcIp));
+  ZeroMemory(dstIp, sizeof(dstIp));
+  ZeroMemory(suffix, sizeof(suffix));
+
+  IpBin2String((unsigned char *)&packetInfo->srcIpBin, (unsigned char *)srcIp, sizeof(srcIp) - 1);
+  IpBin2String((unsigned char *)&packetInfo->dstIpBin, (unsigned char *)dstIp, sizeof(dstIp) - 1);
+
+  if (packetInfo->view.Layers & PV_LAYER_TCP)
+  {
+    snprintf(suffix, sizeof(suffix) - 1, "[%s%s%s%s%s%s]",
+      packetInfo->view.TcpFlags & PV_TCP_ACK ? "a" : " ",
+      packetInfo->view.TcpFlags & PV_TCP_SYN ? "s" : " ",
+      packetInfo->view.TcpFlags & PV_TCP_PSH ? "p" : " ",
+      packetInfo->view.TcpFlags & PV_TCP_FIN ? "f" : " ",
+      packetInfo->view.TcpFlags & PV_TCP_RST ? "r" : " ",
+      packetInfo->view.TcpFlags & PV_TCP_URG ? "u" : " ");
+  }
+
+  LogMsg(DBG_INFO, "%-5s %-4s %-15s %5d -> %-15s %-5d    %5d bytes    %s",
+    directionParam, packetInfo->proto, srcIp, packetInfo->view.SrcPort, dstIp,
+    packetInfo->view.DstPort, packetInfo->view.PayloadLength, suffix);
 }
 
 
@@ -303,6 +740,13 @@ BOOL RouterIPv4_ControlHandler(DWORD pControlType)
     return FALSE;
 
   case CTRL_BREAK_EVENT:
+    // Latency report instead of exiting
+    if (LatencyStatsEnabled() == TRUE)
+    {
+      LatencyStatsPrint();
+      return TRUE;
+    }
+
     LogMsg(DBG_INFO, "Ctrl-Break event : Exiting process");
     CloseAllPcapHandles();
     LogMsg(DBG_INFO, "Ctrl-C event : pcap closed");
@@ -334,24 +778,30 @@ void CloseAllPcapHandles()
   if (gScanParams.PcapFileHandle != NULL)
   {
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.PcapFileHandle");
-    pcap_breakloop(gScanParams.PcapFileHandle);
-    pcap_close(gScanParams.PcapFileHandle);
+    CaptureBreakLoop(gScanParams.PcapFileHandle);
+    CaptureClose(gScanParams.PcapFileHandle);
+    gScanParams.PcapFileHandle = NULL;
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.PcapFileHandle done");
   }
 
-  if (gScanParams.InterfaceWriteHandle != NULL)
+  // Read and write handle usually are the same capture handle.
+  if (gScanParams.InterfaceWriteHandle != NULL &&
+      gScanParams.InterfaceWriteHandle != gScanParams.InterfaceReadHandle)
   {
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.InterfaceWriteHandle");
-    pcap_breakloop(gScanParams.InterfaceWriteHandle);
-    pcap_close(gScanParams.InterfaceWriteHandle);
+    CaptureBreakLoop(gScanParams.InterfaceWriteHandle);
+    CaptureClose(gScanParams.InterfaceWriteHandle);
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.InterfaceWriteHandle done");
   }
 
+  gScanParams.InterfaceWriteHandle = NULL;
+
   if (gScanParams.InterfaceReadHandle != NULL)
   {
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.InterfaceReadHandle");
-    pcap_breakloop(gScanParams.InterfaceReadHandle);
-    pcap_close(gScanParams.InterfaceReadHandle);
+    CaptureBreakLoop(gScanParams.InterfaceReadHandle);
+    CaptureClose(gScanParams.InterfaceReadHandle);
+    gScanParams.InterfaceReadHandle = NULL;
     LogMsg(DBG_INFO, "CloseAllPcapHandles(): Closing gScanParams.InterfaceReadHandle done");
   }
-}
+}
\ No newline at end of file
@@ -1,43 +1,100 @@
 #pragma once
 
 #include <windows.h>
-#include "LinkedListTargetSystems.h"
+#include "EtherTemplate.h"
+#include "FirewallClassifier.h"
+#include "FlowCache.h"
+#include "HostTable.h"
+#include "LatencyStats.h"
+#include "LinkedListFirewallRules.h"
+#include "PacketCapture.h"
+#include "PacketView.h"
+#include "TransmitQueue.h"
+
+
+// Set to capture with AF_XDP (Linux, zero-copy drivers only)
+#define FORWARDING_AFXDP_ENV "ROUTERIPV4_AFXDP"
 
 
 typedef struct
 {
   u_char *pcapData;
   unsigned int pcapDataLen;
+  PACKET_VIEW view;
   PETHDR etherHdr;
   PIPHDR ipHdr;
-  PTCPHDR tcpHdr;
-  PUDPHDR udpHdr;
-  int ipHdrLen;
-  unsigned char srcIp[MAX_BUF_SIZE + 1];
   unsigned long srcIpBin;
-  unsigned char dstIp[MAX_BUF_SIZE + 1];
   unsigned long dstIpBin;
-  unsigned short dstPort;
-  unsigned short srcPort;
-  char proto[128];
-  unsigned short pktLen;
-  char suffix[MAX_BUF_SIZE + 1];
-  char logMsg[MAX_BUF_SIZE + 1];
+  char *proto;
+  uint64_t captureTimeUs;
+  int latencyClass;
 }
 PACKET_INFO, *PPACKET_INFO;
 
 
+/*
+ * Everything one forwarding thread works with. Each forwarding
+ * worker has its own context and its own transmit queue. The
+ * target systems are looked up in the shared host table, which
+ * readers access without a lock. The compiled firewall rules
+ * are only read after startup and are shared. Without them the
+ * rule list is walked.
+ *
+ * Verdicts are remembered per flow in FlowCache, together with
+ * the next hop's Ethernet addresses. A change of the host table
+ * generation or of gFirewallRulesGeneration invalidates them.
+ * GatewayTemplate is built once, the gateway doesn't change.
+ *
+ * InPlaceHandle is set if the frames are received into buffers
+ * the capture handle can send from directly (AF_XDP). They are
+ * forwarded from there instead of being copied to the queue.
+ *
+ * Latency is only set if LATENCY_STATS_ENV is, see LatencyStats.h.
+ * Frames from a file (OfflineCapture) carry old capture
+ * timestamps, for them only the handler time is recorded.
+ *
+ */
+typedef struct
+{
+  PSCANPARAMS ScanParams;
+  PTRANSMIT_QUEUE TransmitQueue;
+  PCAPTURE_HANDLE InPlaceHandle;
+  ETHER_TEMPLATE GatewayTemplate;
+  PRULENODE FirewallRules;
+  PFIREWALL_CLASSIFIER Firewall;
+  LONG TargetsGeneration;
+  LONG FirewallGeneration;
+  FLOW_CACHE FlowCache;
+  PLATENCY_STATS Latency;
+  BOOL OfflineCapture;
+  unsigned long long Packets;
+  unsigned long long Blocked;
+  unsigned long long SendErrors;
+}
+FORWARDING_CONTEXT, *PFORWARDING_CONTEXT;
+
+
 /*
  * Function forward declarations
  *
  */
+BOOL ForwardingContextInit(PFORWARDING_CONTEXT forwardingContext, PSCANPARAMS scanParams, PCAPTURE_HANDLE writeHandle);
+void ForwardingContextRelease(PFORWARDING_CONTEXT forwardingContext);
+void ForwardingTransmitError(void *contextParam, unsigned int failedFramesParam, char *errorParam);
+void ForwardingContextRefresh(PFORWARDING_CONTEXT forwardingContext);
+void PacketForwarding_batch_handler(u_char *param, PCAPTURE_BATCH batch);
 void PacketForwarding_handler(u_char *param, const struct pcap_pkthdr *pktHeader, const u_char *data);
+void ForwardPacket(PFORWARDING_CONTEXT forwardingContext, PPACKET_INFO packetInfo);
+BOOL ForwardingTransmit(PFORWARDING_CONTEXT forwardingContext, PPACKET_INFO packetInfo);
+unsigned char ForwardingVerdict(PFORWARDING_CONTEXT forwardingContext, PPACKET_INFO packetInfo, PETHER_TEMPLATE etherTemplateParam);
+int ForwardingLatencyClass(unsigned char verdictParam);
 BOOL RouterIPv4_ControlHandler(DWORD pControlType);
 DWORD PacketHandlerRouterIPv4(PSCANPARAMS lpParam);
-void PrepareDataPacketStructure(const u_char *data, PPACKET_INFO packetInfo);
-BOOL SendPacket(int maxTries, LPVOID writeHandle, u_char *data, unsigned int dataSize);
-BOOL ProcessData2GW(PPACKET_INFO packetInfo, PSCANPARAMS scanParams);
-BOOL ProcessData2Internet(PPACKET_INFO packetInfo, PSCANPARAMS scanParams);
-BOOL ProcessFirewalledData(PPACKET_INFO packetInfo, PSCANPARAMS scanParams);
-BOOL ProcessData2Victim(PPACKET_INFO packetInfo, PSYSNODE realDstSys, PSCANPARAMS scanParams);
+BOOL PrepareDataPacketStructure(const u_char *data, unsigned int dataLength, PPACKET_INFO packetInfo);
+void PreparePacketInfo(const u_char *data, unsigned int dataLength, PPACKET_VIEW viewParam, PPACKET_INFO packetInfo);
+BOOL ProcessData2GW(PPACKET_INFO packetInfo, PETHER_TEMPLATE etherTemplateParam, PFORWARDING_CONTEXT forwardingContext);
+BOOL ProcessData2Internet(PPACKET_INFO packetInfo, PETHER_TEMPLATE etherTemplateParam, PFORWARDING_CONTEXT forwardingContext);
+BOOL ProcessFirewalledData(PPACKET_INFO packetInfo, PFORWARDING_CONTEXT forwardingContext);
+BOOL ProcessData2Victim(PPACKET_INFO packetInfo, PETHER_TEMPLATE etherTemplateParam, PFORWARDING_CONTEXT forwardingContext);
+void LogForwardedPacket(PPACKET_INFO packetInfo, char *directionParam);
 void CloseAllPcapHandles();
\ No newline at end of file
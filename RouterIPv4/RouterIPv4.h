@@ -3,7 +3,6 @@
 #include "NetworkStructs.h"
 
 #define MAX_BUF_SIZE 1024
-#define MAX_SYSTEMS_COUNT 1024
 
 #define ROUTERIPV4_VERSION "0.1"
 #define FILE_HOST_TARGETS ".targethosts"
@@ -17,18 +16,6 @@
  *
  */
 
-typedef struct
-{
-  unsigned char sysIpStr[MAX_IP_LEN + 1];
-  unsigned char sysIpBin[BIN_IP_LEN];
-  unsigned char sysMacBin[BIN_MAC_LEN];
-  unsigned char srcIpStr[MAX_IP_LEN + 1];
-  unsigned char dstIpStr[MAX_IP_LEN + 1];
-  unsigned short srcPort;
-  unsigned short dstPort;
-} SYSTEMNODE, *PSYSTEMNODE, **PPSYSTEMNODE;
-
-
 typedef struct SCANPARAMS
 {
   unsigned char ApplicationName[MAX_BUF_SIZE + 1];
@@ -51,6 +38,7 @@ typedef struct SCANPARAMS
   unsigned char *PcapPattern;
   unsigned char OutputPipeName[MAX_BUF_SIZE + 1];
   unsigned char PcapFilePath[MAX_BUF_SIZE + 1];
+  unsigned char DumpFilePath[MAX_BUF_SIZE + 1];  // Dry run output, see OpenPcapOutputHandle()
   HANDLE PipeHandle;
   void *InterfaceReadHandle;  // HACK! because of header hell :/ Anyone?
   void *InterfaceWriteHandle; // HACK! because of header hell :/ Anyone?
@@ -0,0 +1,630 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <windows.h>
+
+#include "Sniffer.h"
+#include "SniffAndEvaluate.h"
+#include "ConnectionTable.h"
+#include "ModeMinary.h"
+
+// Chunks of a record written without an allocation
+#define CONNECTION_OUTPUT_VECTOR_SIZE 16
+
+
+struct CONNECTION_TABLE
+{
+  PCONNODE *Buckets;
+  unsigned int BucketMask;
+  PCONNODE Nodes;
+  PCONNODE FreeNodes;
+  int Capacity;
+  PTIMER_WHEEL Wheel;
+  PTCP_REASSEMBLY Reassembly;
+  PPAYLOAD_POOL Payload;
+  PHTTP_PARSER Http;
+  unsigned int HttpFields;    // Header fields written out, 0 for all
+  uint64_t Now;
+  CONNECTION_TABLE_STATS Stats;
+};
+
+
+static void ConnectionTableAppend(PCONNECTION_TABLE tableParam, PCONNODE nodeParam, unsigned char *dataParam, unsigned int lengthParam);
+static void ConnectionTableClock(PCONNECTION_TABLE tableParam, uint64_t nowParam);
+static void ConnectionTableDeliver(void *contextParam, void *ownerParam, unsigned char *dataParam, unsigned int lengthParam);
+static unsigned int ConnectionTableHash(PCONNECTION_ID idParam);
+static PCONNODE *ConnectionTableFind(PCONNECTION_TABLE tableParam, PCONNECTION_ID idParam);
+static void ConnectionTableHttpEvent(void *contextParam, PHTTP_STREAM streamParam, PHTTP_EVENT eventParam);
+static uint64_t ConnectionTableIdleTick(PCONNODE nodeParam);
+static void ConnectionTableIdleTimer(void *contextParam, PTIMER_WHEEL_TIMER timerParam);
+static void ConnectionTableRelease(PCONNECTION_TABLE tableParam, PCONNODE nodeParam);
+
+
+/*
+ * The buckets outnumber the nodes two to one, chains stay short
+ * even when the table is full
+ *
+ */
+PCONNECTION_TABLE ConnectionTableCreate(int capacityParam)
+{
+  PCONNECTION_TABLE retVal = NULL;
+  PCONNECTION_TABLE table = NULL;
+  unsigned int bucketCount = 1;
+  int counter = 0;
+
+  if (capacityParam <= 0)
+  {
+    goto END;
+  }
+
+  while (bucketCount < (unsigned int)capacityParam * 2)
+  {
+    bucketCount <<= 1;
+  }
+
+  if ((table = (PCONNECTION_TABLE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(CONNECTION_TABLE))) == NULL ||
+      (table->Buckets = (PCONNODE *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, bucketCount * sizeof(PCONNODE))) == NULL ||
+      (table->Nodes = (PCONNODE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, capacityParam * sizeof(CONNODE))) == NULL ||
+      (table->Wheel = TimerWheelCreate(0)) == NULL ||
+      (table->Reassembly = TcpReassemblyCreate(TCP_REASSEMBLY_MAX_BUFFERED, ConnectionTableDeliver, table)) == NULL ||
+      (table->Payload = PayloadPoolCreate(PAYLOAD_POOL_MAX_CHUNKS)) == NULL ||
+      (table->Http = HttpParserCreate(ConnectionTableHttpEvent, table)) == NULL)
+  {
+    goto END;
+  }
+
+  table->BucketMask = bucketCount - 1;
+  table->Capacity = capacityParam;
+
+  for (counter = capacityParam - 1; counter >= 0; counter--)
+  {
+    table->Nodes[counter].HashNext = table->FreeNodes;
+    table->FreeNodes = &table->Nodes[counter];
+  }
+
+  retVal = table;
+  table = NULL;
+
+END:
+
+  ConnectionTableDestroy(table);
+
+  return retVal;
+}
+
+
+/*
+ * Data still buffered is dropped
+ *
+ */
+void ConnectionTableDestroy(PCONNECTION_TABLE tableParam)
+{
+  unsigned int bucket = 0;
+  PCONNODE tempNode = NULL;
+
+  if (tableParam == NULL)
+  {
+    return;
+  }
+
+  if (tableParam->Buckets != NULL)
+  {
+    for (bucket = 0; bucket <= tableParam->BucketMask; bucket++)
+    {
+      for (tempNode = tableParam->Buckets[bucket]; tempNode != NULL; tempNode = tempNode->HashNext)
+      {
+        TcpStreamRelease(tableParam->Reassembly, &tempNode->Stream);
+      }
+    }
+
+    HeapFree(GetProcessHeap(), 0, tableParam->Buckets);
+  }
+
+  if (tableParam->Nodes != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, tableParam->Nodes);
+  }
+
+  TimerWheelDestroy(tableParam->Wheel);
+  TcpReassemblyDestroy(tableParam->Reassembly);
+  PayloadPoolDestroy(tableParam->Payload);
+  HttpParserDestroy(tableParam->Http);
+  HeapFree(GetProcessHeap(), 0, tableParam);
+}
+
+
+/*
+ * Comma separated header field names, e.g. "Host,Cookie".
+ * Only these fields are written out, by default all are.
+ *
+ */
+BOOL ConnectionTableSetHttpFields(PCONNECTION_TABLE tableParam, char *fieldListParam)
+{
+  char fieldName[HTTP_MAX_FIELD_NAME + 1];
+  size_t nameLength = 0;
+  int field = 0;
+
+  if (tableParam == NULL ||
+      fieldListParam == NULL)
+  {
+    return FALSE;
+  }
+
+  while (*fieldListParam != 0)
+  {
+    fieldListParam += strspn(fieldListParam, " ,");
+
+    if ((nameLength = strcspn(fieldListParam, " ,")) == 0)
+    {
+      continue;
+    }
+
+    if (nameLength > HTTP_MAX_FIELD_NAME)
+    {
+      return FALSE;
+    }
+
+    ZeroMemory(fieldName, sizeof(fieldName));
+    CopyMemory(fieldName, fieldListParam, nameLength);
+    fieldListParam += nameLength;
+
+    if ((field = HttpParserAddField(tableParam->Http, fieldName)) < 0)
+    {
+      return FALSE;
+    }
+
+    tableParam->HttpFields |= 1u << field;
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * A hit counts as activity and defers
+ * the connection's idle expiry
+ *
+ */
+PCONNODE ConnectionTableLookup(PCONNECTION_TABLE tableParam, PCONNECTION_ID idParam, uint64_t nowParam)
+{
+  PCONNODE *nodeRef = NULL;
+
+  if (tableParam == NULL ||
+      idParam == NULL)
+  {
+    return NULL;
+  }
+
+  ConnectionTableClock(tableParam, nowParam);
+
+  if (*(nodeRef = ConnectionTableFind(tableParam, idParam)) == NULL)
+  {
+    return NULL;
+  }
+
+  // The timer is not touched, when it fires it
+  // finds the new time and waits for the rest
+  (*nodeRef)->LastSeen = tableParam->Now;
+
+  return *nodeRef;
+}
+
+
+/*
+ * Returns the existing node if the connection is known
+ * already, NULL if the table is full
+ *
+ */
+PCONNODE ConnectionTableAdd(PCONNECTION_TABLE tableParam, unsigned char *srcMacBinParam, PCONNECTION_ID idParam, uint64_t nowParam)
+{
+  PCONNODE *nodeRef = NULL;
+  PCONNODE tempNode = NULL;
+
+  if (tableParam == NULL ||
+      srcMacBinParam == NULL ||
+      idParam == NULL ||
+      idParam->srcPort <= 0 ||
+      idParam->dstPort <= 0)
+  {
+    return NULL;
+  }
+
+  ConnectionTableClock(tableParam, nowParam);
+
+  if (*(nodeRef = ConnectionTableFind(tableParam, idParam)) != NULL)
+  {
+    (*nodeRef)->LastSeen = tableParam->Now;
+    return *nodeRef;
+  }
+
+  if ((tempNode = tableParam->FreeNodes) == NULL)
+  {
+    tableParam->Stats.Dropped++;
+    return NULL;
+  }
+
+  tableParam->FreeNodes = tempNode->HashNext;
+
+  CopyMemory(&tempNode->ID, idParam, sizeof(CONNECTION_ID));
+  CopyMemory(tempNode->srcMacBin, srcMacBinParam, BIN_MAC_LEN);
+  tempNode->Created = tableParam->Now;
+  tempNode->LastSeen = tableParam->Now;
+  TcpStreamInit(&tempNode->Stream, tempNode);
+  HttpStreamInit(&tempNode->Http, tempNode);
+
+  // The lookup left nodeRef at the end of the bucket's chain
+  tempNode->HashNext = NULL;
+  *nodeRef = tempNode;
+
+  TimerWheelSchedule(tableParam->Wheel, &tempNode->Timer, ConnectionTableIdleTick(tempNode));
+
+  tableParam->Stats.Count++;
+  tableParam->Stats.Created++;
+
+  return tempNode;
+}
+
+
+/*
+ * seqParam in host byte order. capturedLengthParam of the
+ * segmentLengthParam payload bytes are in dataParam. The
+ * messages the segment completes are written out.
+ *
+ */
+void ConnectionTableAddSegment(PCONNECTION_TABLE tableParam, PCONNODE nodeParam, uint32_t seqParam, unsigned char tcpFlagsParam, unsigned char *dataParam, int capturedLengthParam, int segmentLengthParam)
+{
+  if (tableParam == NULL || nodeParam == NULL || capturedLengthParam < 0 || segmentLengthParam < 0)
+  {
+    return;
+  }
+
+  TcpStreamSegment(tableParam->Reassembly, &nodeParam->Stream, seqParam, tcpFlagsParam, dataParam, (unsigned int)capturedLengthParam, (unsigned int)segmentLengthParam);
+}
+
+
+/*
+ * The connection was closed (FIN or RST). A response
+ * delimited by the close is written out.
+ *
+ */
+void ConnectionTableRemove(PCONNECTION_TABLE tableParam, PCONNECTION_ID idParam)
+{
+  PCONNODE tempNode = NULL;
+
+  if (tableParam == NULL ||
+      idParam == NULL ||
+      (tempNode = *ConnectionTableFind(tableParam, idParam)) == NULL)
+  {
+    return;
+  }
+
+  tableParam->Stats.Closed++;
+  ConnectionTableRelease(tableParam, tempNode);
+}
+
+
+/*
+ * Write out and remove the connections idle for
+ * CONNECTION_IDLE_TIMEOUT_MS. Cheap enough to be
+ * called for every packet, the wheel only moves
+ * every CONNECTION_TABLE_TICK_MS.
+ *
+ */
+int ConnectionTableExpire(PCONNECTION_TABLE tableParam, uint64_t nowParam)
+{
+  uint64_t idleExpired = 0;
+
+  if (tableParam == NULL)
+  {
+    return 0;
+  }
+
+  ConnectionTableClock(tableParam, nowParam);
+  idleExpired = tableParam->Stats.IdleExpired;
+  TimerWheelAdvance(tableParam->Wheel, tableParam->Now / CONNECTION_TABLE_TICK_MS, ConnectionTableIdleTimer, tableParam);
+
+  return (int)(tableParam->Stats.IdleExpired - idleExpired);
+}
+
+
+int ConnectionTableCount(PCONNECTION_TABLE tableParam)
+{
+  return tableParam != NULL ? tableParam->Stats.Count : 0;
+}
+
+
+void ConnectionTableGetStats(PCONNECTION_TABLE tableParam, PCONNECTION_TABLE_STATS statsParam)
+{
+  if (tableParam == NULL ||
+      statsParam == NULL)
+  {
+    return;
+  }
+
+  CopyMemory(statsParam, &tableParam->Stats, sizeof(CONNECTION_TABLE_STATS));
+  TcpReassemblyGetStats(tableParam->Reassembly, &statsParam->Reassembly);
+  PayloadPoolGetStats(tableParam->Payload, &statsParam->Payload);
+  HttpParserGetStats(tableParam->Http, &statsParam->Http);
+}
+
+
+/*
+ * One HTTPREQ record, read straight from the rope's chunks
+ *
+ */
+void WriteHttpDataToPipe(PPAYLOAD_ROPE payloadParam, unsigned char *srcMacBinParam, PCONNECTION_ID idParam)
+{
+  OUTPUT_BUFFER vectorBuffer[CONNECTION_OUTPUT_VECTOR_SIZE];
+  POUTPUT_BUFFER vector = vectorBuffer;
+  char header[MAX_OUTPUT_HEADER_LEN + 1];
+  PPAYLOAD_CHUNK chunk = NULL;
+  int vectorCount = 0;
+
+  if (payloadParam == NULL ||
+      payloadParam->Length == 0)
+  {
+    return;
+  }
+
+  // Header, chunks, line end
+  if (payloadParam->ChunkCount + 2 > CONNECTION_OUTPUT_VECTOR_SIZE &&
+      (vector = (POUTPUT_BUFFER)HeapAlloc(GetProcessHeap(), 0, (payloadParam->ChunkCount + 2) * sizeof(OUTPUT_BUFFER))) == NULL)
+  {
+    return;
+  }
+
+  ZeroMemory(header, sizeof(header));
+  vector[vectorCount].Data = header;
+  vector[vectorCount++].Length = FormatOutputHeader(header, MAX_OUTPUT_HEADER_LEN, "HTTPREQ", srcMacBinParam, idParam->srcIpBin, idParam->srcPort, idParam->dstIpBin, idParam->dstPort);
+
+  for (chunk = payloadParam->Head; chunk != NULL; chunk = chunk->Next)
+  {
+    vector[vectorCount].Data = (char *)chunk->Data;
+    vector[vectorCount++].Length = (int)chunk->Length;
+  }
+
+  vector[vectorCount].Data = "\r\n";
+  vector[vectorCount++].Length = 2;
+
+  WriteOutputVector(vector, vectorCount);
+
+  if (vector != vectorBuffer)
+  {
+    HeapFree(GetProcessHeap(), 0, vector);
+  }
+}
+
+
+
+/*
+ * Stringified into the node's rope, what does not fit
+ * into MAX_CONNECTION_VOLUME is left out
+ *
+ */
+static void ConnectionTableAppend(PCONNECTION_TABLE tableParam, PCONNODE nodeParam, unsigned char *dataParam, unsigned int lengthParam)
+{
+  unsigned char *space = NULL;
+  unsigned int spaceLength = 0;
+  unsigned int counter = 0;
+
+  while (lengthParam > 0 &&
+         nodeParam->Payload.Length < MAX_CONNECTION_VOLUME &&
+         (space = PayloadRopeReserve(tableParam->Payload, &nodeParam->Payload, &spaceLength)) != NULL)
+  {
+    spaceLength = spaceLength < lengthParam ? spaceLength : lengthParam;
+    spaceLength = spaceLength < MAX_CONNECTION_VOLUME - nodeParam->Payload.Length ? spaceLength : MAX_CONNECTION_VOLUME - nodeParam->Payload.Length;
+
+    for (counter = 0; counter < spaceLength; counter++)
+    {
+      space[counter] = dataParam[counter] < 32 || dataParam[counter] > 126 ? '.' : dataParam[counter];
+    }
+
+    PayloadRopeCommit(&nodeParam->Payload, spaceLength);
+    dataParam += spaceLength;
+    lengthParam -= spaceLength;
+  }
+
+  tableParam->Stats.TruncatedBytes += lengthParam;
+}
+
+
+/*
+ * Capture timestamps of a replay start over with
+ * every loop, the table's time never goes back
+ *
+ */
+static void ConnectionTableClock(PCONNECTION_TABLE tableParam, uint64_t nowParam)
+{
+  if (nowParam > tableParam->Now)
+  {
+    tableParam->Now = nowParam;
+  }
+}
+
+
+static void ConnectionTableDeliver(void *contextParam, void *ownerParam, unsigned char *dataParam, unsigned int lengthParam)
+{
+  PCONNECTION_TABLE table = (PCONNECTION_TABLE)contextParam;
+  PCONNODE tempNode = (PCONNODE)ownerParam;
+
+  HttpStreamData(table->Http, &tempNode->Http, dataParam, lengthParam);
+}
+
+
+/*
+ * MurmurHash3 x86_32 over the four words of the ID
+ *
+ */
+static unsigned int ConnectionTableHash(PCONNECTION_ID idParam)
+{
+  unsigned int words[sizeof(CONNECTION_ID) / sizeof(unsigned int)];
+  unsigned int hash = 0;
+  unsigned int word = 0;
+  int counter = 0;
+
+  CopyMemory(words, idParam, sizeof(words));
+
+  for (counter = 0; counter < (int)(sizeof(words) / sizeof(words[0])); counter++)
+  {
+    word = words[counter] * 0xcc9e2d51;
+    word = (word << 15) | (word >> 17);
+    word *= 0x1b873593;
+
+    hash ^= word;
+    hash = (hash << 13) | (hash >> 19);
+    hash = hash * 5 + 0xe6546b64;
+  }
+
+  hash ^= sizeof(words);
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+
+  return hash;
+}
+
+
+/*
+ * Returns the link pointing to the node, or the
+ * empty link at the end of the bucket's chain
+ *
+ */
+static PCONNODE *ConnectionTableFind(PCONNECTION_TABLE tableParam, PCONNECTION_ID idParam)
+{
+  PCONNODE *nodeRef = &tableParam->Buckets[ConnectionTableHash(idParam) & tableParam->BucketMask];
+
+  while (*nodeRef != NULL &&
+         memcmp(&(*nodeRef)->ID, idParam, sizeof(CONNECTION_ID)) != 0)
+  {
+    nodeRef = &(*nodeRef)->HashNext;
+  }
+
+  return nodeRef;
+}
+
+
+/*
+ * Build the record of the current message in the node's rope,
+ * the same text the proxies write: the start line, "..Name: value"
+ * for each header field, "...." and the body. Line breaks and other
+ * control characters become dots.
+ *
+ */
+static void ConnectionTableHttpEvent(void *contextParam, PHTTP_STREAM streamParam, PHTTP_EVENT eventParam)
+{
+  PCONNECTION_TABLE table = (PCONNECTION_TABLE)contextParam;
+  PCONNODE tempNode = (PCONNODE)streamParam->Owner;
+  BOOL selected = table->HttpFields == 0 ||
+                  (eventParam->Field >= 0 && (table->HttpFields & (1u << eventParam->Field)) != 0);
+  char *fieldName = NULL;
+
+  switch (eventParam->Type)
+  {
+    case HTTP_EVENT_START_LINE:
+    case HTTP_EVENT_BODY:
+      ConnectionTableAppend(table, tempNode, eventParam->Data, eventParam->Length);
+      break;
+
+    // Unless all fields are written out, the name is
+    // only known with its last piece
+    case HTTP_EVENT_HEADER_NAME:
+      if (table->HttpFields == 0)
+      {
+        if (eventParam->Piece & HTTP_PIECE_FIRST)
+        {
+          ConnectionTableAppend(table, tempNode, (unsigned char *)"..", 2);
+        }
+
+        ConnectionTableAppend(table, tempNode, eventParam->Data, eventParam->Length);
+      }
+      else if ((eventParam->Piece & HTTP_PIECE_LAST) && selected &&
+               (fieldName = HttpParserFieldName(table->Http, eventParam->Field)) != NULL)
+      {
+        ConnectionTableAppend(table, tempNode, (unsigned char *)"..", 2);
+        ConnectionTableAppend(table, tempNode, (unsigned char *)fieldName, (unsigned int)strlen(fieldName));
+      }
+      break;
+
+    case HTTP_EVENT_HEADER_VALUE:
+      if (selected)
+      {
+        if (eventParam->Piece & HTTP_PIECE_FIRST)
+        {
+          ConnectionTableAppend(table, tempNode, (unsigned char *)": ", 2);
+        }
+
+        ConnectionTableAppend(table, tempNode, eventParam->Data, eventParam->Length);
+      }
+      break;
+
+    case HTTP_EVENT_HEAD_END:
+      ConnectionTableAppend(table, tempNode, (unsigned char *)"....", 4);
+      break;
+
+    case HTTP_EVENT_MESSAGE_END:
+      WriteHttpDataToPipe(&tempNode->Payload, tempNode->srcMacBin, &tempNode->ID);
+      PayloadRopeRelease(table->Payload, &tempNode->Payload);
+      break;
+
+    case HTTP_EVENT_ABORT:
+      PayloadRopeRelease(table->Payload, &tempNode->Payload);
+      break;
+  }
+}
+
+
+static uint64_t ConnectionTableIdleTick(PCONNODE nodeParam)
+{
+  return (nodeParam->LastSeen + CONNECTION_IDLE_TIMEOUT_MS) / CONNECTION_TABLE_TICK_MS + 1;
+}
+
+
+static void ConnectionTableIdleTimer(void *contextParam, PTIMER_WHEEL_TIMER timerParam)
+{
+  PCONNECTION_TABLE table = (PCONNECTION_TABLE)contextParam;
+  PCONNODE tempNode = (PCONNODE)((char *)timerParam - offsetof(CONNODE, Timer));
+
+  // Seen since the timer was set, wait for the rest
+  if (table->Now - tempNode->LastSeen < CONNECTION_IDLE_TIMEOUT_MS)
+  {
+    TimerWheelSchedule(table->Wheel, &tempNode->Timer, ConnectionTableIdleTick(tempNode));
+    return;
+  }
+
+  table->Stats.IdleExpired++;
+  ConnectionTableRelease(table, tempNode);
+}
+
+
+/*
+ * Write out the node's data, unlink it and
+ * put it back on the free list
+ *
+ */
+static void ConnectionTableRelease(PCONNECTION_TABLE tableParam, PCONNODE nodeParam)
+{
+  PCONNODE *nodeRef = ConnectionTableFind(tableParam, &nodeParam->ID);
+
+  if (*nodeRef != nodeParam)
+  {
+    return;
+  }
+
+  *nodeRef = nodeParam->HashNext;
+  TimerWheelCancel(tableParam->Wheel, &nodeParam->Timer);
+
+  // Segments still waiting for a hole to be filled
+  TcpStreamFlush(tableParam->Reassembly, &nodeParam->Stream);
+  TcpStreamRelease(tableParam->Reassembly, &nodeParam->Stream);
+  HttpStreamClose(tableParam->Http, &nodeParam->Http);
+
+  // What is left belongs to an incomplete message
+  PayloadRopeRelease(tableParam->Payload, &nodeParam->Payload);
+
+  ZeroMemory(nodeParam, sizeof(CONNODE));
+  nodeParam->HashNext = tableParam->FreeNodes;
+  tableParam->FreeNodes = nodeParam;
+  tableParam->Stats.Count--;
+}
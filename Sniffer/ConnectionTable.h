@@ -0,0 +1,102 @@
+#ifndef __CONNECTIONTABLE__
+#define __CONNECTIONTABLE__
+
+#include <stdint.h>
+#include "HttpParser.h"
+#include "PayloadPool.h"
+#include "TcpReassembly.h"
+#include "TimerWheel.h"
+
+
+/*
+ * Flow table of the HTTP connections the sniffer reassembles
+ *
+ * Hash table keyed by the binary 5-tuple. Nodes come from a pool
+ * allocated once, lookup, insert and remove are O(1). Idle flows
+ * are expired by a timer wheel.
+ *
+ * Each node is one direction of a TCP connection. Its segments go
+ * through the node's TCP_STREAM, the reassembled bytes through its
+ * HTTP_STREAM. The start line, the selected header fields and the
+ * body of the current message are collected in the node's payload
+ * rope, at most MAX_CONNECTION_VOLUME bytes of it. Each complete
+ * message is written out as one record, an incomplete one is
+ * dropped.
+ *
+ * Times are milliseconds, taken from the capture timestamps.
+ *
+ * Only the capture thread uses the table, it has no lock.
+ *
+ */
+#define CONNECTION_TABLE_CAPACITY 16384
+#define CONNECTION_TABLE_TICK_MS 100
+#define CONNECTION_IDLE_TIMEOUT_MS (TCP_MAX_ACTIVITY * 1000)
+
+
+/*
+ * Type declarations.
+ *
+ */
+typedef struct
+{
+  unsigned char srcIpBin[BIN_IP_LEN];
+  unsigned char dstIpBin[BIN_IP_LEN];
+  unsigned short srcPort;
+  unsigned short dstPort;
+  unsigned char protocol;
+  unsigned char reserved[3];  // Zero, IDs are compared as a whole
+} CONNECTION_ID, *PCONNECTION_ID;
+
+
+typedef struct CONNODE
+{
+  CONNECTION_ID ID;
+  uint64_t Created;
+  uint64_t LastSeen;
+
+  unsigned char srcMacBin[BIN_MAC_LEN];
+  PAYLOAD_ROPE Payload;      // Record of the current message
+
+  TCP_STREAM Stream;
+  HTTP_STREAM Http;
+  TIMER_WHEEL_TIMER Timer;    // Idle expiry
+  struct CONNODE *HashNext;   // Bucket chain, free list while unused
+} CONNODE, *PCONNODE;
+
+
+typedef struct
+{
+  int Count;
+  uint64_t Created;
+  uint64_t Closed;            // FIN or RST seen
+  uint64_t IdleExpired;
+  uint64_t Dropped;           // Table was full
+  uint64_t TruncatedBytes;    // Beyond MAX_CONNECTION_VOLUME
+  TCP_REASSEMBLY_STATS Reassembly;
+  HTTP_PARSER_STATS Http;
+  PAYLOAD_POOL_STATS Payload;
+} CONNECTION_TABLE_STATS, *PCONNECTION_TABLE_STATS;
+
+
+// Opaque, see ConnectionTable.c
+typedef struct CONNECTION_TABLE CONNECTION_TABLE, *PCONNECTION_TABLE;
+
+
+
+/*
+ * Function forward declarations.
+ *
+ */
+PCONNECTION_TABLE ConnectionTableCreate(int capacityParam);
+void ConnectionTableDestroy(PCONNECTION_TABLE tableParam);
+BOOL ConnectionTableSetHttpFields(PCONNECTION_TABLE tableParam, char *fieldListParam);
+PCONNODE ConnectionTableLookup(PCONNECTION_TABLE tableParam, PCONNECTION_ID idParam, uint64_t nowParam);
+PCONNODE ConnectionTableAdd(PCONNECTION_TABLE tableParam, unsigned char *srcMacBinParam, PCONNECTION_ID idParam, uint64_t nowParam);
+void ConnectionTableAddSegment(PCONNECTION_TABLE tableParam, PCONNODE nodeParam, uint32_t seqParam, unsigned char tcpFlagsParam, unsigned char *dataParam, int capturedLengthParam, int segmentLengthParam);
+void ConnectionTableRemove(PCONNECTION_TABLE tableParam, PCONNECTION_ID idParam);
+int ConnectionTableExpire(PCONNECTION_TABLE tableParam, uint64_t nowParam);
+int ConnectionTableCount(PCONNECTION_TABLE tableParam);
+void ConnectionTableGetStats(PCONNECTION_TABLE tableParam, PCONNECTION_TABLE_STATS statsParam);
+void WriteHttpDataToPipe(PPAYLOAD_ROPE payloadParam, unsigned char *srcMacBinParam, PCONNECTION_ID idParam);
+
+#endif
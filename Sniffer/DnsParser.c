@@ -3,54 +3,28 @@
 #include <windows.h>
 #include <stdint.h>
 
-#include "NetBase.h"
+#include "NetworkStructs.h"
+#include "PacketView.h"
 #include "DnsStructs.h"
 
 
-BOOL GetResolvedIpAddress(unsigned char *packetParam)
+BOOL GetReqHostName(unsigned char *packetParam, PPACKET_VIEW viewParam, char *hostnameParam, int hostBufferLengthParam)
 {
   BOOL retVal = FALSE;
-  PETHDR etherHdrPtr = NULL;
-  PIPHDR ipHdrPtr = NULL;       // ip header
-  PUDPHDR udpHdrPtr = NULL;     // udp header                              
-  PDNS_HEADER dnsHdrPtr = NULL; // dns header
   char *data = NULL;
-  int ipHdrLength = 0;
-
-  etherHdrPtr = (PETHDR)packetParam;
-  ipHdrPtr = (PIPHDR)((unsigned char*)packetParam + sizeof(ETHDR));
-  ipHdrLength = (ipHdrPtr->ver_ihl & 0xf) * 4;
-  udpHdrPtr = (PUDPHDR)((unsigned char*)ipHdrPtr + ipHdrLength);
-  dnsHdrPtr = (PDNS_HEADER)((unsigned char*)udpHdrPtr + sizeof(UDPHDR));
-  data = (char *)((unsigned char*)dnsHdrPtr + sizeof(DNS_HEADER));
-
-  return retVal;
-}
-
-
-BOOL GetReqHostName(unsigned char *packetParam, int packetLengthParam, char *hostnameParam, int hostBufferLengthParam)
-{
-  BOOL retVal = FALSE;
-  PETHDR etherHdrPtr = NULL;
-  PIPHDR ipHdrPtr = NULL;       // ip header
-  PUDPHDR udpHdrPtr = NULL;     // udp header                              
-  PDNS_HEADER dnsHdrPtr = NULL; // dns header
-  char *data = NULL;
-  int ipHdrLength = 0;
   int dataLength = 0;
   int index1;
-  int count2;
+  int count2 = 0;
+
+  if ((viewParam->Layers & PV_LAYER_UDP) == 0)
+  {
+    return retVal;
+  }
 
-  etherHdrPtr = (PETHDR)packetParam;
-  ipHdrPtr = (PIPHDR)((unsigned char*)packetParam + sizeof(ETHDR));
-  ipHdrLength = (ipHdrPtr->ver_ihl & 0xf) * 4;
-  udpHdrPtr = (PUDPHDR)((unsigned char*)ipHdrPtr + ipHdrLength);
-  dnsHdrPtr = (PDNS_HEADER)((unsigned char*)udpHdrPtr + sizeof(UDPHDR));
-  data = (char *)((unsigned char*)dnsHdrPtr + sizeof(DNS_HEADER));
-//dnsHdrPtr->qr
+  data = (char *)PV_PAYLOAD(packetParam, viewParam) + sizeof(DNS_HEADER);
 
   // Extract host name
-  if ((dataLength = packetLengthParam - (sizeof(ETHDR) + ipHdrLength + sizeof(UDPHDR) + sizeof(PDNS_HEADER))) > 0)
+  if ((dataLength = viewParam->PayloadCapLength - (int)sizeof(DNS_HEADER)) > 0)
   {
     count2 = 0;
 
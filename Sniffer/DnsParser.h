@@ -1,3 +1,5 @@
 #pragma once
 
-int GetReqHostName(unsigned char *packetParam, int packetLengthParam, char *hostnameParam, int hostBufferLengthParam);
+#include "PacketView.h"
+
+int GetReqHostName(unsigned char *packetParam, PPACKET_VIEW viewParam, char *hostnameParam, int hostBufferLengthParam);
@@ -0,0 +1,1031 @@
+#include <string.h>
+#include <windows.h>
+#include <Shlwapi.h>
+
+#include "HttpParser.h"
+
+
+#define HTTP_STATE_START 0             // Between messages
+#define HTTP_STATE_METHOD 1            // Or the "HTTP" of a status line
+#define HTTP_STATE_TARGET 2
+#define HTTP_STATE_VERSION 3
+#define HTTP_STATE_STATUS_VERSION 4
+#define HTTP_STATE_STATUS_CODE 5
+#define HTTP_STATE_REASON 6
+#define HTTP_STATE_LINE_LF 7
+#define HTTP_STATE_HEADER_START 8
+#define HTTP_STATE_HEADER_NAME 9
+#define HTTP_STATE_HEADER_OWS 10
+#define HTTP_STATE_HEADER_VALUE 11
+#define HTTP_STATE_HEAD_LF 12
+#define HTTP_STATE_BODY 13
+#define HTTP_STATE_BODY_CLOSE 14
+#define HTTP_STATE_CHUNK_SIZE 15
+#define HTTP_STATE_CHUNK_EXT 16
+#define HTTP_STATE_CHUNK_DATA 17
+#define HTTP_STATE_CHUNK_CR 18
+#define HTTP_STATE_CHUNK_LF 19
+#define HTTP_STATE_TRAILER_START 20
+#define HTTP_STATE_TRAILER 21
+#define HTTP_STATE_RESYNC 22           // Skipping to the next line
+
+#define HTTP_MAX_METHOD 16
+#define HTTP_MAX_LENGTH_DIGITS 15
+#define HTTP_MAX_CHUNK_DIGITS 12
+
+#define HTTP_IS_HEAD_STATE(state) ((state) >= HTTP_STATE_METHOD && (state) <= HTTP_STATE_HEAD_LF)
+#define HTTP_IS_CONTROL(c) (((c) < 32 && (c) != '\t') || (c) == 127)
+#define HTTP_LOWER(c) ((c) >= 'A' && (c) <= 'Z' ? (c) + 32 : (c))
+
+
+struct HTTP_PARSER
+{
+  HTTP_STREAM_HANDLER Handler;
+  void *Context;
+  char Fields[HTTP_MAX_FIELDS][HTTP_MAX_FIELD_NAME + 1];
+  int FieldCount;
+  HTTP_PARSER_STATS Stats;
+};
+
+
+static void HttpStreamEmit(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, int typeParam, uint64_t offsetParam, unsigned char *dataParam, unsigned int lengthParam, int pieceParam);
+static void HttpStreamPiece(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, unsigned char *dataParam, unsigned int startParam, unsigned int endParam, BOOL lastParam);
+static void HttpStreamAbort(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam);
+static void HttpStreamGap(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, unsigned int lengthParam);
+static void HttpStreamLineEnd(PHTTP_STREAM streamParam, unsigned char charParam);
+static void HttpStreamNameChar(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, unsigned char charParam);
+static int HttpStreamNameField(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam);
+static BOOL HttpStreamValueChar(PHTTP_STREAM streamParam, unsigned char charParam);
+static BOOL HttpStreamHeaderEnd(PHTTP_STREAM streamParam);
+static void HttpStreamHeadEnd(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, uint64_t offsetParam);
+static void HttpStreamChunkLineEnd(PHTTP_STREAM streamParam);
+static void HttpStreamMessageEnd(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, uint64_t offsetParam);
+static BOOL HttpIsToken(unsigned char charParam);
+static int HttpHexValue(unsigned char charParam);
+
+
+PHTTP_PARSER HttpParserCreate(HTTP_STREAM_HANDLER handlerParam, void *contextParam)
+{
+  PHTTP_PARSER parser = NULL;
+
+  if (handlerParam == NULL ||
+      (parser = (PHTTP_PARSER)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(HTTP_PARSER))) == NULL)
+  {
+    return NULL;
+  }
+
+  parser->Handler = handlerParam;
+  parser->Context = contextParam;
+
+  // HTTP_FIELD_CONTENT_LENGTH and HTTP_FIELD_TRANSFER_ENCODING
+  HttpParserAddField(parser, "Content-Length");
+  HttpParserAddField(parser, "Transfer-Encoding");
+
+  return parser;
+}
+
+
+void HttpParserDestroy(PHTTP_PARSER parserParam)
+{
+  if (parserParam == NULL)
+  {
+    return;
+  }
+
+  HeapFree(GetProcessHeap(), 0, parserParam);
+}
+
+
+/*
+ * Returns the index of the field, case is ignored. A field
+ * known already keeps its index, -1 if there is no room.
+ *
+ */
+int HttpParserAddField(PHTTP_PARSER parserParam, char *nameParam)
+{
+  int counter = 0;
+  size_t nameLength = 0;
+
+  if (parserParam == NULL ||
+      nameParam == NULL ||
+      (nameLength = strlen(nameParam)) == 0 ||
+      nameLength > HTTP_MAX_FIELD_NAME)
+  {
+    return -1;
+  }
+
+  for (counter = 0; counter < parserParam->FieldCount; counter++)
+  {
+    if (StrCmpI(parserParam->Fields[counter], nameParam) == 0)
+    {
+      return counter;
+    }
+  }
+
+  if (parserParam->FieldCount >= HTTP_MAX_FIELDS)
+  {
+    return -1;
+  }
+
+  strncpy(parserParam->Fields[parserParam->FieldCount], nameParam, HTTP_MAX_FIELD_NAME);
+
+  return parserParam->FieldCount++;
+}
+
+
+char *HttpParserFieldName(PHTTP_PARSER parserParam, int fieldParam)
+{
+  if (parserParam == NULL ||
+      fieldParam < 0 ||
+      fieldParam >= parserParam->FieldCount)
+  {
+    return NULL;
+  }
+
+  return parserParam->Fields[fieldParam];
+}
+
+
+void HttpParserGetStats(PHTTP_PARSER parserParam, PHTTP_PARSER_STATS statsParam)
+{
+  if (parserParam == NULL ||
+      statsParam == NULL)
+  {
+    return;
+  }
+
+  CopyMemory(statsParam, &parserParam->Stats, sizeof(HTTP_PARSER_STATS));
+}
+
+
+void HttpStreamInit(PHTTP_STREAM streamParam, void *ownerParam)
+{
+  if (streamParam == NULL)
+  {
+    return;
+  }
+
+  ZeroMemory(streamParam, sizeof(HTTP_STREAM));
+  streamParam->Owner = ownerParam;
+  streamParam->State = HTTP_STATE_START;
+  streamParam->Field = -1;
+}
+
+
+/*
+ * The next lengthParam bytes of the stream, dataParam is
+ * NULL if they were lost
+ *
+ */
+void HttpStreamData(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, unsigned char *dataParam, unsigned int lengthParam)
+{
+  unsigned int position = 0;
+  unsigned int pieceStart = 0;
+  unsigned int count = 0;
+  unsigned char *lineEnd = NULL;
+  unsigned char current = 0;
+  int value = 0;
+
+  if (parserParam == NULL ||
+      streamParam == NULL ||
+      lengthParam == 0)
+  {
+    return;
+  }
+
+  if (dataParam == NULL)
+  {
+    HttpStreamGap(parserParam, streamParam, lengthParam);
+    return;
+  }
+
+  while (position < lengthParam)
+  {
+    current = dataParam[position];
+
+    if (HTTP_IS_HEAD_STATE(streamParam->State) &&
+        (++streamParam->HeadLength > HTTP_MAX_HEAD || ++streamParam->LineLength > HTTP_MAX_LINE))
+    {
+      HttpStreamAbort(parserParam, streamParam);
+      continue;
+    }
+
+    switch (streamParam->State)
+    {
+      // Empty lines before a message are skipped, the
+      // first other byte is looked at again as its start
+      case HTTP_STATE_START:
+        if (current == '\r' || current == '\n')
+        {
+          position++;
+          break;
+        }
+
+        streamParam->State = HTTP_STATE_METHOD;
+        streamParam->MessageOffset = streamParam->Offset + position;
+        streamParam->Flags = 0;
+        streamParam->Status = 0;
+        streamParam->Remaining = 0;
+        streamParam->HeadLength = 0;
+        streamParam->LineLength = 0;
+        streamParam->Match = 0;
+        streamParam->Field = -1;
+        streamParam->Token = HTTP_EVENT_START_LINE;
+        streamParam->TokenLength = 0;
+        pieceStart = position;
+        break;
+
+      // Match counts the leading characters of "HTTP"
+      case HTTP_STATE_METHOD:
+        if (current >= 'A' && current <= 'Z' && streamParam->LineLength <= HTTP_MAX_METHOD)
+        {
+          if (streamParam->Match == streamParam->LineLength - 1 &&
+              streamParam->Match < 4 &&
+              current == "HTTP"[streamParam->Match])
+          {
+            streamParam->Match++;
+          }
+        }
+        else if (current == '/' && streamParam->Match == 4 && streamParam->LineLength == 5)
+        {
+          streamParam->Flags |= HTTP_MESSAGE_RESPONSE;
+          streamParam->State = HTTP_STATE_STATUS_VERSION;
+          streamParam->Match = 0;
+        }
+        else if (current == ' ' && streamParam->LineLength > 1)
+        {
+          streamParam->State = HTTP_STATE_TARGET;
+          streamParam->Match = 0;
+        }
+        else
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_TARGET:
+        if (current == ' ' && streamParam->Match > 0)
+        {
+          streamParam->State = HTTP_STATE_VERSION;
+          streamParam->Match = 0;
+        }
+        else if (current > 32 && current < 127)
+        {
+          streamParam->Match = 1;
+        }
+        else
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_VERSION:
+        if ((streamParam->Match < 7 && current == "HTTP/1."[streamParam->Match]) ||
+            (streamParam->Match == 7 && current >= '0' && current <= '9'))
+        {
+          streamParam->Match++;
+        }
+        else if (streamParam->Match == 8 && (current == '\r' || current == '\n'))
+        {
+          HttpStreamPiece(parserParam, streamParam, dataParam, pieceStart, position, TRUE);
+          HttpStreamLineEnd(streamParam, current);
+        }
+        else
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      // The "1.x " behind "HTTP/"
+      case HTTP_STATE_STATUS_VERSION:
+        if ((streamParam->Match == 0 && current == '1') ||
+            (streamParam->Match == 1 && current == '.') ||
+            (streamParam->Match == 2 && current >= '0' && current <= '9'))
+        {
+          streamParam->Match++;
+        }
+        else if (streamParam->Match == 3 && current == ' ')
+        {
+          streamParam->State = HTTP_STATE_STATUS_CODE;
+          streamParam->Match = 0;
+        }
+        else
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_STATUS_CODE:
+        if (streamParam->Match < 3 && current >= '0' && current <= '9')
+        {
+          streamParam->Status = streamParam->Status * 10 + (current - '0');
+          streamParam->Match++;
+        }
+        else if (streamParam->Match == 3 && current == ' ')
+        {
+          streamParam->State = HTTP_STATE_REASON;
+        }
+        else if (streamParam->Match == 3 && (current == '\r' || current == '\n'))
+        {
+          HttpStreamPiece(parserParam, streamParam, dataParam, pieceStart, position, TRUE);
+          HttpStreamLineEnd(streamParam, current);
+        }
+        else
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_REASON:
+        if (current == '\r' || current == '\n')
+        {
+          HttpStreamPiece(parserParam, streamParam, dataParam, pieceStart, position, TRUE);
+          HttpStreamLineEnd(streamParam, current);
+        }
+        else if (HTTP_IS_CONTROL(current))
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_LINE_LF:
+        if (current != '\n')
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        HttpStreamLineEnd(streamParam, current);
+        position++;
+        break;
+
+      case HTTP_STATE_HEADER_START:
+        if (current == '\r')
+        {
+          streamParam->State = HTTP_STATE_HEAD_LF;
+        }
+        else if (current == '\n')
+        {
+          HttpStreamHeadEnd(parserParam, streamParam, streamParam->Offset + position + 1);
+        }
+        else if (HttpIsToken(current))
+        {
+          streamParam->State = HTTP_STATE_HEADER_NAME;
+          streamParam->Token = HTTP_EVENT_HEADER_NAME;
+          streamParam->TokenLength = 0;
+          streamParam->Candidates = parserParam->FieldCount >= HTTP_MAX_FIELDS ? 0xffffffff : (1u << parserParam->FieldCount) - 1;
+          streamParam->Match = 0;
+          streamParam->Field = -1;
+          pieceStart = position;
+          HttpStreamNameChar(parserParam, streamParam, current);
+        }
+        else
+        {
+          // Folded lines included
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_HEADER_NAME:
+        if (HttpIsToken(current))
+        {
+          HttpStreamNameChar(parserParam, streamParam, current);
+        }
+        else if (current == ':')
+        {
+          streamParam->Field = HttpStreamNameField(parserParam, streamParam);
+          HttpStreamPiece(parserParam, streamParam, dataParam, pieceStart, position, TRUE);
+
+          // The last Content-Length wins
+          if (streamParam->Field == HTTP_FIELD_CONTENT_LENGTH)
+          {
+            streamParam->Flags |= HTTP_MESSAGE_LENGTH;
+            streamParam->Remaining = 0;
+          }
+
+          streamParam->State = HTTP_STATE_HEADER_OWS;
+          streamParam->Match = 0;
+        }
+        else
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_HEADER_OWS:
+        if (current == ' ' || current == '\t')
+        {
+          position++;
+          break;
+        }
+
+        streamParam->Token = HTTP_EVENT_HEADER_VALUE;
+        streamParam->TokenLength = 0;
+        pieceStart = position;
+
+        if (current == '\r' || current == '\n')
+        {
+          HttpStreamPiece(parserParam, streamParam, dataParam, pieceStart, position, TRUE);
+
+          if (HttpStreamHeaderEnd(streamParam) == FALSE)
+          {
+            HttpStreamAbort(parserParam, streamParam);
+            break;
+          }
+
+          HttpStreamLineEnd(streamParam, current);
+        }
+        else if (HttpStreamValueChar(streamParam, current) == TRUE)
+        {
+          streamParam->State = HTTP_STATE_HEADER_VALUE;
+        }
+        else
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_HEADER_VALUE:
+        if (current == '\r' || current == '\n')
+        {
+          HttpStreamPiece(parserParam, streamParam, dataParam, pieceStart, position, TRUE);
+
+          if (HttpStreamHeaderEnd(streamParam) == FALSE)
+          {
+            HttpStreamAbort(parserParam, streamParam);
+            break;
+          }
+
+          HttpStreamLineEnd(streamParam, current);
+        }
+        else if (HttpStreamValueChar(streamParam, current) == FALSE)
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_HEAD_LF:
+        if (current != '\n')
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        HttpStreamHeadEnd(parserParam, streamParam, streamParam->Offset + position + 1);
+        position++;
+        break;
+
+      case HTTP_STATE_BODY:
+      case HTTP_STATE_CHUNK_DATA:
+        count = lengthParam - position;
+
+        if (count > streamParam->Remaining)
+        {
+          count = (unsigned int)streamParam->Remaining;
+        }
+
+        HttpStreamEmit(parserParam, streamParam, HTTP_EVENT_BODY, streamParam->Offset + position, dataParam + position, count, 0);
+        streamParam->Remaining -= count;
+        position += count;
+
+        if (streamParam->Remaining > 0)
+        {
+          break;
+        }
+
+        if (streamParam->State == HTTP_STATE_BODY)
+        {
+          HttpStreamMessageEnd(parserParam, streamParam, streamParam->Offset + position);
+        }
+        else
+        {
+          streamParam->State = HTTP_STATE_CHUNK_CR;
+        }
+
+        break;
+
+      case HTTP_STATE_BODY_CLOSE:
+        HttpStreamEmit(parserParam, streamParam, HTTP_EVENT_BODY, streamParam->Offset + position, dataParam + position, lengthParam - position, 0);
+        position = lengthParam;
+        break;
+
+      case HTTP_STATE_CHUNK_SIZE:
+        if ((value = HttpHexValue(current)) >= 0 && streamParam->Match < HTTP_MAX_CHUNK_DIGITS)
+        {
+          streamParam->Remaining = streamParam->Remaining * 16 + value;
+          streamParam->Match++;
+        }
+        else if (streamParam->Match > 0 && (current == ';' || current == ' ' || current == '\t' || current == '\r'))
+        {
+          streamParam->State = HTTP_STATE_CHUNK_EXT;
+        }
+        else if (streamParam->Match > 0 && current == '\n')
+        {
+          HttpStreamChunkLineEnd(streamParam);
+        }
+        else
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_CHUNK_EXT:
+        if (current == '\n')
+        {
+          HttpStreamChunkLineEnd(streamParam);
+        }
+        else if (++streamParam->LineLength > HTTP_MAX_LINE)
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_CHUNK_CR:
+      case HTTP_STATE_CHUNK_LF:
+        if (current == '\r' && streamParam->State == HTTP_STATE_CHUNK_CR)
+        {
+          streamParam->State = HTTP_STATE_CHUNK_LF;
+        }
+        else if (current == '\n')
+        {
+          streamParam->State = HTTP_STATE_CHUNK_SIZE;
+          streamParam->Remaining = 0;
+          streamParam->Match = 0;
+          streamParam->LineLength = 0;
+        }
+        else
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      // Trailer fields are not reported
+      case HTTP_STATE_TRAILER_START:
+        if (current == '\n')
+        {
+          HttpStreamMessageEnd(parserParam, streamParam, streamParam->Offset + position + 1);
+        }
+        else if (current != '\r')
+        {
+          streamParam->State = HTTP_STATE_TRAILER;
+          streamParam->LineLength = 0;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_TRAILER:
+        if (current == '\n')
+        {
+          streamParam->State = HTTP_STATE_TRAILER_START;
+        }
+        else if (++streamParam->LineLength > HTTP_MAX_LINE)
+        {
+          HttpStreamAbort(parserParam, streamParam);
+          break;
+        }
+
+        position++;
+        break;
+
+      case HTTP_STATE_RESYNC:
+        if ((lineEnd = (unsigned char *)memchr(dataParam + position, '\n', lengthParam - position)) == NULL)
+        {
+          count = lengthParam - position;
+        }
+        else
+        {
+          count = (unsigned int)(lineEnd - (dataParam + position)) + 1;
+          streamParam->State = HTTP_STATE_START;
+        }
+
+        parserParam->Stats.SkippedBytes += count;
+        position += count;
+        break;
+    }
+  }
+
+  // The rest of a start line or header goes on in the next buffer
+  if (streamParam->Token != 0)
+  {
+    HttpStreamPiece(parserParam, streamParam, dataParam, pieceStart, lengthParam, FALSE);
+  }
+
+  streamParam->Offset += lengthParam;
+}
+
+
+/*
+ * The end of the stream completes a response whose
+ * body is delimited by it, any other message is aborted
+ *
+ */
+void HttpStreamClose(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam)
+{
+  if (parserParam == NULL ||
+      streamParam == NULL)
+  {
+    return;
+  }
+
+  if (streamParam->State == HTTP_STATE_BODY_CLOSE)
+  {
+    HttpStreamMessageEnd(parserParam, streamParam, streamParam->Offset);
+  }
+  else if (streamParam->State != HTTP_STATE_START &&
+           streamParam->State != HTTP_STATE_RESYNC)
+  {
+    HttpStreamAbort(parserParam, streamParam);
+  }
+
+  streamParam->State = HTTP_STATE_START;
+}
+
+
+
+static void HttpStreamEmit(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, int typeParam, uint64_t offsetParam, unsigned char *dataParam, unsigned int lengthParam, int pieceParam)
+{
+  HTTP_EVENT event;
+
+  event.Type = typeParam;
+  event.Offset = offsetParam;
+  event.Data = dataParam;
+  event.Length = lengthParam;
+  event.Piece = pieceParam;
+  event.Field = typeParam == HTTP_EVENT_HEADER_NAME || typeParam == HTTP_EVENT_HEADER_VALUE ? streamParam->Field : -1;
+
+  parserParam->Handler(parserParam->Context, streamParam, &event);
+}
+
+
+/*
+ * Hand over the bytes of the current token between startParam
+ * and endParam. An empty piece is only worth an event if it
+ * ends the token.
+ *
+ */
+static void HttpStreamPiece(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, unsigned char *dataParam, unsigned int startParam, unsigned int endParam, BOOL lastParam)
+{
+  int piece = (streamParam->TokenLength == 0 ? HTTP_PIECE_FIRST : 0) | (lastParam == TRUE ? HTTP_PIECE_LAST : 0);
+
+  if (endParam > startParam || lastParam == TRUE)
+  {
+    HttpStreamEmit(parserParam, streamParam, streamParam->Token, streamParam->Offset + startParam, dataParam + startParam, endParam - startParam, piece);
+    streamParam->TokenLength += endParam - startParam;
+  }
+
+  if (lastParam == TRUE)
+  {
+    streamParam->Token = 0;
+    streamParam->TokenLength = 0;
+  }
+}
+
+
+/*
+ * A line that did not get past its first token was no
+ * message, there is nothing to take back
+ *
+ */
+static void HttpStreamAbort(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam)
+{
+  if (streamParam->State != HTTP_STATE_METHOD ||
+      streamParam->TokenLength > 0)
+  {
+    HttpStreamEmit(parserParam, streamParam, HTTP_EVENT_ABORT, streamParam->MessageOffset, NULL, 0, 0);
+    parserParam->Stats.Aborted++;
+  }
+
+  streamParam->State = HTTP_STATE_RESYNC;
+  streamParam->Token = 0;
+  streamParam->TokenLength = 0;
+}
+
+
+/*
+ * Lost bytes inside a body of known length keep the stream
+ * in step, the message is aborted once its end is reached
+ *
+ */
+static void HttpStreamGap(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, unsigned int lengthParam)
+{
+  if ((streamParam->State == HTTP_STATE_BODY || streamParam->State == HTTP_STATE_CHUNK_DATA) &&
+      lengthParam <= streamParam->Remaining)
+  {
+    streamParam->Flags |= HTTP_MESSAGE_GAP;
+    streamParam->Remaining -= lengthParam;
+    streamParam->Offset += lengthParam;
+
+    if (streamParam->Remaining == 0)
+    {
+      if (streamParam->State == HTTP_STATE_BODY)
+      {
+        HttpStreamMessageEnd(parserParam, streamParam, streamParam->Offset);
+      }
+      else
+      {
+        streamParam->State = HTTP_STATE_CHUNK_CR;
+      }
+    }
+
+    return;
+  }
+
+  if (streamParam->State == HTTP_STATE_BODY_CLOSE)
+  {
+    streamParam->Flags |= HTTP_MESSAGE_GAP;
+    streamParam->Offset += lengthParam;
+    return;
+  }
+
+  if (streamParam->State != HTTP_STATE_START &&
+      streamParam->State != HTTP_STATE_RESYNC)
+  {
+    HttpStreamAbort(parserParam, streamParam);
+  }
+
+  streamParam->State = HTTP_STATE_RESYNC;
+  streamParam->Offset += lengthParam;
+  parserParam->Stats.SkippedBytes += lengthParam;
+}
+
+
+/*
+ * After a CR the LF is still to come
+ *
+ */
+static void HttpStreamLineEnd(PHTTP_STREAM streamParam, unsigned char charParam)
+{
+  if (charParam == '\r')
+  {
+    streamParam->State = HTTP_STATE_LINE_LF;
+    return;
+  }
+
+  streamParam->State = HTTP_STATE_HEADER_START;
+  streamParam->LineLength = 0;
+}
+
+
+/*
+ * Drop the fields whose name differs at the current position,
+ * Match is the length of the name so far
+ *
+ */
+static void HttpStreamNameChar(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, unsigned char charParam)
+{
+  unsigned int candidates = streamParam->Candidates;
+  int field = 0;
+
+  for (field = 0; candidates != 0; field++, candidates >>= 1)
+  {
+    if ((candidates & 1) != 0 &&
+        (streamParam->Match >= HTTP_MAX_FIELD_NAME ||
+         HTTP_LOWER((unsigned char)parserParam->Fields[field][streamParam->Match]) != HTTP_LOWER(charParam)))
+    {
+      streamParam->Candidates &= ~(1u << field);
+    }
+  }
+
+  streamParam->Match++;
+}
+
+
+static int HttpStreamNameField(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam)
+{
+  unsigned int candidates = streamParam->Candidates;
+  int field = 0;
+
+  for (field = 0; candidates != 0; field++, candidates >>= 1)
+  {
+    if ((candidates & 1) != 0 &&
+        parserParam->Fields[field][streamParam->Match] == 0)
+    {
+      return field;
+    }
+  }
+
+  return -1;
+}
+
+
+/*
+ * Content-Length is read while it goes by. For Transfer-Encoding
+ * Match counts the characters of "chunked" the value ends with.
+ *
+ */
+static BOOL HttpStreamValueChar(PHTTP_STREAM streamParam, unsigned char charParam)
+{
+  unsigned char lower = HTTP_LOWER(charParam);
+
+  if (HTTP_IS_CONTROL(charParam))
+  {
+    return FALSE;
+  }
+
+  if (streamParam->Field == HTTP_FIELD_CONTENT_LENGTH)
+  {
+    if (charParam >= '0' && charParam <= '9' && streamParam->Match < HTTP_MAX_LENGTH_DIGITS)
+    {
+      streamParam->Remaining = streamParam->Remaining * 10 + (charParam - '0');
+      streamParam->Match++;
+    }
+    else if (charParam == ' ' || charParam == '\t')
+    {
+      // No more digits after the white space
+      if (streamParam->Match > 0)
+      {
+        streamParam->Match = HTTP_MAX_LENGTH_DIGITS;
+      }
+    }
+    else
+    {
+      return FALSE;
+    }
+  }
+  else if (streamParam->Field == HTTP_FIELD_TRANSFER_ENCODING)
+  {
+    if (charParam == ' ' || charParam == '\t')
+    {
+      if (streamParam->Match < 7)
+      {
+        streamParam->Match = 0;
+      }
+    }
+    else if (streamParam->Match < 7 && lower == "chunked"[streamParam->Match])
+    {
+      streamParam->Match++;
+    }
+    else
+    {
+      streamParam->Match = lower == 'c' ? 1 : 0;
+    }
+  }
+
+  return TRUE;
+}
+
+
+static BOOL HttpStreamHeaderEnd(PHTTP_STREAM streamParam)
+{
+  if (streamParam->Field == HTTP_FIELD_CONTENT_LENGTH &&
+      streamParam->Match == 0)
+  {
+    return FALSE;
+  }
+
+  // Only the last coding frames the body
+  if (streamParam->Field == HTTP_FIELD_TRANSFER_ENCODING)
+  {
+    if (streamParam->Match == 7)
+    {
+      streamParam->Flags |= HTTP_MESSAGE_CHUNKED;
+    }
+    else
+    {
+      streamParam->Flags &= ~HTTP_MESSAGE_CHUNKED;
+    }
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * RFC 7230 3.3.3, except that responses to HEAD
+ * requests can not be told apart
+ *
+ */
+static void HttpStreamHeadEnd(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, uint64_t offsetParam)
+{
+  HttpStreamEmit(parserParam, streamParam, HTTP_EVENT_HEAD_END, offsetParam, NULL, 0, 0);
+
+  streamParam->LineLength = 0;
+  streamParam->Match = 0;
+
+  if ((streamParam->Flags & HTTP_MESSAGE_RESPONSE) &&
+      (streamParam->Status / 100 == 1 || streamParam->Status == 204 || streamParam->Status == 304))
+  {
+    HttpStreamMessageEnd(parserParam, streamParam, offsetParam);
+  }
+  else if (streamParam->Flags & HTTP_MESSAGE_CHUNKED)
+  {
+    streamParam->State = HTTP_STATE_CHUNK_SIZE;
+    streamParam->Remaining = 0;
+  }
+  else if ((streamParam->Flags & HTTP_MESSAGE_LENGTH) && streamParam->Remaining > 0)
+  {
+    streamParam->State = HTTP_STATE_BODY;
+  }
+  else if ((streamParam->Flags & (HTTP_MESSAGE_LENGTH | HTTP_MESSAGE_RESPONSE)) == HTTP_MESSAGE_RESPONSE)
+  {
+    streamParam->State = HTTP_STATE_BODY_CLOSE;
+  }
+  else
+  {
+    HttpStreamMessageEnd(parserParam, streamParam, offsetParam);
+  }
+}
+
+
+static void HttpStreamChunkLineEnd(PHTTP_STREAM streamParam)
+{
+  streamParam->State = streamParam->Remaining > 0 ? HTTP_STATE_CHUNK_DATA : HTTP_STATE_TRAILER_START;
+  streamParam->LineLength = 0;
+}
+
+
+static void HttpStreamMessageEnd(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, uint64_t offsetParam)
+{
+  if (streamParam->Flags & HTTP_MESSAGE_GAP)
+  {
+    HttpStreamEmit(parserParam, streamParam, HTTP_EVENT_ABORT, streamParam->MessageOffset, NULL, 0, 0);
+    parserParam->Stats.Aborted++;
+  }
+  else
+  {
+    HttpStreamEmit(parserParam, streamParam, HTTP_EVENT_MESSAGE_END, offsetParam, NULL, 0, 0);
+
+    if (streamParam->Flags & HTTP_MESSAGE_RESPONSE)
+    {
+      parserParam->Stats.Responses++;
+    }
+    else
+    {
+      parserParam->Stats.Requests++;
+    }
+  }
+
+  streamParam->State = HTTP_STATE_START;
+  streamParam->Token = 0;
+  streamParam->TokenLength = 0;
+}
+
+
+static BOOL HttpIsToken(unsigned char charParam)
+{
+  return (charParam >= 'a' && charParam <= 'z') ||
+         (charParam >= 'A' && charParam <= 'Z') ||
+         (charParam >= '0' && charParam <= '9') ||
+         (charParam != 0 && strchr("!#$%&'*+-.^_`|~", charParam) != NULL);
+}
+
+
+static int HttpHexValue(unsigned char charParam)
+{
+  if (charParam >= '0' && charParam <= '9')
+  {
+    return charParam - '0';
+  }
+
+  if (charParam >= 'a' && charParam <= 'f')
+  {
+    return charParam - 'a' + 10;
+  }
+
+  if (charParam >= 'A' && charParam <= 'F')
+  {
+    return charParam - 'A' + 10;
+  }
+
+  return -1;
+}
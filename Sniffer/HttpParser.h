@@ -0,0 +1,125 @@
+#ifndef __HTTPPARSER__
+#define __HTTPPARSER__
+
+#include <windows.h>
+#include <stdint.h>
+
+
+/*
+ * Incremental HTTP/1.x parser
+ *
+ * An HTTP_STREAM follows the reassembled bytes of one direction of
+ * a connection, fed in whatever pieces the reassembly hands over.
+ * Requests and responses are told apart by their start line, any
+ * number of pipelined or keep-alive messages may follow each other.
+ *
+ * Nothing is copied. The handler gets events pointing into the
+ * buffer being parsed, with their offset in the stream. A start
+ * line, header name or header value split across buffers arrives
+ * in pieces, HTTP_PIECE_FIRST and HTTP_PIECE_LAST mark its ends.
+ * The field of a header is known with the last piece of its name.
+ *
+ * Bodies are framed by Content-Length or chunked transfer coding,
+ * the body events carry the decoded data only. A response without
+ * either ends when the stream is closed. Responses to HEAD requests
+ * are not recognised, the directions are parsed independently.
+ *
+ * Whatever can not be parsed aborts the message, the stream then
+ * skips to the next line that starts a message. So do bytes lost in
+ * the reassembly, unless they are part of a body of known length.
+ * A message is only complete with HTTP_EVENT_MESSAGE_END.
+ *
+ * Not thread safe.
+ *
+ */
+#define HTTP_MAX_LINE 8192
+#define HTTP_MAX_HEAD (64 * 1024)
+#define HTTP_MAX_FIELDS 32
+#define HTTP_MAX_FIELD_NAME 64
+
+// Fields every parser knows, they frame the body
+#define HTTP_FIELD_CONTENT_LENGTH 0
+#define HTTP_FIELD_TRANSFER_ENCODING 1
+
+#define HTTP_EVENT_START_LINE 1
+#define HTTP_EVENT_HEADER_NAME 2
+#define HTTP_EVENT_HEADER_VALUE 3
+#define HTTP_EVENT_HEAD_END 4        // Offset is the body's first byte
+#define HTTP_EVENT_BODY 5
+#define HTTP_EVENT_MESSAGE_END 6
+#define HTTP_EVENT_ABORT 7           // Drop what the message delivered
+
+#define HTTP_PIECE_FIRST 0x01
+#define HTTP_PIECE_LAST 0x02
+
+#define HTTP_MESSAGE_RESPONSE 0x01
+#define HTTP_MESSAGE_LENGTH 0x02
+#define HTTP_MESSAGE_CHUNKED 0x04
+#define HTTP_MESSAGE_GAP 0x08        // Body bytes lost, the message is aborted at its end
+
+
+/*
+ * Type declarations.
+ *
+ */
+typedef struct
+{
+  int Type;
+  uint64_t Offset;
+  unsigned char *Data;               // Valid during the handler call only
+  unsigned int Length;
+  int Piece;
+  int Field;                         // Header events, -1 if unknown
+} HTTP_EVENT, *PHTTP_EVENT;
+
+
+typedef struct HTTP_STREAM
+{
+  void *Owner;
+  int State;
+  uint64_t Offset;                   // Stream bytes parsed
+  uint64_t MessageOffset;            // Where the current message started
+  int Flags;                         // HTTP_MESSAGE_...
+  int Status;
+  uint64_t Remaining;                // Body or chunk bytes still to come
+  int Token;                         // Event type of the piece in progress
+  unsigned int TokenLength;
+  unsigned int LineLength;
+  unsigned int HeadLength;
+  unsigned int Match;
+  unsigned int Candidates;           // Fields the header name may still be
+  int Field;
+} HTTP_STREAM, *PHTTP_STREAM;
+
+
+typedef void(*HTTP_STREAM_HANDLER)(void *contextParam, PHTTP_STREAM streamParam, PHTTP_EVENT eventParam);
+
+
+typedef struct
+{
+  uint64_t Requests;
+  uint64_t Responses;
+  uint64_t Aborted;
+  uint64_t SkippedBytes;             // Looking for the start of a message
+} HTTP_PARSER_STATS, *PHTTP_PARSER_STATS;
+
+
+// Opaque, see HttpParser.c
+typedef struct HTTP_PARSER HTTP_PARSER, *PHTTP_PARSER;
+
+
+
+/*
+ * Function forward declarations.
+ *
+ */
+PHTTP_PARSER HttpParserCreate(HTTP_STREAM_HANDLER handlerParam, void *contextParam);
+void HttpParserDestroy(PHTTP_PARSER parserParam);
+int HttpParserAddField(PHTTP_PARSER parserParam, char *nameParam);
+char *HttpParserFieldName(PHTTP_PARSER parserParam, int fieldParam);
+void HttpParserGetStats(PHTTP_PARSER parserParam, PHTTP_PARSER_STATS statsParam);
+void HttpStreamInit(PHTTP_STREAM streamParam, void *ownerParam);
+void HttpStreamData(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam, unsigned char *dataParam, unsigned int lengthParam);
+void HttpStreamClose(PHTTP_PARSER parserParam, PHTTP_STREAM streamParam);
+
+#endif
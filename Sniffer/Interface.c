@@ -11,8 +11,6 @@
 
 #include "Sniffer.h"
 #include "GenericSniffer.h"
-#include "LinkedListSystems.h"
-#include "LinkedListConnections.h"
 #include "Logging.h"
 #include "NetworkFunctions.h"
 
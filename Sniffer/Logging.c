@@ -1,77 +1,62 @@
 #include <Windows.h>
 #include <stdio.h>
-#include <time.h>
 
 #include "Sniffer.h"
+#include "AsyncLog.h"
 #include "Logging.h"
-#include "ModeMinary.h"
 
-char *gLogPriority[] = { "OFF", "DEBUG", "INFO", "LOW", "MEDIUM", "HIGH", "ERROR", "FATAL" };
+extern int gDEBUGLEVEL;
 
 
-static HANDLE fileHandle = INVALID_HANDLE_VALUE;
-void LogMsg(int priorityParam, char *logMessageParam, ...)
+/*
+ * LogMsg() only hands the arguments to the asynchronous
+ * logger (Common/AsyncLog.c). Formatting, timestamps and
+ * writing to the console happen on the logger thread. The
+ * Sniffer never wrote DBG_LOGFILE, it logs to the console
+ * only.
+ *
+ */
+BOOLEAN InitLogging()
 {
-  OVERLAPPED overlapped = { 0 };
-  char dateStamp[MAX_BUF_SIZE + 1];
-  char timeStamp[MAX_BUF_SIZE + 1];
-  char time[MAX_BUF_SIZE + 1];
-  char tempBuffer[MAX_BUF_SIZE + 1];
-  char logMessage[MAX_BUF_SIZE + 1];
-  DWORD bytesWritten = 0;
-  va_list args;
-  
-  if (priorityParam < DEBUG_LEVEL ||
-      DEBUG_LEVEL == DBG_OFF)
+  if (AsyncLogStart(NULL, TRUE) == FALSE)
   {
-    goto END;
+    printf("InitLogging(): Starting the logger failed\r\n");
+    return FALSE;
   }
 
-  if (fileHandle == INVALID_HANDLE_VALUE &&
-      (fileHandle = CreateFile(DBG_LOGFILE, GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0)) == INVALID_HANDLE_VALUE)
-  {
-    goto END;
-  }
+  return TRUE;
+}
 
-  ZeroMemory(&overlapped, sizeof(overlapped));
-  if (LockFileEx(fileHandle, LOCKFILE_EXCLUSIVE_LOCK, 0, 0, 0, &overlapped) == TRUE)
-  {
-    goto END;
-  }
 
-  ZeroMemory(time, sizeof(time));
-  ZeroMemory(timeStamp, sizeof(timeStamp));
-  ZeroMemory(dateStamp, sizeof(dateStamp));
+void StopLogging()
+{
+  AsyncLogStop();
+}
 
-  // Create timestamp
-  _strtime(timeStamp);
-  _strdate(dateStamp);
-  snprintf(time, sizeof(time) - 1, "%s %s", dateStamp, timeStamp);
 
-  // Create log message
-  __try
-  {
-    ZeroMemory(tempBuffer, sizeof(tempBuffer));
-    ZeroMemory(logMessage, sizeof(logMessage));
-    va_start(args, logMessageParam);
-    vsprintf(tempBuffer, logMessageParam, args);
-    va_end(args);
-    snprintf(logMessage, sizeof(logMessage) - 1, "%s %-7s: %s\n", time, gLogPriority[priorityParam], tempBuffer);
-    puts(logMessage);
-  }
-  __except (FilterException(GetExceptionCode(), GetExceptionInformation()))
+void LogMsg(int priorityParam, char *logMessageParam, ...)
+{
+  va_list args;
+
+  if (LogLevelEnabled(priorityParam) == FALSE ||
+      logMessageParam == NULL)
   {
-    puts("OMG it's a bug!!\r\n");
     return;
   }
-  // Write message to the logfile.
-  SetFilePointer(fileHandle, 0, NULL, FILE_END);
-//  WriteFile(fileHandle, logMessage, strnlen(logMessage, sizeof(logMessage) - 1), &bytesWritten, NULL);
 
-END:
-  if (fileHandle != INVALID_HANDLE_VALUE)
-  {
-    UnlockFileEx(fileHandle, 0, 0, 0, &overlapped);
-    CloseHandle(fileHandle);
-  }
+  va_start(args, logMessageParam);
+  AsyncLogWriteV(priorityParam, logMessageParam, args);
+  va_end(args);
+}
+
+
+/*
+ * Log handler of the capture stats monitor (Common/CaptureStats.c).
+ * Overload warnings are logged as errors, so they show up at any
+ * debug level.
+ *
+ */
+void LogCaptureStats(BOOL warningParam, char *messageParam)
+{
+  LogMsg(warningParam == TRUE ? DBG_ERROR : DBG_INFO, "%s", messageParam);
 }
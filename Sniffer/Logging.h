@@ -14,5 +14,21 @@
 
 #define DBG_LOGFILE "c:\\debug.log"
 
+BOOLEAN InitLogging();
+void StopLogging();
 void LogMsg(int priorityParam, char *logMessageParam, ...);
-void PrintToScreen(char *data);
\ No newline at end of file
+void LogCaptureStats(BOOL warningParam, char *messageParam);
+void PrintToScreen(char *data);
+
+
+extern int gDEBUGLEVEL;
+
+/*
+ * Callers check this before they produce expensive log
+ * arguments (address strings, hostnames, ...)
+ *
+ */
+static __inline BOOL LogLevelEnabled(int priorityParam)
+{
+  return priorityParam >= gDEBUGLEVEL && gDEBUGLEVEL != DBG_OFF;
+}
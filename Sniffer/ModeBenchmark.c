@@ -0,0 +1,466 @@
+#define HAVE_REMOTE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pcap.h>
+
+#include "Sniffer.h"
+#include "Benchmark.h"
+#include "DnsParser.h"
+#include "ConnectionTable.h"
+#include "Logging.h"
+#include "ModeBenchmark.h"
+#include "ModeGenericSniffer.h"
+#include "ModeMinary.h"
+#include "NetworkFunctions.h"
+#include "PacketCapture.h"
+
+
+extern int gDEBUGLEVEL;
+extern SCANPARAMS gCurrentScanParams;
+extern POUTPUT_CHANNEL gOutputChannel;
+
+#define MICRO_HTTP_REQUEST "POST /login.php HTTP/1.1\r\nHost: www.example.com\r\nUser-Agent: Mozilla/5.0\r\n" \
+                           "Cookie: session=0123456789abcdef\r\nContent-Type: application/x-www-form-urlencoded\r\n" \
+                           "Content-Length: %4d\r\n\r\n"
+
+static void LearnLocalMacBatchCallback(unsigned char *scanParamsParam, PCAPTURE_BATCH batchParam);
+static uint64_t MicroGetReqHostName(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroStringify(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroConnectionTableLookup(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroHttpParser(void *contextParam, uint64_t iterationsParam);
+static void MicroHttpEvent(void *contextParam, PHTTP_STREAM streamParam, PHTTP_EVENT eventParam);
+static uint64_t MicroOutputChannel(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroIpBin2String(void *contextParam, uint64_t iterationsParam);
+static uint64_t MicroMac2String(void *contextParam, uint64_t iterationsParam);
+
+
+/*
+ * Replay benchmark
+ *
+ * param   pcap file, loop count
+ *   -b     {...}
+ *
+ * Feeds the pcap file through SniffAndParseCallback and then through
+ * GenericSnifferCallback as fast as possible. The Minary output goes
+ * to the null device instead of the named pipe. SniffAndParseCallback
+ * only evaluates frames sent to the local MAC address, so the system
+ * the first frame was sent to is taken as the local system.
+ *
+ */
+int ModeBenchmarkStart(PSCANPARAMS scanParamsParam, char *pcapFileParam, int loopCountParam)
+{
+  int retVal = 0;
+  char errorBuffer[CAPTURE_ERRBUF_SIZE];
+  PCAPTURE_HANDLE replayHandle = NULL;
+  PBENCHMARK_RUN benchmarkRun = NULL;
+
+  ZeroMemory(errorBuffer, sizeof(errorBuffer));
+
+  // Logging would be all we measure
+  gDEBUGLEVEL = DBG_OFF;
+
+  if ((benchmarkRun = (PBENCHMARK_RUN)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(BENCHMARK_RUN))) == NULL)
+  {
+    retVal = 1;
+    goto END;
+  }
+
+  if ((replayHandle = CaptureOpenReplay(pcapFileParam, loopCountParam, errorBuffer)) == NULL)
+  {
+    fprintf(stderr, "Unable to open the file %s.\nerror=%s\n", pcapFileParam, errorBuffer);
+    retVal = 2;
+    goto END;
+  }
+
+  ZeroMemory(&gCurrentScanParams, sizeof(gCurrentScanParams));
+  CopyMemory(&gCurrentScanParams, scanParamsParam, sizeof(gCurrentScanParams));
+  gCurrentScanParams.IfcReadHandle = replayHandle;
+  gCurrentScanParams.IfcWriteHandle = replayHandle;
+
+  CaptureDispatchLoop(replayHandle, LearnLocalMacBatchCallback, (unsigned char *)&gCurrentScanParams);
+
+  // Output to the null device. Nothing is dropped, a run
+  // includes the records' way to the output channel's writer.
+  if ((gOutputChannel = OutputChannelOpen("NUL", OUTPUT_POLICY_BLOCK)) == NULL)
+  {
+    fprintf(stderr, "Unable to open the null device\n");
+    retVal = 3;
+    goto END;
+  }
+
+  if (BenchmarkReplay(replayHandle, "SniffAndParseCallback", (BENCHMARK_PACKET_HANDLER)SniffAndParseCallback, (unsigned char *)&gCurrentScanParams, benchmarkRun) == FALSE)
+  {
+    fprintf(stderr, "Replay failed: %s\n", CaptureGetError(replayHandle));
+    retVal = 4;
+    goto END;
+  }
+
+  BenchmarkPrintReport(benchmarkRun);
+
+  if (BenchmarkReplay(replayHandle, "GenericSnifferCallback", (BENCHMARK_PACKET_HANDLER)GenericSnifferCallback, (unsigned char *)&gCurrentScanParams, benchmarkRun) == FALSE)
+  {
+    fprintf(stderr, "Replay failed: %s\n", CaptureGetError(replayHandle));
+    retVal = 4;
+    goto END;
+  }
+
+  BenchmarkPrintReport(benchmarkRun);
+
+END:
+
+  if (gOutputChannel != NULL)
+  {
+    OutputChannelClose(gOutputChannel);
+    gOutputChannel = NULL;
+  }
+
+  if (replayHandle != NULL)
+  {
+    CaptureClose(replayHandle);
+  }
+
+  if (benchmarkRun != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, benchmarkRun);
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Take the destination MAC of the first frame as the local
+ * MAC address and stop.
+ *
+ */
+static void LearnLocalMacBatchCallback(unsigned char *scanParamsParam, PCAPTURE_BATCH batchParam)
+{
+  PSCANPARAMS scanParams = (PSCANPARAMS)scanParamsParam;
+
+  if (batchParam->FrameCount == 0)
+  {
+    return;
+  }
+
+  if (batchParam->Headers[0]->caplen >= sizeof(ETHDR))
+  {
+    CopyMemory(scanParams->LocalMAC, ((PETHDR)batchParam->Frames[0])->ether_dhost, BIN_MAC_LEN);
+    Mac2String(scanParams->LocalMAC, scanParams->LocalMACStr, sizeof(scanParams->LocalMACStr) - 1);
+  }
+
+  CaptureBreakLoop((PCAPTURE_HANDLE)scanParams->IfcReadHandle);
+}
+
+
+
+/*
+ * Microbenchmarks
+ *
+ * param   filter
+ *   -m     {...}
+ *
+ * Times the primitives of the sniffer paths one at a time, each
+ * for a few input or table sizes. Only benchmarks whose name
+ * (<primitive>/<size>) contains the filter run, e.g.
+ * "-m ConnectionTableLookup" or "-m /1024". The connection table
+ * holds at most CONNECTION_TABLE_CAPACITY entries.
+ *
+ */
+int ModeMicroBenchmarkStart(char *filterParam)
+{
+  int retVal = 0;
+  int hostnameSizes[] = { 16, 64, 200 };
+  int payloadSizes[] = { 64, 512, MAX_PAYLOAD };
+  int connectionCounts[] = { 16, 1024, CONNECTION_TABLE_CAPACITY };
+  int requestSizes[] = { 256, 512, MAX_PAYLOAD };
+  int recordSizes[] = { 64, 512, MAX_PAYLOAD };
+  int headerLength = 0;
+  PMICRO_BENCHMARK microBenchmark = NULL;
+  char hostname[MAX_BUF_SIZE + 1];
+  unsigned char query[BENCHMARK_FRAME_SIZE];
+  unsigned int queryLength = 0;
+  unsigned char srcMacBin[BIN_MAC_LEN] = { 0x02, 0x02, 0x02, 0x02, 0x02, 0x02 };
+  uint64_t randomState = 0x2545f4914f6cdd1dULL;
+  int counter = 0;
+  int keyCounter = 0;
+
+  gDEBUGLEVEL = DBG_OFF;
+
+  if ((microBenchmark = (PMICRO_BENCHMARK)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(MICRO_BENCHMARK))) == NULL)
+  {
+    retVal = 1;
+    goto END;
+  }
+
+  BenchmarkMicroStart("Sniffer primitives", filterParam);
+
+  // DNS queries, the size is the length of the queried name
+  for (counter = 0; counter < (int)(sizeof(hostnameSizes) / sizeof(hostnameSizes[0])); counter++)
+  {
+    BenchmarkBuildHostname(hostname, hostnameSizes[counter]);
+
+    if ((queryLength = BenchmarkBuildDnsQuery(query, sizeof(query), hostname)) == 0)
+    {
+      retVal = 2;
+      goto END;
+    }
+
+    microBenchmark->FrameLength = BenchmarkBuildFrame(microBenchmark->Frame, BENCHMARK_PROTO_UDP, 40000, 53, query, queryLength);
+    PacketViewParse(microBenchmark->Frame, microBenchmark->FrameLength, &microBenchmark->View);
+    BenchmarkMicro("GetReqHostName", hostnameSizes[counter], MicroGetReqHostName, microBenchmark);
+  }
+
+  // HTTP like payload, text with a few control characters
+  for (counter = 0; counter < MAX_PAYLOAD; counter++)
+  {
+    microBenchmark->Payload[counter] = counter % 40 == 39 ? '\n' : (unsigned char)('a' + counter % 26);
+  }
+
+  for (counter = 0; counter < (int)(sizeof(payloadSizes) / sizeof(payloadSizes[0])); counter++)
+  {
+    microBenchmark->PayloadLength = payloadSizes[counter];
+    BenchmarkMicro("Stringify", payloadSizes[counter], MicroStringify, microBenchmark);
+  }
+
+  // A POST request with a form body, the size is that of the whole
+  // request. The stream is fed one request per call.
+  for (counter = 0; counter < (int)(sizeof(requestSizes) / sizeof(requestSizes[0])); counter++)
+  {
+    if (BenchmarkMicroSelected("HttpParser", requestSizes[counter]) == FALSE)
+    {
+      continue;
+    }
+
+    if ((microBenchmark->HttpParser = HttpParserCreate(MicroHttpEvent, microBenchmark)) == NULL)
+    {
+      retVal = 4;
+      goto END;
+    }
+
+    // The length has a fixed width, the head is as long
+    // with the right Content-Length as it is with 0
+    headerLength = snprintf((char *)microBenchmark->Payload, sizeof(microBenchmark->Payload), MICRO_HTTP_REQUEST, 0);
+    snprintf((char *)microBenchmark->Payload, sizeof(microBenchmark->Payload), MICRO_HTTP_REQUEST, requestSizes[counter] - headerLength);
+    memset(microBenchmark->Payload + headerLength, 'a', requestSizes[counter] - headerLength);
+    microBenchmark->PayloadLength = requestSizes[counter];
+    HttpStreamInit(&microBenchmark->HttpStream, microBenchmark);
+
+    BenchmarkMicro("HttpParser", requestSizes[counter], MicroHttpParser, microBenchmark);
+
+    HttpParserDestroy(microBenchmark->HttpParser);
+    microBenchmark->HttpParser = NULL;
+  }
+
+  // Records written to the null device until they are out,
+  // the writer thread's share included
+  for (counter = 0; counter < (int)(sizeof(recordSizes) / sizeof(recordSizes[0])); counter++)
+  {
+    if (BenchmarkMicroSelected("OutputChannel", recordSizes[counter]) == FALSE)
+    {
+      continue;
+    }
+
+    if ((microBenchmark->Output = OutputChannelOpen("NUL", OUTPUT_POLICY_BLOCK)) == NULL)
+    {
+      retVal = 5;
+      goto END;
+    }
+
+    memset(microBenchmark->Payload, 'a', recordSizes[counter]);
+    microBenchmark->PayloadLength = recordSizes[counter];
+
+    BenchmarkMicro("OutputChannel", recordSizes[counter], MicroOutputChannel, microBenchmark);
+
+    OutputChannelClose(microBenchmark->Output);
+    microBenchmark->Output = NULL;
+  }
+
+  for (counter = 0; counter < (int)(sizeof(connectionCounts) / sizeof(connectionCounts[0])); counter++)
+  {
+    if (BenchmarkMicroSelected("ConnectionTableLookup", connectionCounts[counter]) == FALSE)
+    {
+      continue;
+    }
+
+    if ((microBenchmark->Connections = ConnectionTableCreate(CONNECTION_TABLE_CAPACITY)) == NULL)
+    {
+      retVal = 3;
+      goto END;
+    }
+
+    for (keyCounter = 0; keyCounter < connectionCounts[counter]; keyCounter++)
+    {
+      microBenchmark->Keys[keyCounter].srcIpBin[0] = 10;
+      microBenchmark->Keys[keyCounter].srcIpBin[2] = (unsigned char)(keyCounter >> 8);
+      microBenchmark->Keys[keyCounter].srcIpBin[3] = (unsigned char)keyCounter;
+      microBenchmark->Keys[keyCounter].dstIpBin[0] = 192;
+      microBenchmark->Keys[keyCounter].dstIpBin[1] = 168;
+      microBenchmark->Keys[keyCounter].dstIpBin[3] = 1;
+      microBenchmark->Keys[keyCounter].srcPort = (unsigned short)(1024 + keyCounter);
+      microBenchmark->Keys[keyCounter].dstPort = 80;
+      microBenchmark->Keys[keyCounter].protocol = IP_PROTO_TCP;
+      ConnectionTableAdd(microBenchmark->Connections, srcMacBin, &microBenchmark->Keys[keyCounter], 0);
+    }
+
+    // Hits only, in random order
+    microBenchmark->LookupCount = CONNECTION_TABLE_CAPACITY;
+
+    for (keyCounter = 0; keyCounter < microBenchmark->LookupCount; keyCounter++)
+    {
+      randomState ^= randomState << 13;
+      randomState ^= randomState >> 7;
+      randomState ^= randomState << 17;
+      CopyMemory(&microBenchmark->Lookups[keyCounter], &microBenchmark->Keys[randomState % connectionCounts[counter]], sizeof(CONNECTION_ID));
+    }
+
+    BenchmarkMicro("ConnectionTableLookup", connectionCounts[counter], MicroConnectionTableLookup, microBenchmark);
+
+    ConnectionTableDestroy(microBenchmark->Connections);
+    microBenchmark->Connections = NULL;
+  }
+
+  BenchmarkMicro("IpBin2String", BIN_IP_LEN, MicroIpBin2String, microBenchmark);
+  BenchmarkMicro("Mac2String", BIN_MAC_LEN, MicroMac2String, microBenchmark);
+
+  printf("\n");
+
+END:
+
+  if (microBenchmark != NULL)
+  {
+    ConnectionTableDestroy(microBenchmark->Connections);
+    HttpParserDestroy(microBenchmark->HttpParser);
+    OutputChannelClose(microBenchmark->Output);
+    HeapFree(GetProcessHeap(), 0, microBenchmark);
+  }
+
+  return retVal;
+}
+
+
+static uint64_t MicroGetReqHostName(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  char hostname[MAX_BUF_SIZE + 1];
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    result += GetReqHostName(microBenchmark->Frame, &microBenchmark->View, hostname, sizeof(hostname) - 1);
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroStringify(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  unsigned char output[MAX_PAYLOAD + 1];
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    Stringify(microBenchmark->Payload, microBenchmark->PayloadLength, output);
+    result += output[0];
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroConnectionTableLookup(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+  int index = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    result += ConnectionTableLookup(microBenchmark->Connections, &microBenchmark->Lookups[index], 0) != NULL ? 1 : 0;
+
+    if (++index >= microBenchmark->LookupCount)
+    {
+      index = 0;
+    }
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroHttpParser(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  uint64_t counter = 0;
+
+  microBenchmark->HttpEvents = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    HttpStreamData(microBenchmark->HttpParser, &microBenchmark->HttpStream, microBenchmark->Payload, microBenchmark->PayloadLength);
+  }
+
+  return microBenchmark->HttpEvents;
+}
+
+
+static void MicroHttpEvent(void *contextParam, PHTTP_STREAM streamParam, PHTTP_EVENT eventParam)
+{
+  ((PMICRO_BENCHMARK)contextParam)->HttpEvents += eventParam->Length + 1;
+}
+
+
+static uint64_t MicroOutputChannel(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    result += OutputChannelWrite(microBenchmark->Output, (char *)microBenchmark->Payload, microBenchmark->PayloadLength);
+  }
+
+  OutputChannelFlush(microBenchmark->Output);
+
+  return result;
+}
+
+
+static uint64_t MicroIpBin2String(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  unsigned char output[MAX_IP_LEN + 1];
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    IpBin2String(microBenchmark->Frame + sizeof(ETHDR) + 12, output, sizeof(output) - 1);
+    result += output[0];
+  }
+
+  return result;
+}
+
+
+static uint64_t MicroMac2String(void *contextParam, uint64_t iterationsParam)
+{
+  PMICRO_BENCHMARK microBenchmark = (PMICRO_BENCHMARK)contextParam;
+  unsigned char output[MAX_MAC_LEN + 1];
+  uint64_t result = 0;
+  uint64_t counter = 0;
+
+  for (counter = 0; counter < iterationsParam; counter++)
+  {
+    Mac2String(microBenchmark->Frame + BIN_MAC_LEN, output, sizeof(output) - 1);
+    result += output[0];
+  }
+
+  return result;
+}
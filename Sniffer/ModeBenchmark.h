@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Windows.h>
+#include <time.h>
+#include "Sniffer.h"
+#include "Benchmark.h"
+#include "ConnectionTable.h"
+#include "HttpParser.h"
+#include "OutputChannel.h"
+#include "PacketView.h"
+
+
+/*
+ * Type definitions
+ *
+ */
+
+// Inputs of the microbenchmark currently running
+typedef struct
+{
+  unsigned char Frame[BENCHMARK_FRAME_SIZE];
+  unsigned int FrameLength;
+  PACKET_VIEW View;
+  unsigned char Payload[MAX_PAYLOAD];
+  int PayloadLength;
+  PCONNECTION_TABLE Connections;
+  CONNECTION_ID Keys[CONNECTION_TABLE_CAPACITY];
+  CONNECTION_ID Lookups[CONNECTION_TABLE_CAPACITY];
+  int LookupCount;
+  PHTTP_PARSER HttpParser;
+  HTTP_STREAM HttpStream;
+  uint64_t HttpEvents;
+  POUTPUT_CHANNEL Output;
+} MICRO_BENCHMARK, *PMICRO_BENCHMARK;
+
+
+/*
+ * Function forward declarations
+ *
+ */
+int ModeBenchmarkStart(PSCANPARAMS scanParamsParam, char *pcapFileParam, int loopCountParam);
+int ModeMicroBenchmarkStart(char *filterParam);
@@ -5,17 +5,19 @@
 #include <pcap.h>
 #include <Shlwapi.h>
 
+#include "CaptureStats.h"
 #include "DnsStructs.h"
 #include "Logging.h"
 #include "ModeGenericSniffer.h"
 #include "ModeMinary.h"
 #include "NetworkFunctions.h"
+#include "PacketCapture.h"
 #include "Sniffer.h"
 #include "SniffAndEvaluate.h"
 
 
 // Global variables
-pcap_t *gPcapHandle;
+PCAPTURE_HANDLE gCaptureHandle;
 
 
 
@@ -29,7 +31,6 @@ int ModeGenericSnifferStart(PSCANPARAMS scanParamsParam)
   char bpfFilter[MAX_BUF_SIZE + 1];
   int counter = 0;
   int interfaceNum = 0;
-  struct bpf_program filterCode;
   unsigned int netMask = 0;
 
   // Set exit function to trigger depoisoning functions and command.
@@ -54,9 +55,9 @@ int ModeGenericSnifferStart(PSCANPARAMS scanParamsParam)
   }
 
   // Open interface.
-  if ((gPcapHandle = pcap_open(adapter, 65536, PCAP_OPENFLAG_PROMISCUOUS, PCAP_READTIMEOUT, NULL, tempBuffer)) == NULL)
+  if ((gCaptureHandle = CaptureOpen(adapter, 65536, CAPTURE_FLAG_PROMISCUOUS, PCAP_READTIMEOUT, tempBuffer)) == NULL)
   {
-    LogMsg(DBG_ERROR, "GeneralSniffer() : Unable to open the adapter \"%s\"", scanParamsParam->IfcName);
+    LogMsg(DBG_ERROR, "GeneralSniffer() : Unable to open the adapter \"%s\" : %s", scanParamsParam->IfcName, tempBuffer);
     retVal = 3;
     goto END;
   }
@@ -71,7 +72,6 @@ int ModeGenericSnifferStart(PSCANPARAMS scanParamsParam)
     netMask = 0xffffff;
   }
 
-  ZeroMemory(&filterCode, sizeof(filterCode));
   ZeroMemory(bpfFilter, sizeof(bpfFilter));
 
   if (scanParamsParam->PcapPattern != NULL)
@@ -79,16 +79,9 @@ int ModeGenericSnifferStart(PSCANPARAMS scanParamsParam)
     snprintf(bpfFilter, sizeof(bpfFilter) - 1, "%s", scanParamsParam->PcapPattern);
   }
 
-  if (pcap_compile(gPcapHandle, &filterCode, bpfFilter, 1, netMask) < 0)
+  if (CaptureSetFilter(gCaptureHandle, bpfFilter, netMask) == FALSE)
   {
-    LogMsg(DBG_ERROR, "GeneralSniffer() : Unable to compile the packet filter");
-    retVal = 4;
-    goto END;
-  }
-
-  if (pcap_setfilter(gPcapHandle, &filterCode) < 0)
-  {
-    LogMsg(DBG_ERROR, "GeneralSniffer() : Error setting the filter.");
+    LogMsg(DBG_ERROR, "GeneralSniffer() : Error setting the filter : %s", CaptureGetError(gCaptureHandle));
     retVal = 5;
     goto END;
   }
@@ -100,11 +93,17 @@ int ModeGenericSnifferStart(PSCANPARAMS scanParamsParam)
     pcap_freealldevs(allDevices);
   }
 
-  LogMsg(DBG_INFO, "GeneralSniffer() : General scanner started. Waiting for \"%s\" data on device \"%s\"", bpfFilter, adapter);
+  LogMsg(DBG_INFO, "GeneralSniffer() : General scanner started. Waiting for \"%s\" data on device \"%s\" (%s)", bpfFilter, adapter, CaptureGetBackendName(gCaptureHandle));
+  CaptureStatsAddHandle("capture", gCaptureHandle);
+  CaptureStatsStart(LogCaptureStats);
+
   // Start intercepting data packets.
-  pcap_loop(gPcapHandle, 0, (pcap_handler)GenericSnifferCallback, (unsigned char *)scanParamsParam);
+  CaptureDispatchLoop(gCaptureHandle, GenericSnifferBatchCallback, (unsigned char *)scanParamsParam);
   LogMsg(DBG_INFO, "GeneralSniffer() : General scanner stopped");
 
+  CaptureStatsStop();
+  CaptureStatsRemove(gCaptureHandle);
+
 END:
 
   // Release all allocated resources.
@@ -118,92 +117,56 @@ END:
 }
 
 
+void GenericSnifferBatchCallback(u_char *callbackParam, PCAPTURE_BATCH batchParam)
+{
+  int counter = 0;
+
+  for (counter = 0; counter < batchParam->FrameCount; counter++)
+  {
+    GenericSnifferCallback(callbackParam, batchParam->Headers[counter], batchParam->Frames[counter]);
+  }
+}
+
+
 void GenericSnifferCallback(u_char *callbackParam, const struct pcap_pkthdr *headerParam, const u_char *packetDataParam)
 {
-  PETHDR etherHdr = (PETHDR)packetDataParam;
-  char srcMacStr[64];
-  char dstMacStr[64];
-  char srcIpStr[64];
-  char dstIpStr[64];
-  char proto[MAX_BUF_SIZE + 1];
-  PETHDR ethrHdrPtr = (PETHDR)packetDataParam;
+  PACKET_VIEW view;
   PARPHDR arpDataPtr = NULL;
   PIPHDR ipHdrPtr = NULL;
-  PTCPHDR tcpHdrPtr = NULL;
   PUDPHDR udpHdrPtr = NULL;
-  int ipLength = 0;
-  int totalLength = 0;
-  int ipHdrLength = 0;
-  int tcpHdrLength = 0;
-  int tcpDataLength = 0;
-  unsigned char data[1500 + 1];
-  unsigned char realData[1500 + 1];
-  unsigned char *readlDataPtr = NULL;
-  unsigned char tempBuffer[MAX_BUF_SIZE + 1];
-  int counter = 0;
+  PTCPHDR tcpHdrPtr = NULL;
 
-  if (htons(ethrHdrPtr->ether_type) == 0x0800)
+  if (PacketViewParse(packetDataParam, headerParam->caplen, &view) == FALSE)
   {
-    ZeroMemory(dstMacStr, sizeof(dstMacStr));
-    ZeroMemory(srcMacStr, sizeof(srcMacStr));
-    ZeroMemory(srcIpStr, sizeof(srcIpStr));
-    ZeroMemory(dstIpStr, sizeof(dstIpStr));
-    ZeroMemory(proto, sizeof(proto));
-
-    Mac2String(etherHdr->ether_shost, (unsigned char *)srcMacStr, sizeof(srcMacStr) - 1);
-    Mac2String(etherHdr->ether_dhost, (unsigned char *)dstMacStr, sizeof(dstMacStr) - 1);
+    return;
+  }
 
+  // Addresses and payload stay in binary form. Nothing is
+  // rendered to text until there is an output for it.
+  if (view.Layers & PV_LAYER_IPV4)
+  {
     // IPv4
-    if (htons(etherHdr->ether_type) == 0x0800)
+    ipHdrPtr = PV_IP(packetDataParam, &view);
+
+    if (view.Layers & PV_LAYER_ICMP)
     {
-      ipHdrPtr = (PIPHDR)(packetDataParam + 14);
-
-      ipLength = (ipHdrPtr->ver_ihl & 0xf) * 4;
-      totalLength = ntohs(ipHdrPtr->tlen);
-
-      snprintf(dstIpStr, sizeof(dstIpStr) - 1, "%d.%d.%d.%d", ipHdrPtr->daddr.byte1, ipHdrPtr->daddr.byte2, ipHdrPtr->daddr.byte3, ipHdrPtr->daddr.byte4);
-      snprintf(srcIpStr, sizeof(srcIpStr) - 1, "%d.%d.%d.%d", ipHdrPtr->saddr.byte1, ipHdrPtr->saddr.byte2, ipHdrPtr->saddr.byte3, ipHdrPtr->saddr.byte4);
-
-      if (ipHdrPtr->proto == 1)
-      {
-
-      // TCP data packet
-      }
-      else if (ipHdrPtr->proto == IP_PROTO_TCP)
-      {
-        tcpHdrPtr = (PTCPHDR)((u_char*)ipHdrPtr + ipLength);
-        totalLength = ntohs(ipHdrPtr->tlen);
-
-        tcpHdrLength = tcpHdrPtr->doff * 4;
-        tcpDataLength = totalLength - ipHdrLength - tcpHdrLength;
-
-        if (tcpDataLength > 0)
-        {
-          strncpy((char *)data, (char *)tcpHdrPtr + tcpHdrLength, tcpDataLength);
-          ZeroMemory(realData, sizeof(realData));
-          Stringify(data, tcpDataLength, realData);
-
-          for (counter = 0, readlDataPtr = realData; counter < tcpDataLength; counter += 64)
-          {
-            ZeroMemory(tempBuffer, sizeof(tempBuffer));
-            memcpy((char *)tempBuffer, (char *)readlDataPtr + counter, 64);
-          }
-
-          ZeroMemory(tempBuffer, sizeof(tempBuffer));
-          memcpy((char *)tempBuffer, (char *)readlDataPtr + counter, 64);
-        }
-      }
-      else if (ipHdrPtr->proto == IP_PROTO_UDP)
-      {
-        udpHdrPtr = (PUDPHDR)((u_char*)ipHdrPtr + ipLength);
-      }
+
+    // TCP data packet
+    }
+    else if (view.Layers & PV_LAYER_TCP)
+    {
+      tcpHdrPtr = PV_TCP(packetDataParam, &view);
+    }
+    else if (view.Layers & PV_LAYER_UDP)
+    {
+      udpHdrPtr = PV_UDP(packetDataParam, &view);
     }
 
   // IPv6
   }
-  else if (htons(ethrHdrPtr->ether_type) == 0x0806)
+  else if (view.Layers & PV_LAYER_ARP)
   {
-
+    arpDataPtr = PV_ARP(packetDataParam, &view);
   }
 }
 
@@ -215,37 +178,37 @@ BOOL Sniffer_ControlHandler(DWORD pControlType)
     // Handle the CTRL-C signal. 
   case CTRL_C_EVENT:
     LogMsg(DBG_INFO, "Ctrl-C event : Exiting process");
-    pcap_breakloop(gPcapHandle);
+    CaptureBreakLoop(gCaptureHandle);
     LogMsg(DBG_INFO, "Ctrl-C event : pcap closed");
     return FALSE;
 
   case CTRL_CLOSE_EVENT:
     LogMsg(DBG_INFO, "Ctrl-Close event : Exiting process");
-    pcap_breakloop(gPcapHandle);
+    CaptureBreakLoop(gCaptureHandle);
     LogMsg(DBG_INFO, "Ctrl-Close event : pcap closed");
     return FALSE;
 
   case CTRL_BREAK_EVENT:
     LogMsg(DBG_INFO, "Ctrl-Break event : Exiting process");
-    pcap_breakloop(gPcapHandle);
+    CaptureBreakLoop(gCaptureHandle);
     LogMsg(DBG_INFO, "Ctrl-Break event : pcap closed");
     return FALSE;
 
   case CTRL_LOGOFF_EVENT:
     printf("Ctrl-Logoff event : Exiting process");
-    pcap_breakloop(gPcapHandle);
+    CaptureBreakLoop(gCaptureHandle);
     printf("Ctrl-Logoff event : pcap closed");
     return FALSE;
 
   case CTRL_SHUTDOWN_EVENT:
     LogMsg(DBG_INFO, "Ctrl-Shutdown event : Exiting process");
-    pcap_breakloop(gPcapHandle);
+    CaptureBreakLoop(gCaptureHandle);
     LogMsg(DBG_INFO, "Ctrl-Shutdown event : pcap closed", pControlType);
     return FALSE;
 
   default:
     LogMsg(DBG_INFO, "Unknown event \"%d\" : Exiting process", pControlType);
-    pcap_breakloop(gPcapHandle);
+    CaptureBreakLoop(gCaptureHandle);
     LogMsg(DBG_INFO, "Unknown event \"%d\" : pcap closed", pControlType);
     return FALSE;
   }
@@ -2,7 +2,10 @@
 
 #include <windows.h>
 #include "Sniffer.h"
+#include "PacketCapture.h"
+#include "PacketView.h"
 
 int ModeGenericSnifferStart(PSCANPARAMS pScanParams);
+void GenericSnifferBatchCallback(u_char *callbackParam, PCAPTURE_BATCH batchParam);
 void GenericSnifferCallback(u_char *param, const struct pcap_pkthdr *header, const u_char *pkt_data);
 BOOL Sniffer_ControlHandler(DWORD pControlType);
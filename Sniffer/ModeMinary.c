@@ -6,23 +6,32 @@
 #include <Shlwapi.h>
 
 #include "Sniffer.h"
+#include "CaptureStats.h"
 #include "DnsParser.h"
 #include "DnsStructs.h"
-#include "LinkedListConnections.h"
-#include "LinkedListSystems.h"
+#include "ConnectionTable.h"
 #include "Logging.h"
 #include "ModeMinary.h"
 #include "NetworkFunctions.h"
+#include "PacketCapture.h"
+#include "Probes.h"
 
 
 extern int gDEBUGLEVEL;
 extern char gTempFilesDir[MAX_BUF_SIZE + 1];
 extern CRITICAL_SECTION gCSOutputPipe;
-extern PCONNODE gConnectionList;
+extern PCONNECTION_TABLE gConnectionTable;
 
-PSYSNODE gTargetSystemsList;
 SCANPARAMS gCurrentScanParams;
-HANDLE gOutputPipe = INVALID_HANDLE_VALUE;
+POUTPUT_CHANNEL gOutputChannel = NULL;
+
+static char *gOutputVectorBuffer = NULL;
+static int gOutputVectorBufferSize = 0;
+
+
+static void WriteOutputConsole(char *data, int dataLength);
+static void LogOutputStats();
+static void OutputChannelError(void *contextParam, char *errorParam);
 
 
 int ModeMinaryStart(PSCANPARAMS scanParamsParam)
@@ -44,7 +53,15 @@ int ModeMinaryStart(PSCANPARAMS scanParamsParam)
   {
     snprintf(namedPipePath, sizeof(namedPipePath) - 1, "\\\\.\\pipe\\%s", gCurrentScanParams.OutputPipeName);
     printf("Writing output to NamedPipe:%s\n", namedPipePath);
-    gOutputPipe = CreateFile(namedPipePath, GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
+
+    if ((gOutputChannel = OutputChannelOpen(namedPipePath, gCurrentScanParams.OutputPolicy)) == NULL)
+    {
+      LogMsg(DBG_ERROR, "ModeMinaryStart() : Can't open the named pipe %s", namedPipePath);
+    }
+    else
+    {
+      OutputChannelSetErrorHandler(gOutputChannel, OutputChannelError, namedPipePath);
+    }
   }
   else
   {
@@ -59,282 +76,174 @@ int ModeMinaryStart(PSCANPARAMS scanParamsParam)
 
   LogMsg(DBG_INFO, "startSniffer() : Scanner started. Waiting for data ...");
 
+  CaptureStatsAddHandle("capture", (PCAPTURE_HANDLE)gCurrentScanParams.IfcReadHandle);
+  CaptureStatsStart(LogCaptureStats);
+
   // Start intercepting data packets.
-  pcap_loop((pcap_t *)gCurrentScanParams.IfcReadHandle, 0, (pcap_handler)SniffAndParseCallback, (unsigned char *)&gCurrentScanParams);
+  CaptureDispatchLoop((PCAPTURE_HANDLE)gCurrentScanParams.IfcReadHandle, SniffAndParseBatchCallback, (unsigned char *)&gCurrentScanParams);
+
+  CaptureStatsStop();
+  CaptureStatsRemove(gCurrentScanParams.IfcReadHandle);
 
 END:
 
+  if (gOutputChannel != NULL)
+  {
+    OutputChannelFlush(gOutputChannel);
+    LogOutputStats();
+    OutputChannelClose(gOutputChannel);
+    gOutputChannel = NULL;
+  }
+
   return retVal;
 }
 
 
+void SniffAndParseBatchCallback(unsigned char *scanParamsParam, PCAPTURE_BATCH batchParam)
+{
+  int counter = 0;
+
+  for (counter = 0; counter < batchParam->FrameCount; counter++)
+  {
+    SniffAndParseCallback(scanParamsParam, batchParam->Headers[counter], batchParam->Frames[counter]);
+  }
+}
+
+
 void SniffAndParseCallback(unsigned char *scanParamsParam, struct pcap_pkthdr *pcapHdrParam, unsigned char *packetDataParam)
 {
-  SYSTEMNODE system;
+  PACKET_VIEW view;
   PETHDR ethrHdr = (PETHDR)packetDataParam;
   PIPHDR ipHdrPtrParam = NULL;
-  PTCPHDR tcpHdrPtrParam = NULL;
   PUDPHDR udpHdrPtr = NULL;
-  int ipHeaderLength = 0;
-  int tcpHeaderLength = 0;
-  int tcpDataLength = 0;
-  unsigned char data[1500 + 1];
-  unsigned char realData[1500 + 1];
-  int totalLength = 0;
-  unsigned char *tempBufferPtr = NULL;
-  unsigned char tempBuffer[MAX_BUF_SIZE + 1];
-  unsigned char tempBuffer2[MAX_BUF_SIZE + 1];
-  unsigned char srcMacStr[MAX_BUF_SIZE + 1];
-  unsigned char dstMacStr[MAX_BUF_SIZE + 1];
-  unsigned char dstMac[MAX_BUF_SIZE + 1];
-  unsigned char srcIpStr[MAX_BUF_SIZE + 1];
-  unsigned char dstIpStr[MAX_BUF_SIZE + 1];
-  unsigned char ipBytes[BIN_IP_LEN];
+  char outputBuffer[MAX_BUF_SIZE + 1];
   int bufferLength = 0;
-  int retVal = 0;
-  int pcapRetVal = 0;
-  unsigned long dstIpNumber = 0;
-  int lInSubnet = 0;
-  unsigned char *dataPipe = NULL;
-  PSCANPARAMS tempParams = (PSCANPARAMS)scanParamsParam;
-  SCANPARAMS scanParams;
-  unsigned int sequenceNumber = 0;
+  PSCANPARAMS scanParams = (PSCANPARAMS)scanParamsParam;
   char hostname[MAX_BUF_SIZE + 1];
-  HANDLE fileHandle = INVALID_HANDLE_VALUE;
-  PSYSNODE readlDstSystem = NULL;
-  PARPHDR arpData = NULL;
-  unsigned short type = htons(ethrHdr->ether_type);
-  char *payloadPtr = NULL;
-
-  ZeroMemory(&scanParams, sizeof(scanParams));
-  CopyMemory(&scanParams, tempParams, sizeof(scanParams));
+  uint64_t captureTime = (uint64_t)pcapHdrParam->ts.tv_sec * 1000 + pcapHdrParam->ts.tv_usec / 1000;
 
+  PROBE_PACKET_RECEIVED(packetDataParam, pcapHdrParam->caplen);
 
   // Its an IP packet and its destination is not our own system.
   // We forward it to the real gateway.
-  if (type != ETHERTYPE_IP)
+  if (PacketViewParse(packetDataParam, pcapHdrParam->caplen, &view) == FALSE ||
+      (view.Layers & PV_LAYER_IPV4) == 0)
   {
     return;
   }
 
-  if (memcmp(scanParams.LocalMAC, ethrHdr->ether_shost, BIN_MAC_LEN) == 0 ||
-    memcmp(scanParams.LocalMAC, ethrHdr->ether_dhost, BIN_MAC_LEN) != 0)
+  PROBE_PACKET_PARSED(packetDataParam, view.Layers);
+
+  if (memcmp(scanParams->LocalMAC, ethrHdr->ether_shost, BIN_MAC_LEN) == 0 ||
+    memcmp(scanParams->LocalMAC, ethrHdr->ether_dhost, BIN_MAC_LEN) != 0)
   {
     return;
   }
 
-  ipHdrPtrParam = (PIPHDR)(packetDataParam + 14);
-  ipHeaderLength = (ipHdrPtrParam->ver_ihl & 0xf) * 4;
-
-  ZeroMemory(srcIpStr, sizeof(srcIpStr));
-  ZeroMemory(dstIpStr, sizeof(dstIpStr));
-  ZeroMemory(srcMacStr, sizeof(srcMacStr));
-  ZeroMemory(dstMacStr, sizeof(dstMacStr));
-  ZeroMemory(dstMac, sizeof(dstMac));
-
-  snprintf((char *)srcIpStr, sizeof(srcIpStr) - 1, "%d.%d.%d.%d", ipHdrPtrParam->saddr.byte1, ipHdrPtrParam->saddr.byte2, ipHdrPtrParam->saddr.byte3, ipHdrPtrParam->saddr.byte4);
-  snprintf((char *)dstIpStr, sizeof(dstIpStr) - 1, "%d.%d.%d.%d", ipHdrPtrParam->daddr.byte1, ipHdrPtrParam->daddr.byte2, ipHdrPtrParam->daddr.byte3, ipHdrPtrParam->daddr.byte4);
-
-  Mac2String(ethrHdr->ether_shost, srcMacStr, sizeof(srcMacStr) - 1);
-  Mac2String(ethrHdr->ether_dhost, dstMacStr, sizeof(dstMacStr) - 1);
-
-  ipBytes[0] = ipHdrPtrParam->daddr.byte1;
-  ipBytes[1] = ipHdrPtrParam->daddr.byte2;
-  ipBytes[2] = ipHdrPtrParam->daddr.byte3;
-  ipBytes[3] = ipHdrPtrParam->daddr.byte4;
+  ipHdrPtrParam = PV_IP(packetDataParam, &view);
 
   // Dst IP is our local IP and port is 80.
   // We do this because of DNS poisoning and to evaluate traffic we
   // redirect to this system (e.g. www.facebook.com).
   //
-  if (memcmp(&ipHdrPtrParam->daddr, scanParams.LocalIP, BIN_IP_LEN) == 0 &&
-      ipHdrPtrParam->proto == IP_PROTO_TCP)
+  if (memcmp(&ipHdrPtrParam->daddr, scanParams->LocalIP, BIN_IP_LEN) == 0 &&
+      (view.Layers & PV_LAYER_TCP))
   {
-    readlDstSystem = GetNodeByIp(gTargetSystemsList, ethrHdr->ether_dhost);
-    Mac2String(ethrHdr->ether_dhost, dstMacStr, sizeof(dstMacStr) - 1);
-
-    ZeroMemory(&system, sizeof(system));
-    // Src/Dst IPs
-    snprintf((char *)system.dstIpStr, sizeof(system.dstIpStr) - 1, "%d.%d.%d.%d", ipHdrPtrParam->daddr.byte1, ipHdrPtrParam->daddr.byte2, ipHdrPtrParam->daddr.byte3, ipHdrPtrParam->daddr.byte4);
-    snprintf((char *)system.srcIpStr, sizeof(system.srcIpStr) - 1, "%d.%d.%d.%d", ipHdrPtrParam->saddr.byte1, ipHdrPtrParam->saddr.byte2, ipHdrPtrParam->saddr.byte3, ipHdrPtrParam->saddr.byte4);
-
-    totalLength = ntohs(ipHdrPtrParam->tlen);
-    tcpHdrPtrParam = (PTCPHDR)((u_char*)ipHdrPtrParam + ipHeaderLength);
-
-    tcpHeaderLength = tcpHdrPtrParam->doff * 4;
-    tcpDataLength = totalLength - ipHeaderLength - tcpHeaderLength;
-
-    ZeroMemory(srcMacStr, sizeof(srcMacStr));
-    Mac2String(ethrHdr->ether_shost, srcMacStr, sizeof(srcMacStr) - 1);
-
     // If packet is an HTTP(S) request sent by the client to the server
     // the packet is processed separately.
-    if (ntohs(tcpHdrPtrParam->dport) == 80)
+    if (view.DstPort == 80)
     {
-      HandleHttpTraffic((char *)srcMacStr, ipHdrPtrParam, tcpHdrPtrParam);
+      HandleHttpTraffic(ethrHdr->ether_shost, packetDataParam, &view, captureTime);
     }
 
 
   // Dst IP is not our own local IP.
   // Process packet and forward it to the default GW.
   }
-  else if (memcmp(&ipHdrPtrParam->saddr, scanParams.LocalIP, BIN_IP_LEN) != 0 &&
-           memcmp(&ipHdrPtrParam->daddr, scanParams.LocalIP, BIN_IP_LEN) != 0)
+  else if (memcmp(&ipHdrPtrParam->saddr, scanParams->LocalIP, BIN_IP_LEN) != 0 &&
+           memcmp(&ipHdrPtrParam->daddr, scanParams->LocalIP, BIN_IP_LEN) != 0)
   {
-    readlDstSystem = GetNodeByIp(gTargetSystemsList, ethrHdr->ether_dhost);
-
-    Mac2String(ethrHdr->ether_dhost, dstMacStr, sizeof(dstMacStr) - 1);
-
-    ZeroMemory(&system, sizeof(system));
-    // Src/Dst IPs
-    snprintf((char *)system.dstIpStr, sizeof(system.dstIpStr) - 1, "%d.%d.%d.%d", ipHdrPtrParam->daddr.byte1, ipHdrPtrParam->daddr.byte2, ipHdrPtrParam->daddr.byte3, ipHdrPtrParam->daddr.byte4);
-    snprintf((char *)system.srcIpStr, sizeof(system.srcIpStr) - 1, "%d.%d.%d.%d", ipHdrPtrParam->saddr.byte1, ipHdrPtrParam->saddr.byte2, ipHdrPtrParam->saddr.byte3, ipHdrPtrParam->saddr.byte4);
-
     // Process TCP data
-    if (ipHdrPtrParam->proto == IP_PROTO_TCP)
+    if (view.Layers & PV_LAYER_TCP)
     {
-      totalLength = ntohs(ipHdrPtrParam->tlen);
-      tcpHdrPtrParam = (PTCPHDR)((u_char*)ipHdrPtrParam + ipHeaderLength);
-
-      tcpHeaderLength = tcpHdrPtrParam->doff * 4;
-      tcpDataLength = totalLength - ipHeaderLength - tcpHeaderLength;
-
-      ZeroMemory(srcMacStr, sizeof(srcMacStr));
-      Mac2String(ethrHdr->ether_shost, srcMacStr, sizeof(srcMacStr) - 1);
-
-
-
       /*
        * Client opens an HTTPS connection to peer system.
        */
-      if (ntohs(tcpHdrPtrParam->dport) == 443 &&
-          tcpHdrPtrParam->syn == 1)
+      if (view.DstPort == 443 &&
+          (view.TcpFlags & PV_TCP_SYN))
       {
-        char httpsData[1024];
-        system.srcPort = ntohs(tcpHdrPtrParam->sport);
-        system.dstPort = ntohs(tcpHdrPtrParam->dport);
-
-        ZeroMemory(httpsData, sizeof(httpsData));
-        snprintf(httpsData, 1024, "HTTPS||%s||%s||%d||%s||%d||CONNECT:%s\r\n", srcMacStr, system.srcIpStr, system.srcPort, system.dstIpStr, system.dstPort, system.dstIpStr);
-        bufferLength = strlen((char *)httpsData);
-        WriteOutput(httpsData, bufferLength);
+        ZeroMemory(outputBuffer, sizeof(outputBuffer));
+        bufferLength = FormatOutputHeader(outputBuffer, sizeof(outputBuffer) - 1, "HTTPS", ethrHdr->ether_shost, (unsigned char *)&ipHdrPtrParam->saddr, view.SrcPort, (unsigned char *)&ipHdrPtrParam->daddr, view.DstPort);
+        snprintf(outputBuffer + bufferLength, sizeof(outputBuffer) - bufferLength - 1, "CONNECT:%d.%d.%d.%d\r\n", ipHdrPtrParam->daddr.byte1, ipHdrPtrParam->daddr.byte2, ipHdrPtrParam->daddr.byte3, ipHdrPtrParam->daddr.byte4);
+        bufferLength = strlen(outputBuffer);
+        WriteOutput(outputBuffer, bufferLength);
       }
 
 
-      // If packet is an HTTP request sent by a client to the server
-      // the packet is processed separately./
-      else if (ntohs(tcpHdrPtrParam->dport) == 80)
+      // HTTP requests sent by a client to the server and the
+      // server's responses are reassembled and parsed per
+      // connection direction, each message is written out once
+      // it is complete.
+      else if (view.DstPort == 80 ||
+               view.SrcPort == 80)
       {
-        HandleHttpTraffic((char *)srcMacStr, ipHdrPtrParam, tcpHdrPtrParam);
-
-      // When the HTTP server sends a response
-      // concat data to the previous client request data buffer
-      // and send the request/response data pair to the named pipe
-      }
-      else if (ntohs(tcpHdrPtrParam->sport) == 80)
-      {
-        if (tcpDataLength > 10)
-        {
-          ZeroMemory(tempBuffer, sizeof(tempBuffer));
-          ZeroMemory(tempBuffer2, sizeof(tempBuffer2));
-          ZeroMemory(data, sizeof(data));
-          ZeroMemory(realData, sizeof(realData));
-
-          /*
-           * Copy connection data to data structure.
-           */
-          system.srcPort = ntohs(tcpHdrPtrParam->sport);
-          system.dstPort = ntohs(tcpHdrPtrParam->dport);
-
-
-          /*
-           * Copy and stringify the payload
-           */
-          if (tcpDataLength > 1460)
-          {
-            strncpy((char *)data, (char *)tcpHdrPtrParam + tcpHeaderLength, 1460);
-            Stringify(data, 1460, realData);
-          }
-          else if (tcpDataLength > 0)
-          {
-            strncpy((char *)data, (char *)tcpHdrPtrParam + tcpHeaderLength, tcpDataLength);
-            Stringify(data, tcpDataLength, realData);
-          }
-
-          // OVERHEAD is calculated as follows : 15 + 10 + 32 ~ 84
-          if (tcpDataLength > 2 &&
-             (dataPipe = (unsigned char *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, tcpDataLength + 84)) != NULL)
-          {
-            snprintf((char *)dataPipe, tcpDataLength + 80, "HTTPREQ||%s||%s||%d||%s||%d||%s", srcMacStr, system.srcIpStr, system.srcPort, system.dstIpStr, system.dstPort, realData);
-            strcat((char *)dataPipe, "\r\n");
-            bufferLength = strlen((char *)dataPipe);
-
-            WriteOutput((char *)dataPipe, bufferLength);
-            HeapFree(GetProcessHeap(), 0, dataPipe);
-          }
-        }
+        HandleHttpTraffic(ethrHdr->ether_shost, packetDataParam, &view, captureTime);
       }
     }
-    else if (ipHdrPtrParam->proto == IP_PROTO_UDP)
+    else if (view.Layers & PV_LAYER_UDP)
     {
-      totalLength = ntohs(ipHdrPtrParam->tlen);
-      udpHdrPtr = (PUDPHDR)((unsigned char*)ipHdrPtrParam + ipHeaderLength);
-
-      // Src/Dst Ports
-      system.srcPort = ntohs(udpHdrPtr->sport);
-      system.dstPort = ntohs(udpHdrPtr->dport);
+      udpHdrPtr = PV_UDP(packetDataParam, &view);
 
       // Handle DNS requests.
-      if (ntohs(udpHdrPtr->dport) == 53)
+      if (view.DstPort == 53)
       {
         ZeroMemory(hostname, sizeof(hostname));
-        if (GetReqHostName(packetDataParam, pcapHdrParam->len, hostname, sizeof(hostname) - 1) == TRUE)
+        if (GetReqHostName(packetDataParam, &view, hostname, sizeof(hostname) - 1) == TRUE)
         {
+          PROBE_DNS_NAME(packetDataParam, hostname, 0);
+
           // Write DNS data to pipe
-          if ((dataPipe = (unsigned char *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, MAX_BUF_SIZE + 1)) != NULL)
-          {
-            snprintf((char *)dataPipe, MAX_BUF_SIZE, "DNSREQ||%s||%s||%d||%s||%d||%s", srcMacStr, system.srcIpStr, system.srcPort, system.dstIpStr, system.dstPort, hostname);
-            strcat((char *)dataPipe, "\r\n");
-            bufferLength = strlen((char *)dataPipe);
+          ZeroMemory(outputBuffer, sizeof(outputBuffer));
+          bufferLength = FormatOutputHeader(outputBuffer, sizeof(outputBuffer) - 1, "DNSREQ", ethrHdr->ether_shost, (unsigned char *)&ipHdrPtrParam->saddr, view.SrcPort, (unsigned char *)&ipHdrPtrParam->daddr, view.DstPort);
+          snprintf(outputBuffer + bufferLength, sizeof(outputBuffer) - bufferLength - 3, "%s", hostname);
+          strcat(outputBuffer, "\r\n");
+          bufferLength = strlen(outputBuffer);
 
-            WriteOutput((char *)dataPipe, bufferLength);
-            HeapFree(GetProcessHeap(), 0, dataPipe);
-          }
+          WriteOutput(outputBuffer, bufferLength);
         }
       }
-      else if (ntohs(udpHdrPtr->sport) == 53)
+      else if (view.SrcPort == 53)
       {
         ZeroMemory(hostname, sizeof(hostname));
-        if (GetReqHostName(packetDataParam, pcapHdrParam->len, hostname, sizeof(hostname) - 1) == TRUE)
+        if (GetReqHostName(packetDataParam, &view, hostname, sizeof(hostname) - 1) == TRUE)
         {
-          if ((dataPipe = (unsigned char *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, MAX_BUF_SIZE + 1)) != NULL)
+          PROBE_DNS_NAME(packetDataParam, hostname, 0);
+
+          // Determine resolved IPs
+          char hostResBuffer[1024];
+          char *hostRes[20];
+          ZeroMemory(hostRes, sizeof(hostRes));
+          ZeroMemory(hostResBuffer, sizeof(hostResBuffer));
+          GetHostResolution((unsigned char *) udpHdrPtr, hostRes);
+
+          for (int i = 0; i < 20 && hostRes[i] != NULL; i++)
           {
-            // Determine resolved IPs
-            char hostResBuffer[1024];
-            char *hostRes[20];
-            ZeroMemory(hostRes, sizeof(hostRes));
-            ZeroMemory(hostResBuffer, sizeof(hostResBuffer));
-            GetHostResolution((unsigned char *) udpHdrPtr, hostRes);
-
-            for (int i = 0; i < 20 && hostRes[i] != NULL; i++)
-            {
-              strncat(hostResBuffer, hostRes[i], sizeof(hostResBuffer) - 1);
-              strcat(hostResBuffer, ",");
-              HeapFree(GetProcessHeap(), 0, hostRes[i]);
-            }
-
-            // We have to swap src/dst port so that this message can reach the plugins that
-            // request and process data determined for port 53. If we dont do that the packets won't reach 
-            // the plugins because of the client system's random source port, that in the context of
-            // a DNS response is the destination port. 
-//            snprintf((char *)dataPipe, MAX_BUF_SIZE, "DNSREP||%s||%s||%d||%s||%d||%s", srcMacStr, system.srcIpStr, system.dstPort, system.dstIpStr, system.srcPort, hostname);
-            snprintf((char *)dataPipe, MAX_BUF_SIZE, "DNSREP||%s||%s||%d||%s||%d||%s", srcMacStr, system.srcIpStr, system.dstPort, system.dstIpStr, system.srcPort, hostResBuffer);
-            strcat((char *)dataPipe, "\r\n");
-            bufferLength = strnlen((char *)dataPipe, MAX_BUF_SIZE);
-
-            WriteOutput((char *)dataPipe, bufferLength);
-            HeapFree(GetProcessHeap(), 0, dataPipe);
+            strncat(hostResBuffer, hostRes[i], sizeof(hostResBuffer) - 1);
+            strcat(hostResBuffer, ",");
+            HeapFree(GetProcessHeap(), 0, hostRes[i]);
           }
+
+          // We have to swap src/dst port so that this message can reach the plugins that
+          // request and process data determined for port 53. If we dont do that the packets won't reach 
+          // the plugins because of the client system's random source port, that in the context of
+          // a DNS response is the destination port. 
+          ZeroMemory(outputBuffer, sizeof(outputBuffer));
+          bufferLength = FormatOutputHeader(outputBuffer, sizeof(outputBuffer) - 1, "DNSREP", ethrHdr->ether_shost, (unsigned char *)&ipHdrPtrParam->saddr, view.DstPort, (unsigned char *)&ipHdrPtrParam->daddr, view.SrcPort);
+          snprintf(outputBuffer + bufferLength, sizeof(outputBuffer) - bufferLength - 3, "%s", hostResBuffer);
+          strcat(outputBuffer, "\r\n");
+          bufferLength = strnlen(outputBuffer, MAX_BUF_SIZE);
+
+          WriteOutput(outputBuffer, bufferLength);
         }
       }
     }
@@ -342,56 +251,58 @@ void SniffAndParseCallback(unsigned char *scanParamsParam, struct pcap_pkthdr *p
 }
 
 
-BOOL WriteOutput(char *data, int dataLength)
+/*
+ * Render the common "TYPE||MAC||SRCIP||SRCPORT||DSTIP||DSTPORT||"
+ * prefix of an output record. The packet handlers keep addresses in
+ * binary form, this is the only place where they become text.
+ *
+ */
+int FormatOutputHeader(char *bufferParam, int bufferSizeParam, char *typeParam, unsigned char *srcMacParam, unsigned char *srcIpParam, unsigned short srcPortParam, unsigned char *dstIpParam, unsigned short dstPortParam)
 {
-  BOOL retVal = FALSE;
-  DWORD dwRead = 0;
+  int retVal = 0;
+
+  retVal = snprintf(bufferParam, bufferSizeParam, "%s||%02X-%02X-%02X-%02X-%02X-%02X||%d.%d.%d.%d||%d||%d.%d.%d.%d||%d||",
+    typeParam, srcMacParam[0], srcMacParam[1], srcMacParam[2], srcMacParam[3], srcMacParam[4], srcMacParam[5],
+    srcIpParam[0], srcIpParam[1], srcIpParam[2], srcIpParam[3], srcPortParam,
+    dstIpParam[0], dstIpParam[1], dstIpParam[2], dstIpParam[3], dstPortParam);
+
+  if (retVal < 0 || retVal >= bufferSizeParam)
+  {
+    retVal = bufferSizeParam - 1;
+    bufferParam[retVal] = 0;
+  }
+
+  return retVal;
+}
 
+
+/*
+ * Records for the named pipe are queued on the output channel,
+ * its writer thread sends them in batches (one record per message
+ * on a message-mode pipe). The capture thread
+ * only waits for the pipe with "-o block", by default records are
+ * dropped and counted while the reader falls behind. Without a
+ * pipe, or once writing to it failed, records go to the console.
+ *
+ */
+BOOL WriteOutput(char *data, int dataLength)
+{
   if (data == NULL || 
       dataLength <= 0)
   {
     return NOK;
   }
 
-  EnterCriticalSection(&gCSOutputPipe);
-
-  // Write output data to named pipe
-  if (gCurrentScanParams.OutputPipeName[0] != NULL &&
-      ((int)gOutputPipe) != INVALID_HANDLE_VALUE &&
-      ((int)gOutputPipe) != 0)
+  if (OutputChannelIsOpen(gOutputChannel) == TRUE)
   {
-    if (!WriteFile(gOutputPipe, data, dataLength, &dwRead, NULL))
-    {
-      CloseHandle(gOutputPipe);
-      gOutputPipe = INVALID_HANDLE_VALUE;
-      LogMsg(DBG_ERROR, "WriteOutput() : Error occurred while writing \"%s\" ...", data);
-    }
-    else
-    {
-      //LogMsg(DBG_INFO, "WriteOutput() : Data written \"%s\" ...", pData);
-    }
+    return OutputChannelWrite(gOutputChannel, data, dataLength);
   }
-  else
-  {
-    // Write output data to the screen
-    LogMsg(DBG_HIGH, "gOutputPipe == INVALID_HANDLE_VALUE || gOutputPipe == 0\n");
-    if (gCurrentScanParams.OutputPipeName[0] != NULL)
-    {
-      LogMsg(DBG_HIGH, "gCurrentScanParams.OutputPipeName[0]=%s\n", gCurrentScanParams.OutputPipeName[0]);
-    }
 
-    if (data != NULL)
-    {
-      __try
-      {
-        puts(data);
-      }
-      __except (FilterException(GetExceptionCode(), GetExceptionInformation()))
-      {
-        printf("OMG it's a bug!\r\n");
-      }
-    }
-  }
+  PROBE_OUTPUT_WRITTEN(data, dataLength);
+
+  EnterCriticalSection(&gCSOutputPipe);
+
+  WriteOutputConsole(data, dataLength);
 
   LeaveCriticalSection(&gCSOutputPipe);
 
@@ -399,95 +310,126 @@ BOOL WriteOutput(char *data, int dataLength)
 }
 
 
-void HandleHttpTraffic(char *srcMacStrParam, PIPHDR ipHdrPtrParam, PTCPHDR tcpHdrPtrParam)
+/*
+ * One record from several buffers. The output channel gathers
+ * them into its ring. For the console they are copied once into
+ * a buffer that is kept and only ever grows.
+ *
+ */
+BOOL WriteOutputVector(POUTPUT_BUFFER buffersParam, int bufferCountParam)
 {
-  char srcIpStr[MAX_BUF_SIZE + 1];
-  char dstIpStr[MAX_BUF_SIZE + 1];
-  char connectionId[MAX_BUF_SIZE + 1];
-  char data[1500 + 1];
-  char realData[1500 + 1];
-  unsigned short srcPort = 0;
-  unsigned short dstPort = 0;
-  unsigned long sequenceNr = 0;
-  unsigned long sequenceAckNr = 0;
-  int numberConnections = 0;
-  int ipHeaderLength = 0;
-  int tcpHeaderLength = 0;
-  int tcpDataLength = 0;
-  int totalLength = 0;
-  PCONNODE tmpNodePtr = NULL;
-
-  ipHeaderLength = (ipHdrPtrParam->ver_ihl & 0xf) * 4;
-  totalLength = ntohs(ipHdrPtrParam->tlen);
-  tcpHdrPtrParam = (PTCPHDR)((u_char*)ipHdrPtrParam + ipHeaderLength);
+  int dataLength = 0;
+  int counter = 0;
+  char *tempBuffer = NULL;
 
-  tcpHeaderLength = tcpHdrPtrParam->doff * 4;
-  tcpDataLength = totalLength - ipHeaderLength - tcpHeaderLength;
+  if (buffersParam == NULL ||
+      bufferCountParam <= 0)
+  {
+    return NOK;
+  }
 
-  ZeroMemory(srcIpStr, sizeof(srcIpStr));
-  ZeroMemory(dstIpStr, sizeof(dstIpStr));
-  ZeroMemory(connectionId, sizeof(connectionId));
+  for (counter = 0; counter < bufferCountParam; counter++)
+  {
+    dataLength += buffersParam[counter].Length;
+  }
 
-  srcPort = ntohs(tcpHdrPtrParam->sport);
-  dstPort = ntohs(tcpHdrPtrParam->dport);
+  if (dataLength <= 0)
+  {
+    return NOK;
+  }
 
-  snprintf(dstIpStr, sizeof(dstIpStr) - 1, "%d.%d.%d.%d", ipHdrPtrParam->daddr.byte1,
-    ipHdrPtrParam->daddr.byte2, ipHdrPtrParam->daddr.byte3, ipHdrPtrParam->daddr.byte4);
+  if (OutputChannelIsOpen(gOutputChannel) == TRUE)
+  {
+    return OutputChannelWriteVector(gOutputChannel, buffersParam, bufferCountParam);
+  }
 
-  snprintf(srcIpStr, sizeof(srcIpStr) - 1, "%d.%d.%d.%d", ipHdrPtrParam->saddr.byte1,
-    ipHdrPtrParam->saddr.byte2, ipHdrPtrParam->saddr.byte3, ipHdrPtrParam->saddr.byte4);
+  EnterCriticalSection(&gCSOutputPipe);
 
-  sequenceNr = ntohl(tcpHdrPtrParam->seq);
-  sequenceAckNr = ntohl(tcpHdrPtrParam->ack_seq);
+  if (dataLength + 1 > gOutputVectorBufferSize)
+  {
+    tempBuffer = gOutputVectorBuffer == NULL ?
+      (char *)HeapAlloc(GetProcessHeap(), 0, dataLength + 1) :
+      (char *)HeapReAlloc(GetProcessHeap(), 0, gOutputVectorBuffer, dataLength + 1);
 
+    if (tempBuffer == NULL)
+    {
+      LeaveCriticalSection(&gCSOutputPipe);
+      return NOK;
+    }
 
-  snprintf(connectionId, sizeof(connectionId) - 1, "%s:%d->%s:%d", srcIpStr, srcPort, dstIpStr, dstPort);
+    gOutputVectorBuffer = tempBuffer;
+    gOutputVectorBufferSize = dataLength + 1;
+  }
 
-  // The data is attached to the connection buffer.
-  if (tcpDataLength > 0)
+  for (dataLength = 0, counter = 0; counter < bufferCountParam; counter++)
   {
-    ZeroMemory(data, sizeof(data));
-    ZeroMemory(realData, sizeof(realData));
+    CopyMemory(gOutputVectorBuffer + dataLength, buffersParam[counter].Data, buffersParam[counter].Length);
+    dataLength += buffersParam[counter].Length;
+  }
 
-    // Copy and stringify the payload
-    if (tcpDataLength > MAX_PAYLOAD)
-    {
-      strncpy(data, (char *)tcpHdrPtrParam + tcpHeaderLength, MAX_PAYLOAD);
-      Stringify((unsigned char *)data, MAX_PAYLOAD, (unsigned char *)realData);
-    }
-    else if (tcpDataLength > 0)
-    {
-      strncpy(data, (char *)tcpHdrPtrParam + tcpHeaderLength, tcpDataLength);
-      Stringify((unsigned char *)data, tcpDataLength, (unsigned char *)realData);
-    }
+  gOutputVectorBuffer[dataLength] = 0;
 
-    //Archive packet
-    if (ConnectionNodeExists(gConnectionList, connectionId) == NULL)
-    {
-      AddConnectionToList(&gConnectionList, srcMacStrParam, srcIpStr, srcPort, dstIpStr, dstPort);
-    }
+  PROBE_OUTPUT_WRITTEN(gOutputVectorBuffer, dataLength);
+  WriteOutputConsole(gOutputVectorBuffer, dataLength);
+
+  LeaveCriticalSection(&gCSOutputPipe);
 
-    if ((tmpNodePtr = ConnectionNodeExists(gConnectionList, connectionId)) != NULL)
+  return TRUE;
+}
+
+
+/*
+ * nowParam is the capture time in milliseconds
+ *
+ */
+void HandleHttpTraffic(unsigned char *srcMacParam, unsigned char *packetParam, PPACKET_VIEW viewParam, uint64_t nowParam)
+{
+  CONNECTION_ID connectionId;
+  int tcpDataLength = 0;
+  int tcpCapturedLength = 0;
+  PIPHDR ipHdrPtrParam = PV_IP(packetParam, viewParam);
+  PTCPHDR tcpHdrPtr = PV_TCP(packetParam, viewParam);
+  PCONNODE tmpNodePtr = NULL;
+
+  // Segment length from the IP header, the snap length
+  // may have cut off the end of the payload
+  tcpDataLength = viewParam->PayloadLength;
+  tcpCapturedLength = viewParam->PayloadCapLength;
+
+  ZeroMemory(&connectionId, sizeof(connectionId));
+  CopyMemory(connectionId.srcIpBin, &ipHdrPtrParam->saddr, BIN_IP_LEN);
+  CopyMemory(connectionId.dstIpBin, &ipHdrPtrParam->daddr, BIN_IP_LEN);
+  connectionId.srcPort = viewParam->SrcPort;
+  connectionId.dstPort = viewParam->DstPort;
+  connectionId.protocol = viewParam->IpProto;
+
+  ConnectionTableExpire(gConnectionTable, nowParam);
+
+  // The connection is tracked from its SYN on, or from its first
+  // data segment if the capture started later. The reassembled
+  // data goes through the connection's HTTP parser.
+  if (tcpDataLength > 0 ||
+      (viewParam->TcpFlags & PV_TCP_SYN))
+  {
+    tmpNodePtr = ConnectionTableLookup(gConnectionTable, &connectionId, nowParam);
+    PROBE_FLOW_LOOKUP(packetParam, tmpNodePtr != NULL);
+
+    if (tmpNodePtr == NULL)
     {
-      ConnectionAddData(tmpNodePtr, realData, strlen(realData));
+      tmpNodePtr = ConnectionTableAdd(gConnectionTable, srcMacParam, &connectionId, nowParam);
     }
-  }
 
-  numberConnections = ConnectionCountNodes(gConnectionList);
+    ConnectionTableAddSegment(gConnectionTable, tmpNodePtr, ntohl(tcpHdrPtr->seq), viewParam->TcpFlags, PV_PAYLOAD(packetParam, viewParam), tcpCapturedLength, tcpDataLength);
+  }
 
-  printf("HTTP  Con(1)# : %d\n", numberConnections);
+  LogMsg(DBG_DEBUG, "HandleHttpTraffic(): HTTP  Con(1)# : %d", ConnectionTableCount(gConnectionTable));
 
   // TCP status bits FIN or RST are set. Remove the
-  // according list entries.
-  if (tcpHdrPtrParam->fin == 1 ||
-      tcpHdrPtrParam->rst == 1)
+  // according table entry.
+  if (viewParam->TcpFlags & (PV_TCP_FIN | PV_TCP_RST))
   {
-    ConnectionDeleteNode(&gConnectionList, connectionId);
+    ConnectionTableRemove(gConnectionTable, &connectionId);
   }
-
-  // There should be a better place where this 
-  // function is called.
-  RemoveOldConnections(&gConnectionList);
 }
 
 
@@ -503,7 +445,6 @@ BOOL GetPcapDevice()
   BOOL retVal = FALSE;
   pcap_if_t *device = NULL;
   pcap_if_t *allDevices = NULL;
-  struct bpf_program filterCode;
   unsigned int netMask = 0;
   char adapter[MAX_BUF_SIZE + 1];
   char bpfFilter[MAX_BUF_SIZE + 1];
@@ -537,9 +478,9 @@ BOOL GetPcapDevice()
   }
 
   // Open interface.
-  if ((gCurrentScanParams.IfcReadHandle = pcap_open(adapter, 65536, PCAP_OPENFLAG_PROMISCUOUS, PCAP_READTIMEOUT, NULL, tempBuffer)) == NULL)
+  if ((gCurrentScanParams.IfcReadHandle = CaptureOpen(adapter, 65536, CAPTURE_FLAG_PROMISCUOUS, PCAP_READTIMEOUT, tempBuffer)) == NULL)
   {
-    LogMsg(DBG_ERROR, "startSniffer() : Unable to open the adapter \"%s\"", gCurrentScanParams.IfcName);
+    LogMsg(DBG_ERROR, "startSniffer() : Unable to open the adapter \"%s\" : %s", gCurrentScanParams.IfcName, tempBuffer);
     goto END;
   }
 
@@ -560,20 +501,14 @@ BOOL GetPcapDevice()
     netMask = 0xffffff;
   }
 
-  ZeroMemory(&filterCode, sizeof(filterCode));
   ZeroMemory(bpfFilter, sizeof(bpfFilter));
   snprintf(bpfFilter, sizeof(bpfFilter) - 1, "dst port 80 \
                                            or (dst port 443 or src port 443)\
                                            or dst port 53 \
                                            or src port 53");
-  if (pcap_compile((pcap_t *)gCurrentScanParams.IfcReadHandle, &filterCode, bpfFilter, 1, netMask) < 0)
-  {
-    LogMsg(DBG_ERROR, "startSniffer() : Unable to compile the packet filter");
-  }
-
-  if (pcap_setfilter((pcap_t *)gCurrentScanParams.IfcReadHandle, &filterCode) >= 0)
+  if (CaptureSetFilter((PCAPTURE_HANDLE)gCurrentScanParams.IfcReadHandle, bpfFilter, netMask) == FALSE)
   {
-    LogMsg(DBG_ERROR, "startSniffer() : Error setting the filter");
+    LogMsg(DBG_ERROR, "startSniffer() : Error setting the filter : %s", CaptureGetError((PCAPTURE_HANDLE)gCurrentScanParams.IfcReadHandle));
   }
 
   retVal = TRUE;
@@ -755,3 +690,55 @@ void ChangeToDnsNameFormat(unsigned char* input, unsigned char* output, int outp
 
   output[i - 1] = 0;
 }
+
+
+
+/*
+ * Caller holds gCSOutputPipe
+ *
+ */
+static void WriteOutputConsole(char *data, int dataLength)
+{
+  // Write output data to the screen
+  LogMsg(DBG_HIGH, "gOutputChannel == NULL || OutputChannelIsOpen(gOutputChannel) == FALSE\n");
+  if (gCurrentScanParams.OutputPipeName[0] != NULL)
+  {
+    LogMsg(DBG_HIGH, "gCurrentScanParams.OutputPipeName=%s\n", gCurrentScanParams.OutputPipeName);
+  }
+
+  if (data != NULL)
+  {
+    __try
+    {
+      puts(data);
+    }
+    __except (FilterException(GetExceptionCode(), GetExceptionInformation()))
+    {
+      printf("OMG it's a bug!\r\n");
+    }
+  }
+}
+
+
+static void LogOutputStats()
+{
+  OUTPUT_CHANNEL_STATS outputStats;
+
+  OutputChannelGetStats(gOutputChannel, &outputStats);
+  LogMsg(outputStats.Dropped > 0 || outputStats.WriteErrors > 0 ? DBG_ERROR : DBG_INFO,
+         "ModeMinaryStart() : Output records=%llu bytes=%llu batches=%llu dropped=%llu blocked=%llu write errors=%llu",
+         (unsigned long long)outputStats.Records, (unsigned long long)outputStats.Bytes, (unsigned long long)outputStats.Batches,
+         (unsigned long long)outputStats.Dropped, (unsigned long long)outputStats.Blocked, (unsigned long long)outputStats.WriteErrors);
+}
+
+
+/*
+ * The output channel closed the pipe after a failed write.
+ * Records still in its ring are dropped, WriteOutput() and
+ * WriteOutputVector() fall back to the console.
+ *
+ */
+static void OutputChannelError(void *contextParam, char *errorParam)
+{
+  LogMsg(DBG_ERROR, "OutputChannelError() : Writing to the named pipe %s failed, output goes to the console from now on: %s", (char *)contextParam, errorParam);
+}
@@ -2,12 +2,20 @@
 
 #include <Windows.h>
 #include "Sniffer.h"
+#include "PacketCapture.h"
+#include "PacketView.h"
+#include "OutputChannel.h"
+
+#define MAX_OUTPUT_HEADER_LEN 128
 
 
 int ModeMinaryStart(PSCANPARAMS scanParamsParam);
+void SniffAndParseBatchCallback(unsigned char *scanParamsParam, PCAPTURE_BATCH batchParam);
 void SniffAndParseCallback(unsigned char *scanParamsParam, struct pcap_pkthdr *pcapHdrParam, unsigned char *packetDataParam);
 int WriteOutput(char *data, int dataLength);
-void HandleHttpTraffic(char *srcMacStrParam, PIPHDR ipHdrPtrParam, PTCPHDR tcpHdrPtrParam);
+int WriteOutputVector(POUTPUT_BUFFER buffersParam, int bufferCountParam);
+void HandleHttpTraffic(unsigned char *srcMacParam, unsigned char *packetParam, PPACKET_VIEW viewParam, uint64_t nowParam);
+int FormatOutputHeader(char *bufferParam, int bufferSizeParam, char *typeParam, unsigned char *srcMacParam, unsigned char *srcIpParam, unsigned short srcPortParam, unsigned char *dstIpParam, unsigned short dstPortParam);
 BOOL GetPcapDevice();
 int FilterException(int code, PEXCEPTION_POINTERS ex);
 u_char* ReadName(unsigned char* reader, unsigned char* buffer, int* count);
@@ -11,8 +11,6 @@
 #include <icmpapi.h>
 
 #include "Sniffer.h"
-#include "LinkedListSystems.h"
-#include "LinkedListConnections.h"
 #include "Logging.h"
 #include "NetworkFunctions.h"
 
@@ -0,0 +1,200 @@
+#include <string.h>
+#include <windows.h>
+
+#include "PayloadPool.h"
+
+
+typedef struct PAYLOAD_SLAB
+{
+  struct PAYLOAD_SLAB *Next;
+  PAYLOAD_CHUNK Chunks[PAYLOAD_POOL_SLAB_CHUNKS];
+} PAYLOAD_SLAB, *PPAYLOAD_SLAB;
+
+
+struct PAYLOAD_POOL
+{
+  PPAYLOAD_SLAB Slabs;
+  PPAYLOAD_CHUNK FreeChunks;
+  int MaxChunks;
+  PAYLOAD_POOL_STATS Stats;
+};
+
+
+static PPAYLOAD_CHUNK PayloadPoolGet(PPAYLOAD_POOL poolParam);
+
+
+PPAYLOAD_POOL PayloadPoolCreate(int maxChunksParam)
+{
+  PPAYLOAD_POOL pool = NULL;
+
+  if ((pool = (PPAYLOAD_POOL)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(PAYLOAD_POOL))) == NULL)
+  {
+    return NULL;
+  }
+
+  pool->MaxChunks = maxChunksParam;
+
+  return pool;
+}
+
+
+/*
+ * Ropes still holding chunks must not be
+ * used afterwards
+ *
+ */
+void PayloadPoolDestroy(PPAYLOAD_POOL poolParam)
+{
+  PPAYLOAD_SLAB slab = NULL;
+
+  if (poolParam == NULL)
+  {
+    return;
+  }
+
+  while ((slab = poolParam->Slabs) != NULL)
+  {
+    poolParam->Slabs = slab->Next;
+    HeapFree(GetProcessHeap(), 0, slab);
+  }
+
+  HeapFree(GetProcessHeap(), 0, poolParam);
+}
+
+
+void PayloadPoolGetStats(PPAYLOAD_POOL poolParam, PPAYLOAD_POOL_STATS statsParam)
+{
+  if (poolParam == NULL ||
+      statsParam == NULL)
+  {
+    return;
+  }
+
+  CopyMemory(statsParam, &poolParam->Stats, sizeof(PAYLOAD_POOL_STATS));
+}
+
+
+/*
+ * Free space at the end of the rope, a new chunk is linked if the
+ * last one is full. Returns NULL if the pool is exhausted. Whatever
+ * the caller writes there is added by PayloadRopeCommit().
+ *
+ */
+unsigned char *PayloadRopeReserve(PPAYLOAD_POOL poolParam, PPAYLOAD_ROPE ropeParam, unsigned int *spaceParam)
+{
+  PPAYLOAD_CHUNK chunk = NULL;
+
+  if (poolParam == NULL ||
+      ropeParam == NULL ||
+      spaceParam == NULL)
+  {
+    return NULL;
+  }
+
+  if (ropeParam->Tail == NULL ||
+      ropeParam->Tail->Length >= PAYLOAD_CHUNK_SIZE)
+  {
+    if ((chunk = PayloadPoolGet(poolParam)) == NULL)
+    {
+      return NULL;
+    }
+
+    if (ropeParam->Tail != NULL)
+    {
+      ropeParam->Tail->Next = chunk;
+    }
+    else
+    {
+      ropeParam->Head = chunk;
+    }
+
+    ropeParam->Tail = chunk;
+    ropeParam->ChunkCount++;
+  }
+
+  *spaceParam = PAYLOAD_CHUNK_SIZE - ropeParam->Tail->Length;
+
+  return ropeParam->Tail->Data + ropeParam->Tail->Length;
+}
+
+
+void PayloadRopeCommit(PPAYLOAD_ROPE ropeParam, unsigned int lengthParam)
+{
+  if (ropeParam == NULL ||
+      ropeParam->Tail == NULL ||
+      lengthParam > PAYLOAD_CHUNK_SIZE - ropeParam->Tail->Length)
+  {
+    return;
+  }
+
+  ropeParam->Tail->Length += lengthParam;
+  ropeParam->Length += lengthParam;
+}
+
+
+/*
+ * Hand all chunks back to the pool, the
+ * rope is empty afterwards
+ *
+ */
+void PayloadRopeRelease(PPAYLOAD_POOL poolParam, PPAYLOAD_ROPE ropeParam)
+{
+  if (poolParam == NULL ||
+      ropeParam == NULL ||
+      ropeParam->Head == NULL)
+  {
+    return;
+  }
+
+  ropeParam->Tail->Next = poolParam->FreeChunks;
+  poolParam->FreeChunks = ropeParam->Head;
+  poolParam->Stats.FreeChunks += ropeParam->ChunkCount;
+
+  ZeroMemory(ropeParam, sizeof(PAYLOAD_ROPE));
+}
+
+
+
+/*
+ * The most recently released chunk first, it is
+ * the most likely one to still be cached
+ *
+ */
+static PPAYLOAD_CHUNK PayloadPoolGet(PPAYLOAD_POOL poolParam)
+{
+  PPAYLOAD_SLAB slab = NULL;
+  PPAYLOAD_CHUNK chunk = NULL;
+  int counter = 0;
+
+  if (poolParam->FreeChunks == NULL)
+  {
+    if (poolParam->Stats.Chunks + PAYLOAD_POOL_SLAB_CHUNKS > poolParam->MaxChunks ||
+        (slab = (PPAYLOAD_SLAB)HeapAlloc(GetProcessHeap(), 0, sizeof(PAYLOAD_SLAB))) == NULL)
+    {
+      poolParam->Stats.Exhausted++;
+      return NULL;
+    }
+
+    slab->Next = poolParam->Slabs;
+    poolParam->Slabs = slab;
+
+    for (counter = PAYLOAD_POOL_SLAB_CHUNKS - 1; counter >= 0; counter--)
+    {
+      slab->Chunks[counter].Next = poolParam->FreeChunks;
+      poolParam->FreeChunks = &slab->Chunks[counter];
+    }
+
+    poolParam->Stats.Slabs++;
+    poolParam->Stats.Chunks += PAYLOAD_POOL_SLAB_CHUNKS;
+    poolParam->Stats.FreeChunks += PAYLOAD_POOL_SLAB_CHUNKS;
+  }
+
+  chunk = poolParam->FreeChunks;
+  poolParam->FreeChunks = chunk->Next;
+  poolParam->Stats.FreeChunks--;
+
+  chunk->Next = NULL;
+  chunk->Length = 0;
+
+  return chunk;
+}
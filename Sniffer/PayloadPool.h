@@ -0,0 +1,73 @@
+#ifndef __PAYLOADPOOL__
+#define __PAYLOADPOOL__
+
+#include <windows.h>
+#include <stdint.h>
+
+
+/*
+ * Pooled payload storage
+ *
+ * A connection's data is a rope: a chain of fixed size chunks.
+ * Appending fills the last chunk and links a new one when it is
+ * full, data already stored never moves. The chunks come from slabs
+ * of PAYLOAD_POOL_SLAB_CHUNKS, a released rope's chunks go back to
+ * the pool's free list and are reused before a new slab is
+ * allocated. Slabs are only freed with the pool.
+ *
+ * Not thread safe.
+ *
+ */
+#define PAYLOAD_CHUNK_SIZE 1024
+#define PAYLOAD_POOL_SLAB_CHUNKS 64
+#define PAYLOAD_POOL_MAX_CHUNKS 16384   // 16 MB of payload
+
+
+/*
+ * Type declarations.
+ *
+ */
+typedef struct PAYLOAD_CHUNK
+{
+  struct PAYLOAD_CHUNK *Next;
+  unsigned int Length;
+  unsigned char Data[PAYLOAD_CHUNK_SIZE];
+} PAYLOAD_CHUNK, *PPAYLOAD_CHUNK;
+
+
+// A zeroed rope is empty
+typedef struct
+{
+  PPAYLOAD_CHUNK Head;
+  PPAYLOAD_CHUNK Tail;
+  unsigned int Length;
+  int ChunkCount;
+} PAYLOAD_ROPE, *PPAYLOAD_ROPE;
+
+
+typedef struct
+{
+  int Slabs;
+  int Chunks;
+  int FreeChunks;
+  uint64_t Exhausted;   // Chunks refused because of the limit
+} PAYLOAD_POOL_STATS, *PPAYLOAD_POOL_STATS;
+
+
+// Opaque, see PayloadPool.c
+typedef struct PAYLOAD_POOL PAYLOAD_POOL, *PPAYLOAD_POOL;
+
+
+
+/*
+ * Function forward declarations.
+ *
+ */
+PPAYLOAD_POOL PayloadPoolCreate(int maxChunksParam);
+void PayloadPoolDestroy(PPAYLOAD_POOL poolParam);
+void PayloadPoolGetStats(PPAYLOAD_POOL poolParam, PPAYLOAD_POOL_STATS statsParam);
+unsigned char *PayloadRopeReserve(PPAYLOAD_POOL poolParam, PPAYLOAD_ROPE ropeParam, unsigned int *spaceParam);
+void PayloadRopeCommit(PPAYLOAD_ROPE ropeParam, unsigned int lengthParam);
+void PayloadRopeRelease(PPAYLOAD_POOL poolParam, PPAYLOAD_ROPE ropeParam);
+
+#endif
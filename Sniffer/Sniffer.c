@@ -8,8 +8,9 @@
 #include "Sniffer.h"
 #include "getopt.h"
 #include "Interface.h"
-#include "LinkedListConnections.h"
+#include "ConnectionTable.h"
 #include "Logging.h"
+#include "ModeBenchmark.h"
 #include "ModeGenericSniffer.h"
 #include "ModeMinary.h"
 
@@ -22,10 +23,8 @@
 extern char *optarg;
 
 
-CRITICAL_SECTION csSystemsLL;
 CRITICAL_SECTION gCSOutputPipe;
-CRITICAL_SECTION gCSConnectionsList;
-PCONNODE gConnectionList = NULL;
+PCONNECTION_TABLE gConnectionTable = NULL;
 
 int gDEBUGLEVEL = DEBUG_LEVEL;
 SCANPARAMS gScanParams;
@@ -39,11 +38,21 @@ int main(int argc, char* argv[])
   int retVal = 0;
   int opt = 0;
   int action = 0;
+  int loopCount = 1;
+  char *pcapFile = NULL;
+  char *benchmarkFilter = NULL;
+  char *httpFields = NULL;
+  char *outputPolicy = NULL;
+
+  if (InitLogging() == FALSE)
+  {
+    printf("main(): Logging initialization failed!");
+    exit(1);
+  }
 
   // Initialisation
-  if (!InitializeCriticalSectionAndSpinCount(&csSystemsLL, 0x00000400) ||
-      !InitializeCriticalSectionAndSpinCount(&gCSOutputPipe, 0x00000400) ||
-      !InitializeCriticalSectionAndSpinCount(&gCSConnectionsList, 0x00000400))
+  if (!InitializeCriticalSectionAndSpinCount(&gCSOutputPipe, 0x00000400) ||
+      (gConnectionTable = ConnectionTableCreate(CONNECTION_TABLE_CAPACITY)) == NULL)
   {
     retVal = 1;
     goto END;
@@ -52,10 +61,9 @@ int main(int argc, char* argv[])
   LogMsg(DBG_LOW, "main() : Starting %s", argv[0]);
   ZeroMemory(&gScanParams, sizeof(gScanParams));
   gARGV = argv;
-  gConnectionList = InitConnectionList();
 
   // Parse command line parameters
-  while ((opt = getopt(argc, argv, "lg:p:x:")) != -1)
+  while ((opt = getopt(argc, argv, "lg:p:x:b:mf:o:")) != -1)
   {
     switch (opt)
     {
@@ -75,6 +83,49 @@ int main(int argc, char* argv[])
         GetInterfaceDetails(optarg, &gScanParams);
         action = 'x';
         break;
+      case 'b':
+        pcapFile = optarg;
+        loopCount = argc >= 4 ? atoi(argv[3]) : 1;
+        action = 'b';
+        break;
+      case 'm':
+        benchmarkFilter = argc >= 3 ? argv[2] : NULL;
+        action = 'm';
+        break;
+      case 'f':
+        httpFields = optarg;
+        break;
+      case 'o':
+        outputPolicy = optarg;
+        break;
+    }
+  }
+
+  // HTTP header fields written out
+  if (httpFields != NULL &&
+      ConnectionTableSetHttpFields(gConnectionTable, httpFields) == FALSE)
+  {
+    printf("main(): Invalid HTTP header field list \"%s\"\n", httpFields);
+    retVal = 1;
+    goto END;
+  }
+
+  // Drop records or stall the capture while the pipe reader falls behind
+  if (outputPolicy != NULL)
+  {
+    if (strcmp(outputPolicy, "drop") == 0)
+    {
+      gScanParams.OutputPolicy = OUTPUT_POLICY_DROP;
+    }
+    else if (strcmp(outputPolicy, "block") == 0)
+    {
+      gScanParams.OutputPolicy = OUTPUT_POLICY_BLOCK;
+    }
+    else
+    {
+      printf("main(): Invalid output policy \"%s\"\n", outputPolicy);
+      retVal = 1;
+      goto END;
     }
   }
   
@@ -113,6 +164,26 @@ int main(int argc, char* argv[])
   else if (argc >= 3 && action == 'x')
   {
     ModeMinaryStart(&gScanParams);
+
+
+  //
+  // Replay benchmark
+  // -b datadump.pcap [loops]
+  //
+  }
+  else if (action == 'b')
+  {
+    retVal = ModeBenchmarkStart(&gScanParams, pcapFile, loopCount);
+
+
+  //
+  // Microbenchmarks
+  // -m [filter]
+  //
+  }
+  else if (action == 'm')
+  {
+    retVal = ModeMicroBenchmarkStart(benchmarkFilter);
   }
   else
   {
@@ -120,6 +191,8 @@ int main(int argc, char* argv[])
   }
 
 END:
+  ConnectionTableDestroy(gConnectionTable);
+  StopLogging();
 
   return 0;
 }
@@ -211,11 +284,14 @@ void PrintUsage(char *pAppName)
   printf("--------------------\n\n");
   printf("List all interfaces               :  %s -l\n", pAppName);
   printf("Start generic sniffer             :  %s -g IFC-Name\n", pAppName);
-  printf("Start Minary sniffer              :  %s -x IFC-Name [-p PIPE_NAME] \n", pAppName);
+  printf("Start Minary sniffer              :  %s -x IFC-Name [-p PIPE_NAME] [-o drop|block] [-f FIELD,...]\n", pAppName);
+  printf("Benchmark the packet handlers     :  %s -b datadump.pcap [loops]\n", pAppName);
+  printf("Microbenchmark the primitives     :  %s -m [filter]\n", pAppName);
   printf("\n\n\n\nExamples\n--------\n\n");
   printf("Example : %s -l\n", pAppName);
   printf("Example : %s -x 0F716AAF-D4A7-ACBA-1234-EA45A939F624\n", pAppName);
-  printf("Example : %s -x 0F716AAF-D4A7-ACBA-1234-EA45A939F624\n\n\n\n\n", pAppName);
+  printf("Example : %s -x 0F716AAF-D4A7-ACBA-1234-EA45A939F624 -f Host,Cookie,Authorization\n", pAppName);
+  printf("Example : %s -x 0F716AAF-D4A7-ACBA-1234-EA45A939F624 -p Minary -o block\n\n\n\n\n", pAppName);
   printf("WinPcap version\n---------------\n\n");
   printf("%s\n\n", pcap_lib_version());
 }
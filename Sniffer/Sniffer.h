@@ -4,7 +4,7 @@
 #include <windows.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include "NetBase.h"
+#include "NetworkStructs.h"
 
 
 #define SNIFFER_VERSION "0.1"
@@ -15,9 +15,7 @@
 #define MAX_ID_LEN 128
 #define MAX_PAYLOAD 1460
 #define MAX_CONNECTION_VOLUME 4096
-#define MAX_CONNECTION_COUNT 1024
 
-#define MAX_SYSTEMS_COUNT 1024
 #define MAX_ARP_SCAN_ROUNDS 5
 
 #define MAX_BUF_SIZE 1024
@@ -39,18 +37,6 @@
  * Type definitions
  *
  */
-typedef struct
-{
-  unsigned char sysIpStr[MAX_IP_LEN + 1];
-  unsigned char sysIpBin[BIN_IP_LEN];
-  unsigned char sysMacBin[BIN_MAC_LEN];
-  unsigned char srcIpStr[MAX_IP_LEN + 1];
-  unsigned char dstIpStr[MAX_IP_LEN + 1];
-  unsigned short srcPort;
-  unsigned short dstPort;
-} SYSTEMNODE, *PSYSTEMNODE, **PPSYSTEMNODE;
-
-
 typedef struct SCANPARAMS
 {
   unsigned char IfcName[MAX_BUF_SIZE + 1];
@@ -71,6 +57,7 @@ typedef struct SCANPARAMS
   unsigned char LocalMACStr[MAX_MAC_LEN];
   unsigned char *PcapPattern;
   unsigned char OutputPipeName[MAX_BUF_SIZE + 1];
+  int OutputPolicy;     // OUTPUT_POLICY_..., what to do when the pipe falls behind
   HANDLE PipeHandle;
   void *IfcReadHandle;  // HACK! because of header hell :/
   void *IfcWriteHandle; // HACK! because of header hell :/
@@ -0,0 +1,499 @@
+#include <string.h>
+#include <windows.h>
+
+#include "PacketView.h"
+#include "TcpReassembly.h"
+
+
+#define TCP_SEQ_LT(a, b) ((int32_t)((a) - (b)) < 0)
+#define TCP_SEQ_GT(a, b) ((int32_t)((a) - (b)) > 0)
+
+
+struct TCP_REASSEMBLY
+{
+  TCP_STREAM_HANDLER Handler;
+  void *Context;
+  unsigned int MaxBuffered;
+  PTCP_STREAM PendingHead;
+  PTCP_STREAM PendingTail;
+  TCP_REASSEMBLY_STATS Stats;
+};
+
+
+static void TcpStreamData(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, uint32_t seqParam, unsigned char *dataParam, unsigned int lengthParam);
+static void TcpStreamDeliver(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, unsigned char *dataParam, unsigned int lengthParam);
+static void TcpStreamDeliverQueued(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam);
+static void TcpStreamQueue(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, uint32_t seqParam, unsigned char *dataParam, unsigned int lengthParam);
+static void TcpStreamSkipHole(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam);
+static void TcpStreamLose(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, unsigned int lengthParam);
+static void TcpStreamFreeSegment(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, PTCP_SEGMENT segmentParam);
+static void TcpStreamPendingUnlink(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam);
+
+
+PTCP_REASSEMBLY TcpReassemblyCreate(unsigned int maxBufferedParam, TCP_STREAM_HANDLER handlerParam, void *contextParam)
+{
+  PTCP_REASSEMBLY reassembly = NULL;
+
+  if (handlerParam == NULL ||
+      (reassembly = (PTCP_REASSEMBLY)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TCP_REASSEMBLY))) == NULL)
+  {
+    return NULL;
+  }
+
+  reassembly->Handler = handlerParam;
+  reassembly->Context = contextParam;
+  reassembly->MaxBuffered = maxBufferedParam;
+
+  return reassembly;
+}
+
+
+/*
+ * The streams must have been released
+ *
+ */
+void TcpReassemblyDestroy(PTCP_REASSEMBLY reassemblyParam)
+{
+  if (reassemblyParam == NULL)
+  {
+    return;
+  }
+
+  HeapFree(GetProcessHeap(), 0, reassemblyParam);
+}
+
+
+void TcpReassemblyGetStats(PTCP_REASSEMBLY reassemblyParam, PTCP_REASSEMBLY_STATS statsParam)
+{
+  if (reassemblyParam == NULL ||
+      statsParam == NULL)
+  {
+    return;
+  }
+
+  CopyMemory(statsParam, &reassemblyParam->Stats, sizeof(TCP_REASSEMBLY_STATS));
+}
+
+
+void TcpStreamInit(PTCP_STREAM streamParam, void *ownerParam)
+{
+  if (streamParam == NULL)
+  {
+    return;
+  }
+
+  ZeroMemory(streamParam, sizeof(TCP_STREAM));
+  streamParam->Owner = ownerParam;
+}
+
+
+/*
+ * seqParam in host byte order, tcpFlagsParam the PV_TCP_* bits
+ * of the segment. lengthParam is the segment length announced
+ * by the IP header, the first capturedParam bytes of it are in
+ * dataParam. The rest was cut off by the snap length and is
+ * handed over as lost once the stream gets to it.
+ *
+ */
+void TcpStreamSegment(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, uint32_t seqParam, unsigned char tcpFlagsParam, unsigned char *dataParam, unsigned int capturedParam, unsigned int lengthParam)
+{
+  uint32_t capturedEnd = 0;
+  uint32_t segmentEnd = 0;
+
+  if (reassemblyParam == NULL ||
+      streamParam == NULL)
+  {
+    return;
+  }
+
+  // A new SYN starts the stream over, a
+  // retransmitted one changes nothing
+  if (tcpFlagsParam & PV_TCP_SYN)
+  {
+    if (streamParam->Synchronized == FALSE ||
+        streamParam->Isn != seqParam)
+    {
+      TcpStreamRelease(reassemblyParam, streamParam);
+      streamParam->Synchronized = TRUE;
+      streamParam->Isn = seqParam;
+      streamParam->NextSeq = seqParam + 1;
+    }
+
+    seqParam++;
+  }
+
+  if (lengthParam == 0)
+  {
+    return;
+  }
+
+  if (dataParam == NULL)
+  {
+    capturedParam = 0;
+  }
+
+  capturedParam = capturedParam < lengthParam ? capturedParam : lengthParam;
+
+  if (streamParam->Synchronized == FALSE)
+  {
+    streamParam->Synchronized = TRUE;
+    streamParam->Isn = seqParam - 1;
+    streamParam->NextSeq = seqParam;
+  }
+
+  capturedEnd = seqParam + capturedParam;
+  segmentEnd = seqParam + lengthParam;
+
+  if (capturedParam > 0)
+  {
+    TcpStreamData(reassemblyParam, streamParam, seqParam, dataParam, capturedParam);
+  }
+
+  // The stream got up to the part that wasn't captured
+  if (TCP_SEQ_LT(streamParam->NextSeq, capturedEnd) == FALSE &&
+      TCP_SEQ_LT(streamParam->NextSeq, segmentEnd))
+  {
+    TcpStreamLose(reassemblyParam, streamParam, segmentEnd - streamParam->NextSeq);
+  }
+}
+
+
+/*
+ * Hand over everything queued, holes included. The stream
+ * continues after the last queued byte.
+ *
+ */
+void TcpStreamFlush(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam)
+{
+  if (reassemblyParam == NULL ||
+      streamParam == NULL)
+  {
+    return;
+  }
+
+  while (streamParam->Segments != NULL)
+  {
+    TcpStreamSkipHole(reassemblyParam, streamParam);
+  }
+}
+
+
+/*
+ * Drop the queued segments without handing them over
+ *
+ */
+void TcpStreamRelease(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam)
+{
+  PTCP_SEGMENT segment = NULL;
+
+  if (reassemblyParam == NULL ||
+      streamParam == NULL)
+  {
+    return;
+  }
+
+  while ((segment = streamParam->Segments) != NULL)
+  {
+    streamParam->Segments = segment->Next;
+    TcpStreamFreeSegment(reassemblyParam, streamParam, segment);
+  }
+
+  TcpStreamPendingUnlink(reassemblyParam, streamParam);
+}
+
+
+
+/*
+ * Captured bytes of a segment: delivered if they are next,
+ * queued if they are ahead
+ *
+ */
+static void TcpStreamData(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, uint32_t seqParam, unsigned char *dataParam, unsigned int lengthParam)
+{
+  unsigned int overlap = 0;
+  unsigned int pieceLength = 0;
+
+  // Cut off what was delivered already
+  if (TCP_SEQ_LT(seqParam, streamParam->NextSeq))
+  {
+    if ((overlap = streamParam->NextSeq - seqParam) >= lengthParam)
+    {
+      reassemblyParam->Stats.DuplicateBytes += lengthParam;
+      return;
+    }
+
+    reassemblyParam->Stats.DuplicateBytes += overlap;
+    seqParam += overlap;
+    dataParam += overlap;
+    lengthParam -= overlap;
+  }
+
+  // In order. Only the holes in front of and between the
+  // queued segments are taken from it, the queued bytes
+  // were received first.
+  while (seqParam == streamParam->NextSeq)
+  {
+    pieceLength = lengthParam;
+
+    if (streamParam->Segments != NULL &&
+        TCP_SEQ_LT(streamParam->Segments->Seq, seqParam + lengthParam))
+    {
+      pieceLength = streamParam->Segments->Seq - seqParam;
+    }
+
+    TcpStreamDeliver(reassemblyParam, streamParam, dataParam, pieceLength);
+    TcpStreamDeliverQueued(reassemblyParam, streamParam);
+
+    if ((overlap = streamParam->NextSeq - seqParam) >= lengthParam)
+    {
+      reassemblyParam->Stats.DuplicateBytes += lengthParam - pieceLength;
+      return;
+    }
+
+    reassemblyParam->Stats.DuplicateBytes += overlap - pieceLength;
+    seqParam += overlap;
+    dataParam += overlap;
+    lengthParam -= overlap;
+  }
+
+  if (seqParam - streamParam->NextSeq > TCP_STREAM_MAX_WINDOW)
+  {
+    reassemblyParam->Stats.DroppedSegments++;
+    return;
+  }
+
+  TcpStreamQueue(reassemblyParam, streamParam, seqParam, dataParam, lengthParam);
+
+  while (streamParam->SegmentCount > TCP_STREAM_MAX_SEGMENTS ||
+         streamParam->BufferedBytes > TCP_STREAM_MAX_BUFFERED)
+  {
+    reassemblyParam->Stats.Evictions++;
+    TcpStreamSkipHole(reassemblyParam, streamParam);
+  }
+
+  while (reassemblyParam->Stats.BufferedBytes > reassemblyParam->MaxBuffered &&
+         reassemblyParam->PendingHead != NULL)
+  {
+    reassemblyParam->Stats.Evictions++;
+    TcpStreamSkipHole(reassemblyParam, reassemblyParam->PendingHead);
+  }
+}
+
+
+static void TcpStreamDeliver(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, unsigned char *dataParam, unsigned int lengthParam)
+{
+  streamParam->NextSeq += lengthParam;
+  reassemblyParam->Stats.DeliveredBytes += lengthParam;
+  reassemblyParam->Handler(reassemblyParam->Context, streamParam->Owner, dataParam, lengthParam);
+}
+
+
+/*
+ * Hand over the queued segments the
+ * stream has caught up with
+ *
+ */
+static void TcpStreamDeliverQueued(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam)
+{
+  PTCP_SEGMENT segment = NULL;
+  unsigned int offset = 0;
+
+  while ((segment = streamParam->Segments) != NULL &&
+         TCP_SEQ_GT(segment->Seq, streamParam->NextSeq) == FALSE)
+  {
+    streamParam->Segments = segment->Next;
+    offset = streamParam->NextSeq - segment->Seq;
+
+    if (offset < segment->Length)
+    {
+      reassemblyParam->Stats.DuplicateBytes += offset;
+      TcpStreamDeliver(reassemblyParam, streamParam, segment->Data + offset, segment->Length - offset);
+    }
+    else
+    {
+      reassemblyParam->Stats.DuplicateBytes += segment->Length;
+    }
+
+    TcpStreamFreeSegment(reassemblyParam, streamParam, segment);
+  }
+
+  if (streamParam->Segments == NULL)
+  {
+    TcpStreamPendingUnlink(reassemblyParam, streamParam);
+  }
+}
+
+
+/*
+ * Copy the parts of the segment that fill holes
+ * between the queued ones
+ *
+ */
+static void TcpStreamQueue(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, uint32_t seqParam, unsigned char *dataParam, unsigned int lengthParam)
+{
+  PTCP_SEGMENT *segmentRef = &streamParam->Segments;
+  PTCP_SEGMENT segment = NULL;
+  unsigned int pieceLength = 0;
+  BOOL queued = FALSE;
+
+  while (lengthParam > 0)
+  {
+    segment = *segmentRef;
+
+    // Queued segment starting at or before the data, skip
+    // whatever of the data it covers
+    if (segment != NULL &&
+        TCP_SEQ_GT(segment->Seq, seqParam) == FALSE)
+    {
+      if (TCP_SEQ_GT(segment->Seq + segment->Length, seqParam))
+      {
+        pieceLength = segment->Seq + segment->Length - seqParam;
+        pieceLength = pieceLength < lengthParam ? pieceLength : lengthParam;
+        reassemblyParam->Stats.DuplicateBytes += pieceLength;
+        seqParam += pieceLength;
+        dataParam += pieceLength;
+        lengthParam -= pieceLength;
+      }
+
+      segmentRef = &segment->Next;
+      continue;
+    }
+
+    // The hole up to the next queued segment
+    pieceLength = lengthParam;
+
+    if (segment != NULL &&
+        TCP_SEQ_LT(segment->Seq, seqParam + lengthParam))
+    {
+      pieceLength = segment->Seq - seqParam;
+    }
+
+    if ((*segmentRef = (PTCP_SEGMENT)HeapAlloc(GetProcessHeap(), 0, sizeof(TCP_SEGMENT) + pieceLength)) == NULL)
+    {
+      *segmentRef = segment;
+      reassemblyParam->Stats.DroppedSegments++;
+      break;
+    }
+
+    (*segmentRef)->Next = segment;
+    (*segmentRef)->Seq = seqParam;
+    (*segmentRef)->Length = pieceLength;
+    CopyMemory((*segmentRef)->Data, dataParam, pieceLength);
+
+    streamParam->SegmentCount++;
+    streamParam->BufferedBytes += pieceLength;
+    reassemblyParam->Stats.BufferedBytes += pieceLength;
+    queued = TRUE;
+
+    segmentRef = &(*segmentRef)->Next;
+    seqParam += pieceLength;
+    dataParam += pieceLength;
+    lengthParam -= pieceLength;
+  }
+
+  if (queued == FALSE)
+  {
+    return;
+  }
+
+  reassemblyParam->Stats.OutOfOrderSegments++;
+
+  // Newly waiting, to the end of the line
+  if (streamParam->PendingPrev == NULL &&
+      reassemblyParam->PendingHead != streamParam)
+  {
+    streamParam->PendingNext = NULL;
+    streamParam->PendingPrev = reassemblyParam->PendingTail;
+
+    if (reassemblyParam->PendingTail != NULL)
+    {
+      reassemblyParam->PendingTail->PendingNext = streamParam;
+    }
+    else
+    {
+      reassemblyParam->PendingHead = streamParam;
+    }
+
+    reassemblyParam->PendingTail = streamParam;
+  }
+}
+
+
+/*
+ * Give up on the bytes missing before the
+ * first queued segment
+ *
+ */
+static void TcpStreamSkipHole(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam)
+{
+  unsigned int holeLength = 0;
+
+  if (streamParam->Segments == NULL)
+  {
+    return;
+  }
+
+  if ((holeLength = streamParam->Segments->Seq - streamParam->NextSeq) > 0)
+  {
+    TcpStreamLose(reassemblyParam, streamParam, holeLength);
+  }
+  else
+  {
+    TcpStreamDeliverQueued(reassemblyParam, streamParam);
+  }
+}
+
+
+/*
+ * Skip the next lengthParam bytes of the stream and
+ * hand over what was queued behind them
+ *
+ */
+static void TcpStreamLose(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, unsigned int lengthParam)
+{
+  reassemblyParam->Stats.Gaps++;
+  reassemblyParam->Stats.GapBytes += lengthParam;
+  streamParam->NextSeq += lengthParam;
+  reassemblyParam->Handler(reassemblyParam->Context, streamParam->Owner, NULL, lengthParam);
+  TcpStreamDeliverQueued(reassemblyParam, streamParam);
+}
+
+
+static void TcpStreamFreeSegment(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, PTCP_SEGMENT segmentParam)
+{
+  streamParam->SegmentCount--;
+  streamParam->BufferedBytes -= segmentParam->Length;
+  reassemblyParam->Stats.BufferedBytes -= segmentParam->Length;
+  HeapFree(GetProcessHeap(), 0, segmentParam);
+}
+
+
+static void TcpStreamPendingUnlink(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam)
+{
+  if (streamParam->PendingPrev == NULL &&
+      reassemblyParam->PendingHead != streamParam)
+  {
+    return;
+  }
+
+  if (streamParam->PendingPrev != NULL)
+  {
+    streamParam->PendingPrev->PendingNext = streamParam->PendingNext;
+  }
+  else
+  {
+    reassemblyParam->PendingHead = streamParam->PendingNext;
+  }
+
+  if (streamParam->PendingNext != NULL)
+  {
+    streamParam->PendingNext->PendingPrev = streamParam->PendingPrev;
+  }
+  else
+  {
+    reassemblyParam->PendingTail = streamParam->PendingPrev;
+  }
+
+  streamParam->PendingNext = NULL;
+  streamParam->PendingPrev = NULL;
+}
@@ -0,0 +1,101 @@
+#ifndef __TCPREASSEMBLY__
+#define __TCPREASSEMBLY__
+
+#include <windows.h>
+#include <stdint.h>
+
+
+/*
+ * TCP stream reassembly
+ *
+ * A TCP_STREAM follows one direction of a connection. The SYN sets
+ * the initial sequence number, a stream picked up in the middle
+ * starts at its first data segment. The handler gets every byte of
+ * the stream once and in order. Retransmitted bytes are dropped.
+ * Segments ahead of the next expected byte wait in a sorted list
+ * of non overlapping intervals until the hole before them is filled.
+ * Where a later segment, in order or not, overlaps queued data, the
+ * data received first wins.
+ *
+ * In order data is handed over straight from the packet, only out
+ * of order segments are copied. Bytes a short snap length cut off
+ * are reported as missing once the stream reaches them in order.
+ *
+ * Buffering is capped. A stream holding more than
+ * TCP_STREAM_MAX_SEGMENTS segments or TCP_STREAM_MAX_BUFFERED bytes
+ * gives up on its first hole. So does the stream waiting longest
+ * once all streams together hold more than the reassembly's limit.
+ * The handler is then told how many bytes are missing, followed by
+ * the data behind the hole.
+ *
+ * Not thread safe.
+ *
+ */
+#define TCP_STREAM_MAX_SEGMENTS 64
+#define TCP_STREAM_MAX_BUFFERED (64 * 1024)
+#define TCP_STREAM_MAX_WINDOW (1024 * 1024)   // Segments further ahead are dropped
+#define TCP_REASSEMBLY_MAX_BUFFERED (8 * 1024 * 1024)
+
+
+/*
+ * Type declarations.
+ *
+ */
+typedef struct TCP_SEGMENT
+{
+  struct TCP_SEGMENT *Next;
+  uint32_t Seq;
+  unsigned int Length;
+  unsigned char Data[1];
+} TCP_SEGMENT, *PTCP_SEGMENT;
+
+
+typedef struct TCP_STREAM
+{
+  void *Owner;                      // Passed to the handler
+  BOOL Synchronized;
+  uint32_t Isn;
+  uint32_t NextSeq;
+  PTCP_SEGMENT Segments;            // Out of order, sorted by Seq
+  int SegmentCount;
+  unsigned int BufferedBytes;
+  struct TCP_STREAM *PendingNext;   // Streams with queued segments,
+  struct TCP_STREAM *PendingPrev;   // the one waiting longest first
+} TCP_STREAM, *PTCP_STREAM;
+
+
+// dataParam is NULL if lengthParam bytes of the stream are lost
+typedef void(*TCP_STREAM_HANDLER)(void *contextParam, void *ownerParam, unsigned char *dataParam, unsigned int lengthParam);
+
+
+typedef struct
+{
+  uint64_t DeliveredBytes;
+  uint64_t DuplicateBytes;          // Delivered or queued already
+  uint64_t OutOfOrderSegments;
+  uint64_t DroppedSegments;         // Beyond TCP_STREAM_MAX_WINDOW
+  uint64_t Gaps;
+  uint64_t GapBytes;
+  uint64_t Evictions;               // Holes given up because of the caps
+  unsigned int BufferedBytes;
+} TCP_REASSEMBLY_STATS, *PTCP_REASSEMBLY_STATS;
+
+
+// Opaque, see TcpReassembly.c
+typedef struct TCP_REASSEMBLY TCP_REASSEMBLY, *PTCP_REASSEMBLY;
+
+
+
+/*
+ * Function forward declarations.
+ *
+ */
+PTCP_REASSEMBLY TcpReassemblyCreate(unsigned int maxBufferedParam, TCP_STREAM_HANDLER handlerParam, void *contextParam);
+void TcpReassemblyDestroy(PTCP_REASSEMBLY reassemblyParam);
+void TcpReassemblyGetStats(PTCP_REASSEMBLY reassemblyParam, PTCP_REASSEMBLY_STATS statsParam);
+void TcpStreamInit(PTCP_STREAM streamParam, void *ownerParam);
+void TcpStreamSegment(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam, uint32_t seqParam, unsigned char tcpFlagsParam, unsigned char *dataParam, unsigned int capturedParam, unsigned int lengthParam);
+void TcpStreamFlush(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam);
+void TcpStreamRelease(PTCP_REASSEMBLY reassemblyParam, PTCP_STREAM streamParam);
+
+#endif
@@ -0,0 +1,680 @@
+#include <stdio.h>
+
+#include "Checksum.h"
+#include "FlowGenerator.h"
+
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_PSH 0x08
+#define TCP_FLAG_ACK 0x10
+
+#define MIN_FRAME_SIZE 60
+#define TCP_MSS_OPTION_LEN 4
+#define BASE_TIMESTAMP_SEC 1500000000ULL
+#define FIRST_CLIENT_PORT 1024
+
+
+static uint64_t RandomNext(PFLOW_GENERATOR generatorParam);
+static unsigned int RandomRange(PFLOW_GENERATOR generatorParam, unsigned int rangeParam);
+static void FlowStart(PFLOW_GENERATOR generatorParam, PFLOW flowParam);
+static unsigned int FlowNextSegmentSize(PFLOW_GENERATOR generatorParam);
+static unsigned int FlowStepTcp(PFLOW_GENERATOR generatorParam, PFLOW flowParam, unsigned char *frameParam);
+static unsigned int FlowStepDns(PFLOW_GENERATOR generatorParam, PFLOW flowParam, unsigned char *frameParam);
+static unsigned int FlowServerData(PFLOW_GENERATOR generatorParam, PFLOW flowParam, unsigned char *frameParam);
+static unsigned int FlowRequest(PFLOW_GENERATOR generatorParam, PFLOW flowParam, unsigned char *frameParam);
+static void FillStreamData(PFLOW flowParam, uint32_t seqParam, unsigned char *bufferParam, unsigned int lengthParam);
+static unsigned int BuildTcpFrame(PFLOW_GENERATOR generatorParam, PFLOW flowParam, BOOL fromClientParam, uint32_t seqParam, uint32_t ackParam, unsigned char flagsParam, unsigned char *frameParam, unsigned int payloadLengthParam);
+static unsigned int BuildUdpFrame(PFLOW_GENERATOR generatorParam, PFLOW flowParam, BOOL fromClientParam, unsigned char *frameParam, unsigned int payloadLengthParam);
+static unsigned int BuildEthIpHeader(PFLOW_GENERATOR generatorParam, PFLOW flowParam, BOOL fromClientParam, unsigned char protoParam, unsigned char *frameParam, unsigned int l4LengthParam);
+static unsigned int BuildDnsMessage(PFLOW flowParam, BOOL responseParam, unsigned char *bufferParam);
+static void Write16(unsigned char *bufferParam, unsigned short valueParam);
+static void Write32(unsigned char *bufferParam, uint32_t valueParam);
+
+
+
+BOOL FlowGeneratorInit(PFLOW_GENERATOR generatorParam, PTRAFFIC_PROFILE profileParam)
+{
+  BOOL retVal = FALSE;
+  unsigned int counter = 0;
+
+  ZeroMemory(generatorParam, sizeof(FLOW_GENERATOR));
+  generatorParam->Profile = profileParam;
+  generatorParam->TimestampNs = BASE_TIMESTAMP_SEC * 1000000000ULL;
+  generatorParam->NextClientPort = FIRST_CLIENT_PORT;
+
+  // splitmix64 scrambling, xorshift must not start at 0
+  generatorParam->RandomState = profileParam->Seed + 0x9e3779b97f4a7c15ULL;
+  generatorParam->RandomState = (generatorParam->RandomState ^ (generatorParam->RandomState >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  generatorParam->RandomState = (generatorParam->RandomState ^ (generatorParam->RandomState >> 27)) * 0x94d049bb133111ebULL;
+  generatorParam->RandomState ^= generatorParam->RandomState >> 31;
+  if (generatorParam->RandomState == 0)
+  {
+    generatorParam->RandomState = 0x9e3779b97f4a7c15ULL;
+  }
+
+  if ((generatorParam->Flows = (PFLOW)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(FLOW) * profileParam->FlowCount)) == NULL)
+  {
+    goto END;
+  }
+
+  for (counter = 0; counter < profileParam->FlowCount; counter++)
+  {
+    FlowStart(generatorParam, &generatorParam->Flows[counter]);
+  }
+
+  retVal = TRUE;
+
+END:
+
+  return retVal;
+}
+
+
+/*
+ * Build the next frame of the corpus into frameParam (at least
+ * MAX_FRAME_SIZE bytes). Returns the frame length.
+ *
+ */
+unsigned int FlowGeneratorNextFrame(PFLOW_GENERATOR generatorParam, unsigned char *frameParam, uint64_t *timestampUsParam)
+{
+  PFLOW flow = NULL;
+  unsigned int retVal = 0;
+
+  while (retVal == 0)
+  {
+    flow = &generatorParam->Flows[RandomRange(generatorParam, generatorParam->Profile->FlowCount)];
+
+    if (flow->State == FLOW_STATE_DONE)
+    {
+      FlowStart(generatorParam, flow);
+    }
+
+    if (flow->Type == FLOW_TYPE_DNS)
+    {
+      retVal = FlowStepDns(generatorParam, flow, frameParam);
+    }
+    else
+    {
+      retVal = FlowStepTcp(generatorParam, flow, frameParam);
+    }
+  }
+
+  // Runts are padded on the wire. The IP total length excludes the padding.
+  if (retVal < MIN_FRAME_SIZE)
+  {
+    ZeroMemory(frameParam + retVal, MIN_FRAME_SIZE - retVal);
+    retVal = MIN_FRAME_SIZE;
+  }
+
+  *timestampUsParam = generatorParam->TimestampNs / 1000;
+  generatorParam->TimestampNs += 1000000000ULL / generatorParam->Profile->PacketsPerSecond;
+
+  return retVal;
+}
+
+
+void FlowGeneratorRelease(PFLOW_GENERATOR generatorParam)
+{
+  if (generatorParam->Flows != NULL)
+  {
+    HeapFree(GetProcessHeap(), 0, generatorParam->Flows);
+    generatorParam->Flows = NULL;
+  }
+}
+
+
+/*
+ * Client n lives at 192.168.(n / 253).(n % 253 + 2), .0, .1 and .255
+ * of every /24 are left out. The MAC embeds the IP address.
+ *
+ */
+void FlowGeneratorClientAddress(unsigned int clientIndexParam, unsigned char ipParam[BIN_IP_LEN], unsigned char macParam[BIN_MAC_LEN])
+{
+  ipParam[0] = 192;
+  ipParam[1] = 168;
+  ipParam[2] = (unsigned char)(clientIndexParam / 253);
+  ipParam[3] = (unsigned char)(clientIndexParam % 253 + 2);
+
+  macParam[0] = 0x02;
+  macParam[1] = 0x00;
+  CopyMemory(&macParam[2], ipParam, BIN_IP_LEN);
+}
+
+
+
+/*
+ * Flow life cycle
+ *
+ */
+static void FlowStart(PFLOW_GENERATOR generatorParam, PFLOW flowParam)
+{
+  PTRAFFIC_PROFILE profile = generatorParam->Profile;
+  unsigned int mixValue = 0;
+  unsigned int serverIndex = 0;
+
+  ZeroMemory(flowParam, sizeof(FLOW));
+  generatorParam->FlowsStarted++;
+
+  mixValue = RandomRange(generatorParam, profile->MixHttp + profile->MixDns + profile->MixTls);
+  if (mixValue < profile->MixHttp)
+  {
+    flowParam->Type = FLOW_TYPE_HTTP;
+    flowParam->ServerPort = 80;
+  }
+  else if (mixValue < profile->MixHttp + profile->MixDns)
+  {
+    flowParam->Type = FLOW_TYPE_DNS;
+    flowParam->ServerPort = UDP_DNS;
+  }
+  else
+  {
+    flowParam->Type = FLOW_TYPE_TLS;
+    flowParam->ServerPort = 443;
+  }
+
+  FlowGeneratorClientAddress(RandomRange(generatorParam, profile->ClientCount), flowParam->ClientIpBin, flowParam->ClientMacBin);
+
+  // Servers live in the benchmarking range 198.18.0.0/15
+  serverIndex = RandomRange(generatorParam, profile->ServerCount);
+  flowParam->ServerIpBin[0] = 198;
+  flowParam->ServerIpBin[1] = (unsigned char)(18 + (serverIndex >> 16));
+  flowParam->ServerIpBin[2] = (unsigned char)(serverIndex >> 8);
+  flowParam->ServerIpBin[3] = (unsigned char)serverIndex;
+
+  flowParam->ClientPort = generatorParam->NextClientPort;
+  generatorParam->NextClientPort = generatorParam->NextClientPort == 0xffff ? FIRST_CLIENT_PORT : generatorParam->NextClientPort + 1;
+
+  flowParam->HostId = RandomRange(generatorParam, profile->ServerCount);
+  flowParam->DnsId = (unsigned short)RandomNext(generatorParam);
+  flowParam->ClientSeq = (uint32_t)RandomNext(generatorParam);
+  flowParam->ServerSeq = (uint32_t)RandomNext(generatorParam);
+
+  if (flowParam->Type == FLOW_TYPE_DNS)
+  {
+    flowParam->State = FLOW_STATE_DNS_QUERY;
+  }
+  else
+  {
+    flowParam->State = FLOW_STATE_SYN;
+    flowParam->LongLived = RandomRange(generatorParam, 100) < profile->LongLivedPercent ? TRUE : FALSE;
+  }
+}
+
+
+static unsigned int FlowStepTcp(PFLOW_GENERATOR generatorParam, PFLOW flowParam, unsigned char *frameParam)
+{
+  unsigned int retVal = 0;
+
+  switch (flowParam->State)
+  {
+    case FLOW_STATE_SYN:
+      retVal = BuildTcpFrame(generatorParam, flowParam, TRUE, flowParam->ClientSeq, 0, TCP_FLAG_SYN, frameParam, 0);
+      flowParam->ClientSeq++;
+      flowParam->State = FLOW_STATE_SYNACK;
+      break;
+
+    case FLOW_STATE_SYNACK:
+      retVal = BuildTcpFrame(generatorParam, flowParam, FALSE, flowParam->ServerSeq, flowParam->ClientSeq, TCP_FLAG_SYN | TCP_FLAG_ACK, frameParam, 0);
+      flowParam->ServerSeq++;
+      flowParam->State = FLOW_STATE_ACK;
+      break;
+
+    case FLOW_STATE_ACK:
+      retVal = BuildTcpFrame(generatorParam, flowParam, TRUE, flowParam->ClientSeq, flowParam->ServerSeq, TCP_FLAG_ACK, frameParam, 0);
+      flowParam->State = FLOW_STATE_REQUEST;
+      break;
+
+    case FLOW_STATE_REQUEST:
+      retVal = FlowRequest(generatorParam, flowParam, frameParam);
+      flowParam->State = FLOW_STATE_DATA;
+      break;
+
+    case FLOW_STATE_DATA:
+      retVal = FlowServerData(generatorParam, flowParam, frameParam);
+      break;
+
+    case FLOW_STATE_FIN:
+      retVal = BuildTcpFrame(generatorParam, flowParam, FALSE, flowParam->ServerSeq, flowParam->ClientSeq, TCP_FLAG_FIN | TCP_FLAG_ACK, frameParam, 0);
+      flowParam->ServerSeq++;
+      flowParam->State = FLOW_STATE_FINACK;
+      break;
+
+    case FLOW_STATE_FINACK:
+      retVal = BuildTcpFrame(generatorParam, flowParam, TRUE, flowParam->ClientSeq, flowParam->ServerSeq, TCP_FLAG_FIN | TCP_FLAG_ACK, frameParam, 0);
+      flowParam->ClientSeq++;
+      flowParam->State = FLOW_STATE_LASTACK;
+      break;
+
+    case FLOW_STATE_LASTACK:
+      retVal = BuildTcpFrame(generatorParam, flowParam, FALSE, flowParam->ServerSeq, flowParam->ClientSeq, TCP_FLAG_ACK, frameParam, 0);
+      flowParam->State = FLOW_STATE_DONE;
+      break;
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Client request. The first one of a TLS flow is a ClientHello,
+ * later ones (long-lived flows only) are application data records.
+ *
+ */
+static unsigned int FlowRequest(PFLOW_GENERATOR generatorParam, PFLOW flowParam, unsigned char *frameParam)
+{
+  unsigned char *payload = frameParam + sizeof(ETHDR) + sizeof(IPHDR) + sizeof(TCPHDR);
+  unsigned int payloadLength = 0;
+  unsigned int retVal = 0;
+
+  if (flowParam->Type == FLOW_TYPE_HTTP)
+  {
+    payloadLength = (unsigned int)_snprintf((char *)payload, MAX_TCP_PAYLOAD,
+      "GET /page%u/index%u.html HTTP/1.1\r\nHost: www%u.example.com\r\nUser-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64)\r\nAccept: */*\r\nConnection: %s\r\n\r\n",
+      flowParam->RequestCount, RandomRange(generatorParam, 1000), flowParam->HostId, flowParam->LongLived == TRUE ? "keep-alive" : "close");
+  }
+  else if (flowParam->RequestCount == 0)
+  {
+    // Record header, handshake header, client version, random, rest as filler
+    payloadLength = 200 + RandomRange(generatorParam, 318);
+    FillStreamData(flowParam, flowParam->ClientSeq, payload, payloadLength);
+    payload[0] = 0x16;
+    payload[1] = 0x03;
+    payload[2] = 0x01;
+    Write16(payload + 3, (unsigned short)(payloadLength - 5));
+    payload[5] = 0x01;
+    payload[6] = 0x00;
+    Write16(payload + 7, (unsigned short)(payloadLength - 9));
+    payload[9] = 0x03;
+    payload[10] = 0x03;
+  }
+  else
+  {
+    payloadLength = FlowNextSegmentSize(generatorParam);
+    payloadLength = payloadLength < 5 ? 5 : payloadLength;
+    FillStreamData(flowParam, flowParam->ClientSeq, payload, payloadLength);
+    payload[0] = 0x17;
+    payload[1] = 0x03;
+    payload[2] = 0x03;
+    Write16(payload + 3, (unsigned short)(payloadLength - 5));
+  }
+
+  retVal = BuildTcpFrame(generatorParam, flowParam, TRUE, flowParam->ClientSeq, flowParam->ServerSeq, TCP_FLAG_PSH | TCP_FLAG_ACK, frameParam, payloadLength);
+  flowParam->ClientSeq += payloadLength;
+  flowParam->RequestCount++;
+  flowParam->SegmentsLeft = 1 + RandomRange(generatorParam, generatorParam->Profile->MaxSegments);
+  flowParam->SegmentsSent = 0;
+
+  return retVal;
+}
+
+
+/*
+ * Server response segments. Every FLOW_ACK_EVERY_SEGMENTS segments the
+ * client acknowledges. With Profile->ReorderPercent probability two
+ * segments are swapped on the wire.
+ *
+ */
+static unsigned int FlowServerData(PFLOW_GENERATOR generatorParam, PFLOW flowParam, unsigned char *frameParam)
+{
+  unsigned char *payload = frameParam + sizeof(ETHDR) + sizeof(IPHDR) + sizeof(TCPHDR);
+  unsigned int firstLength = 0;
+  unsigned int secondLength = 0;
+  unsigned int headerLength = 0;
+  unsigned int retVal = 0;
+  uint32_t ack = 0;
+  char header[MAX_BUF_SIZE];
+
+  if (flowParam->UnackedSegments >= FLOW_ACK_EVERY_SEGMENTS)
+  {
+    // Only what arrived in order can be acknowledged
+    ack = flowParam->HeldLength > 0 ? flowParam->HeldSeq : flowParam->ServerSeq;
+    flowParam->UnackedSegments = 0;
+    return BuildTcpFrame(generatorParam, flowParam, TRUE, flowParam->ClientSeq, ack, TCP_FLAG_ACK, frameParam, 0);
+  }
+
+  // Swapped segment that is still missing
+  if (flowParam->HeldLength > 0)
+  {
+    FillStreamData(flowParam, flowParam->HeldSeq, payload, flowParam->HeldLength);
+    retVal = BuildTcpFrame(generatorParam, flowParam, FALSE, flowParam->HeldSeq, flowParam->ClientSeq, TCP_FLAG_ACK, frameParam, flowParam->HeldLength);
+    flowParam->HeldLength = 0;
+    flowParam->UnackedSegments++;
+  }
+  else if (flowParam->SegmentsLeft >= 2 &&
+           flowParam->SegmentsSent > 0 &&
+           RandomRange(generatorParam, 100) < generatorParam->Profile->ReorderPercent)
+  {
+    firstLength = FlowNextSegmentSize(generatorParam);
+    secondLength = FlowNextSegmentSize(generatorParam);
+    FillStreamData(flowParam, flowParam->ServerSeq + firstLength, payload, secondLength);
+    retVal = BuildTcpFrame(generatorParam, flowParam, FALSE, flowParam->ServerSeq + firstLength, flowParam->ClientSeq, TCP_FLAG_ACK, frameParam, secondLength);
+
+    flowParam->HeldSeq = flowParam->ServerSeq;
+    flowParam->HeldLength = firstLength;
+    flowParam->ServerSeq += firstLength + secondLength;
+    flowParam->SegmentsLeft -= 2;
+    flowParam->SegmentsSent += 2;
+    flowParam->UnackedSegments++;
+    generatorParam->ReorderedSegments++;
+  }
+  else
+  {
+    firstLength = FlowNextSegmentSize(generatorParam);
+
+    // The response header goes into the first segment of a HTTP response
+    if (flowParam->SegmentsSent == 0 &&
+        flowParam->Type == FLOW_TYPE_HTTP)
+    {
+      headerLength = (unsigned int)_snprintf(header, sizeof(header) - 1, "HTTP/1.1 200 OK\r\nServer: nginx\r\nContent-Type: text/html\r\nConnection: %s\r\n\r\n",
+        flowParam->LongLived == TRUE ? "keep-alive" : "close");
+      firstLength = firstLength < headerLength ? headerLength : firstLength;
+      FillStreamData(flowParam, flowParam->ServerSeq, payload, firstLength);
+      CopyMemory(payload, header, headerLength);
+    }
+    else
+    {
+      FillStreamData(flowParam, flowParam->ServerSeq, payload, firstLength);
+    }
+
+    retVal = BuildTcpFrame(generatorParam, flowParam, FALSE, flowParam->ServerSeq, flowParam->ClientSeq, TCP_FLAG_ACK | (flowParam->SegmentsLeft == 1 ? TCP_FLAG_PSH : 0), frameParam, firstLength);
+    flowParam->ServerSeq += firstLength;
+    flowParam->SegmentsLeft--;
+    flowParam->SegmentsSent++;
+    flowParam->UnackedSegments++;
+  }
+
+  if (flowParam->SegmentsLeft == 0 &&
+      flowParam->HeldLength == 0)
+  {
+    flowParam->UnackedSegments = 0;
+    flowParam->State = flowParam->LongLived == TRUE ? FLOW_STATE_REQUEST : FLOW_STATE_FIN;
+  }
+
+  return retVal;
+}
+
+
+static unsigned int FlowStepDns(PFLOW_GENERATOR generatorParam, PFLOW flowParam, unsigned char *frameParam)
+{
+  unsigned char *payload = frameParam + sizeof(ETHDR) + sizeof(IPHDR) + sizeof(UDPHDR);
+  unsigned int retVal = 0;
+
+  if (flowParam->State == FLOW_STATE_DNS_QUERY)
+  {
+    retVal = BuildUdpFrame(generatorParam, flowParam, TRUE, frameParam, BuildDnsMessage(flowParam, FALSE, payload));
+    flowParam->State = FLOW_STATE_DNS_RESPONSE;
+  }
+  else if (flowParam->State == FLOW_STATE_DNS_RESPONSE)
+  {
+    retVal = BuildUdpFrame(generatorParam, flowParam, FALSE, frameParam, BuildDnsMessage(flowParam, TRUE, payload));
+    flowParam->State = FLOW_STATE_DONE;
+  }
+
+  return retVal;
+}
+
+
+
+/*
+ * Payload sizes
+ *
+ * IMIX uses the classic 7:4:1 mix of small, medium and full sized
+ * frames (60, 590 and 1514 bytes on the wire).
+ *
+ */
+static unsigned int FlowNextSegmentSize(PFLOW_GENERATOR generatorParam)
+{
+  PTRAFFIC_PROFILE profile = generatorParam->Profile;
+  unsigned int imixValue = 0;
+  unsigned int retVal = 0;
+
+  if (profile->SizeDistribution == SIZE_DIST_FIXED)
+  {
+    retVal = profile->SizeMin;
+  }
+  else if (profile->SizeDistribution == SIZE_DIST_UNIFORM)
+  {
+    retVal = profile->SizeMin + RandomRange(generatorParam, profile->SizeMax - profile->SizeMin + 1);
+  }
+  else
+  {
+    imixValue = RandomRange(generatorParam, 12);
+    retVal = imixValue < 7 ? 6 : imixValue < 11 ? 536 : MAX_TCP_PAYLOAD;
+  }
+
+  if (retVal < 1)
+  {
+    retVal = 1;
+  }
+  else if (retVal > MAX_TCP_PAYLOAD)
+  {
+    retVal = MAX_TCP_PAYLOAD;
+  }
+
+  return retVal;
+}
+
+
+/*
+ * Stream content is a function of the sequence number, so a swapped
+ * segment is rebuilt with exactly the bytes it would have had.
+ *
+ */
+static void FillStreamData(PFLOW flowParam, uint32_t seqParam, unsigned char *bufferParam, unsigned int lengthParam)
+{
+  unsigned int counter = 0;
+  uint32_t offset = 0;
+
+  for (counter = 0; counter < lengthParam; counter++)
+  {
+    offset = seqParam + counter;
+
+    if (flowParam->Type == FLOW_TYPE_HTTP)
+    {
+      bufferParam[counter] = (unsigned char)('a' + offset % 26);
+    }
+    else
+    {
+      bufferParam[counter] = (unsigned char)((offset * 2654435761U) >> 24);
+    }
+  }
+}
+
+
+
+/*
+ * Frame construction. All multi byte fields are written byte by byte
+ * in network order, so the result does not depend on the host. The
+ * checksums are sums of the bytes in memory order and are stored as
+ * they are.
+ *
+ */
+static unsigned int BuildTcpFrame(PFLOW_GENERATOR generatorParam, PFLOW flowParam, BOOL fromClientParam, uint32_t seqParam, uint32_t ackParam, unsigned char flagsParam, unsigned char *frameParam, unsigned int payloadLengthParam)
+{
+  unsigned char *tcpHeader = frameParam + sizeof(ETHDR) + sizeof(IPHDR);
+  unsigned int tcpHeaderLength = sizeof(TCPHDR);
+  unsigned int tcpLength = 0;
+  unsigned short checksum = 0;
+  uint32_t sum = 0;
+
+  if (flagsParam & TCP_FLAG_SYN)
+  {
+    tcpHeaderLength += TCP_MSS_OPTION_LEN;
+  }
+
+  tcpLength = tcpHeaderLength + payloadLengthParam;
+
+  Write16(tcpHeader, fromClientParam == TRUE ? flowParam->ClientPort : flowParam->ServerPort);
+  Write16(tcpHeader + 2, fromClientParam == TRUE ? flowParam->ServerPort : flowParam->ClientPort);
+  Write32(tcpHeader + 4, seqParam);
+  Write32(tcpHeader + 8, (flagsParam & TCP_FLAG_ACK) ? ackParam : 0);
+  tcpHeader[12] = (unsigned char)((tcpHeaderLength / 4) << 4);
+  tcpHeader[13] = flagsParam;
+  Write16(tcpHeader + 14, fromClientParam == TRUE ? 64240 : 65535);
+  Write16(tcpHeader + 16, 0);
+  Write16(tcpHeader + 18, 0);
+
+  // SYN and SYN/ACK announce the MSS, they never carry data
+  if (tcpHeaderLength > sizeof(TCPHDR))
+  {
+    tcpHeader[20] = 2;
+    tcpHeader[21] = TCP_MSS_OPTION_LEN;
+    Write16(tcpHeader + 22, MAX_TCP_PAYLOAD);
+  }
+
+  BuildEthIpHeader(generatorParam, flowParam, fromClientParam, IP_PROTO_TCP, frameParam, tcpLength);
+
+  sum = ChecksumPseudoHeader(0, frameParam + sizeof(ETHDR) + 12, frameParam + sizeof(ETHDR) + 16, IP_PROTO_TCP, (unsigned short)tcpLength);
+  sum = ChecksumAdd(sum, tcpHeader, tcpLength);
+  checksum = ChecksumFold(sum);
+  CopyMemory(tcpHeader + 16, &checksum, sizeof(checksum));
+
+  return sizeof(ETHDR) + sizeof(IPHDR) + tcpLength;
+}
+
+
+static unsigned int BuildUdpFrame(PFLOW_GENERATOR generatorParam, PFLOW flowParam, BOOL fromClientParam, unsigned char *frameParam, unsigned int payloadLengthParam)
+{
+  unsigned char *udpHeader = frameParam + sizeof(ETHDR) + sizeof(IPHDR);
+  unsigned int udpLength = sizeof(UDPHDR) + payloadLengthParam;
+  unsigned short checksum = 0;
+  uint32_t sum = 0;
+
+  Write16(udpHeader, fromClientParam == TRUE ? flowParam->ClientPort : flowParam->ServerPort);
+  Write16(udpHeader + 2, fromClientParam == TRUE ? flowParam->ServerPort : flowParam->ClientPort);
+  Write16(udpHeader + 4, (unsigned short)udpLength);
+  Write16(udpHeader + 6, 0);
+
+  BuildEthIpHeader(generatorParam, flowParam, fromClientParam, IP_PROTO_UDP, frameParam, udpLength);
+
+  sum = ChecksumPseudoHeader(0, frameParam + sizeof(ETHDR) + 12, frameParam + sizeof(ETHDR) + 16, IP_PROTO_UDP, (unsigned short)udpLength);
+  sum = ChecksumAdd(sum, udpHeader, udpLength);
+
+  // 0 means "no checksum" in UDP
+  checksum = ChecksumFold(sum);
+  checksum = checksum == 0 ? 0xffff : checksum;
+  CopyMemory(udpHeader + 6, &checksum, sizeof(checksum));
+
+  return sizeof(ETHDR) + sizeof(IPHDR) + udpLength;
+}
+
+
+static unsigned int BuildEthIpHeader(PFLOW_GENERATOR generatorParam, PFLOW flowParam, BOOL fromClientParam, unsigned char protoParam, unsigned char *frameParam, unsigned int l4LengthParam)
+{
+  PTRAFFIC_PROFILE profile = generatorParam->Profile;
+  unsigned char *ipHeader = frameParam + sizeof(ETHDR);
+  unsigned short checksum = 0;
+
+  // Ethernet: everything is sent to the local (poisoning) system
+  CopyMemory(frameParam, profile->LocalMacBin, BIN_MAC_LEN);
+  CopyMemory(frameParam + BIN_MAC_LEN, fromClientParam == TRUE ? flowParam->ClientMacBin : profile->GatewayMacBin, BIN_MAC_LEN);
+  Write16(frameParam + 12, ETHERTYPE_IP);
+
+  ipHeader[0] = 0x45;
+  ipHeader[1] = 0;
+  Write16(ipHeader + 2, (unsigned short)(sizeof(IPHDR) + l4LengthParam));
+  Write16(ipHeader + 4, generatorParam->NextIpId++);
+  Write16(ipHeader + 6, 0x4000);
+  ipHeader[8] = fromClientParam == TRUE ? 128 : 54;
+  ipHeader[9] = protoParam;
+  Write16(ipHeader + 10, 0);
+  CopyMemory(ipHeader + 12, fromClientParam == TRUE ? flowParam->ClientIpBin : flowParam->ServerIpBin, BIN_IP_LEN);
+  CopyMemory(ipHeader + 16, fromClientParam == TRUE ? flowParam->ServerIpBin : flowParam->ClientIpBin, BIN_IP_LEN);
+  checksum = ChecksumCompute(ipHeader, sizeof(IPHDR));
+  CopyMemory(ipHeader + 10, &checksum, sizeof(checksum));
+
+  return sizeof(ETHDR) + sizeof(IPHDR);
+}
+
+
+/*
+ * A query for www<HostId>.example.com/A and its answer
+ *
+ */
+static unsigned int BuildDnsMessage(PFLOW flowParam, BOOL responseParam, unsigned char *bufferParam)
+{
+  unsigned int offset = 12;
+  char label[16];
+  int labelLength = 0;
+
+  Write16(bufferParam, flowParam->DnsId);
+  Write16(bufferParam + 2, responseParam == TRUE ? 0x8180 : 0x0100);
+  Write16(bufferParam + 4, 1);
+  Write16(bufferParam + 6, responseParam == TRUE ? 1 : 0);
+  Write16(bufferParam + 8, 0);
+  Write16(bufferParam + 10, 0);
+
+  labelLength = _snprintf(label, sizeof(label) - 1, "www%u", flowParam->HostId);
+  bufferParam[offset++] = (unsigned char)labelLength;
+  CopyMemory(bufferParam + offset, label, labelLength);
+  offset += labelLength;
+  bufferParam[offset++] = 7;
+  CopyMemory(bufferParam + offset, "example", 7);
+  offset += 7;
+  bufferParam[offset++] = 3;
+  CopyMemory(bufferParam + offset, "com", 3);
+  offset += 3;
+  bufferParam[offset++] = 0;
+  Write16(bufferParam + offset, 1);
+  Write16(bufferParam + offset + 2, 1);
+  offset += 4;
+
+  if (responseParam == TRUE)
+  {
+    // Name pointer to the question, A, IN, TTL 300, 198.51.100.0/24 address
+    Write16(bufferParam + offset, 0xc00c);
+    Write16(bufferParam + offset + 2, 1);
+    Write16(bufferParam + offset + 4, 1);
+    Write32(bufferParam + offset + 6, 300);
+    Write16(bufferParam + offset + 10, BIN_IP_LEN);
+    bufferParam[offset + 12] = 198;
+    bufferParam[offset + 13] = 51;
+    bufferParam[offset + 14] = 100;
+    bufferParam[offset + 15] = (unsigned char)flowParam->HostId;
+    offset += 16;
+  }
+
+  return offset;
+}
+
+
+static void Write16(unsigned char *bufferParam, unsigned short valueParam)
+{
+  bufferParam[0] = (unsigned char)(valueParam >> 8);
+  bufferParam[1] = (unsigned char)valueParam;
+}
+
+
+static void Write32(unsigned char *bufferParam, uint32_t valueParam)
+{
+  bufferParam[0] = (unsigned char)(valueParam >> 24);
+  bufferParam[1] = (unsigned char)(valueParam >> 16);
+  bufferParam[2] = (unsigned char)(valueParam >> 8);
+  bufferParam[3] = (unsigned char)valueParam;
+}
+
+
+
+/*
+ * xorshift64*
+ *
+ */
+static uint64_t RandomNext(PFLOW_GENERATOR generatorParam)
+{
+  generatorParam->RandomState ^= generatorParam->RandomState >> 12;
+  generatorParam->RandomState ^= generatorParam->RandomState << 25;
+  generatorParam->RandomState ^= generatorParam->RandomState >> 27;
+
+  return generatorParam->RandomState * 0x2545f4914f6cdd1dULL;
+}
+
+
+static unsigned int RandomRange(PFLOW_GENERATOR generatorParam, unsigned int rangeParam)
+{
+  if (rangeParam == 0)
+  {
+    return 0;
+  }
+
+  return (unsigned int)((RandomNext(generatorParam) >> 32) % rangeParam);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Platform.h"
+#include "TrafficGenerator.h"
+
+/*
+ * Deterministic flow model.
+ *
+ * FlowCount flows are active at any time. Every call to
+ * FlowGeneratorNextFrame() picks one of them at random and builds its
+ * next frame. Finished flows are replaced by new ones in the same slot,
+ * long-lived flows keep sending requests until the corpus is complete.
+ * All randomness comes from one xorshift generator seeded with
+ * Profile->Seed, so the same profile always yields the same file.
+ *
+ * Client to server frames are addressed from the client MAC to
+ * Profile->LocalMacBin, server to client frames from
+ * Profile->GatewayMacBin to Profile->LocalMacBin. This is what an
+ * ARP poisoning host sees on the wire.
+ *
+ */
+
+// Flow states
+#define FLOW_STATE_SYN 0
+#define FLOW_STATE_SYNACK 1
+#define FLOW_STATE_ACK 2
+#define FLOW_STATE_REQUEST 3
+#define FLOW_STATE_DATA 4
+#define FLOW_STATE_FIN 5
+#define FLOW_STATE_FINACK 6
+#define FLOW_STATE_LASTACK 7
+#define FLOW_STATE_DNS_QUERY 8
+#define FLOW_STATE_DNS_RESPONSE 9
+#define FLOW_STATE_DONE 10
+
+#define FLOW_ACK_EVERY_SEGMENTS 2
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  int Type;
+  int State;
+  BOOL LongLived;
+  unsigned char ClientIpBin[BIN_IP_LEN];
+  unsigned char ClientMacBin[BIN_MAC_LEN];
+  unsigned char ServerIpBin[BIN_IP_LEN];
+  unsigned short ClientPort;
+  unsigned short ServerPort;
+  uint32_t ClientSeq;
+  uint32_t ServerSeq;
+  unsigned int SegmentsLeft;
+  unsigned int SegmentsSent;
+  unsigned int UnackedSegments;
+  unsigned int RequestCount;
+  uint32_t HeldSeq;
+  unsigned int HeldLength;
+  unsigned int HostId;
+  unsigned short DnsId;
+} FLOW, *PFLOW;
+
+
+typedef struct
+{
+  PTRAFFIC_PROFILE Profile;
+  PFLOW Flows;
+  uint64_t RandomState;
+  uint64_t TimestampNs;
+  uint64_t FlowsStarted;
+  uint64_t ReorderedSegments;
+  unsigned short NextClientPort;
+  unsigned short NextIpId;
+} FLOW_GENERATOR, *PFLOW_GENERATOR;
+
+
+/*
+ * Function forward declarations.
+ *
+ */
+BOOL FlowGeneratorInit(PFLOW_GENERATOR generatorParam, PTRAFFIC_PROFILE profileParam);
+unsigned int FlowGeneratorNextFrame(PFLOW_GENERATOR generatorParam, unsigned char *frameParam, uint64_t *timestampUsParam);
+void FlowGeneratorRelease(PFLOW_GENERATOR generatorParam);
+void FlowGeneratorClientAddress(unsigned int clientIndexParam, unsigned char ipParam[BIN_IP_LEN], unsigned char macParam[BIN_MAC_LEN]);
@@ -0,0 +1,102 @@
+#include <stdio.h>
+
+#include "PcapWriter.h"
+
+
+// On-disk layouts, all fields in host byte order
+typedef struct
+{
+  uint32_t Magic;
+  uint16_t VersionMajor;
+  uint16_t VersionMinor;
+  int32_t ThisZone;
+  uint32_t SigFigs;
+  uint32_t SnapLen;
+  uint32_t LinkType;
+} PCAP_FILE_HEADER;
+
+
+typedef struct
+{
+  uint32_t TsSec;
+  uint32_t TsUsec;
+  uint32_t CapLen;
+  uint32_t Len;
+} PCAP_RECORD_HEADER;
+
+
+
+BOOL PcapWriterOpen(PPCAP_WRITER writerParam, char *filePathParam)
+{
+  BOOL retVal = FALSE;
+  PCAP_FILE_HEADER fileHeader;
+
+  ZeroMemory(writerParam, sizeof(PCAP_WRITER));
+  ZeroMemory(&fileHeader, sizeof(fileHeader));
+
+  if ((writerParam->FileHandle = fopen(filePathParam, "wb")) == NULL)
+  {
+    goto END;
+  }
+
+  fileHeader.Magic = PCAP_MAGIC_MICROSECONDS;
+  fileHeader.VersionMajor = PCAP_VERSION_MAJOR;
+  fileHeader.VersionMinor = PCAP_VERSION_MINOR;
+  fileHeader.SnapLen = PCAP_SNAPLEN;
+  fileHeader.LinkType = PCAP_LINKTYPE_ETHERNET;
+
+  if (fwrite(&fileHeader, sizeof(fileHeader), 1, writerParam->FileHandle) != 1)
+  {
+    goto END;
+  }
+
+  retVal = TRUE;
+
+END:
+
+  if (retVal == FALSE)
+  {
+    PcapWriterClose(writerParam);
+  }
+
+  return retVal;
+}
+
+
+BOOL PcapWriterWriteFrame(PPCAP_WRITER writerParam, uint64_t timestampUsParam, unsigned char *frameParam, unsigned int frameLengthParam)
+{
+  PCAP_RECORD_HEADER recordHeader;
+
+  if (writerParam->FileHandle == NULL ||
+      frameParam == NULL ||
+      frameLengthParam > PCAP_SNAPLEN)
+  {
+    return FALSE;
+  }
+
+  recordHeader.TsSec = (uint32_t)(timestampUsParam / 1000000);
+  recordHeader.TsUsec = (uint32_t)(timestampUsParam % 1000000);
+  recordHeader.CapLen = frameLengthParam;
+  recordHeader.Len = frameLengthParam;
+
+  if (fwrite(&recordHeader, sizeof(recordHeader), 1, writerParam->FileHandle) != 1 ||
+      fwrite(frameParam, frameLengthParam, 1, writerParam->FileHandle) != 1)
+  {
+    return FALSE;
+  }
+
+  writerParam->PacketsWritten++;
+  writerParam->BytesWritten += frameLengthParam;
+
+  return TRUE;
+}
+
+
+void PcapWriterClose(PPCAP_WRITER writerParam)
+{
+  if (writerParam->FileHandle != NULL)
+  {
+    fclose(writerParam->FileHandle);
+    writerParam->FileHandle = NULL;
+  }
+}
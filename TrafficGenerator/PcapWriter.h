@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Platform.h"
+
+/*
+ * Writer for classic pcap files (magic 0xa1b2c3d4, microsecond
+ * timestamps, LINKTYPE_ETHERNET) in host byte order. This is the
+ * format CaptureOpenReplay() and pcap_open_offline() read, so no
+ * pcap library is needed to produce a corpus.
+ *
+ */
+#define PCAP_MAGIC_MICROSECONDS 0xa1b2c3d4
+#define PCAP_VERSION_MAJOR 2
+#define PCAP_VERSION_MINOR 4
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_SNAPLEN 65535
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  FILE *FileHandle;
+  uint64_t PacketsWritten;
+  uint64_t BytesWritten;
+} PCAP_WRITER, *PPCAP_WRITER;
+
+
+/*
+ * Function forward declarations.
+ *
+ */
+BOOL PcapWriterOpen(PPCAP_WRITER writerParam, char *filePathParam);
+BOOL PcapWriterWriteFrame(PPCAP_WRITER writerParam, uint64_t timestampUsParam, unsigned char *frameParam, unsigned int frameLengthParam);
+void PcapWriterClose(PPCAP_WRITER writerParam);
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TrafficGenerator.h"
+#include "FlowGenerator.h"
+#include "getopt.h"
+#include "PcapWriter.h"
+
+
+extern char *optarg;
+
+
+static BOOL ParseMix(char *inputParam, PTRAFFIC_PROFILE profileParam);
+static BOOL ParseSizeDistribution(char *inputParam, PTRAFFIC_PROFILE profileParam);
+static BOOL ParseMac(char *inputParam, unsigned char macParam[BIN_MAC_LEN]);
+static BOOL WriteTargetHostsFile(PTRAFFIC_PROFILE profileParam);
+static int GenerateCorpus(PTRAFFIC_PROFILE profileParam);
+
+
+int main(int argc, char* argv[])
+{
+  int retVal = 0;
+  int opt = 0;
+  TRAFFIC_PROFILE profile;
+
+  ZeroMemory(&profile, sizeof(profile));
+  profile.PacketCount = DEFAULT_PACKET_COUNT;
+  profile.Seed = DEFAULT_SEED;
+  profile.FlowCount = DEFAULT_FLOW_COUNT;
+  profile.ClientCount = DEFAULT_CLIENT_COUNT;
+  profile.ServerCount = DEFAULT_SERVER_COUNT;
+  profile.PacketsPerSecond = DEFAULT_PPS;
+  profile.MixHttp = DEFAULT_MIX_HTTP;
+  profile.MixDns = DEFAULT_MIX_DNS;
+  profile.MixTls = DEFAULT_MIX_TLS;
+  profile.ReorderPercent = DEFAULT_REORDER_PERCENT;
+  profile.LongLivedPercent = DEFAULT_LONGLIVED_PERCENT;
+  profile.MaxSegments = DEFAULT_MAX_SEGMENTS;
+  profile.SizeDistribution = SIZE_DIST_IMIX;
+  ParseMac("02:00:00:00:00:fe", profile.LocalMacBin);
+  ParseMac("02:00:00:00:00:01", profile.GatewayMacBin);
+
+  // Parse command line parameters
+  while ((opt = getopt(argc, argv, "o:n:f:c:S:s:m:z:r:L:M:p:a:g:t:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'o':
+        strncpy(profile.OutputFile, optarg, sizeof(profile.OutputFile) - 1);
+        break;
+      case 'n':
+        profile.PacketCount = strtoull(optarg, NULL, 10);
+        break;
+      case 'f':
+        profile.FlowCount = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'c':
+        profile.ClientCount = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'S':
+        profile.ServerCount = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        profile.Seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'm':
+        if (ParseMix(optarg, &profile) == FALSE)
+        {
+          printf("Invalid protocol mix \"%s\"\n", optarg);
+          retVal = 1;
+          goto END;
+        }
+        break;
+      case 'z':
+        if (ParseSizeDistribution(optarg, &profile) == FALSE)
+        {
+          printf("Invalid size distribution \"%s\"\n", optarg);
+          retVal = 1;
+          goto END;
+        }
+        break;
+      case 'r':
+        profile.ReorderPercent = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'L':
+        profile.LongLivedPercent = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'M':
+        profile.MaxSegments = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'p':
+        profile.PacketsPerSecond = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'a':
+      case 'g':
+        if (ParseMac(optarg, opt == 'a' ? profile.LocalMacBin : profile.GatewayMacBin) == FALSE)
+        {
+          printf("Invalid MAC address \"%s\"\n", optarg);
+          retVal = 1;
+          goto END;
+        }
+        break;
+      case 't':
+        strncpy(profile.TargetHostsFile, optarg, sizeof(profile.TargetHostsFile) - 1);
+        break;
+      default:
+        PrintUsage(argv[0]);
+        retVal = 1;
+        goto END;
+    }
+  }
+
+  if (profile.OutputFile[0] == '\0' ||
+      profile.PacketCount == 0 ||
+      profile.FlowCount == 0 || profile.FlowCount > MAX_FLOW_COUNT ||
+      profile.ClientCount == 0 || profile.ClientCount > MAX_CLIENT_COUNT ||
+      profile.ServerCount == 0 || profile.ServerCount > MAX_SERVER_COUNT ||
+      profile.PacketsPerSecond == 0 ||
+      profile.ReorderPercent > 100 ||
+      profile.LongLivedPercent > 100 ||
+      profile.MaxSegments == 0)
+  {
+    PrintUsage(argv[0]);
+    retVal = 1;
+    goto END;
+  }
+
+  if (profile.TargetHostsFile[0] != '\0' &&
+      WriteTargetHostsFile(&profile) == FALSE)
+  {
+    printf("Unable to write %s\n", profile.TargetHostsFile);
+    retVal = 1;
+    goto END;
+  }
+
+  retVal = GenerateCorpus(&profile);
+
+END:
+
+  return retVal;
+}
+
+
+void PrintUsage(char *appNameParam)
+{
+  printf("TrafficGenerator  Version %s\n", TRAFFICGENERATOR_VERSION);
+  printf("-----------------------------\n\n");
+  printf("Write a synthetic pcap corpus    :  %s -o corpus.pcap [options]\n\n", appNameParam);
+  printf("  -n packets          Packets to write (default %d)\n", DEFAULT_PACKET_COUNT);
+  printf("  -f flows            Concurrently active flows (default %d, max %d)\n", DEFAULT_FLOW_COUNT, MAX_FLOW_COUNT);
+  printf("  -c clients          Client systems in 192.168.0.0/16 (default %d, max %d)\n", DEFAULT_CLIENT_COUNT, MAX_CLIENT_COUNT);
+  printf("  -S servers          Server systems in 198.18.0.0/15 (default %d, max %d)\n", DEFAULT_SERVER_COUNT, MAX_SERVER_COUNT);
+  printf("  -s seed             Random seed, same seed same file (default %d)\n", DEFAULT_SEED);
+  printf("  -m http,dns,tls     Flow mix weights (default %d,%d,%d)\n", DEFAULT_MIX_HTTP, DEFAULT_MIX_DNS, DEFAULT_MIX_TLS);
+  printf("  -z distribution     Data segment sizes: imix, fixed:N or uniform:MIN-MAX (default imix)\n");
+  printf("  -r percent          Out of order data segments (default %d)\n", DEFAULT_REORDER_PERCENT);
+  printf("  -L percent          Long-lived TCP flows (default %d)\n", DEFAULT_LONGLIVED_PERCENT);
+  printf("  -M segments         Max. response segments per request (default %d)\n", DEFAULT_MAX_SEGMENTS);
+  printf("  -p pps              Packet rate for the timestamps (default %d)\n", DEFAULT_PPS);
+  printf("  -a MAC              Local (poisoning) system MAC, destination of all frames\n");
+  printf("  -g MAC              Gateway MAC, source of all server frames\n");
+  printf("  -t file             Also write the clients as .targethosts file\n");
+  printf("\n\n\nExamples\n--------\n\n");
+  printf("Example : %s -o corpus.pcap\n", appNameParam);
+  printf("Example : %s -o flows50k.pcap -n 5000000 -f 50000 -c 2000 -m 60,20,20 -t .targethosts\n", appNameParam);
+  printf("Example : %s -o small.pcap -z fixed:64 -r 5 -s 42\n\n", appNameParam);
+}
+
+
+
+static int GenerateCorpus(PTRAFFIC_PROFILE profileParam)
+{
+  int retVal = 0;
+  uint64_t counter = 0;
+  uint64_t timestamp = 0;
+  unsigned int frameLength = 0;
+  unsigned char frame[MAX_FRAME_SIZE];
+  FLOW_GENERATOR generator;
+  PCAP_WRITER writer;
+
+  ZeroMemory(&generator, sizeof(generator));
+  ZeroMemory(&writer, sizeof(writer));
+
+  if (FlowGeneratorInit(&generator, profileParam) == FALSE)
+  {
+    printf("Unable to allocate %u flows\n", profileParam->FlowCount);
+    retVal = 1;
+    goto END;
+  }
+
+  if (PcapWriterOpen(&writer, profileParam->OutputFile) == FALSE)
+  {
+    printf("Unable to create %s\n", profileParam->OutputFile);
+    retVal = 1;
+    goto END;
+  }
+
+  for (counter = 0; counter < profileParam->PacketCount; counter++)
+  {
+    frameLength = FlowGeneratorNextFrame(&generator, frame, &timestamp);
+
+    if (PcapWriterWriteFrame(&writer, timestamp, frame, frameLength) == FALSE)
+    {
+      printf("Unable to write to %s\n", profileParam->OutputFile);
+      retVal = 1;
+      goto END;
+    }
+  }
+
+  printf("%s\n", profileParam->OutputFile);
+  printf("  packets      : %llu (%llu bytes)\n", (unsigned long long)writer.PacketsWritten, (unsigned long long)writer.BytesWritten);
+  printf("  flows        : %llu started, %u active at a time\n", (unsigned long long)generator.FlowsStarted, profileParam->FlowCount);
+  printf("  out of order : %llu segment pairs\n", (unsigned long long)generator.ReorderedSegments);
+
+END:
+
+  PcapWriterClose(&writer);
+  FlowGeneratorRelease(&generator);
+
+  return retVal;
+}
+
+
+static BOOL ParseMix(char *inputParam, PTRAFFIC_PROFILE profileParam)
+{
+  unsigned int http = 0;
+  unsigned int dns = 0;
+  unsigned int tls = 0;
+
+  if (sscanf(inputParam, "%u,%u,%u", &http, &dns, &tls) != 3 ||
+      http + dns + tls == 0)
+  {
+    return FALSE;
+  }
+
+  profileParam->MixHttp = http;
+  profileParam->MixDns = dns;
+  profileParam->MixTls = tls;
+
+  return TRUE;
+}
+
+
+static BOOL ParseSizeDistribution(char *inputParam, PTRAFFIC_PROFILE profileParam)
+{
+  unsigned int sizeMin = 0;
+  unsigned int sizeMax = 0;
+
+  if (strcmp(inputParam, "imix") == 0)
+  {
+    profileParam->SizeDistribution = SIZE_DIST_IMIX;
+  }
+  else if (sscanf(inputParam, "fixed:%u", &sizeMin) == 1)
+  {
+    profileParam->SizeDistribution = SIZE_DIST_FIXED;
+    profileParam->SizeMin = sizeMin;
+    profileParam->SizeMax = sizeMin;
+  }
+  else if (sscanf(inputParam, "uniform:%u-%u", &sizeMin, &sizeMax) == 2 &&
+           sizeMin <= sizeMax)
+  {
+    profileParam->SizeDistribution = SIZE_DIST_UNIFORM;
+    profileParam->SizeMin = sizeMin;
+    profileParam->SizeMax = sizeMax;
+  }
+  else
+  {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static BOOL ParseMac(char *inputParam, unsigned char macParam[BIN_MAC_LEN])
+{
+  if (sscanf(inputParam, "%02hhX:%02hhX:%02hhX:%02hhX:%02hhX:%02hhX", &macParam[0], &macParam[1], &macParam[2], &macParam[3], &macParam[4], &macParam[5]) != 6 &&
+      sscanf(inputParam, "%02hhX-%02hhX-%02hhX-%02hhX-%02hhX-%02hhX", &macParam[0], &macParam[1], &macParam[2], &macParam[3], &macParam[4], &macParam[5]) != 6)
+  {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * One "IP,MAC" line per client, the format RouterIPv4 reads
+ * from .targethosts
+ *
+ */
+static BOOL WriteTargetHostsFile(PTRAFFIC_PROFILE profileParam)
+{
+  BOOL retVal = FALSE;
+  FILE *fileHandle = NULL;
+  unsigned int counter = 0;
+  unsigned char ipBin[BIN_IP_LEN];
+  unsigned char macBin[BIN_MAC_LEN];
+
+  if ((fileHandle = fopen(profileParam->TargetHostsFile, "w")) == NULL)
+  {
+    goto END;
+  }
+
+  for (counter = 0; counter < profileParam->ClientCount; counter++)
+  {
+    FlowGeneratorClientAddress(counter, ipBin, macBin);
+    fprintf(fileHandle, "%d.%d.%d.%d,%02X:%02X:%02X:%02X:%02X:%02X\n", ipBin[0], ipBin[1], ipBin[2], ipBin[3],
+      macBin[0], macBin[1], macBin[2], macBin[3], macBin[4], macBin[5]);
+  }
+
+  retVal = TRUE;
+
+END:
+
+  if (fileHandle != NULL)
+  {
+    fclose(fileHandle);
+  }
+
+  return retVal;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "NetworkStructs.h"
+
+#define TRAFFICGENERATOR_VERSION "0.1"
+
+#define MAX_BUF_SIZE 1024
+#define MAX_FRAME_SIZE 1514
+#define MAX_TCP_PAYLOAD 1460
+#define MAX_FLOW_COUNT 1000000
+#define MAX_CLIENT_COUNT (253 * 256)
+#define MAX_SERVER_COUNT (2 * 65536)
+
+// Defaults
+#define DEFAULT_PACKET_COUNT 1000000
+#define DEFAULT_FLOW_COUNT 10000
+#define DEFAULT_CLIENT_COUNT 253
+#define DEFAULT_SERVER_COUNT 4096
+#define DEFAULT_SEED 1
+#define DEFAULT_PPS 100000
+#define DEFAULT_MIX_HTTP 50
+#define DEFAULT_MIX_DNS 30
+#define DEFAULT_MIX_TLS 20
+#define DEFAULT_REORDER_PERCENT 1
+#define DEFAULT_LONGLIVED_PERCENT 2
+#define DEFAULT_MAX_SEGMENTS 16
+
+// Packet size distributions
+#define SIZE_DIST_IMIX 0
+#define SIZE_DIST_FIXED 1
+#define SIZE_DIST_UNIFORM 2
+
+// Flow types
+#define FLOW_TYPE_HTTP 0
+#define FLOW_TYPE_DNS 1
+#define FLOW_TYPE_TLS 2
+
+
+/*
+ * Type definitions
+ *
+ */
+typedef struct
+{
+  char OutputFile[MAX_BUF_SIZE + 1];
+  char TargetHostsFile[MAX_BUF_SIZE + 1];
+  uint64_t PacketCount;
+  uint64_t Seed;
+  unsigned int FlowCount;
+  unsigned int ClientCount;
+  unsigned int ServerCount;
+  unsigned int PacketsPerSecond;
+  unsigned int MixHttp;
+  unsigned int MixDns;
+  unsigned int MixTls;
+  unsigned int ReorderPercent;
+  unsigned int LongLivedPercent;
+  unsigned int MaxSegments;
+  int SizeDistribution;
+  unsigned int SizeMin;
+  unsigned int SizeMax;
+  unsigned char LocalMacBin[BIN_MAC_LEN];
+  unsigned char GatewayMacBin[BIN_MAC_LEN];
+} TRAFFIC_PROFILE, *PTRAFFIC_PROFILE;
+
+
+/*
+ * Function forward declarations.
+ *
+ */
+void PrintUsage(char *appNameParam);